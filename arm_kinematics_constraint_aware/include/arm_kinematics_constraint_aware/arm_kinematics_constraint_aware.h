@@ -60,6 +60,7 @@
 // plugin
 #include <pluginlib/class_loader.h>
 #include <kinematics_base/kinematics_base.h>
+#include <kinematics_base/kinematics_solver_selector.h>
 #include <arm_kinematics_constraint_aware/arm_kinematics_solver_constraint_aware.h>
 
 
@@ -81,6 +82,15 @@ public:
    */
   ArmKinematicsConstraintAware();
 
+  /**
+   * @brief Construct the kinematics node in the given namespace so it can be
+   * embedded in another process. The kinematics services are still advertised
+   * for external callers, but in-process consumers should invoke the public
+   * request/response methods below directly - they take the messages by
+   * reference, so a direct call pays no serialization or transport cost.
+   */
+  ArmKinematicsConstraintAware(const std::string& ns);
+
   virtual ~ArmKinematicsConstraintAware()
   {
     if (collision_models_interface_)
@@ -128,13 +138,19 @@ private:
   void printStringVec(const std::string &prefix, const std::vector<std::string> &string_vector);
   ros::Publisher display_trajectory_publisher_;
   bool visualize_solution_;
+  bool kinematics_only_;
 
+  void initialize();
   void advertiseBaseKinematicsServices();
   void advertiseConstraintIKService();
 
   bool isReady(arm_navigation_msgs::ArmNavigationErrorCodes &error_code);
   void sendEndEffectorPose(const planning_models::KinematicState* state, bool valid);
 
+  /// random in-limit joint configurations for the solver selector's
+  /// startup micro-benchmark
+  std::vector<std::vector<double> > sampleGroupConfigurations(unsigned int count) const;
+
   kinematics_msgs::KinematicSolverInfo chain_info_;
 
 };
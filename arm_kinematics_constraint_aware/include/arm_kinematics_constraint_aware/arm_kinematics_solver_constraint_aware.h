@@ -55,6 +55,30 @@ public:
     return active_;
   }
 
+  /**
+     @brief Rejection-sampling statistics for the most recent
+     constraint-aware solve: how many IK solutions the solver produced,
+     how many were rejected and why, and where the time went. Lets a
+     caller distinguish "IK cannot reach the pose" from "every reachable
+     solution is in collision" and adapt its retry strategy.
+  */
+  struct SolveStats {
+    SolveStats() : solutions_found(0),
+                   rejected_in_collision(0),
+                   rejected_by_constraints(0),
+                   solver_time(0.0),
+                   constraint_check_time(0.0) {}
+    unsigned int solutions_found;
+    unsigned int rejected_in_collision;
+    unsigned int rejected_by_constraints;
+    double solver_time;
+    double constraint_check_time;
+  };
+
+  const SolveStats& getLastSolveStats() const {
+    return last_solve_stats_;
+  }
+
   bool getPositionFK(const planning_models::KinematicState* robot_state,
                      const std::vector<std::string>& link_names,
                      std::vector<geometry_msgs::Pose> &poses);
@@ -71,6 +95,23 @@ public:
                                    arm_navigation_msgs::ArmNavigationErrorCodes& error_code,
                                    const bool& do_initial_pose_check = true);
   
+  /**
+     @brief Validate a batch of IK candidates for one pose in a single
+     collision session. The scene lock is held once for the whole batch,
+     the joint values are applied through the group handle so only the
+     group's links run forward kinematics per candidate, and the initial
+     pose check runs once for the pose instead of once per candidate.
+     Pairs with the batch solve APIs that return every solution for a
+     pose. error_codes[i] receives the per-candidate verdict.
+     @return the index of the first valid candidate, or -1 if none pass
+  */
+  int validateIKCandidates(const geometry_msgs::Pose& pose,
+                           const arm_navigation_msgs::Constraints& constraints,
+                           planning_models::KinematicState* robot_state,
+                           const std::vector<std::vector<double> >& candidates,
+                           std::vector<int>& error_codes,
+                           const bool& do_initial_pose_check = true);
+
   bool findConsistentConstraintAwareSolution(const geometry_msgs::Pose& pose,
                                              const arm_navigation_msgs::Constraints& constraints,
                                              planning_models::KinematicState* robot_state,
@@ -80,6 +121,27 @@ public:
                                              const double& max_consistency,
                                              const bool& do_initial_pose_check = true);
 
+  /**
+     @brief Solve IK for a sequence of Cartesian waypoints, seeding each
+     solve from the previous waypoint's solution and failing fast when
+     any joint jumps by more than max_joint_delta between consecutive
+     waypoints. Warm seeds mean the solver rarely needs a restart, and
+     jumpy configuration flips are rejected at the waypoint where they
+     happen instead of being filtered out of a finished trajectory.
+     Continuous joints are compared by shortest angular distance.
+     @return true if every waypoint solved continuously; traj then holds
+     one point per pose. On failure error_code carries the verdict for
+     the first waypoint that could not be solved (INVALID_TRAJECTORY for
+     a discontinuity).
+  */
+  bool solveCartesianPath(const std::vector<geometry_msgs::Pose>& poses,
+                          const double& max_joint_delta,
+                          const arm_navigation_msgs::Constraints& constraints,
+                          planning_models::KinematicState* robot_state,
+                          trajectory_msgs::JointTrajectory& traj,
+                          arm_navigation_msgs::ArmNavigationErrorCodes& error_code,
+                          const bool& do_initial_pose_check = true);
+
   bool interpolateIKDirectional(const geometry_msgs::Pose& start_pose,
                                 const tf::Vector3& direction,
                                 const double& distance,
@@ -148,6 +210,7 @@ protected:
   bool do_initial_pose_check_;
   planning_models::KinematicState* state_;
   arm_navigation_msgs::Constraints constraints_;
+  SolveStats last_solve_stats_;
 
   void collisionCheck(const geometry_msgs::Pose &ik_pose,
                       const std::vector<double> &ik_solution,
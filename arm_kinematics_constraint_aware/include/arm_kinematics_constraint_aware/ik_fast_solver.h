@@ -8,6 +8,17 @@ public:
   virtual int solve(KDL::Frame &pose_frame, const std::vector<double> &ik_seed_state) = 0;
   virtual void getSolution(int i, std::vector<double> &solution) = 0;
   virtual void getClosestSolution(const std::vector<double> &ik_seed_state, std::vector<double> &solution) = 0;
+  //solve a batch of poses into a caller-provided flat buffer, numJoints
+  //doubles per kept solution; joint_min/joint_max filter solutions in
+  //place (use infinite bounds for unlimited joints). Returns the total
+  //number of doubles written, or -1 if the buffer ran out
+  virtual int solveBatch(const std::vector<KDL::Frame> &pose_frames,
+                         const std::vector<double> &vfree,
+                         const double *joint_min,
+                         const double *joint_max,
+                         double *solution_buffer,
+                         int buffer_capacity,
+                         std::vector<int> &solution_counts) = 0;
 };
 template <class  T> class ikfast_solver: public ik_solver_base{
 public:
@@ -41,6 +52,47 @@ public:
       
     return solutions.size();
   }
+  //variant writing straight into a raw buffer of numJoints doubles; the
+  //free-parameter scratch is reused so nothing is allocated per solution
+  void getSolution(int i, double *solution){
+    free_scratch.resize(solutions[i].GetFree().size());
+    solutions[i].GetSolution(solution,free_scratch.size()>0?&free_scratch[0]:NULL);
+  }
+  virtual int solveBatch(const std::vector<KDL::Frame> &pose_frames,
+                         const std::vector<double> &vfree,
+                         const double *joint_min,
+                         const double *joint_max,
+                         double *solution_buffer,
+                         int buffer_capacity,
+                         std::vector<int> &solution_counts){
+    solution_counts.resize(pose_frames.size());
+    int written = 0;
+    for(size_t p=0; p<pose_frames.size(); ++p){
+      KDL::Frame pose_frame = pose_frames[p];
+      solve(pose_frame,vfree);
+      int count = 0;
+      for(size_t s=0; s<solutions.size(); ++s){
+        if(written+numJoints > buffer_capacity)
+          return -1;
+        double *out = solution_buffer+written;
+        getSolution(s,out);
+        bool obeys_limits = true;
+        for(int j=0; j<numJoints; ++j){
+          if(out[j] < joint_min[j] || out[j] > joint_max[j]){
+            obeys_limits = false;
+            break;
+          }
+        }
+        //a rejected solution is overwritten by the next one in place
+        if(obeys_limits){
+          written += numJoints;
+          ++count;
+        }
+      }
+      solution_counts[p] = count;
+    }
+    return written;
+  }
   virtual void getSolution(int i, std::vector<double> &solution){
     solution.clear();
     std::vector<IKReal> vsolfree(solutions[i].GetFree().size());
@@ -135,6 +187,7 @@ public:
 private:
   ik_type ik;
   std::vector<T> solutions;
+  std::vector<IKReal> free_scratch;
   int numJoints;
 };
 }
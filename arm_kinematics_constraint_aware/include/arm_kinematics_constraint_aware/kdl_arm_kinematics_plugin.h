@@ -46,6 +46,8 @@
 
 // System
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
 #include <algorithm>
 #include <numeric>
 #include <cstring>
@@ -66,6 +68,8 @@
 #include <kdl/chainiksolverpos_nr_jl.hpp>
 #include <kdl/chainiksolvervel_pinv.hpp>
 #include <kdl/chainfksolverpos_recursive.hpp>
+#include <kdl/chainjnttojacsolver.hpp>
+#include <kdl/jacobian.hpp>
 
 // MISC
 #include <angles/angles.h>
@@ -202,17 +206,51 @@ class KDLArmKinematicsPlugin : public kinematics::KinematicsBase
     int getJointIndex(const std::string &name);
     int getKDLSegmentIndex(const std::string &name);
     double genRandomNumber(const double &min, const double &max);
+    double genRandomNumber(unsigned int &rng_state, const double &min, const double &max);
     KDL::JntArray getRandomConfiguration();
+    KDL::JntArray getRandomConfiguration(unsigned int &rng_state);
     KDL::JntArray getRandomConfiguration(const KDL::JntArray& seed_state,
                                          const unsigned int& redundancy,
                                          const double& consistency_limit);
 
     bool checkConsistency(const KDL::JntArray& seed_state,
                           const unsigned int& redundancy,
-                          const double& consistency_limit, 
+                          const double& consistency_limit,
                           const KDL::JntArray& solution) const;
 
+    /**
+     * @brief Yoshikawa manipulability measure sqrt(det(J*J^T)) at the
+     * given configuration; 0.0 if the Jacobian cannot be computed
+     */
+    double computeManipulability(KDL::ChainJntToJacSolver& jac_solver,
+                                 const KDL::JntArray& jnt_array) const;
+
+    /**
+     * @brief Draw a random restart seed, redrawing a bounded number of
+     * times when the seed lands in a region the Jacobian marks as
+     * near-singular; restarts started there tend to converge into the
+     * same singular basin and are wasted. Returns the best draw seen
+     * if every draw scores below the threshold.
+     */
+    KDL::JntArray getScreenedRandomConfiguration(KDL::ChainJntToJacSolver& jac_solver);
+    KDL::JntArray getScreenedRandomConfiguration(KDL::ChainJntToJacSolver& jac_solver,
+                                                 unsigned int &rng_state);
+
+    /**
+     * @brief Run the random restarts concurrently, one worker per solver
+     * set in the pool; the first worker to converge cancels the rest.
+     * @return True if any worker found a solution, false otherwise
+     */
+    bool searchPositionIKParallel(const KDL::Frame &pose_desired,
+                                  const KDL::JntArray &jnt_seed_state,
+                                  std::vector<double> &solution);
+
+    void searchPositionIKThread(unsigned int thread_index,
+                                const KDL::Frame &pose_desired,
+                                const KDL::JntArray &jnt_seed_state);
+
     int max_search_iterations_;
+    int parallel_search_threads_;
 
     bool active_;
     kinematics_msgs::KinematicSolverInfo chain_info_;
@@ -220,6 +258,48 @@ class KDLArmKinematicsPlugin : public kinematics::KinematicsBase
     boost::shared_ptr<KDL::ChainIkSolverVel_pinv> ik_solver_vel_;
     boost::shared_ptr<KDL::ChainFkSolverPos_recursive> fk_solver_;
     boost::shared_ptr<KDL::ChainIkSolverPos_NR_JL> ik_solver_pos_;
+    boost::shared_ptr<KDL::ChainJntToJacSolver> jac_solver_;
+
+    /// Seeds whose manipulability falls below this are redrawn;
+    /// 0 disables screening. The measure scales with the robot's link
+    /// lengths, so the threshold is a per-robot parameter.
+    double min_seed_manipulability_;
+
+    /// KDL solvers keep internal scratch state, so each concurrent
+    /// restart worker needs its own instances
+    struct IKSolverSet
+    {
+      boost::shared_ptr<KDL::ChainFkSolverPos_recursive> fk_solver;
+      boost::shared_ptr<KDL::ChainIkSolverVel_pinv> ik_solver_vel;
+      boost::shared_ptr<KDL::ChainIkSolverPos_NR_JL> ik_solver_pos;
+      boost::shared_ptr<KDL::ChainJntToJacSolver> jac_solver;
+    };
+    std::vector<IKSolverSet> solver_pool_;
+
+    boost::mutex parallel_solution_lock_;
+    bool parallel_solution_found_;
+    KDL::JntArray parallel_solution_;
+
+    /// Persistent direct-mapped seed cache keyed by discretized
+    /// end-effector pose (position voxel + orientation bin). Recurring
+    /// poses, e.g. in bin picking, then restart from a recently
+    /// successful solution instead of a random configuration. Zero is
+    /// reserved as the empty-slot key.
+    struct SeedCache
+    {
+      enum { SIZE = 4096 };
+      SeedCache() : keys(SIZE, 0), seeds(SIZE) {}
+      std::vector<unsigned long long> keys;
+      std::vector<std::vector<double> > seeds;
+    };
+
+    unsigned long long seedCacheKey(const KDL::Frame &pose_desired) const;
+    bool lookupCachedSeed(const KDL::Frame &pose_desired, KDL::JntArray &seed) const;
+    void storeCachedSeed(const KDL::Frame &pose_desired, const KDL::JntArray &solution);
+
+    SeedCache seed_cache_;
+    double seed_cache_translation_resolution_;
+    double seed_cache_rotation_resolution_;
 
     unsigned int dimension_;
     KDL::Chain kdl_chain_;
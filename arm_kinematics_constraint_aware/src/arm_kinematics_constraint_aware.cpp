@@ -39,6 +39,9 @@
 #include <visualization_msgs/Marker.h>
 #include <visualization_msgs/MarkerArray.h>
 
+#include <sstream>
+#include <cstdlib>
+
 namespace arm_kinematics_constraint_aware {
 
 static const std::string IK_WITH_COLLISION_SERVICE = "get_constraint_aware_ik";
@@ -47,13 +50,25 @@ static const std::string FK_INFO_SERVICE = "get_fk_solver_info";
 static const std::string IK_SERVICE = "get_ik";
 static const std::string FK_SERVICE = "get_fk";
 static const double IK_DEFAULT_TIMEOUT = 10.0;
+static const unsigned int SOLVER_BENCHMARK_SAMPLES = 25;
 
 ArmKinematicsConstraintAware::ArmKinematicsConstraintAware(): kinematics_loader_("kinematics_base","kinematics::KinematicsBase"),node_handle_("~")
+{
+  initialize();
+}
+
+ArmKinematicsConstraintAware::ArmKinematicsConstraintAware(const std::string& ns): kinematics_loader_("kinematics_base","kinematics::KinematicsBase"),node_handle_(ns)
+{
+  initialize();
+}
+
+void ArmKinematicsConstraintAware::initialize()
 {
   std::string group_name, kinematics_solver_name;
   node_handle_.param<bool>("visualize_solution",visualize_solution_,true);
   node_handle_.param<std::string>("group", group_, std::string());
   node_handle_.param<std::string>("kinematics_solver",kinematics_solver_name," ");
+  node_handle_.param<bool>("kinematics_only", kinematics_only_, false);
   ROS_INFO("Using kinematics solver name: %s",kinematics_solver_name.c_str());
   if (group_.empty())
   {
@@ -62,17 +77,54 @@ ArmKinematicsConstraintAware::ArmKinematicsConstraintAware(): kinematics_loader_
     return;
   }
 
-  collision_models_interface_ = new planning_environment::CollisionModelsInterface("robot_description");
+  if(kinematics_only_) {
+    //plain FK/IK never touches geometry, so load only the kinematic
+    //skeleton - no mesh parsing, no collision environment, and no
+    //planning scene registration with the environment server
+    collision_models_interface_ = new planning_environment::CollisionModelsInterface("robot_description", false, true);
+  } else {
+    collision_models_interface_ = new planning_environment::CollisionModelsInterface("robot_description");
+  }
+
+  //a whitespace-separated list of candidate plugins makes the solver
+  //choice a runtime decision: each candidate is micro-benchmarked once
+  //at startup and calls are routed to the fastest correct one, so a
+  //generated analytic solver wins over the KDL fallback wherever one
+  //exists for the chain
+  std::string kinematics_solver_names;
+  node_handle_.param<std::string>("kinematics_solvers", kinematics_solver_names, std::string());
 
   kinematics::KinematicsBase* kinematics_solver = NULL;
-  try
+  if(!kinematics_solver_names.empty())
   {
-    kinematics_solver = kinematics_loader_.createClassInstance(kinematics_solver_name);
+    kinematics::KinematicsSolverSelector* selector = new kinematics::KinematicsSolverSelector();
+    std::stringstream ss(kinematics_solver_names);
+    std::string candidate_name;
+    while(ss >> candidate_name)
+    {
+      try
+      {
+        selector->addCandidate(candidate_name, kinematics_loader_.createClassInstance(candidate_name));
+      }
+      catch(pluginlib::PluginlibException& ex)
+      {
+        ROS_ERROR("Candidate plugin %s failed to load: %s", candidate_name.c_str(), ex.what());
+      }
+    }
+    selector->setBenchmarkConfigurations(sampleGroupConfigurations(SOLVER_BENCHMARK_SAMPLES));
+    kinematics_solver = selector;
   }
-  catch(pluginlib::PluginlibException& ex)
+  else
   {
-    ROS_ERROR("The plugin failed to load. Error1: %s", ex.what());    //handle the class failing to load
-    return;
+    try
+    {
+      kinematics_solver = kinematics_loader_.createClassInstance(kinematics_solver_name);
+    }
+    catch(pluginlib::PluginlibException& ex)
+    {
+      ROS_ERROR("The plugin failed to load. Error1: %s", ex.what());    //handle the class failing to load
+      return;
+    }
   }
 
   solver_ = new ArmKinematicsSolverConstraintAware(kinematics_solver,
@@ -89,7 +141,36 @@ ArmKinematicsConstraintAware::ArmKinematicsConstraintAware(): kinematics_loader_
   }
 
   advertiseBaseKinematicsServices();
-  advertiseConstraintIKService();
+  if(!kinematics_only_) {
+    advertiseConstraintIKService();
+  }
+}
+
+std::vector<std::vector<double> > ArmKinematicsConstraintAware::sampleGroupConfigurations(unsigned int count) const
+{
+  std::vector<std::vector<double> > configurations;
+  const planning_models::KinematicModel::JointModelGroup* joint_model_group =
+    collision_models_interface_->getKinematicModel()->getModelGroup(group_);
+  if(joint_model_group == NULL) {
+    ROS_WARN_STREAM("No joint group " << group_ << ", can't sample benchmark configurations");
+    return configurations;
+  }
+  const std::vector<const planning_models::KinematicModel::JointModel*>& joint_models =
+    joint_model_group->getJointModels();
+  for(unsigned int i = 0; i < count; i++) {
+    std::vector<double> configuration(joint_models.size());
+    for(unsigned int j = 0; j < joint_models.size(); j++) {
+      std::pair<double, double> bounds;
+      if(!joint_models[j]->getVariableBounds(joint_models[j]->getName(), bounds) ||
+         bounds.first >= bounds.second) {
+        bounds.first = -M_PI;
+        bounds.second = M_PI;
+      }
+      configuration[j] = bounds.first + (bounds.second - bounds.first)*((double)rand()/(double)RAND_MAX);
+    }
+    configurations.push_back(configuration);
+  }
+  return configurations;
 }
 
 void ArmKinematicsConstraintAware::advertiseBaseKinematicsServices()
@@ -143,7 +224,7 @@ bool ArmKinematicsConstraintAware::getConstraintAwarePositionIK(kinematics_msgs:
   geometry_msgs::PoseStamped pose_msg_in = request_in.ik_request.pose_stamped;
   ROS_DEBUG_STREAM("Before Pose is " << pose_msg_in.pose.position.x << " " << pose_msg_in.pose.position.y << " " << pose_msg_in.pose.position.z);
   geometry_msgs::PoseStamped pose_msg_out;
-  planning_environment::setRobotStateAndComputeTransforms(request_in.ik_request.robot_state, *collision_models_interface_->getPlanningSceneState());
+  planning_environment::setRobotStateAndComputeGroupTransforms(request_in.ik_request.robot_state, group_, *collision_models_interface_->getPlanningSceneState());
   
   if(!collision_models_interface_->convertPoseGivenWorldTransform(*collision_models_interface_->getPlanningSceneState(),
                                                                   solver_->getBaseName(),
@@ -162,6 +243,14 @@ bool ArmKinematicsConstraintAware::getConstraintAwarePositionIK(kinematics_msgs:
                                                        response.solution.joint_state,
                                                        response.error_code,
                                                        true);
+  //tell the client what the rejection sampling actually did, so a
+  //failure can be retried intelligently
+  const ArmKinematicsSolverConstraintAware::SolveStats& solve_stats = solver_->getLastSolveStats();
+  response.ik_solutions_found = solve_stats.solutions_found;
+  response.solutions_rejected_in_collision = solve_stats.rejected_in_collision;
+  response.solutions_rejected_by_constraints = solve_stats.rejected_by_constraints;
+  response.ik_solver_time = solve_stats.solver_time;
+  response.constraint_check_time = solve_stats.constraint_check_time;
   if(ik_valid)
   {
     response.error_code.val = response.error_code.SUCCESS;
@@ -255,8 +344,9 @@ bool ArmKinematicsConstraintAware::getPositionIK(kinematics_msgs::GetPositionIK:
     state->setKinematicStateToDefault();
   }
 
-  planning_environment::setRobotStateAndComputeTransforms(request.ik_request.robot_state,
-                                                          *state);
+  planning_environment::setRobotStateAndComputeGroupTransforms(request.ik_request.robot_state,
+                                                               group_,
+                                                               *state);
 
   geometry_msgs::PoseStamped pose_msg_in = request.ik_request.pose_stamped;
   geometry_msgs::PoseStamped pose_msg_out;
@@ -33,6 +33,7 @@
 #include <arm_kinematics_constraint_aware/arm_kinematics_solver_constraint_aware.h>
 #include <arm_kinematics_constraint_aware/arm_kinematics_constraint_aware_utils.h>
 #include <planning_environment/models/model_utils.h>
+#include <angles/angles.h>
 
 namespace arm_kinematics_constraint_aware 
 {
@@ -133,17 +134,19 @@ bool ArmKinematicsSolverConstraintAware::findConstraintAwareSolution(const geome
   do_initial_pose_check_ = do_initial_pose_check;
   constraints_ = constraints;
   state_ = robot_state;
-  
+  last_solve_stats_ = SolveStats();
+
   std::map<std::string, double> seed_state_map;
   robot_state->getKinematicStateValues(seed_state_map);
-  
+
   std::vector<double> seed_state_vector(kinematics_solver_->getJointNames().size());
   for(unsigned int i = 0; i < kinematics_solver_->getJointNames().size(); i++) {
     seed_state_vector[i] = seed_state_map[kinematics_solver_->getJointNames()[i]];
-  } 
-  
+  }
+
   std::vector<double> sol;
   int kinematics_error_code;
+  ros::WallTime solve_start = ros::WallTime::now();
   bool ik_valid = kinematics_solver_->searchPositionIK(pose,
                                                       seed_state_vector,
                                                       1.0,
@@ -151,6 +154,8 @@ bool ArmKinematicsSolverConstraintAware::findConstraintAwareSolution(const geome
                                                       boost::bind(&ArmKinematicsSolverConstraintAware::initialPoseCheck, this, _1, _2, _3),
                                                       boost::bind(&ArmKinematicsSolverConstraintAware::collisionCheck, this, _1, _2, _3),
                                                       kinematics_error_code);
+  last_solve_stats_.solver_time =
+    (ros::WallTime::now()-solve_start).toSec() - last_solve_stats_.constraint_check_time;
   if(ik_valid) {
     solution.name = kinematics_solver_->getJointNames();
     solution.position = sol;
@@ -175,17 +180,19 @@ bool ArmKinematicsSolverConstraintAware::findConsistentConstraintAwareSolution(c
   do_initial_pose_check_ = do_initial_pose_check;
   constraints_ = constraints;
   state_ = robot_state;
-  
+  last_solve_stats_ = SolveStats();
+
   std::map<std::string, double> seed_state_map;
   robot_state->getKinematicStateValues(seed_state_map);
-  
+
   std::vector<double> seed_state_vector(kinematics_solver_->getJointNames().size());
   for(unsigned int i = 0; i < kinematics_solver_->getJointNames().size(); i++) {
     seed_state_vector[i] = seed_state_map[kinematics_solver_->getJointNames()[i]];
-  } 
-  
+  }
+
   std::vector<double> sol;
   int kinematics_error_code;
+  ros::WallTime solve_start = ros::WallTime::now();
   bool ik_valid = kinematics_solver_->searchPositionIK(pose,
                                                        seed_state_vector,
                                                        1.0,
@@ -195,6 +202,8 @@ bool ArmKinematicsSolverConstraintAware::findConsistentConstraintAwareSolution(c
                                                        boost::bind(&ArmKinematicsSolverConstraintAware::initialPoseCheck, this, _1, _2, _3),
                                                        boost::bind(&ArmKinematicsSolverConstraintAware::collisionCheck, this, _1, _2, _3),
                                                        kinematics_error_code);
+  last_solve_stats_.solver_time =
+    (ros::WallTime::now()-solve_start).toSec() - last_solve_stats_.constraint_check_time;
   if(ik_valid) {
     solution.name = kinematics_solver_->getJointNames();
     solution.position = sol;
@@ -208,23 +217,97 @@ bool ArmKinematicsSolverConstraintAware::findConsistentConstraintAwareSolution(c
 }
 
 
+int ArmKinematicsSolverConstraintAware::validateIKCandidates(const geometry_msgs::Pose& pose,
+                                                             const arm_navigation_msgs::Constraints& constraints,
+                                                             planning_models::KinematicState* robot_state,
+                                                             const std::vector<std::vector<double> >& candidates,
+                                                             std::vector<int>& error_codes,
+                                                             const bool& do_initial_pose_check)
+{
+  error_codes.clear();
+  error_codes.resize(candidates.size(), kinematics::STATE_IN_COLLISION);
+  do_initial_pose_check_ = do_initial_pose_check;
+  constraints_ = constraints;
+  state_ = robot_state;
+
+  //the pose check does not depend on the candidate joint values, so it
+  //gates the whole batch once
+  int pose_check_code = kinematics::SUCCESS;
+  initialPoseCheck(pose, std::vector<double>(), pose_check_code);
+  if(pose_check_code != kinematics::SUCCESS) {
+    for(unsigned int i = 0; i < error_codes.size(); i++) {
+      error_codes[i] = pose_check_code;
+    }
+    return -1;
+  }
+
+  const std::vector<std::string>& joint_names = kinematics_solver_->getJointNames();
+  std::map<std::string, double> joint_values;
+  std::vector<std::map<std::string, double>::iterator> value_slots(joint_names.size());
+  for(unsigned int i = 0; i < joint_names.size(); i++) {
+    value_slots[i] = joint_values.insert(std::make_pair(joint_names[i], 0.0)).first;
+  }
+
+  //group handle so each candidate only runs forward kinematics for the
+  //group's links rather than the whole robot
+  planning_models::KinematicState::JointStateGroup* joint_state_group =
+    robot_state->getJointStateGroup(group_name_);
+
+  int first_valid = -1;
+  //one session for the batch: scene mutations wait until every
+  //candidate has been judged against the same scene
+  cm_->bodiesLock();
+  for(unsigned int i = 0; i < candidates.size(); i++) {
+    if(candidates[i].size() != joint_names.size()) {
+      error_codes[i] = kinematics::NO_IK_SOLUTION;
+      continue;
+    }
+    for(unsigned int j = 0; j < joint_names.size(); j++) {
+      value_slots[j]->second = candidates[i][j];
+    }
+    if(joint_state_group != NULL) {
+      joint_state_group->setKinematicState(joint_values);
+    } else {
+      robot_state->setKinematicState(joint_values);
+    }
+    if(cm_->isKinematicStateInCollision(*robot_state)) {
+      error_codes[i] = kinematics::STATE_IN_COLLISION;
+    } else if(!planning_environment::doesKinematicStateObeyConstraints(*robot_state,
+                                                                       constraints_)) {
+      error_codes[i] = kinematics::GOAL_CONSTRAINTS_VIOLATED;
+    } else {
+      error_codes[i] = kinematics::SUCCESS;
+      if(first_valid < 0) {
+        first_valid = (int)i;
+      }
+    }
+  }
+  cm_->bodiesUnlock();
+  return first_valid;
+}
+
 void ArmKinematicsSolverConstraintAware::collisionCheck(const geometry_msgs::Pose &ik_pose,
                                                         const std::vector<double> &ik_solution,
                                                         int &error_code)
 {
+  ros::WallTime check_start = ros::WallTime::now();
   std::map<std::string, double> joint_values;
   for(unsigned int i=0; i < kinematics_solver_->getJointNames().size(); i++) {
     joint_values[kinematics_solver_->getJointNames()[i]] = ik_solution[i];
   }
-  
+
   state_->setKinematicState(joint_values);
   error_code = kinematics::SUCCESS;
+  last_solve_stats_.solutions_found++;
   if(cm_->isKinematicStateInCollision(*state_)) {
     error_code = kinematics::STATE_IN_COLLISION;
-  } else if(!planning_environment::doesKinematicStateObeyConstraints(*state_, 
+    last_solve_stats_.rejected_in_collision++;
+  } else if(!planning_environment::doesKinematicStateObeyConstraints(*state_,
                                                                      constraints_)) {
     error_code = kinematics::GOAL_CONSTRAINTS_VIOLATED;
+    last_solve_stats_.rejected_by_constraints++;
   }
+  last_solve_stats_.constraint_check_time += (ros::WallTime::now()-check_start).toSec();
 }
 
 void ArmKinematicsSolverConstraintAware::initialPoseCheck(const geometry_msgs::Pose &ik_pose,
@@ -235,6 +318,7 @@ void ArmKinematicsSolverConstraintAware::initialPoseCheck(const geometry_msgs::P
     error_code = kinematics::SUCCESS;
     return;
   }
+  ros::WallTime check_start = ros::WallTime::now();
   std::string kinematic_frame_id = kinematics_solver_->getBaseName();
   std::string planning_frame_id = cm_->getWorldFrameId();
   geometry_msgs::PoseStamped pose_stamped;
@@ -260,6 +344,7 @@ void ArmKinematicsSolverConstraintAware::initialPoseCheck(const geometry_msgs::P
   tf::poseMsgToTF(pose_stamped.pose,transform);
   if(!state_->hasLinkState(tip_name_)) {
     error_code = kinematics::INVALID_LINK_NAME;
+    last_solve_stats_.constraint_check_time += (ros::WallTime::now()-check_start).toSec();
     return;
   }
   state_->updateKinematicStateWithLinkAt(tip_name_, transform);
@@ -270,6 +355,96 @@ void ArmKinematicsSolverConstraintAware::initialPoseCheck(const geometry_msgs::P
     error_code = kinematics::SUCCESS;
   }
   cm_->setAlteredAllowedCollisionMatrix(save_acm);
+  last_solve_stats_.constraint_check_time += (ros::WallTime::now()-check_start).toSec();
+}
+
+bool ArmKinematicsSolverConstraintAware::solveCartesianPath(const std::vector<geometry_msgs::Pose>& poses,
+                                                            const double& max_joint_delta,
+                                                            const arm_navigation_msgs::Constraints& constraints,
+                                                            planning_models::KinematicState* robot_state,
+                                                            trajectory_msgs::JointTrajectory& traj,
+                                                            arm_navigation_msgs::ArmNavigationErrorCodes& error_code,
+                                                            const bool& do_initial_pose_check)
+{
+  const std::vector<std::string>& joint_names = kinematics_solver_->getJointNames();
+
+  trajectory_msgs::JointTrajectory ret_traj;
+  ret_traj.joint_names = joint_names;
+  ret_traj.points.resize(poses.size());
+
+  if(poses.empty()) {
+    error_code.val = error_code.SUCCESS;
+    traj = ret_traj;
+    return true;
+  }
+
+  //continuous joints wrap, so their deltas are measured as shortest
+  //angular distance
+  std::vector<bool> continuous(joint_names.size(), false);
+  for(unsigned int i = 0; i < joint_names.size(); i++) {
+    const planning_models::KinematicModel::RevoluteJointModel* rev
+      = dynamic_cast<const planning_models::KinematicModel::RevoluteJointModel*>(cm_->getKinematicModel()->getJointModel(joint_names[i]));
+    continuous[i] = (rev != NULL && rev->continuous_);
+  }
+
+  std::map<std::string, double> joint_values;
+  std::vector<std::map<std::string, double>::iterator> value_slots(joint_names.size());
+  for(unsigned int i = 0; i < joint_names.size(); i++) {
+    value_slots[i] = joint_values.insert(std::make_pair(joint_names[i], 0.0)).first;
+  }
+
+  planning_models::KinematicState::JointStateGroup* joint_state_group =
+    robot_state->getJointStateGroup(group_name_);
+
+  for(unsigned int i = 0; i < poses.size(); i++) {
+    //waypoint 0 seeds from the state the caller passed in; each later
+    //waypoint from its predecessor's solution, which for a dense path
+    //is close enough that the solver rarely restarts
+    if(i > 0) {
+      for(unsigned int j = 0; j < joint_names.size(); j++) {
+        value_slots[j]->second = ret_traj.points[i-1].positions[j];
+      }
+      if(joint_state_group != NULL) {
+        joint_state_group->setKinematicState(joint_values);
+      } else {
+        robot_state->setKinematicState(joint_values);
+      }
+    }
+    sensor_msgs::JointState solution;
+    arm_navigation_msgs::ArmNavigationErrorCodes temp_error_code;
+    if(!findConstraintAwareSolution(poses[i],
+                                    constraints,
+                                    robot_state,
+                                    solution,
+                                    temp_error_code,
+                                    do_initial_pose_check)) {
+      ROS_DEBUG_STREAM("Cartesian path unsolvable at waypoint " << i);
+      error_code = temp_error_code;
+      return false;
+    }
+    if(i > 0 && max_joint_delta > 0.0) {
+      for(unsigned int j = 0; j < joint_names.size(); j++) {
+        double delta;
+        if(continuous[j]) {
+          delta = fabs(angles::shortest_angular_distance(ret_traj.points[i-1].positions[j],
+                                                         solution.position[j]));
+        } else {
+          delta = fabs(solution.position[j] - ret_traj.points[i-1].positions[j]);
+        }
+        if(delta > max_joint_delta) {
+          ROS_DEBUG_STREAM("Cartesian path discontinuous at waypoint " << i
+                           << ": " << joint_names[j] << " jumps " << delta);
+          error_code.val = error_code.INVALID_TRAJECTORY;
+          return false;
+        }
+      }
+    }
+    ret_traj.points[i].positions = solution.position;
+  }
+  checkForWraparound(ret_traj);
+  error_code.val = error_code.SUCCESS;
+  traj = ret_traj;
+  return true;
 }
 
 bool ArmKinematicsSolverConstraintAware::interpolateIKDirectional(const geometry_msgs::Pose& start_pose,
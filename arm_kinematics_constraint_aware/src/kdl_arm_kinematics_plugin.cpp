@@ -34,6 +34,8 @@
 #include <arm_kinematics_constraint_aware/kdl_arm_kinematics_plugin.h>
 #include <kdl_conversions/kdl_msg.h>
 #include <pluginlib/class_list_macros.h>
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
 
 using namespace KDL;
 using namespace tf;
@@ -66,6 +68,14 @@ double KDLArmKinematicsPlugin::genRandomNumber(const double &min, const double &
   return result;
 }
 
+double KDLArmKinematicsPlugin::genRandomNumber(unsigned int &rng_state, const double &min, const double &max)
+{
+  //rand_r keeps the concurrent restart workers off the shared rand() state
+  int rand_num = rand_r(&rng_state)%100+1;
+  double result = min + (double)((max-min)*rand_num)/101.0;
+  return result;
+}
+
 KDL::JntArray KDLArmKinematicsPlugin::getRandomConfiguration()
 {
   KDL::JntArray jnt_array;
@@ -75,6 +85,15 @@ KDL::JntArray KDLArmKinematicsPlugin::getRandomConfiguration()
   return jnt_array;
 }
 
+KDL::JntArray KDLArmKinematicsPlugin::getRandomConfiguration(unsigned int &rng_state)
+{
+  KDL::JntArray jnt_array;
+  jnt_array.resize(dimension_);
+  for(unsigned int i=0; i < dimension_; i++)
+    jnt_array(i) = genRandomNumber(rng_state,joint_min_(i),joint_max_(i));
+  return jnt_array;
+}
+
 KDL::JntArray KDLArmKinematicsPlugin::getRandomConfiguration(const KDL::JntArray& seed_state,
                                                              const unsigned int& redundancy,
                                                              const double& consistency_limit)
@@ -93,6 +112,145 @@ KDL::JntArray KDLArmKinematicsPlugin::getRandomConfiguration(const KDL::JntArray
   return jnt_array;
 }
 
+double KDLArmKinematicsPlugin::computeManipulability(KDL::ChainJntToJacSolver &jac_solver,
+                                                     const KDL::JntArray &jnt_array) const
+{
+  KDL::Jacobian jacobian(dimension_);
+  if(jac_solver.JntToJac(jnt_array,jacobian) < 0)
+    return 0.0;
+  //G = J*J^T is 6x6 regardless of the chain length
+  double g[6][6];
+  for(unsigned int i=0; i < 6; i++) {
+    for(unsigned int j=0; j <= i; j++) {
+      double sum = 0.0;
+      for(unsigned int k=0; k < dimension_; k++)
+        sum += jacobian(i,k)*jacobian(j,k);
+      g[i][j] = sum;
+      g[j][i] = sum;
+    }
+  }
+  //det(G) by gaussian elimination with partial pivoting
+  double det = 1.0;
+  for(unsigned int col=0; col < 6; col++) {
+    unsigned int pivot = col;
+    for(unsigned int row=col+1; row < 6; row++) {
+      if(fabs(g[row][col]) > fabs(g[pivot][col]))
+        pivot = row;
+    }
+    if(g[pivot][col] == 0.0)
+      return 0.0;
+    if(pivot != col) {
+      for(unsigned int k=col; k < 6; k++)
+        std::swap(g[col][k],g[pivot][k]);
+      det = -det;
+    }
+    det *= g[col][col];
+    for(unsigned int row=col+1; row < 6; row++) {
+      double factor = g[row][col]/g[col][col];
+      for(unsigned int k=col; k < 6; k++)
+        g[row][k] -= factor*g[col][k];
+    }
+  }
+  if(det <= 0.0)
+    return 0.0;
+  return sqrt(det);
+}
+
+KDL::JntArray KDLArmKinematicsPlugin::getScreenedRandomConfiguration(KDL::ChainJntToJacSolver &jac_solver)
+{
+  if(min_seed_manipulability_ <= 0.0)
+    return getRandomConfiguration();
+  //one Jacobian evaluation per draw is far cheaper than the Newton
+  //iterations a restart burns converging into a singular basin
+  static const int max_draws = 4;
+  KDL::JntArray best;
+  double best_score = -1.0;
+  for(int i=0; i < max_draws; i++) {
+    KDL::JntArray jnt_array = getRandomConfiguration();
+    double score = computeManipulability(jac_solver,jnt_array);
+    if(score >= min_seed_manipulability_)
+      return jnt_array;
+    if(score > best_score) {
+      best_score = score;
+      best = jnt_array;
+    }
+  }
+  return best;
+}
+
+KDL::JntArray KDLArmKinematicsPlugin::getScreenedRandomConfiguration(KDL::ChainJntToJacSolver &jac_solver,
+                                                                     unsigned int &rng_state)
+{
+  if(min_seed_manipulability_ <= 0.0)
+    return getRandomConfiguration(rng_state);
+  static const int max_draws = 4;
+  KDL::JntArray best;
+  double best_score = -1.0;
+  for(int i=0; i < max_draws; i++) {
+    KDL::JntArray jnt_array = getRandomConfiguration(rng_state);
+    double score = computeManipulability(jac_solver,jnt_array);
+    if(score >= min_seed_manipulability_)
+      return jnt_array;
+    if(score > best_score) {
+      best_score = score;
+      best = jnt_array;
+    }
+  }
+  return best;
+}
+
+unsigned long long KDLArmKinematicsPlugin::seedCacheKey(const KDL::Frame &pose_desired) const
+{
+  //hash the voxel indices of the pose so that all poses within one
+  //workspace voxel share a cache slot; the quaternion is quantized at
+  //the rotation resolution
+  double qx, qy, qz, qw;
+  pose_desired.M.GetQuaternion(qx, qy, qz, qw);
+  double quantized[7];
+  quantized[0] = pose_desired.p[0]/seed_cache_translation_resolution_;
+  quantized[1] = pose_desired.p[1]/seed_cache_translation_resolution_;
+  quantized[2] = pose_desired.p[2]/seed_cache_translation_resolution_;
+  quantized[3] = qx/seed_cache_rotation_resolution_;
+  quantized[4] = qy/seed_cache_rotation_resolution_;
+  quantized[5] = qz/seed_cache_rotation_resolution_;
+  quantized[6] = qw/seed_cache_rotation_resolution_;
+
+  unsigned long long hash = 0;
+  for(unsigned int i=0; i < 7; i++)
+  {
+    unsigned long long cell = (unsigned long long)(long long)floor(quantized[i] + 0.5);
+    hash ^= cell;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+  }
+  hash ^= hash >> 33;
+  if(!hash)
+    hash = 1;
+  return hash;
+}
+
+bool KDLArmKinematicsPlugin::lookupCachedSeed(const KDL::Frame &pose_desired, KDL::JntArray &seed) const
+{
+  unsigned long long key = seedCacheKey(pose_desired);
+  unsigned int slot = (unsigned int)(key & (unsigned long long)(SeedCache::SIZE-1));
+  if(seed_cache_.keys[slot] != key || seed_cache_.seeds[slot].size() != dimension_)
+    return false;
+  seed.resize(dimension_);
+  for(unsigned int i=0; i < dimension_; i++)
+    seed(i) = seed_cache_.seeds[slot][i];
+  return true;
+}
+
+void KDLArmKinematicsPlugin::storeCachedSeed(const KDL::Frame &pose_desired, const KDL::JntArray &solution)
+{
+  unsigned long long key = seedCacheKey(pose_desired);
+  unsigned int slot = (unsigned int)(key & (unsigned long long)(SeedCache::SIZE-1));
+  seed_cache_.keys[slot] = key;
+  seed_cache_.seeds[slot].resize(dimension_);
+  for(unsigned int i=0; i < dimension_; i++)
+    seed_cache_.seeds[slot][i] = solution(i);
+}
+
 bool KDLArmKinematicsPlugin::checkConsistency(const KDL::JntArray& seed_state,
                                               const unsigned int& redundancy,
                                               const double& consistency_limit,
@@ -144,11 +302,36 @@ bool KDLArmKinematicsPlugin::initialize(const std::string& group_name,
   private_handle.param("max_solver_iterations", max_iterations, 500);
   private_handle.param("max_search_iterations", max_search_iterations_, 3);
   private_handle.param("epsilon", epsilon, 1e-5);
+  private_handle.param("parallel_search_threads", parallel_search_threads_, 1);
+  if(parallel_search_threads_ < 1)
+    parallel_search_threads_ = 1;
+  private_handle.param("seed_cache_translation_resolution", seed_cache_translation_resolution_, 0.02);
+  private_handle.param("seed_cache_rotation_resolution", seed_cache_rotation_resolution_, 0.05);
+  private_handle.param("min_seed_manipulability", min_seed_manipulability_, 0.0);
 
   // Build Solvers
   fk_solver_.reset(new KDL::ChainFkSolverPos_recursive(kdl_chain_));
   ik_solver_vel_.reset(new KDL::ChainIkSolverVel_pinv(kdl_chain_));
   ik_solver_pos_.reset(new KDL::ChainIkSolverPos_NR_JL(kdl_chain_, joint_min_, joint_max_,*fk_solver_, *ik_solver_vel_, max_iterations, epsilon));
+  jac_solver_.reset(new KDL::ChainJntToJacSolver(kdl_chain_));
+
+  //one solver set per concurrent restart worker; the chain itself is
+  //only read by the solvers and can be shared
+  if(parallel_search_threads_ > 1)
+  {
+    solver_pool_.resize(parallel_search_threads_);
+    for(int i=0; i < parallel_search_threads_; i++)
+    {
+      solver_pool_[i].fk_solver.reset(new KDL::ChainFkSolverPos_recursive(kdl_chain_));
+      solver_pool_[i].ik_solver_vel.reset(new KDL::ChainIkSolverVel_pinv(kdl_chain_));
+      solver_pool_[i].ik_solver_pos.reset(new KDL::ChainIkSolverPos_NR_JL(kdl_chain_, joint_min_, joint_max_,
+                                                                          *solver_pool_[i].fk_solver,
+                                                                          *solver_pool_[i].ik_solver_vel,
+                                                                          max_iterations, epsilon));
+      solver_pool_[i].jac_solver.reset(new KDL::ChainJntToJacSolver(kdl_chain_));
+    }
+  }
+  parallel_solution_found_ = false;
   active_ = true;
   return true;
 }
@@ -346,30 +529,110 @@ bool KDLArmKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose &ik_pose
   {
     jnt_pos_in(i) = ik_seed_state[i];
   }
+  if(!solver_pool_.empty())
+  {
+    if(searchPositionIKParallel(pose_desired,jnt_pos_in,solution))
+    {
+      ROS_DEBUG_STREAM("Parallel IK solved, time " << (ros::WallTime::now()-n1).toSec());
+      error_code = kinematics::SUCCESS;
+      return true;
+    }
+    ROS_DEBUG("An IK solution could not be found");
+    error_code = kinematics::NO_IK_SOLUTION;
+    return false;
+  }
+  bool consulted_seed_cache = false;
   for(int i=0; i < max_search_iterations_; i++)
   {
     for(unsigned int j=0; j < dimension_; j++)
-    { 
+    {
       ROS_DEBUG_STREAM("seed state " << j << " " << jnt_pos_in(j));
     }
-    int ik_valid = ik_solver_pos_->CartToJnt(jnt_pos_in,pose_desired,jnt_pos_out);                      
+    int ik_valid = ik_solver_pos_->CartToJnt(jnt_pos_in,pose_desired,jnt_pos_out);
     ROS_DEBUG_STREAM("IK success " << ik_valid << " time " << (ros::WallTime::now()-n1).toSec());
-    if(ik_valid >= 0) {                                                                                                       
+    if(ik_valid >= 0) {
       solution.resize(dimension_);
       for(unsigned int j=0; j < dimension_; j++) {
         solution[j] = jnt_pos_out(j);
       }
+      storeCachedSeed(pose_desired,jnt_pos_out);
       error_code = kinematics::SUCCESS;
       ROS_DEBUG_STREAM("Solved after " << i+1 << " iterations");
       return true;
-    }      
-    jnt_pos_in = getRandomConfiguration();
+    }
+    //a recently successful solution for this workspace voxel is a much
+    //better restart than a random configuration
+    if(!consulted_seed_cache)
+    {
+      consulted_seed_cache = true;
+      if(lookupCachedSeed(pose_desired,jnt_pos_in))
+        continue;
+    }
+    jnt_pos_in = getScreenedRandomConfiguration(*jac_solver_);
   }
-  ROS_DEBUG("An IK solution could not be found");   
+  ROS_DEBUG("An IK solution could not be found");
   error_code = kinematics::NO_IK_SOLUTION;
   return false;
 }
 
+bool KDLArmKinematicsPlugin::searchPositionIKParallel(const KDL::Frame &pose_desired,
+                                                      const KDL::JntArray &jnt_seed_state,
+                                                      std::vector<double> &solution)
+{
+  parallel_solution_found_ = false;
+  boost::thread_group workers;
+  for(unsigned int i=0; i < solver_pool_.size(); i++)
+    workers.create_thread(boost::bind(&KDLArmKinematicsPlugin::searchPositionIKThread,this,i,
+                                      boost::cref(pose_desired),boost::cref(jnt_seed_state)));
+  workers.join_all();
+  if(!parallel_solution_found_)
+    return false;
+  storeCachedSeed(pose_desired,parallel_solution_);
+  solution.resize(dimension_);
+  for(unsigned int j=0; j < dimension_; j++)
+    solution[j] = parallel_solution_(j);
+  return true;
+}
+
+void KDLArmKinematicsPlugin::searchPositionIKThread(unsigned int thread_index,
+                                                    const KDL::Frame &pose_desired,
+                                                    const KDL::JntArray &jnt_seed_state)
+{
+  IKSolverSet &solvers = solver_pool_[thread_index];
+  unsigned int rng_state = (unsigned int)time(NULL) + thread_index;
+  //worker 0 starts from the caller's seed, worker 1 from the cached
+  //seed for this workspace voxel when there is one, the others from
+  //random restarts; the restarts are split round-robin so the total
+  //stays max_search_iterations_. The cache is only written after the
+  //workers have been joined, so reading it here is safe.
+  KDL::JntArray jnt_pos_in;
+  if(thread_index == 0)
+    jnt_pos_in = jnt_seed_state;
+  else if(thread_index != 1 || !lookupCachedSeed(pose_desired,jnt_pos_in))
+    jnt_pos_in = getScreenedRandomConfiguration(*solvers.jac_solver,rng_state);
+  KDL::JntArray jnt_pos_out;
+  for(int i=(int)thread_index; i < max_search_iterations_; i+=(int)solver_pool_.size())
+  {
+    {
+      boost::mutex::scoped_lock lock(parallel_solution_lock_);
+      if(parallel_solution_found_)
+        return;
+    }
+    int ik_valid = solvers.ik_solver_pos->CartToJnt(jnt_pos_in,pose_desired,jnt_pos_out);
+    if(ik_valid >= 0)
+    {
+      boost::mutex::scoped_lock lock(parallel_solution_lock_);
+      if(!parallel_solution_found_)
+      {
+        parallel_solution_found_ = true;
+        parallel_solution_ = jnt_pos_out;
+      }
+      return;
+    }
+    jnt_pos_in = getScreenedRandomConfiguration(*solvers.jac_solver,rng_state);
+  }
+}
+
 bool KDLArmKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose &ik_pose,
                                               const std::vector<double> &ik_seed_state,
                                               const double &timeout,
@@ -478,8 +741,8 @@ bool KDLArmKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose &ik_pose
     //{ 
     //  ROS_DEBUG_STREAM("seed state " << j << " " << jnt_pos_in(j));
     //}
-    int ik_valid = ik_solver_pos_->CartToJnt(jnt_pos_in,pose_desired,jnt_pos_out);                      
-    jnt_pos_in = getRandomConfiguration();
+    int ik_valid = ik_solver_pos_->CartToJnt(jnt_pos_in,pose_desired,jnt_pos_out);
+    jnt_pos_in = getScreenedRandomConfiguration(*jac_solver_);
     if(ik_valid < 0)                                                                                                       
       continue;
     std::vector<double> solution_local;
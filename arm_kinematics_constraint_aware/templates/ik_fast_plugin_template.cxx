@@ -15,6 +15,10 @@ class IKFastKinematicsPlugin : public kinematics::KinematicsBase
   std::vector<double> joint_min_vector_;
   std::vector<double> joint_max_vector_;
   std::vector<bool> joint_has_limits_vector_;
+  //effective bounds for the batch API: unlimited joints get infinite
+  //bounds so the per-solution filter needs no has-limits lookup
+  std::vector<double> joint_min_effective_;
+  std::vector<double> joint_max_effective_;
   std::vector<std::string> link_names_;
   arm_kinematics_constraint_aware::ik_solver_base* ik_solver_;
   size_t num_joints_;
@@ -120,9 +124,44 @@ public:
     for(size_t i=0; i <num_joints_; ++i)
       ROS_INFO_STREAM(joint_names_[i] << " " << joint_min_vector_[i] << " " << joint_max_vector_[i] << " " << joint_has_limits_vector_[i]);
 
+    joint_min_effective_.resize(num_joints_);
+    joint_max_effective_.resize(num_joints_);
+    for(size_t i=0; i <num_joints_; ++i){
+      joint_min_effective_[i] = joint_has_limits_vector_[i] ? joint_min_vector_[i] : -DBL_MAX;
+      joint_max_effective_[i] = joint_has_limits_vector_[i] ? joint_max_vector_[i] : DBL_MAX;
+    }
+
     return true;
   }
 
+  /**
+   * @brief Solve IK for a batch of candidate poses, e.g. the grasp poses
+   * evaluated per pick. Limit-obeying solutions land back to back in the
+   * caller-provided flat buffer, getNumJoints() doubles per solution,
+   * with solution_counts[p] kept solutions for pose p; the pose setup
+   * and solution container are reused across the batch so nothing is
+   * allocated per pose. Returns the total number of doubles written,
+   * or -1 if the buffer ran out.
+   */
+  int getPositionIKBatch(const std::vector<geometry_msgs::Pose> &ik_poses,
+                         const std::vector<double> &ik_seed_state,
+                         double *solution_buffer,
+                         int buffer_capacity,
+                         std::vector<int> &solution_counts) {
+
+    std::vector<double> vfree(free_params_.size());
+    for(std::size_t i = 0; i < free_params_.size(); ++i)
+      vfree[i] = ik_seed_state[free_params_[i]];
+
+    std::vector<KDL::Frame> frames(ik_poses.size());
+    for(std::size_t i = 0; i < ik_poses.size(); ++i)
+      tf::PoseMsgToKDL(ik_poses[i],frames[i]);
+
+    return ik_solver_->solveBatch(frames, vfree,
+                                  &joint_min_effective_[0], &joint_max_effective_[0],
+                                  solution_buffer, buffer_capacity, solution_counts);
+  }
+
   bool getCount(int &count, 
                 const int &max_count, 
                 const int &min_count)
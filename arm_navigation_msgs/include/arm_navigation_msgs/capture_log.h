@@ -0,0 +1,224 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2011, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#ifndef ARM_NAVIGATION_MSGS_CAPTURE_LOG_
+#define ARM_NAVIGATION_MSGS_CAPTURE_LOG_
+
+#include <ros/ros.h>
+#include <boost/thread/mutex.hpp>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstring>
+
+namespace arm_navigation_msgs
+{
+
+/** Record types a capture log can carry. The payload is the ROS
+    serialization of the message named in the comment. */
+enum CaptureRecordType
+{
+  //arm_navigation_msgs::SetPlanningSceneDiff::Request
+  CAPTURE_PLANNING_SCENE = 1,
+  //arm_navigation_msgs::GetMotionPlan::Request
+  CAPTURE_MOTION_PLAN_REQUEST = 2,
+  //arm_navigation_msgs::FilterJointTrajectoryWithConstraints::Request
+  CAPTURE_FILTER_REQUEST = 3
+};
+
+/** Identifies the format; bump the digit if the framing ever changes */
+static const char CAPTURE_LOG_MAGIC[8] = {'A','N','A','V','C','A','P','1'};
+
+/**
+   @brief Appends timestamped, serialized messages to a binary capture
+   log. Each record is the 4-byte record type, the 8-byte capture wall
+   time in seconds, the 4-byte payload length and the payload, all
+   little-endian as written by the capturing machine. Writes are
+   mutex-protected and flushed per record so a log survives the node
+   being killed; an unopened writer ignores every write, so capture
+   call sites need no guards.
+*/
+class CaptureLogWriter
+{
+public:
+  CaptureLogWriter() : file_(NULL)
+  {
+  }
+
+  ~CaptureLogWriter()
+  {
+    close();
+  }
+
+  bool open(const std::string &path)
+  {
+    close();
+    file_ = fopen(path.c_str(), "wb");
+    if(!file_)
+    {
+      ROS_ERROR_STREAM("Could not open capture log " << path << " for writing");
+      return false;
+    }
+    fwrite(CAPTURE_LOG_MAGIC, sizeof(CAPTURE_LOG_MAGIC), 1, file_);
+    fflush(file_);
+    ROS_INFO_STREAM("Capturing workload to " << path);
+    return true;
+  }
+
+  bool isOpen() const
+  {
+    return file_ != NULL;
+  }
+
+  template<typename M>
+  void write(uint32_t record_type, const M &msg)
+  {
+    if(!file_)
+      return;
+    uint32_t length = ros::serialization::serializationLength(msg);
+    std::vector<uint8_t> buffer(length);
+    if(length > 0)
+    {
+      ros::serialization::OStream stream(&buffer[0], length);
+      ros::serialization::serialize(stream, msg);
+    }
+    double stamp = ros::WallTime::now().toSec();
+    boost::mutex::scoped_lock lock(lock_);
+    if(!file_)
+      return;
+    fwrite(&record_type, sizeof(record_type), 1, file_);
+    fwrite(&stamp, sizeof(stamp), 1, file_);
+    fwrite(&length, sizeof(length), 1, file_);
+    if(length > 0)
+      fwrite(&buffer[0], length, 1, file_);
+    fflush(file_);
+  }
+
+  void close()
+  {
+    boost::mutex::scoped_lock lock(lock_);
+    if(file_)
+    {
+      fclose(file_);
+      file_ = NULL;
+    }
+  }
+
+private:
+  FILE *file_;
+  boost::mutex lock_;
+};
+
+/**
+   @brief Reads a capture log record by record. A record whose payload
+   fails to deserialize (e.g. a log captured against different message
+   definitions) surfaces as a decode failure on that record only, so
+   the caller can skip it and keep replaying.
+*/
+class CaptureLogReader
+{
+public:
+  CaptureLogReader() : file_(NULL)
+  {
+  }
+
+  ~CaptureLogReader()
+  {
+    if(file_)
+      fclose(file_);
+  }
+
+  bool open(const std::string &path)
+  {
+    if(file_)
+    {
+      fclose(file_);
+      file_ = NULL;
+    }
+    file_ = fopen(path.c_str(), "rb");
+    if(!file_)
+    {
+      ROS_ERROR_STREAM("Could not open capture log " << path);
+      return false;
+    }
+    char magic[sizeof(CAPTURE_LOG_MAGIC)];
+    if(fread(magic, sizeof(magic), 1, file_) != 1 ||
+       memcmp(magic, CAPTURE_LOG_MAGIC, sizeof(magic)) != 0)
+    {
+      ROS_ERROR_STREAM(path << " is not a capture log");
+      fclose(file_);
+      file_ = NULL;
+      return false;
+    }
+    return true;
+  }
+
+  /** @brief Read the next record; false at end of file or on a
+      truncated record (a node killed mid-write leaves one) */
+  bool next(uint32_t &record_type, double &stamp, std::vector<uint8_t> &payload)
+  {
+    if(!file_)
+      return false;
+    uint32_t length;
+    if(fread(&record_type, sizeof(record_type), 1, file_) != 1 ||
+       fread(&stamp, sizeof(stamp), 1, file_) != 1 ||
+       fread(&length, sizeof(length), 1, file_) != 1)
+      return false;
+    payload.resize(length);
+    if(length > 0 && fread(&payload[0], length, 1, file_) != 1)
+      return false;
+    return true;
+  }
+
+  template<typename M>
+  static bool decode(std::vector<uint8_t> &payload, M &msg)
+  {
+    try
+    {
+      ros::serialization::IStream stream(payload.empty() ? NULL : &payload[0], payload.size());
+      ros::serialization::deserialize(stream, msg);
+    }
+    catch(ros::serialization::StreamOverrunException &)
+    {
+      return false;
+    }
+    return true;
+  }
+
+private:
+  FILE *file_;
+};
+
+}
+
+#endif
@@ -0,0 +1,147 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2011, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef ARM_NAVIGATION_MSGS_COLLISION_MAP_CODEC_H_
+#define ARM_NAVIGATION_MSGS_COLLISION_MAP_CODEC_H_
+
+#include <arm_navigation_msgs/CollisionMap.h>
+#include <arm_navigation_msgs/CompactCollisionMap.h>
+#include <vector>
+#include <algorithm>
+#include <math.h>
+
+namespace arm_navigation_msgs
+{
+
+/** @brief Encode a voxel collision map into its run-length encoded form.
+
+    Collision maps produced by the occupancy mapping nodes store one
+    OrientedBoundingBox per voxel although every voxel shares the same
+    extents and (axis-aligned) orientation.  This packs the voxel centers
+    onto an integer grid anchored at the minimum center, runs consecutive
+    voxels along x together, and drops the per-voxel extents and
+    orientation entirely.
+
+    @return false if the map is not such a voxel grid (non-uniform
+    extents are not detected, but grids too large for 16-bit coordinates
+    are) in which case the caller should fall back to the full message.
+*/
+inline bool encodeCollisionMap(const CollisionMap &map, CompactCollisionMap &compact)
+{
+  compact.header = map.header;
+  compact.runs.clear();
+  compact.origin.x = compact.origin.y = compact.origin.z = 0.0;
+  if(map.boxes.empty())
+  {
+    compact.resolution = 0.0;
+    return true;
+  }
+  double resolution = map.boxes[0].extents.x;
+  if(resolution <= 0.0)
+    return false;
+
+  double min_x = map.boxes[0].center.x;
+  double min_y = map.boxes[0].center.y;
+  double min_z = map.boxes[0].center.z;
+  for(unsigned int i = 1; i < map.boxes.size(); i++)
+  {
+    if(map.boxes[i].center.x < min_x) min_x = map.boxes[i].center.x;
+    if(map.boxes[i].center.y < min_y) min_y = map.boxes[i].center.y;
+    if(map.boxes[i].center.z < min_z) min_z = map.boxes[i].center.z;
+  }
+
+  //keys sort by (z,y,x) so voxels that are consecutive along x are adjacent
+  std::vector<unsigned long long> keys(map.boxes.size());
+  for(unsigned int i = 0; i < map.boxes.size(); i++)
+  {
+    long ix = (long)floor((map.boxes[i].center.x - min_x)/resolution + 0.5);
+    long iy = (long)floor((map.boxes[i].center.y - min_y)/resolution + 0.5);
+    long iz = (long)floor((map.boxes[i].center.z - min_z)/resolution + 0.5);
+    if(ix > 65535 || iy > 65535 || iz > 65535)
+      return false;
+    keys[i] = ((unsigned long long)iz << 32) | ((unsigned long long)iy << 16) | (unsigned long long)ix;
+  }
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+  compact.resolution = resolution;
+  compact.origin.x = min_x;
+  compact.origin.y = min_y;
+  compact.origin.z = min_z;
+  for(unsigned int i = 0; i < keys.size(); )
+  {
+    unsigned int j = i+1;
+    while(j < keys.size() && keys[j] == keys[j-1]+1 && (keys[j] & 0xffff) != 0 && j-i < 65535)
+      j++;
+    compact.runs.push_back((uint16_t)(keys[i] & 0xffff));
+    compact.runs.push_back((uint16_t)((keys[i] >> 16) & 0xffff));
+    compact.runs.push_back((uint16_t)((keys[i] >> 32) & 0xffff));
+    compact.runs.push_back((uint16_t)(j-i));
+    i = j;
+  }
+  return true;
+}
+
+/** @brief Expand a run-length encoded collision map back into the
+    per-voxel box form, with shared extents and identity orientation. */
+inline void decodeCollisionMap(const CompactCollisionMap &compact, CollisionMap &map)
+{
+  map.header = compact.header;
+  map.boxes.clear();
+
+  unsigned int num_voxels = 0;
+  for(unsigned int i = 0; i+3 < compact.runs.size(); i += 4)
+    num_voxels += compact.runs[i+3];
+  map.boxes.reserve(num_voxels);
+
+  OrientedBoundingBox box;
+  box.extents.x = box.extents.y = box.extents.z = compact.resolution;
+  box.axis.x = box.axis.y = 0.0;
+  box.axis.z = 1.0;
+  box.angle = 0.0;
+  for(unsigned int i = 0; i+3 < compact.runs.size(); i += 4)
+  {
+    box.center.y = compact.origin.y + compact.runs[i+1]*compact.resolution;
+    box.center.z = compact.origin.z + compact.runs[i+2]*compact.resolution;
+    for(unsigned int k = 0; k < compact.runs[i+3]; k++)
+    {
+      box.center.x = compact.origin.x + (compact.runs[i]+k)*compact.resolution;
+      map.boxes.push_back(box);
+    }
+  }
+}
+
+}
+
+#endif
@@ -64,6 +64,20 @@ inline trajectory_msgs::JointTrajectoryPoint jointStateToJointTrajectoryPoint(co
     return point;
   }
 
+  /**
+     @brief Convert a joint state to a joint trajectory point message, writing into a caller-owned point
+     @param The input joint state message
+     @param The output joint trajectory point; only position information is filled in, existing storage is reused
+  */
+inline void jointStateToJointTrajectoryPoint(const sensor_msgs::JointState &state,
+                                             trajectory_msgs::JointTrajectoryPoint &point)
+  {
+    point.positions = state.position;
+    point.velocities.clear();
+    point.accelerations.clear();
+    point.time_from_start = ros::Duration(0.0);
+  }
+
   /**
      @brief Convert a multi-dof state to a multi-dof joint trajectory point message
      @param The input multi-dof state
@@ -77,6 +91,18 @@ inline arm_navigation_msgs::MultiDOFJointTrajectoryPoint multiDOFJointStateToMul
     return point;
   }
 
+  /**
+     @brief Convert a multi-dof state to a multi-dof joint trajectory point message, writing into a caller-owned point
+     @param The input multi-dof state
+     @param The output multi-dof joint trajectory point; existing storage is reused
+  */
+inline void multiDOFJointStateToMultiDOFJointTrajectoryPoint(const arm_navigation_msgs::MultiDOFJointState &state,
+                                                             arm_navigation_msgs::MultiDOFJointTrajectoryPoint &point)
+  {
+    point.poses = state.poses;
+    point.time_from_start = ros::Duration(0.0);
+  }
+
   /**
      @brief Convert a robot state to a robot trajectory message
      @param The input robot state
@@ -86,8 +112,8 @@ inline void robotStateToRobotTrajectoryPoint(const arm_navigation_msgs::RobotSta
                                              trajectory_msgs::JointTrajectoryPoint &point,
                                              arm_navigation_msgs::MultiDOFJointTrajectoryPoint &multi_dof_point)
   {
-    point = jointStateToJointTrajectoryPoint(state.joint_state);
-    multi_dof_point = multiDOFJointStateToMultiDOFJointTrajectoryPoint(state.multi_dof_joint_state);
+    jointStateToJointTrajectoryPoint(state.joint_state, point);
+    multiDOFJointStateToMultiDOFJointTrajectoryPoint(state.multi_dof_joint_state, multi_dof_point);
     return;
   }
 
@@ -109,6 +135,25 @@ inline  sensor_msgs::JointState jointConstraintsToJointState(const std::vector<a
     return state;
   }
 
+  /**
+     @brief Extract joint position information from a set of joint constraints into a caller-owned joint state message
+     @param The input vector of joint constraints
+     @param The output joint state message; existing storage is reused so repeated calls do not reallocate
+   */
+inline  void jointConstraintsToJointState(const std::vector<arm_navigation_msgs::JointConstraint> &constraints,
+                                          sensor_msgs::JointState &state)
+  {
+    state.name.resize(constraints.size());
+    state.position.resize(constraints.size());
+    for(unsigned int i=0; i < constraints.size(); i++)
+    {
+      state.name[i] = constraints[i].joint_name;
+      state.position[i] = constraints[i].position;
+    }
+    state.velocity.clear();
+    state.effort.clear();
+  }
+
   /**
      @brief Extract joint position information from a set of joint constraints into a joint state message
      @param The input vector of joint constraints
@@ -119,11 +164,15 @@ inline  trajectory_msgs::JointTrajectory jointConstraintsToJointTrajectory(const
     trajectory_msgs::JointTrajectory path;
     if(constraints.empty())
       return path;
-    sensor_msgs::JointState state = jointConstraintsToJointState(constraints);
-    trajectory_msgs::JointTrajectoryPoint point = jointStateToJointTrajectoryPoint(state);
     //    path.header = constraints[0].header;
-    path.points.push_back(point);
-    path.joint_names = state.name;
+    path.joint_names.resize(constraints.size());
+    path.points.resize(1);
+    path.points[0].positions.resize(constraints.size());
+    for(unsigned int i=0; i < constraints.size(); i++)
+    {
+      path.joint_names[i] = constraints[i].joint_name;
+      path.points[0].positions[i] = constraints[i].position;
+    }
     return path;
   }
 
@@ -145,6 +194,21 @@ inline  geometry_msgs::PoseStamped poseConstraintsToPoseStamped(const arm_naviga
     return pose_stamped;
   }
 
+  /**
+     @brief Extract pose information from a position and orientation constraint into a caller-owned pose stamped message
+     @param The input position constraint
+     @param The input orientation constraint
+     @param The output pose stamped message
+   */
+inline  void poseConstraintsToPoseStamped(const arm_navigation_msgs::PositionConstraint &position_constraint,
+                                          const arm_navigation_msgs::OrientationConstraint &orientation_constraint,
+                                          geometry_msgs::PoseStamped &pose_stamped)
+  {
+    pose_stamped.header = position_constraint.header;
+    pose_stamped.pose.position = position_constraint.position;
+    pose_stamped.pose.orientation = orientation_constraint.orientation;
+  }
+
   /**
      @brief Create a joint state from a std vector of names and values
      @param The input vector of joint names
@@ -347,11 +411,13 @@ inline void printJointState(const sensor_msgs::JointState &joint_state)
       ROS_ERROR("Number of position constraints does not match number of orientation constraints");
       return false;
     }
+    unsigned int offset = poses.size();
+    poses.resize(offset + constraints.position_constraints.size());
     for(unsigned int i =0; i < constraints.position_constraints.size(); i++)
     {
-      geometry_msgs::PoseStamped pose = poseConstraintsToPoseStamped(constraints.position_constraints[i],
-                                                                     constraints.orientation_constraints[i]);
-      poses.push_back(pose);
+      poseConstraintsToPoseStamped(constraints.position_constraints[i],
+                                   constraints.orientation_constraints[i],
+                                   poses[offset+i]);
     }
     return true;
   }
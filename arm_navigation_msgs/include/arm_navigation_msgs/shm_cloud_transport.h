@@ -0,0 +1,151 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2011, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef ARM_NAVIGATION_MSGS_SHM_CLOUD_TRANSPORT_H_
+#define ARM_NAVIGATION_MSGS_SHM_CLOUD_TRANSPORT_H_
+
+#include <arm_navigation_msgs/ShmPointCloud.h>
+#include <ros/serialization.h>
+
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <string>
+#include <sstream>
+
+namespace arm_navigation_msgs
+{
+
+/**
+   @brief Serializes cloud messages into a small ring of POSIX shared
+   memory segments and fills in the ShmPointCloud descriptor to
+   publish in their place.
+
+   The ring keeps a descriptor's segment untouched for ring_size-1
+   further writes, so a subscriber with a short queue reads a segment
+   before the writer comes back around to it. Segments are removed
+   when the writer is destroyed.
+*/
+class ShmCloudWriter
+{
+public:
+  ShmCloudWriter(const std::string &base_name, unsigned int ring_size = 4)
+    : base_name_(base_name), ring_size_(ring_size), sequence_(0)
+  {
+    // shm segment names cannot contain path separators
+    for (std::string::size_type i = 0 ; i < base_name_.size() ; ++i)
+      if (base_name_[i] == '/')
+        base_name_[i] = '_';
+  }
+
+  ~ShmCloudWriter(void)
+  {
+    for (unsigned int i = 0 ; i < ring_size_ ; ++i)
+      boost::interprocess::shared_memory_object::remove(segmentName(i).c_str());
+  }
+
+  /** @brief Write one cloud message into the next ring segment and
+      fill the descriptor that names it */
+  template<typename M>
+  void write(const M &cloud, ShmPointCloud &descriptor)
+  {
+    namespace ipc = boost::interprocess;
+
+    uint32_t length = ros::serialization::serializationLength(cloud);
+    std::string name = segmentName(sequence_ % ring_size_);
+
+    ipc::shared_memory_object shm(ipc::open_or_create, name.c_str(), ipc::read_write);
+    ipc::offset_t size = 0;
+    shm.get_size(size);
+    if (size < (ipc::offset_t)length)
+      shm.truncate(length);
+    ipc::mapped_region region(shm, ipc::read_write);
+
+    ros::serialization::OStream stream((uint8_t*)region.get_address(), length);
+    ros::serialization::serialize(stream, cloud);
+
+    descriptor.header = cloud.header;
+    descriptor.segment_name = name;
+    descriptor.length = length;
+    descriptor.sequence = sequence_++;
+  }
+
+private:
+  std::string segmentName(unsigned int slot) const
+  {
+    std::stringstream ss;
+    ss << base_name_ << "_" << slot;
+    return ss.str();
+  }
+
+  std::string base_name_;
+  unsigned int ring_size_;
+  uint32_t sequence_;
+};
+
+/**
+   @brief Reads a cloud message back out of the shared memory segment
+   a ShmPointCloud descriptor names
+*/
+class ShmCloudReader
+{
+public:
+  /** @brief Deserialize the descriptor's segment into the given
+      message; returns false if the segment is missing or too short
+      (e.g. the writer exited) */
+  template<typename M>
+  bool read(const ShmPointCloud &descriptor, M &cloud)
+  {
+    namespace ipc = boost::interprocess;
+
+    try
+    {
+      ipc::shared_memory_object shm(ipc::open_only, descriptor.segment_name.c_str(), ipc::read_only);
+      ipc::mapped_region region(shm, ipc::read_only);
+      if (region.get_size() < descriptor.length)
+        return false;
+      ros::serialization::IStream stream((uint8_t*)region.get_address(), descriptor.length);
+      ros::serialization::deserialize(stream, cloud);
+    }
+    catch (boost::interprocess::interprocess_exception&)
+    {
+      return false;
+    }
+    return true;
+  }
+};
+
+}
+
+#endif
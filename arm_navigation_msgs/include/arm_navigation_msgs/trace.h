@@ -0,0 +1,90 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2011, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#ifndef ARM_NAVIGATION_MSGS_TRACE_
+#define ARM_NAVIGATION_MSGS_TRACE_
+
+#include <ros/ros.h>
+#include <arm_navigation_msgs/TraceSpan.h>
+
+namespace arm_navigation_msgs
+{
+
+/** Topic all pipeline stages publish their trace spans on; resolved
+    against the given node handle so the whole pipeline shares one
+    stream */
+static const std::string TRACE_TOPIC = "arm_navigation_trace";
+
+/**
+   @brief Advertise the shared trace topic
+   @param The node handle to advertise on
+   @return The publisher for TraceSpan messages
+*/
+inline ros::Publisher advertiseTraceTopic(ros::NodeHandle &node_handle)
+{
+  return node_handle.advertise<arm_navigation_msgs::TraceSpan>(TRACE_TOPIC, 128);
+}
+
+/**
+   @brief Publishes a TraceSpan covering its own lifetime, for scoping
+   a pipeline stage. A zero trace_id disables publication, so untraced
+   requests cost one time stamp and nothing else.
+*/
+class ScopedTraceSpan
+{
+public:
+  ScopedTraceSpan(ros::Publisher &publisher, unsigned int trace_id, const std::string &stage)
+    : publisher_(publisher)
+  {
+    span_.trace_id = trace_id;
+    span_.stage = stage;
+    span_.start_time = ros::Time::now();
+  }
+
+  ~ScopedTraceSpan()
+  {
+    if(span_.trace_id == 0)
+      return;
+    span_.node = ros::this_node::getName();
+    span_.end_time = ros::Time::now();
+    publisher_.publish(span_);
+  }
+
+private:
+  ros::Publisher &publisher_;
+  arm_navigation_msgs::TraceSpan span_;
+};
+
+}
+
+#endif
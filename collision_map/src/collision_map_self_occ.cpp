@@ -37,7 +37,12 @@
 #include <ros/ros.h>
 #include <std_srvs/Empty.h>
 #include <sensor_msgs/PointCloud.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/point_cloud_conversion.h>
 #include <arm_navigation_msgs/CollisionMap.h>
+#include <arm_navigation_msgs/CollisionMapDelta.h>
+#include <arm_navigation_msgs/CompactCollisionMap.h>
+#include <arm_navigation_msgs/shm_cloud_transport.h>
 #include <tf/transform_listener.h>
 #include <tf/message_filter.h>
 #include <message_filters/subscriber.h>
@@ -48,10 +53,17 @@
 #include <algorithm>
 #include <set>
 #include <iterator>
+#include <fstream>
 #include <cstdlib>
+#include <cstdio>
+#include <cmath>
 #include <arm_navigation_msgs/MakeStaticCollisionMapAction.h>
 #include <actionlib/server/simple_action_server.h>
 
+#if defined __SSE2__
+#include <emmintrin.h>
+#endif
+
 struct CloudInfo 
 {
   CloudInfo(): cloud_name_(""), frame_subsample_(1.0),
@@ -59,7 +71,7 @@ struct CloudInfo
 	       dynamic_buffer_size_(1), static_buffer_size_(1), 
 	       dynamic_buffer_duration_(0), static_buffer_duration_(0),
 	       dynamic_publish_(true), static_publish_(true), 
-               dynamic_until_static_publish_(true)
+               dynamic_until_static_publish_(true), shm_(false)
   {
   };
   std::string cloud_name_;
@@ -78,6 +90,10 @@ struct CloudInfo
   // the dynamic map will be published on the main topic until a static map from that source is created, 
   // at which point dynamic behavior will revert to that specified by dynamic_publish;
   bool dynamic_publish_, static_publish_, dynamic_until_static_publish_;  
+
+  // receive this source through shared memory descriptors on
+  // <name>_shm instead of full clouds on <name>
+  bool shm_;
 };
 
 class CollisionMapperOcc
@@ -120,6 +136,28 @@ public:
     priv.param<bool>("publish_occlusion", publishOcclusion_, false);
     priv.param<bool>("publish_static_over_dynamic_map", publish_over_dynamic_map_, false);
 
+    // when enabled, the full map published on collision_map_occ is
+    // accompanied by a delta message (voxels added/removed since the
+    // previous cycle) with a full keyframe every so many cycles
+    priv.param<bool>("publish_deltas", publishDeltas_, false);
+    priv.param<int>("delta_keyframe_interval", deltaKeyframeInterval_, 50);
+    deltaCount_ = 0;
+
+    // when enabled, the full map is also published in run-length
+    // encoded form, built straight from the integer voxel grid
+    priv.param<bool>("publish_compact", publishCompact_, false);
+
+    // file the acquired static maps are persisted to (empty disables
+    // persistence); a restarted node reloads it and skips the slow
+    // re-acquisition sweep
+    priv.param<std::string>("static_map_file", staticMapFile_, "");
+
+    // at most this many voxels that dropped out of view are kept
+    // alive per cycle (nearest the robot first), each for at most
+    // occlusion_timeout seconds; 0 drops them immediately
+    priv.param<int>("occlusion_budget", occlusionBudget_, 0);
+    priv.param<double>("occlusion_timeout", occlusionTimeout_, 5.0);
+
 
     // compute some useful values
     bi_.real_minX = -bi_.dimensionX + bi_.originX;
@@ -135,6 +173,10 @@ public:
     cmapPublisher_ = root_handle_.advertise<arm_navigation_msgs::CollisionMap>("collision_map_occ", 1, true);
     cmapUpdPublisher_ = root_handle_.advertise<arm_navigation_msgs::CollisionMap>("collision_map_occ_update", 1);
     static_map_publisher_ = root_handle_.advertise<arm_navigation_msgs::CollisionMap>("collision_map_occ_static", 1);
+    if (publishDeltas_)
+      cmapDeltaPublisher_ = root_handle_.advertise<arm_navigation_msgs::CollisionMapDelta>("collision_map_occ_delta", 1, true);
+    if (publishCompact_)
+      cmapCompactPublisher_ = root_handle_.advertise<arm_navigation_msgs::CompactCollisionMap>("collision_map_occ_compact", 1, true);
         
     if(!priv.hasParam("cloud_sources")) {
       ROS_WARN("No links specified for self filtering.");
@@ -195,13 +237,21 @@ public:
 	    cps.dynamic_until_static_publish_ = cloud_vals[i]["dynamic_until_static_publish"];
           }
 
+	  if(cloud_vals[i].hasMember("shm"))
+	    cps.shm_ = cloud_vals[i]["shm"];
+
           if(cloud_source_map_.find(cps.cloud_name_) != cloud_source_map_.end()) {
             ROS_WARN_STREAM("Already have a cloud defined with name " << cps.cloud_name_);
           } else {
             cloud_source_map_[cps.cloud_name_] = cps;
+            if(cps.shm_) {
+              shm_cloud_sub_vector_.push_back(root_handle_.subscribe<arm_navigation_msgs::ShmPointCloud>(cps.cloud_name_+"_shm", 1,
+                                                                                                         boost::bind(&CollisionMapperOcc::shmCloudCallback, this, _1, cps.cloud_name_)));
+            } else {
             mn_cloud_tf_sub_vector_.push_back(new message_filters::Subscriber<sensor_msgs::PointCloud>(root_handle_, cps.cloud_name_, 1));
             mn_cloud_tf_fil_vector_.push_back(new tf::MessageFilter<sensor_msgs::PointCloud>(*(mn_cloud_tf_sub_vector_.back()), tf_, "", 1));
             mn_cloud_tf_fil_vector_.back()->registerCallback(boost::bind(&CollisionMapperOcc::cloudCallback, this, _1, cps.cloud_name_));
+            }
             // if (publishOcclusion_) {
             //   std::string name = std::string("collision_map_occ_occlusion_")+cps.cloud_name_;
             //   occPublisherMap_[cps.cloud_name_] = root_handle_.advertise<arm_navigation_msgs::CollisionMap>(name, 1);
@@ -229,8 +279,10 @@ public:
     //mnCloudIncremental_->setTargetFrame(frames);
     resetService_ = priv.advertiseService("reset", &CollisionMapperOcc::reset, this);
 
-    action_server_.reset(new actionlib::SimpleActionServer<arm_navigation_msgs::MakeStaticCollisionMapAction>(root_handle_, "make_static_collision_map", 
+    action_server_.reset(new actionlib::SimpleActionServer<arm_navigation_msgs::MakeStaticCollisionMapAction>(root_handle_, "make_static_collision_map",
                                                                                                                     boost::bind(&CollisionMapperOcc::makeStaticCollisionMap, this, _1)));
+
+    loadStaticMaps();
   }
   
   ~CollisionMapperOcc(void)
@@ -279,30 +331,234 @@ private:
     int x, y, z;
   };
 
-  // define an order on points
-  struct CollisionPointOrder
+  // An open-addressing hash set of voxel coordinates. Each cell is
+  // packed into a single 64-bit key and stored in a flat power-of-two
+  // table, so insertion, union and difference touch contiguous memory
+  // and allocate nothing per cell - unlike the former
+  // std::set<CollisionPoint>, which paid a node allocation and a tree
+  // rebalance per voxel and could not keep up at high resolution
+  class CMap
   {
-    bool operator()(const CollisionPoint &a, const CollisionPoint &b) const
+  public:
+
+    typedef unsigned long long Key;
+
+    CMap(void)
     {
-      if (a.x < b.x)
-        return true;
-      if (a.x > b.x)
-        return false;
-      if (a.y < b.y)
-        return true;
-      if (a.y > b.y)
-        return false;
-      return a.z < b.z;
+      clear();
+    }
+
+    void clear(void)
+    {
+      keys_.assign(INITIAL_CAPACITY, Key(EMPTY_KEY));
+      size_ = 0;
+    }
+
+    bool empty(void) const
+    {
+      return size_ == 0;
+    }
+
+    unsigned int size(void) const
+    {
+      return size_;
+    }
+
+    void insert(const CollisionPoint &p)
+    {
+      insertKey(packKey(p));
+    }
+
+    /** Pack quantized coordinates into a key, for callers that batch
+        keys up before loading them with insertKeys() */
+    static Key makeKey(int x, int y, int z)
+    {
+      return packKey(CollisionPoint(x, y, z));
     }
+
+    /** Bulk load a batch of keys: the table is sized once for the
+        final count, so no rehash happens mid-insertion */
+    void insertKeys(const std::vector<Key> &keys)
+    {
+      reserveFor(size_ + keys.size());
+      for (unsigned int i = 0 ; i < keys.size() ; ++i)
+        insertKey(keys[i]);
+    }
+
+    bool contains(const CollisionPoint &p) const
+    {
+      return findKey(packKey(p));
+    }
+
+    /** Bulk union: add every cell of another map */
+    void insertUnion(const CMap &other)
+    {
+      for (unsigned int i = 0 ; i < other.keys_.size() ; ++i)
+        if (other.keys_[i] != EMPTY_KEY)
+          insertKey(other.keys_[i]);
+    }
+
+    /** Bulk difference: collect the cells of this map that are not in the other map */
+    void difference(const CMap &other, std::vector<CollisionPoint> &out) const
+    {
+      out.clear();
+      for (unsigned int i = 0 ; i < keys_.size() ; ++i)
+        if (keys_[i] != EMPTY_KEY && !other.findKey(keys_[i]))
+          out.push_back(unpackKey(keys_[i]));
+    }
+
+    void getPoints(std::vector<CollisionPoint> &out) const
+    {
+      out.clear();
+      out.reserve(size_);
+      for (unsigned int i = 0 ; i < keys_.size() ; ++i)
+        if (keys_[i] != EMPTY_KEY)
+          out.push_back(unpackKey(keys_[i]));
+    }
+
+    /** Forward iteration over the stored cells, in table order */
+    class const_iterator
+    {
+    public:
+
+      const_iterator(const std::vector<Key> *keys, unsigned int pos) : keys_(keys), pos_(pos)
+      {
+        advance();
+      }
+
+      const CollisionPoint& operator*(void) const
+      {
+        return cur_;
+      }
+
+      const_iterator& operator++(void)
+      {
+        ++pos_;
+        advance();
+        return *this;
+      }
+
+      bool operator!=(const const_iterator &other) const
+      {
+        return pos_ != other.pos_;
+      }
+
+    private:
+
+      void advance(void)
+      {
+        while (pos_ < keys_->size() && (*keys_)[pos_] == EMPTY_KEY)
+          ++pos_;
+        if (pos_ < keys_->size())
+          cur_ = unpackKey((*keys_)[pos_]);
+      }
+
+      const std::vector<Key> *keys_;
+      unsigned int            pos_;
+      CollisionPoint          cur_;
+    };
+
+    const_iterator begin(void) const
+    {
+      return const_iterator(&keys_, 0);
+    }
+
+    const_iterator end(void) const
+    {
+      return const_iterator(&keys_, keys_.size());
+    }
+
+  private:
+
+    // cell coordinates fit in 21 bits each (plus-minus a million
+    // cells from the origin); a key never sets the top bit, so the
+    // all-ones pattern is free to mark empty slots
+    static const Key EMPTY_KEY = ~(Key)0;
+    static const int COORD_OFFSET = 1 << 20;
+    static const Key COORD_MASK = 0x1FFFFF;
+    static const unsigned int INITIAL_CAPACITY = 1024;
+
+    static Key packKey(const CollisionPoint &p)
+    {
+      return ((Key)((p.x + COORD_OFFSET) & COORD_MASK) << 42) |
+             ((Key)((p.y + COORD_OFFSET) & COORD_MASK) << 21) |
+              (Key)((p.z + COORD_OFFSET) & COORD_MASK);
+    }
+
+    static CollisionPoint unpackKey(Key k)
+    {
+      return CollisionPoint((int)((k >> 42) & COORD_MASK) - COORD_OFFSET,
+                            (int)((k >> 21) & COORD_MASK) - COORD_OFFSET,
+                            (int)(k & COORD_MASK) - COORD_OFFSET);
+    }
+
+    static unsigned int hashKey(Key k)
+    {
+      // 64-bit finalizer-style mix so neighbouring cells spread out
+      k ^= k >> 33;
+      k *= 0xff51afd7ed558ccdULL;
+      k ^= k >> 33;
+      k *= 0xc4ceb9fe1a85ec53ULL;
+      k ^= k >> 33;
+      return (unsigned int)k;
+    }
+
+    bool findKey(Key k) const
+    {
+      const unsigned int mask = keys_.size() - 1;
+      for (unsigned int i = hashKey(k) & mask ; keys_[i] != EMPTY_KEY ; i = (i + 1) & mask)
+        if (keys_[i] == k)
+          return true;
+      return false;
+    }
+
+    void insertKey(Key k)
+    {
+      const unsigned int mask = keys_.size() - 1;
+      unsigned int i = hashKey(k) & mask;
+      while (keys_[i] != EMPTY_KEY)
+      {
+        if (keys_[i] == k)
+          return;
+        i = (i + 1) & mask;
+      }
+      keys_[i] = k;
+      ++size_;
+      // keep the load factor below 0.7 so probe chains stay short
+      if ((unsigned long long)size_ * 10 >= (unsigned long long)keys_.size() * 7)
+        grow();
+    }
+
+    void reserveFor(unsigned int n)
+    {
+      while ((unsigned long long)keys_.size() * 7 <= (unsigned long long)n * 10)
+        grow();
+    }
+
+    void grow(void)
+    {
+      std::vector<Key> old;
+      old.swap(keys_);
+      keys_.assign(old.size() * 2, Key(EMPTY_KEY));
+      size_ = 0;
+      for (unsigned int i = 0 ; i < old.size() ; ++i)
+        if (old[i] != EMPTY_KEY)
+          insertKey(old[i]);
+    }
+
+    std::vector<Key> keys_;
+    unsigned int     size_;
   };
-    
-  typedef std::set<CollisionPoint, CollisionPointOrder> CMap;
 
   struct StampedCMap
   {
     std::string frame_id;
     ros::Time stamp;
     CMap cmap;
+
+    // voxels kept alive by the budgeted occlusion pass, mapped to the
+    // time they first went unobserved (see updateMap())
+    std::map<CMap::Key, ros::Time> retained;
   };
   
 
@@ -317,7 +573,46 @@ private:
     double real_minX, real_minY, real_minZ;
     double real_maxX, real_maxY, real_maxZ;
   };
-			
+
+  // orders voxels by squared distance of their center from the robot
+  // frame origin, so budgeted passes spend their budget near the
+  // robot's workspace first
+  struct CollisionPointDist2Order
+  {
+    CollisionPointDist2Order(const BoxInfo &bi) : bi_(bi)
+    {
+    }
+
+    double dist2(const CollisionPoint &p) const
+    {
+      double x = p.x * bi_.resolution + bi_.originX;
+      double y = p.y * bi_.resolution + bi_.originY;
+      double z = p.z * bi_.resolution + bi_.originZ;
+      return x * x + y * y + z * z;
+    }
+
+    bool operator()(const CollisionPoint &a, const CollisionPoint &b) const
+    {
+      return dist2(a) < dist2(b);
+    }
+
+    const BoxInfo &bi_;
+  };
+
+  // orders voxels by (z, y, x) so voxels consecutive along x end up
+  // adjacent, ready for run-length encoding
+  struct CollisionPointZYXOrder
+  {
+    bool operator()(const CollisionPoint &a, const CollisionPoint &b) const
+    {
+      if (a.z != b.z)
+        return a.z < b.z;
+      if (a.y != b.y)
+        return a.y < b.y;
+      return a.x < b.x;
+    }
+  };
+
   void cloudIncrementalCallback(const sensor_msgs::PointCloudConstPtr &cloud)
   {
     if (!mapProcessing_.try_lock())
@@ -412,7 +707,7 @@ private:
       int processed = 0;
       for(std::list<StampedCMap*>::iterator itbuff = it->second.begin(); itbuff != it->second.end(); itbuff++)
       {
-        set_union(uni.begin(), uni.end(), (*itbuff)->cmap.begin(), (*itbuff)->cmap.end(), std::inserter(uni, uni.begin()), CollisionPointOrder());
+        uni.insertUnion((*itbuff)->cmap);
         processed++;
       }
 
@@ -421,6 +716,29 @@ private:
 
   }
     
+  // clouds arriving through shared memory bypass the tf message
+  // filter, so transform availability is checked here before handing
+  // the cloud to the normal callback
+  void shmCloudCallback(const arm_navigation_msgs::ShmPointCloudConstPtr &descriptor, const std::string topic_name)
+  {
+    sensor_msgs::PointCloud2 cloud2;
+    if (!shm_reader_.read(*descriptor, cloud2)) {
+      ROS_WARN_THROTTLE(5.0, "Could not read cloud for %s from shared memory segment %s", topic_name.c_str(), descriptor->segment_name.c_str());
+      return;
+    }
+
+    sensor_msgs::PointCloudPtr cloud(new sensor_msgs::PointCloud());
+    if (!sensor_msgs::convertPointCloud2ToPointCloud(cloud2, *cloud))
+      return;
+
+    if (!tf_.waitForTransform(robotFrame_, cloud->header.frame_id, cloud->header.stamp, ros::Duration(0.2))) {
+      ROS_DEBUG("Dropping shm cloud for %s: no transform from %s to %s", topic_name.c_str(), cloud->header.frame_id.c_str(), robotFrame_.c_str());
+      return;
+    }
+
+    cloudCallback(cloud, topic_name);
+  }
+
   void cloudCallback(const sensor_msgs::PointCloudConstPtr &cloud, const std::string topic_name)
   {
     CloudInfo settings =  cloud_source_map_[topic_name];
@@ -443,19 +761,23 @@ private:
     ROS_DEBUG("After subsampling we have %u data points.",(unsigned int)subCloud.points.size ());
 
 
-    boost::recursive_mutex::scoped_lock lock(mapProcessing_);
-
     CMap obstacles;
 
     sensor_msgs::PointCloud transCloud;
-    
-    tf_.transformPointCloud(robotFrame_, subCloud, transCloud);
-	
+
     // transform the pointcloud to the robot frame
     // since we need the points in this frame (around the robot)
     // to compute the collision map
+    tf_.transformPointCloud(robotFrame_, subCloud, transCloud);
+
+    // the per-sensor stages above (subsampling, transform, binning
+    // into voxels) touch no shared state, so with the multi-threaded
+    // spinner clouds from different sensors get this far concurrently;
+    // only the buffer updates and the map union below are serialized
     constructCollisionMap(transCloud, obstacles);
 
+    boost::recursive_mutex::scoped_lock lock(mapProcessing_);
+
     if(making_static_collision_map_ && topic_name == static_map_goal_->cloud_source) {
       if(disregard_first_message_) {
         disregard_first_message_ = false;
@@ -471,7 +793,7 @@ private:
 	  static_map->stamp = transCloud.header.stamp;
           tempMaps_[map_name] = static_map;
         } 
-        updateMap(&static_map->cmap, obstacles, transCloud.header.frame_id, transCloud.header.stamp, settings.sensor_frame_, settings.cloud_name_);
+        updateMap(static_map, obstacles, transCloud.header.frame_id, transCloud.header.stamp, settings.sensor_frame_, settings.cloud_name_);
         if(++cloud_count_ == static_map_goal_->number_of_clouds) {
 
 	    ROS_DEBUG("Publishing static map");
@@ -488,6 +810,8 @@ private:
 
 	    updateBuffer(currentMaps_[topic_name+"_static"], settings.static_buffer_size_, settings.static_buffer_duration_, topic_name+"_static");
 
+	    saveStaticMaps();
+
             if(settings.dynamic_until_static_publish_) {
               //now if we are supposed to stop publishing dynamic maps get ride of the dynamic map for this topic
               std::list<StampedCMap*>& dyn_list = currentMaps_[topic_name+"_dynamic"];
@@ -501,6 +825,10 @@ private:
             composeMapUnion(currentMaps_, uni);
 
             publishCollisionMap(uni, transCloud.header.frame_id, transCloud.header.stamp, cmapPublisher_);
+            if (publishDeltas_)
+              publishCollisionMapDelta(uni, transCloud.header.frame_id, transCloud.header.stamp);
+            if (publishCompact_)
+              publishCollisionMapCompact(uni, transCloud.header.frame_id, transCloud.header.stamp);
 	  }
           
 	  tempMaps_.erase(map_name);
@@ -534,15 +862,19 @@ private:
       }
 
       // update map
-      updateMap(&current_map->cmap, obstacles, transCloud.header.frame_id, transCloud.header.stamp, settings.sensor_frame_, settings.cloud_name_);
+      updateMap(current_map, obstacles, transCloud.header.frame_id, transCloud.header.stamp, settings.sensor_frame_, settings.cloud_name_);
       updateBuffer(currentMaps_[topic_name+"_dynamic"], settings.dynamic_buffer_size_, settings.dynamic_buffer_duration_, topic_name+"_dynamic");
 
       CMap uni;
       composeMapUnion(currentMaps_, uni);
 
       publishCollisionMap(uni, transCloud.header.frame_id, transCloud.header.stamp, cmapPublisher_);
+      if (publishDeltas_)
+        publishCollisionMapDelta(uni, transCloud.header.frame_id, transCloud.header.stamp);
+      if (publishCompact_)
+        publishCollisionMapCompact(uni, transCloud.header.frame_id, transCloud.header.stamp);
 
-    } 
+    }
 
     double sec = (ros::WallTime::now() - tm).toSec();
     ROS_DEBUG("Updated collision map took %g seconds",sec);
@@ -551,35 +883,54 @@ private:
 
 
 
-  void updateMap(CMap* currentMap, CMap &obstacles, 
+  void updateMap(StampedCMap* currentMap, CMap &obstacles,
 		 std::string &frame_id,
 		 ros::Time &stamp,
-		 std::string to_frame_id, 
+		 std::string to_frame_id,
 		 std::string cloud_name)
   {
-    if (currentMap->empty())
+    if (currentMap->cmap.empty())
     {
-      *currentMap = obstacles;
+      currentMap->cmap = obstacles;
     }
     else
     {
-      CMap diff;
-	    
       // find the points from the old map that are no longer visible
-      set_difference(currentMap->begin(), currentMap->end(), obstacles.begin(), obstacles.end(),
-                     std::inserter(diff, diff.begin()), CollisionPointOrder());
-	    
+      std::vector<CollisionPoint> pts;
+      currentMap->cmap.difference(obstacles, pts);
+
       // the current map will at least contain the new info
-      *currentMap = obstacles;
+      currentMap->cmap = obstacles;
+
+      // budgeted occlusion preservation: rather than re-examining the
+      // whole previous map, at most occlusionBudget_ of the voxels
+      // that dropped out of view - nearest the robot first, where
+      // planning actually cares - are kept alive, each until it has
+      // gone unobserved for occlusionTimeout_ seconds; per-cycle cost
+      // is thus bounded by the budget and the amount of scene change,
+      // not by map size
+      if (occlusionBudget_ > 0 && !pts.empty())
+      {
+        unsigned int budget = std::min((unsigned int)occlusionBudget_, (unsigned int)pts.size());
+        std::partial_sort(pts.begin(), pts.begin() + budget, pts.end(), CollisionPointDist2Order(bi_));
+
+        std::map<CMap::Key, ros::Time> still;
+        for (unsigned int i = 0 ; i < budget ; ++i)
+        {
+          CMap::Key key = CMap::makeKey(pts[i].x, pts[i].y, pts[i].z);
+          std::map<CMap::Key, ros::Time>::iterator it = currentMap->retained.find(key);
+          ros::Time first = (it == currentMap->retained.end()) ? stamp : it->second;
+          if ((stamp - first).toSec() < occlusionTimeout_)
+          {
+            currentMap->cmap.insert(pts[i]);
+            still[key] = first;
+          }
+        }
+        currentMap->retained.swap(still);
+      }
 
-      // find out which of these points are now occluded 
+      // find out which of these points are now occluded
       //sm_->assumeFrame(header, to_frame_id, 0.05);
-	    
-      // OpenMP need an int as the lookup variable, but for set,
-      // this is not possible, so we copy to a vector
-      int n = diff.size();
-      std::vector<CollisionPoint> pts(n);
-      std::copy(diff.begin(), diff.end(), pts.begin());
 
       //unsigned int count = 0;
 
@@ -650,10 +1001,19 @@ private:
     currentMaps_.clear();
     tempMaps_.clear();
 
+    // the persisted file mirrors the in-memory static maps, so a
+    // reset clears it too instead of resurrecting the old map on the
+    // next restart
+    saveStaticMaps();
+
     CMap uni;
     composeMapUnion(currentMaps_, uni);
 
     publishCollisionMap(uni, robotFrame_, ros::Time::now(), cmapPublisher_);
+    if (publishDeltas_)
+      publishCollisionMapDelta(uni, robotFrame_, ros::Time::now());
+    if (publishCompact_)
+      publishCollisionMapCompact(uni, robotFrame_, ros::Time::now());
 
     return true;
   }
@@ -702,10 +1062,10 @@ private:
 
    
     // copy data to temporary location
-    const int n = map.size();
-    std::vector<CollisionPoint> pts(n);
-    std::copy(map.begin(), map.end(), pts.begin());
+    std::vector<CollisionPoint> pts;
+    map.getPoints(pts);
     map.clear();
+    const int n = pts.size();
 	
     //#pragma omp parallel for
     for (int i = 0 ; i < n ; ++i)
@@ -735,19 +1095,64 @@ private:
   void constructCollisionMap(const sensor_msgs::PointCloud &cloud, CMap &map)
   {
     const unsigned int n = cloud.points.size();
-    CollisionPoint c;
-	
-    for (unsigned int i = 0 ; i < n ; ++i)
+
+    // quantize all points into packed voxel keys first, then
+    // sort-unique the batch and bulk load it, instead of probing the
+    // map once per point
+    std::vector<CMap::Key> keys;
+    keys.reserve(n);
+
+    const float inv_res = (float)(1.0 / bi_.resolution);
+    unsigned int i = 0;
+#if defined __SSE2__
+    // four points per step: bounds masks and the scaled float-to-int
+    // conversion are done on all lanes at once
+    const __m128 ox = _mm_set1_ps((float)bi_.originX);
+    const __m128 oy = _mm_set1_ps((float)bi_.originY);
+    const __m128 oz = _mm_set1_ps((float)bi_.originZ);
+    const __m128 minx = _mm_set1_ps((float)bi_.real_minX), maxx = _mm_set1_ps((float)bi_.real_maxX);
+    const __m128 miny = _mm_set1_ps((float)bi_.real_minY), maxy = _mm_set1_ps((float)bi_.real_maxY);
+    const __m128 minz = _mm_set1_ps((float)bi_.real_minZ), maxz = _mm_set1_ps((float)bi_.real_maxZ);
+    const __m128 ir = _mm_set1_ps(inv_res);
+    const __m128 half = _mm_set1_ps(0.5f);
+    for ( ; i + 4 <= n ; i += 4)
+    {
+      const geometry_msgs::Point32 &p0 = cloud.points[i];
+      const geometry_msgs::Point32 &p1 = cloud.points[i + 1];
+      const geometry_msgs::Point32 &p2 = cloud.points[i + 2];
+      const geometry_msgs::Point32 &p3 = cloud.points[i + 3];
+      const __m128 x = _mm_set_ps(p3.x, p2.x, p1.x, p0.x);
+      const __m128 y = _mm_set_ps(p3.y, p2.y, p1.y, p0.y);
+      const __m128 z = _mm_set_ps(p3.z, p2.z, p1.z, p0.z);
+
+      __m128 inb = _mm_and_ps(_mm_cmpgt_ps(x, minx), _mm_cmplt_ps(x, maxx));
+      inb = _mm_and_ps(inb, _mm_and_ps(_mm_cmpgt_ps(y, miny), _mm_cmplt_ps(y, maxy)));
+      inb = _mm_and_ps(inb, _mm_and_ps(_mm_cmpgt_ps(z, minz), _mm_cmplt_ps(z, maxz)));
+      int mask = _mm_movemask_ps(inb);
+      if (!mask)
+        continue;
+
+      int qx[4], qy[4], qz[4];
+      _mm_storeu_si128((__m128i*)qx, _mm_cvttps_epi32(_mm_add_ps(half, _mm_mul_ps(_mm_sub_ps(x, ox), ir))));
+      _mm_storeu_si128((__m128i*)qy, _mm_cvttps_epi32(_mm_add_ps(half, _mm_mul_ps(_mm_sub_ps(y, oy), ir))));
+      _mm_storeu_si128((__m128i*)qz, _mm_cvttps_epi32(_mm_add_ps(half, _mm_mul_ps(_mm_sub_ps(z, oz), ir))));
+      for (int lane = 0 ; lane < 4 ; ++lane)
+        if (mask & (1 << lane))
+          keys.push_back(CMap::makeKey(qx[lane], qy[lane], qz[lane]));
+    }
+#endif
+    for ( ; i < n ; ++i)
     {
       const geometry_msgs::Point32 &p = cloud.points[i];
       if (p.x > bi_.real_minX && p.x < bi_.real_maxX && p.y > bi_.real_minY && p.y < bi_.real_maxY && p.z > bi_.real_minZ && p.z < bi_.real_maxZ)
-      {
-        c.x = (int)(0.5 + (p.x - bi_.originX) / bi_.resolution);
-        c.y = (int)(0.5 + (p.y - bi_.originY) / bi_.resolution);
-        c.z = (int)(0.5 + (p.z - bi_.originZ) / bi_.resolution);
-        map.insert(c);
-      }
+        keys.push_back(CMap::makeKey((int)(0.5f + (p.x - (float)bi_.originX) * inv_res),
+                                     (int)(0.5f + (p.y - (float)bi_.originY) * inv_res),
+                                     (int)(0.5f + (p.z - (float)bi_.originZ) * inv_res)));
     }
+
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    map.insertKeys(keys);
   }
     
   void publishCollisionMap(const CMap &map, 
@@ -773,10 +1178,260 @@ private:
       cmap.boxes.push_back(box);
     } 
     pub.publish(cmap);
-    
+
     ROS_DEBUG("Published collision map with %u boxes", ms);
   }
 
+  void collisionPointsToCenters(const std::vector<CollisionPoint> &pts, std::vector<geometry_msgs::Point32> &centers) const
+  {
+    centers.resize(pts.size());
+    for (unsigned int i = 0 ; i < pts.size() ; ++i)
+    {
+      centers[i].x = pts[i].x * bi_.resolution + bi_.originX;
+      centers[i].y = pts[i].y * bi_.resolution + bi_.originY;
+      centers[i].z = pts[i].z * bi_.resolution + bi_.originZ;
+    }
+  }
+
+  /** Publish the change set between the given map and the one passed
+      to the previous call; every deltaKeyframeInterval_ cycles (and
+      whenever the frame changes) a keyframe carrying the full map is
+      sent instead so late joiners and droppped messages recover */
+  void publishCollisionMapDelta(const CMap &map,
+                                const std::string &frame_id,
+                                const ros::Time &stamp)
+  {
+    arm_navigation_msgs::CollisionMapDelta delta;
+    delta.header.frame_id = frame_id;
+    delta.header.stamp = stamp;
+    delta.resolution = bi_.resolution;
+    delta.keyframe = (deltaCount_ % deltaKeyframeInterval_ == 0) || frame_id != lastDeltaFrame_;
+
+    std::vector<CollisionPoint> pts;
+    if (delta.keyframe)
+    {
+      map.getPoints(pts);
+      collisionPointsToCenters(pts, delta.added);
+    }
+    else
+    {
+      map.difference(lastDeltaMap_, pts);
+      collisionPointsToCenters(pts, delta.added);
+      pts.clear();
+      lastDeltaMap_.difference(map, pts);
+      collisionPointsToCenters(pts, delta.removed);
+    }
+
+    lastDeltaMap_ = map;
+    lastDeltaFrame_ = frame_id;
+    deltaCount_++;
+
+    cmapDeltaPublisher_.publish(delta);
+    ROS_DEBUG("Published collision map delta with %u additions, %u removals%s", (unsigned int)delta.added.size(),
+              (unsigned int)delta.removed.size(), delta.keyframe ? " (keyframe)" : "");
+  }
+
+  /** Publish the map in run-length encoded form; since the map is
+      already a grid of integer voxel coordinates, the runs are built
+      straight from the sorted points with no box expansion or
+      re-quantization step in between */
+  void publishCollisionMapCompact(const CMap &map,
+                                  const std::string &frame_id,
+                                  const ros::Time &stamp)
+  {
+    arm_navigation_msgs::CompactCollisionMap compact;
+    compact.header.frame_id = frame_id;
+    compact.header.stamp = stamp;
+    compact.resolution = bi_.resolution;
+    compact.origin.x = compact.origin.y = compact.origin.z = 0.0;
+
+    std::vector<CollisionPoint> pts;
+    map.getPoints(pts);
+    if (!pts.empty())
+    {
+      std::sort(pts.begin(), pts.end(), CollisionPointZYXOrder());
+
+      int min_x = pts[0].x, min_y = pts[0].y, min_z = pts[0].z;
+      for (unsigned int i = 1 ; i < pts.size() ; ++i)
+      {
+        if (pts[i].x < min_x) min_x = pts[i].x;
+        if (pts[i].y < min_y) min_y = pts[i].y;
+        if (pts[i].z < min_z) min_z = pts[i].z;
+      }
+      compact.origin.x = min_x * bi_.resolution + bi_.originX;
+      compact.origin.y = min_y * bi_.resolution + bi_.originY;
+      compact.origin.z = min_z * bi_.resolution + bi_.originZ;
+
+      for (unsigned int i = 0 ; i < pts.size() ; )
+      {
+        unsigned int j = i + 1;
+        while (j < pts.size() && pts[j].z == pts[i].z && pts[j].y == pts[i].y &&
+               pts[j].x == pts[j-1].x + 1 && j - i < 65535)
+          ++j;
+        compact.runs.push_back((uint16_t)(pts[i].x - min_x));
+        compact.runs.push_back((uint16_t)(pts[i].y - min_y));
+        compact.runs.push_back((uint16_t)(pts[i].z - min_z));
+        compact.runs.push_back((uint16_t)(j - i));
+        i = j;
+      }
+    }
+
+    cmapCompactPublisher_.publish(compact);
+    ROS_DEBUG("Published compact collision map with %u voxels in %u runs",
+              (unsigned int)pts.size(), (unsigned int)(compact.runs.size() / 4));
+  }
+
+  static void writeString(std::ofstream &out, const std::string &s)
+  {
+    unsigned int len = s.size();
+    out.write((const char*)&len, sizeof(len));
+    out.write(s.data(), len);
+  }
+
+  static bool readString(std::ifstream &in, std::string &s)
+  {
+    unsigned int len = 0;
+    if (!in.read((char*)&len, sizeof(len)) || len > (1u << 20))
+      return false;
+    s.resize(len);
+    if (len > 0 && !in.read(&s[0], len))
+      return false;
+    return true;
+  }
+
+  static bool isStaticMapName(const std::string &name)
+  {
+    return name.size() > 7 && name.compare(name.size() - 7, 7, "_static") == 0;
+  }
+
+  /** Persist the most recent static map of every source to
+      staticMapFile_ (keys + metadata); the file is written under a
+      temporary name and renamed into place, so a crash mid-write
+      never leaves a truncated map behind */
+  void saveStaticMaps(void)
+  {
+    if (staticMapFile_.empty())
+      return;
+
+    std::string tmp_name = staticMapFile_ + ".tmp";
+    std::ofstream out(tmp_name.c_str(), std::ios::out | std::ios::binary);
+    if (!out)
+    {
+      ROS_WARN("Unable to write static collision map file '%s'", staticMapFile_.c_str());
+      return;
+    }
+
+    unsigned int magic = STATIC_MAP_MAGIC;
+    unsigned int version = STATIC_MAP_VERSION;
+    out.write((const char*)&magic, sizeof(magic));
+    out.write((const char*)&version, sizeof(version));
+    out.write((const char*)&bi_.resolution, sizeof(bi_.resolution));
+    out.write((const char*)&bi_.originX, sizeof(bi_.originX));
+    out.write((const char*)&bi_.originY, sizeof(bi_.originY));
+    out.write((const char*)&bi_.originZ, sizeof(bi_.originZ));
+
+    unsigned int nmaps = 0;
+    for (std::map<std::string, std::list<StampedCMap*> >::iterator it = currentMaps_.begin(); it != currentMaps_.end(); it++)
+      if (isStaticMapName(it->first) && !it->second.empty())
+        nmaps++;
+    out.write((const char*)&nmaps, sizeof(nmaps));
+
+    for (std::map<std::string, std::list<StampedCMap*> >::iterator it = currentMaps_.begin(); it != currentMaps_.end(); it++)
+    {
+      if (!isStaticMapName(it->first) || it->second.empty())
+        continue;
+      const StampedCMap *sm = it->second.front();
+      writeString(out, it->first);
+      writeString(out, sm->frame_id);
+      std::vector<CollisionPoint> pts;
+      sm->cmap.getPoints(pts);
+      unsigned int nkeys = pts.size();
+      out.write((const char*)&nkeys, sizeof(nkeys));
+      for (unsigned int i = 0 ; i < nkeys ; ++i)
+      {
+        CMap::Key k = CMap::makeKey(pts[i].x, pts[i].y, pts[i].z);
+        out.write((const char*)&k, sizeof(k));
+      }
+    }
+
+    out.close();
+    if (!out || ::rename(tmp_name.c_str(), staticMapFile_.c_str()) != 0)
+    {
+      ROS_WARN("Unable to write static collision map file '%s'", staticMapFile_.c_str());
+      ::remove(tmp_name.c_str());
+    }
+    else
+      ROS_DEBUG("Persisted %u static map(s) to '%s'", nmaps, staticMapFile_.c_str());
+  }
+
+  /** Reload static maps persisted by a previous run; the file is
+      ignored if its grid metadata does not match the current
+      parameters, since the voxel keys would mean something else */
+  void loadStaticMaps(void)
+  {
+    if (staticMapFile_.empty())
+      return;
+
+    std::ifstream in(staticMapFile_.c_str(), std::ios::in | std::ios::binary);
+    if (!in)
+      return;
+
+    unsigned int magic = 0, version = 0, nmaps = 0;
+    double res = 0.0, ox = 0.0, oy = 0.0, oz = 0.0;
+    in.read((char*)&magic, sizeof(magic));
+    in.read((char*)&version, sizeof(version));
+    in.read((char*)&res, sizeof(res));
+    in.read((char*)&ox, sizeof(ox));
+    in.read((char*)&oy, sizeof(oy));
+    in.read((char*)&oz, sizeof(oz));
+    if (!in || magic != STATIC_MAP_MAGIC || version != STATIC_MAP_VERSION)
+    {
+      ROS_WARN("Static collision map file '%s' is not readable; ignoring it", staticMapFile_.c_str());
+      return;
+    }
+    if (fabs(res - bi_.resolution) > 1e-9 || fabs(ox - bi_.originX) > 1e-9 || fabs(oy - bi_.originY) > 1e-9 || fabs(oz - bi_.originZ) > 1e-9)
+    {
+      ROS_WARN("Static collision map file '%s' was built with different grid parameters; ignoring it", staticMapFile_.c_str());
+      return;
+    }
+
+    in.read((char*)&nmaps, sizeof(nmaps));
+    unsigned int total = 0;
+    for (unsigned int m = 0 ; in && m < nmaps ; ++m)
+    {
+      std::string name, frame;
+      unsigned int nkeys = 0;
+      if (!readString(in, name) || !readString(in, frame) || !in.read((char*)&nkeys, sizeof(nkeys)))
+        break;
+      std::vector<CMap::Key> keys(nkeys);
+      if (nkeys > 0 && !in.read((char*)&keys[0], nkeys * sizeof(CMap::Key)))
+        break;
+
+      StampedCMap *static_map = new StampedCMap();
+      static_map->frame_id = frame;
+      static_map->stamp = ros::Time::now();
+      static_map->cmap.insertKeys(keys);
+      currentMaps_[name].push_front(static_map);
+
+      std::string topic = name.substr(0, name.size() - 7);
+      if (static_map_published_.find(topic) != static_map_published_.end())
+        static_map_published_[topic] = true;
+      total += nkeys;
+    }
+
+    if (!currentMaps_.empty())
+    {
+      ROS_INFO("Restored %u voxels of static collision map from '%s'", total, staticMapFile_.c_str());
+      CMap uni;
+      composeMapUnion(currentMaps_, uni);
+      publishCollisionMap(uni, robotFrame_, ros::Time::now(), cmapPublisher_);
+      if (publishDeltas_)
+        publishCollisionMapDelta(uni, robotFrame_, ros::Time::now());
+      if (publishCompact_)
+        publishCollisionMapCompact(uni, robotFrame_, ros::Time::now());
+    }
+  }
+
   void makeStaticCollisionMap(const arm_navigation_msgs::MakeStaticCollisionMapGoalConstPtr& goal) {
     
     if(cloud_source_map_.find(goal->cloud_source) == cloud_source_map_.end())
@@ -841,15 +1496,33 @@ private:
   //robot_self_filter::SelfMask                  *sm_;
   //filters::SelfFilter<sensor_msgs::PointCloud> *self_filter_;
   std::vector<message_filters::Subscriber<sensor_msgs::PointCloud>* > mn_cloud_tf_sub_vector_;
+  std::vector<ros::Subscriber> shm_cloud_sub_vector_;
+  arm_navigation_msgs::ShmCloudReader shm_reader_;
   std::vector<tf::MessageFilter<sensor_msgs::PointCloud>* > mn_cloud_tf_fil_vector_;
   //tf::MessageNotifier<sensor_msgs::PointCloud> *mnCloudIncremental_;
   ros::NodeHandle                               root_handle_;
   ros::Publisher                                cmapPublisher_;
   ros::Publisher                                cmapUpdPublisher_;
-  ros::Publisher static_map_publisher_;           
+  ros::Publisher static_map_publisher_;
+  ros::Publisher                                cmapDeltaPublisher_;
+  ros::Publisher                                cmapCompactPublisher_;
   std::map<std::string, ros::Publisher>         occPublisherMap_;
   ros::ServiceServer                            resetService_;
   bool                                          publishOcclusion_;
+
+  bool                                          publishDeltas_;
+  bool                                          publishCompact_;
+  int                                           deltaKeyframeInterval_;
+  int                                           deltaCount_;
+  CMap                                          lastDeltaMap_;
+  std::string                                   lastDeltaFrame_;
+
+  static const unsigned int                     STATIC_MAP_MAGIC = 0x70614D43;
+  static const unsigned int                     STATIC_MAP_VERSION = 1;
+  std::string                                   staticMapFile_;
+
+  int                                           occlusionBudget_;
+  double                                        occlusionTimeout_;
     
   arm_navigation_msgs::MakeStaticCollisionMapGoal *static_map_goal_;
   bool making_static_collision_map_;
@@ -878,7 +1551,11 @@ private:
 
 void spinThread()
 {
-  ros::spin();
+  // one callback thread per core so clouds from independent sensor
+  // topics are processed concurrently; callbacks of a single
+  // subscription are still invoked in order, one at a time
+  ros::MultiThreadedSpinner spinner;
+  spinner.spin();
 }
   
 int main (int argc, char** argv)
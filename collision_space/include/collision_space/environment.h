@@ -102,6 +102,53 @@ public:
 
   typedef std::map<std::string, std::map<std::string, std::vector<AllowedContact> > > AllowedContactMap;
 
+  /** \brief A caller-owned pool of Contact entries that retains its
+      storage (including the body name strings) across queries, so
+      repeated contact queries at monitoring rates are
+      allocation-free once the pool has reached its high-water mark. */
+  class ContactPool
+  {
+  public:
+
+    ContactPool() : used_(0)
+    {
+    }
+
+    /** \brief Mark the pool empty without releasing any storage */
+    void reset()
+    {
+      used_ = 0;
+    }
+
+    /** \brief Get the next free contact, growing the pool only past its high-water mark */
+    Contact& alloc()
+    {
+      if (used_ == contacts_.size())
+        contacts_.resize(used_ + 1);
+      return contacts_[used_++];
+    }
+
+    unsigned int size() const
+    {
+      return used_;
+    }
+
+    const Contact& at(unsigned int i) const
+    {
+      return contacts_[i];
+    }
+
+    Contact& at(unsigned int i)
+    {
+      return contacts_[i];
+    }
+
+  private:
+
+    std::vector<Contact> contacts_;
+    unsigned int used_;
+  };
+
   /** \brief Definition of a structure for the allowed collision matrix */
   /* False means that no collisions are allowed, true means ok */
   class AllowedCollisionMatrix
@@ -110,6 +157,7 @@ public:
     
     AllowedCollisionMatrix(){
       valid_ = true;
+      compiled_valid_ = false;
     }
 
     AllowedCollisionMatrix(const std::vector<std::string>& names,
@@ -160,6 +208,24 @@ public:
 
     void getAllEntryNames(std::vector<std::string>& names) const;
 
+    /** \brief Compile the matrix into a packed triangular bitset so
+        index-resolved queries are a single O(1) bit test. The
+        compiled form is invalidated by any change to the matrix. */
+    void compile() const;
+
+    bool isCompiled() const {
+      return compiled_valid_;
+    }
+
+    /** \brief O(1) query on the compiled bitset. Indices must be
+        valid and compile() must have been called. */
+    bool getAllowedCollisionCompiled(unsigned int i, unsigned int j) const {
+      if(i < j) {
+        unsigned int t = i; i = j; j = t;
+      }
+      return compiled_entries_[(i * (i + 1)) / 2 + j];
+    }
+
     bool getValid() const {
       return valid_;
     };
@@ -181,6 +247,10 @@ public:
     bool valid_;
     std::vector<std::vector<bool> > allowed_entries_;
 
+    /** \brief Packed triangular form of allowed_entries_, built by compile() */
+    mutable std::vector<bool> compiled_entries_;
+    mutable bool compiled_valid_;
+
     entry_type allowed_entries_bimap_;
   };
 
@@ -189,6 +259,7 @@ public:
     verbose_ = false;
     objects_ = new EnvironmentObjects();
     use_altered_collision_matrix_ = false;
+    modification_epoch_ = 0;
   }
 	
   virtual ~EnvironmentModel(void)
@@ -222,6 +293,17 @@ public:
   /** \brief Update the positions of the geometry used in collision detection */
   virtual void updateRobotModel(const planning_models::KinematicState* state) = 0;
 
+  /** \brief Update the positions of the collision geometry for the
+      indicated links only. Links not named are assumed not to have
+      moved since the last update; the names of the moved links can be
+      obtained from the JointStateGroup that changed. The default
+      implementation updates all links. */
+  virtual void updateRobotModel(const planning_models::KinematicState* state,
+                                const std::vector<std::string>& changed_links)
+  {
+    updateRobotModel(state);
+  }
+
   /** \brief Update the set of bodies that are attached to the robot (re-creates them) */
   virtual void updateAttachedBodies() = 0;
 		
@@ -262,6 +344,45 @@ public:
   /** \brief This function will get the complete list of contacts between any two potentially colliding bodies.  The num per contacts specifies the number of contacts per pair that will be returned */
   virtual bool getAllCollisionContacts(std::vector<Contact> &contacts, unsigned int num_per_contact = 1) const = 0;
 
+  /** \brief Same as the vector form, but fills a reusable caller-owned
+      pool. The default implementation copies out of a temporary
+      vector; implementations may override this to write into the pool
+      directly so the query does not allocate. */
+  virtual bool getAllCollisionContacts(ContactPool &pool, unsigned int num_per_contact = 1) const;
+
+  /** \brief Get the clearance between a robot link (including its
+      padding) and the environment obstacles. Pairs whose bounding
+      boxes are further apart than distance_threshold are skipped, and
+      distance is capped at distance_threshold when nothing is
+      closer. The reported distance is conservative: it never
+      overestimates the true clearance. Returns false if distance
+      queries are not supported by the implementation or the link is
+      unknown. */
+  virtual bool getDistanceRobotToEnvironment(const std::string& link_name,
+                                             double distance_threshold,
+                                             double& distance) const
+  {
+    return false;
+  }
+
+  /** \brief Check the motion between two states for collision. The
+      default implementation only checks the endpoints and the
+      midpoint; implementations may override this with a swept check
+      so thin obstacles cannot be tunneled through. Returns true if
+      any part of the motion collides. The states are interpolated
+      linearly in joint space. */
+  virtual bool isTrajectorySegmentInCollision(const planning_models::KinematicState* from,
+                                              const planning_models::KinematicState* to);
+
+  /** \brief Check a batch of states for collision in one call. The
+      collisions vector is resized to match the states vector, with
+      one entry per state. Returns true if any state is in
+      collision. The default implementation checks the states
+      serially; implementations may override this to distribute the
+      batch over multiple threads. */
+  virtual bool checkStatesBatch(const std::vector<planning_models::KinematicState*> &states,
+                                std::vector<bool> &collisions);
+
   /**********************************************************************/
   /* Collision Bodies                                                   */
   /**********************************************************************/
@@ -284,6 +405,28 @@ public:
   /** \brief Add a set of collision objects to the map. The user releases ownership of the passed objects. Memory allocated for the shapes is freed by the collision environment.*/
   virtual void addObjects(const std::string &ns, const std::vector<shapes::Shape*> &shapes, const std::vector<tf::Transform> &poses) = 0;
 
+  /** \brief Start a batch of object additions. Broadphase setup and
+      bounds updates for the touched namespaces are deferred until
+      commitObjectBatch(), so a scene carrying many objects pays one
+      rebuild instead of one per addition. The default implementation
+      does nothing, for backends without deferrable setup. */
+  virtual void beginObjectBatch(void)
+  {
+  }
+
+  /** \brief Commit a batch of object additions started with
+      beginObjectBatch() */
+  virtual void commitObjectBatch(void)
+  {
+  }
+
+  /** \brief Remove individual objects from a namespace, identified by
+      the shape pointers the environment owns. Memory for the removed
+      shapes is freed. The default implementation rebuilds the
+      namespace without the removed objects; implementations may
+      override this to destroy only the affected geoms. */
+  virtual void removeObjects(const std::string &ns, const std::vector<const shapes::Shape*> &shapes);
+
   virtual void getAttachedBodyPoses(std::map<std::string, std::vector<tf::Transform> >& pose_map) const = 0;
 
   /** \briefs Sets a temporary robot padding on the indicated links */
@@ -308,9 +451,16 @@ public:
   /** \brief set the matrix for collision touch to use in lieu of the default settings */
   virtual void setAlteredCollisionMatrix(const AllowedCollisionMatrix& acm);
 
-  /** \brief reverts to using default settings for allowed collisions */  
+  /** \brief reverts to using default settings for allowed collisions */
   virtual void revertAlteredCollisionMatrix();
 
+  /** \brief Restrict self collision testing to geom pairs where at
+      least one body belongs to an updated link of the named group (as
+      configured on the robot model). Pairs of links the group cannot
+      move are skipped entirely. An empty name reverts to the full
+      pair set. */
+  virtual void setSelfCollisionGroupScope(const std::string& group_name);
+
   /** \brief sets the allowed contacts that will be used in collision checking */
   virtual void setAllowedContacts(const std::vector<AllowedContact>& allowed_contacts);
 
@@ -318,9 +468,10 @@ public:
   const std::vector<AllowedContact>& getAllowedContacts() const;
   
   /** \brief clear out all allowed contacts */
-  void clearAllowedContacts() {
+  virtual void clearAllowedContacts() {
     allowed_contact_map_.clear();
     allowed_contacts_.clear();
+    bumpModificationEpoch();
   }
 
   /**********************************************************************/
@@ -333,6 +484,15 @@ public:
   /** \brief Provide interface to a lock. Use carefully! */
   void unlock(void) const;
 
+  /** \brief Monotonic counter bumped by every structural write
+      (objects added or removed, robot model, padding or collision
+      matrix changed). Reader threads that each hold a clone() can
+      compare the epoch they cloned at against the master's and
+      re-clone only when it moved, instead of serializing every query
+      through lock(). Setting the robot state with updateRobotModel()
+      on a private clone does not count as a structural write. */
+  unsigned long getModificationEpoch(void) const;
+
   /** \brief Enable/disable verbosity */
   void setVerbose(bool verbose);
 	
@@ -347,6 +507,13 @@ protected:
   /** \brief Mutex used to lock the datastructure */
   mutable boost::recursive_mutex lock_;
 
+  /** \brief Called by derived classes whenever the environment
+      structure changes, so snapshot holders can detect staleness */
+  void bumpModificationEpoch(void);
+
+  /** \brief Structural modification counter, see getModificationEpoch() */
+  unsigned long modification_epoch_;
+
   /** \brief Flag to indicate whether verbose mode is on */
   bool verbose_;
 
@@ -367,6 +534,9 @@ protected:
 
   bool use_altered_collision_matrix_;
 
+  /** \brief Group the self collision pass is scoped to; empty means all pairs are tested */
+  std::string self_collision_group_scope_;
+
   std::map<std::string, double> default_link_padding_map_;
   std::map<std::string, double> altered_link_padding_map_;
 
@@ -39,7 +39,10 @@
 
 #include "collision_space/environment.h"
 #include <ode/ode.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/barrier.hpp>
 #include <map>
+#include <set>
 
 namespace collision_space
 {
@@ -61,6 +64,32 @@ public:
   /** \brief This function will get the complete list of contacts between any two potentially colliding bodies.  The num per contacts specifies the number of contacts per pair that will be returned */
   virtual bool getAllCollisionContacts(std::vector<Contact> &contacts, unsigned int num_per_contact = 1) const;
 
+  /** \brief Same as the vector form, but writes directly into a reusable caller-owned pool so the query does not allocate */
+  virtual bool getAllCollisionContacts(ContactPool &pool, unsigned int num_per_contact = 1) const;
+
+  /** \brief Check a batch of states for collision, distributing the
+      states over a pool of worker threads. Each worker gets its own
+      clone of the environment and its own ODE scratch space, so the
+      states in the batch are checked concurrently. */
+  virtual bool checkStatesBatch(const std::vector<planning_models::KinematicState*> &states,
+                                std::vector<bool> &collisions);
+
+  /** \brief Get a conservative clearance between a robot link and the
+      environment, based on geom bounding boxes with exact refinement
+      where the shapes allow it. Pairs further apart than
+      distance_threshold cost only an AABB test. */
+  virtual bool getDistanceRobotToEnvironment(const std::string& link_name,
+                                             double distance_threshold,
+                                             double& distance) const;
+
+  /** \brief Check the motion between two states for collision using
+      conservative advancement: a sub-segment is accepted only when
+      every link's clearance to the environment exceeds a bound on how
+      far that link can move across the sub-segment, and bisected
+      otherwise, so thin obstacles cannot be tunneled through. */
+  virtual bool isTrajectorySegmentInCollision(const planning_models::KinematicState* from,
+                                              const planning_models::KinematicState* to);
+
   /** \brief Check if a model is in collision */
   virtual bool isCollision(void) const;
 
@@ -102,6 +131,18 @@ public:
   /** \brief Add a set of collision objects to the map. The user releases ownership of the passed objects. Memory allocated for the shapes is freed by the collision environment. */
   virtual void addObjects(const std::string &ns, const std::vector<shapes::Shape*> &shapes, const std::vector<tf::Transform> &poses);
 
+  /** \brief Defer collide2 setup and namespace bounds for added
+      objects until the matching commitObjectBatch() */
+  virtual void beginObjectBatch(void);
+
+  /** \brief Set up the broadphase and bounds of every namespace the
+      batch touched, in one pass */
+  virtual void commitObjectBatch(void);
+
+  /** \brief Remove individual objects from a namespace, destroying
+      only the affected geoms; the rest of the namespace is untouched */
+  virtual void removeObjects(const std::string &ns, const std::vector<const shapes::Shape*> &shapes);
+
   virtual void getAttachedBodyPoses(std::map<std::string, std::vector<tf::Transform> >& pose_map) const;
 
   /** \brief Add a robot model. Ignore robot links if their name is not
@@ -119,21 +160,102 @@ public:
   /** \brief Update the positions of the geometry used in collision detection */
   virtual void updateRobotModel(const planning_models::KinematicState* state);
 
+  /** \brief Update only the geometry for the indicated links, skipping untouched geoms */
+  virtual void updateRobotModel(const planning_models::KinematicState* state,
+                                const std::vector<std::string>& changed_links);
+
   /** \brief Update the set of bodies that are attached to the robot (re-creates them) */
   virtual void updateAttachedBodies(void);
 
   /** \brief Update the set of bodies that are attached to the robot (re-creates them) using the indicated padding or default if non-specified */
   virtual void updateAttachedBodies(const std::map<std::string, double>& link_padding_map);
 
+  /** \brief Set the matrix for collision touch to use in lieu of the default settings; invalidates the compiled self-collision pair list */
+  virtual void setAlteredCollisionMatrix(const AllowedCollisionMatrix& acm);
+
+  /** \brief Reverts to using default settings for allowed collisions; invalidates the compiled self-collision pair list */
+  virtual void revertAlteredCollisionMatrix();
+
+  /** \brief Sets the allowed contacts and compiles them into per-pair
+      region lists with precomputed bounding spheres */
+  virtual void setAllowedContacts(const std::vector<AllowedContact>& allowed_contacts);
+
+  /** \brief Clears the allowed contacts and the compiled region lists */
+  virtual void clearAllowedContacts();
+
   /** \briefs Sets a temporary robot padding on the indicated links */
   virtual void setAlteredLinkPadding(const std::map<std::string, double>& link_padding_map);
 
   /** \briefs Reverts link padding to that set at robot initialization */
   virtual void revertAlteredLinkPadding();
 
-  /** \brief Clone the environment */
+  /** \brief Clone the environment. Static environment geometry is
+      shared copy-on-write between the clone and the original, so the
+      clone is cheap even when large meshes are loaded; only the robot
+      body geoms are rebuilt per clone. */
   virtual EnvironmentModel* clone(void) const;
 
+  /** \brief Per-pair counters gathered during queries while
+      statistics are enabled. The counters accumulate until the next
+      resetQueryStatistics() so a whole planning episode can be
+      profiled at once. */
+  struct QueryStatistics
+  {
+    struct PairStats
+    {
+      PairStats() : narrowphase_calls(0), contacts(0), nanoseconds(0)
+      {
+      }
+
+      unsigned int narrowphase_calls;
+      unsigned int contacts;
+      unsigned long long nanoseconds;
+    };
+
+    QueryStatistics() : narrowphase_calls(0), contacts(0), nanoseconds(0)
+    {
+    }
+
+    void clear()
+    {
+      pairs.clear();
+      narrowphase_calls = 0;
+      contacts = 0;
+      nanoseconds = 0;
+    }
+
+    std::map<std::pair<std::string, std::string>, PairStats> pairs;
+    unsigned int narrowphase_calls;
+    unsigned int contacts;
+    unsigned long long nanoseconds;
+  };
+
+  /** \brief Enable or disable the gathering of per-pair query
+      statistics. When disabled (the default) the hot path only pays a
+      null pointer check. Enabling clears any previous counters. */
+  void enableQueryStatistics(bool enable);
+
+  /** \brief Clear the accumulated query statistics */
+  void resetQueryStatistics();
+
+  /** \brief Get the statistics accumulated since the last reset */
+  const QueryStatistics& getQueryStatistics() const;
+
+  /** \brief Print the accumulated statistics, most expensive pairs first */
+  void printQueryStatistics(std::ostream& out) const;
+
+  /** \brief Enable or disable coarse-then-fine environment checking.
+      When enabled, mesh links are first probed against the environment
+      with a bounding sphere and the trimesh narrowphase only runs when
+      the probe hits. Cheaper for sampling-based planners, where most
+      states are nowhere near contact; states in contact pay for both
+      phases, so callers that mostly query colliding states should
+      leave this off. */
+  void setTwoPhaseEnvironmentCheck(bool enable);
+
+  /** \brief Tells whether coarse-then-fine environment checking is on */
+  bool getTwoPhaseEnvironmentCheck(void) const;
+
 protected:
 
   /** \brief Structure for maintaining ODE temporary data */
@@ -146,6 +268,9 @@ protected:
       dTriMeshDataID data;
       int n_indices;
       int n_vertices;
+      /** \brief True when the buffers belong to the trimesh cache; the
+          storage must not free them */
+      bool shared;
     };
 	    
     ~ODEStorage(void)
@@ -160,9 +285,12 @@ protected:
       }
 
       Element& e = meshes[id];
-      delete[] e.indices;
-      delete[] e.vertices;
-      dGeomTriMeshDataDestroy(e.data);
+      if (!e.shared)
+      {
+        delete[] e.indices;
+        delete[] e.vertices;
+        dGeomTriMeshDataDestroy(e.data);
+      }
       meshes.erase(id);
     }
 	    
@@ -172,6 +300,8 @@ protected:
           it != meshes.end();
           it++)
       {
+        if (it->second.shared)
+          continue;
         delete[] it->second.indices;
         delete[] it->second.vertices;
         dGeomTriMeshDataDestroy(it->second.data);
@@ -182,6 +312,29 @@ protected:
     /* Pointers for ODE indices; we need this around in ODE's assumed datatype */
     std::map<dGeomID, Element> meshes;
   };
+
+  /** \brief Built trimesh data keyed by mesh content (and the scale
+      and padding baked into the vertices). Planning scenes re-add the
+      same environment meshes over and over; the cache makes every add
+      after the first skip the expensive dTriMeshData build. Entries
+      live for the lifetime of the environment. */
+  struct TriMeshCache
+  {
+    ~TriMeshCache(void)
+    {
+      for(std::map<std::string, ODEStorage::Element>::iterator it = entries.begin();
+          it != entries.end();
+          it++)
+      {
+        delete[] it->second.indices;
+        delete[] it->second.vertices;
+        dGeomTriMeshDataDestroy(it->second.data);
+      }
+      entries.clear();
+    }
+
+    std::map<std::string, ODEStorage::Element> entries;
+  };
 	
   class ODECollide2
   {
@@ -201,6 +354,10 @@ protected:
 	    
     void registerSpace(dSpaceID space);
     void registerGeom(dGeomID geom);
+    /** \brief Register a batch of geoms at once; if the arrays are
+        already sorted the batch is sorted separately and merged in,
+        avoiding a full re-sort */
+    void registerGeoms(const std::vector<dGeomID> &geoms);
     void unregisterGeom(dGeomID geom);
     void clear(void);
     void setup(void);
@@ -307,6 +464,10 @@ protected:
     std::vector<dGeomID> padded_geom;
     const planning_models::KinematicModel::AttachedBodyModel *att;
     unsigned int index;
+    /** \brief Content key the geoms were built under (object name,
+        shape data, scale, padding); identifies the park slot these
+        geoms return to when the body is detached */
+    std::string park_key;
   };
 
   struct LinkGeom
@@ -321,6 +482,11 @@ protected:
       for(unsigned int i = 0; i < padded_geom.size(); i++) {
         dGeomDestroy(padded_geom[i]);
       }
+      for(unsigned int i = 0; i < coarse_geom.size(); i++) {
+        if(coarse_geom[i]) {
+          dGeomDestroy(coarse_geom[i]);
+        }
+      }
       deleteAttachedBodies();
     }
     
@@ -335,6 +501,10 @@ protected:
     ODEStorage& storage;
     std::vector<dGeomID> geom;
     std::vector<dGeomID> padded_geom;
+    /** \brief Coarse bounding-sphere proxies for the padded mesh
+        geoms, created lazily when two-phase checking is enabled; NULL
+        for geoms that are cheap to collide directly */
+    std::vector<dGeomID> coarse_geom;
     std::vector<AttGeom*> att_bodies;
     const planning_models::KinematicModel::LinkModel *link;
     unsigned int index;
@@ -354,7 +524,7 @@ protected:
 	
   struct CollisionNamespace
   {
-    CollisionNamespace(const std::string &nm) : name(nm)
+    CollisionNamespace(const std::string &nm) : name(nm), batch_query(false), bounds_valid(false)
     {
       space = dHashSpaceCreate(0);
     }
@@ -375,6 +545,36 @@ protected:
       geoms.clear();
       collide2.clear();
       storage.clear();
+      batch_query = false;
+      bounds_valid = false;
+    }
+
+    /** \brief Union AABB over the geoms in the namespace. Objects do
+        not move once added, so the cache only invalidates when the
+        namespace contents change. */
+    const dReal* getBounds() const
+    {
+      if(!bounds_valid) {
+        for(unsigned int i = 0; i < 3; i++) {
+          bounds[2 * i] = dInfinity;
+          bounds[2 * i + 1] = -dInfinity;
+        }
+        int n = dSpaceGetNumGeoms(space);
+        for(int i = 0; i < n; i++) {
+          dReal aabb[6];
+          dGeomGetAABB(dSpaceGetGeom(space, i), aabb);
+          for(unsigned int k = 0; k < 3; k++) {
+            if(aabb[2 * k] < bounds[2 * k]) {
+              bounds[2 * k] = aabb[2 * k];
+            }
+            if(aabb[2 * k + 1] > bounds[2 * k + 1]) {
+              bounds[2 * k + 1] = aabb[2 * k + 1];
+            }
+          }
+        }
+        bounds_valid = true;
+      }
+      return bounds;
     }
 	    
     std::string name;
@@ -382,12 +582,57 @@ protected:
     std::vector<dGeomID> geoms;
     ODECollide2 collide2;
     ODEStorage storage;
+    /** \brief When true the namespace holds a large batch of uniformly
+        sized boxes (a collision map); queries then go through the hash
+        space as a single broadphase entry instead of registering
+        thousands of geoms in collide2 */
+    bool batch_query;
+    /** \brief Cached union AABB over the namespace geoms */
+    mutable dReal bounds[6];
+    mutable bool bounds_valid;
   };
     
+  /** \brief Per-geom record resolved once at registration time so the
+      collision near-callback does not do string lookups */
+  struct GeomLookup
+  {
+    GeomLookup() : type(LINK), acm_index(0), has_acm_index(false)
+    {
+    }
+
+    GeomLookup(const std::string& nm, BodyType t, unsigned int index) :
+      name(nm), type(t), acm_index(index), has_acm_index(true)
+    {
+    }
+
+    std::string name;
+    BodyType type;
+    /** \brief Index of this body in the allowed collision matrix, for the compiled bitset fast path */
+    unsigned int acm_index;
+    bool has_acm_index;
+  };
+
+  /** \brief An allowed contact region compiled for the near callback:
+      the region body with its depth bound plus a precomputed bounding
+      sphere, so containment only runs for contact points that are at
+      least inside the sphere */
+  struct CompiledAllowedContact
+  {
+    boost::shared_ptr<bodies::Body> bound;
+    double depth;
+    tf::Vector3 center;
+    double radius2;
+  };
+
+  /** \brief Compiled allowed contact regions grouped per body pair,
+      with both name orders present */
+  typedef std::map<std::pair<std::string, std::string>, std::vector<CompiledAllowedContact> > CompiledAllowedContactMap;
+
   struct CollisionData
   {
     CollisionData(void)
     {
+      stats = NULL;
       done = false;
       collides = false;
       max_contacts_total = 0;
@@ -395,20 +640,31 @@ protected:
       contacts = NULL;
       allowed_collision_matrix = NULL;
       allowed = NULL;
+      contact_pool = NULL;
+      pair_list_prefiltered = false;
     }
 
     //these are parameters
     unsigned int max_contacts_total;
     unsigned int max_contacts_pair;
     const AllowedCollisionMatrix *allowed_collision_matrix;
-    const std::map<dGeomID, std::pair<std::string, BodyType> >* geom_lookup_map;
+    const std::map<dGeomID, GeomLookup>* geom_lookup_map;
     const std::map<std::string, dSpaceID>* dspace_lookup_map;
-    const AllowedContactMap *allowed;
+    const CompiledAllowedContactMap *allowed;
+
+    //set when the pair being tested came from the compiled pair list,
+    //which has already applied the allowed collision matrix
+    bool pair_list_prefiltered;
+
+    //when set, narrowphase counters and timings are accumulated here
+    QueryStatistics *stats;
 	    
     //these are for return info
     bool done;
     bool collides;
     std::vector<EnvironmentModelODE::Contact> *contacts;
+    //when set, contacts are written here instead of into the vector
+    ContactPool *contact_pool;
     
     //for the last collision found
     std::string body_name_1;
@@ -425,9 +681,25 @@ protected:
   /** \brief Internal function for collision detection */
   void testCollision(CollisionData *data) const;
 
+  /** \brief Copy the scratch pool's contacts into the output vector
+      with a single sized resize */
+  void copyScratchContacts(std::vector<Contact> &contacts) const;
+
   /** \brief Internal function for collision detection */
   void testSelfCollision(CollisionData *data) const;
 
+  /** \brief Compile the flat list of self-collision geom pairs
+      admitted by the current allowed collision matrix, so the
+      self-collision scan does no matrix lookups at query time */
+  void compileSelfCollisionPairList() const;
+
+  /** \brief Self-collision pairs to traverse for the current group
+      scope: the full compiled list when no scope is set, otherwise a
+      cached subset holding only pairs where at least one geom moves
+      with the scoped group. Built lazily per group and kept until
+      the pair list itself is recompiled */
+  std::vector<std::pair<unsigned int, unsigned int> >& scopedSelfCollisionPairs() const;
+
   /** \brief Internal function for collision detection */
   void testEnvironmentCollision(CollisionData *data) const;
 
@@ -444,7 +716,8 @@ protected:
   void testObjectCollision(CollisionNamespace *cn, CollisionData *data) const;
   
   dGeomID copyGeom(dSpaceID space, ODEStorage &storage, dGeomID geom, ODEStorage &sourceStorage) const;
-  void createODERobotModel();	
+  void createODERobotModel();
+  void updateLinkGeom(LinkGeom* lg, const planning_models::KinematicState::LinkState* link_state);
   dGeomID createODEGeom(dSpaceID space, ODEStorage &storage, const shapes::Shape *shape, double scale, double padding);
   dGeomID createODEGeom(dSpaceID space, ODEStorage &storage, const shapes::StaticShape *shape);
   void updateGeom(dGeomID geom, const tf::Transform &pose) const;	
@@ -452,17 +725,127 @@ protected:
   void addAttachedBody(LinkGeom* lg, const planning_models::KinematicModel::AttachedBodyModel* attm,
                        double padd);
 
+  /** \brief Remove an attached body's geoms from their spaces and park
+      them under the body's content key for later re-attachment */
+  void parkAttachedBody(AttGeom* attg);
+
+  /** \brief Destroy all parked attached-body geoms */
+  void clearParkedAttachedBodies();
+
   std::map<std::string, bool> attached_bodies_in_collision_matrix_;
 
+  /** \brief Detached attached-body geoms retained for reuse, keyed by
+      object name and shape content together with scale and padding;
+      re-attaching the same object becomes a transform update instead
+      of a geom (and trimesh) rebuild */
+  std::map<std::string, std::vector<AttGeom*> > parked_att_geoms_;
+
+  /** \brief Total geoms parked across all keys, bounding the pool */
+  unsigned int parked_att_geom_count_;
+
   void setAttachedBodiesLinkPadding();
   void revertAttachedBodiesLinkPadding();
 
-  void freeMemory(void);	
-	
+  /** \brief Recursive helper for isTrajectorySegmentInCollision */
+  bool testSegmentSwept(const std::vector<double>& from_vals,
+                        const std::vector<double>& to_vals,
+                        planning_models::KinematicState& state,
+                        unsigned int depth);
+
+  /** \brief Worker for checkStatesBatch; checks every stride-th state starting at start on the given environment */
+  static void batchCheckWorker(EnvironmentModelODE* env,
+                               const std::vector<planning_models::KinematicState*>* states,
+                               std::vector<unsigned char>* results,
+                               unsigned int start,
+                               unsigned int stride);
+
+  /** \brief Spawned-worker wrapper for checkStatesBatch: pins itself
+      node round-robin, clones the master under the clone lock so its
+      environment's pages are committed node-locally by first touch,
+      signals the barrier once the clone exists and the master may
+      start mutating its own robot state, then runs batchCheckWorker
+      on the clone and frees it */
+  static void batchCheckClonedWorker(EnvironmentModelODE* master,
+                                     boost::mutex* clone_lock,
+                                     boost::barrier* clones_ready,
+                                     const std::vector<planning_models::KinematicState*>* states,
+                                     std::vector<unsigned char>* results,
+                                     unsigned int start,
+                                     unsigned int stride);
+
+  void freeMemory(void);
+
+  /** \brief Rebuild a private copy of a collision namespace that is
+      shared with a clone, so it can be mutated without affecting the
+      clone. Does nothing if the namespace is not shared. */
+  void detachCollisionNamespace(const std::string &ns);
+
   ModelInfo model_geom_;
-  std::map<std::string, CollisionNamespace*> coll_namespaces_;
 
-  std::map<dGeomID, std::pair<std::string, BodyType> > geom_lookup_map_;
+  /** \brief Cache of built trimesh data, shared by all namespaces and
+      robot links of this environment */
+  TriMeshCache trimesh_cache_;
+
+  /** \brief Geoms appearing in the compiled self-collision pair list */
+  mutable std::vector<dGeomID> self_collision_geoms_;
+  /** \brief Bounding sphere radius about each self-collision geom origin,
+      computed alongside the pair list; rotation invariant, so only the
+      centers need refreshing as the robot moves */
+  mutable std::vector<double> self_collision_sphere_radii_;
+
+  /** \brief Compiled pairs of indices into self_collision_geoms_ that must be tested for self collision */
+  mutable std::vector<std::pair<unsigned int, unsigned int> > self_collision_pairs_;
+
+  /** \brief Link each self-collision geom moves with (attached body
+      geoms record their attachment link), used to partition the pair
+      list by group */
+  mutable std::vector<std::string> self_collision_geom_links_;
+
+  /** \brief Pair subsets keyed by group name; each holds only the
+      pairs where at least one geom belongs to a link the group
+      updates */
+  mutable std::map<std::string, std::vector<std::pair<unsigned int, unsigned int> > > group_self_collision_pairs_;
+
+  mutable bool self_collision_pairs_valid_;
+
+  /** \brief Per-pair counters, populated only while query statistics are enabled */
+  mutable QueryStatistics query_stats_;
+
+  /** \brief Environment-owned contact workspace, retained at its
+      high-water mark so the vector-returning contact queries fill
+      and copy once instead of growing the output per contact.
+      Queries on one environment are serialized by its lock, so a
+      single scratch pool suffices. */
+  mutable ContactPool contact_scratch_;
+
+  CompiledAllowedContactMap compiled_allowed_contact_map_;
+  bool two_phase_env_check_;
+  bool query_stats_enabled_;
+
+  /** \brief Counters for the adaptive ordering of boolean queries:
+      whichever of the self and environment phases fails more often is
+      run first, so the early-out triggers sooner */
+  mutable unsigned int self_first_collision_count_;
+  mutable unsigned int env_first_collision_count_;
+
+  /** \brief True between beginObjectBatch() and commitObjectBatch();
+      additions record their namespace instead of setting up */
+  bool object_batch_active_;
+
+  /** \brief Namespaces touched by the open object batch */
+  std::set<std::string> object_batch_dirty_;
+
+  /** \brief Maps link names to their index in model_geom_.link_geom for incremental updates */
+  std::map<std::string, unsigned int> link_geom_map_;
+
+  std::map<std::string, boost::shared_ptr<CollisionNamespace> > coll_namespaces_;
+
+  std::map<dGeomID, GeomLookup> geom_lookup_map_;
+
+  /** \brief Re-resolve the allowed collision matrix indices cached in
+      geom_lookup_map_, needed after entries are removed from the
+      default matrix and indices shift */
+  void refreshGeomLookupIndices();
   std::map<std::string, dSpaceID> dspace_lookup_map_;
 
   bool previous_set_robot_model_;
@@ -60,16 +60,35 @@ public:
     clearObjects();
   }
 	
+  /** \brief Axis-aligned bounding box of one object in the
+      environment frame */
+  struct AABB
+  {
+    tf::Vector3 low;
+    tf::Vector3 high;
+
+    bool intersects(const tf::Vector3 &box_low, const tf::Vector3 &box_high) const
+    {
+      return low.x() <= box_high.x() && high.x() >= box_low.x() &&
+             low.y() <= box_high.y() && high.y() >= box_low.y() &&
+             low.z() <= box_high.z() && high.z() >= box_low.z();
+    }
+  };
+
   struct NamespaceObjects
   {
     /** \brief An array of static shapes */
     std::vector< shapes::StaticShape* > static_shape;
-	    
+
     /** \brief An array of shapes */
     std::vector< shapes::Shape* > shape;
 
     /** \brief An array of shape poses */
     std::vector< tf::Transform > shape_pose;
+
+    /** \brief Bounding boxes parallel to shape, maintained as
+        objects are added and removed */
+    std::vector< AABB > shape_aabb;
   };
 	
   /** \brief Get the list of namespaces */
@@ -102,6 +121,17 @@ public:
   /** \brief Adds namespace without necessary adding a shape. */
   void addObjectNamespace(const std::string ns);
 
+  /** \brief Get the namespaces that have at least one object whose
+      bounding box intersects the given box. Namespaces holding
+      static shapes are always included since those have no bounds. */
+  void getNamespacesIntersectingBox(const tf::Vector3 &box_low, const tf::Vector3 &box_high,
+                                    std::vector<std::string> &ns) const;
+
+  /** \brief Compute the bounding box of a posed shape; boxes,
+      spheres and cylinders are bounded analytically, meshes by their
+      vertices */
+  static void computeAABB(const shapes::Shape *shape, const tf::Transform &pose, AABB &aabb);
+
   /** \brief Clone this instance of the class */
   EnvironmentObjects* clone(void) const;
 	
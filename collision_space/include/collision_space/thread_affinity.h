@@ -0,0 +1,73 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+/** \author Ioan Sucan */
+
+#ifndef COLLISION_SPACE_THREAD_AFFINITY_
+#define COLLISION_SPACE_THREAD_AFFINITY_
+
+namespace collision_space
+{
+
+/** \brief Worker thread placement for multi-socket machines.
+
+    The parallel batch checkers and planners spawn short-lived worker
+    threads that each own a clone of the collision environment. On a
+    multi-node machine a worker migrating to the other socket after
+    its clone's memory was committed pays interconnect latency on
+    every query. The helpers here read the node topology from
+    /sys/devices/system/node once at first use and pin workers to
+    nodes round-robin; a worker that clones its environment after
+    pinning gets node-local pages through first-touch. Everything
+    degrades to a no-op on single-node machines, when the topology is
+    unreadable, or off Linux, and the calling thread is never pinned -
+    only workers that exit at the end of their batch. */
+namespace thread_affinity
+{
+
+/** \brief Number of memory nodes detected; 1 when detection is
+    unavailable or the machine has a single node */
+unsigned int getNodeCount(void);
+
+/** \brief Pin the calling worker thread to the CPUs of the node its
+    index maps to (round-robin). Call first thing in the worker,
+    before touching any large allocation. No-op on single-node
+    machines. */
+void bindCurrentThreadForWorker(unsigned int worker_index);
+
+}
+
+}
+
+#endif
@@ -35,8 +35,10 @@
 /** \author Ioan Sucan */
 
 #include "collision_space/environment.h"
+#include <geometric_shapes/shape_operations.h>
 #include <ros/console.h>
 #include <iomanip>
+#include <algorithm>
 
 collision_space::EnvironmentModel::AllowedCollisionMatrix::AllowedCollisionMatrix(const std::vector<std::string>& names,
                                                                                   bool allowed) 
@@ -48,6 +50,7 @@ collision_space::EnvironmentModel::AllowedCollisionMatrix::AllowedCollisionMatri
     allowed_entries_bimap_.insert(entry_type::value_type(names[i], i));
   }
   valid_ = true;
+  compiled_valid_ = false;
 }
 
 collision_space::EnvironmentModel::AllowedCollisionMatrix::AllowedCollisionMatrix(const std::vector<std::vector<bool> >& all_coll_vectors,
@@ -55,6 +58,7 @@ collision_space::EnvironmentModel::AllowedCollisionMatrix::AllowedCollisionMatri
 {
   unsigned int num_outer = all_coll_vectors.size();
   valid_ = true;
+  compiled_valid_ = false;
   if(all_coll_indices.size() != all_coll_vectors.size()) {
     valid_ = false;
     ROS_WARN_STREAM("Indices size " << all_coll_indices.size() << " not equal to num vecs " << all_coll_vectors.size());
@@ -93,6 +97,8 @@ collision_space::EnvironmentModel::AllowedCollisionMatrix::AllowedCollisionMatri
   valid_ = acm.valid_;
   allowed_entries_ = acm.allowed_entries_;
   allowed_entries_bimap_ = acm.allowed_entries_bimap_;
+  compiled_entries_ = acm.compiled_entries_;
+  compiled_valid_ = acm.compiled_valid_;
 }
 
 bool collision_space::EnvironmentModel::AllowedCollisionMatrix::getAllowedCollision(const std::string& name1, 
@@ -157,6 +163,7 @@ bool collision_space::EnvironmentModel::AllowedCollisionMatrix::getEntryName(con
 }
 
 bool collision_space::EnvironmentModel::AllowedCollisionMatrix::removeEntry(const std::string& name) {
+  compiled_valid_ = false;
   if(allowed_entries_bimap_.left.find(name) == allowed_entries_bimap_.left.end()) {
     return false;
   }
@@ -194,6 +201,7 @@ bool collision_space::EnvironmentModel::AllowedCollisionMatrix::removeEntry(cons
 bool collision_space::EnvironmentModel::AllowedCollisionMatrix::addEntry(const std::string& name,
                                                                          bool allowed)
 {
+  compiled_valid_ = false;
   if(allowed_entries_bimap_.left.find(name) != allowed_entries_bimap_.left.end()) {
     return false;
   }
@@ -211,6 +219,7 @@ bool collision_space::EnvironmentModel::AllowedCollisionMatrix::addEntry(const s
 
 bool collision_space::EnvironmentModel::AllowedCollisionMatrix::changeEntry(bool allowed)
 {
+  compiled_valid_ = false;
   for(unsigned int i = 0; i < allowed_entries_.size(); i++) {
     for(unsigned int j = 0; j < allowed_entries_[i].size(); j++) {
       allowed_entries_[i][j] = allowed;
@@ -223,6 +232,7 @@ bool collision_space::EnvironmentModel::AllowedCollisionMatrix::changeEntry(bool
 bool collision_space::EnvironmentModel::AllowedCollisionMatrix::changeEntry(const std::string& name1,
                                                                             const std::string& name2,
                                                                             bool allowed) {
+  compiled_valid_ = false;
   entry_type::left_const_iterator it1 = allowed_entries_bimap_.left.find(name1);
   if(it1 == allowed_entries_bimap_.left.end()) {
     return false;
@@ -239,6 +249,7 @@ bool collision_space::EnvironmentModel::AllowedCollisionMatrix::changeEntry(cons
 bool collision_space::EnvironmentModel::AllowedCollisionMatrix::changeEntry(unsigned int i, unsigned int j,
                                                                             bool allowed) 
 {
+  compiled_valid_ = false;
   if(i > allowed_entries_.size() || j > allowed_entries_[i].size()) {
     return false;
   }
@@ -249,6 +260,7 @@ bool collision_space::EnvironmentModel::AllowedCollisionMatrix::changeEntry(unsi
 bool collision_space::EnvironmentModel::AllowedCollisionMatrix::changeEntry(const std::string& name, 
                                                                             bool allowed)
 {
+  compiled_valid_ = false;
   if(allowed_entries_bimap_.left.find(name) == allowed_entries_bimap_.left.end()) {
     return false;
   }
@@ -264,6 +276,7 @@ bool collision_space::EnvironmentModel::AllowedCollisionMatrix::changeEntry(cons
                                                                             const std::vector<std::string>& change_names,
                                                                             bool allowed)
 {
+  compiled_valid_ = false;
   bool ok = true;
   if(allowed_entries_bimap_.left.find(name) == allowed_entries_bimap_.left.end()) {
     ROS_DEBUG_STREAM("No entry for " << name);
@@ -307,6 +320,18 @@ bool collision_space::EnvironmentModel::AllowedCollisionMatrix::changeEntry(cons
   return ok;
 }
 
+void collision_space::EnvironmentModel::AllowedCollisionMatrix::compile() const
+{
+  unsigned int n = allowed_entries_.size();
+  compiled_entries_.assign((n * (n + 1)) / 2, false);
+  for(unsigned int i = 0; i < n; i++) {
+    for(unsigned int j = 0; j <= i; j++) {
+      compiled_entries_[(i * (i + 1)) / 2 + j] = allowed_entries_[i][j];
+    }
+  }
+  compiled_valid_ = true;
+}
+
 void collision_space::EnvironmentModel::AllowedCollisionMatrix::getAllEntryNames(std::vector<std::string>& names) const
 {
   names.clear();
@@ -326,6 +351,59 @@ void collision_space::EnvironmentModel::AllowedCollisionMatrix::print(std::ostre
   }
 }
 
+bool collision_space::EnvironmentModel::getAllCollisionContacts(ContactPool &pool, unsigned int num_per_contact) const
+{
+  pool.reset();
+  std::vector<Contact> contacts;
+  bool collides = getAllCollisionContacts(contacts, num_per_contact);
+  for(unsigned int i = 0; i < contacts.size(); i++) {
+    pool.alloc() = contacts[i];
+  }
+  return collides;
+}
+
+bool collision_space::EnvironmentModel::isTrajectorySegmentInCollision(const planning_models::KinematicState* from,
+                                                                       const planning_models::KinematicState* to)
+{
+  updateRobotModel(from);
+  if(isCollision()) {
+    return true;
+  }
+  updateRobotModel(to);
+  if(isCollision()) {
+    return true;
+  }
+
+  std::vector<double> from_vals, to_vals;
+  from->getKinematicStateValues(from_vals);
+  to->getKinematicStateValues(to_vals);
+  std::vector<double> mid_vals(from_vals.size());
+  for(unsigned int i = 0; i < from_vals.size(); i++) {
+    mid_vals[i] = 0.5 * (from_vals[i] + to_vals[i]);
+  }
+  planning_models::KinematicState mid(*from);
+  mid.setKinematicState(mid_vals);
+  updateRobotModel(&mid);
+  return isCollision();
+}
+
+bool collision_space::EnvironmentModel::checkStatesBatch(const std::vector<planning_models::KinematicState*> &states,
+                                                         std::vector<bool> &collisions)
+{
+  collisions.assign(states.size(), false);
+  bool any_collision = false;
+  lock_.lock();
+  for(unsigned int i = 0; i < states.size(); i++) {
+    updateRobotModel(states[i]);
+    if(isCollision()) {
+      collisions[i] = true;
+      any_collision = true;
+    }
+  }
+  lock_.unlock();
+  return any_collision;
+}
+
 bool collision_space::EnvironmentModel::getVerbose(void) const
 {
   return verbose_;
@@ -336,6 +414,32 @@ void collision_space::EnvironmentModel::setVerbose(bool verbose)
   verbose_ = verbose;
 }
 
+void collision_space::EnvironmentModel::removeObjects(const std::string &ns, const std::vector<const shapes::Shape*> &shapes)
+{
+  //generic fallback - clone what survives, then rebuild the namespace
+  //without the removed objects
+  const EnvironmentObjects::NamespaceObjects& no = objects_->getObjects(ns);
+  std::vector<shapes::Shape*> keep_shapes;
+  std::vector<tf::Transform> keep_poses;
+  for(unsigned int i = 0; i < no.shape.size(); i++) {
+    if(std::find(shapes.begin(), shapes.end(), no.shape[i]) == shapes.end()) {
+      keep_shapes.push_back(shapes::cloneShape(no.shape[i]));
+      keep_poses.push_back(no.shape_pose[i]);
+    }
+  }
+  std::vector<shapes::StaticShape*> keep_static;
+  for(unsigned int i = 0; i < no.static_shape.size(); i++) {
+    keep_static.push_back(shapes::cloneShape(no.static_shape[i]));
+  }
+  clearObjects(ns);
+  if(!keep_shapes.empty()) {
+    addObjects(ns, keep_shapes, keep_poses);
+  }
+  for(unsigned int i = 0; i < keep_static.size(); i++) {
+    addObject(ns, keep_static[i]);
+  }
+}
+
 const collision_space::EnvironmentObjects* collision_space::EnvironmentModel::getObjects(void) const
 {
   return objects_;
@@ -379,6 +483,16 @@ void collision_space::EnvironmentModel::unlock(void) const
   lock_.unlock();
 }
 
+unsigned long collision_space::EnvironmentModel::getModificationEpoch(void) const
+{
+  return modification_epoch_;
+}
+
+void collision_space::EnvironmentModel::bumpModificationEpoch(void)
+{
+  modification_epoch_++;
+}
+
 const collision_space::EnvironmentModel::AllowedCollisionMatrix& 
 collision_space::EnvironmentModel::getDefaultAllowedCollisionMatrix() const
 {
@@ -402,6 +516,11 @@ void collision_space::EnvironmentModel::revertAlteredCollisionMatrix() {
   use_altered_collision_matrix_ = false;
 }
 
+void collision_space::EnvironmentModel::setSelfCollisionGroupScope(const std::string& group_name) {
+  self_collision_group_scope_ = group_name;
+  bumpModificationEpoch();
+}
+
 void collision_space::EnvironmentModel::setAlteredLinkPadding(const std::map<std::string, double>& new_link_padding) {
   altered_link_padding_map_.clear();
   for(std::map<std::string, double>::const_iterator it = new_link_padding.begin();
@@ -417,11 +536,13 @@ void collision_space::EnvironmentModel::setAlteredLinkPadding(const std::map<std
     }
   }
   use_altered_link_padding_map_ = true;
+  bumpModificationEpoch();
 }
 
 void collision_space::EnvironmentModel::revertAlteredLinkPadding() {
   altered_link_padding_map_.clear();
   use_altered_link_padding_map_ = false;
+  bumpModificationEpoch();
 }
 
 const std::map<std::string, double>& collision_space::EnvironmentModel::getDefaultLinkPaddingMap() const {
@@ -455,6 +576,7 @@ void collision_space::EnvironmentModel::setAllowedContacts(const std::vector<All
     allowed_contact_map_[allowed_contacts_[i].body_name_1][allowed_contacts_[i].body_name_2].push_back(allowed_contacts_[i]);
     allowed_contact_map_[allowed_contacts_[i].body_name_2][allowed_contacts_[i].body_name_1].push_back(allowed_contacts_[i]);
   }
+  bumpModificationEpoch();
 }
 
 const std::vector<collision_space::EnvironmentModel::AllowedContact>& collision_space::EnvironmentModel::getAllowedContacts() const {
@@ -1,13 +1,13 @@
 /*********************************************************************
 * Software License Agreement (BSD License)
-* 
+*
 *  Copyright (c) 2008, Willow Garage, Inc.
 *  All rights reserved.
-* 
+*
 *  Redistribution and use in source and binary forms, with or without
 *  modification, are permitted provided that the following conditions
 *  are met:
-* 
+*
 *   * Redistributions of source code must retain the above copyright
 *     notice, this list of conditions and the following disclaimer.
 *   * Redistributions in binary form must reproduce the above
@@ -17,7 +17,7 @@
 *   * Neither the name of the Willow Garage nor the names of its
 *     contributors may be used to endorse or promote products derived
 *     from this software without specific prior written permission.
-* 
+*
 *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
 *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
 *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
@@ -35,407 +35,804 @@
 /** \author Ioan Sucan */
 
 #include "collision_space/environmentBullet.h"
+#include <geometric_shapes/shape_operations.h>
+#include <ros/console.h>
+#include <cassert>
+#include <climits>
 
-void collision_space::EnvironmentModelBullet::freeMemory(void)
+namespace
 {
-  for (unsigned int j = 0 ; j < m_modelGeom.linkGeom.size() ; ++j)
-    delete m_modelGeom.linkGeom[j];
-  /*
-    if (m_world)
-    {
-    for(int i = m_world->getNumCollisionObjects() - 1; i >= 0; --i)
-    {
-    btCollisionObject* obj = m_world->getCollisionObjectArray()[i];
-    delete obj->getCollisionShape();
-    delete obj;
-    }
-	
-    delete m_world->getBroadphase();
-    delete m_world->getDispatcher();
-    delete m_world;
-    }	
-    
-    if (m_config)
-    delete m_config; */
+
+btTransform btTransformFrom(const tf::Transform& pose)
+{
+  const tf::Vector3& o = pose.getOrigin();
+  tf::Quaternion q = pose.getRotation();
+  return btTransform(btQuaternion(q.getX(), q.getY(), q.getZ(), q.getW()),
+                     btVector3(o.getX(), o.getY(), o.getZ()));
 }
 
-void collision_space::EnvironmentModelBullet::setRobotModel(const boost::shared_ptr<const planning_models::KinematicModel> &model, 
-                                                            const std::vector<std::string> &links,
-                                                            const std::map<std::string, double>& link_padding_map,
-                                                            double default_padding,
-                                                            double scale)
+tf::Transform tfTransformFrom(const btTransform& pose)
 {
-  collision_space::EnvironmentModel::setRobotModel(model, links, link_padding_map, default_padding, scale);
-  m_modelGeom.scale = scale;
-  m_modelGeom.padding = default_padding;
+  const btVector3& o = pose.getOrigin();
+  btQuaternion q = pose.getRotation();
+  return tf::Transform(tf::Quaternion(q.getX(), q.getY(), q.getZ(), q.getW()),
+                       tf::Vector3(o.getX(), o.getY(), o.getZ()));
+}
 
-  for (unsigned int i = 0 ; i < links.size() ; ++i)
+/** \brief Contact callback shared by all the query entry points; it
+    resolves body names from the records hung off the collision
+    objects, consults the allowed collision matrix and fills the
+    contact vector up to the configured limits */
+struct CollisionCallback : public btCollisionWorld::ContactResultCallback
+{
+  CollisionCallback(collision_space::EnvironmentModelBullet::CollisionData* d,
+                    const collision_space::EnvironmentModel::AllowedCollisionMatrix* matrix)
+    : cdata(d), acm(matrix)
   {
-    /* skip this link if we have no geometry or if the link
-       name is not specified as enabled for collision
-       checking */
-    const planning_models::KinematicModel::LinkModel *link = m_robotModel->getLinkModel(links[i]);
-    if (!link || !link->getLinkShape())
-	    continue;
-	
-    kGeom *kg = new kGeom();
-    kg->link = link;
-    kg->enabled = true;
-    kg->index = i;
-    btCollisionObject *obj = createCollisionBody(link->getLinkShape(), scale, default_padding);
-    assert(obj);
-    m_world->addCollisionObject(obj);
-    obj->setUserPointer(reinterpret_cast<void*>(kg));
-    kg->geom.push_back(obj);
-    for (unsigned int k = 0 ; k < kg->link->getAttachedBodyModels().size() ; ++k)
-    {
-	    btCollisionObject *obja = createCollisionBody(kg->link->attached_bodies[k]->shapes[0], scale, default_padding);
-	    assert(obja);	
-	    m_world->addCollisionObject(obja);
-	    obja->setUserPointer(reinterpret_cast<void*>(kg));
-	    kg->geom.push_back(obja);
+  }
+
+  virtual btScalar addSingleResult(btManifoldPoint& cp,
+                                   const btCollisionObject* col_obj_0, int, int,
+                                   const btCollisionObject* col_obj_1, int, int)
+  {
+    if (cdata->done) {
+      return 0.0;
+    }
+
+    collision_space::EnvironmentModelBullet::BodyRecord* r1 =
+      reinterpret_cast<collision_space::EnvironmentModelBullet::BodyRecord*>(col_obj_0->getUserPointer());
+    collision_space::EnvironmentModelBullet::BodyRecord* r2 =
+      reinterpret_cast<collision_space::EnvironmentModelBullet::BodyRecord*>(col_obj_1->getUserPointer());
+
+    if (acm && r1 && r2) {
+      bool allowed = false;
+      if (acm->getAllowedCollision(r1->name, r2->name, allowed) && allowed) {
+        return 0.0;
+      }
+    }
+
+    cdata->collides = true;
+
+    if (!cdata->contacts) {
+      cdata->done = true;
+      return 0.0;
     }
-    m_modelGeom.linkGeom.push_back(kg);
+
+    std::pair<std::string, std::string> key(r1 ? r1->name : std::string(),
+                                            r2 ? r2->name : std::string());
+    if (pair_counts[key] >= cdata->max_contacts_pair) {
+      return 0.0;
+    }
+    pair_counts[key]++;
+
+    collision_space::EnvironmentModel::Contact contact;
+    const btVector3& p = cp.getPositionWorldOnB();
+    contact.pos = tf::Vector3(p.getX(), p.getY(), p.getZ());
+    contact.normal = tf::Vector3(cp.m_normalWorldOnB.getX(), cp.m_normalWorldOnB.getY(), cp.m_normalWorldOnB.getZ());
+    contact.depth = -cp.getDistance();
+    contact.body_name_1 = r1 ? r1->name : std::string();
+    contact.body_type_1 = r1 ? r1->type : collision_space::EnvironmentModel::OBJECT;
+    contact.body_name_2 = r2 ? r2->name : std::string();
+    contact.body_type_2 = r2 ? r2->type : collision_space::EnvironmentModel::OBJECT;
+    cdata->contacts->push_back(contact);
+
+    if (cdata->contacts->size() >= cdata->max_contacts_total) {
+      cdata->done = true;
+    }
+    return 0.0;
   }
+
+  collision_space::EnvironmentModelBullet::CollisionData* cdata;
+  const collision_space::EnvironmentModel::AllowedCollisionMatrix* acm;
+  std::map<std::pair<std::string, std::string>, unsigned int> pair_counts;
+};
+
 }
 
-const std::vector<const planning_models::KinematicModel::AttachedBody*> collision_space::EnvironmentModelBullet::getAttachedBodies(void) const 
+collision_space::EnvironmentModelBullet::EnvironmentModelBullet(void) : EnvironmentModel()
 {
-  std::vector<const planning_models::KinematicModel::AttachedBody*> ret_vec;
+  config_ = new btDefaultCollisionConfiguration();
+  dispatcher_ = new btCollisionDispatcher(config_);
+  broadphase_ = new btDbvtBroadphase();
+  world_ = new btCollisionWorld(dispatcher_, broadphase_, config_);
+  self_collision_pairs_valid_ = false;
+  previous_set_robot_model_ = false;
+}
 
-  const unsigned int n = m_modelGeom.linkGeom.size();    
-  for (unsigned int i = 0 ; i < n ; ++i)
-  {
-    kGeom *kg = m_modelGeom.linkGeom[i];
-	
-    /* create new set of attached bodies */	
-    const unsigned int nab = kg->link->attached_bodies.size();
-    for (unsigned int k = 0 ; k < nab ; ++k)
-    {
-      ret_vec.push_back(kg->link->attached_bodies[k]);
+collision_space::EnvironmentModelBullet::~EnvironmentModelBullet(void)
+{
+  freeMemory();
+  delete world_;
+  delete broadphase_;
+  delete dispatcher_;
+  delete config_;
+}
+
+collision_space::EnvironmentModelBullet::AttGeom::~AttGeom()
+{
+  for (unsigned int i = 0; i < obj.size(); i++) {
+    delete reinterpret_cast<BodyRecord*>(obj[i]->getUserPointer());
+    delete obj[i]->getCollisionShape();
+    delete obj[i];
+  }
+  for (unsigned int i = 0; i < padded_obj.size(); i++) {
+    delete reinterpret_cast<BodyRecord*>(padded_obj[i]->getUserPointer());
+    delete padded_obj[i]->getCollisionShape();
+    delete padded_obj[i];
+  }
+}
+
+collision_space::EnvironmentModelBullet::LinkGeom::~LinkGeom()
+{
+  if (obj) {
+    delete reinterpret_cast<BodyRecord*>(obj->getUserPointer());
+    delete obj->getCollisionShape();
+    delete obj;
+  }
+  if (padded_obj) {
+    delete reinterpret_cast<BodyRecord*>(padded_obj->getUserPointer());
+    delete padded_obj->getCollisionShape();
+    delete padded_obj;
+  }
+  deleteAttachedBodies();
+}
+
+void collision_space::EnvironmentModelBullet::LinkGeom::deleteAttachedBodies()
+{
+  for (unsigned int i = 0; i < att_bodies.size(); i++) {
+    delete att_bodies[i];
+  }
+  att_bodies.clear();
+}
+
+void collision_space::EnvironmentModelBullet::freeObject(btCollisionObject* obj, bool in_world) const
+{
+  if (in_world) {
+    world_->removeCollisionObject(obj);
+  }
+  delete reinterpret_cast<BodyRecord*>(obj->getUserPointer());
+  delete obj->getCollisionShape();
+  delete obj;
+}
+
+void collision_space::EnvironmentModelBullet::freeMemory(void)
+{
+  for (unsigned int i = 0; i < link_geom_.size(); i++) {
+    delete link_geom_[i];
+  }
+  link_geom_.clear();
+  for (std::map<std::string, CollisionNamespace>::iterator it = coll_namespaces_.begin(); it != coll_namespaces_.end(); ++it) {
+    for (unsigned int i = 0; i < it->second.objects.size(); i++) {
+      freeObject(it->second.objects[i], true);
+    }
+    for (unsigned int i = 0; i < it->second.static_objects.size(); i++) {
+      freeObject(it->second.static_objects[i], true);
     }
   }
-  return ret_vec;
+  coll_namespaces_.clear();
 }
 
-btCollisionObject* collision_space::EnvironmentModelBullet::createCollisionBody(const shapes::Shape *shape, double scale, double padding)
+btCollisionShape* collision_space::EnvironmentModelBullet::createBulletShape(const shapes::Shape *shape, double scale, double padding) const
 {
-  btCollisionShape *btshape = NULL;
-    
+  btCollisionShape* s = NULL;
   switch (shape->type)
   {
   case shapes::SPHERE:
-    {
-	    btshape = dynamic_cast<btCollisionShape*>(new btSphereShape(static_cast<const shapes::Sphere*>(shape)->radius * scale + padding));
-    }
+    s = new btSphereShape(static_cast<const shapes::Sphere*>(shape)->radius * scale + padding);
     break;
   case shapes::BOX:
     {
-	    const double *size = static_cast<const shapes::Box*>(shape)->size;
-	    btshape = dynamic_cast<btCollisionShape*>(new btBoxShape(tf::Vector3(size[0] * scale / 2.0 + padding, size[1] * scale / 2.0 + padding, size[2] * scale / 2.0 + padding)));
-    }	
+      const double *size = static_cast<const shapes::Box*>(shape)->size;
+      s = new btBoxShape(btVector3(size[0] * 0.5 * scale + padding,
+                                   size[1] * 0.5 * scale + padding,
+                                   size[2] * 0.5 * scale + padding));
+    }
     break;
   case shapes::CYLINDER:
     {
-	    double r2 = static_cast<const shapes::Cylinder*>(shape)->radius * scale + padding;
-	    btshape = dynamic_cast<btCollisionShape*>(new btCylinderShapeZ(tf::Vector3(r2, r2, static_cast<const shapes::Cylinder*>(shape)->length * scale / 2.0 + padding)));
+      double radius = static_cast<const shapes::Cylinder*>(shape)->radius * scale + padding;
+      double length = static_cast<const shapes::Cylinder*>(shape)->length * scale + padding * 2.0;
+      s = new btCylinderShapeZ(btVector3(radius, radius, length * 0.5));
     }
     break;
   case shapes::MESH:
     {
-	    const shapes::Mesh *mesh = static_cast<const shapes::Mesh*>(shape);
-	    btConvexHullShape *btmesh = new btConvexHullShape();
-	    
-	    for (unsigned int i = 0 ; i < mesh->vertexCount ; ++i)
-        btmesh->addPoint(tf::Vector3(mesh->vertices[3*i], mesh->vertices[3*i + 1], mesh->vertices[3*i + 2]));
-	    
-	    btmesh->setLocalScaling(tf::Vector3(scale, scale, scale));
-	    btmesh->setMargin(padding + 0.0001); // we need this to be positive
-	    btshape = dynamic_cast<btCollisionShape*>(btmesh);
-    }
-	
+      const shapes::Mesh *mesh = static_cast<const shapes::Mesh*>(shape);
+      if (mesh->vertexCount > 0 && mesh->triangleCount > 0)
+      {
+        //a convex hull of the padded vertices; padding pushes each
+        //vertex away from the mesh center, like the ODE backend does
+        double sx = 0.0, sy = 0.0, sz = 0.0;
+        for (unsigned int i = 0; i < mesh->vertexCount; ++i)
+        {
+          unsigned int i3 = i * 3;
+          sx += mesh->vertices[i3];
+          sy += mesh->vertices[i3 + 1];
+          sz += mesh->vertices[i3 + 2];
+        }
+        sx /= (double)mesh->vertexCount;
+        sy /= (double)mesh->vertexCount;
+        sz /= (double)mesh->vertexCount;
+
+        btConvexHullShape *hull = new btConvexHullShape();
+        for (unsigned int i = 0; i < mesh->vertexCount; ++i)
+        {
+          unsigned int i3 = i * 3;
+          double dx = mesh->vertices[i3] - sx;
+          double dy = mesh->vertices[i3 + 1] - sy;
+          double dz = mesh->vertices[i3 + 2] - sz;
+          double ndx = ((dx > 0) ? dx + padding : dx - padding);
+          double ndy = ((dy > 0) ? dy + padding : dy - padding);
+          double ndz = ((dz > 0) ? dz + padding : dz - padding);
+          hull->addPoint(btVector3(sx + ndx, sy + ndy, sz + ndz));
+        }
+        s = hull;
+      }
+    }
+    break;
   default:
+    ROS_ERROR("Unable to construct bullet collision shape for shape of type %d", (int)shape->type);
     break;
   }
-    
-  if (btshape)
-  {
-    btCollisionObject *object = new btCollisionObject();
-    object->setCollisionShape(btshape);
-    return object;
-  }
-  else
+  return s;
+}
+
+btCollisionObject* collision_space::EnvironmentModelBullet::createCollisionObject(const shapes::Shape *shape, double scale, double padding) const
+{
+  btCollisionShape* s = createBulletShape(shape, scale, padding);
+  if (!s) {
     return NULL;
+  }
+  btCollisionObject* obj = new btCollisionObject();
+  obj->setCollisionShape(s);
+  return obj;
 }
 
-btCollisionObject* collision_space::EnvironmentModelBullet::createCollisionBody(const shapes::StaticShape *shape)
+btCollisionObject* collision_space::EnvironmentModelBullet::createCollisionObject(const shapes::StaticShape *shape) const
 {
-  btCollisionShape *btshape = NULL;
-    
+  btCollisionShape* s = NULL;
   switch (shape->type)
   {
   case shapes::PLANE:
     {
-	    const shapes::Plane *p = static_cast<const shapes::Plane*>(shape);
-	    btshape = new btStaticPlaneShape(tf::Vector3(p->a, p->b, p->c), p->d);
+      const shapes::Plane *p = static_cast<const shapes::Plane*>(shape);
+      s = new btStaticPlaneShape(btVector3(p->a, p->b, p->c), -p->d);
     }
     break;
-
   default:
+    ROS_ERROR("Unable to construct bullet collision shape for static shape of type %d", (int)shape->type);
     break;
   }
-    
-  if (btshape)
-  {
-    btCollisionObject *object = new btCollisionObject();
-    object->setCollisionShape(btshape);
-    return object;
-  }
-  else
+  if (!s) {
     return NULL;
+  }
+  btCollisionObject* obj = new btCollisionObject();
+  obj->setCollisionShape(s);
+  return obj;
 }
 
-void collision_space::EnvironmentModelBullet::updateAttachedBodies(void)
+void collision_space::EnvironmentModelBullet::setRobotModel(const planning_models::KinematicModel* model,
+                                                            const AllowedCollisionMatrix& acm,
+                                                            const std::map<std::string, double>& link_padding_map,
+                                                            double default_padding,
+                                                            double scale)
 {
-  const unsigned int n = m_modelGeom.linkGeom.size();    
-  for (unsigned int i = 0 ; i < n ; ++i)
-  {
-    kGeom *kg = m_modelGeom.linkGeom[i];
-	
-    /* clear previosly attached bodies */
-    for (unsigned int k = 1 ; k < kg->geom.size() ; ++k)
-    {
-	    m_world->removeCollisionObject(kg->geom[k]);
-	    //	    delete kg->geom[k]->getCollisionShape();
-	    //	    delete kg->geom[k];
-    }
-	
-    kg->geom.resize(1);
-	
-    /* create new set of attached bodies */	
-    const unsigned int nab = kg->link->attached_bodies.size();
-    for (unsigned int k = 0 ; k < nab ; ++k)
-    {
-	    btCollisionObject *obja = createCollisionBody(kg->link->attached_bodies[k]->shapes[0], m_modelGeom.scale, m_modelGeom.padding);
-	    assert(obja);
-	    m_world->addCollisionObject(obja);
-	    obja->setUserPointer(reinterpret_cast<void*>(kg));
-	    kg->geom.push_back(obja);
+  collision_space::EnvironmentModel::setRobotModel(model, acm, link_padding_map, default_padding, scale);
+  if (previous_set_robot_model_) {
+    for (unsigned int i = 0; i < link_geom_.size(); i++) {
+      delete link_geom_[i];
     }
+    link_geom_.clear();
+    attached_bodies_in_collision_matrix_.clear();
   }
+  createBulletRobotModel();
+  previous_set_robot_model_ = true;
+  self_collision_pairs_valid_ = false;
 }
 
-void collision_space::EnvironmentModelBullet::updateRobotModel(void)
-{ 
-  const unsigned int n = m_modelGeom.linkGeom.size();
-  for (unsigned int i = 0 ; i < n ; ++i)
+void collision_space::EnvironmentModelBullet::createBulletRobotModel()
+{
+  for (unsigned int i = 0; i < robot_model_->getLinkModels().size(); ++i)
   {
-    m_modelGeom.linkGeom[i]->geom[0]->setWorldTransform(m_modelGeom.linkGeom[i]->link->global_link_transform);
-    const unsigned int nab = m_modelGeom.linkGeom[i]->link->attached_bodies.size();
-    for (unsigned int k = 0 ; k < nab ; ++k)
-	    m_modelGeom.linkGeom[i]->geom[k + 1]->setWorldTransform(m_modelGeom.linkGeom[i]->link->attached_bodies[k]->global_collision_body_transform[0]);
+    const planning_models::KinematicModel::LinkModel *link = robot_model_->getLinkModels()[i];
+    if (!link || !link->getLinkShape()) {
+      continue;
+    }
+
+    double padd = default_robot_padding_;
+    if (default_link_padding_map_.find(link->getName()) != default_link_padding_map_.end()) {
+      padd = default_link_padding_map_.find(link->getName())->second;
+    }
+
+    LinkGeom *lg = new LinkGeom();
+    lg->link = link;
+    lg->obj = createCollisionObject(link->getLinkShape(), 1.0, 0.0);
+    assert(lg->obj);
+    lg->obj->setUserPointer(new BodyRecord(link->getName(), LINK));
+    lg->padded_obj = createCollisionObject(link->getLinkShape(), robot_scale_, padd);
+    assert(lg->padded_obj);
+    lg->padded_obj->setUserPointer(new BodyRecord(link->getName(), LINK));
+
+    const std::vector<planning_models::KinematicModel::AttachedBodyModel*>& attached_bodies = link->getAttachedBodyModels();
+    for (unsigned int j = 0; j < attached_bodies.size(); ++j) {
+      double att_padd = default_robot_padding_;
+      if (default_link_padding_map_.find(attached_bodies[j]->getName()) != default_link_padding_map_.end()) {
+        att_padd = default_link_padding_map_.find(attached_bodies[j]->getName())->second;
+      } else if (default_link_padding_map_.find("attached") != default_link_padding_map_.end()) {
+        att_padd = default_link_padding_map_.find("attached")->second;
+      }
+      addAttachedBody(lg, attached_bodies[j], att_padd);
+    }
+    link_geom_.push_back(lg);
   }
 }
 
-bool collision_space::EnvironmentModelBullet::isCollision(void)
-{   
-  m_world->getPairCache()->setOverlapFilterCallback(&m_genericCollisionFilterCallback);
-  m_world->performDiscreteCollisionDetection();
-    
-  unsigned int numManifolds = m_world->getDispatcher()->getNumManifolds();
-  for(unsigned int i = 0; i < numManifolds; ++i)
-  {
-    btPersistentManifold* contactManifold = m_world->getDispatcher()->getManifoldByIndexInternal(i);
-	
-    if (contactManifold->getNumContacts() > 0)
-	    return true;
+void collision_space::EnvironmentModelBullet::addAttachedBody(LinkGeom* lg,
+                                                              const planning_models::KinematicModel::AttachedBodyModel* attm,
+                                                              double padd)
+{
+  AttGeom* attg = new AttGeom();
+  attg->att = attm;
+
+  if (!default_collision_matrix_.addEntry(attm->getName(), false)) {
+    ROS_WARN_STREAM("Must already have an entry in allowed collision matrix for " << attm->getName());
   }
-    
-  return false;
+  attached_bodies_in_collision_matrix_[attm->getName()] = true;
+  for (unsigned int i = 0; i < attm->getTouchLinks().size(); i++) {
+    if (default_collision_matrix_.hasEntry(attm->getTouchLinks()[i])) {
+      if (!default_collision_matrix_.changeEntry(attm->getName(), attm->getTouchLinks()[i], true)) {
+        ROS_WARN_STREAM("No entry in allowed collision matrix for " << attm->getName() << " and " << attm->getTouchLinks()[i]);
+      }
+    }
+  }
+
+  for (unsigned int i = 0; i < attm->getShapes().size(); i++) {
+    btCollisionObject* o = createCollisionObject(attm->getShapes()[i], 1.0, 0.0);
+    assert(o);
+    o->setUserPointer(new BodyRecord(attm->getName(), ATTACHED));
+    attg->obj.push_back(o);
+
+    btCollisionObject* padded_o = createCollisionObject(attm->getShapes()[i], robot_scale_, padd);
+    assert(padded_o);
+    padded_o->setUserPointer(new BodyRecord(attm->getName(), ATTACHED));
+    attg->padded_obj.push_back(padded_o);
+  }
+  lg->att_bodies.push_back(attg);
 }
 
-bool collision_space::EnvironmentModelBullet::getCollisionContacts(const std::vector<AllowedContact> &allowedContacts, std::vector<Contact> &contacts, unsigned int max_count)
-{        
-  m_world->getPairCache()->setOverlapFilterCallback(&m_genericCollisionFilterCallback);
-  m_world->performDiscreteCollisionDetection();
-  bool collision = false;
-  contacts.clear();
-    
-  unsigned int numManifolds = m_world->getDispatcher()->getNumManifolds();
-  for(unsigned int i = 0; i < numManifolds; ++i)
-  {
-    btPersistentManifold* contactManifold = m_world->getDispatcher()->getManifoldByIndexInternal(i);
-    int nc = contactManifold->getNumContacts();
-    if (nc > 0)
-    {
-	    collision = true;
-	    for (int j = 0 ; j < nc && (contacts.size() < max_count || max_count == 0) ; ++j)
-	    {
-        btManifoldPoint& pt = contactManifold->getContactPoint(j);
-        collision_space::EnvironmentModelBullet::Contact add;
-        add.pos = pt.getPositionWorldOnB();
-        add.normal = pt.m_normalWorldOnB;
-        add.depth = -pt.getDistance();
-        add.link1 = NULL;
-        add.link2 = NULL;
-        btCollisionObject* b0 = reinterpret_cast<btCollisionObject*>(contactManifold->getBody0());
-        btCollisionObject* b1 = reinterpret_cast<btCollisionObject*>(contactManifold->getBody1());
-        if (b1 && b0)
-        {
-          kGeom* kg0 = reinterpret_cast<kGeom*>(b0->getUserPointer());
-          kGeom* kg1 = reinterpret_cast<kGeom*>(b1->getUserPointer());
-          if (kg0)
-            add.link1 = kg0->link;
-          if (kg1)
-            add.link2 = kg1->link;
-        }
-        contacts.push_back(add);
-	    }
-	    if (max_count > 0 && contacts.size() >= max_count)
-        break;
+void collision_space::EnvironmentModelBullet::updateAttachedBodies()
+{
+  for (std::map<std::string, bool>::iterator it = attached_bodies_in_collision_matrix_.begin();
+       it != attached_bodies_in_collision_matrix_.end();
+       it++) {
+    if (!default_collision_matrix_.removeEntry(it->first)) {
+      ROS_WARN_STREAM("No entry in default collision matrix for attached body " << it->first <<
+                      " when there really should be.");
+    }
+  }
+  attached_bodies_in_collision_matrix_.clear();
+
+  for (unsigned int i = 0; i < link_geom_.size(); ++i) {
+    LinkGeom *lg = link_geom_[i];
+    lg->deleteAttachedBodies();
+
+    const std::vector<planning_models::KinematicModel::AttachedBodyModel*>& attached_bodies = lg->link->getAttachedBodyModels();
+    for (unsigned int j = 0; j < attached_bodies.size(); ++j) {
+      double padd = default_robot_padding_;
+      if (default_link_padding_map_.find(attached_bodies[j]->getName()) != default_link_padding_map_.end()) {
+        padd = default_link_padding_map_.find(attached_bodies[j]->getName())->second;
+      } else if (default_link_padding_map_.find("attached") != default_link_padding_map_.end()) {
+        padd = default_link_padding_map_.find("attached")->second;
+      }
+      addAttachedBody(lg, attached_bodies[j], padd);
     }
   }
-    
-  return collision;
+  self_collision_pairs_valid_ = false;
 }
 
-bool collision_space::EnvironmentModelBullet::isSelfCollision(void)
+void collision_space::EnvironmentModelBullet::updateRobotModel(const planning_models::KinematicState* state)
 {
-  m_world->getPairCache()->setOverlapFilterCallback(&m_selfCollisionFilterCallback);
-  m_world->performDiscreteCollisionDetection();
-    
-  unsigned int numManifolds = m_world->getDispatcher()->getNumManifolds();
-  for(unsigned int i = 0; i < numManifolds; ++i)
-  {
-    btPersistentManifold* contactManifold = m_world->getDispatcher()->getManifoldByIndexInternal(i);
-	
-    if (contactManifold->getNumContacts() > 0)
-	    return true;
+  for (unsigned int i = 0; i < link_geom_.size(); ++i) {
+    LinkGeom *lg = link_geom_[i];
+    const planning_models::KinematicState::LinkState* link_state = state->getLinkState(lg->link->getName());
+    if (link_state == NULL) {
+      ROS_WARN_STREAM("No link state for link " << lg->link->getName());
+      continue;
+    }
+    btTransform pose = btTransformFrom(link_state->getGlobalCollisionBodyTransform());
+    lg->obj->setWorldTransform(pose);
+    lg->padded_obj->setWorldTransform(pose);
+
+    const std::vector<planning_models::KinematicState::AttachedBodyState*>& attached_bodies = link_state->getAttachedBodyStateVector();
+    for (unsigned int j = 0; j < attached_bodies.size() && j < lg->att_bodies.size(); ++j) {
+      for (unsigned int k = 0; k < attached_bodies[j]->getNumGlobalCollisionBodyTransforms(); k++) {
+        btTransform att_pose = btTransformFrom(attached_bodies[j]->getGlobalCollisionBodyTransforms()[k]);
+        lg->att_bodies[j]->obj[k]->setWorldTransform(att_pose);
+        lg->att_bodies[j]->padded_obj[k]->setWorldTransform(att_pose);
+      }
+    }
   }
-    
-  return false;
 }
 
-void collision_space::EnvironmentModelBullet::removeCollidingObjects(const shapes::StaticShape *shape)
+void collision_space::EnvironmentModelBullet::setAlteredLinkPadding(const std::map<std::string, double>& link_padding_map)
 {
+  collision_space::EnvironmentModel::setAlteredLinkPadding(link_padding_map);
+  rebuildPaddedRobotObjects(getCurrentLinkPaddingMap());
 }
 
-void collision_space::EnvironmentModelBullet::removeCollidingObjects(const shapes::Shape *shape, const tf::Transform &pose)
+void collision_space::EnvironmentModelBullet::revertAlteredLinkPadding()
 {
+  collision_space::EnvironmentModel::revertAlteredLinkPadding();
+  rebuildPaddedRobotObjects(default_link_padding_map_);
 }
 
-void collision_space::EnvironmentModelBullet::addObjects(const std::string &ns, const std::vector<shapes::Shape*> &shapes, const std::vector<tf::Transform> &poses)
+void collision_space::EnvironmentModelBullet::rebuildPaddedRobotObjects(const std::map<std::string, double>& link_padding_map)
 {
-  assert(shapes.size() == poses.size());
-  for (unsigned int i = 0 ; i < shapes.size() ; ++i)
-    addObject(ns, shapes[i], poses[i]);
+  for (unsigned int i = 0; i < link_geom_.size(); ++i) {
+    LinkGeom *lg = link_geom_[i];
+    double padd = default_robot_padding_;
+    if (link_padding_map.find(lg->link->getName()) != link_padding_map.end()) {
+      padd = link_padding_map.find(lg->link->getName())->second;
+    }
+    btTransform pose = lg->padded_obj->getWorldTransform();
+    delete lg->padded_obj->getCollisionShape();
+    lg->padded_obj->setCollisionShape(createBulletShape(lg->link->getLinkShape(), robot_scale_, padd));
+    lg->padded_obj->setWorldTransform(pose);
+
+    for (unsigned int j = 0; j < lg->att_bodies.size(); ++j) {
+      double att_padd = default_robot_padding_;
+      if (link_padding_map.find(lg->att_bodies[j]->att->getName()) != link_padding_map.end()) {
+        att_padd = link_padding_map.find(lg->att_bodies[j]->att->getName())->second;
+      } else if (link_padding_map.find("attached") != link_padding_map.end()) {
+        att_padd = link_padding_map.find("attached")->second;
+      }
+      for (unsigned int k = 0; k < lg->att_bodies[j]->padded_obj.size(); k++) {
+        btTransform att_pose = lg->att_bodies[j]->padded_obj[k]->getWorldTransform();
+        delete lg->att_bodies[j]->padded_obj[k]->getCollisionShape();
+        lg->att_bodies[j]->padded_obj[k]->setCollisionShape(createBulletShape(lg->att_bodies[j]->att->getShapes()[k], robot_scale_, att_padd));
+        lg->att_bodies[j]->padded_obj[k]->setWorldTransform(att_pose);
+      }
+    }
+  }
 }
 
-void collision_space::EnvironmentModelBullet::addObject(const std::string &ns, shapes::StaticShape* shape)
+void collision_space::EnvironmentModelBullet::setAlteredCollisionMatrix(const AllowedCollisionMatrix& acm)
 {
-  btCollisionObject *obj = createCollisionBody(shape);
-  m_world->addCollisionObject(obj);
-  m_obstacles[ns].push_back(obj);
-  m_objects->addObject(ns, shape);
+  collision_space::EnvironmentModel::setAlteredCollisionMatrix(acm);
+  self_collision_pairs_valid_ = false;
 }
 
-void collision_space::EnvironmentModelBullet::addObject(const std::string &ns, shapes::Shape *shape, const tf::Transform &pose)
+void collision_space::EnvironmentModelBullet::revertAlteredCollisionMatrix()
 {
-  btCollisionObject *obj = createCollisionBody(shape, 1.0, 0.0);
-  obj->setWorldTransform(pose);
-  m_world->addCollisionObject(obj);
-  m_obstacles[ns].push_back(obj);
-  m_objects->addObject(ns, shape, pose);    
+  collision_space::EnvironmentModel::revertAlteredCollisionMatrix();
+  self_collision_pairs_valid_ = false;
 }
 
-void collision_space::EnvironmentModelBullet::clearObjects(const std::string &ns)
+void collision_space::EnvironmentModelBullet::compileSelfCollisionPairList() const
 {
-  if (m_obstacles.find(ns) != m_obstacles.end())
-  {
-    unsigned int n = m_obstacles[ns].size();
-    for (unsigned int i = 0 ; i < n ; ++i)
-    {
-	    btCollisionObject* obj = m_obstacles[ns][i];
-	    m_world->removeCollisionObject(obj);
-	    //	delete obj->getCollisionShape();
-	    //	delete obj;
+  self_collision_pairs_.clear();
+
+  const AllowedCollisionMatrix& acm = getCurrentAllowedCollisionMatrix();
+
+  std::vector<btCollisionObject*> objects;
+  std::vector<std::string> names;
+  for (unsigned int i = 0; i < link_geom_.size(); ++i) {
+    LinkGeom *lg = link_geom_[i];
+    objects.push_back(lg->obj);
+    names.push_back(lg->link->getName());
+    for (unsigned int j = 0; j < lg->att_bodies.size(); j++) {
+      for (unsigned int k = 0; k < lg->att_bodies[j]->obj.size(); k++) {
+        objects.push_back(lg->att_bodies[j]->obj[k]);
+        names.push_back(lg->att_bodies[j]->att->getName());
+      }
     }
-    m_obstacles.erase(ns);
-  }   
-  m_objects->clearObjects(ns);
+  }
+
+  for (unsigned int i = 0; i < objects.size(); i++) {
+    for (unsigned int j = i + 1; j < objects.size(); j++) {
+      if (names[i] == names[j]) {
+        continue;
+      }
+      bool allowed = false;
+      if (!acm.getAllowedCollision(names[i], names[j], allowed)) {
+        ROS_DEBUG_STREAM("No entry in allowed collision matrix for " << names[i] << " and " << names[j]);
+        continue;
+      }
+      if (!allowed) {
+        self_collision_pairs_.push_back(std::pair<btCollisionObject*, btCollisionObject*>(objects[i], objects[j]));
+      }
+    }
+  }
+  self_collision_pairs_valid_ = true;
 }
 
-void collision_space::EnvironmentModelBullet::clearObjects(void)
+void collision_space::EnvironmentModelBullet::testPairCollision(btCollisionObject* o1, btCollisionObject* o2, CollisionData* cdata) const
 {
-  for (std::map<std::string, std::vector<btCollisionObject*> >::iterator it = m_obstacles.begin() ; it != m_obstacles.end() ; ++it)
-    clearObjects(it->first);
+  CollisionCallback cb(cdata, &getCurrentAllowedCollisionMatrix());
+  world_->contactPairTest(o1, o2, cb);
 }
 
-int collision_space::EnvironmentModelBullet::setCollisionCheck(const std::string &link, bool state)
-{ 
-  int result = -1;
-  for (unsigned int j = 0 ; j < m_modelGeom.linkGeom.size() ; ++j)
-  {
-    if (m_modelGeom.linkGeom[j]->link->getName() == link)
-    {
-	    result = m_modelGeom.linkGeom[j]->enabled ? 1 : 0;
-	    m_modelGeom.linkGeom[j]->enabled = state;
-	    break;
-    }
+void collision_space::EnvironmentModelBullet::testSelfCollision(CollisionData* cdata) const
+{
+  if (!self_collision_pairs_valid_) {
+    compileSelfCollisionPairList();
+  }
+  //the matrix was consulted when the pair list was compiled, so pairs
+  //only need the narrowphase here
+  CollisionCallback cb(cdata, NULL);
+  for (unsigned int i = 0; i < self_collision_pairs_.size() && !cdata->done; i++) {
+    world_->contactPairTest(self_collision_pairs_[i].first, self_collision_pairs_[i].second, cb);
   }
+}
 
-  return result;    
+void collision_space::EnvironmentModelBullet::testRobotEnvironmentCollision(CollisionData* cdata) const
+{
+  //contactTest culls through the dynamic AABB tree broadphase of the
+  //world, which holds only environment objects
+  CollisionCallback cb(cdata, &getCurrentAllowedCollisionMatrix());
+  for (unsigned int i = 0; i < link_geom_.size() && !cdata->done; ++i) {
+    LinkGeom *lg = link_geom_[i];
+    world_->contactTest(lg->padded_obj, cb);
+    for (unsigned int j = 0; j < lg->att_bodies.size() && !cdata->done; j++) {
+      for (unsigned int k = 0; k < lg->att_bodies[j]->padded_obj.size() && !cdata->done; k++) {
+        world_->contactTest(lg->att_bodies[j]->padded_obj[k], cb);
+      }
+    }
+  }
 }
 
-void collision_space::EnvironmentModelBullet::setCollisionCheckLinks(const std::vector<std::string> &links, bool state)
-{ 
-  if(links.empty())
+void collision_space::EnvironmentModelBullet::testObjectCollision(const std::string& ns, CollisionData* cdata) const
+{
+  std::map<std::string, CollisionNamespace>::const_iterator it = coll_namespaces_.find(ns);
+  if (it == coll_namespaces_.end()) {
+    ROS_WARN_STREAM("Failed to find object " << ns << " during collision check.");
     return;
+  }
+  for (unsigned int i = 0; i < link_geom_.size() && !cdata->done; ++i) {
+    LinkGeom *lg = link_geom_[i];
+    for (unsigned int j = 0; j < it->second.objects.size() && !cdata->done; j++) {
+      testPairCollision(lg->padded_obj, it->second.objects[j], cdata);
+    }
+    for (unsigned int j = 0; j < it->second.static_objects.size() && !cdata->done; j++) {
+      testPairCollision(lg->padded_obj, it->second.static_objects[j], cdata);
+    }
+    for (unsigned int j = 0; j < lg->att_bodies.size() && !cdata->done; j++) {
+      for (unsigned int k = 0; k < lg->att_bodies[j]->padded_obj.size() && !cdata->done; k++) {
+        for (unsigned int l = 0; l < it->second.objects.size() && !cdata->done; l++) {
+          testPairCollision(lg->att_bodies[j]->padded_obj[k], it->second.objects[l], cdata);
+        }
+      }
+    }
+  }
+}
 
-  for (unsigned int i = 0 ; i < m_modelGeom.linkGeom.size() ; ++i)
-  {
-    for (unsigned int j=0; j < links.size(); j++)
-    {
-      if (m_modelGeom.linkGeom[i]->link->getName() == links[j])
-      {
-        m_modelGeom.linkGeom[i]->enabled = state;
-        break;
+bool collision_space::EnvironmentModelBullet::isCollision(void) const
+{
+  CollisionData cdata;
+  testSelfCollision(&cdata);
+  if (!cdata.collides) {
+    testRobotEnvironmentCollision(&cdata);
+  }
+  return cdata.collides;
+}
+
+bool collision_space::EnvironmentModelBullet::isSelfCollision(void) const
+{
+  CollisionData cdata;
+  testSelfCollision(&cdata);
+  return cdata.collides;
+}
+
+bool collision_space::EnvironmentModelBullet::isEnvironmentCollision(void) const
+{
+  CollisionData cdata;
+  testRobotEnvironmentCollision(&cdata);
+  return cdata.collides;
+}
+
+bool collision_space::EnvironmentModelBullet::isObjectRobotCollision(const std::string& object_name) const
+{
+  CollisionData cdata;
+  testObjectCollision(object_name, &cdata);
+  return cdata.collides;
+}
+
+bool collision_space::EnvironmentModelBullet::isObjectObjectCollision(const std::string& object1_name,
+                                                                      const std::string& object2_name) const
+{
+  std::map<std::string, CollisionNamespace>::const_iterator it1 = coll_namespaces_.find(object1_name);
+  std::map<std::string, CollisionNamespace>::const_iterator it2 = coll_namespaces_.find(object2_name);
+  if (it1 == coll_namespaces_.end() || it2 == coll_namespaces_.end()) {
+    ROS_WARN_STREAM("Failed to find objects " << object1_name << " or " << object2_name << " during collision check.");
+    return false;
+  }
+  CollisionData cdata;
+  for (unsigned int i = 0; i < it1->second.objects.size() && !cdata.done; i++) {
+    for (unsigned int j = 0; j < it2->second.objects.size() && !cdata.done; j++) {
+      testPairCollision(it1->second.objects[i], it2->second.objects[j], &cdata);
+    }
+  }
+  return cdata.collides;
+}
+
+bool collision_space::EnvironmentModelBullet::isObjectInEnvironmentCollision(const std::string& object_name) const
+{
+  for (std::map<std::string, CollisionNamespace>::const_iterator it = coll_namespaces_.begin(); it != coll_namespaces_.end(); ++it) {
+    if (it->first != object_name) {
+      if (isObjectObjectCollision(object_name, it->first)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool collision_space::EnvironmentModelBullet::getAllObjectEnvironmentCollisionContacts(const std::string& object_name,
+                                                                                       std::vector<Contact> &contacts,
+                                                                                       unsigned int num_contacts_per_pair) const
+{
+  contacts.clear();
+  std::map<std::string, CollisionNamespace>::const_iterator it1 = coll_namespaces_.find(object_name);
+  if (it1 == coll_namespaces_.end()) {
+    ROS_WARN_STREAM("Failed to find object " << object_name << " during collision check.");
+    return false;
+  }
+  CollisionData cdata;
+  cdata.contacts = &contacts;
+  cdata.max_contacts_total = UINT_MAX;
+  cdata.max_contacts_pair = num_contacts_per_pair;
+  for (std::map<std::string, CollisionNamespace>::const_iterator it2 = coll_namespaces_.begin(); it2 != coll_namespaces_.end() && !cdata.done; ++it2) {
+    if (it2->first == object_name) {
+      continue;
+    }
+    for (unsigned int i = 0; i < it1->second.objects.size() && !cdata.done; i++) {
+      for (unsigned int j = 0; j < it2->second.objects.size() && !cdata.done; j++) {
+        testPairCollision(it1->second.objects[i], it2->second.objects[j], &cdata);
       }
     }
   }
+  return cdata.collides;
+}
+
+bool collision_space::EnvironmentModelBullet::getCollisionContacts(std::vector<Contact> &contacts, unsigned int max_total, unsigned int max_per_pair) const
+{
+  contacts.clear();
+  CollisionData cdata;
+  cdata.contacts = &contacts;
+  cdata.max_contacts_total = max_total;
+  cdata.max_contacts_pair = max_per_pair;
+  testSelfCollision(&cdata);
+  if (!cdata.done) {
+    testRobotEnvironmentCollision(&cdata);
+  }
+  return cdata.collides;
+}
+
+bool collision_space::EnvironmentModelBullet::getAllCollisionContacts(std::vector<Contact> &contacts, unsigned int num_per_contact) const
+{
+  return getCollisionContacts(contacts, UINT_MAX, num_per_contact);
+}
+
+void collision_space::EnvironmentModelBullet::getAttachedBodyPoses(std::map<std::string, std::vector<tf::Transform> >& pose_map) const
+{
+  pose_map.clear();
+  for (unsigned int i = 0; i < link_geom_.size(); ++i) {
+    LinkGeom *lg = link_geom_[i];
+    for (unsigned int j = 0; j < lg->att_bodies.size(); ++j) {
+      std::vector<tf::Transform> nbt;
+      for (unsigned int k = 0; k < lg->att_bodies[j]->obj.size(); k++) {
+        nbt.push_back(tfTransformFrom(lg->att_bodies[j]->obj[k]->getWorldTransform()));
+      }
+      pose_map[lg->att_bodies[j]->att->getName()] = nbt;
+    }
+  }
+}
+
+bool collision_space::EnvironmentModelBullet::hasObject(const std::string& ns) const
+{
+  return coll_namespaces_.find(ns) != coll_namespaces_.end();
+}
+
+void collision_space::EnvironmentModelBullet::addObject(const std::string &ns, shapes::StaticShape *shape)
+{
+  btCollisionObject* obj = createCollisionObject(shape);
+  if (!obj) {
+    return;
+  }
+  if (coll_namespaces_.find(ns) == coll_namespaces_.end()) {
+    default_collision_matrix_.addEntry(ns, false);
+  }
+  obj->setUserPointer(new BodyRecord(ns, OBJECT));
+  world_->addCollisionObject(obj);
+  coll_namespaces_[ns].static_objects.push_back(obj);
+  objects_->addObject(ns, shape);
 }
 
-void collision_space::EnvironmentModelBullet::setCollisionCheckOnlyLinks(const std::vector<std::string> &links, bool state)
-{ 
-  if(links.empty())
+void collision_space::EnvironmentModelBullet::addObject(const std::string &ns, shapes::Shape* shape, const tf::Transform &pose)
+{
+  btCollisionObject* obj = createCollisionObject(shape, 1.0, 0.0);
+  if (!obj) {
     return;
+  }
+  if (coll_namespaces_.find(ns) == coll_namespaces_.end()) {
+    default_collision_matrix_.addEntry(ns, false);
+  }
+  obj->setUserPointer(new BodyRecord(ns, OBJECT));
+  obj->setWorldTransform(btTransformFrom(pose));
+  world_->addCollisionObject(obj);
+  coll_namespaces_[ns].objects.push_back(obj);
+  objects_->addObject(ns, shape, pose);
+}
 
-  for (unsigned int i = 0 ; i < m_modelGeom.linkGeom.size() ; ++i)
-  {
-    int result = -1;
-    for (unsigned int j=0; j < links.size(); j++)
-    {
-      if (m_modelGeom.linkGeom[i]->link->getName() == links[j])
-      {
-        m_modelGeom.linkGeom[i]->enabled = state;
-        result = j;
-        break;
-      }        
+void collision_space::EnvironmentModelBullet::addObjects(const std::string &ns, const std::vector<shapes::Shape*> &shapes, const std::vector<tf::Transform> &poses)
+{
+  assert(shapes.size() == poses.size());
+  if (coll_namespaces_.find(ns) == coll_namespaces_.end()) {
+    default_collision_matrix_.addEntry(ns, false);
+  }
+  objects_->addObjectNamespace(ns);
+  for (unsigned int i = 0; i < shapes.size(); i++) {
+    btCollisionObject* obj = createCollisionObject(shapes[i], 1.0, 0.0);
+    if (!obj) {
+      continue;
     }
-    if(result < 0)
-      m_modelGeom.linkGeom[i]->enabled = !state;      
+    obj->setUserPointer(new BodyRecord(ns, OBJECT));
+    obj->setWorldTransform(btTransformFrom(poses[i]));
+    world_->addCollisionObject(obj);
+    coll_namespaces_[ns].objects.push_back(obj);
+    objects_->addObject(ns, shapes[i], poses[i]);
   }
 }
 
-void collision_space::EnvironmentModelBullet::setCollisionCheckAll(bool state)
-{ 
-  for (unsigned int j = 0 ; j < m_modelGeom.linkGeom.size() ; ++j)
-  {
-    m_modelGeom.linkGeom[j]->enabled = state;
+void collision_space::EnvironmentModelBullet::clearObjects(void)
+{
+  for (std::map<std::string, CollisionNamespace>::iterator it = coll_namespaces_.begin(); it != coll_namespaces_.end(); ++it) {
+    default_collision_matrix_.removeEntry(it->first);
+    for (unsigned int i = 0; i < it->second.objects.size(); i++) {
+      freeObject(it->second.objects[i], true);
+    }
+    for (unsigned int i = 0; i < it->second.static_objects.size(); i++) {
+      freeObject(it->second.static_objects[i], true);
+    }
   }
+  coll_namespaces_.clear();
+  objects_->clearObjects();
+}
+
+void collision_space::EnvironmentModelBullet::clearObjects(const std::string &ns)
+{
+  std::map<std::string, CollisionNamespace>::iterator it = coll_namespaces_.find(ns);
+  if (it != coll_namespaces_.end()) {
+    default_collision_matrix_.removeEntry(ns);
+    for (unsigned int i = 0; i < it->second.objects.size(); i++) {
+      freeObject(it->second.objects[i], true);
+    }
+    for (unsigned int i = 0; i < it->second.static_objects.size(); i++) {
+      freeObject(it->second.static_objects[i], true);
+    }
+    coll_namespaces_.erase(it);
+  }
+  objects_->clearObjects(ns);
 }
 
 collision_space::EnvironmentModel* collision_space::EnvironmentModelBullet::clone(void) const
 {
-  return NULL;    
+  EnvironmentModelBullet *env = new EnvironmentModelBullet();
+  env->verbose_ = verbose_;
+  if (robot_model_) {
+    env->setRobotModel(new planning_models::KinematicModel(*robot_model_), default_collision_matrix_, default_link_padding_map_, default_robot_padding_, robot_scale_);
+  }
+
+  //deep copy of the environment objects from the bookkeeping
+  std::vector<std::string> ns = objects_->getNamespaces();
+  for (unsigned int i = 0; i < ns.size(); i++) {
+    const EnvironmentObjects::NamespaceObjects& no = objects_->getObjects(ns[i]);
+    for (unsigned int j = 0; j < no.static_shape.size(); j++) {
+      env->addObject(ns[i], shapes::cloneShape(no.static_shape[j]));
+    }
+    for (unsigned int j = 0; j < no.shape.size(); j++) {
+      env->addObject(ns[i], shapes::cloneShape(no.shape[j]), no.shape_pose[j]);
+    }
+  }
+  return env;
 }
@@ -35,15 +35,20 @@
 /** \author Ioan Sucan */
 
 #include "collision_space/environmentODE.h"
+#include "collision_space/thread_affinity.h"
 #include <geometric_shapes/shape_operations.h>
 #include <ros/console.h>
+#include <ros/time.h>
 #include <cassert>
 #include <cstdio>
 #include <cmath>
 #include <algorithm>
 #include <map>
+#include <set>
+#include <sstream>
 
 #include <boost/thread.hpp>
+#include <boost/bind.hpp>
 static int          ODEInitCount = 0;
 static boost::mutex ODEInitCountLock;
 
@@ -54,6 +59,7 @@ static boost::mutex                     ODEThreadMapLock;
 
 static const int MAX_ODE_CONTACTS = 128;
 static const int TEST_FOR_ALLOWED_NUM = 1;
+static const unsigned int MAX_PARKED_ATTACHED_BODIES = 32;
 
 static const std::string CONTACT_ONLY_NAME="contact_only";
 
@@ -76,6 +82,13 @@ collision_space::EnvironmentModelODE::EnvironmentModelODE(void) : EnvironmentMod
   model_geom_.self_space = dSweepAndPruneSpaceCreate(0, dSAP_AXES_XZY);
   
   previous_set_robot_model_ = false;
+  self_collision_pairs_valid_ = false;
+  query_stats_enabled_ = false;
+  two_phase_env_check_ = false;
+  self_first_collision_count_ = 0;
+  env_first_collision_count_ = 0;
+  object_batch_active_ = false;
+  parked_att_geom_count_ = 0;
 }
 
 collision_space::EnvironmentModelODE::~EnvironmentModelODE(void)
@@ -97,7 +110,8 @@ collision_space::EnvironmentModelODE::~EnvironmentModelODE(void)
 }
 
 void collision_space::EnvironmentModelODE::freeMemory(void)
-{ 
+{
+  clearParkedAttachedBodies();
   for (unsigned int j = 0 ; j < model_geom_.link_geom.size() ; ++j)
     delete model_geom_.link_geom[j];
   model_geom_.link_geom.clear();
@@ -105,9 +119,6 @@ void collision_space::EnvironmentModelODE::freeMemory(void)
     dSpaceDestroy(model_geom_.env_space);
   if (model_geom_.self_space)
     dSpaceDestroy(model_geom_.self_space);
-  for (std::map<std::string, CollisionNamespace*>::iterator it = coll_namespaces_.begin() ; it != coll_namespaces_.end() ; ++it) {
-    delete it->second;
-  }
   model_geom_.storage.clear();
   coll_namespaces_.clear();
 }
@@ -134,6 +145,7 @@ void collision_space::EnvironmentModelODE::setRobotModel(const planning_models::
 {
   collision_space::EnvironmentModel::setRobotModel(model, allowed_collision_matrix, link_padding_map, default_padding, scale);
   if(previous_set_robot_model_) {
+    clearParkedAttachedBodies();
     for (unsigned int j = 0 ; j < model_geom_.link_geom.size() ; ++j)
       delete model_geom_.link_geom[j];
     model_geom_.link_geom.clear();
@@ -143,9 +155,14 @@ void collision_space::EnvironmentModelODE::setRobotModel(const planning_models::
     model_geom_.self_space = dSweepAndPruneSpaceCreate(0, dSAP_AXES_XZY);
     attached_bodies_in_collision_matrix_.clear();
     geom_lookup_map_.clear();
+    link_geom_map_.clear();
   }
   createODERobotModel();
   previous_set_robot_model_ = true;
+  self_collision_pairs_valid_ = false;
+  //compile eagerly so snapshot readers never hit the lazy rebuild
+  compileSelfCollisionPairList();
+  bumpModificationEpoch();
 }
 
 void collision_space::EnvironmentModelODE::getAttachedBodyPoses(std::map<std::string, std::vector<tf::Transform> >& pose_map) const
@@ -199,12 +216,12 @@ void collision_space::EnvironmentModelODE::createODERobotModel()
     dGeomID unpadd_g = createODEGeom(model_geom_.self_space, model_geom_.storage, link->getLinkShape(), 1.0, 0.0);
     assert(unpadd_g);
     lg->geom.push_back(unpadd_g);
-    geom_lookup_map_[unpadd_g] = std::pair<std::string, BodyType>(link->getName(), LINK);
+    geom_lookup_map_[unpadd_g] = GeomLookup(link->getName(), LINK, lg->index);
 
     dGeomID padd_g = createODEGeom(model_geom_.env_space, model_geom_.storage, link->getLinkShape(), robot_scale_, padd);
     assert(padd_g);
     lg->padded_geom.push_back(padd_g);
-    geom_lookup_map_[padd_g] = std::pair<std::string, BodyType>(link->getName(), LINK);
+    geom_lookup_map_[padd_g] = GeomLookup(link->getName(), LINK, lg->index);
     const std::vector<planning_models::KinematicModel::AttachedBodyModel*>& attached_bodies = link->getAttachedBodyModels();
     for (unsigned int j = 0 ; j < attached_bodies.size() ; ++j) {
       padd = default_robot_padding_;
@@ -215,6 +232,7 @@ void collision_space::EnvironmentModelODE::createODERobotModel()
       }
       addAttachedBody(lg, attached_bodies[j], padd);
     }
+    link_geom_map_[link->getName()] = model_geom_.link_geom.size();
     model_geom_.link_geom.push_back(lg);
   } 
 }
@@ -236,6 +254,60 @@ dGeomID collision_space::EnvironmentModelODE::createODEGeom(dSpaceID space, ODES
   return g;
 }
 
+namespace
+{
+//64 bit FNV-1a over raw bytes; used to key the trimesh cache on mesh content
+unsigned long long hashBytes(const void *buf, unsigned long len, unsigned long long h)
+{
+  const unsigned char *p = reinterpret_cast<const unsigned char*>(buf);
+  for (unsigned long i = 0 ; i < len ; ++i)
+  {
+    h ^= (unsigned long long)p[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+//content key for parking attached-body geoms: object name plus shape
+//data under the scale and padding the geoms were built with, so a
+//parked entry is only reclaimed for a geometrically identical body
+std::string attachedBodyKey(const planning_models::KinematicModel::AttachedBodyModel* attm, double scale, double padding)
+{
+  std::stringstream ss;
+  ss << attm->getName() << ":" << scale << ":" << padding;
+  for(unsigned int i = 0; i < attm->getShapes().size(); i++) {
+    const shapes::Shape* shape = attm->getShapes()[i];
+    ss << ":" << shape->type;
+    switch(shape->type) {
+    case shapes::SPHERE:
+      ss << ":" << static_cast<const shapes::Sphere*>(shape)->radius;
+      break;
+    case shapes::BOX:
+      {
+        const double* size = static_cast<const shapes::Box*>(shape)->size;
+        ss << ":" << size[0] << ":" << size[1] << ":" << size[2];
+      }
+      break;
+    case shapes::CYLINDER:
+      ss << ":" << static_cast<const shapes::Cylinder*>(shape)->radius
+         << ":" << static_cast<const shapes::Cylinder*>(shape)->length;
+      break;
+    case shapes::MESH:
+      {
+        const shapes::Mesh* mesh = static_cast<const shapes::Mesh*>(shape);
+        ss << ":" << mesh->vertexCount << ":" << mesh->triangleCount << ":"
+           << hashBytes(mesh->vertices, sizeof(double) * 3 * mesh->vertexCount, 14695981039346656037ULL) << ":"
+           << hashBytes(mesh->triangles, sizeof(unsigned int) * 3 * mesh->triangleCount, 14695981039346656037ULL);
+      }
+      break;
+    default:
+      break;
+    }
+  }
+  return ss.str();
+}
+}
+
 dGeomID collision_space::EnvironmentModelODE::createODEGeom(dSpaceID space, ODEStorage &storage, const shapes::Shape *shape, double scale, double padding)
 {
   dGeomID g = NULL;
@@ -263,6 +335,21 @@ dGeomID collision_space::EnvironmentModelODE::createODEGeom(dSpaceID space, ODES
       const shapes::Mesh *mesh = static_cast<const shapes::Mesh*>(shape);
       if (mesh->vertexCount > 0 && mesh->triangleCount > 0)
       {		
+        // scale and padding are baked into the vertices below, so they
+        // are part of the cache key along with the mesh content
+        std::stringstream ss;
+        ss << mesh->vertexCount << ":" << mesh->triangleCount << ":" << scale << ":" << padding << ":"
+           << hashBytes(mesh->vertices, sizeof(double) * 3 * mesh->vertexCount, 14695981039346656037ULL) << ":"
+           << hashBytes(mesh->triangles, sizeof(unsigned int) * 3 * mesh->triangleCount, 14695981039346656037ULL);
+        const std::string key = ss.str();
+        std::map<std::string, ODEStorage::Element>::const_iterator cached = trimesh_cache_.entries.find(key);
+        if (cached != trimesh_cache_.entries.end())
+        {
+          g = dCreateTriMesh(space, cached->second.data, NULL, NULL, NULL);
+          storage.meshes[g] = cached->second;
+          break;
+        }
+
         // copy indices for ODE
         int icount = mesh->triangleCount * 3;
         dTriIndex *indices = new dTriIndex[icount];
@@ -320,6 +407,8 @@ dGeomID collision_space::EnvironmentModelODE::createODEGeom(dSpaceID space, ODES
         e.data = data;
         e.n_vertices = mesh->vertexCount;
         e.n_indices = icount;
+        e.shared = true;
+        trimesh_cache_.entries[key] = e;
       }
     }
 	
@@ -366,8 +455,12 @@ void collision_space::EnvironmentModelODE::updateAttachedBodies(const std::map<s
       for(unsigned int k = 0; k < lg->att_bodies[j]->padded_geom.size(); k++) {
         geom_lookup_map_.erase(lg->att_bodies[j]->padded_geom[k]);
       }
+      //park instead of destroy: pick-place loops re-attach the same
+      //object content over and over, and reclaiming parked geoms
+      //turns the rebuild into a transform update
+      parkAttachedBody(lg->att_bodies[j]);
     }
-    lg->deleteAttachedBodies();
+    lg->att_bodies.clear();
 
     /* create new set of attached bodies */
     const std::vector<planning_models::KinematicModel::AttachedBodyModel*>& attached_bodies = lg->link->getAttachedBodyModels();
@@ -382,14 +475,62 @@ void collision_space::EnvironmentModelODE::updateAttachedBodies(const std::map<s
       addAttachedBody(lg, attached_bodies[j], padd);
     }
   }
+  self_collision_pairs_valid_ = false;
+  compileSelfCollisionPairList();
+  bumpModificationEpoch();
+}
+
+void collision_space::EnvironmentModelODE::parkAttachedBody(AttGeom* attg)
+{
+  if(parked_att_geom_count_ >= MAX_PARKED_ATTACHED_BODIES) {
+    delete attg;
+    return;
+  }
+  for(unsigned int i = 0; i < attg->geom.size(); i++) {
+    dSpaceRemove(model_geom_.self_space, attg->geom[i]);
+  }
+  for(unsigned int i = 0; i < attg->padded_geom.size(); i++) {
+    dSpaceRemove(model_geom_.env_space, attg->padded_geom[i]);
+  }
+  //the body model belongs to the kinematic model and may be freed
+  //before these geoms are reclaimed
+  attg->att = NULL;
+  parked_att_geoms_[attg->park_key].push_back(attg);
+  parked_att_geom_count_++;
+}
+
+void collision_space::EnvironmentModelODE::clearParkedAttachedBodies()
+{
+  for(std::map<std::string, std::vector<AttGeom*> >::iterator it = parked_att_geoms_.begin();
+      it != parked_att_geoms_.end();
+      it++) {
+    for(unsigned int i = 0; i < it->second.size(); i++) {
+      delete it->second[i];
+    }
+  }
+  parked_att_geoms_.clear();
+  parked_att_geom_count_ = 0;
 }
 
-void collision_space::EnvironmentModelODE::addAttachedBody(LinkGeom* lg, 
+void collision_space::EnvironmentModelODE::addAttachedBody(LinkGeom* lg,
                                                            const planning_models::KinematicModel::AttachedBodyModel* attm,
                                                            double padd) {
 
-  AttGeom* attg = new AttGeom(model_geom_.storage);
-  attg->att = attm;
+  AttGeom* attg = NULL;
+  const std::string key = attachedBodyKey(attm, robot_scale_, padd);
+  std::map<std::string, std::vector<AttGeom*> >::iterator parked = parked_att_geoms_.find(key);
+  if(parked != parked_att_geoms_.end() && !parked->second.empty()) {
+    //the same object content was attached before; wake the parked
+    //geoms instead of rebuilding them
+    attg = parked->second.back();
+    parked->second.pop_back();
+    parked_att_geom_count_--;
+    attg->att = attm;
+  } else {
+    attg = new AttGeom(model_geom_.storage);
+    attg->att = attm;
+    attg->park_key = key;
+  }
 
   if(!default_collision_matrix_.addEntry(attm->getName(), false)) {
     ROS_WARN_STREAM("Must already have an entry in allowed collision matrix for " << attm->getName());
@@ -408,16 +549,27 @@ void collision_space::EnvironmentModelODE::addAttachedBody(LinkGeom* lg,
       }
     }
   }
-  for(unsigned int i = 0; i < attm->getShapes().size(); i++) {
-    dGeomID ga = createODEGeom(model_geom_.self_space, model_geom_.storage, attm->getShapes()[i], 1.0, 0.0);
-    assert(ga);
-    attg->geom.push_back(ga);
-    geom_lookup_map_[ga] = std::pair<std::string, BodyType>(attm->getName(), ATTACHED);    
-
-    dGeomID padd_ga = createODEGeom(model_geom_.env_space, model_geom_.storage, attm->getShapes()[i], robot_scale_, padd);
-    assert(padd_ga);
-    attg->padded_geom.push_back(padd_ga);
-    geom_lookup_map_[padd_ga] = std::pair<std::string, BodyType>(attm->getName(), ATTACHED);    
+  if(!attg->geom.empty()) {
+    //reclaimed geoms only need to rejoin the spaces; their transforms
+    //are refreshed with the rest of the link on the next state update
+    for(unsigned int i = 0; i < attg->geom.size(); i++) {
+      dSpaceAdd(model_geom_.self_space, attg->geom[i]);
+      geom_lookup_map_[attg->geom[i]] = GeomLookup(attm->getName(), ATTACHED, attg->index);
+      dSpaceAdd(model_geom_.env_space, attg->padded_geom[i]);
+      geom_lookup_map_[attg->padded_geom[i]] = GeomLookup(attm->getName(), ATTACHED, attg->index);
+    }
+  } else {
+    for(unsigned int i = 0; i < attm->getShapes().size(); i++) {
+      dGeomID ga = createODEGeom(model_geom_.self_space, model_geom_.storage, attm->getShapes()[i], 1.0, 0.0);
+      assert(ga);
+      attg->geom.push_back(ga);
+      geom_lookup_map_[ga] = GeomLookup(attm->getName(), ATTACHED, attg->index);
+
+      dGeomID padd_ga = createODEGeom(model_geom_.env_space, model_geom_.storage, attm->getShapes()[i], robot_scale_, padd);
+      assert(padd_ga);
+      attg->padded_geom.push_back(padd_ga);
+      geom_lookup_map_[padd_ga] = GeomLookup(attm->getName(), ATTACHED, attg->index);
+    }
   }
   lg->att_bodies.push_back(attg);
 }
@@ -442,8 +594,10 @@ void collision_space::EnvironmentModelODE::setAttachedBodiesLinkPadding() {
           dGeomID padd_ga = createODEGeom(model_geom_.env_space, model_geom_.storage, attached_bodies[j]->getShapes()[k], robot_scale_, new_padd);
           assert(padd_ga);
           lg->att_bodies[j]->padded_geom[k] = padd_ga;
-          geom_lookup_map_[padd_ga] = std::pair<std::string, BodyType>(attached_bodies[j]->getName(), ATTACHED);
+          geom_lookup_map_[padd_ga] = GeomLookup(attached_bodies[j]->getName(), ATTACHED, lg->att_bodies[j]->index);
         }
+        //the padded geoms changed, so the slot they would park under changes with them
+        lg->att_bodies[j]->park_key = attachedBodyKey(attached_bodies[j], robot_scale_, new_padd);
       }
     }
   }
@@ -469,13 +623,28 @@ void collision_space::EnvironmentModelODE::revertAttachedBodiesLinkPadding() {
           dGeomID padd_ga = createODEGeom(model_geom_.env_space, model_geom_.storage, attached_bodies[j]->getShapes()[k], robot_scale_, new_padd);
           assert(padd_ga);
           lg->att_bodies[j]->padded_geom[k] = padd_ga;
-          geom_lookup_map_[padd_ga] = std::pair<std::string, BodyType>(attached_bodies[j]->getName(), ATTACHED);
+          geom_lookup_map_[padd_ga] = GeomLookup(attached_bodies[j]->getName(), ATTACHED, lg->att_bodies[j]->index);
         }
+        //the padded geoms changed, so the slot they would park under changes with them
+        lg->att_bodies[j]->park_key = attachedBodyKey(attached_bodies[j], robot_scale_, new_padd);
       }
     }
   }
 }
 
+void collision_space::EnvironmentModelODE::updateLinkGeom(LinkGeom* lg, const planning_models::KinematicState::LinkState* link_state)
+{
+  updateGeom(lg->geom[0], link_state->getGlobalCollisionBodyTransform());
+  updateGeom(lg->padded_geom[0], link_state->getGlobalCollisionBodyTransform());
+  const std::vector<planning_models::KinematicState::AttachedBodyState*>& attached_bodies = link_state->getAttachedBodyStateVector();
+  for (unsigned int j = 0 ; j < attached_bodies.size(); ++j) {
+    for(unsigned int k = 0; k < attached_bodies[j]->getNumGlobalCollisionBodyTransforms(); k++) {
+      updateGeom(lg->att_bodies[j]->geom[k], attached_bodies[j]->getGlobalCollisionBodyTransforms()[k]);
+      updateGeom(lg->att_bodies[j]->padded_geom[k], attached_bodies[j]->getGlobalCollisionBodyTransforms()[k]);
+    }
+  }
+}
+
 void collision_space::EnvironmentModelODE::updateRobotModel(const planning_models::KinematicState* state)
 { 
   const unsigned int n = model_geom_.link_geom.size();
@@ -486,18 +655,70 @@ void collision_space::EnvironmentModelODE::updateRobotModel(const planning_model
       ROS_WARN_STREAM("No link state for link " << model_geom_.link_geom[i]->link->getName());
       continue;
     }
-    updateGeom(model_geom_.link_geom[i]->geom[0], link_state->getGlobalCollisionBodyTransform());
-    updateGeom(model_geom_.link_geom[i]->padded_geom[0], link_state->getGlobalCollisionBodyTransform());
-    const std::vector<planning_models::KinematicState::AttachedBodyState*>& attached_bodies = link_state->getAttachedBodyStateVector();
-    for (unsigned int j = 0 ; j < attached_bodies.size(); ++j) {
-      for(unsigned int k = 0; k < attached_bodies[j]->getGlobalCollisionBodyTransforms().size(); k++) {
-        updateGeom(model_geom_.link_geom[i]->att_bodies[j]->geom[k], attached_bodies[j]->getGlobalCollisionBodyTransforms()[k]);
-        updateGeom(model_geom_.link_geom[i]->att_bodies[j]->padded_geom[k], attached_bodies[j]->getGlobalCollisionBodyTransforms()[k]);
-      }
-    }
+    updateLinkGeom(model_geom_.link_geom[i], link_state);
   }    
 }
 
+void collision_space::EnvironmentModelODE::updateRobotModel(const planning_models::KinematicState* state,
+                                                            const std::vector<std::string>& changed_links)
+{
+  for (unsigned int i = 0 ; i < changed_links.size() ; ++i) {
+    std::map<std::string, unsigned int>::const_iterator it = link_geom_map_.find(changed_links[i]);
+    if(it == link_geom_map_.end()) {
+      //links with no collision geometry are not in the map
+      continue;
+    }
+    const planning_models::KinematicState::LinkState* link_state = state->getLinkState(changed_links[i]);
+    if(link_state == NULL) {
+      ROS_WARN_STREAM("No link state for link " << changed_links[i]);
+      continue;
+    }
+    updateLinkGeom(model_geom_.link_geom[it->second], link_state);
+  }
+}
+
+void collision_space::EnvironmentModelODE::setAlteredCollisionMatrix(const AllowedCollisionMatrix& acm) {
+  collision_space::EnvironmentModel::setAlteredCollisionMatrix(acm);
+  self_collision_pairs_valid_ = false;
+  compileSelfCollisionPairList();
+  bumpModificationEpoch();
+}
+
+void collision_space::EnvironmentModelODE::revertAlteredCollisionMatrix() {
+  collision_space::EnvironmentModel::revertAlteredCollisionMatrix();
+  self_collision_pairs_valid_ = false;
+  compileSelfCollisionPairList();
+  bumpModificationEpoch();
+}
+
+void collision_space::EnvironmentModelODE::setAllowedContacts(const std::vector<AllowedContact>& allowed_contacts)
+{
+  collision_space::EnvironmentModel::setAllowedContacts(allowed_contacts);
+  compiled_allowed_contact_map_.clear();
+  for(unsigned int i = 0; i < allowed_contacts.size(); i++) {
+    const AllowedContact& ac = allowed_contacts[i];
+    if(!ac.bound) {
+      ROS_WARN_STREAM("Allowed contact between " << ac.body_name_1 << " and " << ac.body_name_2 << " has no bound");
+      continue;
+    }
+    CompiledAllowedContact cac;
+    cac.bound = ac.bound;
+    cac.depth = ac.depth;
+    bodies::BoundingSphere bs;
+    ac.bound->computeBoundingSphere(bs);
+    cac.center = bs.center;
+    cac.radius2 = bs.radius * bs.radius;
+    compiled_allowed_contact_map_[std::make_pair(ac.body_name_1, ac.body_name_2)].push_back(cac);
+    compiled_allowed_contact_map_[std::make_pair(ac.body_name_2, ac.body_name_1)].push_back(cac);
+  }
+}
+
+void collision_space::EnvironmentModelODE::clearAllowedContacts()
+{
+  collision_space::EnvironmentModel::clearAllowedContacts();
+  compiled_allowed_contact_map_.clear();
+}
+
 void collision_space::EnvironmentModelODE::setAlteredLinkPadding(const std::map<std::string, double>& new_link_padding) {
   
   //updating altered map
@@ -527,7 +748,7 @@ void collision_space::EnvironmentModelODE::setAlteredLinkPadding(const std::map<
       dGeomID g = createODEGeom(model_geom_.env_space, model_geom_.storage, link->getLinkShape(), robot_scale_, new_padding);
       assert(g);
       lg->padded_geom.push_back(g);
-      geom_lookup_map_[g] = std::pair<std::string, BodyType>(link->getName(), LINK);
+      geom_lookup_map_[g] = GeomLookup(link->getName(), LINK, lg->index);
     }
   }
   //this does all the work
@@ -559,7 +780,7 @@ void collision_space::EnvironmentModelODE::revertAlteredLinkPadding() {
       assert(g);
       dGeomSetData(g, reinterpret_cast<void*>(lg));
       lg->padded_geom.push_back(g);
-      geom_lookup_map_[g] = std::pair<std::string, BodyType>(link->getName(), LINK);
+      geom_lookup_map_[g] = GeomLookup(link->getName(), LINK, lg->index);
     }
   }
   revertAttachedBodiesLinkPadding();
@@ -576,8 +797,10 @@ bool collision_space::EnvironmentModelODE::ODECollide2::empty(void) const
 void collision_space::EnvironmentModelODE::ODECollide2::registerSpace(dSpaceID space)
 {
   int n = dSpaceGetNumGeoms(space);
+  std::vector<dGeomID> geoms(n);
   for (int i = 0 ; i < n ; ++i)
-    registerGeom(dSpaceGetGeom(space, i));
+    geoms[i] = dSpaceGetGeom(space, i);
+  registerGeoms(geoms);
 }
 
 void collision_space::EnvironmentModelODE::ODECollide2::unregisterGeom(dGeomID geom)
@@ -638,10 +861,60 @@ void collision_space::EnvironmentModelODE::ODECollide2::registerGeom(dGeomID geo
   Geom *g = new Geom();
   g->id = geom;
   dGeomGetAABB(geom, g->aabb);
-  geoms_x.push_back(g);
-  geoms_y.push_back(g);
-  geoms_z.push_back(g);
-  setup_ = false;
+  if (setup_)
+  {
+    //the arrays are already sorted, so keep them sorted by inserting in
+    //place rather than invalidating them and paying a full re-sort
+    geoms_x.insert(std::lower_bound(geoms_x.begin(), geoms_x.end(), g, SortByXLow()), g);
+    geoms_y.insert(std::lower_bound(geoms_y.begin(), geoms_y.end(), g, SortByYLow()), g);
+    geoms_z.insert(std::lower_bound(geoms_z.begin(), geoms_z.end(), g, SortByZLow()), g);
+  }
+  else
+  {
+    geoms_x.push_back(g);
+    geoms_y.push_back(g);
+    geoms_z.push_back(g);
+  }
+}
+
+void collision_space::EnvironmentModelODE::ODECollide2::registerGeoms(const std::vector<dGeomID> &geoms)
+{
+  if (geoms.empty())
+    return;
+
+  std::vector<Geom*> batch(geoms.size());
+  for (unsigned int i = 0 ; i < geoms.size() ; ++i)
+  {
+    batch[i] = new Geom();
+    batch[i]->id = geoms[i];
+    dGeomGetAABB(geoms[i], batch[i]->aabb);
+  }
+
+  if (setup_)
+  {
+    //sort just the batch and merge it into the already sorted arrays,
+    //which is O(batch log batch + n) instead of O(n log n)
+    const unsigned int mid_x = geoms_x.size();
+    geoms_x.insert(geoms_x.end(), batch.begin(), batch.end());
+    std::sort(geoms_x.begin() + mid_x, geoms_x.end(), SortByXLow());
+    std::inplace_merge(geoms_x.begin(), geoms_x.begin() + mid_x, geoms_x.end(), SortByXLow());
+
+    const unsigned int mid_y = geoms_y.size();
+    geoms_y.insert(geoms_y.end(), batch.begin(), batch.end());
+    std::sort(geoms_y.begin() + mid_y, geoms_y.end(), SortByYLow());
+    std::inplace_merge(geoms_y.begin(), geoms_y.begin() + mid_y, geoms_y.end(), SortByYLow());
+
+    const unsigned int mid_z = geoms_z.size();
+    geoms_z.insert(geoms_z.end(), batch.begin(), batch.end());
+    std::sort(geoms_z.begin() + mid_z, geoms_z.end(), SortByZLow());
+    std::inplace_merge(geoms_z.begin(), geoms_z.begin() + mid_z, geoms_z.end(), SortByZLow());
+  }
+  else
+  {
+    geoms_x.insert(geoms_x.end(), batch.begin(), batch.end());
+    geoms_y.insert(geoms_y.end(), batch.begin(), batch.end());
+    geoms_z.insert(geoms_z.end(), batch.begin(), batch.end());
+  }
 }
 	
 void collision_space::EnvironmentModelODE::ODECollide2::clear(void)
@@ -765,12 +1038,12 @@ void nearCallbackFn(void *data, dGeomID o1, dGeomID o2)
   
   std::string object_name;
 
-  std::map<dGeomID, std::pair<std::string, EnvironmentModelODE::BodyType> >::const_iterator it1 = cdata->geom_lookup_map->find(o1);
-  std::map<dGeomID, std::pair<std::string, EnvironmentModelODE::BodyType> >::const_iterator it2 = cdata->geom_lookup_map->find(o2);
+  std::map<dGeomID, EnvironmentModelODE::GeomLookup>::const_iterator it1 = cdata->geom_lookup_map->find(o1);
+  std::map<dGeomID, EnvironmentModelODE::GeomLookup>::const_iterator it2 = cdata->geom_lookup_map->find(o2);
   
   if(it1 != cdata->geom_lookup_map->end()) {
-    cdata->body_name_1 = it1->second.first;
-    cdata->body_type_1 = it1->second.second;
+    cdata->body_name_1 = it1->second.name;
+    cdata->body_type_1 = it1->second.type;
   } else {
     for(std::map<std::string, dSpaceID>::const_iterator it = cdata->dspace_lookup_map->begin();
         it != cdata->dspace_lookup_map->end();
@@ -789,8 +1062,8 @@ void nearCallbackFn(void *data, dGeomID o1, dGeomID o2)
   }
 
   if(it2 != cdata->geom_lookup_map->end()) {
-    cdata->body_name_2 = it2->second.first;
-    cdata->body_type_2 = it2->second.second;
+    cdata->body_name_2 = it2->second.name;
+    cdata->body_type_2 = it2->second.type;
   } else {
     for(std::map<std::string, dSpaceID>::const_iterator it = cdata->dspace_lookup_map->begin();
         it != cdata->dspace_lookup_map->end();
@@ -809,9 +1082,18 @@ void nearCallbackFn(void *data, dGeomID o1, dGeomID o2)
   }
 
   //determine whether or not this collision is allowed in the self_collision matrix
-  if (cdata->allowed_collision_matrix && check_in_allowed_collision_matrix) {
+  if (cdata->allowed_collision_matrix && check_in_allowed_collision_matrix && !cdata->pair_list_prefiltered) {
     bool allowed;
-    if(!cdata->allowed_collision_matrix->getAllowedCollision(cdata->body_name_1, cdata->body_name_2, allowed)) {
+    //use the compiled bitset with the indices cached per geom when we
+    //can; this avoids the string lookups in the matrix
+    unsigned int acm_size = cdata->allowed_collision_matrix->getSize();
+    if(!cdata->allowed_collision_matrix->isCompiled()) {
+      cdata->allowed_collision_matrix->compile();
+    }
+    if(it1->second.has_acm_index && it2->second.has_acm_index &&
+       it1->second.acm_index < acm_size && it2->second.acm_index < acm_size) {
+      allowed = cdata->allowed_collision_matrix->getAllowedCollisionCompiled(it1->second.acm_index, it2->second.acm_index);
+    } else if(!cdata->allowed_collision_matrix->getAllowedCollision(cdata->body_name_1, cdata->body_name_2, allowed)) {
       ROS_WARN_STREAM("No entry in allowed collision matrix for " << cdata->body_name_1 << " and " << cdata->body_name_2);
       return;
     }
@@ -825,7 +1107,7 @@ void nearCallbackFn(void *data, dGeomID o1, dGeomID o2)
 
   //do the actual collision check to get the desired number of contacts
   int num_contacts = 1;
-  if(cdata->contacts) {
+  if(cdata->contacts || cdata->contact_pool) {
     num_contacts = std::min(MAX_ODE_CONTACTS, (int) cdata->max_contacts_pair);
   } 
   if(cdata->allowed) {
@@ -836,15 +1118,44 @@ void nearCallbackFn(void *data, dGeomID o1, dGeomID o2)
   ROS_DEBUG_STREAM("Testing " << cdata->body_name_1
                   << " and " << cdata->body_name_2 << " contact size " << num_contacts);
 
+  ros::WallTime stats_start;
+  if (cdata->stats) {
+    stats_start = ros::WallTime::now();
+  }
+
   dContactGeom contactGeoms[num_contacts];
   int numc = dCollide(o1, o2, num_contacts,
                       &(contactGeoms[0]), sizeof(dContactGeom));
+
+  if (cdata->stats) {
+    unsigned long long ns = (ros::WallTime::now() - stats_start).toNSec();
+    unsigned int nc = numc > 0 ? numc : 0;
+    EnvironmentModelODE::QueryStatistics::PairStats& ps =
+      cdata->stats->pairs[std::make_pair(cdata->body_name_1, cdata->body_name_2)];
+    ps.narrowphase_calls++;
+    ps.contacts += nc;
+    ps.nanoseconds += ns;
+    cdata->stats->narrowphase_calls++;
+    cdata->stats->contacts += nc;
+    cdata->stats->nanoseconds += ns;
+  }
   
   //no collisions, return
   if(!numc) 
     return;
 
-  if(!cdata->contacts && !cdata->allowed) {
+  //the compiled map answers in one lookup whether this pair has any
+  //allowed contact regions; pairs without regions keep the fast path
+  const std::vector<EnvironmentModelODE::CompiledAllowedContact>* regions = NULL;
+  if(cdata->allowed) {
+    EnvironmentModelODE::CompiledAllowedContactMap::const_iterator rit =
+      cdata->allowed->find(std::make_pair(cdata->body_name_1, cdata->body_name_2));
+    if(rit != cdata->allowed->end() && !rit->second.empty()) {
+      regions = &rit->second;
+    }
+  }
+
+  if(!cdata->contacts && !cdata->contact_pool && !regions) {
     //we don't care about contact information, so just set to true if there's been collision
     ROS_DEBUG_STREAM_NAMED(CONTACT_ONLY_NAME, "Detected collision between " << cdata->body_name_1 << " and " << cdata->body_name_2);
     cdata->collides = true;      
@@ -874,26 +1185,22 @@ void nearCallbackFn(void *data, dGeomID o1, dGeomID o2)
       //figure out whether the contact is allowed
       //allowed contacts only allowed with objects for now
       bool allowed = false;
-      if(cdata->allowed) { 
-        EnvironmentModel::AllowedContactMap::const_iterator it1 = cdata->allowed->find(cdata->body_name_1);
-        if(it1 != cdata->allowed->end()) {
-          std::map<std::string, std::vector<EnvironmentModel::AllowedContact> >::const_iterator it2 = it1->second.find(cdata->body_name_2);
-          if(it2 != it1->second.end()) {
-            ROS_DEBUG_STREAM("Testing allowed contact for " << cdata->body_name_1 << " and " << cdata->body_name_2 << " num " << i);
-            ROS_DEBUG_STREAM("Contact at " << contactGeoms[i].pos[0] << " " 
-                            << contactGeoms[i].pos[1] << " " << contactGeoms[i].pos[2]);      
-            
-            const std::vector<EnvironmentModel::AllowedContact>& av = it2->second;
-            for(unsigned int j = 0; j < av.size(); j++) {
-              if(av[j].bound->containsPoint(pos)) {
-                if(av[j].depth >= fabs(contactGeoms[i].depth)) {
-                  allowed = true;
-                  ROS_DEBUG_STREAM("Contact allowed by allowed collision region");
-                  break;
-                } else {
-                  ROS_DEBUG_STREAM("Depth check failing " << av[j].depth << " detected " << contactGeoms[i].depth);
-                }
-              }
+      if(regions) {
+        ROS_DEBUG_STREAM("Testing allowed contact for " << cdata->body_name_1 << " and " << cdata->body_name_2 << " num " << i);
+        for(unsigned int j = 0; j < regions->size(); j++) {
+          const EnvironmentModelODE::CompiledAllowedContact& cac = (*regions)[j];
+          //the precomputed bounding sphere rejects contacts nowhere
+          //near the region without the body containment test
+          if(pos.distance2(cac.center) > cac.radius2) {
+            continue;
+          }
+          if(cac.bound->containsPoint(pos)) {
+            if(cac.depth >= fabs(contactGeoms[i].depth)) {
+              allowed = true;
+              ROS_DEBUG_STREAM("Contact allowed by allowed collision region");
+              break;
+            } else {
+              ROS_DEBUG_STREAM("Depth check failing " << cac.depth << " detected " << contactGeoms[i].depth);
             }
           }
         }
@@ -905,25 +1212,31 @@ void nearCallbackFn(void *data, dGeomID o1, dGeomID o2)
 
         ROS_DEBUG_STREAM_NAMED(CONTACT_ONLY_NAME, "Detected collision between " << cdata->body_name_1 << " and " << cdata->body_name_2);
 
-        if(cdata->contacts != NULL) {
+        if(cdata->contacts != NULL || cdata->contact_pool != NULL) {
           if(num_not_allowed <= cdata->max_contacts_pair) {
-            collision_space::EnvironmentModelODE::Contact add;
-            
-            add.pos = pos;
+            collision_space::EnvironmentModelODE::Contact* add;
+            if(cdata->contact_pool != NULL) {
+              add = &cdata->contact_pool->alloc();
+            } else {
+              cdata->contacts->resize(cdata->contacts->size() + 1);
+              add = &cdata->contacts->back();
+            }
+
+            add->pos = pos;
             
-            add.normal.setX(contactGeoms[i].normal[0]);
-            add.normal.setY(contactGeoms[i].normal[1]);
-            add.normal.setZ(contactGeoms[i].normal[2]);
+            add->normal.setX(contactGeoms[i].normal[0]);
+            add->normal.setY(contactGeoms[i].normal[1]);
+            add->normal.setZ(contactGeoms[i].normal[2]);
             
-            add.depth = contactGeoms[i].depth;
+            add->depth = contactGeoms[i].depth;
             
-            add.body_name_1 = cdata->body_name_1;
-            add.body_name_2 = cdata->body_name_2;
-            add.body_type_1 = cdata->body_type_1;
-            add.body_type_2 = cdata->body_type_2;
+            add->body_name_1 = cdata->body_name_1;
+            add->body_name_2 = cdata->body_name_2;
+            add->body_type_1 = cdata->body_type_1;
+            add->body_type_2 = cdata->body_type_2;
             
-            cdata->contacts->push_back(add);
-            if(cdata->contacts->size() >= cdata->max_contacts_total) {
+            unsigned int num_now = cdata->contact_pool != NULL ? cdata->contact_pool->size() : cdata->contacts->size();
+            if(num_now >= cdata->max_contacts_total) {
               cdata->done = true;
             }
           }
@@ -936,50 +1249,454 @@ void nearCallbackFn(void *data, dGeomID o1, dGeomID o2)
 }
 }
 
+void collision_space::EnvironmentModelODE::copyScratchContacts(std::vector<Contact> &contacts) const
+{
+  contacts.resize(contact_scratch_.size());
+  for (unsigned int i = 0 ; i < contact_scratch_.size() ; ++i)
+    contacts[i] = contact_scratch_.at(i);
+}
+
 bool collision_space::EnvironmentModelODE::getCollisionContacts(std::vector<Contact> &contacts, unsigned int max_total, unsigned int max_per_pair) const
 {
-  contacts.clear();
   CollisionData cdata;
   cdata.allowed_collision_matrix = &getCurrentAllowedCollisionMatrix();
   cdata.geom_lookup_map = &geom_lookup_map_;
   cdata.dspace_lookup_map = &dspace_lookup_map_;
-  cdata.contacts = &contacts;
+  //collect into the environment's scratch pool so only the final
+  //copy-out touches the caller's vector
+  contact_scratch_.reset();
+  cdata.contact_pool = &contact_scratch_;
   cdata.max_contacts_total = max_total;
   cdata.max_contacts_pair = max_per_pair;
   if (!allowed_contacts_.empty())
-    cdata.allowed = &allowed_contact_map_;
-  contacts.clear();
+    cdata.allowed = &compiled_allowed_contact_map_;
   checkThreadInit();
   testCollision(&cdata);
+  copyScratchContacts(contacts);
   return cdata.collides;
 }
 
 bool collision_space::EnvironmentModelODE::getAllCollisionContacts(std::vector<Contact> &contacts, unsigned int num_contacts_per_pair) const
 {
-  contacts.clear();
   CollisionData cdata;
   cdata.geom_lookup_map = &geom_lookup_map_;
   cdata.dspace_lookup_map = &dspace_lookup_map_;
   cdata.allowed_collision_matrix = &getCurrentAllowedCollisionMatrix();
-  cdata.contacts = &contacts;
+  contact_scratch_.reset();
+  cdata.contact_pool = &contact_scratch_;
+  cdata.max_contacts_total = UINT_MAX;
+  cdata.max_contacts_pair = num_contacts_per_pair;
+  if (!allowed_contacts_.empty())
+    cdata.allowed = &compiled_allowed_contact_map_;
+  checkThreadInit();
+  testCollision(&cdata);
+  copyScratchContacts(contacts);
+  return cdata.collides;
+}
+
+void collision_space::EnvironmentModelODE::batchCheckWorker(EnvironmentModelODE* env,
+                                                            const std::vector<planning_models::KinematicState*>* states,
+                                                            std::vector<unsigned char>* results,
+                                                            unsigned int start,
+                                                            unsigned int stride)
+{
+  //make sure this worker thread has its own ODE scratch space
+  env->checkThreadInit();
+  for(unsigned int i = start; i < states->size(); i += stride) {
+    env->updateRobotModel((*states)[i]);
+    (*results)[i] = env->isCollision() ? 1 : 0;
+  }
+}
+
+void collision_space::EnvironmentModelODE::batchCheckClonedWorker(EnvironmentModelODE* master,
+                                                                  boost::mutex* clone_lock,
+                                                                  boost::barrier* clones_ready,
+                                                                  const std::vector<planning_models::KinematicState*>* states,
+                                                                  std::vector<unsigned char>* results,
+                                                                  unsigned int start,
+                                                                  unsigned int stride)
+{
+  //pin before cloning so first-touch commits the clone's pages on the
+  //node this worker will run its queries from
+  thread_affinity::bindCurrentThreadForWorker(start);
+  EnvironmentModelODE* env;
+  {
+    boost::mutex::scoped_lock lock(*clone_lock);
+    env = static_cast<EnvironmentModelODE*>(master->clone());
+  }
+  //once every worker holds its clone the master may start mutating its
+  //own robot state for its share of the batch
+  clones_ready->wait();
+  batchCheckWorker(env, states, results, start, stride);
+  //clone() gives the environment its own copy of the kinematic model,
+  //which the environment does not own, so it has to be freed here
+  const planning_models::KinematicModel* worker_model = env->getRobotModel();
+  delete env;
+  delete worker_model;
+}
+
+bool collision_space::EnvironmentModelODE::checkStatesBatch(const std::vector<planning_models::KinematicState*> &states,
+                                                            std::vector<bool> &collisions)
+{
+  collisions.assign(states.size(), false);
+  if(states.empty()) {
+    return false;
+  }
+
+  unsigned int nthreads = boost::thread::hardware_concurrency();
+  if(nthreads > states.size()) {
+    nthreads = states.size();
+  }
+  //for small batches the cost of cloning the environment for each worker
+  //will dominate, so just check serially
+  if(nthreads < 2 || states.size() < 2 * nthreads) {
+    return EnvironmentModel::checkStatesBatch(states, collisions);
+  }
+
+  lock_.lock();
+
+  //each worker needs its own environment so robot geom poses can be set
+  //independently; the clone cost is amortized over the whole batch.
+  //Workers clone for themselves after pinning so that on multi-node
+  //machines the clone's memory lands on the node running its queries;
+  //the barrier keeps the master from mutating its own robot state until
+  //every worker holds its clone
+  boost::mutex clone_lock;
+  boost::barrier clones_ready(nthreads);
+
+  //workers write into a byte vector since neighboring entries of a
+  //std::vector<bool> share storage and can't be written concurrently
+  std::vector<unsigned char> results(states.size(), 0);
+  boost::thread_group workers;
+  for(unsigned int i = 1; i < nthreads; i++) {
+    workers.create_thread(boost::bind(&EnvironmentModelODE::batchCheckClonedWorker, this, &clone_lock, &clones_ready, &states, &results, i, nthreads));
+  }
+  //the calling thread takes a share of the batch as well; it is never
+  //pinned, since affinity would outlive the call
+  clones_ready.wait();
+  batchCheckWorker(this, &states, &results, 0, nthreads);
+  workers.join_all();
+
+  lock_.unlock();
+
+  bool any_collision = false;
+  for(unsigned int i = 0; i < results.size(); i++) {
+    if(results[i]) {
+      collisions[i] = true;
+      any_collision = true;
+    }
+  }
+  return any_collision;
+}
+
+namespace
+{
+//conservative distance between two geoms: the distance between their
+//AABBs, refined to the exact value for sphere pairs
+double geomGeomDistance(dGeomID g1, dGeomID g2)
+{
+  if(dGeomGetClass(g1) == dSphereClass && dGeomGetClass(g2) == dSphereClass) {
+    const dReal* p1 = dGeomGetPosition(g1);
+    const dReal* p2 = dGeomGetPosition(g2);
+    double dx = p1[0] - p2[0];
+    double dy = p1[1] - p2[1];
+    double dz = p1[2] - p2[2];
+    return sqrt(dx * dx + dy * dy + dz * dz) - dGeomSphereGetRadius(g1) - dGeomSphereGetRadius(g2);
+  }
+
+  dReal a[6], b[6];
+  dGeomGetAABB(g1, a);
+  dGeomGetAABB(g2, b);
+  double dist2 = 0.0;
+  for(unsigned int i = 0; i < 3; i++) {
+    double d = 0.0;
+    if(b[2 * i] > a[2 * i + 1]) {
+      d = b[2 * i] - a[2 * i + 1];
+    } else if(a[2 * i] > b[2 * i + 1]) {
+      d = a[2 * i] - b[2 * i + 1];
+    }
+    dist2 += d * d;
+  }
+  return sqrt(dist2);
+}
+}
+
+bool collision_space::EnvironmentModelODE::getDistanceRobotToEnvironment(const std::string& link_name,
+                                                                         double distance_threshold,
+                                                                         double& distance) const
+{
+  std::map<std::string, unsigned int>::const_iterator lit = link_geom_map_.find(link_name);
+  if(lit == link_geom_map_.end()) {
+    ROS_WARN_STREAM("No collision geometry for link " << link_name << " in distance query");
+    return false;
+  }
+  checkThreadInit();
+
+  LinkGeom *lg = model_geom_.link_geom[lit->second];
+  distance = distance_threshold;
+
+  for (std::map<std::string, boost::shared_ptr<CollisionNamespace> >::const_iterator it = coll_namespaces_.begin() ; it != coll_namespaces_.end() ; ++it) {
+    std::vector<dGeomID> env_geoms;
+    if(it->second->batch_query) {
+      //batch namespaces keep their geoms only in the hash space
+      int ngeoms = dSpaceGetNumGeoms(it->second->space);
+      env_geoms.reserve(ngeoms);
+      for(int g = 0; g < ngeoms; g++) {
+        env_geoms.push_back(dSpaceGetGeom(it->second->space, g));
+      }
+    } else {
+      it->second->collide2.getGeoms(env_geoms);
+      env_geoms.insert(env_geoms.end(), it->second->geoms.begin(), it->second->geoms.end());
+    }
+
+    for(unsigned int i = 0; i < env_geoms.size(); i++) {
+      for(unsigned int j = 0; j < lg->padded_geom.size(); j++) {
+        double d = geomGeomDistance(lg->padded_geom[j], env_geoms[i]);
+        if(d < distance) {
+          distance = d;
+        }
+      }
+      //attached bodies move with the link, so they count towards its clearance
+      for(unsigned int j = 0; j < lg->att_bodies.size(); j++) {
+        for(unsigned int k = 0; k < lg->att_bodies[j]->padded_geom.size(); k++) {
+          double d = geomGeomDistance(lg->att_bodies[j]->padded_geom[k], env_geoms[i]);
+          if(d < distance) {
+            distance = d;
+          }
+        }
+      }
+      if(distance <= 0.0) {
+        //already in (padded) contact; no point refining further
+        distance = 0.0;
+        return true;
+      }
+    }
+  }
+  return true;
+}
+
+bool collision_space::EnvironmentModelODE::isTrajectorySegmentInCollision(const planning_models::KinematicState* from,
+                                                                          const planning_models::KinematicState* to)
+{
+  checkThreadInit();
+  updateRobotModel(from);
+  if(isCollision()) {
+    return true;
+  }
+  updateRobotModel(to);
+  if(isCollision()) {
+    return true;
+  }
+
+  std::vector<double> from_vals, to_vals;
+  from->getKinematicStateValues(from_vals);
+  to->getKinematicStateValues(to_vals);
+
+  planning_models::KinematicState scratch(*from);
+  return testSegmentSwept(from_vals, to_vals, scratch, 0);
+}
+
+namespace
+{
+//resolution floor for the swept check; sub-segments where no link can
+//move further than this are accepted without a clearance test
+static const double MIN_SWEEP_MOTION = 1e-4;
+//recursion limit for the bisection; matches a segment split into 2^10 pieces
+static const unsigned int MAX_SWEEP_DEPTH = 10;
+}
+
+bool collision_space::EnvironmentModelODE::testSegmentSwept(const std::vector<double>& from_vals,
+                                                            const std::vector<double>& to_vals,
+                                                            planning_models::KinematicState& state,
+                                                            unsigned int depth)
+{
+  const unsigned int n = model_geom_.link_geom.size();
+
+  //poses of each link body at the two endpoints of the sub-segment, used
+  //to bound how far the link can move across it
+  std::vector<tf::Transform> poses_from(n), poses_to(n);
+  state.setKinematicState(from_vals);
+  for(unsigned int i = 0; i < n; i++) {
+    const planning_models::KinematicState::LinkState* ls = state.getLinkState(model_geom_.link_geom[i]->link->getName());
+    poses_from[i] = ls->getGlobalCollisionBodyTransform();
+  }
+  state.setKinematicState(to_vals);
+  for(unsigned int i = 0; i < n; i++) {
+    const planning_models::KinematicState::LinkState* ls = state.getLinkState(model_geom_.link_geom[i]->link->getName());
+    poses_to[i] = ls->getGlobalCollisionBodyTransform();
+  }
+
+  //discrete check at the midpoint; the clearances measured there decide
+  //whether the two halves need to be looked at more closely
+  std::vector<double> mid_vals(from_vals.size());
+  for(unsigned int i = 0; i < from_vals.size(); i++) {
+    mid_vals[i] = 0.5 * (from_vals[i] + to_vals[i]);
+  }
+  state.setKinematicState(mid_vals);
+  updateRobotModel(&state);
+  if(isCollision()) {
+    return true;
+  }
+
+  bool all_safe = true;
+  std::vector<double> motions(n, 0.0);
+  for(unsigned int i = 0; i < n; i++) {
+    LinkGeom *lg = model_geom_.link_geom[i];
+
+    //bound on the motion of any point of the link across the sub-segment:
+    //translation of the body origin plus the rotation angle scaled by the
+    //radius of the body's bounding box
+    double translation = (poses_to[i].getOrigin() - poses_from[i].getOrigin()).length();
+    double rotation = fabs(poses_from[i].getRotation().angleShortestPath(poses_to[i].getRotation()));
+    double radius = 0.0;
+    for(unsigned int j = 0; j < lg->padded_geom.size(); j++) {
+      dReal aabb[6];
+      dGeomGetAABB(lg->padded_geom[j], aabb);
+      double dx = aabb[1] - aabb[0];
+      double dy = aabb[3] - aabb[2];
+      double dz = aabb[5] - aabb[4];
+      double r = 0.5 * sqrt(dx * dx + dy * dy + dz * dz);
+      if(r > radius) {
+        radius = r;
+      }
+    }
+    double motion = translation + radius * rotation;
+    motions[i] = motion;
+    if(motion < MIN_SWEEP_MOTION) {
+      continue;
+    }
+
+    //under linear interpolation the link moves about half its segment
+    //motion between the midpoint and either endpoint, so a clearance
+    //larger than that rules out contact anywhere on the sub-segment
+    double clearance = 0.0;
+    if(!getDistanceRobotToEnvironment(lg->link->getName(), motion, clearance) || clearance <= 0.5 * motion) {
+      all_safe = false;
+      break;
+    }
+  }
+
+  //self collision needs the same treatment: both members of a pair can
+  //move across the sub-segment, so contact is only ruled out when the
+  //midpoint separation exceeds half their combined motion
+  if(all_safe) {
+    if(!self_collision_pairs_valid_) {
+      compileSelfCollisionPairList();
+    }
+    std::vector<double> geom_motion(self_collision_geom_links_.size(), 0.0);
+    for(unsigned int i = 0; i < self_collision_geom_links_.size(); i++) {
+      std::map<std::string, unsigned int>::const_iterator it = link_geom_map_.find(self_collision_geom_links_[i]);
+      if(it != link_geom_map_.end()) {
+        geom_motion[i] = motions[it->second];
+      }
+    }
+    const std::vector<std::pair<unsigned int, unsigned int> >& pairs = scopedSelfCollisionPairs();
+    for(unsigned int i = 0; i < pairs.size(); i++) {
+      double pair_motion = geom_motion[pairs[i].first] + geom_motion[pairs[i].second];
+      if(pair_motion < MIN_SWEEP_MOTION) {
+        continue;
+      }
+      double d = geomGeomDistance(self_collision_geoms_[pairs[i].first], self_collision_geoms_[pairs[i].second]);
+      if(d <= 0.5 * pair_motion) {
+        all_safe = false;
+        break;
+      }
+    }
+  }
+  if(all_safe) {
+    return false;
+  }
+  if(depth >= MAX_SWEEP_DEPTH) {
+    //resolution floor reached; anything thinner than this would also be
+    //missed by the discrete checks the callers used before
+    return false;
+  }
+  return testSegmentSwept(from_vals, mid_vals, state, depth + 1) ||
+    testSegmentSwept(mid_vals, to_vals, state, depth + 1);
+}
+
+bool collision_space::EnvironmentModelODE::getAllCollisionContacts(ContactPool &pool, unsigned int num_contacts_per_pair) const
+{
+  pool.reset();
+  CollisionData cdata;
+  cdata.geom_lookup_map = &geom_lookup_map_;
+  cdata.dspace_lookup_map = &dspace_lookup_map_;
+  cdata.allowed_collision_matrix = &getCurrentAllowedCollisionMatrix();
+  cdata.contact_pool = &pool;
   cdata.max_contacts_total = UINT_MAX;
   cdata.max_contacts_pair = num_contacts_per_pair;
   if (!allowed_contacts_.empty())
-    cdata.allowed = &allowed_contact_map_;
-  contacts.clear();
+    cdata.allowed = &compiled_allowed_contact_map_;
   checkThreadInit();
   testCollision(&cdata);
   return cdata.collides;
 }
 
+void collision_space::EnvironmentModelODE::enableQueryStatistics(bool enable)
+{
+  if (enable && !query_stats_enabled_) {
+    query_stats_.clear();
+  }
+  query_stats_enabled_ = enable;
+}
+
+void collision_space::EnvironmentModelODE::setTwoPhaseEnvironmentCheck(bool enable)
+{
+  two_phase_env_check_ = enable;
+}
+
+bool collision_space::EnvironmentModelODE::getTwoPhaseEnvironmentCheck(void) const
+{
+  return two_phase_env_check_;
+}
+
+void collision_space::EnvironmentModelODE::resetQueryStatistics()
+{
+  query_stats_.clear();
+}
+
+const collision_space::EnvironmentModelODE::QueryStatistics& collision_space::EnvironmentModelODE::getQueryStatistics() const
+{
+  return query_stats_;
+}
+
+namespace
+{
+struct PairStatsByTime
+{
+  typedef std::pair<std::pair<std::string, std::string>, collision_space::EnvironmentModelODE::QueryStatistics::PairStats> value_type;
+  bool operator()(const value_type& a, const value_type& b) const
+  {
+    return a.second.nanoseconds > b.second.nanoseconds;
+  }
+};
+}
+
+void collision_space::EnvironmentModelODE::printQueryStatistics(std::ostream& out) const
+{
+  out << "Collision query statistics: " << query_stats_.narrowphase_calls << " narrowphase calls, "
+      << query_stats_.contacts << " contacts, " << query_stats_.nanoseconds * 1e-6 << " ms total" << std::endl;
+  std::vector<PairStatsByTime::value_type> sorted(query_stats_.pairs.begin(), query_stats_.pairs.end());
+  std::sort(sorted.begin(), sorted.end(), PairStatsByTime());
+  for (unsigned int i = 0; i < sorted.size(); i++) {
+    out << "  " << sorted[i].first.first << " <-> " << sorted[i].first.second
+        << ": " << sorted[i].second.narrowphase_calls << " calls, "
+        << sorted[i].second.contacts << " contacts, "
+        << sorted[i].second.nanoseconds * 1e-6 << " ms" << std::endl;
+  }
+}
+
 bool collision_space::EnvironmentModelODE::isCollision(void) const
 {
   CollisionData cdata;
   cdata.allowed_collision_matrix = &getCurrentAllowedCollisionMatrix();
+  if (query_stats_enabled_) {
+    cdata.stats = &query_stats_;
+  }
   cdata.geom_lookup_map = &geom_lookup_map_;
   cdata.dspace_lookup_map = &dspace_lookup_map_;
   if (!allowed_contacts_.empty()) {
-    cdata.allowed = &allowed_contact_map_;
+    cdata.allowed = &compiled_allowed_contact_map_;
     ROS_DEBUG_STREAM("Got contacts size " << cdata.allowed->size());
   } else {
     ROS_DEBUG_STREAM("No allowed contacts");
@@ -992,11 +1709,14 @@ bool collision_space::EnvironmentModelODE::isCollision(void) const
 bool collision_space::EnvironmentModelODE::isSelfCollision(void) const
 {
   CollisionData cdata; 
+  if (query_stats_enabled_) {
+    cdata.stats = &query_stats_;
+  }
   cdata.geom_lookup_map = &geom_lookup_map_;
   cdata.dspace_lookup_map = &dspace_lookup_map_;
   cdata.allowed_collision_matrix = &getCurrentAllowedCollisionMatrix();
   if (!allowed_contacts_.empty())
-    cdata.allowed = &allowed_contact_map_;
+    cdata.allowed = &compiled_allowed_contact_map_;
   checkThreadInit();
   testSelfCollision(&cdata);
   return cdata.collides;
@@ -1005,18 +1725,21 @@ bool collision_space::EnvironmentModelODE::isSelfCollision(void) const
 bool collision_space::EnvironmentModelODE::isEnvironmentCollision(void) const
 {
   CollisionData cdata; 
+  if (query_stats_enabled_) {
+    cdata.stats = &query_stats_;
+  }
   cdata.geom_lookup_map = &geom_lookup_map_;
   cdata.dspace_lookup_map = &dspace_lookup_map_;
   cdata.allowed_collision_matrix = &getCurrentAllowedCollisionMatrix();
   if (!allowed_contacts_.empty())
-    cdata.allowed = &allowed_contact_map_;
+    cdata.allowed = &compiled_allowed_contact_map_;
   checkThreadInit();
   testEnvironmentCollision(&cdata);
   return cdata.collides;
 }
 
 bool collision_space::EnvironmentModelODE::isObjectRobotCollision(const std::string& object_name) const {
-  std::map<std::string, CollisionNamespace *>::const_iterator it =
+  std::map<std::string, boost::shared_ptr<CollisionNamespace> >::const_iterator it =
     coll_namespaces_.find(object_name);
   if (it == coll_namespaces_.end()) {
     ROS_WARN("Attempt to check collision for %s and robot, but no such object exists", object_name.c_str());
@@ -1027,9 +1750,9 @@ bool collision_space::EnvironmentModelODE::isObjectRobotCollision(const std::str
   cdata.dspace_lookup_map = &dspace_lookup_map_;
   cdata.allowed_collision_matrix = &getCurrentAllowedCollisionMatrix();
   if (!allowed_contacts_.empty())
-    cdata.allowed = &allowed_contact_map_;
+    cdata.allowed = &compiled_allowed_contact_map_;
   checkThreadInit();
-  testObjectCollision(it->second, &cdata);
+  testObjectCollision(it->second.get(), &cdata);
   return cdata.collides;
 }
 
@@ -1041,7 +1764,7 @@ bool collision_space::EnvironmentModelODE::isObjectObjectCollision(const std::st
   cdata.dspace_lookup_map = &dspace_lookup_map_;
   cdata.allowed_collision_matrix = &getCurrentAllowedCollisionMatrix();
   if (!allowed_contacts_.empty())
-    cdata.allowed = &allowed_contact_map_;
+    cdata.allowed = &compiled_allowed_contact_map_;
   checkThreadInit();
   testObjectObjectCollision(&cdata, object1_name, object2_name);
   return cdata.collides;
@@ -1054,7 +1777,7 @@ bool collision_space::EnvironmentModelODE::isObjectInEnvironmentCollision(const
   cdata.dspace_lookup_map = &dspace_lookup_map_;
   cdata.allowed_collision_matrix = &getCurrentAllowedCollisionMatrix();
   if (!allowed_contacts_.empty())
-    cdata.allowed = &allowed_contact_map_;
+    cdata.allowed = &compiled_allowed_contact_map_;
   checkThreadInit();
   testObjectEnvironmentCollision(&cdata, object_name);
   return cdata.collides;
@@ -1063,24 +1786,25 @@ bool collision_space::EnvironmentModelODE::isObjectInEnvironmentCollision(const
 bool collision_space::EnvironmentModelODE::getAllObjectEnvironmentCollisionContacts(const std::string& object_name, 
                                                                                     std::vector<Contact> &contacts,
                                                                                     unsigned int num_contacts_per_pair) const {
-  contacts.clear();
   CollisionData cdata;
   cdata.geom_lookup_map = &geom_lookup_map_;
   cdata.dspace_lookup_map = &dspace_lookup_map_;
   cdata.allowed_collision_matrix = &getCurrentAllowedCollisionMatrix();
-  cdata.contacts = &contacts;
+  contact_scratch_.reset();
+  cdata.contact_pool = &contact_scratch_;
   cdata.max_contacts_total = UINT_MAX;
   cdata.max_contacts_pair = num_contacts_per_pair;
   if (!allowed_contacts_.empty())
-    cdata.allowed = &allowed_contact_map_;
+    cdata.allowed = &compiled_allowed_contact_map_;
   checkThreadInit();
   testObjectEnvironmentCollision(&cdata, object_name);
+  copyScratchContacts(contacts);
   return cdata.collides;
 }
 
 void collision_space::EnvironmentModelODE::testObjectEnvironmentCollision(CollisionData *cdata, const std::string& object_name) const {
   /* check collision with other ode bodies until done*/
-  for (std::map<std::string, CollisionNamespace*>::const_iterator it = coll_namespaces_.begin() ; it != coll_namespaces_.end() && !cdata->done ; ++it) {
+  for (std::map<std::string, boost::shared_ptr<CollisionNamespace> >::const_iterator it = coll_namespaces_.begin() ; it != coll_namespaces_.end() && !cdata->done ; ++it) {
     if (it->first != object_name) // Don't check with itself.
     {
       testObjectObjectCollision(cdata, object_name, it->first);
@@ -1093,13 +1817,13 @@ void collision_space::EnvironmentModelODE::testObjectObjectCollision(CollisionDa
                                                                      const std::string& object2_name) const
 {
   // Check if the given names are valid.
-  std::map<std::string, CollisionNamespace*>::const_iterator it1 = coll_namespaces_.find(object1_name);
+  std::map<std::string, boost::shared_ptr<CollisionNamespace> >::const_iterator it1 = coll_namespaces_.find(object1_name);
   if (it1 == coll_namespaces_.end())
   {
     ROS_WARN_STREAM("Failed to find object " << object1_name << " during collision check.");
     return;
   }
-  std::map<std::string, CollisionNamespace*>::const_iterator it2 = coll_namespaces_.find(object2_name);
+  std::map<std::string, boost::shared_ptr<CollisionNamespace> >::const_iterator it2 = coll_namespaces_.find(object2_name);
   if (it2 == coll_namespaces_.end())
   {
     ROS_WARN_STREAM("Failed to find object " << object2_name << " during collision check.");
@@ -1116,6 +1840,17 @@ void collision_space::EnvironmentModelODE::testObjectObjectCollision(CollisionDa
 
   if (!allowed)
   {
+    //namespaces whose bounds don't overlap can't collide; this keeps
+    //all-pairs object queries from colliding every space against
+    //every other space
+    const dReal* b1 = it1->second->getBounds();
+    const dReal* b2 = it2->second->getBounds();
+    if(b1[0] > b2[1] || b2[0] > b1[1] ||
+       b1[2] > b2[3] || b2[2] > b1[3] ||
+       b1[4] > b2[5] || b2[4] > b1[5]) {
+      ROS_DEBUG_STREAM("Bounds of " << object1_name << " and " << object2_name << " do not overlap.");
+      return;
+    }
     ROS_DEBUG_STREAM("Checking collision between " << object1_name << " and " << object2_name << ".");
     dSpaceCollide2((dxGeom *)it1->second->space, (dxGeom *)it2->second->space, cdata, nearCallbackFn);
   }
@@ -1127,14 +1862,37 @@ void collision_space::EnvironmentModelODE::testObjectObjectCollision(CollisionDa
  
 }
 
+namespace
+{
+struct CoarseProbe
+{
+  bool hit;
+};
+
+//boolean-only near callback for the coarse phase; no contact
+//attribution and no allowed collision matrix, so a hit may be spurious
+//but a miss is definitive
+void coarseNearCallbackFn(void *data, dGeomID o1, dGeomID o2)
+{
+  CoarseProbe *probe = reinterpret_cast<CoarseProbe*>(data);
+  if (probe->hit)
+    return;
+  dContactGeom contact;
+  if (dCollide(o1, o2, 1, &contact, sizeof(dContactGeom)) > 0)
+    probe->hit = true;
+}
+}
+
 void collision_space::EnvironmentModelODE::testObjectCollision(CollisionNamespace *cn, CollisionData *cdata) const
 { 
-  if (cn->collide2.empty()) {
+  if (!cn->batch_query && cn->collide2.empty()) {
     ROS_WARN_STREAM("Problem - collide2 required for body collision for " << cn->name);
     return;
   }
-  
-  cn->collide2.setup();
+
+  if(!cn->batch_query) {
+    cn->collide2.setup();
+  }
   for (int i = model_geom_.link_geom.size() - 1 ; i >= 0 && !cdata->done; --i) {
     LinkGeom *lg = model_geom_.link_geom[i];
     
@@ -1150,19 +1908,60 @@ void collision_space::EnvironmentModelODE::testObjectCollision(CollisionNamespac
     if(!allowed) {
       ROS_DEBUG_STREAM("Will test for collision between object " << cn->name << " and link " << lg->link->getName());
       for(unsigned int j = 0; j < lg->padded_geom.size(); j++) {
+        //coarse phase: probe mesh links with a bounding sphere first
+        //and only run the trimesh narrowphase when the probe hits; the
+        //sphere is sized from the current AABB, so no update plumbing
+        if(two_phase_env_check_ && dGeomGetClass(lg->padded_geom[j]) == dTriMeshClass) {
+          if(lg->coarse_geom.size() != lg->padded_geom.size()) {
+            lg->coarse_geom.resize(lg->padded_geom.size(), NULL);
+          }
+          if(!lg->coarse_geom[j]) {
+            lg->coarse_geom[j] = dCreateSphere(0, 1.0);
+          }
+          dReal aabb[6];
+          dGeomGetAABB(lg->padded_geom[j], aabb);
+          dReal hx = (aabb[1] - aabb[0]) * 0.5;
+          dReal hy = (aabb[3] - aabb[2]) * 0.5;
+          dReal hz = (aabb[5] - aabb[4]) * 0.5;
+          dGeomSphereSetRadius(lg->coarse_geom[j], sqrt(hx * hx + hy * hy + hz * hz));
+          dGeomSetPosition(lg->coarse_geom[j], aabb[0] + hx, aabb[2] + hy, aabb[4] + hz);
+          CoarseProbe probe;
+          probe.hit = false;
+          if(cn->batch_query) {
+            dSpaceCollide2((dxGeom*)cn->space, lg->coarse_geom[j], &probe, coarseNearCallbackFn);
+          } else {
+            cn->collide2.collide(lg->coarse_geom[j], &probe, coarseNearCallbackFn);
+          }
+          if(!probe.hit) {
+            continue;
+          }
+        }
         //have to figure
         unsigned int current_contacts_size = 0;
-        if(cdata->contacts) {
+        if(cdata->contact_pool) {
+          current_contacts_size = cdata->contact_pool->size();
+        } else if(cdata->contacts) {
           current_contacts_size = cdata->contacts->size();
         }
-        cn->collide2.collide(lg->padded_geom[j], cdata, nearCallbackFn);
-        if(cdata->contacts && cdata->contacts->size() > current_contacts_size) {
+        if(cn->batch_query) {
+          dSpaceCollide2((dxGeom*)cn->space, lg->padded_geom[j], cdata, nearCallbackFn);
+        } else {
+          cn->collide2.collide(lg->padded_geom[j], cdata, nearCallbackFn);
+        }
+        unsigned int new_contacts_size = current_contacts_size;
+        if(cdata->contact_pool) {
+          new_contacts_size = cdata->contact_pool->size();
+        } else if(cdata->contacts) {
+          new_contacts_size = cdata->contacts->size();
+        }
+        if(new_contacts_size > current_contacts_size) {
           //new contacts must mean collision
-          for(unsigned int k = current_contacts_size; k < cdata->contacts->size(); k++) {
-            if(cdata->contacts->at(k).body_type_1 == OBJECT) {
-              cdata->contacts->at(k).body_name_1 = cn->name;
-            } else if(cdata->contacts->at(k).body_type_2 == OBJECT) {
-              cdata->contacts->at(k).body_name_2 = cn->name;
+          for(unsigned int k = current_contacts_size; k < new_contacts_size; k++) {
+            Contact& contact = cdata->contact_pool ? cdata->contact_pool->at(k) : cdata->contacts->at(k);
+            if(contact.body_type_1 == OBJECT) {
+              contact.body_name_1 = cn->name;
+            } else if(contact.body_type_2 == OBJECT) {
+              contact.body_name_2 = cn->name;
             } else {
               ROS_WARN_STREAM("New contacts really should have an object as one of the bodys");
             }
@@ -1190,17 +1989,30 @@ void collision_space::EnvironmentModelODE::testObjectCollision(CollisionNamespac
         for(unsigned int k = 0; k < lg->att_bodies[j]->padded_geom.size(); k++) {
           //have to figure
           unsigned int current_contacts_size = 0;
-          if(cdata->contacts) {
+          if(cdata->contact_pool) {
+            current_contacts_size = cdata->contact_pool->size();
+          } else if(cdata->contacts) {
             current_contacts_size = cdata->contacts->size();
           }
-          cn->collide2.collide(lg->att_bodies[j]->padded_geom[k], cdata, nearCallbackFn);
-          if(cdata->contacts && cdata->contacts->size() > current_contacts_size) {
+          if(cn->batch_query) {
+            dSpaceCollide2((dxGeom*)cn->space, lg->att_bodies[j]->padded_geom[k], cdata, nearCallbackFn);
+          } else {
+            cn->collide2.collide(lg->att_bodies[j]->padded_geom[k], cdata, nearCallbackFn);
+          }
+          unsigned int new_contacts_size = current_contacts_size;
+          if(cdata->contact_pool) {
+            new_contacts_size = cdata->contact_pool->size();
+          } else if(cdata->contacts) {
+            new_contacts_size = cdata->contacts->size();
+          }
+          if(new_contacts_size > current_contacts_size) {
             //new contacts must mean collision
-            for(unsigned int l = current_contacts_size; l < cdata->contacts->size(); l++) {
-              if(cdata->contacts->at(l).body_type_1 == OBJECT) {
-                cdata->contacts->at(l).body_name_1 = cn->name;
-              } else if(cdata->contacts->at(l).body_type_2 == OBJECT) {
-                cdata->contacts->at(l).body_name_2 = cn->name;
+            for(unsigned int l = current_contacts_size; l < new_contacts_size; l++) {
+              Contact& contact = cdata->contact_pool ? cdata->contact_pool->at(l) : cdata->contacts->at(l);
+              if(contact.body_type_1 == OBJECT) {
+                contact.body_name_1 = cn->name;
+              } else if(contact.body_type_2 == OBJECT) {
+                contact.body_name_2 = cn->name;
               } else {
                 ROS_WARN_STREAM("New contacts really should have an object as one of the bodys");
               }
@@ -1219,20 +2031,243 @@ void collision_space::EnvironmentModelODE::testObjectCollision(CollisionNamespac
 
 void collision_space::EnvironmentModelODE::testCollision(CollisionData *cdata) const
 {
+  //boolean queries stop at the first contact, so run whichever phase
+  //has been failing more often first; most invalid samples keep
+  //failing on the same obstacles
+  bool boolean_query = cdata->contacts == NULL && cdata->contact_pool == NULL;
+  if(boolean_query && env_first_collision_count_ > self_first_collision_count_) {
+    testEnvironmentCollision(cdata);
+    if(cdata->collides) {
+      env_first_collision_count_++;
+      return;
+    }
+    testSelfCollision(cdata);
+    if(cdata->collides) {
+      self_first_collision_count_++;
+    }
+    return;
+  }
   testSelfCollision(cdata);
-  testEnvironmentCollision(cdata);    
+  if(boolean_query && cdata->collides) {
+    self_first_collision_count_++;
+    return;
+  }
+  testEnvironmentCollision(cdata);
+  if(boolean_query && cdata->collides) {
+    env_first_collision_count_++;
+  }
+}
+
+namespace
+{
+//radius of a sphere centered at the geom origin that encloses the geom
+//at any orientation; exact for the primitive classes, bounded through
+//the current AABB for everything else
+double geomBoundingRadius(dGeomID geom)
+{
+  int cls = dGeomGetClass(geom);
+  if(cls == dSphereClass) {
+    return dGeomSphereGetRadius(geom);
+  }
+  if(cls == dBoxClass) {
+    dVector3 len;
+    dGeomBoxGetLengths(geom, len);
+    return 0.5 * sqrt(len[0] * len[0] + len[1] * len[1] + len[2] * len[2]);
+  }
+  if(cls == dCylinderClass) {
+    dReal radius, length;
+    dGeomCylinderGetParams(geom, &radius, &length);
+    return sqrt(radius * radius + 0.25 * length * length);
+  }
+
+  //the distance from the origin to the farthest surface point does not
+  //change as the geom rotates, and the AABB bounds it at the current pose
+  dReal aabb[6];
+  dGeomGetAABB(geom, aabb);
+  const dReal* pos = dGeomGetPosition(geom);
+  double radius = 0.0;
+  for(unsigned int i = 0; i < 3; i++) {
+    double d = std::max(fabs(aabb[2 * i] - pos[i]), fabs(aabb[2 * i + 1] - pos[i]));
+    radius += d * d;
+  }
+  return sqrt(radius);
+}
+}
+
+void collision_space::EnvironmentModelODE::compileSelfCollisionPairList() const
+{
+  self_collision_geoms_.clear();
+  self_collision_pairs_.clear();
+  self_collision_geom_links_.clear();
+  group_self_collision_pairs_.clear();
+
+  const AllowedCollisionMatrix& acm = getCurrentAllowedCollisionMatrix();
+
+  //gather the self-space geoms along with the body names they belong to;
+  //the link each geom moves with is kept separately for group partitioning,
+  //since attached bodies are named after the body but move with their link
+  std::vector<std::string> names;
+  for (unsigned int i = 0 ; i < model_geom_.link_geom.size() ; ++i) {
+    LinkGeom *lg = model_geom_.link_geom[i];
+    for(unsigned int j = 0; j < lg->geom.size(); j++) {
+      self_collision_geoms_.push_back(lg->geom[j]);
+      names.push_back(lg->link->getName());
+      self_collision_geom_links_.push_back(lg->link->getName());
+    }
+    for(unsigned int j = 0; j < lg->att_bodies.size(); j++) {
+      for(unsigned int k = 0; k < lg->att_bodies[j]->geom.size(); k++) {
+        self_collision_geoms_.push_back(lg->att_bodies[j]->geom[k]);
+        names.push_back(lg->att_bodies[j]->att->getName());
+        self_collision_geom_links_.push_back(lg->link->getName());
+      }
+    }
+  }
+
+  //compile the pairs the matrix actually admits; everything filtered
+  //here never costs a lookup at query time
+  for(unsigned int i = 0; i < self_collision_geoms_.size(); i++) {
+    for(unsigned int j = i + 1; j < self_collision_geoms_.size(); j++) {
+      if(names[i] == names[j]) {
+        continue;
+      }
+      bool allowed = false;
+      if(!acm.getAllowedCollision(names[i], names[j], allowed)) {
+        ROS_DEBUG_STREAM("No entry in allowed collision matrix for " << names[i] << " and " << names[j]);
+        continue;
+      }
+      if(!allowed) {
+        self_collision_pairs_.push_back(std::pair<unsigned int, unsigned int>(i, j));
+      }
+    }
+  }
+  self_collision_sphere_radii_.resize(self_collision_geoms_.size());
+  for(unsigned int i = 0; i < self_collision_geoms_.size(); i++) {
+    self_collision_sphere_radii_[i] = geomBoundingRadius(self_collision_geoms_[i]);
+  }
+
+  self_collision_pairs_valid_ = true;
+  ROS_DEBUG_STREAM("Compiled " << self_collision_pairs_.size() << " self collision pairs over "
+                   << self_collision_geoms_.size() << " geoms");
+}
+
+std::vector<std::pair<unsigned int, unsigned int> >& collision_space::EnvironmentModelODE::scopedSelfCollisionPairs() const
+{
+  if(self_collision_group_scope_.empty()) {
+    return self_collision_pairs_;
+  }
+  std::map<std::string, std::vector<std::pair<unsigned int, unsigned int> > >::iterator it =
+    group_self_collision_pairs_.find(self_collision_group_scope_);
+  if(it != group_self_collision_pairs_.end()) {
+    return it->second;
+  }
+
+  std::vector<std::pair<unsigned int, unsigned int> >& subset = group_self_collision_pairs_[self_collision_group_scope_];
+  const planning_models::KinematicModel::JointModelGroup* group = robot_model_->getModelGroup(self_collision_group_scope_);
+  if(group == NULL) {
+    //unknown group gets the full list cached under its name, so the
+    //warning fires once per compile instead of once per query
+    ROS_WARN_STREAM("No group " << self_collision_group_scope_ << " for self collision scope, testing all pairs");
+    subset = self_collision_pairs_;
+    return subset;
+  }
+
+  std::vector<std::string> updated_link_names = group->getUpdatedLinkModelNames();
+  std::set<std::string> updated_links(updated_link_names.begin(), updated_link_names.end());
+  std::vector<bool> moving(self_collision_geom_links_.size(), false);
+  for(unsigned int i = 0; i < self_collision_geom_links_.size(); i++) {
+    moving[i] = (updated_links.find(self_collision_geom_links_[i]) != updated_links.end());
+  }
+  //a pair of geoms the group cannot move can never newly collide, so
+  //only pairs with at least one moving member survive the partition
+  for(unsigned int i = 0; i < self_collision_pairs_.size(); i++) {
+    if(moving[self_collision_pairs_[i].first] || moving[self_collision_pairs_[i].second]) {
+      subset.push_back(self_collision_pairs_[i]);
+    }
+  }
+  ROS_DEBUG_STREAM("Partitioned " << subset.size() << " of " << self_collision_pairs_.size()
+                   << " self collision pairs for group " << self_collision_group_scope_);
+  return subset;
 }
 
 void collision_space::EnvironmentModelODE::testSelfCollision(CollisionData *cdata) const
 {
-  dSpaceCollide(model_geom_.self_space, cdata, nearCallbackFn);
+  if(!self_collision_pairs_valid_) {
+    compileSelfCollisionPairList();
+  }
+
+  std::vector<std::pair<unsigned int, unsigned int> >& pairs = scopedSelfCollisionPairs();
+
+  const unsigned int ngeoms = self_collision_geoms_.size();
+
+  //bounding sphere per geom: center from the current geom position, radius
+  //precomputed with the pair list; a single squared-distance compare
+  //rejects the pairs that are nowhere near each other
+  std::vector<dReal> spheres(ngeoms * 4);
+  for(unsigned int i = 0; i < ngeoms; i++) {
+    const dReal* pos = dGeomGetPosition(self_collision_geoms_[i]);
+    spheres[i * 4 + 0] = pos[0];
+    spheres[i * 4 + 1] = pos[1];
+    spheres[i * 4 + 2] = pos[2];
+    spheres[i * 4 + 3] = self_collision_sphere_radii_[i];
+  }
+
+  //AABBs are only fetched for the geoms that survive the sphere test
+  std::vector<dReal> aabbs(ngeoms * 6);
+  std::vector<unsigned char> aabb_fetched(ngeoms, 0);
+
+  cdata->pair_list_prefiltered = true;
+  unsigned int colliding_pair = 0;
+  bool had_collision = cdata->collides;
+  for(unsigned int i = 0; i < pairs.size() && !cdata->done; i++) {
+    const unsigned int first = pairs[i].first;
+    const unsigned int second = pairs[i].second;
+
+    const dReal* sa = &spheres[first * 4];
+    const dReal* sb = &spheres[second * 4];
+    dReal dx = sa[0] - sb[0];
+    dReal dy = sa[1] - sb[1];
+    dReal dz = sa[2] - sb[2];
+    dReal rr = sa[3] + sb[3];
+    if(dx * dx + dy * dy + dz * dz > rr * rr) {
+      continue;
+    }
+
+    if(!aabb_fetched[first]) {
+      dGeomGetAABB(self_collision_geoms_[first], &aabbs[first * 6]);
+      aabb_fetched[first] = 1;
+    }
+    if(!aabb_fetched[second]) {
+      dGeomGetAABB(self_collision_geoms_[second], &aabbs[second * 6]);
+      aabb_fetched[second] = 1;
+    }
+    const dReal* a = &aabbs[first * 6];
+    const dReal* b = &aabbs[second * 6];
+    if(a[0] > b[1] || b[0] > a[1] ||
+       a[2] > b[3] || b[2] > a[3] ||
+       a[4] > b[5] || b[4] > a[5]) {
+      continue;
+    }
+    nearCallbackFn(cdata, self_collision_geoms_[first], self_collision_geoms_[second]);
+    if(!had_collision && cdata->collides) {
+      had_collision = true;
+      colliding_pair = i;
+    }
+  }
+  cdata->pair_list_prefiltered = false;
+
+  //self-organizing pair list: a pair that produced a contact moves one
+  //slot toward the front, so frequent offenders drift to the top and
+  //the boolean early-out triggers after fewer narrowphase calls
+  if(had_collision && !cdata->contacts && !cdata->contact_pool && colliding_pair > 0) {
+    std::swap(pairs[colliding_pair], pairs[colliding_pair - 1]);
+  }
 }
 
 void collision_space::EnvironmentModelODE::testEnvironmentCollision(CollisionData *cdata) const
 {
   /* check collision with other ode bodies until done*/
-  for (std::map<std::string, CollisionNamespace*>::const_iterator it = coll_namespaces_.begin() ; it != coll_namespaces_.end() && !cdata->done ; ++it) {
-    testObjectCollision(it->second, cdata);
+  for (std::map<std::string, boost::shared_ptr<CollisionNamespace> >::const_iterator it = coll_namespaces_.begin() ; it != coll_namespaces_.end() && !cdata->done ; ++it) {
+    testObjectCollision(it->second.get(), cdata);
   }
 }
 
@@ -1244,51 +2279,178 @@ bool collision_space::EnvironmentModelODE::hasObject(const std::string& ns) cons
   return false;
 }
 
+void collision_space::EnvironmentModelODE::detachCollisionNamespace(const std::string &ns)
+{
+  std::map<std::string, boost::shared_ptr<CollisionNamespace> >::iterator it = coll_namespaces_.find(ns);
+  if (it == coll_namespaces_.end() || it->second.unique()) {
+    return;
+  }
+
+  //the namespace is shared with a clone, so rebuild a private copy from
+  //the object bookkeeping before anything in it is mutated
+  ROS_DEBUG_STREAM("Detaching shared collision namespace " << ns);
+  boost::shared_ptr<CollisionNamespace> cn(new CollisionNamespace(ns));
+  cn->batch_query = it->second->batch_query;
+  const EnvironmentObjects::NamespaceObjects &no = objects_->getObjects(ns);
+  for (unsigned int i = 0 ; i < no.static_shape.size() ; ++i)
+  {
+    dGeomID g = createODEGeom(cn->space, cn->storage, no.static_shape[i]);
+    assert(g);
+    dGeomSetData(g, reinterpret_cast<void*>(no.static_shape[i]));
+    cn->geoms.push_back(g);
+  }
+  for (unsigned int i = 0 ; i < no.shape.size() ; ++i)
+  {
+    dGeomID g = createODEGeom(cn->space, cn->storage, no.shape[i], 1.0, 0.0);
+    assert(g);
+    dGeomSetData(g, reinterpret_cast<void*>(no.shape[i]));
+    updateGeom(g, no.shape_pose[i]);
+    if(!cn->batch_query) {
+      cn->collide2.registerGeom(g);
+    }
+  }
+  if(!cn->batch_query) {
+    cn->collide2.setup();
+  }
+  cn->getBounds();
+  it->second = cn;
+  dspace_lookup_map_[ns] = cn->space;
+}
+
+namespace
+{
+//batches of at least this many boxes are queried through the namespace
+//hash space instead of being registered individually in collide2
+static const unsigned int BOX_BATCH_MIN_SIZE = 100;
+}
+
 void collision_space::EnvironmentModelODE::addObjects(const std::string &ns, const std::vector<shapes::Shape*> &shapes, const std::vector<tf::Transform> &poses)
 {
   assert(shapes.size() == poses.size());
-  std::map<std::string, CollisionNamespace*>::iterator it = coll_namespaces_.find(ns);
+  detachCollisionNamespace(ns);
+  std::map<std::string, boost::shared_ptr<CollisionNamespace> >::iterator it = coll_namespaces_.find(ns);
   CollisionNamespace* cn = NULL;    
   if (it == coll_namespaces_.end())
   {
     cn = new CollisionNamespace(ns);
     dspace_lookup_map_[ns] = cn->space;
-    coll_namespaces_[ns] = cn;
+    coll_namespaces_[ns].reset(cn);
     default_collision_matrix_.addEntry(ns, false);
   }
   else {
-     cn = it->second;
+     cn = it->second.get();
   }
 
   //we're going to create the namespace in objects_ even if it doesn't have anything in it
   objects_->addObjectNamespace(ns);
 
   unsigned int n = shapes.size();
+
+  //a large batch of boxes is almost always a collision map; rather than
+  //registering thousands of geoms in collide2 we leave them in the hash
+  //space and query that as a single broadphase entry, with the hash cell
+  //sizes matched to the box extents
+  if(!cn->batch_query && cn->collide2.empty() && cn->geoms.empty() && n >= BOX_BATCH_MIN_SIZE) {
+    double max_extent = 0.0;
+    bool all_boxes = true;
+    for(unsigned int i = 0; i < n; i++) {
+      if(shapes[i]->type != shapes::BOX) {
+        all_boxes = false;
+        break;
+      }
+      const shapes::Box* box = static_cast<const shapes::Box*>(shapes[i]);
+      max_extent = std::max(max_extent, (double) std::max(box->size[0], std::max(box->size[1], box->size[2])));
+    }
+    if(all_boxes && max_extent > 0.0) {
+      int level = (int) ceil(log(max_extent) / log(2.0));
+      dHashSpaceSetLevels(cn->space, level, level + 2);
+      cn->batch_query = true;
+      ROS_DEBUG_STREAM("Treating namespace " << ns << " as a batch of " << n << " boxes");
+    }
+  }
+
+  std::vector<dGeomID> new_geoms(n);
   for (unsigned int i = 0 ; i < n ; ++i)
   {
     dGeomID g = createODEGeom(cn->space, cn->storage, shapes[i], 1.0, 0.0);
     assert(g);
     dGeomSetData(g, reinterpret_cast<void*>(shapes[i]));
     updateGeom(g, poses[i]);
-    cn->collide2.registerGeom(g);
+    new_geoms[i] = g;
     objects_->addObject(ns, shapes[i], poses[i]);
   }
-  cn->collide2.setup();
+  //the geoms already live in the namespace hash space, which is the
+  //broadphase for a batch namespace
+  if(!cn->batch_query) {
+    cn->collide2.registerGeoms(new_geoms);
+    if(!object_batch_active_) {
+      cn->collide2.setup();
+    }
+  }
+  cn->bounds_valid = false;
+  if(object_batch_active_) {
+    object_batch_dirty_.insert(ns);
+  } else {
+    cn->getBounds();
+    bumpModificationEpoch();
+  }
+}
+
+void collision_space::EnvironmentModelODE::removeObjects(const std::string &ns, const std::vector<const shapes::Shape*> &shapes)
+{
+  std::map<std::string, boost::shared_ptr<CollisionNamespace> >::iterator it = coll_namespaces_.find(ns);
+  if (it == coll_namespaces_.end() || shapes.empty()) {
+    return;
+  }
+  detachCollisionNamespace(ns);
+  CollisionNamespace* cn = coll_namespaces_.find(ns)->second.get();
+
+  //the geoms carry their shape pointer as data, so the doomed ones can
+  //be picked out of the namespace space directly
+  std::set<const void*> doomed(shapes.begin(), shapes.end());
+  std::vector<dGeomID> dead;
+  int n = dSpaceGetNumGeoms(cn->space);
+  for(int i = 0; i < n; i++) {
+    dGeomID g = dSpaceGetGeom(cn->space, i);
+    if(doomed.find(dGeomGetData(g)) != doomed.end()) {
+      dead.push_back(g);
+    }
+  }
+  for(unsigned int i = 0; i < dead.size(); i++) {
+    if(!cn->batch_query) {
+      cn->collide2.unregisterGeom(dead[i]);
+    }
+    std::vector<dGeomID>::iterator git = std::find(cn->geoms.begin(), cn->geoms.end(), dead[i]);
+    if(git != cn->geoms.end()) {
+      cn->geoms.erase(git);
+    }
+    cn->storage.remove(dead[i]);
+    dGeomDestroy(dead[i]);
+  }
+  for(unsigned int i = 0; i < shapes.size(); i++) {
+    if(objects_->removeObject(ns, shapes[i])) {
+      delete shapes[i];
+    }
+  }
+  cn->bounds_valid = false;
+  cn->getBounds();
+  bumpModificationEpoch();
 }
 
 void collision_space::EnvironmentModelODE::addObject(const std::string &ns, shapes::Shape *shape, const tf::Transform &pose)
 {
-  std::map<std::string, CollisionNamespace*>::iterator it = coll_namespaces_.find(ns);
+  detachCollisionNamespace(ns);
+  std::map<std::string, boost::shared_ptr<CollisionNamespace> >::iterator it = coll_namespaces_.find(ns);
   CollisionNamespace* cn = NULL;    
   if (it == coll_namespaces_.end())
   {
     cn = new CollisionNamespace(ns);
     dspace_lookup_map_[ns] = cn->space;
-    coll_namespaces_[ns] = cn;
+    coll_namespaces_[ns].reset(cn);
     default_collision_matrix_.addEntry(ns, false);
   }
   else
-    cn = it->second;
+    cn = it->second.get();
 
   dGeomID g = createODEGeom(cn->space, cn->storage, shape, 1.0, 0.0);
   assert(g);
@@ -1296,51 +2458,119 @@ void collision_space::EnvironmentModelODE::addObject(const std::string &ns, shap
 
   updateGeom(g, pose);
   cn->geoms.push_back(g);
+  cn->bounds_valid = false;
   objects_->addObject(ns, shape, pose);
+  if(object_batch_active_) {
+    object_batch_dirty_.insert(ns);
+  } else {
+    //cook the namespace bounds now so concurrent readers of a shared
+    //namespace only ever read them
+    cn->getBounds();
+    bumpModificationEpoch();
+  }
 }
 
 void collision_space::EnvironmentModelODE::addObject(const std::string &ns, shapes::StaticShape* shape)
 {   
-  std::map<std::string, CollisionNamespace*>::iterator it = coll_namespaces_.find(ns);
+  detachCollisionNamespace(ns);
+  std::map<std::string, boost::shared_ptr<CollisionNamespace> >::iterator it = coll_namespaces_.find(ns);
   CollisionNamespace* cn = NULL;    
   if (it == coll_namespaces_.end())
   {
     cn = new CollisionNamespace(ns);
     dspace_lookup_map_[ns] = cn->space;
-    coll_namespaces_[ns] = cn;
+    coll_namespaces_[ns].reset(cn);
     default_collision_matrix_.addEntry(ns, false);
   }
   else
-    cn = it->second;
+    cn = it->second.get();
 
   dGeomID g = createODEGeom(cn->space, cn->storage, shape);
   assert(g);
   dGeomSetData(g, reinterpret_cast<void*>(shape));
   cn->geoms.push_back(g);
+  cn->bounds_valid = false;
   objects_->addObject(ns, shape);
+  if(object_batch_active_) {
+    object_batch_dirty_.insert(ns);
+  } else {
+    cn->getBounds();
+    bumpModificationEpoch();
+  }
+}
+
+void collision_space::EnvironmentModelODE::beginObjectBatch(void)
+{
+  object_batch_active_ = true;
+  object_batch_dirty_.clear();
+}
+
+void collision_space::EnvironmentModelODE::commitObjectBatch(void)
+{
+  if(!object_batch_active_) {
+    return;
+  }
+  object_batch_active_ = false;
+  for(std::set<std::string>::iterator it = object_batch_dirty_.begin();
+      it != object_batch_dirty_.end();
+      it++) {
+    std::map<std::string, boost::shared_ptr<CollisionNamespace> >::iterator nit = coll_namespaces_.find(*it);
+    if(nit == coll_namespaces_.end()) {
+      //namespace was cleared while the batch was open
+      continue;
+    }
+    CollisionNamespace* cn = nit->second.get();
+    if(!cn->batch_query) {
+      cn->collide2.setup();
+    }
+    cn->bounds_valid = false;
+    cn->getBounds();
+  }
+  object_batch_dirty_.clear();
+  bumpModificationEpoch();
+}
+
+void collision_space::EnvironmentModelODE::refreshGeomLookupIndices()
+{
+  for (unsigned int i = 0 ; i < model_geom_.link_geom.size() ; ++i) {
+    LinkGeom *lg = model_geom_.link_geom[i];
+    default_collision_matrix_.getEntryIndex(lg->link->getName(), lg->index);
+    for(unsigned int j = 0; j < lg->att_bodies.size(); j++) {
+      default_collision_matrix_.getEntryIndex(lg->att_bodies[j]->att->getName(), lg->att_bodies[j]->index);
+    }
+  }
+  for(std::map<dGeomID, GeomLookup>::iterator it = geom_lookup_map_.begin();
+      it != geom_lookup_map_.end();
+      it++) {
+    it->second.has_acm_index = default_collision_matrix_.getEntryIndex(it->second.name, it->second.acm_index);
+  }
 }
 
 void collision_space::EnvironmentModelODE::clearObjects(void)
 {
-  for (std::map<std::string, CollisionNamespace*>::iterator it = coll_namespaces_.begin() ; it != coll_namespaces_.end() ; ++it) {
+  for (std::map<std::string, boost::shared_ptr<CollisionNamespace> >::iterator it = coll_namespaces_.begin() ; it != coll_namespaces_.end() ; ++it) {
     default_collision_matrix_.removeEntry(it->first);
-    delete it->second;
   }
   dspace_lookup_map_.clear();
   coll_namespaces_.clear();
   objects_->clearObjects();
+  //removing matrix entries shifts the indices cached per geom
+  refreshGeomLookupIndices();
+  bumpModificationEpoch();
 }
 
 void collision_space::EnvironmentModelODE::clearObjects(const std::string &ns)
 {
-  std::map<std::string, CollisionNamespace*>::iterator it = coll_namespaces_.find(ns);
+  std::map<std::string, boost::shared_ptr<CollisionNamespace> >::iterator it = coll_namespaces_.find(ns);
   if (it != coll_namespaces_.end()) {
     default_collision_matrix_.removeEntry(ns);
-    delete it->second;
     coll_namespaces_.erase(ns);
     dspace_lookup_map_.erase(ns);
+    //removing a matrix entry shifts the indices cached per geom
+    refreshGeomLookupIndices();
   }
   objects_->clearObjects(ns);
+  bumpModificationEpoch();
 }
 
 dGeomID collision_space::EnvironmentModelODE::copyGeom(dSpaceID space, ODEStorage &storage, dGeomID geom, ODEStorage &sourceStorage) const
@@ -1385,6 +2615,7 @@ dGeomID collision_space::EnvironmentModelODE::copyGeom(dSpaceID space, ODEStorag
         if (it->second.data == tdata)
         {
           ODEStorage::Element& e = storage.meshes[geom];
+          e.shared = false;
           e.n_vertices = it->second.n_vertices;
           e.n_indices = it->second.n_indices;
           e.indices = new dTriIndex[e.n_indices];
@@ -1426,66 +2657,34 @@ collision_space::EnvironmentModel* collision_space::EnvironmentModelODE::clone(v
   env->verbose_ = verbose_;
   env->robot_scale_ = robot_scale_;
   env->default_robot_padding_ = default_robot_padding_;
+  //altered state comes along so query clones answer exactly like the
+  //master; the padding map must be in place before the robot geoms
+  //are built
+  env->altered_collision_matrix_ = altered_collision_matrix_;
+  env->use_altered_collision_matrix_ = use_altered_collision_matrix_;
+  env->altered_link_padding_map_ = altered_link_padding_map_;
+  env->use_altered_link_padding_map_ = use_altered_link_padding_map_;
+  env->allowed_contacts_ = allowed_contacts_;
+  env->allowed_contact_map_ = allowed_contact_map_;
+  env->self_collision_group_scope_ = self_collision_group_scope_;
   env->robot_model_ = new planning_models::KinematicModel(*robot_model_);
   env->createODERobotModel();
 
-  for (std::map<std::string, CollisionNamespace*>::const_iterator it = coll_namespaces_.begin() ; it != coll_namespaces_.end() ; ++it) {
-    // construct a map of the shape pointers we have; this points to the index positions where they are stored;
-    std::map<void*, int> shapePtrs;
+  //static environment geometry is shared copy-on-write with the clone;
+  //whichever environment mutates a shared namespace first detaches its
+  //own private copy, so neither sees the other's changes
+  env->coll_namespaces_ = coll_namespaces_;
+  env->dspace_lookup_map_ = dspace_lookup_map_;
+
+  //the object bookkeeping is still copied so each environment owns its shapes
+  for (std::map<std::string, boost::shared_ptr<CollisionNamespace> >::const_iterator it = coll_namespaces_.begin() ; it != coll_namespaces_.end() ; ++it) {
     const EnvironmentObjects::NamespaceObjects &ns = objects_->getObjects(it->first);
-    unsigned int n = ns.static_shape.size();
-    for (unsigned int i = 0 ; i < n ; ++i)
-      shapePtrs[ns.static_shape[i]] = -1 - i;
-    n = ns.shape.size();
-    for (unsigned int i = 0 ; i < n ; ++i)
-      shapePtrs[ns.shape[i]] = i;
-    
-    // copy the collision namespace structure, geom by geom
-    CollisionNamespace *cn = new CollisionNamespace(it->first);
-    env->coll_namespaces_[it->first] = cn;
-    env->dspace_lookup_map_[cn->name] = cn->space;
-    n = it->second->geoms.size();
-    cn->geoms.reserve(n);
-    for (unsigned int i = 0 ; i < n ; ++i)
-    {
-      dGeomID newGeom = copyGeom(cn->space, cn->storage, it->second->geoms[i], it->second->storage);
-      int idx = shapePtrs[dGeomGetData(it->second->geoms[i])];
-      if (idx < 0) // static geom
-      {
-        shapes::StaticShape *newShape = shapes::cloneShape(ns.static_shape[-idx - 1]);
-        dGeomSetData(newGeom, reinterpret_cast<void*>(newShape));
-        env->objects_->addObject(it->first, newShape);
-      }
-      else // movable geom
-      {
-        shapes::Shape *newShape = shapes::cloneShape(ns.shape[idx]);
-        dGeomSetData(newGeom, reinterpret_cast<void*>(newShape));
-        env->objects_->addObject(it->first, newShape, ns.shape_pose[idx]);
-      }
-      cn->geoms.push_back(newGeom);
-    }
-    std::vector<dGeomID> geoms;
-    it->second->collide2.getGeoms(geoms);
-    n = geoms.size();
-    for (unsigned int i = 0 ; i < n ; ++i)
-    {
-      dGeomID newGeom = copyGeom(cn->space, cn->storage, geoms[i], it->second->storage);
-      int idx = shapePtrs[dGeomGetData(geoms[i])];
-      if (idx < 0) // static geom
-      {
-        shapes::StaticShape *newShape = shapes::cloneShape(ns.static_shape[-idx - 1]);
-        dGeomSetData(newGeom, reinterpret_cast<void*>(newShape));
-        env->objects_->addObject(it->first, newShape);
-      }
-      else // movable geom
-      {
-        shapes::Shape *newShape = shapes::cloneShape(ns.shape[idx]);
-        dGeomSetData(newGeom, reinterpret_cast<void*>(newShape));
-        env->objects_->addObject(it->first, newShape, ns.shape_pose[idx]);
-      }
-      cn->collide2.registerGeom(newGeom);
-    }
+    env->objects_->addObjectNamespace(it->first);
+    for (unsigned int i = 0 ; i < ns.static_shape.size() ; ++i)
+      env->objects_->addObject(it->first, shapes::cloneShape(ns.static_shape[i]));
+    for (unsigned int i = 0 ; i < ns.shape.size() ; ++i)
+      env->objects_->addObject(it->first, shapes::cloneShape(ns.shape[i]), ns.shape_pose[i]);
   }
-    
+
   return env;    
 }
@@ -36,6 +36,7 @@
 
 #include "collision_space/environment_objects.h"
 #include <geometric_shapes/shape_operations.h>
+#include <ros/console.h>
 
 std::vector<std::string> collision_space::EnvironmentObjects::getNamespaces(void) const
 {
@@ -66,8 +67,11 @@ void collision_space::EnvironmentObjects::addObject(const std::string &ns, shape
 
 void collision_space::EnvironmentObjects::addObject(const std::string &ns, shapes::Shape *shape, const tf::Transform &pose)
 {
-  objects_[ns].shape.push_back(shape);
-  objects_[ns].shape_pose.push_back(pose);
+  NamespaceObjects &no = objects_[ns];
+  no.shape.push_back(shape);
+  no.shape_pose.push_back(pose);
+  no.shape_aabb.resize(no.shape_aabb.size() + 1);
+  computeAABB(shape, pose, no.shape_aabb.back());
 }
 
 bool collision_space::EnvironmentObjects::removeObject(const std::string &ns, const shapes::Shape *shape)
@@ -81,6 +85,7 @@ bool collision_space::EnvironmentObjects::removeObject(const std::string &ns, co
       {
         it->second.shape.erase(it->second.shape.begin() + i);
         it->second.shape_pose.erase(it->second.shape_pose.begin() + i);
+        it->second.shape_aabb.erase(it->second.shape_aabb.begin() + i);
         return true;
       }
   }
@@ -146,6 +151,77 @@ collision_space::EnvironmentObjects* collision_space::EnvironmentObjects::clone(
     for (unsigned int i = 0 ; i < n ; ++i)
       ns.shape.push_back(shapes::cloneShape(it->second.shape[i]));
     ns.shape_pose = it->second.shape_pose;
+    ns.shape_aabb = it->second.shape_aabb;
   }
   return c;
 }
+
+void collision_space::EnvironmentObjects::computeAABB(const shapes::Shape *shape, const tf::Transform &pose, AABB &aabb)
+{
+  const tf::Vector3 &origin = pose.getOrigin();
+  tf::Vector3 extents(0.0, 0.0, 0.0);
+  switch (shape->type)
+  {
+  case shapes::SPHERE:
+    {
+      double r = static_cast<const shapes::Sphere*>(shape)->radius;
+      extents = tf::Vector3(r, r, r);
+    }
+    break;
+  case shapes::BOX:
+  case shapes::CYLINDER:
+    {
+      //a cylinder is bounded by the box of its radius and length;
+      //the rotated box extent along each world axis is the sum of
+      //the half extents weighted by the basis magnitudes
+      tf::Vector3 half;
+      if (shape->type == shapes::BOX)
+      {
+        const double *size = static_cast<const shapes::Box*>(shape)->size;
+        half = tf::Vector3(size[0] / 2.0, size[1] / 2.0, size[2] / 2.0);
+      }
+      else
+      {
+        const shapes::Cylinder *c = static_cast<const shapes::Cylinder*>(shape);
+        half = tf::Vector3(c->radius, c->radius, c->length / 2.0);
+      }
+      const tf::Matrix3x3 &basis = pose.getBasis();
+      for (int i = 0 ; i < 3 ; ++i)
+        extents[i] = fabs(basis[i].x()) * half.x() + fabs(basis[i].y()) * half.y() + fabs(basis[i].z()) * half.z();
+    }
+    break;
+  case shapes::MESH:
+    {
+      const shapes::Mesh *mesh = static_cast<const shapes::Mesh*>(shape);
+      aabb.low = aabb.high = origin;
+      for (unsigned int i = 0 ; i < mesh->vertexCount ; ++i)
+      {
+        tf::Vector3 v = pose * tf::Vector3(mesh->vertices[3 * i], mesh->vertices[3 * i + 1], mesh->vertices[3 * i + 2]);
+        aabb.low.setMin(v);
+        aabb.high.setMax(v);
+      }
+      return;
+    }
+  default:
+    ROS_WARN("Unknown shape type %d for bounding box computation", (int)shape->type);
+    break;
+  }
+  aabb.low = origin - extents;
+  aabb.high = origin + extents;
+}
+
+void collision_space::EnvironmentObjects::getNamespacesIntersectingBox(const tf::Vector3 &box_low, const tf::Vector3 &box_high,
+                                                                       std::vector<std::string> &ns) const
+{
+  ns.clear();
+  for (std::map<std::string, NamespaceObjects>::const_iterator it = objects_.begin() ; it != objects_.end() ; ++it)
+  {
+    //static shapes (planes) are unbounded, so a namespace holding
+    //any can never be pruned
+    bool intersects = !it->second.static_shape.empty();
+    for (unsigned int i = 0 ; !intersects && i < it->second.shape_aabb.size() ; ++i)
+      intersects = it->second.shape_aabb[i].intersects(box_low, box_high);
+    if (intersects)
+      ns.push_back(it->first);
+  }
+}
@@ -0,0 +1,187 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+/** \author Ioan Sucan */
+
+#include "collision_space/thread_affinity.h"
+
+#include <ros/console.h>
+#include <boost/thread/mutex.hpp>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cctype>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+
+#if defined(__linux__)
+
+struct NodeTopology
+{
+  NodeTopology(void) : detected(false)
+  {
+  }
+
+  bool detected;
+  //one CPU list per node, e.g. cpus_per_node[1] = {8,...,15}
+  std::vector<std::vector<unsigned int> > cpus_per_node;
+};
+
+NodeTopology topology;
+boost::mutex topology_lock;
+
+/** Parse a cpulist file of the "0-3,8-11" form */
+bool parseCpuList(const std::string& text, std::vector<unsigned int>& cpus)
+{
+  unsigned int pos = 0;
+  while(pos < text.size()) {
+    if(!isdigit(text[pos])) {
+      return false;
+    }
+    unsigned int first = 0;
+    while(pos < text.size() && isdigit(text[pos])) {
+      first = first * 10 + (text[pos] - '0');
+      pos++;
+    }
+    unsigned int last = first;
+    if(pos < text.size() && text[pos] == '-') {
+      pos++;
+      last = 0;
+      if(pos >= text.size() || !isdigit(text[pos])) {
+        return false;
+      }
+      while(pos < text.size() && isdigit(text[pos])) {
+        last = last * 10 + (text[pos] - '0');
+        pos++;
+      }
+    }
+    for(unsigned int c = first; c <= last; c++) {
+      cpus.push_back(c);
+    }
+    if(pos < text.size()) {
+      if(text[pos] != ',') {
+        return false;
+      }
+      pos++;
+    }
+  }
+  return !cpus.empty();
+}
+
+/** Must hold topology_lock; fills in the topology on first call */
+void detectTopology(void)
+{
+  if(topology.detected) {
+    return;
+  }
+  topology.detected = true;
+  for(unsigned int node = 0; ; node++) {
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", node);
+    FILE* f = fopen(path, "r");
+    if(f == NULL) {
+      break;
+    }
+    char buf[4096];
+    std::string text;
+    if(fgets(buf, sizeof(buf), f) != NULL) {
+      text = buf;
+      while(!text.empty() && (text[text.size() - 1] == '\n' || text[text.size() - 1] == ' ')) {
+        text.erase(text.size() - 1);
+      }
+    }
+    fclose(f);
+    std::vector<unsigned int> cpus;
+    if(!parseCpuList(text, cpus)) {
+      ROS_DEBUG_STREAM("Could not parse cpu list '" << text << "' for node " << node);
+      topology.cpus_per_node.clear();
+      return;
+    }
+    topology.cpus_per_node.push_back(cpus);
+  }
+  if(topology.cpus_per_node.size() > 1) {
+    ROS_DEBUG_STREAM("Detected " << topology.cpus_per_node.size()
+                     << " memory nodes, worker threads will be pinned node round-robin");
+  }
+}
+
+#endif
+
+}
+
+unsigned int collision_space::thread_affinity::getNodeCount(void)
+{
+#if defined(__linux__)
+  boost::mutex::scoped_lock lock(topology_lock);
+  detectTopology();
+  if(topology.cpus_per_node.size() > 1) {
+    return topology.cpus_per_node.size();
+  }
+#endif
+  return 1;
+}
+
+void collision_space::thread_affinity::bindCurrentThreadForWorker(unsigned int worker_index)
+{
+#if defined(__linux__)
+  std::vector<unsigned int> cpus;
+  {
+    boost::mutex::scoped_lock lock(topology_lock);
+    detectTopology();
+    //nothing to gain from pinning on a single-node machine
+    if(topology.cpus_per_node.size() < 2) {
+      return;
+    }
+    cpus = topology.cpus_per_node[worker_index % topology.cpus_per_node.size()];
+  }
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for(unsigned int i = 0; i < cpus.size(); i++) {
+    if(cpus[i] < CPU_SETSIZE) {
+      CPU_SET(cpus[i], &cpu_set);
+    }
+  }
+  if(pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) != 0) {
+    ROS_DEBUG("Could not set worker thread affinity");
+  }
+#else
+  (void) worker_index;
+#endif
+}
@@ -0,0 +1,255 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+/* Benchmark for collision_space backends.
+ *
+ * Replays updateRobotModel()+isCollision() cycles against a scene with
+ * a dense collision map, shelf boxes and a few meshes, and reports
+ * checks/sec, mean and p99 latency and allocation counts, so backend
+ * and broadphase changes can be compared on numbers instead of gut
+ * feel.
+ *
+ * Usage: collision_space_benchmark [cycles] [map_boxes] [backend]
+ *   cycles    number of check cycles to run (default 10000)
+ *   map_boxes number of collision map boxes (default 1000)
+ *   backend   "ode" (default), "ode2phase" or "bullet"
+ */
+
+#include <planning_models/kinematic_model.h>
+#include <planning_models/kinematic_state.h>
+#include <collision_space/environmentODE.h>
+#include <collision_space/environmentBullet.h>
+#include <ros/package.h>
+#include <ros/time.h>
+#include <cstdlib>
+#include <cstdio>
+#include <algorithm>
+#include <new>
+
+//urdf location relative to the planning_models path
+static const std::string rel_path = "/test_urdf/robot.xml";
+
+//count every allocation that goes through global new, so the report
+//can show how much of the hot loop still hits the heap
+static unsigned long allocation_count = 0;
+
+void* operator new(std::size_t size) throw (std::bad_alloc)
+{
+  allocation_count++;
+  void* p = malloc(size ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void* operator new[](std::size_t size) throw (std::bad_alloc)
+{
+  allocation_count++;
+  void* p = malloc(size ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) throw()
+{
+  free(p);
+}
+
+void operator delete[](void* p) throw()
+{
+  free(p);
+}
+
+//deterministic across runs, so two builds see the same states
+static double uniform(double low, double high)
+{
+  return low + (high - low) * ((double)rand() / (double)RAND_MAX);
+}
+
+//a box as a mesh, to put trimesh work into the scene the way shelf
+//models from perception do
+static shapes::Mesh* makeBoxMesh(double x, double y, double z)
+{
+  shapes::Mesh* mesh = new shapes::Mesh(8, 12);
+  double hx = x * 0.5, hy = y * 0.5, hz = z * 0.5;
+  for (unsigned int i = 0; i < 8; i++)
+  {
+    mesh->vertices[i * 3 + 0] = (i & 1) ? hx : -hx;
+    mesh->vertices[i * 3 + 1] = (i & 2) ? hy : -hy;
+    mesh->vertices[i * 3 + 2] = (i & 4) ? hz : -hz;
+  }
+  static const unsigned int tris[36] = {0, 1, 2, 1, 3, 2,
+                                        4, 6, 5, 5, 6, 7,
+                                        0, 4, 1, 1, 4, 5,
+                                        2, 3, 6, 3, 7, 6,
+                                        0, 2, 4, 2, 6, 4,
+                                        1, 5, 3, 3, 7, 5};
+  for (unsigned int i = 0; i < 36; i++)
+    mesh->triangles[i] = tris[i];
+  return mesh;
+}
+
+int main(int argc, char** argv)
+{
+  unsigned int cycles = argc > 1 ? atoi(argv[1]) : 10000;
+  unsigned int map_boxes = argc > 2 ? atoi(argv[2]) : 1000;
+  std::string backend = argc > 3 ? argv[3] : "ode";
+
+  ros::Time::init();
+  srand(42);
+
+  std::string full_path = ros::package::getPath("planning_models") + rel_path;
+  urdf::Model urdf_model;
+  if (!urdf_model.initFile(full_path))
+  {
+    fprintf(stderr, "Cannot load urdf from %s\n", full_path.c_str());
+    return 1;
+  }
+
+  std::vector<planning_models::KinematicModel::MultiDofConfig> multi_dof_configs;
+  planning_models::KinematicModel::MultiDofConfig config("base_joint");
+  config.type = "Planar";
+  config.parent_frame_id = "base_footprint";
+  config.child_frame_id = "base_footprint";
+  multi_dof_configs.push_back(config);
+  std::vector<planning_models::KinematicModel::GroupConfig> gcs;
+  planning_models::KinematicModel* kinematic_model =
+    new planning_models::KinematicModel(urdf_model, gcs, multi_dof_configs);
+
+  collision_space::EnvironmentModel* coll_space = NULL;
+  collision_space::EnvironmentModelODE* ode_space = NULL;
+  if (backend == "bullet")
+  {
+    coll_space = new collision_space::EnvironmentModelBullet();
+  }
+  else
+  {
+    ode_space = new collision_space::EnvironmentModelODE();
+    if (backend == "ode2phase")
+      ode_space->setTwoPhaseEnvironmentCheck(true);
+    coll_space = ode_space;
+  }
+
+  std::vector<std::string> links;
+  kinematic_model->getLinkModelNames(links);
+  std::map<std::string, double> link_padding_map;
+
+  //start from everything forbidden, then allow exactly the pairs that
+  //touch in the default state, like a real setup would
+  collision_space::EnvironmentModel::AllowedCollisionMatrix acm(links, false);
+  coll_space->setRobotModel(kinematic_model, acm, link_padding_map);
+
+  planning_models::KinematicState state(kinematic_model);
+  state.setKinematicStateToDefault();
+  coll_space->updateRobotModel(&state);
+
+  std::vector<collision_space::EnvironmentModel::Contact> contacts;
+  coll_space->getAllCollisionContacts(contacts, 1);
+  for (unsigned int i = 0; i < contacts.size(); i++)
+    acm.changeEntry(contacts[i].body_name_1, contacts[i].body_name_2, true);
+  coll_space->setRobotModel(kinematic_model, acm, link_padding_map);
+
+  //collision map: a block of small boxes in front of the robot
+  {
+    std::vector<shapes::Shape*> shapes;
+    std::vector<tf::Transform> poses;
+    for (unsigned int i = 0; i < map_boxes; i++)
+    {
+      shapes.push_back(new shapes::Box(0.02, 0.02, 0.02));
+      tf::Transform pose;
+      pose.setIdentity();
+      pose.setOrigin(tf::Vector3(uniform(0.6, 1.4), uniform(-0.8, 0.8), uniform(0.3, 1.3)));
+      poses.push_back(pose);
+    }
+    coll_space->addObjects("collision_map", shapes, poses);
+  }
+
+  //a few mesh objects standing in for recognized shelf models
+  for (unsigned int i = 0; i < 4; i++)
+  {
+    tf::Transform pose;
+    pose.setIdentity();
+    pose.setOrigin(tf::Vector3(1.0, -0.9 + 0.6 * i, 0.5));
+    coll_space->addObject("shelves", makeBoxMesh(0.4, 0.5, 1.0), pose);
+  }
+
+  //joint values are perturbed around the default state, the way a
+  //sampling-based planner explores near its start state
+  std::vector<double> default_values;
+  state.getKinematicStateValues(default_values);
+
+  printf("Benchmarking backend %s: %u cycles, %u map boxes, %u dof\n",
+         backend.c_str(), cycles, map_boxes, (unsigned int)default_values.size());
+
+  std::vector<double> latencies(cycles);
+  std::vector<double> values(default_values.size());
+  unsigned int colliding = 0;
+  unsigned long allocations_before = allocation_count;
+  ros::WallTime total_start = ros::WallTime::now();
+
+  for (unsigned int i = 0; i < cycles; i++)
+  {
+    for (unsigned int j = 0; j < values.size(); j++)
+      values[j] = default_values[j] + uniform(-0.3, 0.3);
+    state.setKinematicState(values);
+
+    ros::WallTime cycle_start = ros::WallTime::now();
+    coll_space->updateRobotModel(&state);
+    if (coll_space->isCollision())
+      colliding++;
+    latencies[i] = (ros::WallTime::now() - cycle_start).toSec();
+  }
+
+  double total = (ros::WallTime::now() - total_start).toSec();
+  unsigned long allocations = allocation_count - allocations_before;
+
+  std::sort(latencies.begin(), latencies.end());
+  double mean = 0.0;
+  for (unsigned int i = 0; i < cycles; i++)
+    mean += latencies[i];
+  mean /= (double)cycles;
+  double p99 = latencies[(unsigned int)((double)(cycles - 1) * 0.99)];
+
+  printf("  %u/%u states in collision\n", colliding, cycles);
+  printf("  checks/sec:  %.0f\n", (double)cycles / total);
+  printf("  mean:        %.1f us\n", mean * 1e6);
+  printf("  p99:         %.1f us\n", p99 * 1e6);
+  printf("  allocations: %lu total, %.1f per cycle\n",
+         allocations, (double)allocations / (double)cycles);
+
+  delete coll_space;
+  delete kinematic_model;
+  return 0;
+}
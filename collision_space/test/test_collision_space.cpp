@@ -561,6 +561,39 @@ TEST_F(TestCollisionSpace, TestAllowedContacts)
   coll_space_->clearAllowedContacts();
 }
 
+TEST_F(TestCollisionSpace, TestBatchCheck)
+{
+  std::vector<std::string> links;
+  kinematic_model_->getLinkModelNames(links);
+  std::map<std::string, double> link_padding_map;
+
+  collision_space::EnvironmentModel::AllowedCollisionMatrix acm(links, false);
+  coll_space_->setRobotModel(kinematic_model_, acm, link_padding_map);
+
+  //a batch of default states, all of which should be in collision
+  std::vector<planning_models::KinematicState*> states;
+  for(unsigned int i = 0; i < 32; i++) {
+    planning_models::KinematicState* state = new planning_models::KinematicState(kinematic_model_);
+    state->setKinematicStateToDefault();
+    states.push_back(state);
+  }
+
+  std::vector<bool> collisions;
+  ASSERT_TRUE(coll_space_->checkStatesBatch(states, collisions));
+  ASSERT_EQ(collisions.size(), states.size());
+  for(unsigned int i = 0; i < collisions.size(); i++) {
+    EXPECT_TRUE(collisions[i]);
+  }
+
+  //batch results should agree with the serial check
+  coll_space_->updateRobotModel(states[0]);
+  ASSERT_TRUE(coll_space_->isCollision());
+
+  for(unsigned int i = 0; i < states.size(); i++) {
+    delete states[i];
+  }
+}
+
 TEST_F(TestCollisionSpace, TestThreading)
 {
   boost::thread thread1(boost::bind(&TestCollisionSpace::spinThread, this));
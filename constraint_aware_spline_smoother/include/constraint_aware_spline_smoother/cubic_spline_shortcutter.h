@@ -39,6 +39,8 @@
 
 #include <ros/ros.h>
 #include <tf/tf.h>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
 #include <spline_smoother/spline_smoother.h>
 #include <spline_smoother/cubic_trajectory.h>
 #include <planning_environment/models/collision_models_interface.h>
@@ -70,11 +72,86 @@ public:
 private:
   bool active_;
   double discretization_;
+  int num_shortcut_threads_;
+
+  /** Wall-clock deadline of the current smooth() call, set from the
+      request's allowed_time before the workers are spawned.  Workers stop
+      proposing once it passes, so a round overruns the filter budget by at
+      most one candidate check.  Zero means no deadline. */
+  mutable ros::Time round_deadline_;
   bool setupCollisionEnvironment();
   planning_environment::CollisionModelsInterface *collision_models_interface_;
   //  ros::NodeHandle node_handle_;
+
+  /** A shortcut proposal a worker validated against its own collision
+      environment clone: the interval of the current trajectory it replaces
+      and the two already-parameterized replacement waypoints. */
+  struct ShortcutCandidate
+  {
+    double segment_start_time;
+    double segment_end_time;
+    ros::Duration shortcut_duration;
+    trajectory_msgs::JointTrajectoryPoint start_point;
+    trajectory_msgs::JointTrajectoryPoint end_point;
+  };
+
+  /** How many shortcut intervals each worker tries per round before the
+      coordinator folds the accepted ones back into the trajectory. */
+  static const int PROPOSALS_PER_ROUND = 4;
+
+  /** When no path constraints need per-point evaluation, candidate
+      shortcuts are sampled this many times coarser than the configured
+      discretization and the gaps are covered by the clearance-adaptive
+      segment check, which only refines where the clearance is low. */
+  static const int ADAPTIVE_COARSENING_FACTOR = 8;
+
+  static bool hasActiveConstraints(const arm_navigation_msgs::Constraints &constraints)
+  {
+    return !constraints.joint_constraints.empty() ||
+           !constraints.position_constraints.empty() ||
+           !constraints.orientation_constraints.empty() ||
+           !constraints.visibility_constraints.empty();
+  }
+
+  static bool shortcutSavesMore(const ShortcutCandidate &a, const ShortcutCandidate &b)
+  {
+    return (a.segment_end_time - a.segment_start_time) - a.shortcut_duration.toSec() >
+           (b.segment_end_time - b.segment_start_time) - b.shortcut_duration.toSec();
+  }
+
+  static bool shortcutStartsLater(const ShortcutCandidate &a, const ShortcutCandidate &b)
+  {
+    return a.segment_start_time > b.segment_start_time;
+  }
+
+  static bool pointsMatch(const trajectory_msgs::JointTrajectoryPoint &a,
+                          const trajectory_msgs::JointTrajectoryPoint &b)
+  {
+    return a.positions == b.positions && a.velocities == b.velocities;
+  }
+
+  /** Rebuilds the spline for a trajectory that differs from
+      previous_trajectory only by spliced-in shortcuts.  Segments whose
+      waypoint pair survived the splice keep their previous solution, so
+      only the changed segments (three per applied shortcut) pay for a
+      fresh minimum-time solve. */
+  bool reparameterizeChangedSegments(const trajectory_msgs::JointTrajectory &trajectory,
+                                     const std::vector<arm_navigation_msgs::JointLimits> &limits,
+                                     const trajectory_msgs::JointTrajectory &previous_trajectory,
+                                     spline_smoother::SplineTrajectory &spline) const;
+
+  void proposeShortcuts(const spline_smoother::SplineTrajectory &spline,
+                        const std::vector<arm_navigation_msgs::JointLimits> &limits,
+                        const arm_navigation_msgs::Constraints &path_constraints,
+                        const std::map<std::string, double> &base_state_values,
+                        double total_time,
+                        unsigned int rng_seed,
+                        bool try_full_span,
+                        std::vector<ShortcutCandidate> &accepted) const;
+
   int getRandomInt(int min,int max) const;
   double getRandomTimeStamp(double min,double max) const;
+  double getRandomTimeStamp(double min,double max,unsigned int &rng_state) const;
   void discretizeTrajectory(const spline_smoother::SplineTrajectory &spline, 
                             const double &discretization,
                             trajectory_msgs::JointTrajectory &joint_trajectory) const;
@@ -118,6 +195,8 @@ bool CubicSplineShortCutter<T>::configure()
   else
   {
     ROS_DEBUG("Using a discretization value of %f",discretization_);
+    if (!spline_smoother::SplineSmoother<T>::getParam("shortcut_threads", num_shortcut_threads_))
+      num_shortcut_threads_ = 0; // one worker per hardware thread
     return true;
   }
 };
@@ -125,6 +204,7 @@ bool CubicSplineShortCutter<T>::configure()
 template <typename T>
 CubicSplineShortCutter<T>::CubicSplineShortCutter()
 {
+  num_shortcut_threads_ = 0;
   if(!setupCollisionEnvironment())
     active_ = false;
   else
@@ -152,6 +232,14 @@ double CubicSplineShortCutter<T>::getRandomTimeStamp(double min,double max)const
   return result;
 }
 
+template <typename T>
+double CubicSplineShortCutter<T>::getRandomTimeStamp(double min,double max,unsigned int &rng_state)const
+{
+  int rand_num = rand_r(&rng_state)%100+1;
+  double result = min + (double)((max-min)*rand_num)/101.0;
+  return result;
+}
+
 template <typename T>
 bool CubicSplineShortCutter<T>::smooth(const T& trajectory_in, 
                                        T& trajectory_out) const
@@ -175,8 +263,7 @@ bool CubicSplineShortCutter<T>::smooth(const T& trajectory_in,
   std::vector<arm_navigation_msgs::ArmNavigationErrorCodes> trajectory_error_codes;
   arm_navigation_msgs::RobotState robot_state;
   spline_smoother::CubicTrajectory trajectory_solver;
-  spline_smoother::SplineTrajectory spline, shortcut_spline;
-  arm_navigation_msgs::JointTrajectoryWithLimits shortcut, discretized_trajectory;
+  spline_smoother::SplineTrajectory spline;
 
   trajectory_out.request = trajectory_in.request;
 
@@ -200,14 +287,12 @@ bool CubicSplineShortCutter<T>::smooth(const T& trajectory_in,
   if (!spline_smoother::checkTrajectoryConsistency(trajectory_out))
     return false;
 
-  shortcut.limits = trajectory_in.request.limits;
-  shortcut.trajectory.joint_names = trajectory_in.request.trajectory.joint_names;
-
-  discretized_trajectory.limits = trajectory_in.request.limits;
-  discretized_trajectory.trajectory.joint_names = trajectory_in.request.trajectory.joint_names;
-
   ros::Time start_time = ros::Time::now();
   ros::Duration timeout = trajectory_in.request.allowed_time;
+  if(timeout > ros::Duration(0.0))
+    round_deadline_ = start_time + timeout;
+  else
+    round_deadline_ = ros::Time();
 
   bool success = trajectory_solver.parameterize(trajectory_out.request.trajectory,trajectory_in.request.limits,spline);      
   getWaypoints(spline,trajectory_out.request.trajectory);
@@ -252,82 +337,104 @@ bool CubicSplineShortCutter<T>::smooth(const T& trajectory_in,
   }
   
 
-  std::vector<double> sample_times;
-  sample_times.resize(2);
+  std::map<std::string, double> base_state_values;
+  collision_models_interface_->getPlanningSceneState()->getKinematicStateValues(base_state_values);
+
+  unsigned int num_threads = num_shortcut_threads_ > 0 ? (unsigned int)num_shortcut_threads_
+                                                       : boost::thread::hardware_concurrency();
+  if(num_threads == 0)
+    num_threads = 1;
+
   bool first_try = true;
   while(ros::Time::now() - start_time < timeout)
   {
     double total_time = trajectory_out.request.trajectory.points.back().time_from_start.toSec();
-    double segment_start_time = getRandomTimeStamp(0.0,total_time);
-    double segment_end_time = getRandomTimeStamp(segment_start_time,total_time);
-    if(segment_start_time == segment_end_time)
+
+    //workers propose shortcuts against the current spline, each validating
+    //through its own kinematic state and per-thread collision clone
+    std::vector<std::vector<ShortcutCandidate> > proposals(num_threads);
+    boost::thread_group workers;
+    for(unsigned int i=0; i < num_threads; i++)
+    {
+      workers.create_thread(boost::bind(&CubicSplineShortCutter<T>::proposeShortcuts, this,
+                                        boost::cref(spline),
+                                        boost::cref(trajectory_in.request.limits),
+                                        boost::cref(trajectory_in.request.path_constraints),
+                                        boost::cref(base_state_values),
+                                        total_time,
+                                        (unsigned int)rand(),
+                                        first_try && i == 0,
+                                        boost::ref(proposals[i])));
+    }
+    workers.join_all();
+    first_try = false;
+
+    std::vector<ShortcutCandidate> candidates;
+    for(unsigned int i=0; i < num_threads; i++)
+      candidates.insert(candidates.end(),proposals[i].begin(),proposals[i].end());
+    if(candidates.empty())
       continue;
-    if(first_try)
+
+    //keep the biggest savers whose intervals don't overlap, then apply
+    //them latest-first so the earlier time stamps stay valid as the
+    //trajectory shrinks
+    std::sort(candidates.begin(),candidates.end(),shortcutSavesMore);
+    std::vector<ShortcutCandidate> selected;
+    for(unsigned int i=0; i < candidates.size(); i++)
     {
-      segment_start_time = 0.0;
-      segment_end_time = total_time;
-      first_try = false;
+      bool conflicts = false;
+      for(unsigned int j=0; j < selected.size(); j++)
+      {
+        if(candidates[i].segment_start_time < selected[j].segment_end_time &&
+           selected[j].segment_start_time < candidates[i].segment_end_time)
+        {
+          conflicts = true;
+          break;
+        }
+      }
+      if(!conflicts)
+        selected.push_back(candidates[i]);
     }
-    sample_times[0] = segment_start_time;
-    sample_times[1] = segment_end_time;
+    std::sort(selected.begin(),selected.end(),shortcutStartsLater);
 
-    spline_smoother::sampleSplineTrajectory(spline,sample_times,shortcut.trajectory);
-    ROS_DEBUG("Start time: %f, %f",segment_start_time,shortcut.trajectory.points[0].positions[0]);
-    ROS_DEBUG("End time  : %f, %f",segment_end_time,shortcut.trajectory.points[1].positions[0]);
-    shortcut.trajectory.points[0].time_from_start = ros::Duration(0.0);
-    shortcut.trajectory.points[1].time_from_start = ros::Duration(0.0);
-    
-    if(!trajectory_solver.parameterize(shortcut.trajectory,trajectory_in.request.limits,shortcut_spline))
-      return false;
-    discretizeTrajectory(shortcut_spline,discretization,discretized_trajectory.trajectory);
-    ROS_DEBUG("Succeeded in sampling trajectory with size: %d",(int)discretized_trajectory.trajectory.points.size());
-
-    arm_navigation_msgs::Constraints empty_goal_constraints;
-
-    if(collision_models_interface_->isJointTrajectoryValid(*collision_models_interface_->getPlanningSceneState(),
-                                                           discretized_trajectory.trajectory,
-                                                           empty_goal_constraints,
-                                                           trajectory_in.request.path_constraints,
-                                                           error_code,
-                                                           trajectory_error_codes,
-                                                           false))
+    //snapshot the waypoints the current spline was solved against so that
+    //after the splices only the changed segments need a fresh solve
+    trajectory_msgs::JointTrajectory previous_trajectory = trajectory_out.request.trajectory;
+
+    bool any_applied = false;
+    for(unsigned int i=0; i < selected.size(); i++)
     {
-      ros::Duration shortcut_duration = discretized_trajectory.trajectory.points.back().time_from_start - discretized_trajectory.trajectory.points.front().time_from_start;
-      if(segment_end_time-segment_start_time <= shortcut_duration.toSec())
-        continue;
-      if(!trimTrajectory(trajectory_out.request.trajectory,segment_start_time,segment_end_time))
+      ShortcutCandidate &candidate = selected[i];
+      if(!trimTrajectory(trajectory_out.request.trajectory,candidate.segment_start_time,candidate.segment_end_time))
         continue;
       ROS_DEBUG_STREAM("Trimmed trajectory has " << trajectory_out.request.trajectory.points.size() << " points");
-
       ROS_DEBUG("Shortcut reduced duration from: %f to %f",
-                segment_end_time-segment_start_time,
-                shortcut_duration.toSec());
-      shortcut.trajectory.points[0].time_from_start = ros::Duration(segment_start_time);
-      shortcut.trajectory.points[1].time_from_start = ros::Duration(segment_start_time) + shortcut_duration;
+                candidate.segment_end_time-candidate.segment_start_time,
+                candidate.shortcut_duration.toSec());
+      candidate.start_point.time_from_start = ros::Duration(candidate.segment_start_time);
+      candidate.end_point.time_from_start = ros::Duration(candidate.segment_start_time) + candidate.shortcut_duration;
       addToTrajectory(trajectory_out.request.trajectory,
-                      shortcut.trajectory.points[0],
+                      candidate.start_point,
                       ros::Duration(0.0));
       addToTrajectory(trajectory_out.request.trajectory,
-                      shortcut.trajectory.points[1],
-                      shortcut_duration-ros::Duration(segment_end_time-segment_start_time));
-      spline.segments.clear();
-      if(!trajectory_solver.parameterize(trajectory_out.request.trajectory,trajectory_in.request.limits,spline)) {
-        trajectory_out.response.error_code.val = arm_navigation_msgs::ArmNavigationErrorCodes::INVALID_TRAJECTORY;
-        return false;
-      }
-      if(!getWaypoints(spline,trajectory_out.request.trajectory)) {
-        trajectory_out.response.error_code.val = arm_navigation_msgs::ArmNavigationErrorCodes::INVALID_TRAJECTORY;
-        return false;
-      }
-      printTrajectory(trajectory_out.request.trajectory);
-      if(trajectory_out.request.trajectory.points.size() < 3)
-        break;
+                      candidate.end_point,
+                      candidate.shortcut_duration-ros::Duration(candidate.segment_end_time-candidate.segment_start_time));
+      any_applied = true;
     }
-    else 
-    {
-      ROS_DEBUG("Traj segment rejected with error code: %d",error_code.val);
+    if(!any_applied)
       continue;
+
+    if(!reparameterizeChangedSegments(trajectory_out.request.trajectory,trajectory_in.request.limits,previous_trajectory,spline)) {
+      trajectory_out.response.error_code.val = arm_navigation_msgs::ArmNavigationErrorCodes::INVALID_TRAJECTORY;
+      return false;
+    }
+    if(!getWaypoints(spline,trajectory_out.request.trajectory)) {
+      trajectory_out.response.error_code.val = arm_navigation_msgs::ArmNavigationErrorCodes::INVALID_TRAJECTORY;
+      return false;
     }
+    printTrajectory(trajectory_out.request.trajectory);
+    if(trajectory_out.request.trajectory.points.size() < 3)
+      break;
   }
   ROS_INFO("Trajectory filter took %f seconds",(ros::Time::now() - start_time).toSec());
   for(unsigned int i=0; i < trajectory_out.request.trajectory.points.size(); i++)
@@ -402,6 +509,194 @@ bool CubicSplineShortCutter<T>::smooth(const T& trajectory_in,
   return success;
 }
 
+template <typename T>
+void CubicSplineShortCutter<T>::proposeShortcuts(const spline_smoother::SplineTrajectory &spline,
+                                                 const std::vector<arm_navigation_msgs::JointLimits> &limits,
+                                                 const arm_navigation_msgs::Constraints &path_constraints,
+                                                 const std::map<std::string, double> &base_state_values,
+                                                 double total_time,
+                                                 unsigned int rng_seed,
+                                                 bool try_full_span,
+                                                 std::vector<ShortcutCandidate> &accepted) const
+{
+  //each worker validates through its own kinematic state; the collision
+  //checks themselves run against per-thread environment clones
+  planning_models::KinematicState state(collision_models_interface_->getKinematicModel());
+  state.setKinematicState(base_state_values);
+  planning_models::KinematicState segment_state(collision_models_interface_->getKinematicModel());
+  segment_state.setKinematicState(base_state_values);
+
+  bool use_adaptive_check = !hasActiveConstraints(path_constraints);
+
+  spline_smoother::CubicTrajectory trajectory_solver;
+  spline_smoother::SplineTrajectory shortcut_spline;
+  trajectory_msgs::JointTrajectory shortcut_trajectory, discretized_trajectory;
+  arm_navigation_msgs::Constraints empty_goal_constraints;
+  std::vector<double> sample_times(2);
+
+  for(int i=0; i < PROPOSALS_PER_ROUND; i++)
+  {
+    if(!round_deadline_.isZero() && ros::Time::now() >= round_deadline_)
+      break;
+    double segment_start_time, segment_end_time;
+    if(try_full_span && i == 0)
+    {
+      //the first round always tries the single full-span shortcut
+      segment_start_time = 0.0;
+      segment_end_time = total_time;
+    }
+    else
+    {
+      segment_start_time = getRandomTimeStamp(0.0,total_time,rng_seed);
+      segment_end_time = getRandomTimeStamp(segment_start_time,total_time,rng_seed);
+    }
+    if(segment_start_time == segment_end_time)
+      continue;
+    sample_times[0] = segment_start_time;
+    sample_times[1] = segment_end_time;
+
+    spline_smoother::sampleSplineTrajectory(spline,sample_times,shortcut_trajectory);
+    ROS_DEBUG("Start time: %f, %f",segment_start_time,shortcut_trajectory.points[0].positions[0]);
+    ROS_DEBUG("End time  : %f, %f",segment_end_time,shortcut_trajectory.points[1].positions[0]);
+    shortcut_trajectory.points[0].time_from_start = ros::Duration(0.0);
+    shortcut_trajectory.points[1].time_from_start = ros::Duration(0.0);
+
+    if(!trajectory_solver.parameterize(shortcut_trajectory,limits,shortcut_spline))
+      continue;
+    double check_discretization = use_adaptive_check ? discretization_*ADAPTIVE_COARSENING_FACTOR
+                                                     : discretization_;
+    discretized_trajectory.joint_names = spline.names;
+    discretizeTrajectory(shortcut_spline,check_discretization,discretized_trajectory);
+    ROS_DEBUG("Succeeded in sampling trajectory with size: %d",(int)discretized_trajectory.points.size());
+
+    if(use_adaptive_check)
+    {
+      //coarse samples along the shortcut, with the clearance-adaptive
+      //segment check covering the motion between them
+      bool segment_valid = !discretized_trajectory.points.empty();
+      planning_models::KinematicState* prev = &state;
+      planning_models::KinematicState* cur = &segment_state;
+      std::map<std::string, double> joint_value_map;
+      if(segment_valid)
+      {
+        for(unsigned int j=0; j < spline.names.size(); j++)
+          joint_value_map[spline.names[j]] = discretized_trajectory.points[0].positions[j];
+        prev->setKinematicState(joint_value_map);
+        segment_valid = prev->areJointsWithinBounds(spline.names);
+      }
+      for(unsigned int k=1; k < discretized_trajectory.points.size() && segment_valid; k++)
+      {
+        for(unsigned int j=0; j < spline.names.size(); j++)
+          joint_value_map[spline.names[j]] = discretized_trajectory.points[k].positions[j];
+        cur->setKinematicState(joint_value_map);
+        if(!cur->areJointsWithinBounds(spline.names) ||
+           collision_models_interface_->isKinematicSegmentInCollision(*prev,*cur))
+          segment_valid = false;
+        std::swap(prev,cur);
+      }
+      if(!segment_valid)
+      {
+        ROS_DEBUG("Traj segment rejected by adaptive check");
+        continue;
+      }
+    }
+    else
+    {
+      arm_navigation_msgs::ArmNavigationErrorCodes error_code;
+      std::vector<arm_navigation_msgs::ArmNavigationErrorCodes> trajectory_error_codes;
+      if(!collision_models_interface_->isJointTrajectoryValid(state,
+                                                              discretized_trajectory,
+                                                              empty_goal_constraints,
+                                                              path_constraints,
+                                                              error_code,
+                                                              trajectory_error_codes,
+                                                              false))
+      {
+        ROS_DEBUG("Traj segment rejected with error code: %d",error_code.val);
+        continue;
+      }
+    }
+    ros::Duration shortcut_duration = discretized_trajectory.points.back().time_from_start - discretized_trajectory.points.front().time_from_start;
+    if(segment_end_time-segment_start_time <= shortcut_duration.toSec())
+      continue;
+
+    ShortcutCandidate candidate;
+    candidate.segment_start_time = segment_start_time;
+    candidate.segment_end_time = segment_end_time;
+    candidate.shortcut_duration = shortcut_duration;
+    candidate.start_point = shortcut_trajectory.points[0];
+    candidate.end_point = shortcut_trajectory.points[1];
+    accepted.push_back(candidate);
+  }
+}
+
+template <typename T>
+bool CubicSplineShortCutter<T>::reparameterizeChangedSegments(const trajectory_msgs::JointTrajectory &trajectory,
+                                                              const std::vector<arm_navigation_msgs::JointLimits> &limits,
+                                                              const trajectory_msgs::JointTrajectory &previous_trajectory,
+                                                              spline_smoother::SplineTrajectory &spline) const
+{
+  int num_points = (int)trajectory.points.size();
+  if(num_points < 2)
+    return false;
+
+  spline_smoother::SplineTrajectory updated;
+  updated.names = trajectory.joint_names;
+  updated.segments.resize(num_points-1);
+
+  spline_smoother::CubicTrajectory trajectory_solver;
+  spline_smoother::SplineTrajectory segment_spline;
+  trajectory_msgs::JointTrajectory segment_trajectory;
+  segment_trajectory.joint_names = trajectory.joint_names;
+  segment_trajectory.points.resize(2);
+
+  //surviving waypoints keep their relative order, so one forward pointer
+  //into the previous trajectory is enough to line the two up
+  int old_index = 0;
+  int num_old_segments = (int)spline.segments.size();
+  for(int i=0; i < num_points-1; i++)
+  {
+    const trajectory_msgs::JointTrajectoryPoint &start = trajectory.points[i];
+    const trajectory_msgs::JointTrajectoryPoint &end = trajectory.points[i+1];
+    double segment_duration = (end.time_from_start - start.time_from_start).toSec();
+
+    bool start_matches = old_index < num_old_segments && pointsMatch(previous_trajectory.points[old_index],start);
+    if(start_matches &&
+       pointsMatch(previous_trajectory.points[old_index+1],end) &&
+       fabs((previous_trajectory.points[old_index+1].time_from_start -
+             previous_trajectory.points[old_index].time_from_start).toSec() - segment_duration) < 1e-6)
+    {
+      updated.segments[i] = spline.segments[old_index];
+      old_index++;
+      continue;
+    }
+
+    //a spliced segment: solve it on its own
+    segment_trajectory.points[0] = start;
+    segment_trajectory.points[1] = end;
+    segment_trajectory.points[0].time_from_start = ros::Duration(0.0);
+    segment_trajectory.points[1].time_from_start = end.time_from_start - start.time_from_start;
+    if(!trajectory_solver.parameterize(segment_trajectory,limits,segment_spline))
+      return false;
+    updated.segments[i] = segment_spline.segments[0];
+
+    //skip past the waypoints the shortcut removed; if the segment end is an
+    //inserted point there is nothing to line up with yet
+    for(int j = old_index + (start_matches ? 1 : 0); j <= num_old_segments; j++)
+    {
+      if(pointsMatch(previous_trajectory.points[j],end))
+      {
+        old_index = j;
+        break;
+      }
+    }
+  }
+
+  spline.segments.swap(updated.segments);
+  spline.names.swap(updated.names);
+  return true;
+}
+
 template <typename T>
 void CubicSplineShortCutter<T>::refineTrajectory(T &trajectory) const
 {
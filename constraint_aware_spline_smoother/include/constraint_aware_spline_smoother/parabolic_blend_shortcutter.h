@@ -58,6 +58,7 @@ using namespace ParabolicRamp;
 namespace constraint_aware_spline_smoother
 {
 static const double MIN_DELTA = 0.01;
+static const int SHORTCUT_ITERATIONS_PER_DEADLINE_CHECK = 10;
 static const double DEFAULT_VEL_MAX = 1000.0;
 static const double DEFAULT_ACC_MAX = 1000.0;
 static const double DEFAULT_POS_MAX = 1000.0;
@@ -76,6 +77,10 @@ public:
   void resetRequest();
   bool isActive();
   void initialize();
+  /** \brief Sets the wall-clock time after which feasibility queries fail
+      immediately, so a single shortcut candidate can never hold the filter
+      past its budget.  A zero time disables the deadline. */
+  void setDeadline(const ros::Time &deadline);
 private:
   std::vector<std::string> joint_names_;
   bool active_;
@@ -83,9 +88,11 @@ private:
   ros::NodeHandle node_handle_;
   bool setupCollisionEnvironment();
   planning_environment::CollisionModelsInterface *collision_models_interface_;
-  void discretizeTrajectory(const trajectory_msgs::JointTrajectory &trajectory, 
+  void discretizeTrajectory(const trajectory_msgs::JointTrajectory &trajectory,
                             trajectory_msgs::JointTrajectory &trajectory_out);
+  bool hasPathConstraints() const;
   arm_navigation_msgs::Constraints path_constraints_;
+  ros::Time deadline_;
 };
 
 FeasibilityChecker::FeasibilityChecker() : FeasibilityCheckerBase(), node_handle_("~")
@@ -142,6 +149,11 @@ void FeasibilityChecker::resetRequest()
 {
 }
 
+void FeasibilityChecker::setDeadline(const ros::Time &deadline)
+{
+  deadline_ = deadline;
+}
+
 bool FeasibilityChecker::setupCollisionEnvironment()
 {
   bool use_collision_map;
@@ -187,6 +199,11 @@ void FeasibilityChecker::discretizeTrajectory(const trajectory_msgs::JointTrajec
 
 bool FeasibilityChecker::ConfigFeasible(const Vector& x)
 {
+  //past the deadline candidates are simply rejected, leaving the best
+  //trajectory found so far untouched
+  if(!deadline_.isZero() && ros::Time::now() >= deadline_)
+    return false;
+
   arm_navigation_msgs::ArmNavigationErrorCodes error_code;
   std::vector<arm_navigation_msgs::ArmNavigationErrorCodes> trajectory_error_codes;
 
@@ -207,11 +224,41 @@ bool FeasibilityChecker::ConfigFeasible(const Vector& x)
                                                              false));
 }
 
+bool FeasibilityChecker::hasPathConstraints() const
+{
+  return !path_constraints_.joint_constraints.empty() ||
+         !path_constraints_.position_constraints.empty() ||
+         !path_constraints_.orientation_constraints.empty() ||
+         !path_constraints_.visibility_constraints.empty();
+}
+
 bool FeasibilityChecker::SegmentFeasible(const Vector& a,const Vector& b)
 {
+  if(!deadline_.isZero() && ros::Time::now() >= deadline_)
+    return false;
+
+  if(!hasPathConstraints())
+  {
+    //no per-point constraints to evaluate, so the segment can be checked
+    //with the clearance-adaptive motion check: it refines only where the
+    //distance queries report low clearance, and segments in open space
+    //are accepted after a handful of checks instead of a fixed-resolution
+    //sweep
+    planning_models::KinematicState from(*collision_models_interface_->getPlanningSceneState());
+    planning_models::KinematicState to(*collision_models_interface_->getPlanningSceneState());
+    std::map<std::string, double> joint_value_map;
+    for(unsigned int i=0; i < joint_names_.size(); i++)
+      joint_value_map[joint_names_[i]] = a[i];
+    from.setKinematicState(joint_value_map);
+    for(unsigned int i=0; i < joint_names_.size(); i++)
+      joint_value_map[joint_names_[i]] = b[i];
+    to.setKinematicState(joint_value_map);
+    return !collision_models_interface_->isKinematicSegmentInCollision(from,to);
+  }
+
   arm_navigation_msgs::ArmNavigationErrorCodes error_code;
   std::vector<arm_navigation_msgs::ArmNavigationErrorCodes> trajectory_error_codes;
- 
+
   trajectory_msgs::JointTrajectory joint_traj_in, joint_traj;
   joint_traj_in.joint_names = joint_names_;
   joint_traj.header.stamp = ros::Time::now();
@@ -297,10 +344,16 @@ bool ParabolicBlendShortCutter<T>::smooth(const T& trajectory_in,
     return false;
   }
   
+  ros::Time start_time = ros::Time::now();
+  ros::Time deadline;
+  if(trajectory_in.request.allowed_time > ros::Duration(0.0))
+    deadline = start_time + trajectory_in.request.allowed_time;
+
   feasibility_checker_->setInitial(trajectory_in.request.trajectory,
                                    trajectory_in.request.group_name,
                                    trajectory_in.request.start_state,
                                    trajectory_in.request.path_constraints);
+  feasibility_checker_->setDeadline(deadline);
   std::vector<Vector> path;        //the sequence of milestones
   Vector vmax,amax;           //velocity and acceleration bounds, respectively
   Vector pmin,pmax;           //joint position bounds
@@ -358,7 +411,24 @@ bool ParabolicBlendShortCutter<T>::smooth(const T& trajectory_in,
   traj.SetMilestones(path);   //now the trajectory starts and stops at every milestone
   ROS_DEBUG("Initial path duration: %g\n",(double)traj.GetTotalTime());
   RampFeasibilityChecker check(feasibility_checker_.get(),tol);
-  int res=traj.Shortcut(num_iterations_,check);
+  //run the shortcut iterations in small batches so the allowed_time budget
+  //is enforced between them; the path only ever improves, so stopping at
+  //the deadline returns the best trajectory found so far
+  int res=0;
+  for(int iterations_done=0; iterations_done < num_iterations_;
+      iterations_done += SHORTCUT_ITERATIONS_PER_DEADLINE_CHECK)
+  {
+    if(!deadline.isZero() && ros::Time::now() >= deadline)
+    {
+      ROS_DEBUG("Shortcutting stopped after %d of %d iterations: allowed_time exhausted",
+                iterations_done,num_iterations_);
+      break;
+    }
+    int batch = num_iterations_-iterations_done;
+    if(batch > SHORTCUT_ITERATIONS_PER_DEADLINE_CHECK)
+      batch = SHORTCUT_ITERATIONS_PER_DEADLINE_CHECK;
+    res += traj.Shortcut(batch,check);
+  }
   ROS_DEBUG("After shortcutting: duration %g\n",(double)traj.GetTotalTime());
   unsigned int num_points = (unsigned int)(traj.GetTotalTime()/discretization_+0.5) + 1;
   double totalTime = (double) traj.GetTotalTime();
@@ -70,7 +70,8 @@ inline Real MaxBBLInfDistance(const Vector& x,const Vector& bmin,const Vector& b
 }
 
 inline bool SolveMinTime(const Vector& x0,const Vector& dx0,const Vector& x1,const Vector& dx1,
-		  const Vector& accMax,const Vector& velMax,const Vector& xMin,const Vector& xMax,DynamicPath& out)
+		  const Vector& accMax,const Vector& velMax,const Vector& xMin,const Vector& xMax,DynamicPath& out,
+		  vector<std::vector<ParabolicRamp1D> >& workRamps)
 {
   if(xMin.empty()) {
     out.ramps.resize(1);
@@ -83,17 +84,45 @@ inline bool SolveMinTime(const Vector& x0,const Vector& dx0,const Vector& x1,con
     if(!res) return false;
   }
   else {
-    vector<std::vector<ParabolicRamp1D> > ramps;
     Real res=SolveMinTimeBounded(x0,dx0,x1,dx1,
 				 accMax,velMax,xMin,xMax,
-				 ramps);
+				 workRamps);
     if(res < 0) return false;
-    CombineRamps(ramps,out.ramps);
+    CombineRamps(workRamps,out.ramps);
   }
   PARABOLIC_RAMP_ASSERT(out.IsValid());
   return true;
 }
 
+//Swaps the contents of two N-d ramps without copying their vectors.
+inline void SwapRamps(ParabolicRampND& a,ParabolicRampND& b)
+{
+  a.x0.swap(b.x0);
+  a.dx0.swap(b.dx0);
+  a.x1.swap(b.x1);
+  a.dx1.swap(b.dx1);
+  a.ramps.swap(b.ramps);
+  std::swap(a.endTime,b.endTime);
+}
+
+//Replaces the ramps in [start,end) of path with the contents of segment.
+//The range is adjusted with a single erase/insert and the new ramps are
+//swapped into place rather than copied, so the vectors inside segment's
+//ramps get recycled.  segment is left holding the displaced contents and
+//can be reused for the next candidate.
+inline void SpliceRamps(std::vector<ParabolicRampND>& path,int start,int end,
+			std::vector<ParabolicRampND>& segment)
+{
+  int count=(int)segment.size();
+  int gap=end-start;
+  if(count < gap)
+    path.erase(path.begin()+start+count,path.begin()+end);
+  else if(count > gap)
+    path.insert(path.begin()+end,count-gap,ParabolicRampND());
+  for(int i=0;i<count;i++)
+    SwapRamps(path[start+i],segment[i]);
+}
+
 DynamicPath::DynamicPath()
 {}
 
@@ -627,12 +656,10 @@ bool DynamicPath::TryShortcut(Real t1,Real t2,RampFeasibilityChecker& check)
   ramps[i2].TrimFront(u2);
   ramps[i2].x0 = intermediate.ramps.back().x1;
   ramps[i2].dx0 = intermediate.ramps.back().dx1;
-  
+
   //replace intermediate ramps with test
-  for(int i=0;i<i2-i1-1;i++)
-    ramps.erase(ramps.begin()+i1+1);
-  ramps.insert(ramps.begin()+i1+1,intermediate.ramps.begin(),intermediate.ramps.end());
-  
+  SpliceRamps(ramps,i1+1,i2,intermediate.ramps);
+
   //check for consistency
   for(size_t i=0;i+1<ramps.size();i++) {
     PARABOLIC_RAMP_ASSERT(ramps[i].x1 == ramps[i+1].x0);
@@ -656,7 +683,10 @@ int DynamicPath::Shortcut(int numIters,RampFeasibilityChecker& check,RandomNumbe
     rampStartTime[i] = endTime;
     endTime += ramps[i].endTime;
   }
+  //workspace vectors reused across iterations; after the first candidate
+  //their storage is recycled instead of reallocated
   Vector x0,x1,dx0,dx1;
+  vector<std::vector<ParabolicRamp1D> > workRamps;
   DynamicPath intermediate;
   intermediate.Init(velMax,accMax);
   intermediate.SetJointLimits(xMin,xMax);
@@ -678,7 +708,7 @@ int DynamicPath::Shortcut(int numIters,RampFeasibilityChecker& check,RandomNumbe
     ramps[i2].Evaluate(u2,x1);
     ramps[i1].Derivative(u1,dx0);
     ramps[i2].Derivative(u2,dx1);
-    bool res=SolveMinTime(x0,dx0,x1,dx1,accMax,velMax,xMin,xMax,intermediate);
+    bool res=SolveMinTime(x0,dx0,x1,dx1,accMax,velMax,xMin,xMax,intermediate,workRamps);
     if(!res) continue;
     bool feas=true;
     for(size_t i=0;i<intermediate.ramps.size();i++)
@@ -695,18 +725,16 @@ int DynamicPath::Shortcut(int numIters,RampFeasibilityChecker& check,RandomNumbe
     ramps[i2].TrimFront(u2);
     ramps[i2].x0 = intermediate.ramps.back().x1;
     ramps[i2].dx0 = intermediate.ramps.back().dx1;
-    
-    //replace intermediate ramps 
-    for(int i=0;i<i2-i1-1;i++)
-      ramps.erase(ramps.begin()+i1+1);
-    ramps.insert(ramps.begin()+i1+1,intermediate.ramps.begin(),intermediate.ramps.end());
+
+    //replace intermediate ramps
+    SpliceRamps(ramps,i1+1,i2,intermediate.ramps);
 
     //check for consistency
     for(size_t i=0;i+1<ramps.size();i++) {
       PARABOLIC_RAMP_ASSERT(ramps[i].x1 == ramps[i+1].x0);
       PARABOLIC_RAMP_ASSERT(ramps[i].dx1 == ramps[i+1].dx0);
     }
-    
+
     //revise the timing
     rampStartTime.resize(ramps.size());
     endTime=0;
@@ -721,9 +749,10 @@ int DynamicPath::Shortcut(int numIters,RampFeasibilityChecker& check,RandomNumbe
 int DynamicPath::ShortCircuit(RampFeasibilityChecker& check)
 {
   int shortcuts=0;
+  vector<std::vector<ParabolicRamp1D> > workRamps;
   DynamicPath intermediate;
   for(int i=0;i+1<(int)ramps.size();i++) {
-    bool res=SolveMinTime(ramps[i].x0,ramps[i].dx0,ramps[i].x1,ramps[i].dx1,accMax,velMax,xMin,xMax,intermediate);
+    bool res=SolveMinTime(ramps[i].x0,ramps[i].dx0,ramps[i].x1,ramps[i].dx1,accMax,velMax,xMin,xMax,intermediate,workRamps);
     if(!res) continue;
     bool feas=true;
     for(size_t j=0;j<intermediate.ramps.size();j++)
@@ -733,8 +762,7 @@ int DynamicPath::ShortCircuit(RampFeasibilityChecker& check)
       }
     if(!feas) continue;
 
-    ramps.erase(ramps.begin()+i+1);
-    ramps.insert(ramps.begin()+i+1,intermediate.ramps.begin(),intermediate.ramps.end());
+    SpliceRamps(ramps,i+1,i+2,intermediate.ramps);
     i += (int)intermediate.ramps.size()-2;
     shortcuts++;
   }
@@ -759,6 +787,7 @@ int DynamicPath::OnlineShortcut(Real leadTime,Real padTime,RampFeasibilityChecke
     endTime += ramps[i].endTime;
   }
   Vector x0,x1,dx0,dx1;
+  vector<std::vector<ParabolicRamp1D> > workRamps;
   DynamicPath intermediate;
   while(1) {
     //can only start from here
@@ -783,7 +812,7 @@ int DynamicPath::OnlineShortcut(Real leadTime,Real padTime,RampFeasibilityChecke
     ramps[i2].Evaluate(u2,x1);
     ramps[i1].Derivative(u1,dx0);
     ramps[i2].Derivative(u2,dx1);
-    bool res=SolveMinTime(x0,dx0,x1,dx1,accMax,velMax,xMin,xMax,intermediate);
+    bool res=SolveMinTime(x0,dx0,x1,dx1,accMax,velMax,xMin,xMax,intermediate,workRamps);
     if(!res) continue;
     bool feas=true;
     for(size_t i=0;i<intermediate.ramps.size();i++)
@@ -793,8 +822,8 @@ int DynamicPath::OnlineShortcut(Real leadTime,Real padTime,RampFeasibilityChecke
       }
     if(!feas) continue;
     //check for time elapse, otherwise can't perform this shortcut
-    if(timer.ElapsedTime()-leadTime > t1) continue; 
-    
+    if(timer.ElapsedTime()-leadTime > t1) continue;
+
     shortcuts++;
     //crop i1 and i2
     ramps[i1].TrimBack(ramps[i1].endTime-u1);
@@ -806,10 +835,8 @@ int DynamicPath::OnlineShortcut(Real leadTime,Real padTime,RampFeasibilityChecke
     PARABOLIC_RAMP_ASSERT(ramps[i1].IsValid());
     PARABOLIC_RAMP_ASSERT(ramps[i2].IsValid());
 
-    //replace intermediate ramps 
-    for(int i=0;i<i2-i1-1;i++)
-      ramps.erase(ramps.begin()+i1+1);
-    ramps.insert(ramps.begin()+i1+1,intermediate.ramps.begin(),intermediate.ramps.end());
+    //replace intermediate ramps
+    SpliceRamps(ramps,i1+1,i2,intermediate.ramps);
 
     //check for consistency
     for(size_t i=0;i+1<ramps.size();i++) {
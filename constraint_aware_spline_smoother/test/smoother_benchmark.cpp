@@ -0,0 +1,255 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2011, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/**
+ * Replays recorded planner outputs through a set of trajectory filter
+ * configurations and reports runtime, resulting path duration, jerk
+ * metrics and collision check counts for each, so per-task filter chains
+ * can be chosen from data rather than folklore.
+ *
+ * Parameters:
+ *   ~bag_file   bag holding recorded
+ *               arm_navigation_msgs/FilterJointTrajectoryWithConstraints
+ *               service requests (e.g. recorded at the filter server)
+ *   ~bag_topic  topic the requests were recorded on
+ *               (default "filter_requests")
+ *   ~chains     list of parameter namespaces, each configured exactly
+ *               like a trajectory_filter_server filter_chain
+ *
+ * A planning scene must be available for the collision-aware filters,
+ * exactly as when running the trajectory filter server.
+ */
+
+#include <ros/ros.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <filters/filter_chain.h>
+#include <arm_navigation_msgs/FilterJointTrajectoryWithConstraints.h>
+#include <planning_environment/models/collision_models.h>
+#include <boost/foreach.hpp>
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <string>
+
+namespace
+{
+
+struct ChainStats
+{
+  std::string name;
+  unsigned int attempts;
+  unsigned int successes;
+  double total_runtime;
+  double total_duration;
+  double total_rms_jerk;
+  double max_jerk;
+  unsigned long total_collision_checks;
+
+  ChainStats() : attempts(0), successes(0), total_runtime(0.0),
+                 total_duration(0.0), total_rms_jerk(0.0), max_jerk(0.0),
+                 total_collision_checks(0)
+  {
+  }
+};
+
+double pathDuration(const trajectory_msgs::JointTrajectory& trajectory)
+{
+  if(trajectory.points.empty())
+    return 0.0;
+  return trajectory.points.back().time_from_start.toSec();
+}
+
+/** Finite-differences the positions three times so the metric works
+    whether or not the filter filled in velocities and accelerations. */
+void jerkMetrics(const trajectory_msgs::JointTrajectory& trajectory,
+                 double& rms_jerk,
+                 double& max_jerk)
+{
+  rms_jerk = 0.0;
+  max_jerk = 0.0;
+  size_t num_points = trajectory.points.size();
+  if(num_points < 4)
+    return;
+  size_t num_joints = trajectory.points[0].positions.size();
+
+  double sum_sq = 0.0;
+  unsigned int samples = 0;
+  for(size_t j = 0; j < num_joints; j++)
+  {
+    for(size_t i = 0; i + 3 < num_points; i++)
+    {
+      double t0 = trajectory.points[i].time_from_start.toSec();
+      double t1 = trajectory.points[i+1].time_from_start.toSec();
+      double t2 = trajectory.points[i+2].time_from_start.toSec();
+      double t3 = trajectory.points[i+3].time_from_start.toSec();
+      double dt01 = t1-t0, dt12 = t2-t1, dt23 = t3-t2;
+      if(dt01 <= 0.0 || dt12 <= 0.0 || dt23 <= 0.0)
+        continue;
+      double v0 = (trajectory.points[i+1].positions[j]-trajectory.points[i].positions[j])/dt01;
+      double v1 = (trajectory.points[i+2].positions[j]-trajectory.points[i+1].positions[j])/dt12;
+      double v2 = (trajectory.points[i+3].positions[j]-trajectory.points[i+2].positions[j])/dt23;
+      double a0 = (v1-v0)/(0.5*(dt01+dt12));
+      double a1 = (v2-v1)/(0.5*(dt12+dt23));
+      double jerk = (a1-a0)/(0.5*(dt01+dt12+dt12+dt23)*0.5);
+      sum_sq += jerk*jerk;
+      samples++;
+      if(fabs(jerk) > max_jerk)
+        max_jerk = fabs(jerk);
+    }
+  }
+  if(samples > 0)
+    rms_jerk = sqrt(sum_sq/samples);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "smoother_benchmark");
+  ros::AsyncSpinner spinner(1);
+  spinner.start();
+
+  ros::NodeHandle private_handle("~");
+
+  std::string bag_file, bag_topic;
+  if(!private_handle.getParam("bag_file", bag_file))
+  {
+    ROS_ERROR("smoother_benchmark requires the ~bag_file parameter");
+    return 1;
+  }
+  private_handle.param<std::string>("bag_topic", bag_topic, "filter_requests");
+
+  XmlRpc::XmlRpcValue chain_list;
+  if(!private_handle.getParam("chains", chain_list) ||
+     chain_list.getType() != XmlRpc::XmlRpcValue::TypeArray ||
+     chain_list.size() == 0)
+  {
+    ROS_ERROR("smoother_benchmark requires ~chains, a list of filter chain namespaces");
+    return 1;
+  }
+
+  //load the recorded requests up front so replay timing only measures the
+  //filters themselves
+  std::vector<arm_navigation_msgs::FilterJointTrajectoryWithConstraints::Request> requests;
+  rosbag::Bag bag;
+  bag.open(bag_file, rosbag::bagmode::Read);
+  rosbag::View view(bag, rosbag::TopicQuery(bag_topic));
+  BOOST_FOREACH(rosbag::MessageInstance const m, view)
+  {
+    arm_navigation_msgs::FilterJointTrajectoryWithConstraints::Request::Ptr req =
+      m.instantiate<arm_navigation_msgs::FilterJointTrajectoryWithConstraints::Request>();
+    if(req)
+      requests.push_back(*req);
+  }
+  bag.close();
+  if(requests.empty())
+  {
+    ROS_ERROR("No requests found in %s on topic %s", bag_file.c_str(), bag_topic.c_str());
+    return 1;
+  }
+  ROS_INFO("Replaying %d recorded requests through %d filter configurations",
+           (int)requests.size(), (int)chain_list.size());
+
+  std::vector<ChainStats> stats;
+  for(int c = 0; c < chain_list.size(); c++)
+  {
+    std::string chain_name = static_cast<std::string>(chain_list[c]);
+    filters::FilterChain<arm_navigation_msgs::FilterJointTrajectoryWithConstraints>
+      chain("arm_navigation_msgs::FilterJointTrajectoryWithConstraints");
+    if(!chain.configure(chain_name, private_handle))
+    {
+      ROS_ERROR("Could not configure filter chain '%s', skipping it", chain_name.c_str());
+      continue;
+    }
+
+    ChainStats chain_stats;
+    chain_stats.name = chain_name;
+    for(size_t r = 0; r < requests.size(); r++)
+    {
+      arm_navigation_msgs::FilterJointTrajectoryWithConstraints chain_input, chain_output;
+      chain_input.request = requests[r];
+
+      planning_environment::CollisionModels::resetCollisionCheckCount();
+      ros::WallTime before = ros::WallTime::now();
+      bool ok = chain.update(chain_input, chain_output);
+      double runtime = (ros::WallTime::now()-before).toSec();
+      unsigned long collision_checks = planning_environment::CollisionModels::getCollisionCheckCount();
+
+      chain_stats.attempts++;
+      chain_stats.total_runtime += runtime;
+      chain_stats.total_collision_checks += collision_checks;
+      if(ok)
+      {
+        double rms_jerk, max_jerk;
+        jerkMetrics(chain_output.request.trajectory, rms_jerk, max_jerk);
+        chain_stats.successes++;
+        chain_stats.total_duration += pathDuration(chain_output.request.trajectory);
+        chain_stats.total_rms_jerk += rms_jerk;
+        if(max_jerk > chain_stats.max_jerk)
+          chain_stats.max_jerk = max_jerk;
+        ROS_INFO("%s request %d: %.3fs runtime, %.3fs path, rms jerk %.3f, %lu collision checks",
+                 chain_name.c_str(), (int)r, runtime,
+                 pathDuration(chain_output.request.trajectory), rms_jerk, collision_checks);
+      }
+      else
+      {
+        ROS_WARN("%s request %d: failed after %.3fs and %lu collision checks",
+                 chain_name.c_str(), (int)r, runtime, collision_checks);
+      }
+    }
+    stats.push_back(chain_stats);
+  }
+
+  //summary table - mean runtime against mean path duration and jerk is the
+  //quality/latency frontier the per-task chains get picked from
+  printf("\n%-30s %8s %10s %10s %10s %10s %12s\n",
+         "chain", "ok", "runtime[s]", "path[s]", "rms jerk", "max jerk", "coll checks");
+  for(size_t i = 0; i < stats.size(); i++)
+  {
+    const ChainStats& s = stats[i];
+    double n = s.attempts > 0 ? (double)s.attempts : 1.0;
+    double ns = s.successes > 0 ? (double)s.successes : 1.0;
+    printf("%-30s %4u/%-4u %10.3f %10.3f %10.3f %10.3f %12.1f\n",
+           s.name.c_str(), s.successes, s.attempts,
+           s.total_runtime/n,
+           s.total_duration/ns,
+           s.total_rms_jerk/ns,
+           s.max_jerk,
+           s.total_collision_checks/n);
+  }
+
+  ros::shutdown();
+  return 0;
+}
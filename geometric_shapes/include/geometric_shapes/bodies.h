@@ -112,8 +112,10 @@ struct BoundingCylinder
         method sets the padding. Default is 0.0 */
     void setPadding(double padd)
     {
+      if (m_padding == padd)
+        return;
       m_padding = padd;
-      updateInternalData();
+      paddingUpdated();
     }
 	
     /** \brief Retrieve the current padding */
@@ -155,8 +157,27 @@ struct BoundingCylinder
     virtual bool intersectsRay(const tf::Vector3& origin, const tf::Vector3 &dir, std::vector<tf::Vector3> *intersections = NULL, unsigned int count = 0) const = 0;
 	
     /** \brief Check is a point is inside the body */
-    virtual bool containsPoint(const tf::Vector3 &p, bool verbose = false) const = 0;	
-	
+    virtual bool containsPoint(const tf::Vector3 &p, bool verbose = false) const = 0;
+
+    /** \brief Single-precision point containment. Bodies keep float
+        mirrors of their transformed parameters, refreshed in
+        updateInternalData(); float precision is ample for
+        containment masks and halves the cache footprint of bulk
+        queries. The default implementation falls back to the double
+        precision test. */
+    virtual bool containsPointFloat(float x, float y, float z) const
+    {
+      return containsPoint(tf::Vector3(tfScalar(x), tfScalar(y), tfScalar(z)));
+    }
+
+    /** \brief Bulk single-precision containment test: points holds n
+        xyz triples; inside gets one entry per point and is only
+        grown, so a reused buffer makes the call allocation-free.
+        The default tests point by point; cylinders and boxes
+        override it with a packed kernel, so callers with many points
+        against one body pay one virtual dispatch total */
+    virtual void containsPoints(const float *points, unsigned int n, std::vector<bool> &inside) const;
+
     /** \brief Compute the volume of the body. This method includes
         changes induced by scaling and padding */
     virtual double computeVolume(void) const = 0;
@@ -173,6 +194,15 @@ struct BoundingCylinder
 	
     virtual void updateInternalData(void) = 0;
     virtual void useDimensions(const shapes::Shape *shape) = 0;
+
+    /** \brief Called when only the padding changed. The default
+        recomputes everything; bodies with expensive internal data
+        can override this to update just the padding-derived
+        values. */
+    virtual void paddingUpdated(void)
+    {
+      updateInternalData();
+    }
 	
     shapes::ShapeType m_type;
     tf::Transform       m_pose;	
@@ -200,20 +230,26 @@ public:
   }
 	
   virtual bool containsPoint(const tf::Vector3 &p, bool verbose = false) const;
+  virtual bool containsPointFloat(float x, float y, float z) const;
   virtual double computeVolume(void) const;
   virtual void computeBoundingSphere(BoundingSphere &sphere) const;
   virtual void computeBoundingCylinder(BoundingCylinder &cylinder) const;
   virtual bool intersectsRay(const tf::Vector3& origin, const tf::Vector3 &dir, std::vector<tf::Vector3> *intersections = NULL, unsigned int count = 0) const;
 
 protected:
-	
+
   virtual void useDimensions(const shapes::Shape *shape);
   virtual void updateInternalData(void);
-	
+
   tf::Vector3 m_center;
-  double    m_radius;	
+  double    m_radius;
   double    m_radiusU;
-  double    m_radius2;		    
+  double    m_radius2;
+
+  // float mirror of the transformed parameters for the
+  // single-precision containment path
+  float     m_fcenter[3];
+  float     m_fradius2;
 };
 
 /** \brief Definition of a cylinder */
@@ -236,23 +272,25 @@ public:
   }
 	
   virtual bool containsPoint(const tf::Vector3 &p, bool verbose = false) const;
+  virtual bool containsPointFloat(float x, float y, float z) const;
+  virtual void containsPoints(const float *points, unsigned int n, std::vector<bool> &inside) const;
   virtual double computeVolume(void) const;
   virtual void computeBoundingSphere(BoundingSphere &sphere) const;
   virtual void computeBoundingCylinder(BoundingCylinder &cylinder) const;
   virtual bool intersectsRay(const tf::Vector3& origin, const tf::Vector3 &dir, std::vector<tf::Vector3> *intersections = NULL, unsigned int count = 0) const;
 
 protected:
-	
+
   virtual void useDimensions(const shapes::Shape *shape);
   virtual void updateInternalData(void);
-	
+
   tf::Vector3 m_center;
   tf::Vector3 m_normalH;
   tf::Vector3 m_normalB1;
   tf::Vector3 m_normalB2;
-	
+
   double    m_length;
-  double    m_length2;	
+  double    m_length2;
   double    m_radius;
   double    m_radiusU;
   double    m_radiusB;
@@ -260,6 +298,14 @@ protected:
   double    m_radius2;
   double    m_d1;
   double    m_d2;
+
+  // float mirrors for the single-precision containment path
+  float     m_fcenter[3];
+  float     m_fnormalH[3];
+  float     m_fnormalB1[3];
+  float     m_fnormalB2[3];
+  float     m_flength2;
+  float     m_fradius2;
 };
     
 /** \brief Definition of a box */
@@ -282,32 +328,43 @@ public:
   }
 	
   virtual bool containsPoint(const tf::Vector3 &p, bool verbose = false) const;
+  virtual bool containsPointFloat(float x, float y, float z) const;
+  virtual void containsPoints(const float *points, unsigned int n, std::vector<bool> &inside) const;
   virtual double computeVolume(void) const;
   virtual void computeBoundingSphere(BoundingSphere &sphere) const;
   virtual void computeBoundingCylinder(BoundingCylinder &cylinder) const;
   virtual bool intersectsRay(const tf::Vector3& origin, const tf::Vector3 &dir, std::vector<tf::Vector3> *intersections = NULL, unsigned int count = 0) const;
 
 protected:
-	
-  virtual void useDimensions(const shapes::Shape *shape); // (x, y, z) = (length, width, height)	    
+
+  virtual void useDimensions(const shapes::Shape *shape); // (x, y, z) = (length, width, height)
   virtual void updateInternalData(void);
-	
+
   tf::Vector3 m_center;
   tf::Vector3 m_normalL;
   tf::Vector3 m_normalW;
   tf::Vector3 m_normalH;
-	
+
   tf::Vector3 m_corner1;
   tf::Vector3 m_corner2;
 
   double    m_length;
   double    m_width;
-  double    m_height;	
+  double    m_height;
   double    m_length2;
   double    m_width2;
-  double    m_height2;	
+  double    m_height2;
   double    m_radiusB;
   double    m_radius2;
+
+  // float mirrors for the single-precision containment path
+  float     m_fcenter[3];
+  float     m_fnormalL[3];
+  float     m_fnormalW[3];
+  float     m_fnormalH[3];
+  float     m_flength2;
+  float     m_fwidth2;
+  float     m_fheight2;
 };
 
 /*
@@ -369,13 +426,15 @@ class ConvexMesh : public Body
 public:
 	
   ConvexMesh(void) : Body()
-  {	    
+  {
     m_type = shapes::MESH;
+    m_scaledVerticesDirty = false;
   }
-	
+
   ConvexMesh(const shapes::Shape *shape) : Body()
-  {	  
+  {
     m_type = shapes::MESH;
+    m_scaledVerticesDirty = false;
     setDimensions(shape);
   }
 	
@@ -384,8 +443,9 @@ public:
   }	
 
   virtual bool containsPoint(const tf::Vector3 &p, bool verbose = false) const;
+  virtual bool containsPointFloat(float x, float y, float z) const;
   virtual double computeVolume(void) const;
-	
+
   virtual void computeBoundingSphere(BoundingSphere &sphere) const;
   virtual void computeBoundingCylinder(BoundingCylinder &cylinder) const;
   virtual bool intersectsRay(const tf::Vector3& origin, const tf::Vector3 &dir, std::vector<tf::Vector3> *intersections = NULL, unsigned int count = 0) const;
@@ -399,6 +459,8 @@ public:
   }
 
   const std::vector<tf::Vector3>& getScaledVertices() const {
+    if (m_scaledVerticesDirty)
+      updateScaledVertices();
     return m_scaledVertices;
   }
 
@@ -406,14 +468,74 @@ protected:
 	
   virtual void useDimensions(const shapes::Shape *shape);
   virtual void updateInternalData(void);
-	
+
+  /** \brief A padding change only moves the padding-derived offsets -
+      the bounding volumes and the query-time plane threshold - so the
+      per-vertex rescale is deferred until the scaled vertices are
+      actually needed by a ray query */
+  virtual void paddingUpdated(void);
+
+  /** \brief Recompute the scaled (and padded) vertices from the hull
+      vertices */
+  void updateScaledVertices(void) const;
+
+  /** \brief Node of the static BVH over the hull triangles. Internal
+      nodes store the indices of their two children; leaves (left ==
+      -1) store a range in the reordered triangle index array. The
+      split structure is fixed at construction; the node bounds are
+      refit from the scaled vertices whenever those are recomputed. */
+  struct BVHNode
+  {
+    tf::Vector3 bmin;
+    tf::Vector3 bmax;
+    int left;
+    int right;
+    unsigned int start;
+    unsigned int count;
+  };
+
+  /** \brief Build the BVH structure over the hull triangles by
+      recursive median split of the triangle centroids */
+  void buildBVH(void);
+  int buildBVHNode(unsigned int start, unsigned int count, const std::vector<tf::Vector3>& centroids);
+
+  /** \brief Recompute the node bounds from the current scaled
+      vertices */
+  void refitBVH(void) const;
+
+  /** \brief Test one hull triangle against a ray given in the mesh
+      frame, returning the ray parameter of the hit */
+  bool intersectsTriangle(unsigned int index, const tf::Vector3& orig, const tf::Vector3& dr, double& t) const;
+
   unsigned int countVerticesBehindPlane(const tf::tfVector4& planeNormal) const;
   bool isPointInsidePlanes(const tf::Vector3& point) const;
-	
+
+  /** \brief Plane containment test for a point already transformed
+      into the (scaled) mesh frame, evaluated entirely in single
+      precision */
+  bool isPointInsidePlanesFloat(float x, float y, float z) const;
+
+  /** \brief Repack the plane equations into the padded
+      structure-of-arrays float layout used by the vectorized point
+      containment test */
+  void computePlanesSoA(void);
+
   std::vector<tf::tfVector4>    m_planes;
+
+  // plane equations as padded structure-of-arrays floats, four values
+  // per component per step, so point containment can evaluate four
+  // planes at a time; the pad planes can never reject a point
+  std::vector<float>          m_planesX;
+  std::vector<float>          m_planesY;
+  std::vector<float>          m_planesZ;
+  std::vector<float>          m_planesW;
   std::vector<tf::Vector3>    m_vertices;
-  std::vector<tf::Vector3>    m_scaledVertices;
+  mutable std::vector<tf::Vector3>    m_scaledVertices;
+  mutable bool                m_scaledVerticesDirty;
   std::vector<unsigned int> m_triangles;
+
+  mutable std::vector<BVHNode> m_bvhNodes;
+  std::vector<unsigned int>   m_bvhTriangles;
   tf::Transform               m_iPose;
 	
   tf::Vector3                 m_center;
@@ -425,6 +547,13 @@ protected:
   tf::Vector3                 m_boxOffset;
   Box                       m_boundingBox;
   BoundingCylinder          m_boundingCylinder;
+
+  // float mirrors of the inverse pose (basis rows then origin), mesh
+  // center and scale for the single-precision containment path
+  float                     m_fiBasis[9];
+  float                     m_fiOrigin[3];
+  float                     m_fmeshCenter[3];
+  float                     m_fscale;
 };
     
     
@@ -447,6 +576,12 @@ public:
 
   void addBody(const shapes::Shape* shape, const tf::Transform& pose, double padding = 0.0);
 
+  /** \brief Add a group of shapes sharing one pose and padding -
+      typically the pieces of a convex decomposition
+      (shapes::createConvexDecomposition) - so a concave part is
+      represented by several tight hulls instead of one loose one */
+  void addBodyGroup(const std::vector<shapes::Shape*>& shapes, const tf::Transform& pose, double padding = 0.0);
+
   void setPose(unsigned int i, const tf::Transform& pose);
 
   unsigned int getSize() const {
@@ -466,6 +601,28 @@ public:
   double getBoundingSphereRadiusSquared(unsigned int i) const;
   double getPaddedBoundingSphereRadiusSquared(unsigned int i) const;
 
+  /** \brief Check whether any body in the vector contains the
+      point. The packed bounding-sphere table is scanned first -
+      vectorized where available - so the per-body virtual
+      containsPoint() is only dispatched for bodies whose bounding
+      sphere the point is actually inside. When use_padding is true
+      the padded bodies are tested instead. */
+  bool containsPoint(const tf::Vector3 &p, bool use_padding = false) const;
+
+  /** \brief Test num_rays rays against every body in the vector,
+      filling the caller-owned hits buffer with one entry per ray -
+      true when the ray intersects any body. Bodies are tried
+      cheapest shape type first so most rays exit before reaching any
+      mesh, intersection points are never gathered, and the buffer is
+      only grown, so a reused buffer makes the call allocation-free.
+      When use_padding is true the padded bodies are tested
+      instead. */
+  void intersectsRayBatch(const tf::Vector3* origins,
+                          const tf::Vector3* dirs,
+                          unsigned int num_rays,
+                          std::vector<bool>& hits,
+                          bool use_padding = false) const;
+
 private:
 
   std::vector<Body*> bodies_;
@@ -474,6 +631,28 @@ private:
   std::vector<double> rsqrs_;
   std::vector<double> padded_rsqrs_;
 
+  /** \brief Body indices ordered by how cheap their ray test is -
+      primitives before meshes - so batched ray queries early-exit on
+      the inexpensive bodies first */
+  std::vector<unsigned int> ray_query_order_;
+
+  /** \brief Rebuild the packed bounding-sphere tables from the
+      current body poses */
+  void refreshPretestTable(void);
+
+  /** \brief Packed bounding spheres (center xyz and squared radius
+      as structure-of-arrays floats, padded to a multiple of four
+      with never-passing entries) scanned by point queries before any
+      virtual dispatch; refreshed whenever a body or pose changes */
+  std::vector<float> sphere_centers_x_;
+  std::vector<float> sphere_centers_y_;
+  std::vector<float> sphere_centers_z_;
+  std::vector<float> sphere_rsqrs_;
+  std::vector<float> padded_sphere_centers_x_;
+  std::vector<float> padded_sphere_centers_y_;
+  std::vector<float> padded_sphere_centers_z_;
+  std::vector<float> padded_sphere_rsqrs_;
+
 };
     
 }
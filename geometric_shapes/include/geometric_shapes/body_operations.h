@@ -46,7 +46,10 @@ namespace bodies {
 
 /**
    This function sets the mask for the transforms to false if they
-   are inside any body in any body vector, and otherwise sets them to true
+   are inside any body in any body vector, and otherwise sets them to
+   true. Each body vector is prefiltered with a merged bounding sphere
+   so a pose only tests bodies it could plausibly be inside of, and
+   large pose sets are masked in parallel across hardware threads.
  */
 
 void maskPosesInsideBodyVectors(const std::vector<tf::Transform>& poses,
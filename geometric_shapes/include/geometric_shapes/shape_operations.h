@@ -63,6 +63,16 @@ Mesh* createMeshFromVertices(const std::vector<tf::Vector3> &vertices, const std
     each triangle is also computed */
 Mesh* createMeshFromVertices(const std::vector<tf::Vector3> &source);
 
+/** \brief Decompose a mesh into approximately convex pieces by
+    growing patches of adjacent triangles; a triangle joins a patch
+    only while no vertex sticks out in front of the patch's
+    supporting planes by more than the given tolerance (in meters).
+    Intended as an offline step: each returned mesh is suitable for
+    single-hull approximation (e.g. bodies::ConvexMesh), yielding a
+    much tighter fit for concave parts than one hull over the whole
+    mesh. The caller owns the returned meshes */
+std::vector<Mesh*> createConvexDecomposition(const Mesh *mesh, double tolerance = 0.01);
+
 /** \brief Load a mesh from a file that contains a mesh that can be loaded by assimp */
 Mesh* createMeshFromFilename(const std::string& filename, const tf::Vector3* scale = NULL);
     
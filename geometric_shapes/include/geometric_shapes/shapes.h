@@ -158,6 +158,7 @@ namespace shapes
 	    triangleCount = 0;
 	    triangles = NULL;
 	    normals = NULL;
+	    shared_count_ = NULL;
 	}
 	
 	Mesh(unsigned int vCount, unsigned int tCount) : Shape()
@@ -168,10 +169,42 @@ namespace shapes
 	    triangleCount = tCount;
 	    triangles = new unsigned int[tCount * 3];
 	    normals = new double[tCount * 3];
+	    shared_count_ = NULL;
 	}
-	
+
+	/** \brief Construct a mesh that shares the (immutable) vertex,
+	    triangle and normal arrays of another mesh instead of
+	    copying them. The arrays are freed when the last mesh using
+	    them is destroyed. Meshes sharing storage must never modify
+	    it. */
+	Mesh(const Mesh *source) : Shape()
+	{
+	    type = MESH;
+	    vertexCount = source->vertexCount;
+	    vertices = source->vertices;
+	    triangleCount = source->triangleCount;
+	    triangles = source->triangles;
+	    normals = source->normals;
+	    if (!source->shared_count_)
+	    {
+		// gcc atomics so meshes can be shared across threads;
+		// only one thread gets to install the counter
+		unsigned int *count = new unsigned int(1);
+		if (!__sync_bool_compare_and_swap(&source->shared_count_, (unsigned int*)NULL, count))
+		    delete count;
+	    }
+	    shared_count_ = source->shared_count_;
+	    __sync_add_and_fetch(shared_count_, 1);
+	}
+
 	virtual ~Mesh(void)
 	{
+	    if (shared_count_)
+	    {
+		if (__sync_sub_and_fetch(shared_count_, 1) > 0)
+		    return;
+		delete shared_count_;
+	    }
 	    if (vertices)
 		delete[] vertices;
 	    if (triangles)
@@ -196,7 +229,13 @@ namespace shapes
 	
 	/** \brief The normal to each triangle; unit vector represented
 	    as (x,y,z); If missing from the mesh, these vectors are computed  */
-	double       *normals;       
+	double       *normals;
+
+    private:
+
+	/** \brief Number of meshes referencing the arrays above,
+	    counting this one; NULL while the storage is unshared */
+	mutable unsigned int *shared_count_;
     };
 
     /** \brief Definition of a plane with equation ax + by + cz + d = 0 */
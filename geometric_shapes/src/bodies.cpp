@@ -38,6 +38,17 @@
 
 #include <ros/console.h>
 
+#if defined __SSE2__
+#include <emmintrin.h>
+#endif
+#include <cfloat>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
 extern "C"
 {
 #ifdef GEOMETRIC_SHAPES_HAVE_QHULL_2011
@@ -65,6 +76,125 @@ extern "C"
 #include <iostream>
 #include <cmath>
 
+namespace
+{
+
+// the convex hull computation depends only on the mesh content, so
+// its result is cached per process, keyed by a hash of the vertices
+// and triangles; constructing another body over the same mesh copies
+// the hull instead of re-running qhull. Setting the
+// GEOMETRIC_SHAPES_HULL_CACHE environment variable to a writable
+// directory additionally persists the hulls across restarts.
+struct ConvexHullData
+{
+  std::vector<tf::tfVector4> planes;
+  std::vector<tf::Vector3>   vertices;
+  std::vector<unsigned int>  triangles;
+  tf::Vector3                meshCenter;
+  double                     radiusB;
+};
+
+static std::map<unsigned long long, boost::shared_ptr<ConvexHullData> > g_hull_cache;
+static boost::mutex g_hull_cache_lock;
+
+unsigned long long hashMeshContent(const shapes::Mesh *mesh)
+{
+  unsigned long long hash = 14695981039346656037ULL;
+  const unsigned char* vbytes = (const unsigned char*)mesh->vertices;
+  for (unsigned int i = 0 ; i < mesh->vertexCount * 3 * sizeof(double) ; ++i)
+    hash = (hash ^ vbytes[i]) * 1099511628211ULL;
+  const unsigned char* tbytes = (const unsigned char*)mesh->triangles;
+  for (unsigned int i = 0 ; i < mesh->triangleCount * 3 * sizeof(unsigned int) ; ++i)
+    hash = (hash ^ tbytes[i]) * 1099511628211ULL;
+  return hash;
+}
+
+std::string hullCacheFileName(unsigned long long key)
+{
+  const char* dir = getenv("GEOMETRIC_SHAPES_HULL_CACHE");
+  if (!dir || dir[0] == '\0')
+    return std::string();
+  std::stringstream ss;
+  ss << dir << "/hull_" << std::hex << key << ".bin";
+  return ss.str();
+}
+
+boost::shared_ptr<ConvexHullData> loadHullFromDisk(unsigned long long key)
+{
+  boost::shared_ptr<ConvexHullData> hd;
+  std::string path = hullCacheFileName(key);
+  if (path.empty())
+    return hd;
+  std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+  if (!in)
+    return hd;
+  unsigned int num_planes = 0, num_vertices = 0, num_triangles = 0;
+  in.read((char*)&num_planes, sizeof(num_planes));
+  in.read((char*)&num_vertices, sizeof(num_vertices));
+  in.read((char*)&num_triangles, sizeof(num_triangles));
+  if (!in || num_vertices == 0)
+    return hd;
+  hd.reset(new ConvexHullData());
+  double v[4];
+  for (unsigned int i = 0 ; i < num_planes ; ++i)
+  {
+    in.read((char*)v, 4 * sizeof(double));
+    hd->planes.push_back(tf::tfVector4(v[0], v[1], v[2], v[3]));
+  }
+  for (unsigned int i = 0 ; i < num_vertices ; ++i)
+  {
+    in.read((char*)v, 3 * sizeof(double));
+    hd->vertices.push_back(tf::Vector3(v[0], v[1], v[2]));
+  }
+  hd->triangles.resize(num_triangles);
+  if (num_triangles > 0)
+    in.read((char*)&hd->triangles[0], num_triangles * sizeof(unsigned int));
+  in.read((char*)v, 3 * sizeof(double));
+  hd->meshCenter.setValue(v[0], v[1], v[2]);
+  in.read((char*)&hd->radiusB, sizeof(double));
+  if (!in)
+    hd.reset();
+  return hd;
+}
+
+void saveHullToDisk(unsigned long long key, const ConvexHullData &hd)
+{
+  std::string path = hullCacheFileName(key);
+  if (path.empty())
+    return;
+  std::ofstream out(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!out)
+  {
+    ROS_WARN("Unable to write convex hull cache file %s", path.c_str());
+    return;
+  }
+  unsigned int num_planes = hd.planes.size();
+  unsigned int num_vertices = hd.vertices.size();
+  unsigned int num_triangles = hd.triangles.size();
+  out.write((const char*)&num_planes, sizeof(num_planes));
+  out.write((const char*)&num_vertices, sizeof(num_vertices));
+  out.write((const char*)&num_triangles, sizeof(num_triangles));
+  double v[4];
+  for (unsigned int i = 0 ; i < num_planes ; ++i)
+  {
+    v[0] = hd.planes[i].getX(); v[1] = hd.planes[i].getY();
+    v[2] = hd.planes[i].getZ(); v[3] = hd.planes[i].getW();
+    out.write((const char*)v, 4 * sizeof(double));
+  }
+  for (unsigned int i = 0 ; i < num_vertices ; ++i)
+  {
+    v[0] = hd.vertices[i].getX(); v[1] = hd.vertices[i].getY(); v[2] = hd.vertices[i].getZ();
+    out.write((const char*)v, 3 * sizeof(double));
+  }
+  if (num_triangles > 0)
+    out.write((const char*)&hd.triangles[0], num_triangles * sizeof(unsigned int));
+  v[0] = hd.meshCenter.getX(); v[1] = hd.meshCenter.getY(); v[2] = hd.meshCenter.getZ();
+  out.write((const char*)v, 3 * sizeof(double));
+  out.write((const char*)&hd.radiusB, sizeof(double));
+}
+
+}
+
 bodies::Body* bodies::createBodyFromShape(const shapes::Shape *shape)
 {
   Body *body = NULL;
@@ -159,11 +289,147 @@ struct interscOrder
 }
 }
 
-bool bodies::Sphere::containsPoint(const tf::Vector3 &p, bool verbose) const 
+void bodies::Body::containsPoints(const float *points, unsigned int n, std::vector<bool> &inside) const
+{
+  if (inside.size() < n)
+    inside.resize(n);
+  for (unsigned int i = 0 ; i < n ; ++i)
+    inside[i] = containsPointFloat(points[3 * i], points[3 * i + 1], points[3 * i + 2]);
+}
+
+#if defined __SSE2__
+namespace bodies
+{
+namespace detail
+{
+
+// deinterleave four packed xyz triples into x, y and z lanes
+static inline void load4Points(const float *p, __m128 &x, __m128 &y, __m128 &z)
+{
+  const __m128 x0y0z0x1 = _mm_loadu_ps(p);
+  const __m128 y1z1x2y2 = _mm_loadu_ps(p + 4);
+  const __m128 z2x3y3z3 = _mm_loadu_ps(p + 8);
+  const __m128 x2y2x3y3 = _mm_shuffle_ps(y1z1x2y2, z2x3y3z3, _MM_SHUFFLE(2, 1, 3, 2));
+  const __m128 y0z0y1z1 = _mm_shuffle_ps(x0y0z0x1, y1z1x2y2, _MM_SHUFFLE(1, 0, 2, 1));
+  x = _mm_shuffle_ps(x0y0z0x1, x2y2x3y3, _MM_SHUFFLE(2, 0, 3, 0));
+  y = _mm_shuffle_ps(y0z0y1z1, x2y2x3y3, _MM_SHUFFLE(3, 1, 2, 0));
+  z = _mm_shuffle_ps(y0z0y1z1, z2x3y3z3, _MM_SHUFFLE(3, 0, 3, 1));
+}
+
+// clears the sign bits, giving |v|
+static inline __m128 abs4(__m128 v)
+{
+  return _mm_andnot_ps(_mm_set1_ps(-0.0f), v);
+}
+
+}
+}
+#endif
+
+void bodies::Cylinder::containsPoints(const float *points, unsigned int n, std::vector<bool> &inside) const
+{
+  if (inside.size() < n)
+    inside.resize(n);
+  unsigned int i = 0;
+#if defined __SSE2__
+  const __m128 cx = _mm_set1_ps(m_fcenter[0]);
+  const __m128 cy = _mm_set1_ps(m_fcenter[1]);
+  const __m128 cz = _mm_set1_ps(m_fcenter[2]);
+  const __m128 hx = _mm_set1_ps(m_fnormalH[0]);
+  const __m128 hy = _mm_set1_ps(m_fnormalH[1]);
+  const __m128 hz = _mm_set1_ps(m_fnormalH[2]);
+  const __m128 b1x = _mm_set1_ps(m_fnormalB1[0]);
+  const __m128 b1y = _mm_set1_ps(m_fnormalB1[1]);
+  const __m128 b1z = _mm_set1_ps(m_fnormalB1[2]);
+  const __m128 b2x = _mm_set1_ps(m_fnormalB2[0]);
+  const __m128 b2y = _mm_set1_ps(m_fnormalB2[1]);
+  const __m128 b2z = _mm_set1_ps(m_fnormalB2[2]);
+  const __m128 l2 = _mm_set1_ps(m_flength2);
+  const __m128 r2 = _mm_set1_ps(m_fradius2);
+  for ( ; i + 4 <= n ; i += 4)
+  {
+    __m128 x, y, z;
+    detail::load4Points(points + 3 * i, x, y, z);
+    const __m128 vx = _mm_sub_ps(x, cx);
+    const __m128 vy = _mm_sub_ps(y, cy);
+    const __m128 vz = _mm_sub_ps(z, cz);
+    const __m128 pH = _mm_add_ps(_mm_mul_ps(vx, hx), _mm_add_ps(_mm_mul_ps(vy, hy), _mm_mul_ps(vz, hz)));
+    const __m128 pB1 = _mm_add_ps(_mm_mul_ps(vx, b1x), _mm_add_ps(_mm_mul_ps(vy, b1y), _mm_mul_ps(vz, b1z)));
+    const __m128 pB2 = _mm_add_ps(_mm_mul_ps(vx, b2x), _mm_add_ps(_mm_mul_ps(vy, b2y), _mm_mul_ps(vz, b2z)));
+    const __m128 remaining = _mm_sub_ps(r2, _mm_mul_ps(pB1, pB1));
+    //same conditions as containsPointFloat: |pH| within the half
+    //length and pB2^2 strictly under what the radius leaves
+    __m128 in = _mm_cmple_ps(detail::abs4(pH), l2);
+    in = _mm_and_ps(in, _mm_cmplt_ps(_mm_mul_ps(pB2, pB2), remaining));
+    const int bits = _mm_movemask_ps(in);
+    inside[i]     = (bits & 1) != 0;
+    inside[i + 1] = (bits & 2) != 0;
+    inside[i + 2] = (bits & 4) != 0;
+    inside[i + 3] = (bits & 8) != 0;
+  }
+#endif
+  for ( ; i < n ; ++i)
+    inside[i] = containsPointFloat(points[3 * i], points[3 * i + 1], points[3 * i + 2]);
+}
+
+void bodies::Box::containsPoints(const float *points, unsigned int n, std::vector<bool> &inside) const
+{
+  if (inside.size() < n)
+    inside.resize(n);
+  unsigned int i = 0;
+#if defined __SSE2__
+  const __m128 cx = _mm_set1_ps(m_fcenter[0]);
+  const __m128 cy = _mm_set1_ps(m_fcenter[1]);
+  const __m128 cz = _mm_set1_ps(m_fcenter[2]);
+  const __m128 lx = _mm_set1_ps(m_fnormalL[0]);
+  const __m128 ly = _mm_set1_ps(m_fnormalL[1]);
+  const __m128 lz = _mm_set1_ps(m_fnormalL[2]);
+  const __m128 wx = _mm_set1_ps(m_fnormalW[0]);
+  const __m128 wy = _mm_set1_ps(m_fnormalW[1]);
+  const __m128 wz = _mm_set1_ps(m_fnormalW[2]);
+  const __m128 hx = _mm_set1_ps(m_fnormalH[0]);
+  const __m128 hy = _mm_set1_ps(m_fnormalH[1]);
+  const __m128 hz = _mm_set1_ps(m_fnormalH[2]);
+  const __m128 l2 = _mm_set1_ps(m_flength2);
+  const __m128 w2 = _mm_set1_ps(m_fwidth2);
+  const __m128 h2 = _mm_set1_ps(m_fheight2);
+  for ( ; i + 4 <= n ; i += 4)
+  {
+    __m128 x, y, z;
+    detail::load4Points(points + 3 * i, x, y, z);
+    const __m128 vx = _mm_sub_ps(x, cx);
+    const __m128 vy = _mm_sub_ps(y, cy);
+    const __m128 vz = _mm_sub_ps(z, cz);
+    const __m128 pL = _mm_add_ps(_mm_mul_ps(vx, lx), _mm_add_ps(_mm_mul_ps(vy, ly), _mm_mul_ps(vz, lz)));
+    const __m128 pW = _mm_add_ps(_mm_mul_ps(vx, wx), _mm_add_ps(_mm_mul_ps(vy, wy), _mm_mul_ps(vz, wz)));
+    const __m128 pH = _mm_add_ps(_mm_mul_ps(vx, hx), _mm_add_ps(_mm_mul_ps(vy, hy), _mm_mul_ps(vz, hz)));
+    __m128 in = _mm_cmple_ps(detail::abs4(pL), l2);
+    in = _mm_and_ps(in, _mm_cmple_ps(detail::abs4(pW), w2));
+    in = _mm_and_ps(in, _mm_cmple_ps(detail::abs4(pH), h2));
+    const int bits = _mm_movemask_ps(in);
+    inside[i]     = (bits & 1) != 0;
+    inside[i + 1] = (bits & 2) != 0;
+    inside[i + 2] = (bits & 4) != 0;
+    inside[i + 3] = (bits & 8) != 0;
+  }
+#endif
+  for ( ; i < n ; ++i)
+    inside[i] = containsPointFloat(points[3 * i], points[3 * i + 1], points[3 * i + 2]);
+}
+
+bool bodies::Sphere::containsPoint(const tf::Vector3 &p, bool verbose) const
 {
   return (m_center - p).length2() < m_radius2;
 }
 
+bool bodies::Sphere::containsPointFloat(float x, float y, float z) const
+{
+  const float dx = x - m_fcenter[0];
+  const float dy = y - m_fcenter[1];
+  const float dz = z - m_fcenter[2];
+  return dx * dx + dy * dy + dz * dz < m_fradius2;
+}
+
 void bodies::Sphere::useDimensions(const shapes::Shape *shape) // radius
 {
   m_radius = static_cast<const shapes::Sphere*>(shape)->radius;
@@ -174,6 +440,11 @@ void bodies::Sphere::updateInternalData(void)
   m_radiusU = m_radius * m_scale + m_padding;
   m_radius2 = m_radiusU * m_radiusU;
   m_center = m_pose.getOrigin();
+
+  m_fcenter[0] = (float)m_center.x();
+  m_fcenter[1] = (float)m_center.y();
+  m_fcenter[2] = (float)m_center.z();
+  m_fradius2 = (float)m_radius2;
 }
 
 double bodies::Sphere::computeVolume(void) const
@@ -268,7 +539,29 @@ bool bodies::Cylinder::containsPoint(const tf::Vector3 &p, bool verbose) const
   {
     double pB2 = v.dot(m_normalB2);
     return pB2 * pB2 < remaining;
-  }		
+  }
+}
+
+bool bodies::Cylinder::containsPointFloat(float x, float y, float z) const
+{
+  const float vx = x - m_fcenter[0];
+  const float vy = y - m_fcenter[1];
+  const float vz = z - m_fcenter[2];
+  const float pH = vx * m_fnormalH[0] + vy * m_fnormalH[1] + vz * m_fnormalH[2];
+
+  if (fabsf(pH) > m_flength2)
+    return false;
+
+  const float pB1 = vx * m_fnormalB1[0] + vy * m_fnormalB1[1] + vz * m_fnormalB1[2];
+  const float remaining = m_fradius2 - pB1 * pB1;
+
+  if (remaining < 0.0f)
+    return false;
+  else
+  {
+    const float pB2 = vx * m_fnormalB2[0] + vy * m_fnormalB2[1] + vz * m_fnormalB2[2];
+    return pB2 * pB2 < remaining;
+  }
 }
 
 void bodies::Cylinder::useDimensions(const shapes::Shape *shape) // (length, radius)
@@ -294,6 +587,16 @@ void bodies::Cylinder::updateInternalData(void)
   double tmp = -m_normalH.dot(m_center);
   m_d1 = tmp + m_length2;
   m_d2 = tmp - m_length2;
+
+  for (int i = 0 ; i < 3 ; ++i)
+  {
+    m_fcenter[i]   = (float)m_center[i];
+    m_fnormalH[i]  = (float)m_normalH[i];
+    m_fnormalB1[i] = (float)m_normalB1[i];
+    m_fnormalB2[i] = (float)m_normalB2[i];
+  }
+  m_flength2 = (float)m_length2;
+  m_fradius2 = (float)m_radius2;
 }
 
 double bodies::Cylinder::computeVolume(void) const
@@ -433,10 +736,28 @@ bool bodies::Box::containsPoint(const tf::Vector3 &p, bool verbose) const
     return false;
     
   double pH = v.dot(m_normalH);
-    
+
   if (fabs(pH) > m_height2)
     return false;
-    
+
+  return true;
+}
+
+bool bodies::Box::containsPointFloat(float x, float y, float z) const
+{
+  const float vx = x - m_fcenter[0];
+  const float vy = y - m_fcenter[1];
+  const float vz = z - m_fcenter[2];
+
+  if (fabsf(vx * m_fnormalL[0] + vy * m_fnormalL[1] + vz * m_fnormalL[2]) > m_flength2)
+    return false;
+
+  if (fabsf(vx * m_fnormalW[0] + vy * m_fnormalW[1] + vz * m_fnormalW[2]) > m_fwidth2)
+    return false;
+
+  if (fabsf(vx * m_fnormalH[0] + vy * m_fnormalH[1] + vz * m_fnormalH[2]) > m_fheight2)
+    return false;
+
   return true;
 }
 
@@ -468,6 +789,17 @@ void bodies::Box::updateInternalData(void)
   const tf::Vector3 tmp(m_normalL * m_length2 + m_normalW * m_width2 + m_normalH * m_height2);
   m_corner1 = m_center - tmp;
   m_corner2 = m_center + tmp;
+
+  for (int i = 0 ; i < 3 ; ++i)
+  {
+    m_fcenter[i]  = (float)m_center[i];
+    m_fnormalL[i] = (float)m_normalL[i];
+    m_fnormalW[i] = (float)m_normalW[i];
+    m_fnormalH[i] = (float)m_normalH[i];
+  }
+  m_flength2 = (float)m_length2;
+  m_fwidth2  = (float)m_width2;
+  m_fheight2 = (float)m_height2;
 }
 
 double bodies::Box::computeVolume(void) const
@@ -781,6 +1113,19 @@ bool bodies::ConvexMesh::containsPoint(const tf::Vector3 &p, bool verbose) const
     return false;
 }
 
+bool bodies::ConvexMesh::containsPointFloat(float x, float y, float z) const
+{
+  if (!m_boundingBox.containsPointFloat(x, y, z))
+    return false;
+  float ix = m_fiBasis[0] * x + m_fiBasis[1] * y + m_fiBasis[2] * z + m_fiOrigin[0];
+  float iy = m_fiBasis[3] * x + m_fiBasis[4] * y + m_fiBasis[5] * z + m_fiOrigin[1];
+  float iz = m_fiBasis[6] * x + m_fiBasis[7] * y + m_fiBasis[8] * z + m_fiOrigin[2];
+  ix = m_fmeshCenter[0] + (ix - m_fmeshCenter[0]) * m_fscale;
+  iy = m_fmeshCenter[1] + (iy - m_fmeshCenter[1]) * m_fscale;
+  iz = m_fmeshCenter[2] + (iz - m_fmeshCenter[2]) * m_fscale;
+  return isPointInsidePlanesFloat(ix, iy, iz);
+}
+
 void bodies::ConvexMesh::useDimensions(const shapes::Shape *shape)
 {  
   const shapes::Mesh *mesh = static_cast<const shapes::Mesh*>(shape);
@@ -814,8 +1159,14 @@ void bodies::ConvexMesh::useDimensions(const shapes::Shape *shape)
   m_boxOffset.setValue((minX + maxX) / 2.0, (minY + maxY) / 2.0, (minZ + maxZ) / 2.0);
     
   m_planes.clear();
+  m_planesX.clear();
+  m_planesY.clear();
+  m_planesZ.clear();
+  m_planesW.clear();
   m_triangles.clear();
   m_vertices.clear();
+  m_bvhNodes.clear();
+  m_bvhTriangles.clear();
   m_meshRadiusB = 0.0;
   m_meshCenter.setValue(tfScalar(0), tfScalar(0), tfScalar(0));
 
@@ -854,14 +1205,8 @@ void bodies::ConvexMesh::useDimensions(const shapes::Shape *shape)
   }
 
 
-  /* compute convex hull */
-  coordT *points = (coordT *)calloc(mesh->vertexCount*3, sizeof(coordT));
   for(unsigned int i = 0; i < mesh->vertexCount ; ++i)
   {
-    points[3*i+0] = (coordT) mesh->vertices[3*i+0];
-    points[3*i+1] = (coordT) mesh->vertices[3*i+1];
-    points[3*i+2] = (coordT) mesh->vertices[3*i+2];
-
     double dista = mesh->vertices[3 * i + off1]-pose1;
     double distb = mesh->vertices[3 * i + off2]-pose2;
     double dist = sqrt(((dista*dista)+(distb*distb)));
@@ -872,6 +1217,40 @@ void bodies::ConvexMesh::useDimensions(const shapes::Shape *shape)
   m_boundingCylinder.radius = maxdist;
   m_boundingCylinder.length = cyl_length;
 
+  //the hull depends only on the mesh content - reuse one already
+  //computed for this mesh instead of re-running qhull
+  unsigned long long mesh_key = hashMeshContent(mesh);
+  {
+    boost::mutex::scoped_lock lock(g_hull_cache_lock);
+    std::map<unsigned long long, boost::shared_ptr<ConvexHullData> >::iterator it = g_hull_cache.find(mesh_key);
+    if (it == g_hull_cache.end())
+    {
+      boost::shared_ptr<ConvexHullData> hd = loadHullFromDisk(mesh_key);
+      if (hd)
+        it = g_hull_cache.insert(std::make_pair(mesh_key, hd)).first;
+    }
+    if (it != g_hull_cache.end())
+    {
+      m_planes = it->second->planes;
+      m_vertices = it->second->vertices;
+      m_triangles = it->second->triangles;
+      m_meshCenter = it->second->meshCenter;
+      m_radiusB = it->second->radiusB;
+      computePlanesSoA();
+      buildBVH();
+      return;
+    }
+  }
+
+  /* compute convex hull */
+  coordT *points = (coordT *)calloc(mesh->vertexCount*3, sizeof(coordT));
+  for(unsigned int i = 0; i < mesh->vertexCount ; ++i)
+  {
+    points[3*i+0] = (coordT) mesh->vertices[3*i+0];
+    points[3*i+1] = (coordT) mesh->vertices[3*i+1];
+    points[3*i+2] = (coordT) mesh->vertices[3*i+2];
+  }
+
   FILE* null = fopen ("/dev/null","w");
 
   char flags[] = "qhull Tv";
@@ -935,6 +1314,23 @@ void bodies::ConvexMesh::useDimensions(const shapes::Shape *shape)
   int curlong, totlong;
   qh_memfreeshort (&curlong, &totlong);
 
+  computePlanesSoA();
+  buildBVH();
+
+  {
+    boost::shared_ptr<ConvexHullData> hd(new ConvexHullData());
+    hd->planes = m_planes;
+    hd->vertices = m_vertices;
+    hd->triangles = m_triangles;
+    hd->meshCenter = m_meshCenter;
+    hd->radiusB = m_radiusB;
+    {
+      boost::mutex::scoped_lock lock(g_hull_cache_lock);
+      g_hull_cache[mesh_key] = hd;
+    }
+    saveHullToDisk(mesh_key, *hd);
+  }
+
 
 
 
@@ -1031,6 +1427,22 @@ void bodies::ConvexMesh::updateInternalData(void)
   m_radiusB = m_meshRadiusB * m_scale + m_padding;
   m_radiusBSqr = m_radiusB * m_radiusB;
 
+  const tf::Matrix3x3 &ibasis = m_iPose.getBasis();
+  for (int r = 0 ; r < 3 ; ++r)
+    for (int c = 0 ; c < 3 ; ++c)
+      m_fiBasis[3 * r + c] = (float)ibasis.getRow(r)[c];
+  for (int i = 0 ; i < 3 ; ++i)
+  {
+    m_fiOrigin[i] = (float)m_iPose.getOrigin()[i];
+    m_fmeshCenter[i] = (float)m_meshCenter[i];
+  }
+  m_fscale = (float)m_scale;
+
+  updateScaledVertices();
+}
+
+void bodies::ConvexMesh::updateScaledVertices(void) const
+{
   m_scaledVertices.resize(m_vertices.size());
   for (unsigned int i = 0 ; i < m_vertices.size() ; ++i)
   {
@@ -1038,6 +1450,19 @@ void bodies::ConvexMesh::updateInternalData(void)
     tfScalar l = v.length();
     m_scaledVertices[i] = m_meshCenter + v * (m_scale + (l > ZERO ? m_padding / l : 0.0));
   }
+  m_scaledVerticesDirty = false;
+  refitBVH();
+}
+
+void bodies::ConvexMesh::paddingUpdated(void)
+{
+  m_boundingBox.setPadding(m_padding);
+  m_radiusB = m_meshRadiusB * m_scale + m_padding;
+  m_radiusBSqr = m_radiusB * m_radiusB;
+  //point containment applies the padding at query time against the
+  //unscaled planes, so only ray queries need the rescaled vertices -
+  //recompute them lazily when one asks
+  m_scaledVerticesDirty = true;
 }
 
 void bodies::ConvexMesh::computeBoundingSphere(BoundingSphere &sphere) const
@@ -1056,8 +1481,64 @@ void bodies::ConvexMesh::computeBoundingCylinder(BoundingCylinder &cylinder) con
   cylinder.pose = cyl.pose;
 }
 
+void bodies::ConvexMesh::computePlanesSoA(void)
+{
+  // pad to a multiple of four with planes whose distance is always
+  // hugely negative, so the pad lanes can never reject a point
+  unsigned int padded = (m_planes.size() + 3) & ~3u;
+  m_planesX.assign(padded, 0.0f);
+  m_planesY.assign(padded, 0.0f);
+  m_planesZ.assign(padded, 0.0f);
+  m_planesW.assign(padded, -FLT_MAX);
+  for (unsigned int i = 0 ; i < m_planes.size() ; ++i)
+  {
+    m_planesX[i] = (float)m_planes[i].getX();
+    m_planesY[i] = (float)m_planes[i].getY();
+    m_planesZ[i] = (float)m_planes[i].getZ();
+    m_planesW[i] = (float)m_planes[i].getW();
+  }
+}
+
+bool bodies::ConvexMesh::isPointInsidePlanesFloat(float x, float y, float z) const
+{
+  const float thresh = (float)(m_padding + 1e-6);
+#if defined __SSE2__
+  if (!m_planesX.empty())
+  {
+    const __m128 px = _mm_set1_ps(x);
+    const __m128 py = _mm_set1_ps(y);
+    const __m128 pz = _mm_set1_ps(z);
+    const __m128 threshv = _mm_set1_ps(thresh);
+    const unsigned int padded = m_planesX.size();
+    for (unsigned int i = 0 ; i < padded ; i += 4)
+    {
+      __m128 dist = _mm_mul_ps(_mm_loadu_ps(&m_planesX[i]), px);
+      dist = _mm_add_ps(dist, _mm_mul_ps(_mm_loadu_ps(&m_planesY[i]), py));
+      dist = _mm_add_ps(dist, _mm_mul_ps(_mm_loadu_ps(&m_planesZ[i]), pz));
+      dist = _mm_add_ps(dist, _mm_loadu_ps(&m_planesW[i]));
+      if (_mm_movemask_ps(_mm_cmpgt_ps(dist, threshv)))
+        return false;
+    }
+    return true;
+  }
+#endif
+  unsigned int numplanes = m_planes.size();
+  for (unsigned int i = 0 ; i < numplanes ; ++i)
+  {
+    const tf::tfVector4& plane = m_planes[i];
+    float dist = (float)plane.getX() * x + (float)plane.getY() * y + (float)plane.getZ() * z + (float)plane.getW();
+    if (dist > thresh)
+      return false;
+  }
+  return true;
+}
+
 bool bodies::ConvexMesh::isPointInsidePlanes(const tf::Vector3& point) const
 {
+#if defined __SSE2__
+  if (!m_planesX.empty())
+    return isPointInsidePlanesFloat((float)point.x(), (float)point.y(), (float)point.z());
+#endif
   unsigned int numplanes = m_planes.size();
   for (unsigned int i = 0 ; i < numplanes ; ++i)
   {
@@ -1095,66 +1576,280 @@ double bodies::ConvexMesh::computeVolume(void) const
   return fabs(volume)/6.0;
 }
 
+namespace
+{
+
+//comparator ordering triangle indices by the position of their
+//centroid along one axis, for the BVH median split
+struct CentroidAxisOrder
+{
+  const std::vector<tf::Vector3>* centroids;
+  int axis;
+
+  bool operator()(unsigned int a, unsigned int b) const
+  {
+    return (*centroids)[a][axis] < (*centroids)[b][axis];
+  }
+};
+
+//slab test of a ray against an axis-aligned box; reports the entry
+//parameter so traversal can visit the nearer child first
+inline bool rayIntersectsAABB(const tf::Vector3& o, const tf::Vector3& d,
+                              const tf::Vector3& bmin, const tf::Vector3& bmax,
+                              double& tnear)
+{
+  double tmin = 0.0;
+  double tmax = INFINITY;
+  for (int a = 0 ; a < 3 ; ++a)
+  {
+    double da = d[a];
+    if (fabs(da) < ZERO)
+    {
+      if (o[a] < bmin[a] || o[a] > bmax[a])
+        return false;
+    }
+    else
+    {
+      double t1 = (bmin[a] - o[a]) / da;
+      double t2 = (bmax[a] - o[a]) / da;
+      if (t1 > t2)
+        std::swap(t1, t2);
+      if (t1 > tmin)
+        tmin = t1;
+      if (t2 < tmax)
+        tmax = t2;
+      if (tmin > tmax)
+        return false;
+    }
+  }
+  tnear = tmin;
+  return true;
+}
+
+static const unsigned int BVH_LEAF_SIZE = 4;
+
+}
+
+void bodies::ConvexMesh::buildBVH(void)
+{
+  m_bvhNodes.clear();
+  const unsigned int nt = m_triangles.size() / 3;
+  m_bvhTriangles.resize(nt);
+  for (unsigned int i = 0 ; i < nt ; ++i)
+    m_bvhTriangles[i] = i;
+  if (nt == 0)
+    return;
+  std::vector<tf::Vector3> centroids(nt);
+  for (unsigned int i = 0 ; i < nt ; ++i)
+    centroids[i] = (m_vertices[m_triangles[3*i]] +
+                    m_vertices[m_triangles[3*i + 1]] +
+                    m_vertices[m_triangles[3*i + 2]]) / 3.0;
+  buildBVHNode(0, nt, centroids);
+}
+
+int bodies::ConvexMesh::buildBVHNode(unsigned int start, unsigned int count, const std::vector<tf::Vector3>& centroids)
+{
+  int node_index = (int)m_bvhNodes.size();
+  m_bvhNodes.push_back(BVHNode());
+  m_bvhNodes[node_index].start = start;
+  m_bvhNodes[node_index].count = count;
+  if (count <= BVH_LEAF_SIZE)
+  {
+    m_bvhNodes[node_index].left = -1;
+    m_bvhNodes[node_index].right = -1;
+    return node_index;
+  }
+  tf::Vector3 cmin = centroids[m_bvhTriangles[start]];
+  tf::Vector3 cmax = cmin;
+  for (unsigned int i = 1 ; i < count ; ++i)
+  {
+    cmin.setMin(centroids[m_bvhTriangles[start + i]]);
+    cmax.setMax(centroids[m_bvhTriangles[start + i]]);
+  }
+  tf::Vector3 extent = cmax - cmin;
+  int axis = 0;
+  if (extent.y() > extent.x())
+    axis = 1;
+  if (extent.z() > extent[axis])
+    axis = 2;
+  CentroidAxisOrder order;
+  order.centroids = &centroids;
+  order.axis = axis;
+  unsigned int half = count / 2;
+  std::nth_element(m_bvhTriangles.begin() + start,
+                   m_bvhTriangles.begin() + start + half,
+                   m_bvhTriangles.begin() + start + count, order);
+  int left = buildBVHNode(start, half, centroids);
+  int right = buildBVHNode(start + half, count - half, centroids);
+  m_bvhNodes[node_index].left = left;
+  m_bvhNodes[node_index].right = right;
+  return node_index;
+}
+
+void bodies::ConvexMesh::refitBVH(void) const
+{
+  //children are always built after their parent, so a reverse sweep
+  //sees both children before the parent
+  for (int i = (int)m_bvhNodes.size() - 1 ; i >= 0 ; --i)
+  {
+    BVHNode& node = m_bvhNodes[i];
+    if (node.left < 0)
+    {
+      node.bmin.setValue(INFINITY, INFINITY, INFINITY);
+      node.bmax.setValue(-INFINITY, -INFINITY, -INFINITY);
+      for (unsigned int k = 0 ; k < node.count ; ++k)
+      {
+        const unsigned int t3 = 3 * m_bvhTriangles[node.start + k];
+        for (unsigned int v = 0 ; v < 3 ; ++v)
+        {
+          node.bmin.setMin(m_scaledVertices[m_triangles[t3 + v]]);
+          node.bmax.setMax(m_scaledVertices[m_triangles[t3 + v]]);
+        }
+      }
+    }
+    else
+    {
+      node.bmin = m_bvhNodes[node.left].bmin;
+      node.bmin.setMin(m_bvhNodes[node.right].bmin);
+      node.bmax = m_bvhNodes[node.left].bmax;
+      node.bmax.setMax(m_bvhNodes[node.right].bmax);
+    }
+  }
+}
+
+bool bodies::ConvexMesh::intersectsTriangle(unsigned int index, const tf::Vector3& orig, const tf::Vector3& dr, double& t) const
+{
+  tfScalar tmp = m_planes[index].dot(dr);
+  if (fabs(tmp) <= ZERO)
+    return false;
+  t = -(m_planes[index].dot(orig) + m_planes[index].getW()) / tmp;
+  if (t <= 0.0)
+    return false;
+
+  const int i3 = 3 * index;
+  const int v1 = m_triangles[i3 + 0];
+  const int v2 = m_triangles[i3 + 1];
+  const int v3 = m_triangles[i3 + 2];
+
+  const tf::Vector3 &a = m_scaledVertices[v1];
+  const tf::Vector3 &b = m_scaledVertices[v2];
+  const tf::Vector3 &c = m_scaledVertices[v3];
+
+  tf::Vector3 cb(c - b);
+  tf::Vector3 ab(a - b);
+
+  // intersection of the plane defined by the triangle and the ray
+  tf::Vector3 P(orig + dr * t);
+
+  // check if it is inside the triangle
+  tf::Vector3 pb(P - b);
+  tf::Vector3 c1(cb.cross(pb));
+  tf::Vector3 c2(cb.cross(ab));
+  if (c1.dot(c2) < 0.0)
+    return false;
+
+  tf::Vector3 ca(c - a);
+  tf::Vector3 pa(P - a);
+  tf::Vector3 ba(-ab);
+
+  c1 = ca.cross(pa);
+  c2 = ca.cross(ba);
+  if (c1.dot(c2) < 0.0)
+    return false;
+
+  c1 = ba.cross(pa);
+  c2 = ba.cross(ca);
+
+  if (c1.dot(c2) < 0.0)
+    return false;
+
+  return true;
+}
+
 bool bodies::ConvexMesh::intersectsRay(const tf::Vector3& origin, const tf::Vector3& dir, std::vector<tf::Vector3> *intersections, unsigned int count) const
 {
   if (distanceSQR(m_center, origin, dir) > m_radiusBSqr) return false;
   if (!m_boundingBox.intersectsRay(origin, dir)) return false;
-    
+
+  if (m_scaledVerticesDirty) updateScaledVertices();
+
   // transform the ray into the coordinate frame of the mesh
   tf::Vector3 orig(m_iPose * origin);
   tf::Vector3 dr(m_iPose.getBasis() * dir);
-    
+
   std::vector<detail::intersc> ipts;
-    
+
   bool result = false;
-    
-  // for each triangle 
+
+  if (!m_bvhNodes.empty())
+  {
+    //walk the BVH visiting the nearer child first; pruned subtrees
+    //never run a triangle test
+    int stack[64];
+    int top = 0;
+    double tnear;
+    if (rayIntersectsAABB(orig, dr, m_bvhNodes[0].bmin, m_bvhNodes[0].bmax, tnear))
+      stack[top++] = 0;
+    bool done = false;
+    while (top > 0 && !done)
+    {
+      const BVHNode& node = m_bvhNodes[stack[--top]];
+      if (node.left < 0)
+      {
+        for (unsigned int k = 0 ; k < node.count ; ++k)
+        {
+          double t;
+          if (intersectsTriangle(m_bvhTriangles[node.start + k], orig, dr, t))
+          {
+            result = true;
+            if (intersections)
+            {
+              detail::intersc ip(origin + dir * t, t);
+              ipts.push_back(ip);
+            }
+            else
+            {
+              done = true;
+              break;
+            }
+          }
+        }
+      }
+      else
+      {
+        double tl = 0.0;
+        double tr = 0.0;
+        bool hit_left = rayIntersectsAABB(orig, dr, m_bvhNodes[node.left].bmin, m_bvhNodes[node.left].bmax, tl);
+        bool hit_right = rayIntersectsAABB(orig, dr, m_bvhNodes[node.right].bmin, m_bvhNodes[node.right].bmax, tr);
+        if (hit_left && hit_right)
+        {
+          if (tl <= tr)
+          {
+            stack[top++] = node.right;
+            stack[top++] = node.left;
+          }
+          else
+          {
+            stack[top++] = node.left;
+            stack[top++] = node.right;
+          }
+        }
+        else if (hit_left)
+          stack[top++] = node.left;
+        else if (hit_right)
+          stack[top++] = node.right;
+      }
+    }
+  }
+  else
+  {
+  // for each triangle
   const unsigned int nt = m_triangles.size() / 3;
   for (unsigned int i = 0 ; i < nt ; ++i)
   {
-    tfScalar tmp = m_planes[i].dot(dr);
-    if (fabs(tmp) > ZERO)
-    {
-      double t = -(m_planes[i].dot(orig) + m_planes[i].getW()) / tmp;
-      if (t > 0.0)
+    double t;
+    if (intersectsTriangle(i, orig, dr, t))
       {
-        const int i3 = 3 * i;
-        const int v1 = m_triangles[i3 + 0];
-        const int v2 = m_triangles[i3 + 1];
-        const int v3 = m_triangles[i3 + 2];
-		
-        const tf::Vector3 &a = m_scaledVertices[v1];
-        const tf::Vector3 &b = m_scaledVertices[v2];
-        const tf::Vector3 &c = m_scaledVertices[v3];
-		
-        tf::Vector3 cb(c - b);
-        tf::Vector3 ab(a - b);
-		
-        // intersection of the plane defined by the triangle and the ray
-        tf::Vector3 P(orig + dr * t);
-		
-        // check if it is inside the triangle
-        tf::Vector3 pb(P - b);
-        tf::Vector3 c1(cb.cross(pb));
-        tf::Vector3 c2(cb.cross(ab));
-        if (c1.dot(c2) < 0.0)
-          continue;
-		
-        tf::Vector3 ca(c - a);
-        tf::Vector3 pa(P - a);
-        tf::Vector3 ba(-ab);
-		
-        c1 = ca.cross(pa);
-        c2 = ca.cross(ba);
-        if (c1.dot(c2) < 0.0)
-          continue;
-		
-        c1 = ba.cross(pa);
-        c2 = ba.cross(ca);
-		
-        if (c1.dot(c2) < 0.0)
-          continue;
-		
         result = true;
         if (intersections)
         {
@@ -1201,10 +1896,38 @@ bodies::BodyVector::~BodyVector() {
   }
 }
 
+namespace
+{
+//relative cost of a single-body ray test, used to order batched ray
+//queries so the cheap tests run first
+unsigned int rayTestCost(shapes::ShapeType type)
+{
+  switch (type)
+  {
+  case shapes::SPHERE:
+    return 0;
+  case shapes::CYLINDER:
+    return 1;
+  case shapes::BOX:
+    return 2;
+  default:
+    return 3;
+  }
+}
+}
+
 void bodies::BodyVector::addBody(const shapes::Shape* shape, const tf::Transform& pose, double padding) {
   bodies::Body* body = bodies::createBodyFromShape(shape);
   body->setPose(pose);
   bodies_.push_back(body);
+
+  unsigned int new_index = bodies_.size() - 1;
+  std::vector<unsigned int>::iterator pos = ray_query_order_.begin();
+  while(pos != ray_query_order_.end() &&
+        rayTestCost(bodies_[*pos]->getType()) <= rayTestCost(shape->type)) {
+    pos++;
+  }
+  ray_query_order_.insert(pos, new_index);
   BoundingSphere sphere;
   body->computeBoundingSphere(sphere);
   rsqrs_.push_back(sphere.radius*sphere.radius);
@@ -1217,6 +1940,13 @@ void bodies::BodyVector::addBody(const shapes::Shape* shape, const tf::Transform
     padded_body->computeBoundingSphere(padded_sphere);
     padded_rsqrs_.push_back(padded_sphere.radius*padded_sphere.radius);
   }
+  refreshPretestTable();
+}
+
+void bodies::BodyVector::addBodyGroup(const std::vector<shapes::Shape*>& shapes, const tf::Transform& pose, double padding) {
+  for(unsigned int i = 0; i < shapes.size(); i++) {
+    addBody(shapes[i], pose, padding);
+  }
 }
 
 void bodies::BodyVector::setPose(unsigned int i, const tf::Transform& pose)
@@ -1226,6 +1956,102 @@ void bodies::BodyVector::setPose(unsigned int i, const tf::Transform& pose)
   if(padding_ > 0.0) {
     padded_bodies_[i]->setPose(pose);
   }
+  refreshPretestTable();
+}
+
+namespace
+{
+
+void packBoundingSpheres(const std::vector<bodies::Body*>& bs,
+                         std::vector<float>& cx, std::vector<float>& cy,
+                         std::vector<float>& cz, std::vector<float>& r2)
+{
+  // pad to a multiple of four with spheres no point can be inside,
+  // so the pad lanes never pass the pretest
+  unsigned int padded = (bs.size() + 3) & ~3u;
+  cx.assign(padded, 0.0f);
+  cy.assign(padded, 0.0f);
+  cz.assign(padded, 0.0f);
+  r2.assign(padded, -FLT_MAX);
+  for (unsigned int i = 0 ; i < bs.size() ; ++i)
+  {
+    bodies::BoundingSphere sphere;
+    bs[i]->computeBoundingSphere(sphere);
+    cx[i] = (float)sphere.center.x();
+    cy[i] = (float)sphere.center.y();
+    cz[i] = (float)sphere.center.z();
+    // inflate slightly so float rounding can never reject a point
+    // the double-precision test would accept
+    float radius = (float)sphere.radius * 1.001f + 1e-4f;
+    r2[i] = radius * radius;
+  }
+}
+
+}
+
+void bodies::BodyVector::refreshPretestTable(void)
+{
+  packBoundingSpheres(bodies_, sphere_centers_x_, sphere_centers_y_, sphere_centers_z_, sphere_rsqrs_);
+  if (!padded_bodies_.empty())
+    packBoundingSpheres(padded_bodies_, padded_sphere_centers_x_, padded_sphere_centers_y_, padded_sphere_centers_z_, padded_sphere_rsqrs_);
+}
+
+bool bodies::BodyVector::containsPoint(const tf::Vector3 &p, bool use_padding) const
+{
+  const bool padded = use_padding && !padded_bodies_.empty();
+  const std::vector<Body*>& test_bodies = padded ? padded_bodies_ : bodies_;
+  if (test_bodies.empty())
+    return false;
+  const std::vector<float>& cx = padded ? padded_sphere_centers_x_ : sphere_centers_x_;
+  const std::vector<float>& cy = padded ? padded_sphere_centers_y_ : sphere_centers_y_;
+  const std::vector<float>& cz = padded ? padded_sphere_centers_z_ : sphere_centers_z_;
+  const std::vector<float>& r2 = padded ? padded_sphere_rsqrs_ : sphere_rsqrs_;
+#if defined __SSE2__
+  const __m128 px = _mm_set1_ps((float)p.x());
+  const __m128 py = _mm_set1_ps((float)p.y());
+  const __m128 pz = _mm_set1_ps((float)p.z());
+  for (unsigned int i = 0 ; i < cx.size() ; i += 4)
+  {
+    const __m128 dx = _mm_sub_ps(px, _mm_loadu_ps(&cx[i]));
+    const __m128 dy = _mm_sub_ps(py, _mm_loadu_ps(&cy[i]));
+    const __m128 dz = _mm_sub_ps(pz, _mm_loadu_ps(&cz[i]));
+    __m128 d2 = _mm_mul_ps(dx, dx);
+    d2 = _mm_add_ps(d2, _mm_mul_ps(dy, dy));
+    d2 = _mm_add_ps(d2, _mm_mul_ps(dz, dz));
+    int mask = _mm_movemask_ps(_mm_cmple_ps(d2, _mm_loadu_ps(&r2[i])));
+    for (unsigned int lane = 0 ; mask != 0 ; ++lane, mask >>= 1)
+      if ((mask & 1) && test_bodies[i + lane]->containsPoint(p))
+        return true;
+  }
+#else
+  const float fx = (float)p.x(), fy = (float)p.y(), fz = (float)p.z();
+  for (unsigned int i = 0 ; i < test_bodies.size() ; ++i)
+  {
+    const float dx = fx - cx[i], dy = fy - cy[i], dz = fz - cz[i];
+    if (dx * dx + dy * dy + dz * dz <= r2[i] && test_bodies[i]->containsPoint(p))
+      return true;
+  }
+#endif
+  return false;
+}
+
+void bodies::BodyVector::intersectsRayBatch(const tf::Vector3* origins,
+                                            const tf::Vector3* dirs,
+                                            unsigned int num_rays,
+                                            std::vector<bool>& hits,
+                                            bool use_padding) const
+{
+  const std::vector<Body*>& test_bodies = use_padding && !padded_bodies_.empty() ? padded_bodies_ : bodies_;
+  if (hits.size() < num_rays)
+    hits.resize(num_rays);
+  const unsigned int nb = ray_query_order_.size();
+  for (unsigned int r = 0 ; r < num_rays ; ++r)
+  {
+    bool hit = false;
+    for (unsigned int i = 0 ; !hit && i < nb ; ++i)
+      hit = test_bodies[ray_query_order_[i]]->intersectsRay(origins[r], dirs[r]);
+    hits[r] = hit;
+  }
 }
 
 const bodies::Body* bodies::BodyVector::getBody(unsigned int i) const
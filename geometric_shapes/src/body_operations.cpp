@@ -35,32 +35,110 @@
 /** \author Ioan Sucan, E. Gil Jones */
 
 #include <geometric_shapes/body_operations.h>
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
 
-void bodies::maskPosesInsideBodyVectors(const std::vector<tf::Transform>& poses,
-                                        const std::vector<bodies::BodyVector*>& bvs,
-                                        std::vector<bool>& mask,
-                                        bool use_padded) {
-  mask.resize(poses.size(), false);
-  for(unsigned int i = 0; i < poses.size(); i++) {
-    bool inside = false;
+namespace {
+
+/** \brief Merged bounding sphere over all bodies of one body vector;
+    a negative radius2 marks an empty vector so every pose skips it */
+struct BodyVectorBound
+{
+  tf::Vector3 center;
+  double radius2;
+};
+
+void maskPosesRange(const std::vector<tf::Transform>& poses,
+                    const std::vector<bodies::BodyVector*>& bvs,
+                    const std::vector<BodyVectorBound>& bounds,
+                    bool use_padded,
+                    unsigned int start,
+                    unsigned int end,
+                    std::vector<char>& inside) {
+  for(unsigned int i = start; i < end; i++) {
+    bool in = false;
     tf::Vector3 pt = poses[i].getOrigin();
-    for(unsigned int j = 0; !inside && j < bvs.size(); j++) {
-      for(unsigned int k = 0;!inside && k < bvs[j]->getSize(); k++) {
+    for(unsigned int j = 0; !in && j < bvs.size(); j++) {
+      //merged sphere first, so an implausible vector costs one distance check
+      if(bounds[j].center.distance2(pt) >= bounds[j].radius2) {
+        continue;
+      }
+      for(unsigned int k = 0;!in && k < bvs[j]->getSize(); k++) {
         if(!use_padded) {
           if(bvs[j]->getBoundingSphere(k).center.distance2(pt) < bvs[j]->getBoundingSphereRadiusSquared(k)) {
             if(bvs[j]->getBody(k)->containsPoint(pt)) {
-              inside = true;
+              in = true;
             }
           }
         } else {
           if(bvs[j]->getPaddedBoundingSphere(k).center.distance2(pt) < bvs[j]->getPaddedBoundingSphereRadiusSquared(k)) {
             if(bvs[j]->getPaddedBody(k)->containsPoint(pt)) {
-              inside = true;
+              in = true;
             }
           }
         }
       }
     }
-    mask[i] = !inside;
+    inside[i] = in ? 1 : 0;
+  }
+}
+
+}
+
+void bodies::maskPosesInsideBodyVectors(const std::vector<tf::Transform>& poses,
+                                        const std::vector<bodies::BodyVector*>& bvs,
+                                        std::vector<bool>& mask,
+                                        bool use_padded) {
+  mask.resize(poses.size(), false);
+  if(poses.empty()) {
+    return;
+  }
+
+  std::vector<BodyVectorBound> bounds(bvs.size());
+  for(unsigned int j = 0; j < bvs.size(); j++) {
+    std::vector<BoundingSphere> spheres(bvs[j]->getSize());
+    for(unsigned int k = 0; k < bvs[j]->getSize(); k++) {
+      spheres[k] = use_padded ? bvs[j]->getPaddedBoundingSphere(k) : bvs[j]->getBoundingSphere(k);
+    }
+    bounds[j].center = tf::Vector3(0.0, 0.0, 0.0);
+    bounds[j].radius2 = -1.0;
+    if(!spheres.empty()) {
+      BoundingSphere merged;
+      mergeBoundingSpheres(spheres, merged);
+      bounds[j].center = merged.center;
+      bounds[j].radius2 = merged.radius * merged.radius;
+    }
+  }
+
+  //workers write disjoint byte ranges; a vector<bool> would pack bits
+  //and make neighboring writes race
+  std::vector<char> inside(poses.size(), 0);
+  const unsigned int min_poses_per_thread = 1024;
+  unsigned int num_threads = boost::thread::hardware_concurrency();
+  if(num_threads > poses.size() / min_poses_per_thread) {
+    num_threads = poses.size() / min_poses_per_thread;
+  }
+  if(num_threads <= 1) {
+    maskPosesRange(poses, bvs, bounds, use_padded, 0, poses.size(), inside);
+  } else {
+    boost::thread_group workers;
+    unsigned int chunk = (poses.size() + num_threads - 1) / num_threads;
+    for(unsigned int t = 0; t < num_threads; t++) {
+      unsigned int start = t * chunk;
+      unsigned int end = start + chunk;
+      if(end > poses.size()) {
+        end = poses.size();
+      }
+      if(start >= end) {
+        break;
+      }
+      workers.create_thread(boost::bind(maskPosesRange, boost::cref(poses), boost::cref(bvs),
+                                        boost::cref(bounds), use_padded, start, end, boost::ref(inside)));
+    }
+    workers.join_all();
+  }
+
+  for(unsigned int i = 0; i < poses.size(); i++) {
+    mask[i] = inside[i] == 0;
   }
 }
@@ -37,9 +37,14 @@
 #include "geometric_shapes/shape_operations.h"
 
 #include <cstdio>
+#include <cstdlib>
 #include <cmath>
 #include <algorithm>
 #include <set>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <boost/thread/mutex.hpp>
 
 #include <ros/console.h>
 #include <resource_retriever/retriever.h>
@@ -73,20 +78,9 @@ Shape* cloneShape(const Shape *shape)
       result = new Box(static_cast<const Box*>(shape)->size[0], static_cast<const Box*>(shape)->size[1], static_cast<const Box*>(shape)->size[2]);
       break;
     case MESH:
-      {
-        const Mesh *src = static_cast<const Mesh*>(shape);
-        Mesh *dest = new Mesh(src->vertexCount, src->triangleCount);
-        unsigned int n = 3 * src->vertexCount;
-        for (unsigned int i = 0 ; i < n ; ++i)
-          dest->vertices[i] = src->vertices[i];
-        n = 3 * src->triangleCount;
-        for (unsigned int i = 0 ; i < n ; ++i)
-        {
-          dest->triangles[i] = src->triangles[i];
-          dest->normals[i] = src->normals[i];
-        }
-        result = dest;
-      }
+      //mesh data is immutable once built, so clones share the vertex,
+      //triangle and normal arrays instead of copying them
+      result = new Mesh(static_cast<const Mesh*>(shape));
       break;
     default:
       break;
@@ -272,11 +266,237 @@ shapes::Mesh* createMeshFromVertices(const std::vector<tf::Vector3> &source)
     mesh->normals[3 * i + 1] = normal.getY();
     mesh->normals[3 * i + 2] = normal.getZ();
   }
-	
+
+  return mesh;
+}
+
+std::vector<shapes::Mesh*> createConvexDecomposition(const shapes::Mesh *mesh, double tolerance)
+{
+  std::vector<shapes::Mesh*> pieces;
+  if (!mesh || mesh->triangleCount == 0)
+    return pieces;
+
+  // map each undirected edge to the triangles sharing it
+  std::map<unsigned long long, std::vector<unsigned int> > edge_triangles;
+  for (unsigned int t = 0 ; t < mesh->triangleCount ; ++t)
+    for (unsigned int e = 0 ; e < 3 ; ++e)
+    {
+      unsigned int a = mesh->triangles[3 * t + e];
+      unsigned int b = mesh->triangles[3 * t + (e + 1) % 3];
+      unsigned long long key = a < b ?
+        ((unsigned long long)a << 32) | b : ((unsigned long long)b << 32) | a;
+      edge_triangles[key].push_back(t);
+    }
+
+  // grow approximately convex patches of triangles: a triangle may
+  // join a patch as long as no vertex on either side sticks out in
+  // front of the other side's supporting planes by more than the
+  // tolerance
+  std::vector<int> patch_of(mesh->triangleCount, -1);
+  std::vector<std::vector<unsigned int> > patches;
+  for (unsigned int seed = 0 ; seed < mesh->triangleCount ; ++seed)
+  {
+    if (patch_of[seed] >= 0)
+      continue;
+    int patch_id = patches.size();
+    patches.push_back(std::vector<unsigned int>());
+    std::vector<tf::Vector3> patch_normals;
+    std::vector<double> patch_offsets;
+    std::set<unsigned int> patch_vertices;
+    std::vector<unsigned int> queue;
+    queue.push_back(seed);
+    while (!queue.empty())
+    {
+      unsigned int t = queue.back();
+      queue.pop_back();
+      if (patch_of[t] >= 0)
+        continue;
+
+      tf::Vector3 normal(mesh->normals[3 * t], mesh->normals[3 * t + 1], mesh->normals[3 * t + 2]);
+      tf::Vector3 v0(mesh->vertices[3 * mesh->triangles[3 * t]],
+                     mesh->vertices[3 * mesh->triangles[3 * t] + 1],
+                     mesh->vertices[3 * mesh->triangles[3 * t] + 2]);
+      double offset = -normal.dot(v0);
+      bool degenerate = normal.length2() < 1e-12;
+
+      bool ok = true;
+      // candidate vertices against patch planes
+      for (unsigned int e = 0 ; ok && e < 3 ; ++e)
+      {
+        unsigned int v = mesh->triangles[3 * t + e];
+        if (patch_vertices.find(v) != patch_vertices.end())
+          continue;
+        tf::Vector3 p(mesh->vertices[3 * v], mesh->vertices[3 * v + 1], mesh->vertices[3 * v + 2]);
+        for (unsigned int k = 0 ; k < patch_normals.size() ; ++k)
+          if (patch_normals[k].dot(p) + patch_offsets[k] > tolerance)
+          {
+            ok = false;
+            break;
+          }
+      }
+      // patch vertices against candidate plane
+      if (ok && !degenerate)
+        for (std::set<unsigned int>::iterator it = patch_vertices.begin() ; it != patch_vertices.end() ; ++it)
+        {
+          tf::Vector3 p(mesh->vertices[3 * *it], mesh->vertices[3 * *it + 1], mesh->vertices[3 * *it + 2]);
+          if (normal.dot(p) + offset > tolerance)
+          {
+            ok = false;
+            break;
+          }
+        }
+      if (!ok && t != seed)
+        continue;
+
+      patch_of[t] = patch_id;
+      patches[patch_id].push_back(t);
+      if (!degenerate)
+      {
+        patch_normals.push_back(normal);
+        patch_offsets.push_back(offset);
+      }
+      for (unsigned int e = 0 ; e < 3 ; ++e)
+      {
+        unsigned int a = mesh->triangles[3 * t + e];
+        unsigned int b = mesh->triangles[3 * t + (e + 1) % 3];
+        patch_vertices.insert(a);
+        unsigned long long key = a < b ?
+          ((unsigned long long)a << 32) | b : ((unsigned long long)b << 32) | a;
+        const std::vector<unsigned int> &neighbours = edge_triangles[key];
+        for (unsigned int k = 0 ; k < neighbours.size() ; ++k)
+          if (patch_of[neighbours[k]] < 0)
+            queue.push_back(neighbours[k]);
+      }
+    }
+  }
+
+  // copy each patch into its own mesh with remapped vertex indices
+  for (unsigned int i = 0 ; i < patches.size() ; ++i)
+  {
+    const std::vector<unsigned int> &patch = patches[i];
+    std::map<unsigned int, unsigned int> vertex_map;
+    for (unsigned int j = 0 ; j < patch.size() ; ++j)
+      for (unsigned int e = 0 ; e < 3 ; ++e)
+      {
+        unsigned int v = mesh->triangles[3 * patch[j] + e];
+        if (vertex_map.find(v) == vertex_map.end())
+        {
+          unsigned int idx = vertex_map.size();
+          vertex_map[v] = idx;
+        }
+      }
+    shapes::Mesh *piece = new shapes::Mesh(vertex_map.size(), patch.size());
+    for (std::map<unsigned int, unsigned int>::iterator it = vertex_map.begin() ; it != vertex_map.end() ; ++it)
+      for (unsigned int c = 0 ; c < 3 ; ++c)
+        piece->vertices[3 * it->second + c] = mesh->vertices[3 * it->first + c];
+    for (unsigned int j = 0 ; j < patch.size() ; ++j)
+      for (unsigned int e = 0 ; e < 3 ; ++e)
+        piece->triangles[3 * j + e] = vertex_map[mesh->triangles[3 * patch[j] + e]];
+    for (unsigned int j = 0 ; j < patch.size() ; ++j)
+      for (unsigned int c = 0 ; c < 3 ; ++c)
+        piece->normals[3 * j + c] = mesh->normals[3 * patch[j] + c];
+    pieces.push_back(piece);
+  }
+
+  return pieces;
+}
+
+namespace
+{
+
+// parsed meshes are cached per process keyed by filename and scale
+// and handed out as shared-storage copies, so a node loading the
+// same dozen meshes retrieves and parses each one only once. Setting
+// the GEOMETRIC_SHAPES_MESH_CACHE environment variable to a writable
+// directory additionally persists the parsed arrays as a binary
+// sidecar file, letting later processes skip retrieval and parsing.
+
+static std::map<std::string, shapes::Mesh*> g_mesh_cache;
+static boost::mutex g_mesh_cache_lock;
+
+std::string makeMeshCacheKey(const std::string& filename, const tf::Vector3& scale)
+{
+  std::stringstream ss;
+  ss << filename << "|" << scale.x() << "|" << scale.y() << "|" << scale.z();
+  return ss.str();
+}
+
+std::string meshSidecarFileName(const std::string& key)
+{
+  const char* dir = getenv("GEOMETRIC_SHAPES_MESH_CACHE");
+  if (!dir || dir[0] == '\0')
+    return std::string();
+  unsigned long long hash = 14695981039346656037ULL;
+  for (unsigned int i = 0 ; i < key.size() ; ++i)
+    hash = (hash ^ (unsigned char)key[i]) * 1099511628211ULL;
+  std::stringstream ss;
+  ss << dir << "/mesh_" << std::hex << hash << ".bin";
+  return ss.str();
+}
+
+shapes::Mesh* loadMeshSidecar(const std::string& key)
+{
+  std::string path = meshSidecarFileName(key);
+  if (path.empty())
+    return NULL;
+  std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+  if (!in)
+    return NULL;
+  unsigned int vertex_count = 0, triangle_count = 0;
+  in.read((char*)&vertex_count, sizeof(vertex_count));
+  in.read((char*)&triangle_count, sizeof(triangle_count));
+  if (!in || vertex_count == 0 || triangle_count == 0)
+    return NULL;
+  shapes::Mesh *mesh = new shapes::Mesh(vertex_count, triangle_count);
+  in.read((char*)mesh->vertices, 3 * vertex_count * sizeof(double));
+  in.read((char*)mesh->triangles, 3 * triangle_count * sizeof(unsigned int));
+  in.read((char*)mesh->normals, 3 * triangle_count * sizeof(double));
+  if (!in)
+  {
+    delete mesh;
+    return NULL;
+  }
   return mesh;
 }
 
+void saveMeshSidecar(const std::string& key, const shapes::Mesh *mesh)
+{
+  std::string path = meshSidecarFileName(key);
+  if (path.empty())
+    return;
+  std::ofstream out(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!out)
+  {
+    ROS_WARN("Unable to write mesh cache file %s", path.c_str());
+    return;
+  }
+  out.write((const char*)&mesh->vertexCount, sizeof(mesh->vertexCount));
+  out.write((const char*)&mesh->triangleCount, sizeof(mesh->triangleCount));
+  out.write((const char*)mesh->vertices, 3 * mesh->vertexCount * sizeof(double));
+  out.write((const char*)mesh->triangles, 3 * mesh->triangleCount * sizeof(unsigned int));
+  out.write((const char*)mesh->normals, 3 * mesh->triangleCount * sizeof(double));
+}
+
+}
+
 shapes::Mesh* createMeshFromFilename(const std::string& filename, const tf::Vector3* scale) {
+  tf::Vector3 mesh_scale(1.0, 1.0, 1.0);
+  if (scale != NULL)
+    mesh_scale = *scale;
+  std::string cache_key = makeMeshCacheKey(filename, mesh_scale);
+  {
+    boost::mutex::scoped_lock lock(g_mesh_cache_lock);
+    std::map<std::string, shapes::Mesh*>::iterator it = g_mesh_cache.find(cache_key);
+    if (it == g_mesh_cache.end())
+    {
+      shapes::Mesh *side = loadMeshSidecar(cache_key);
+      if (side)
+        it = g_mesh_cache.insert(std::make_pair(cache_key, side)).first;
+    }
+    if (it != g_mesh_cache.end())
+      return new shapes::Mesh(it->second);
+  }
+
   resource_retriever::Retriever retriever;
   resource_retriever::MemoryResource res;
   try {
@@ -344,11 +564,15 @@ shapes::Mesh* createMeshFromFilename(const std::string& filename, const tf::Vect
     return NULL;
   }
   aiMatrix4x4 transform = node->mTransformation;
-  tf::Vector3 ts(1.0, 1.0, 1.0);
-  if(scale != NULL) {
-    ts = (*scale);
+  shapes::Mesh *mesh = shapes::createMeshFromAsset(scene->mMeshes[node->mMeshes[0]], transform, mesh_scale);
+  if (mesh)
+  {
+    saveMeshSidecar(cache_key, mesh);
+    boost::mutex::scoped_lock lock(g_mesh_cache_lock);
+    if (g_mesh_cache.find(cache_key) == g_mesh_cache.end())
+      g_mesh_cache.insert(std::make_pair(cache_key, new shapes::Mesh(mesh)));
   }
-  return(shapes::createMeshFromAsset(scene->mMeshes[node->mMeshes[0]], transform, ts));
+  return mesh;
 }
 
 shapes::Mesh* createMeshFromAsset(const aiMesh* a, const aiMatrix4x4& transform, const tf::Vector3& scale)
@@ -62,6 +62,10 @@ private:
   //! Flag that tells us if the robot model was initialized successfully
   bool robot_model_initialized_;
 
+  //! Per-joint wrap-around flag, cached once from the urdf so update calls
+  //! don't have to re-fetch joint info from the model
+  std::map<std::string, bool> joint_wraparound_;
+
 public:
   UnNormalizeJointTrajectory();
   virtual ~UnNormalizeJointTrajectory();
@@ -84,6 +88,9 @@ UnNormalizeJointTrajectory<T>::UnNormalizeJointTrajectory()
   {
     robot_model_.initString(full_urdf_xml);
     robot_model_initialized_ = true;
+    for(std::map<std::string, boost::shared_ptr<urdf::Joint> >::const_iterator it = robot_model_.joints_.begin();
+        it != robot_model_.joints_.end(); it++)
+      joint_wraparound_[it->first] = (it->second->type == urdf::Joint::CONTINUOUS);
   }
 }
 
@@ -116,47 +123,53 @@ bool UnNormalizeJointTrajectory<T>::smooth(const T& trajectory_in,
     joint_values[trajectory_in.request.start_state.joint_state.name[i]] = trajectory_in.request.start_state.joint_state.position[i];
   }
 
-  std::vector<double> current_values;
-  std::vector<int> wraparound;
-  trajectory_msgs::JointTrajectory input_trajectory = trajectory_in.request.trajectory;
-  for (size_t i=0; i<input_trajectory.joint_names.size(); i++)
+  trajectory_msgs::JointTrajectory &trajectory = trajectory_out.request.trajectory;
+
+  std::vector<double> current_values(trajectory.joint_names.size());
+  std::vector<size_t> wrap_indices;
+  for (size_t i=0; i<trajectory.joint_names.size(); i++)
   {
-    std::string name = input_trajectory.joint_names[i];
-    if(joint_values.find(name) == joint_values.end()) {
+    const std::string &name = trajectory.joint_names[i];
+    std::map<std::string, double>::const_iterator value_it = joint_values.find(name);
+    if(value_it == joint_values.end()) {
       ROS_WARN_STREAM("No value set in start state for joint name " << name);
       return false;
     }
     //first waypoint is unnormalized relative to current joint states
-    current_values.push_back(joint_values[name]);
-    
-    boost::shared_ptr<const urdf::Joint> joint = robot_model_.getJoint(name);
-    if (joint.get() == NULL)
+    current_values[i] = value_it->second;
+
+    std::map<std::string, bool>::const_iterator wrap_it = joint_wraparound_.find(name);
+    if (wrap_it == joint_wraparound_.end())
     {
       ROS_ERROR("Joint name %s not found in urdf model", name.c_str());
       return false;
     }
-    if (joint->type == urdf::Joint::CONTINUOUS) wraparound.push_back(1);
-    else wraparound.push_back(0);
+    if (wrap_it->second)
+      wrap_indices.push_back(i);
   }
 
-  trajectory_msgs::JointTrajectory normalized_trajectory = input_trajectory;
-  for (size_t i=0; i<normalized_trajectory.points.size(); i++)
+  if (wrap_indices.empty())
+    return true;
+
+  //unwrap in place in the output trajectory, touching only the continuous
+  //joints at each waypoint
+  for (size_t i=0; i<trajectory.points.size(); i++)
   {
-    for (size_t j=0; j<normalized_trajectory.points[i].positions.size(); j++ )
+    std::vector<double> &positions = trajectory.points[i].positions;
+    for (size_t k=0; k<wrap_indices.size(); k++)
     {
-      if (!wraparound.at(j)) continue;
-      double current = current_values.at(j);
-      double traj = normalized_trajectory.points[i].positions[j];
+      size_t j = wrap_indices[k];
+      double current = current_values[j];
+      double traj = positions[j];
       while ( current - traj > M_PI ) traj += 2*M_PI;
       while ( traj - current > M_PI ) traj -= 2*M_PI;
-      ROS_DEBUG("Normalizing joint %s from %f to %f", normalized_trajectory.joint_names.at(j).c_str(), 
-                normalized_trajectory.points[i].positions[j], traj);
-      normalized_trajectory.points[i].positions[j] = traj;
+      ROS_DEBUG("Normalizing joint %s from %f to %f", trajectory.joint_names[j].c_str(),
+                positions[j], traj);
+      positions[j] = traj;
       //all other waypoints are unnormalized relative to the previous waypoint
-      current_values.at(j) = traj;
-    }  
+      current_values[j] = traj;
+    }
   }
-  trajectory_out.request.trajectory = normalized_trajectory;
   return true;
 }
 }
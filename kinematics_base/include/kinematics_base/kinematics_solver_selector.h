@@ -0,0 +1,292 @@
+/*********************************************************************
+*
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of Willow Garage, Inc. nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*
+*********************************************************************/
+#ifndef KINEMATICS_SOLVER_SELECTOR_
+#define KINEMATICS_SOLVER_SELECTOR_
+
+#include <kinematics_base/kinematics_base.h>
+#include <ros/ros.h>
+#include <cmath>
+#include <cfloat>
+
+namespace kinematics {
+
+/**
+ * @class KinematicsSolverSelector
+ * @brief A KinematicsBase implementation that holds several candidate
+ * solvers for the same group and routes every call to the one that a
+ * one-time micro-benchmark at initialization found to be the fastest
+ * correct solver. A generated analytic solver then wins over the KDL
+ * fallback wherever one exists, without the selection being hardwired
+ * at launch.
+ *
+ * The benchmark needs sample joint configurations within the group's
+ * limits; supply them with setBenchmarkConfigurations() before
+ * initialize(). Each configuration is turned into a target pose via the
+ * candidate's own FK, solved with a different configuration as the
+ * seed, and the solution is verified by FK against the target. The
+ * candidate with the most verified solves wins; ties go to the lowest
+ * total solve time. Without samples (or with a single candidate) the
+ * first successfully initialized candidate is used.
+ */
+class KinematicsSolverSelector : public KinematicsBase {
+public:
+
+  KinematicsSolverSelector() : active_(NULL) {}
+
+  virtual ~KinematicsSolverSelector() {
+    for(unsigned int i = 0; i < candidates_.size(); i++) {
+      delete candidates_[i].solver;
+    }
+  }
+
+  /**
+   * @brief Add a candidate solver; the selector takes ownership.
+   * Candidates must be added before initialize().
+   */
+  void addCandidate(const std::string& plugin_name, KinematicsBase* solver) {
+    Candidate candidate;
+    candidate.plugin_name = plugin_name;
+    candidate.solver = solver;
+    candidates_.push_back(candidate);
+  }
+
+  /**
+   * @brief Joint configurations used as benchmark targets. They must be
+   * within the group's joint limits and in the solver joint order.
+   */
+  void setBenchmarkConfigurations(const std::vector<std::vector<double> >& configurations) {
+    benchmark_configurations_ = configurations;
+  }
+
+  /**
+   * @brief The plugin name of the solver calls are being routed to
+   */
+  const std::string& getSelectedSolverName() const {
+    return selected_name_;
+  }
+
+  virtual bool initialize(const std::string& group_name,
+                          const std::string& base_name,
+                          const std::string& tip_name,
+                          const double& search_discretization) {
+    setValues(group_name, base_name, tip_name, search_discretization);
+    std::vector<Candidate> initialized;
+    for(unsigned int i = 0; i < candidates_.size(); i++) {
+      if(candidates_[i].solver->initialize(group_name, base_name, tip_name, search_discretization)) {
+        initialized.push_back(candidates_[i]);
+      } else {
+        ROS_WARN_STREAM("Kinematics solver " << candidates_[i].plugin_name
+                        << " failed to initialize for group " << group_name << ", dropping it");
+        delete candidates_[i].solver;
+      }
+    }
+    candidates_ = initialized;
+    if(candidates_.empty()) {
+      ROS_ERROR_STREAM("No kinematics solver could be initialized for group " << group_name);
+      return false;
+    }
+    active_ = candidates_[0].solver;
+    selected_name_ = candidates_[0].plugin_name;
+    if(candidates_.size() > 1 && !benchmark_configurations_.empty()) {
+      benchmark();
+    }
+    return true;
+  }
+
+  virtual bool getPositionIK(const geometry_msgs::Pose &ik_pose,
+                             const std::vector<double> &ik_seed_state,
+                             std::vector<double> &solution,
+                             int &error_code) {
+    if(!active_) {
+      error_code = INACTIVE;
+      return false;
+    }
+    return active_->getPositionIK(ik_pose, ik_seed_state, solution, error_code);
+  }
+
+  virtual bool searchPositionIK(const geometry_msgs::Pose &ik_pose,
+                                const std::vector<double> &ik_seed_state,
+                                const double &timeout,
+                                std::vector<double> &solution,
+                                int &error_code) {
+    if(!active_) {
+      error_code = INACTIVE;
+      return false;
+    }
+    return active_->searchPositionIK(ik_pose, ik_seed_state, timeout, solution, error_code);
+  }
+
+  virtual bool searchPositionIK(const geometry_msgs::Pose &ik_pose,
+                                const std::vector<double> &ik_seed_state,
+                                const double &timeout,
+                                const unsigned int& redundancy,
+                                const double &consistency_limit,
+                                std::vector<double> &solution,
+                                int &error_code) {
+    if(!active_) {
+      error_code = INACTIVE;
+      return false;
+    }
+    return active_->searchPositionIK(ik_pose, ik_seed_state, timeout, redundancy,
+                                     consistency_limit, solution, error_code);
+  }
+
+  virtual bool searchPositionIK(const geometry_msgs::Pose &ik_pose,
+                                const std::vector<double> &ik_seed_state,
+                                const double &timeout,
+                                std::vector<double> &solution,
+                                const boost::function<void(const geometry_msgs::Pose &ik_pose,const std::vector<double> &ik_solution,int &error_code)> &desired_pose_callback,
+                                const boost::function<void(const geometry_msgs::Pose &ik_pose,const std::vector<double> &ik_solution,int &error_code)> &solution_callback,
+                                int &error_code) {
+    if(!active_) {
+      error_code = INACTIVE;
+      return false;
+    }
+    return active_->searchPositionIK(ik_pose, ik_seed_state, timeout, solution,
+                                     desired_pose_callback, solution_callback, error_code);
+  }
+
+  virtual bool searchPositionIK(const geometry_msgs::Pose &ik_pose,
+                                const std::vector<double> &ik_seed_state,
+                                const double &timeout,
+                                const unsigned int& redundancy,
+                                const double &consistency_limit,
+                                std::vector<double> &solution,
+                                const boost::function<void(const geometry_msgs::Pose &ik_pose,const std::vector<double> &ik_solution,int &error_code)> &desired_pose_callback,
+                                const boost::function<void(const geometry_msgs::Pose &ik_pose,const std::vector<double> &ik_solution,int &error_code)> &solution_callback,
+                                int &error_code) {
+    if(!active_) {
+      error_code = INACTIVE;
+      return false;
+    }
+    return active_->searchPositionIK(ik_pose, ik_seed_state, timeout, redundancy,
+                                     consistency_limit, solution,
+                                     desired_pose_callback, solution_callback, error_code);
+  }
+
+  virtual bool getPositionFK(const std::vector<std::string> &link_names,
+                             const std::vector<double> &joint_angles,
+                             std::vector<geometry_msgs::Pose> &poses) {
+    if(!active_) {
+      return false;
+    }
+    return active_->getPositionFK(link_names, joint_angles, poses);
+  }
+
+  virtual const std::vector<std::string>& getJointNames() const {
+    return active_->getJointNames();
+  }
+
+  virtual const std::vector<std::string>& getLinkNames() const {
+    return active_->getLinkNames();
+  }
+
+private:
+
+  struct Candidate {
+    std::string plugin_name;
+    KinematicsBase* solver;
+  };
+
+  static bool posesMatch(const geometry_msgs::Pose& a, const geometry_msgs::Pose& b) {
+    static const double position_tolerance = 1e-3;
+    static const double orientation_tolerance = 1e-3;
+    if(fabs(a.position.x - b.position.x) > position_tolerance ||
+       fabs(a.position.y - b.position.y) > position_tolerance ||
+       fabs(a.position.z - b.position.z) > position_tolerance) {
+      return false;
+    }
+    //quaternion dot product close to +-1 means the orientations agree
+    double dot = a.orientation.x*b.orientation.x + a.orientation.y*b.orientation.y +
+      a.orientation.z*b.orientation.z + a.orientation.w*b.orientation.w;
+    return fabs(dot) > 1.0 - orientation_tolerance;
+  }
+
+  void benchmark() {
+    unsigned int best_index = 0;
+    unsigned int best_solved = 0;
+    double best_time = DBL_MAX;
+    for(unsigned int i = 0; i < candidates_.size(); i++) {
+      KinematicsBase* solver = candidates_[i].solver;
+      std::vector<std::string> link_names(1, solver->getTipName());
+      unsigned int solved = 0;
+      double total_time = 0.0;
+      for(unsigned int j = 0; j < benchmark_configurations_.size(); j++) {
+        std::vector<geometry_msgs::Pose> target;
+        if(!solver->getPositionFK(link_names, benchmark_configurations_[j], target)) {
+          continue;
+        }
+        //seed with a different configuration so numeric solvers
+        //actually have to converge
+        const std::vector<double>& seed =
+          benchmark_configurations_[(j+1) % benchmark_configurations_.size()];
+        std::vector<double> solution;
+        int error_code;
+        ros::WallTime start = ros::WallTime::now();
+        bool solver_ok = solver->getPositionIK(target[0], seed, solution, error_code);
+        total_time += (ros::WallTime::now() - start).toSec();
+        if(!solver_ok) {
+          continue;
+        }
+        std::vector<geometry_msgs::Pose> reached;
+        if(solver->getPositionFK(link_names, solution, reached) &&
+           posesMatch(target[0], reached[0])) {
+          solved++;
+        }
+      }
+      ROS_INFO_STREAM("Kinematics solver " << candidates_[i].plugin_name << " solved "
+                      << solved << "/" << benchmark_configurations_.size()
+                      << " benchmark poses in " << total_time << "s");
+      if(solved > best_solved || (solved == best_solved && total_time < best_time)) {
+        best_index = i;
+        best_solved = solved;
+        best_time = total_time;
+      }
+    }
+    active_ = candidates_[best_index].solver;
+    selected_name_ = candidates_[best_index].plugin_name;
+    ROS_INFO_STREAM("Routing kinematics for group " << getGroupName()
+                    << " to " << selected_name_);
+  }
+
+  std::vector<Candidate> candidates_;
+  std::vector<std::vector<double> > benchmark_configurations_;
+  KinematicsBase* active_;
+  std::string selected_name_;
+};
+}
+
+#endif
@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2008, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ */
+
+#include "collision_map_delta_display.h"
+#include "rviz/visualization_manager.h"
+#include "rviz/frame_manager.h"
+
+#include <tf/transform_listener.h>
+
+#include <boost/bind.hpp>
+
+#include <OGRE/OgreSceneNode.h>
+#include <OGRE/OgreSceneManager.h>
+
+#include <rviz/ogre_helpers/point_cloud.h>
+#include <rviz/properties/property.h>
+#include <rviz/properties/float_property.h>
+#include <rviz/properties/ros_topic_property.h>
+#include <rviz/properties/color_property.h>
+
+namespace mapping_rviz_plugin
+{
+
+static inline long long voxelKey(const geometry_msgs::Point32 &point, double resolution)
+{
+  // same quantization the CollisionSpaceMonitor uses: 21 bits per
+  // (offset) coordinate so a voxel re-sent in a later delta maps to
+  // the same key
+  long long x = (long long)floor(point.x / resolution + 0.5) + (1 << 20);
+  long long y = (long long)floor(point.y / resolution + 0.5) + (1 << 20);
+  long long z = (long long)floor(point.z / resolution + 0.5) + (1 << 20);
+  return (x << 42) | (y << 21) | z;
+}
+
+CollisionMapDeltaDisplay::CollisionMapDeltaDisplay()
+  : Display()
+  , color_(0.1f, 1.0f, 0.0f)
+  , resolution_(0.0f)
+  , tf_filter_(NULL)
+{
+  color_property_ = new rviz::ColorProperty ("Color", QColor(255, 0, 0), "", this,
+                                             SLOT (changedColor() ), this);
+
+  alpha_property_ = new rviz::FloatProperty ("Alpha", 1.0f, "", this,
+                                             SLOT( changedAlpha() ), this);
+
+  topic_property_ = new rviz::RosTopicProperty("Topic", "", ros::message_traits::datatype<arm_navigation_msgs::CollisionMapDelta>(), "", this,
+                                               SLOT(changedTopic()), this);
+}
+
+void CollisionMapDeltaDisplay::onInitialize()
+{
+  tf_filter_ = new tf::MessageFilter<arm_navigation_msgs::CollisionMapDelta>(*context_->getTFClient(), "", 2, update_nh_);
+
+  scene_node_ = scene_manager_->getRootSceneNode()->createChildSceneNode();
+
+  cloud_ = new rviz::PointCloud();
+  alpha_ = 1.0f;
+  cloud_->setAlpha(alpha_);
+  cloud_->setRenderMode(rviz::PointCloud::RM_BOXES);
+  scene_node_->attachObject(cloud_);
+
+  tf_filter_->connectInput(sub_);
+  tf_filter_->registerCallback(boost::bind(&CollisionMapDeltaDisplay::incomingMessage, this, _1));
+}
+
+CollisionMapDeltaDisplay::~CollisionMapDeltaDisplay()
+{
+  unsubscribe();
+  clear();
+
+  delete tf_filter_;
+  delete cloud_;
+}
+
+void CollisionMapDeltaDisplay::clear()
+{
+  voxels_.clear();
+  map_frame_.clear();
+  cloud_->clear();
+}
+
+void CollisionMapDeltaDisplay::changedTopic()
+{
+  unsubscribe();
+  clear();
+  topic_ = topic_property_->getStdString();
+  subscribe();
+}
+
+void CollisionMapDeltaDisplay::changedColor(void)
+{
+  color_ = rviz::Color(color_property_->getColor().redF(),
+                       color_property_->getColor().greenF(),
+                       color_property_->getColor().blueF());
+
+  rebuildCloud();
+}
+
+void CollisionMapDeltaDisplay::changedAlpha()
+{
+  alpha_ = alpha_property_->getFloat();
+  cloud_->setAlpha(alpha_);
+  rebuildCloud();
+}
+
+void CollisionMapDeltaDisplay::subscribe()
+{
+  if (!isEnabled())
+    return;
+
+  if (!topic_.empty())
+  {
+    sub_.subscribe(update_nh_, topic_, 1);
+  }
+}
+
+void CollisionMapDeltaDisplay::unsubscribe()
+{
+  sub_.unsubscribe();
+}
+
+void CollisionMapDeltaDisplay::onEnable()
+{
+  scene_node_->setVisible(true);
+  subscribe();
+}
+
+void CollisionMapDeltaDisplay::onDisable()
+{
+  unsubscribe();
+  clear();
+  scene_node_->setVisible(false);
+}
+
+void CollisionMapDeltaDisplay::fixedFrameChanged()
+{
+  tf_filter_->setTargetFrame(fixed_frame_.toStdString());
+  clear();
+}
+
+void CollisionMapDeltaDisplay::update(float wall_dt, float ros_dt)
+{
+}
+
+void CollisionMapDeltaDisplay::rebuildCloud()
+{
+  cloud_->clear();
+
+  if (voxels_.empty())
+    return;
+
+  typedef std::vector<rviz::PointCloud::Point> V_Point;
+  V_Point points;
+  points.resize(voxels_.size());
+  unsigned int i = 0;
+  for (std::map<long long, geometry_msgs::Point32>::const_iterator it = voxels_.begin() ; it != voxels_.end() ; ++it, ++i)
+  {
+    rviz::PointCloud::Point & current_point = points[i];
+
+    current_point.position.x = it->second.x;
+    current_point.position.y = it->second.y;
+    current_point.position.z = it->second.z;
+    current_point.color = Ogre::ColourValue(color_.r_, color_.g_, color_.b_, alpha_);
+  }
+  cloud_->addPoints(&points.front(), points.size());
+}
+
+void CollisionMapDeltaDisplay::processMessage(const arm_navigation_msgs::CollisionMapDelta::ConstPtr& msg)
+{
+  if (!msg)
+  {
+    return;
+  }
+
+  Ogre::Vector3 position;
+  Ogre::Quaternion orientation;
+  if (!context_->getFrameManager()->getTransform(msg->header, position, orientation))
+  {
+    ROS_DEBUG( "Error transforming from frame '%s' to frame '%s'", msg->header.frame_id.c_str(), fixed_frame_.toStdString().c_str() );
+  }
+
+  scene_node_->setPosition( position );
+  scene_node_->setOrientation( orientation );
+
+  bool restart = msg->keyframe || msg->header.frame_id != map_frame_;
+  if (restart)
+  {
+    voxels_.clear();
+    map_frame_ = msg->header.frame_id;
+  }
+  if (msg->resolution != resolution_)
+  {
+    resolution_ = msg->resolution;
+    cloud_->setDimensions(resolution_, resolution_, resolution_);
+  }
+
+  for (unsigned int i = 0 ; i < msg->removed.size() ; ++i)
+    voxels_.erase(voxelKey(msg->removed[i], msg->resolution));
+
+  typedef std::vector<rviz::PointCloud::Point> V_Point;
+  V_Point fresh;
+  fresh.reserve(msg->added.size());
+  for (unsigned int i = 0 ; i < msg->added.size() ; ++i)
+  {
+    std::pair<std::map<long long, geometry_msgs::Point32>::iterator, bool> ins =
+      voxels_.insert(std::make_pair(voxelKey(msg->added[i], msg->resolution), msg->added[i]));
+    if (ins.second)
+    {
+      rviz::PointCloud::Point point;
+      point.position.x = msg->added[i].x;
+      point.position.y = msg->added[i].y;
+      point.position.z = msg->added[i].z;
+      point.color = Ogre::ColourValue(color_.r_, color_.g_, color_.b_, alpha_);
+      fresh.push_back(point);
+    }
+  }
+
+  // a delta that only adds voxels appends to the batched geometry;
+  // everything else invalidates existing points and forces a rebuild
+  if (!restart && msg->removed.empty())
+  {
+    if (!fresh.empty())
+      cloud_->addPoints(&fresh.front(), fresh.size());
+  }
+  else
+    rebuildCloud();
+}
+
+void CollisionMapDeltaDisplay::incomingMessage(const arm_navigation_msgs::CollisionMapDelta::ConstPtr& message)
+{
+  processMessage(message);
+}
+
+void CollisionMapDeltaDisplay::reset()
+{
+  clear();
+}
+
+
+} // namespace mapping_rviz_plugin
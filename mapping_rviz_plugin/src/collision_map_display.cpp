@@ -40,6 +40,11 @@
 #include <OGRE/OgreSceneNode.h>
 #include <OGRE/OgreSceneManager.h>
 #include <OGRE/OgreBillboardSet.h>
+#include <OGRE/OgreCamera.h>
+#include <OGRE/OgreSphere.h>
+
+#include <rviz/view_manager.h>
+#include <rviz/view_controller.h>
 
 #include <rviz/ogre_helpers/point_cloud.h>
 #include <rviz/properties/property.h>
@@ -58,6 +63,9 @@ CollisionMapDisplay::CollisionMapDisplay()
   , color_(0.1f, 1.0f, 0.0f)
   , render_operation_(collision_render_ops::CBoxes)
   , override_color_(false)
+  , view_culling_(false)
+  , lod_distance_(0.0f)
+  , culled_dirty_(false)
   , tf_filter_(NULL)
 {
   override_color_property_ = new rviz::BoolProperty ("Override Color", false, "", this, SLOT (changedOverrideColor() ), this);
@@ -78,6 +86,13 @@ CollisionMapDisplay::CollisionMapDisplay()
   
   topic_property_ = new rviz::RosTopicProperty("Topic", "", ros::message_traits::datatype<arm_navigation_msgs::CollisionMap>(), "", this,
                                                SLOT(changedTopic()), this);
+
+  view_culling_property_ = new rviz::BoolProperty ("View Culling", false, "Only submit voxels the camera can see", this,
+                                                   SLOT( changedViewCulling() ), this);
+
+  lod_distance_property_ = new rviz::FloatProperty ("LOD Distance", 0.0f, "Merge 8 voxels into one double-size box beyond this distance (0 disables)", this,
+                                                    SLOT( changedLodDistance() ), this);
+  lod_distance_property_->setMin(0.0);
 }
 
 void CollisionMapDisplay::onInitialize() 
@@ -95,6 +110,11 @@ void CollisionMapDisplay::onInitialize()
   cloud_->setAlpha(alpha_);
   scene_node_->attachObject(cloud_);
 
+  lod_cloud_ = new rviz::PointCloud();
+  lod_cloud_->setAlpha(alpha_);
+  lod_cloud_->setRenderMode(rviz::PointCloud::RM_BOXES);
+  scene_node_->attachObject(lod_cloud_);
+
   tf_filter_->connectInput(sub_);
   tf_filter_->registerCallback(boost::bind(&CollisionMapDisplay::incomingMessage, this, _1));
 }
@@ -106,11 +126,13 @@ CollisionMapDisplay::~CollisionMapDisplay()
 
   delete tf_filter_;
   delete cloud_;
+  delete lod_cloud_;
 }
 
 void CollisionMapDisplay::clear()
 {
   cloud_->clear();
+  lod_cloud_->clear();
 }
 
 void CollisionMapDisplay::changedTopic()
@@ -159,9 +181,25 @@ void CollisionMapDisplay::changedAlpha()
 {
   alpha_ = alpha_property_->getFloat();
   cloud_->setAlpha(alpha_);
+  lod_cloud_->setAlpha(alpha_);
   processMessage(current_message_);
 }
 
+void CollisionMapDisplay::changedViewCulling()
+{
+  view_culling_ = view_culling_property_->getBool();
+
+  if (!view_culling_)
+    lod_cloud_->clear();
+  processMessage(current_message_);
+}
+
+void CollisionMapDisplay::changedLodDistance()
+{
+  lod_distance_ = lod_distance_property_->getFloat();
+  culled_dirty_ = true;
+}
+
 void CollisionMapDisplay::subscribe()
 {
   if (!isEnabled())
@@ -199,12 +237,116 @@ void CollisionMapDisplay::fixedFrameChanged()
 
 void CollisionMapDisplay::update(float wall_dt, float ros_dt)
 {
+  if (!view_culling_ || !current_message_)
+    return;
+
+  rviz::ViewController* view = context_->getViewManager()->getCurrent();
+  if (!view)
+    return;
+  Ogre::Camera* camera = view->getCamera();
+  if (!camera)
+    return;
+
+  // only recompute the visible set when the camera actually moved
+  Ogre::Vector3 camera_position = camera->getDerivedPosition();
+  Ogre::Quaternion camera_orientation = camera->getDerivedOrientation();
+  if (!culled_dirty_ &&
+      camera_position.distance(last_camera_position_) < 0.01f &&
+      camera_orientation.equals(last_camera_orientation_, Ogre::Radian(0.001f)))
+    return;
+
+  last_camera_position_ = camera_position;
+  last_camera_orientation_ = camera_orientation;
+  culled_dirty_ = false;
+
+  updateCulledCloud(camera);
+}
+
+void CollisionMapDisplay::updateCulledCloud(Ogre::Camera* camera)
+{
+  const arm_navigation_msgs::CollisionMap::ConstPtr& msg = current_message_;
+
+  clear();
+
+  if (!msg || msg->boxes.empty())
+    return;
+
+  //use first box extents
+  float res = msg->boxes[0].extents.x;
+  cloud_->setDimensions(msg->boxes[0].extents.x,
+                        msg->boxes[0].extents.y,
+                        msg->boxes[0].extents.z);
+  lod_cloud_->setDimensions(2.0f * msg->boxes[0].extents.x,
+                            2.0f * msg->boxes[0].extents.y,
+                            2.0f * msg->boxes[0].extents.z);
+
+  Ogre::Vector3 node_position = scene_node_->_getDerivedPosition();
+  Ogre::Quaternion node_orientation = scene_node_->_getDerivedOrientation();
+  Ogre::Vector3 camera_position = camera->getDerivedPosition();
+  float radius = 0.87f * res;
+  float coarse = 2.0f * res;
+  Ogre::ColourValue color(color_.r_, color_.g_, color_.b_, alpha_);
+
+  typedef std::vector<rviz::PointCloud::Point> V_Point;
+  V_Point near_points;
+  near_points.reserve(msg->boxes.size());
+  // one entry per occupied 2x2x2 block of far voxels
+  std::map<long long, rviz::PointCloud::Point> far_blocks;
+
+  for (uint32_t i = 0; i < msg->boxes.size(); i++)
+  {
+    Ogre::Vector3 local(msg->boxes[i].center.x, msg->boxes[i].center.y, msg->boxes[i].center.z);
+    Ogre::Vector3 world = node_position + node_orientation * local;
+
+    if (!camera->isVisible(Ogre::Sphere(world, radius)))
+      continue;
+
+    if (lod_distance_ > 0.0f && world.distance(camera_position) > lod_distance_)
+    {
+      long long ix = (long long)floor(local.x / coarse) + (1 << 20);
+      long long iy = (long long)floor(local.y / coarse) + (1 << 20);
+      long long iz = (long long)floor(local.z / coarse) + (1 << 20);
+      long long key = (ix << 42) | (iy << 21) | iz;
+      if (far_blocks.find(key) == far_blocks.end())
+      {
+        rviz::PointCloud::Point point;
+        point.position.x = (ix - (1 << 20)) * coarse + res;
+        point.position.y = (iy - (1 << 20)) * coarse + res;
+        point.position.z = (iz - (1 << 20)) * coarse + res;
+        point.color = color;
+        far_blocks[key] = point;
+      }
+    }
+    else
+    {
+      rviz::PointCloud::Point point;
+      point.position.x = local.x;
+      point.position.y = local.y;
+      point.position.z = local.z;
+      point.color = color;
+      near_points.push_back(point);
+    }
+  }
+
+  if (!near_points.empty())
+    cloud_->addPoints(&near_points.front(), near_points.size());
+
+  if (!far_blocks.empty())
+  {
+    V_Point far_points;
+    far_points.reserve(far_blocks.size());
+    for (std::map<long long, rviz::PointCloud::Point>::const_iterator it = far_blocks.begin() ; it != far_blocks.end() ; ++it)
+      far_points.push_back(it->second);
+    lod_cloud_->addPoints(&far_points.front(), far_points.size());
+  }
 }
 
 void CollisionMapDisplay::processMessage(const arm_navigation_msgs::CollisionMap::ConstPtr& msg)
 {
   clear();
 
+  current_message_ = msg;
+
   if (!msg)
   {
     return;
@@ -222,10 +364,17 @@ void CollisionMapDisplay::processMessage(const arm_navigation_msgs::CollisionMap
   scene_node_->setPosition( position );
   scene_node_->setOrientation( orientation );
 
+  if (view_culling_)
+  {
+    // the next update() refills the clouds against the current camera
+    culled_dirty_ = true;
+    return;
+  }
+
   Ogre::ColourValue color;
 
   unsigned int num_boxes = msg->boxes.size();
-  ROS_DEBUG("Collision map contains %d boxes.", num_boxes); 
+  ROS_DEBUG("Collision map contains %d boxes.", num_boxes);
 
   typedef std::vector<rviz::PointCloud::Point> V_Point;
   V_Point points;
@@ -238,14 +387,14 @@ void CollisionMapDisplay::processMessage(const arm_navigation_msgs::CollisionMap
   for (uint32_t i = 0; i < num_boxes; i++)
   {
     rviz::PointCloud::Point & current_point = points[i];
-    
+
     current_point.position.x = msg->boxes[i].center.x;
     current_point.position.y = msg->boxes[i].center.y;
     current_point.position.z = msg->boxes[i].center.z;
     current_point.color = Ogre::ColourValue(color_.r_, color_.g_, color_.b_, alpha_);
   }
   cloud_->clear();
-  
+
   if (!points.empty())
   {
     cloud_->addPoints(&points.front(), points.size());
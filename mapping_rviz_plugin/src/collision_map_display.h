@@ -46,6 +46,9 @@
 #include <message_filters/subscriber.h>
 #include <tf/message_filter.h>
 
+#include <OGRE/OgreVector3.h>
+#include <OGRE/OgreQuaternion.h>
+
 namespace rviz
 {
 class PointCloud;
@@ -60,6 +63,7 @@ namespace Ogre
 {
 class SceneNode;
 class ManualObject;
+class Camera;
 }
 
 namespace mapping_rviz_plugin
@@ -95,6 +99,8 @@ public:
   void changedRenderOperation();
   void changedPointSize();
   void changedAlpha();
+  void changedViewCulling();
+  void changedLodDistance();
 
 
   virtual void update(float wall_dt, float ros_dt);
@@ -107,6 +113,12 @@ protected:
   void incomingMessage(const arm_navigation_msgs::CollisionMap::ConstPtr& message);
   void processMessage(const arm_navigation_msgs::CollisionMap::ConstPtr& message);
 
+  /**
+   * \brief Refill the clouds with only the voxels the camera can see,
+   * merging far voxels into double-size boxes past the LOD distance
+   */
+  void updateCulledCloud(Ogre::Camera* camera);
+
   // overrides from Display
   virtual void onEnable();
   virtual void onDisable();
@@ -118,9 +130,18 @@ protected:
   bool override_color_;
   float point_size_;
   float alpha_;
+  bool view_culling_;
+  float lod_distance_;
 
   Ogre::SceneNode* scene_node_;
   rviz::PointCloud* cloud_;
+  rviz::PointCloud* lod_cloud_;    ///< Double-size boxes for voxels past the LOD distance
+
+  /// Set when the map or a property changed and the culled clouds
+  /// need refilling even though the camera is still
+  bool culled_dirty_;
+  Ogre::Vector3 last_camera_position_;
+  Ogre::Quaternion last_camera_orientation_;
 
   arm_navigation_msgs::CollisionMap::ConstPtr current_message_;
   message_filters::Subscriber<arm_navigation_msgs::CollisionMap> sub_;
@@ -132,6 +153,8 @@ protected:
   rviz::EnumProperty* render_operation_property_;
   rviz::FloatProperty* point_size_property_;
   rviz::FloatProperty* alpha_property_;
+  rviz::BoolProperty* view_culling_property_;
+  rviz::FloatProperty* lod_distance_property_;
 };
 
 } // namespace mapping_rviz_plugin
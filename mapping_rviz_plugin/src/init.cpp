@@ -30,5 +30,7 @@
 #include <pluginlib/class_list_macros.h>
 
 #include "collision_map_display.h"
+#include "collision_map_delta_display.h"
 
 PLUGINLIB_DECLARE_CLASS( mapping_rviz_plugin, CollisionMap, mapping_rviz_plugin::CollisionMapDisplay, rviz::Display )
+PLUGINLIB_DECLARE_CLASS( mapping_rviz_plugin, CollisionMapDelta, mapping_rviz_plugin::CollisionMapDeltaDisplay, rviz::Display )
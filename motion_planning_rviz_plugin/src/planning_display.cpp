@@ -88,10 +88,11 @@ private:
 };
 
 PlanningDisplay::PlanningDisplay():
-  Display(), 
-  env_models_(NULL), 
+  Display(),
+  env_models_(NULL),
   kinematic_model_(NULL),
-  new_kinematic_path_(false), 
+  display_state_(NULL),
+  new_kinematic_path_(false),
   animating_path_(false), 
   state_display_time_(0.05f)
 {
@@ -130,6 +131,7 @@ PlanningDisplay::~PlanningDisplay()
 {
   unsubscribe();
 
+  delete display_state_;
   delete env_models_;
   delete robot_;
 }
@@ -200,14 +202,18 @@ void PlanningDisplay::load()
   descr.initXml(doc.RootElement());
   robot_->load( descr);
 
+  delete display_state_;
+  display_state_ = NULL;
   delete env_models_;
   env_models_ = new planning_environment::RobotModels(description_param_);
   kinematic_model_ = env_models_->getKinematicModel();
 
-  planning_models::KinematicState state(kinematic_model_);
-  state.setKinematicStateToDefault();
+  //the state is retained across frames so playback doesn't rebuild
+  //the kinematic tree on every update
+  display_state_ = new planning_models::KinematicState(kinematic_model_);
+  display_state_->setKinematicStateToDefault();
 
-  //robot_->update(PlanningLinkUpdater(&state));
+  //robot_->update(PlanningLinkUpdater(display_state_));
 }
 
 void PlanningDisplay::onEnable()
@@ -261,7 +267,7 @@ void PlanningDisplay::unadvertise()
 
 void PlanningDisplay::update(float wall_dt, float ros_dt)
 {
-  if (!kinematic_model_)
+  if (!kinematic_model_ || !display_state_)
     return;
 
   if (!animating_path_ && !new_kinematic_path_ && loop_display_ && displaying_kinematic_path_message_)
@@ -269,8 +275,6 @@ void PlanningDisplay::update(float wall_dt, float ros_dt)
       new_kinematic_path_ = true;
       incoming_kinematic_path_message_ = displaying_kinematic_path_message_;
   }
-  
-  planning_models::KinematicState state(kinematic_model_);
 
   if (!animating_path_ && new_kinematic_path_)
   {
@@ -281,8 +285,10 @@ void PlanningDisplay::update(float wall_dt, float ros_dt)
     current_state_ = -1;
     current_state_time_ = state_display_time_ + 1.0f;
 
+    //the fixed robot state only needs applying once per trajectory;
+    //playback below just overwrites the joints the trajectory names
     for(unsigned int i = 0; i < displaying_kinematic_path_message_->robot_state.multi_dof_joint_state.joint_names.size(); i++) {
-      planning_models::KinematicState::JointState* js = state.getJointState(displaying_kinematic_path_message_->robot_state.multi_dof_joint_state.joint_names[i]);
+      planning_models::KinematicState::JointState* js = display_state_->getJointState(displaying_kinematic_path_message_->robot_state.multi_dof_joint_state.joint_names[i]);
       if(!js) continue;
       if(displaying_kinematic_path_message_->robot_state.multi_dof_joint_state.frame_ids[i] != js->getParentFrameId() ||
          displaying_kinematic_path_message_->robot_state.multi_dof_joint_state.child_frame_ids[i] != js->getChildFrameId()) {
@@ -294,39 +300,21 @@ void PlanningDisplay::update(float wall_dt, float ros_dt)
       }
     }
 
-    std::map<std::string, double> joint_state_map;
+    joint_state_map_.clear();
     for (unsigned int i = 0 ; i < displaying_kinematic_path_message_->robot_state.joint_state.name.size(); ++i)
     {
-      joint_state_map[displaying_kinematic_path_message_->robot_state.joint_state.name[i]] = displaying_kinematic_path_message_->robot_state.joint_state.position[i];
+      joint_state_map_[displaying_kinematic_path_message_->robot_state.joint_state.name[i]] = displaying_kinematic_path_message_->robot_state.joint_state.position[i];
     }
     //overwriting with vals in first value in trajectory
     for(unsigned int i = 0; i < displaying_kinematic_path_message_->trajectory.joint_trajectory.joint_names.size(); i++) {
-      joint_state_map[displaying_kinematic_path_message_->trajectory.joint_trajectory.joint_names[i]] = displaying_kinematic_path_message_->trajectory.joint_trajectory.points[0].positions[i];
+      joint_state_map_[displaying_kinematic_path_message_->trajectory.joint_trajectory.joint_names[i]] = displaying_kinematic_path_message_->trajectory.joint_trajectory.points[0].positions[i];
     }
-    state.setKinematicState(joint_state_map);
-    robot_->update(PlanningLinkUpdater(&state));
+    display_state_->setKinematicState(joint_state_map_);
+    robot_->update(PlanningLinkUpdater(display_state_));
   }
 
   if (animating_path_)
   {
-
-    for(unsigned int i = 0; i < displaying_kinematic_path_message_->robot_state.multi_dof_joint_state.joint_names.size(); i++) {
-      planning_models::KinematicState::JointState* js = state.getJointState(displaying_kinematic_path_message_->robot_state.multi_dof_joint_state.joint_names[i]);
-      if(!js) continue;
-      if(displaying_kinematic_path_message_->robot_state.multi_dof_joint_state.frame_ids[i] != js->getParentFrameId() ||
-         displaying_kinematic_path_message_->robot_state.multi_dof_joint_state.child_frame_ids[i] != js->getChildFrameId()) {
-        ROS_WARN_STREAM("Robot state msg has bad multi_dof transform");
-      } else {
-        tf::StampedTransform transf;
-        tf::poseMsgToTF(displaying_kinematic_path_message_->robot_state.multi_dof_joint_state.poses[i], transf);
-        js->setJointStateValues(transf);
-      }
-    }
-    std::map<std::string, double> joint_state_map;
-    for (unsigned int i = 0 ; i < displaying_kinematic_path_message_->robot_state.joint_state.name.size(); ++i)
-    {
-      joint_state_map[displaying_kinematic_path_message_->robot_state.joint_state.name[i]] = displaying_kinematic_path_message_->robot_state.joint_state.position[i];
-    }
     if (current_state_time_ > state_display_time_)
     {
       ++current_state_;
@@ -336,34 +324,34 @@ void PlanningDisplay::update(float wall_dt, float ros_dt)
       if ((size_t) current_state_ < displaying_kinematic_path_message_->trajectory.joint_trajectory.points.size())
       {
         for(unsigned int i = 0; i < displaying_kinematic_path_message_->trajectory.joint_trajectory.joint_names.size(); i++) {
-          joint_state_map[displaying_kinematic_path_message_->trajectory.joint_trajectory.joint_names[i]] = displaying_kinematic_path_message_->trajectory.joint_trajectory.points[current_state_].positions[i];
+          joint_state_map_[displaying_kinematic_path_message_->trajectory.joint_trajectory.joint_names[i]] = displaying_kinematic_path_message_->trajectory.joint_trajectory.points[current_state_].positions[i];
         }
 
-        state.setKinematicState(joint_state_map);
-	bool updKstate = false;	
+        display_state_->setKinematicState(joint_state_map_);
+	bool updKstate = false;
 	for(unsigned int i = 0; i < displaying_kinematic_path_message_->trajectory.multi_dof_joint_trajectory.joint_names.size(); i++) {
-	    planning_models::KinematicState::JointState* js = state.getJointState(displaying_kinematic_path_message_->trajectory.multi_dof_joint_trajectory.joint_names[i]);
+	    planning_models::KinematicState::JointState* js = display_state_->getJointState(displaying_kinematic_path_message_->trajectory.multi_dof_joint_trajectory.joint_names[i]);
 	    if(!js) continue;
 	    if(displaying_kinematic_path_message_->trajectory.multi_dof_joint_trajectory.frame_ids[i] != js->getParentFrameId() ||
 	       displaying_kinematic_path_message_->trajectory.multi_dof_joint_trajectory.child_frame_ids[i] != js->getChildFrameId()) {
 		ROS_WARN_STREAM("Robot state msg has bad multi_dof transform");
 	    } else {
-		updKstate = true;	
+		updKstate = true;
 		tf::StampedTransform transf;
 		tf::poseMsgToTF(displaying_kinematic_path_message_->trajectory.multi_dof_joint_trajectory.points[current_state_].poses[i], transf);
 		js->setJointStateValues(transf);
 	    }
 	}
 	if (updKstate)
-	    state.updateKinematicLinks();
-	
-        robot_->update(PlanningLinkUpdater(&state));
+	    display_state_->updateKinematicLinks();
+
+        robot_->update(PlanningLinkUpdater(display_state_));
       }
       else
       {
         animating_path_ = false;
         std_msgs::Bool done;
-        done.data = !animating_path_;        
+        done.data = !animating_path_;
         state_publisher_.publish(done);
       }
 
@@ -48,6 +48,7 @@ class SceneNode;
 namespace planning_models
 {
 class KinematicModel;
+class KinematicState;
 }
 
 namespace planning_environment
@@ -164,6 +165,8 @@ protected:
   std::string kinematic_path_topic_;
   planning_environment::RobotModels* env_models_;
   const planning_models::KinematicModel* kinematic_model_;
+  planning_models::KinematicState* display_state_;  ///< Retained between frames; playback only writes the joints the trajectory names
+  std::map<std::string, double> joint_state_map_;   ///< Working joint value map, seeded once per trajectory from the robot state
   arm_navigation_msgs::DisplayTrajectory::ConstPtr incoming_kinematic_path_message_;
   arm_navigation_msgs::DisplayTrajectory::ConstPtr displaying_kinematic_path_message_;
   bool new_kinematic_path_;
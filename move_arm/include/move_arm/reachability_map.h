@@ -0,0 +1,293 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2011, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVE_ARM_REACHABILITY_MAP_H_
+#define MOVE_ARM_REACHABILITY_MAP_H_
+
+#include <planning_models/kinematic_state.h>
+#include <ros/console.h>
+#include <tf/LinearMath/Vector3.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace move_arm
+{
+
+/**
+   @brief Voxel map of the positions a group's tip link can reach,
+   built offline by sampling forward kinematics over the group's
+   joint bounds and consulted online to reject pose goals that are
+   outside the arm's reach without spending planner time on them.
+
+   Positions are expressed in the frame of the kinematic model's root
+   link, so the map stays valid wherever the robot is. The map is
+   conservative: reachable voxels are dilated by one cell, so a false
+   "unreachable" requires the goal to be at least one resolution step
+   away from every sampled tip position.
+*/
+class ReachabilityMap
+{
+public:
+  ReachabilityMap(void) : resolution_(0.0)
+  {
+    dims_[0] = dims_[1] = dims_[2] = 0;
+    origin_[0] = origin_[1] = origin_[2] = 0.0;
+  }
+
+  bool isLoaded(void) const
+  {
+    return !voxels_.empty();
+  }
+
+  /** @brief Name of the group the map was sampled over */
+  const std::string& getGroupName(void) const
+  {
+    return group_name_;
+  }
+
+  /** @brief Link whose reachable positions the map records */
+  const std::string& getTipLink(void) const
+  {
+    return tip_link_;
+  }
+
+  /** @brief Sample the group's joint bounds uniformly and record
+      which voxels the tip link reaches, in the root link frame. The
+      state is used as FK scratch space and is left at the last
+      sample. Returns false if the group or link is unknown. */
+  bool build(planning_models::KinematicState& state,
+             const std::string& group_name,
+             const std::string& tip_link,
+             double resolution,
+             unsigned int samples)
+  {
+    planning_models::KinematicState::JointStateGroup* group = state.getJointStateGroup(group_name);
+    if(!group) {
+      ROS_ERROR_STREAM("No group " << group_name << " to build reachability map for");
+      return false;
+    }
+    const planning_models::KinematicState::LinkState* tip_state = state.getLinkState(tip_link);
+    if(!tip_state) {
+      ROS_ERROR_STREAM("No link " << tip_link << " to build reachability map for");
+      return false;
+    }
+    const std::string root_link = state.getKinematicModel()->getRoot()->getChildLinkModel()->getName();
+    const planning_models::KinematicState::LinkState* root_state = state.getLinkState(root_link);
+
+    //first pass gathers the tip positions and their bounds so the
+    //grid can be sized before any voxel is marked
+    std::vector<tf::Vector3> positions;
+    positions.reserve(samples);
+    tf::Vector3 low(0.0, 0.0, 0.0), high(0.0, 0.0, 0.0);
+    std::vector<double> values;
+    for(unsigned int i = 0; i < samples; i++) {
+      group->sampleUniform(values);
+      group->setKinematicState(values);
+      tf::Vector3 p = root_state->getGlobalLinkTransform().inverse() *
+        tip_state->getGlobalLinkTransform().getOrigin();
+      if(positions.empty()) {
+        low = high = p;
+      } else {
+        low.setMin(p);
+        high.setMax(p);
+      }
+      positions.push_back(p);
+    }
+    if(positions.empty()) {
+      return false;
+    }
+
+    group_name_ = group_name;
+    tip_link_ = tip_link;
+    resolution_ = resolution;
+    //one cell of margin on every side leaves room for the dilation
+    for(unsigned int i = 0; i < 3; i++) {
+      origin_[i] = low[i] - resolution;
+      dims_[i] = (unsigned int)((high[i] - origin_[i]) / resolution) + 3;
+    }
+    voxels_.clear();
+    voxels_.resize(dims_[0] * dims_[1] * dims_[2], 0);
+    for(unsigned int i = 0; i < positions.size(); i++) {
+      int ix, iy, iz;
+      if(voxelIndices(positions[i], ix, iy, iz)) {
+        voxels_[voxelIndex(ix, iy, iz)] = 1;
+      }
+    }
+    dilate();
+    return true;
+  }
+
+  /** @brief Whether a position in the root link frame falls in a
+      voxel some sample reached, or next to one */
+  bool isReachable(const tf::Vector3& position) const
+  {
+    int ix, iy, iz;
+    if(!voxelIndices(position, ix, iy, iz)) {
+      return false;
+    }
+    return voxels_[voxelIndex(ix, iy, iz)] != 0;
+  }
+
+  bool save(const std::string& filename) const
+  {
+    std::ofstream out(filename.c_str(), std::ios::out | std::ios::binary);
+    if(!out) {
+      ROS_ERROR_STREAM("Unable to open " << filename << " for writing reachability map");
+      return false;
+    }
+    out.write(magic(), 8);
+    writeString(out, group_name_);
+    writeString(out, tip_link_);
+    out.write((const char*)&resolution_, sizeof(resolution_));
+    out.write((const char*)origin_, sizeof(origin_));
+    out.write((const char*)dims_, sizeof(dims_));
+    out.write((const char*)&voxels_.front(), voxels_.size());
+    return out.good();
+  }
+
+  bool load(const std::string& filename)
+  {
+    std::ifstream in(filename.c_str(), std::ios::in | std::ios::binary);
+    if(!in) {
+      ROS_WARN_STREAM("Unable to open reachability map " << filename);
+      return false;
+    }
+    char header[8];
+    in.read(header, 8);
+    if(!in.good() || std::string(header, 8) != magic()) {
+      ROS_WARN_STREAM("File " << filename << " is not a reachability map");
+      return false;
+    }
+    readString(in, group_name_);
+    readString(in, tip_link_);
+    in.read((char*)&resolution_, sizeof(resolution_));
+    in.read((char*)origin_, sizeof(origin_));
+    in.read((char*)dims_, sizeof(dims_));
+    if(!in.good() || resolution_ <= 0.0) {
+      ROS_WARN_STREAM("Reachability map " << filename << " is malformed");
+      voxels_.clear();
+      return false;
+    }
+    voxels_.resize(dims_[0] * dims_[1] * dims_[2]);
+    in.read((char*)&voxels_.front(), voxels_.size());
+    if(!in.good()) {
+      ROS_WARN_STREAM("Reachability map " << filename << " is truncated");
+      voxels_.clear();
+      return false;
+    }
+    return true;
+  }
+
+private:
+
+  bool voxelIndices(const tf::Vector3& position, int& ix, int& iy, int& iz) const
+  {
+    ix = (int)((position.x() - origin_[0]) / resolution_);
+    iy = (int)((position.y() - origin_[1]) / resolution_);
+    iz = (int)((position.z() - origin_[2]) / resolution_);
+    return ix >= 0 && ix < (int)dims_[0] &&
+           iy >= 0 && iy < (int)dims_[1] &&
+           iz >= 0 && iz < (int)dims_[2];
+  }
+
+  unsigned int voxelIndex(int ix, int iy, int iz) const
+  {
+    return ((unsigned int)ix * dims_[1] + (unsigned int)iy) * dims_[2] + (unsigned int)iz;
+  }
+
+  /** @brief Mark every voxel adjacent to a reached one, so goals
+      between sparse samples are not rejected */
+  void dilate(void)
+  {
+    std::vector<unsigned char> dilated = voxels_;
+    for(int ix = 0; ix < (int)dims_[0]; ix++) {
+      for(int iy = 0; iy < (int)dims_[1]; iy++) {
+        for(int iz = 0; iz < (int)dims_[2]; iz++) {
+          if(!voxels_[voxelIndex(ix, iy, iz)]) {
+            continue;
+          }
+          for(int dx = -1; dx <= 1; dx++) {
+            for(int dy = -1; dy <= 1; dy++) {
+              for(int dz = -1; dz <= 1; dz++) {
+                int nx = ix + dx, ny = iy + dy, nz = iz + dz;
+                if(nx >= 0 && nx < (int)dims_[0] &&
+                   ny >= 0 && ny < (int)dims_[1] &&
+                   nz >= 0 && nz < (int)dims_[2]) {
+                  dilated[voxelIndex(nx, ny, nz)] = 1;
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+    voxels_.swap(dilated);
+  }
+
+  static void writeString(std::ofstream& out, const std::string& s)
+  {
+    unsigned int length = s.size();
+    out.write((const char*)&length, sizeof(length));
+    out.write(s.c_str(), length);
+  }
+
+  static void readString(std::ifstream& in, std::string& s)
+  {
+    unsigned int length = 0;
+    in.read((char*)&length, sizeof(length));
+    std::vector<char> buf(length);
+    if(length > 0) {
+      in.read(&buf.front(), length);
+    }
+    s.assign(buf.begin(), buf.end());
+  }
+
+  static const char* magic(void)
+  {
+    return "ARMREACH";
+  }
+
+  std::string group_name_;
+  std::string tip_link_;
+  double resolution_;
+  double origin_[3];
+  unsigned int dims_[3];
+  std::vector<unsigned char> voxels_;
+};
+
+}
+
+#endif
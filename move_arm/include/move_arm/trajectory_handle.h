@@ -0,0 +1,117 @@
+/*********************************************************************
+*
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*
+*********************************************************************/
+
+#ifndef MOVE_ARM_TRAJECTORY_HANDLE_
+#define MOVE_ARM_TRAJECTORY_HANDLE_
+
+#include <trajectory_msgs/JointTrajectory.h>
+#include <boost/shared_ptr.hpp>
+
+namespace move_arm
+{
+
+/** @brief Refcounted handle to a JointTrajectory payload shared
+    between the execution state machine stages. Copying a handle
+    shares the payload; read() gives an immutable view and write()
+    clones the payload first only if another handle still references
+    it, so passing multi-thousand point trajectories around stops
+    costing a full copy per stage. */
+class TrajectoryHandle
+{
+public:
+  TrajectoryHandle(void)
+  {
+  }
+
+  /** @brief Take the contents of a trajectory the caller no longer
+      needs, leaving it empty; no points are copied */
+  void takeFrom(trajectory_msgs::JointTrajectory &trajectory)
+  {
+    trajectory_.reset(new trajectory_msgs::JointTrajectory());
+    trajectory_->header = trajectory.header;
+    trajectory_->joint_names.swap(trajectory.joint_names);
+    trajectory_->points.swap(trajectory.points);
+  }
+
+  /** @brief Take the payload of another handle, leaving it empty */
+  void takeFrom(TrajectoryHandle &other)
+  {
+    trajectory_ = other.trajectory_;
+    other.trajectory_.reset();
+  }
+
+  /** @brief Read-only view of the payload; an empty trajectory if unset */
+  const trajectory_msgs::JointTrajectory& read(void) const
+  {
+    if(!trajectory_)
+      return emptyTrajectory();
+    return *trajectory_;
+  }
+
+  /** @brief Mutable view of the payload; clones it first only if
+      another handle still shares it (copy-on-write) */
+  trajectory_msgs::JointTrajectory& write(void)
+  {
+    if(!trajectory_)
+      trajectory_.reset(new trajectory_msgs::JointTrajectory());
+    else if(!trajectory_.unique())
+      trajectory_.reset(new trajectory_msgs::JointTrajectory(*trajectory_));
+    return *trajectory_;
+  }
+
+  bool empty(void) const
+  {
+    return !trajectory_ || trajectory_->points.empty();
+  }
+
+  void clear(void)
+  {
+    trajectory_.reset();
+  }
+
+private:
+  static const trajectory_msgs::JointTrajectory& emptyTrajectory(void)
+  {
+    static const trajectory_msgs::JointTrajectory empty;
+    return empty;
+  }
+
+  boost::shared_ptr<trajectory_msgs::JointTrajectory> trajectory_;
+};
+
+}
+
+#endif
@@ -0,0 +1,81 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2011, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// Offline tool that samples forward kinematics over a group's joint
+// bounds and saves the reachable-workspace voxel map move_arm loads
+// through the reachability_map_filename parameter.
+
+#include <move_arm/reachability_map.h>
+#include <planning_environment/models/collision_models.h>
+#include <ros/ros.h>
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "build_reachability_map");
+  ros::NodeHandle private_handle("~");
+
+  std::string group_name, tip_link, output_filename;
+  double resolution;
+  int samples;
+  private_handle.param<std::string>("group", group_name, "");
+  private_handle.param<std::string>("tip_link", tip_link, "");
+  private_handle.param<std::string>("output_filename", output_filename, "reachability_map.bin");
+  private_handle.param<double>("resolution", resolution, 0.05);
+  private_handle.param<int>("samples", samples, 500000);
+
+  if(group_name.empty() || tip_link.empty()) {
+    ROS_ERROR("Both the group and tip_link parameters must be set");
+    return 1;
+  }
+
+  planning_environment::CollisionModels collision_models("robot_description");
+  if(!collision_models.loadedModels()) {
+    ROS_ERROR("Unable to load robot model");
+    return 1;
+  }
+  planning_models::KinematicState state(collision_models.getKinematicModel());
+  state.setKinematicStateToDefault();
+
+  ROS_INFO_STREAM("Sampling " << samples << " configurations of group " << group_name
+                  << " for link " << tip_link << " at resolution " << resolution);
+  move_arm::ReachabilityMap map;
+  if(!map.build(state, group_name, tip_link, resolution, (unsigned int)samples)) {
+    return 1;
+  }
+  if(!map.save(output_filename)) {
+    return 1;
+  }
+  ROS_INFO_STREAM("Wrote reachability map to " << output_filename);
+  return 0;
+}
@@ -59,6 +59,10 @@
 #include <arm_navigation_msgs/GetMotionPlan.h>
 #include <arm_navigation_msgs/convert_messages.h>
 #include <arm_navigation_msgs/ArmNavigationErrorCodes.h>
+#include <arm_navigation_msgs/trace.h>
+#include <arm_navigation_msgs/capture_log.h>
+#include <move_arm/reachability_map.h>
+#include <move_arm/trajectory_handle.h>
 
 #include <visualization_msgs/Marker.h>
 
@@ -72,6 +76,9 @@
 #include <planning_environment/models/model_utils.h>
 #include <arm_navigation_msgs/SetPlanningSceneDiff.h>
 
+#include <ompl_ros_interface/ompl_ros.h>
+#include <arm_kinematics_constraint_aware/arm_kinematics_constraint_aware.h>
+
 #include <arm_navigation_msgs/GetRobotState.h>
 
 #include <actionlib/client/simple_action_client.h>
@@ -79,6 +86,9 @@
 
 #include <std_msgs/Bool.h>
 
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+
 #include <valarray>
 #include <algorithm>
 #include <cstdlib>
@@ -143,10 +153,52 @@ public:
     private_handle_.param<double>("trajectory_filter_allowed_time",trajectory_filter_allowed_time_, 2.0);
     private_handle_.param<double>("ik_allowed_time",ik_allowed_time_, 2.0);
 
+    //upper bound on how long a preempt request can go unnoticed while a
+    //planning or filter call is in flight
+    private_handle_.param<double>("preempt_check_period",preempt_check_period_, 0.1);
+
+    //length, in trajectory time, of the window revalidated per
+    //monitoring cycle after a scene change
+    private_handle_.param<double>("monitoring_lookahead_time",monitoring_lookahead_time_, 2.0);
+
     private_handle_.param<bool>("publish_stats",publish_stats_, true);
 
+    //in-process mode hosts the planner inside this node and exchanges
+    //requests by reference, so multi-megabyte planning scenes are not
+    //serialized through loopback on every planning call
+    private_handle_.param<bool>("use_in_process_planner",use_in_process_planner_, false);
+    private_handle_.param<std::string>("in_process_planner_namespace",in_process_planner_namespace_, "/ompl_planning");
+    if(use_in_process_planner_)
+    {
+      in_process_planner_.reset(new ompl_ros_interface::OmplRos(in_process_planner_namespace_));
+      in_process_planner_->run();
+    }
+
+    //same idea for kinematics - host the constraint-aware IK node in this
+    //process and call its handlers by reference, so the per-call transport
+    //of the robot state does not dwarf the actual solve for easy poses
+    private_handle_.param<bool>("use_in_process_kinematics",use_in_process_kinematics_, false);
+    private_handle_.param<std::string>("in_process_kinematics_namespace",in_process_kinematics_namespace_, "/arm_kinematics");
+    if(use_in_process_kinematics_)
+    {
+      in_process_kinematics_.reset(new arm_kinematics_constraint_aware::ArmKinematicsConstraintAware(in_process_kinematics_namespace_));
+      if(!in_process_kinematics_->isActive())
+      {
+        ROS_WARN("In-process kinematics failed to initialize, falling back to the %s service",ARM_IK_NAME.c_str());
+        in_process_kinematics_.reset();
+        use_in_process_kinematics_ = false;
+      }
+    }
+
     planning_scene_state_ = NULL;
 
+    filter_call_ok_ = false;
+    filter_passthrough_ = false;
+    plan_call_ok_ = false;
+    plan_call_done_ = false;
+    last_validated_scene_version_ = 0;
+    revalidation_index_ = 0;
+
     collision_models_ = new planning_environment::CollisionModels("robot_description");
 
     num_planning_attempts_ = 0;
@@ -172,9 +224,36 @@ public:
     display_path_publisher_ = root_handle_.advertise<arm_navigation_msgs::DisplayTrajectory>(DISPLAY_PATH_PUB_TOPIC, 1, true);
     display_joint_goal_publisher_ = root_handle_.advertise<arm_navigation_msgs::DisplayTrajectory>(DISPLAY_JOINT_GOAL_PUB_TOPIC, 1, true);
     stats_publisher_ = private_handle_.advertise<arm_navigation_msgs::MoveArmStatistics>("statistics",1,true);
-  }	
+    private_handle_.param<bool>("publish_traces", publish_traces_, false);
+    //when set, planning and filter requests are appended to this binary
+    //log so a production session can be replayed by replay_captured_workload
+    std::string capture_file;
+    private_handle_.param<std::string>("capture_file", capture_file, "");
+    if(!capture_file.empty())
+      capture_log_.open(capture_file);
+    trace_publisher_ = arm_navigation_msgs::advertiseTraceTopic(root_handle_);
+    trace_id_counter_ = 0;
+    current_trace_id_ = 0;
+
+    //a precomputed reachability map lets pose goals outside the arm's
+    //reach fail immediately instead of burning the planning timeout;
+    //built offline with the build_reachability_map tool
+    private_handle_.param<std::string>("reachability_map_filename", reachability_map_filename_, "");
+    if(!reachability_map_filename_.empty() && reachability_map_.load(reachability_map_filename_)) {
+      ROS_INFO_STREAM("Loaded reachability map for group " << reachability_map_.getGroupName()
+                      << " link " << reachability_map_.getTipLink());
+    }
+
+    //prime the lazily-connected resources in the background so the
+    //first goal after launch performs like the hundredth
+    private_handle_.param<bool>("prime_on_startup", prime_on_startup_, true);
+    if(prime_on_startup_)
+      primer_thread_.reset(new boost::thread(boost::bind(&MoveArm::primePlanningResources, this)));
+  }
   virtual ~MoveArm()
   {
+    if(primer_thread_)
+      primer_thread_->join();
     revertPlanningScene();
     delete collision_models_;
   }
@@ -208,7 +287,7 @@ private:
   /// 
   bool convertPoseGoalToJointGoal(arm_navigation_msgs::GetMotionPlan::Request &req)
   {
-    if(!arm_ik_initialized_)
+    if(!arm_ik_initialized_ && !use_in_process_kinematics_)
     {
       if(!ros::service::waitForService(ARM_IK_NAME,ros::Duration(1.0)))
       {
@@ -299,7 +378,12 @@ private:
     request.ik_request.ik_link_name = link_name;
     request.timeout = ros::Duration(ik_allowed_time_);
     request.constraints = original_request_.motion_plan_request.goal_constraints;
-    if (ik_client_.call(request, response))
+    bool call_ok;
+    if(use_in_process_kinematics_)
+      call_ok = in_process_kinematics_->getConstraintAwarePositionIK(request, response);
+    else
+      call_ok = ik_client_.call(request, response);
+    if (call_ok)
     {
       move_arm_action_result_.error_code = response.error_code;
       if(response.error_code.val != response.error_code.SUCCESS)
@@ -351,7 +435,10 @@ private:
     req.path_constraints = original_request_.motion_plan_request.path_constraints;
     req.goal_constraints = original_request_.motion_plan_request.goal_constraints;
     req.allowed_time = ros::Duration(trajectory_filter_allowed_time_);
+    req.trace_id = current_trace_id_;
+    capture_log_.write(arm_navigation_msgs::CAPTURE_FILTER_REQUEST, req);
     ros::Time smoothing_time = ros::Time::now();
+    arm_navigation_msgs::ScopedTraceSpan span(trace_publisher_, current_trace_id_, "trajectory_filter");
     if(filter_trajectory_client_.call(req,res))
     {
       move_arm_stats_.trajectory_duration = (res.trajectory.points.back().time_from_start-res.trajectory.points.front().time_from_start).toSec();
@@ -366,10 +453,107 @@ private:
     }
   }
 
+  /**
+     @brief Start the trajectory filter service call on a background
+     thread so it overlaps the collision validation of the raw
+     trajectory; the two together dominate the delay between a plan
+     arriving and motion starting. The request is built here, on the
+     calling thread, because it reads the shared planning scene state
+     which must not race with the validity check.
+  */
+  void startTrajectoryFilter(const trajectory_msgs::JointTrajectory &trajectory)
+  {
+    discardTrajectoryFilter();
+    filter_request_ = arm_navigation_msgs::FilterJointTrajectoryWithConstraints::Request();
+    fillTrajectoryMsg(trajectory, filter_request_.trajectory);
+    if(trajectory_filter_allowed_time_ == 0.0)
+    {
+      filter_passthrough_ = true;
+      return;
+    }
+    filter_passthrough_ = false;
+    resetToStartState(planning_scene_state_);
+    planning_environment::convertKinematicStateToRobotState(*planning_scene_state_,
+                                                            ros::Time::now(),
+                                                            collision_models_->getWorldFrameId(),
+                                                            filter_request_.start_state);
+    filter_request_.group_name = group_;
+    filter_request_.path_constraints = original_request_.motion_plan_request.path_constraints;
+    filter_request_.goal_constraints = original_request_.motion_plan_request.goal_constraints;
+    filter_request_.allowed_time = ros::Duration(trajectory_filter_allowed_time_);
+    filter_request_.trace_id = current_trace_id_;
+    capture_log_.write(arm_navigation_msgs::CAPTURE_FILTER_REQUEST, filter_request_);
+    filter_start_time_ = ros::Time::now();
+    filter_thread_.reset(new boost::thread(boost::bind(&MoveArm::trajectoryFilterThread, this)));
+  }
+
+  void trajectoryFilterThread()
+  {
+    arm_navigation_msgs::ScopedTraceSpan span(trace_publisher_, filter_request_.trace_id, "trajectory_filter");
+    filter_call_ok_ = filter_trajectory_client_.call(filter_request_, filter_response_);
+  }
+
+  /**
+     @brief Collect the result of the overlapped filter call, blocking
+     until the service returns if it has not yet. The wait polls for
+     preemption so a preempt abandons the call within
+     preempt_check_period_; the abandoned thread is reaped by the next
+     startTrajectoryFilter or discardTrajectoryFilter.
+  */
+  bool waitForFilteredTrajectory(TrajectoryHandle &trajectory_out)
+  {
+    if(filter_passthrough_)
+    {
+      //the request is rebuilt per goal, so its trajectory can be taken
+      trajectory_out.takeFrom(filter_request_.trajectory);
+      return true;
+    }
+    if(!filter_thread_)
+    {
+      ROS_WARN("No filter call in flight, filtering trajectory synchronously");
+      trajectory_msgs::JointTrajectory filtered;
+      if(!filterTrajectory(current_trajectory_.read(), filtered))
+        return false;
+      trajectory_out.takeFrom(filtered);
+      return true;
+    }
+    while(!filter_thread_->timed_join(boost::posix_time::milliseconds((long)(preempt_check_period_*1000.0))))
+    {
+      if(action_server_->isPreemptRequested())
+      {
+        noticePreempt();
+        move_arm_stats_.preempt_planner_cancel_time = timeSincePreemptNotice();
+        ROS_DEBUG("Abandoning in-flight filter call, preemption was requested");
+        return false;
+      }
+    }
+    filter_thread_.reset();
+    if(!filter_call_ok_)
+    {
+      ROS_ERROR("Service call to filter trajectory failed.");
+      return false;
+    }
+    move_arm_stats_.trajectory_duration = (filter_response_.trajectory.points.back().time_from_start-filter_response_.trajectory.points.front().time_from_start).toSec();
+    move_arm_stats_.smoothing_time = (ros::Time::now()-filter_start_time_).toSec();
+    //the response is rebuilt by the next filter call, so its trajectory can be taken
+    trajectory_out.takeFrom(filter_response_.trajectory);
+    return true;
+  }
+
+  /** @brief Drop an in-flight filter call whose trajectory will not be executed */
+  void discardTrajectoryFilter()
+  {
+    if(filter_thread_)
+    {
+      filter_thread_->join();
+      filter_thread_.reset();
+    }
+  }
+
   ///
   /// End Trajectory Filtering
   ///
- 
+
   void discretizeTrajectory(const trajectory_msgs::JointTrajectory &trajectory, 
                             trajectory_msgs::JointTrajectory &trajectory_out,
                             const double &trajectory_discretization)
@@ -469,6 +653,10 @@ private:
   {
     req.motion_plan_request.workspace_parameters.workspace_region_pose.header.stamp = ros::Time::now();
     req.motion_plan_request = goal->motion_plan_request;
+    //each goal gets its own trace id, propagated through the planner
+    //and filter requests so all stage spans can be joined downstream
+    current_trace_id_ = publish_traces_ ? ++trace_id_counter_ : 0;
+    req.motion_plan_request.trace_id = current_trace_id_;
 
     move_arm_parameters_.accept_partial_plans = goal->accept_partial_plans;
     move_arm_parameters_.accept_invalid_goals = goal->accept_invalid_goals;
@@ -542,6 +730,26 @@ private:
       return false;
     }
     // processing and checking goal
+    if(reachability_map_.isLoaded()) {
+      const std::string root_link = collision_models_->getKinematicModel()->getRoot()->getChildLinkModel()->getName();
+      const std::vector<arm_navigation_msgs::PositionConstraint>& pcs = req.motion_plan_request.goal_constraints.position_constraints;
+      for(unsigned int i = 0; i < pcs.size(); i++) {
+        //the map only knows about the link it was sampled for
+        if(pcs[i].link_name != reachability_map_.getTipLink()) continue;
+        geometry_msgs::PointStamped root_point;
+        if(!collision_models_->convertPointGivenWorldTransform(*planning_scene_state_,
+                                                               root_link,
+                                                               pcs[i].header,
+                                                               pcs[i].position,
+                                                               root_point)) continue;
+        if(!reachability_map_.isReachable(tf::Vector3(root_point.point.x, root_point.point.y, root_point.point.z))) {
+          ROS_ERROR_STREAM("Goal position for " << pcs[i].link_name << " is outside the reachable workspace, not planning");
+          move_arm_action_result_.error_code.val = move_arm_action_result_.error_code.INVALID_GOAL_POSITION_CONSTRAINTS;
+          action_server_->setAborted(move_arm_action_result_);
+          return false;
+        }
+      }
+    }
     if (!move_arm_parameters_.disable_ik && isPoseGoal(req)) {
       ROS_DEBUG("Planning to a pose goal");
       if(!convertPoseGoalToJointGoal(req)) {
@@ -587,29 +795,85 @@ private:
     return true;
   }
 
-  bool createPlan(arm_navigation_msgs::GetMotionPlan::Request &req,  
+  void planningCallThread()
+  {
+    bool call_ok;
+    if(use_in_process_planner_)
+      call_ok = in_process_planner_->computePlan(plan_request_, plan_response_);
+    else
+    {
+      ros::ServiceClient planning_client = root_handle_.serviceClient<arm_navigation_msgs::GetMotionPlan>(move_arm_parameters_.planner_service_name);
+      call_ok = planning_client.call(plan_request_, plan_response_);
+    }
+    boost::mutex::scoped_lock lock(plan_call_lock_);
+    plan_call_ok_ = call_ok;
+    plan_call_done_ = true;
+  }
+
+  bool createPlan(arm_navigation_msgs::GetMotionPlan::Request &req,
                   arm_navigation_msgs::GetMotionPlan::Response &res)
   {
-    while(!ros::service::waitForService(move_arm_parameters_.planner_service_name, ros::Duration(1.0))) {
-      ROS_INFO_STREAM("Waiting for requested service " << move_arm_parameters_.planner_service_name);
+    if(use_in_process_planner_)
+    {
+      move_arm_stats_.planner_service_name = in_process_planner_namespace_;
+      ROS_DEBUG("Issuing in-process request for motion plan");
     }
-    ros::ServiceClient planning_client = root_handle_.serviceClient<arm_navigation_msgs::GetMotionPlan>(move_arm_parameters_.planner_service_name);
-    move_arm_stats_.planner_service_name = move_arm_parameters_.planner_service_name;
-    ROS_DEBUG("Issuing request for motion plan");		    
-    // call the planner and decide whether to use the path
-    if (planning_client.call(req, res))
+    else
+    {
+      while(!ros::service::waitForService(move_arm_parameters_.planner_service_name, ros::Duration(1.0))) {
+        ROS_INFO_STREAM("Waiting for requested service " << move_arm_parameters_.planner_service_name);
+        if(action_server_->isPreemptRequested())
+          return false;
+      }
+      move_arm_stats_.planner_service_name = move_arm_parameters_.planner_service_name;
+      ROS_DEBUG("Issuing request for motion plan");
+    }
+    //a call abandoned by an earlier preemption must drain before its
+    //request/response buffers are reused; this delays the next goal,
+    //never the preemption itself
+    if(plan_thread_)
+    {
+      plan_thread_->join();
+      plan_thread_.reset();
+    }
+    plan_request_ = req;
+    plan_call_ok_ = false;
+    plan_call_done_ = false;
+    //the call runs on its own thread so a preempt is honored within
+    //preempt_check_period_ instead of the planner's full allowed time
+    plan_thread_.reset(new boost::thread(boost::bind(&MoveArm::planningCallThread, this)));
+    while(true)
     {
-      if (res.trajectory.joint_trajectory.points.empty())
+      {
+        boost::mutex::scoped_lock lock(plan_call_lock_);
+        if(plan_call_done_)
+          break;
+      }
+      if(action_server_->isPreemptRequested())
+      {
+        noticePreempt();
+        move_arm_stats_.preempt_planner_cancel_time = timeSincePreemptNotice();
+        ROS_DEBUG("Abandoning in-flight planning call, preemption was requested");
+        return false;
+      }
+      ros::WallDuration(preempt_check_period_).sleep();
+    }
+    plan_thread_->join();
+    plan_thread_.reset();
+    if(plan_call_ok_)
+    {
+      if (plan_response_.trajectory.joint_trajectory.points.empty())
       {
         ROS_WARN("Motion planner was unable to plan a path to goal");
         return false;
       }
       ROS_DEBUG("Motion planning succeeded");
+      res = plan_response_;
       return true;
     }
     else
     {
-      ROS_ERROR("Motion planning service failed on %s",planning_client.getService().c_str());
+      ROS_ERROR("Motion planning call failed on %s",move_arm_stats_.planner_service_name.c_str());
       return false;
     }
   }
@@ -617,7 +881,30 @@ private:
   /// End Motion planning
   ///
 
-  /// 
+  /// Runs once on a background thread at startup: connects the
+  /// services the goal path would otherwise wait for lazily and
+  /// forces the collision environment's first-touch allocations with
+  /// a throwaway query, so the first goal performs like steady state.
+  /// The in-process planner and kinematics already initialize eagerly
+  /// in the constructor when enabled.
+  void primePlanningResources()
+  {
+    if(!use_in_process_kinematics_)
+    {
+      if(ros::service::waitForService(ARM_IK_NAME, ros::Duration(30.0)))
+        arm_ik_initialized_ = true;
+      else
+        ROS_DEBUG("IK service %s not available while priming; first pose goal will wait for it", ARM_IK_NAME.c_str());
+    }
+
+    //the first collision check builds the ODE environment's internal
+    //structures; pay for that here instead of inside goal #1
+    planning_models::KinematicState state(collision_models_->getKinematicModel());
+    state.setKinematicStateToDefault();
+    collision_models_->isKinematicStateInCollision(state);
+  }
+
+  ///
   /// Control
   ///
   bool initializeControllerInterface()
@@ -649,11 +936,14 @@ private:
       controller_goal_handle_.cancel();
     return true;
   }
-  bool sendTrajectory(trajectory_msgs::JointTrajectory &current_trajectory)
+  bool sendTrajectory(TrajectoryHandle &trajectory)
   {
+    //the handle is uniquely held here, so stamping does not clone
+    trajectory_msgs::JointTrajectory &current_trajectory = trajectory.write();
     current_trajectory.header.stamp = ros::Time::now()+ros::Duration(0.2);
 
-    control_msgs::FollowJointTrajectoryGoal goal;  
+    control_msgs::FollowJointTrajectoryGoal goal;
+    //the action goal needs its own copy; this is the only one made on the way out
     goal.trajectory = current_trajectory;
 
     ROS_DEBUG("Sending trajectory with %d points and timestamp: %f",(int)goal.trajectory.points.size(),goal.trajectory.header.stamp.toSec());
@@ -681,6 +971,11 @@ private:
 		  }*/
     controller_goal_handle_ = controller_action_client_->sendGoal(goal,boost::bind(&MoveArm::controllerTransitionCallback, this, _1));
 
+    //the whole trajectory was validated just before being sent
+    last_validated_scene_version_ = collision_models_->getCollisionSceneVersion();
+    revalidation_trajectory_.points.clear();
+    revalidation_index_ = 0;
+
     controller_status_ = QUEUED;
     //    printTrajectory(goal.trajectory);
     return true;
@@ -731,6 +1026,70 @@ private:
       break;
     }
   } 
+  /**
+     @brief Extract the not-yet-executed suffix of the trajectory
+     currently being executed, judged by elapsed time since the
+     trajectory was stamped for the controller.
+  */
+  void getRemainingTrajectory(trajectory_msgs::JointTrajectory &remaining)
+  {
+    const trajectory_msgs::JointTrajectory &current_trajectory = current_trajectory_.read();
+    remaining.header = current_trajectory.header;
+    remaining.joint_names = current_trajectory.joint_names;
+    remaining.points.clear();
+    ros::Duration elapsed = ros::Time::now() - current_trajectory.header.stamp;
+    for(unsigned int i=0; i < current_trajectory.points.size(); i++)
+      if(current_trajectory.points[i].time_from_start >= elapsed)
+        remaining.points.push_back(current_trajectory.points[i]);
+  }
+
+  /**
+     @brief Validate the next look-ahead window of the suffix snapshot
+     taken when the scene last changed. The window is
+     monitoring_lookahead_time_ long in trajectory time, so the
+     per-cycle monitoring cost is bounded by the window length rather
+     than the trajectory length; consecutive windows share an endpoint
+     so the motion joining them is checked too. Returns false when the
+     window is invalid.
+  */
+  bool validateNextMonitoringWindow(arm_navigation_msgs::ArmNavigationErrorCodes &error_code)
+  {
+    if(revalidation_index_ >= revalidation_trajectory_.points.size())
+      return true;
+    trajectory_msgs::JointTrajectory window;
+    window.header = revalidation_trajectory_.header;
+    window.joint_names = revalidation_trajectory_.joint_names;
+    ros::Duration window_end = revalidation_trajectory_.points[revalidation_index_].time_from_start
+      + ros::Duration(monitoring_lookahead_time_);
+    unsigned int last_index = revalidation_index_;
+    for(unsigned int i=revalidation_index_; i < revalidation_trajectory_.points.size(); i++)
+    {
+      //always take at least two points so the window advances
+      if(i > revalidation_index_+1 && revalidation_trajectory_.points[i].time_from_start > window_end)
+        break;
+      window.points.push_back(revalidation_trajectory_.points[i]);
+      last_index = i;
+    }
+    bool covers_goal = (last_index+1 == revalidation_trajectory_.points.size());
+    //the goal constraints only apply to the window holding the final point
+    arm_navigation_msgs::Constraints empty_goal_constraints;
+    std::vector<arm_navigation_msgs::ArmNavigationErrorCodes> traj_error_codes;
+    resetToStartState(planning_scene_state_);
+    if(!collision_models_->isJointTrajectoryValid(*planning_scene_state_,
+                                                  window,
+                                                  covers_goal ? original_request_.motion_plan_request.goal_constraints : empty_goal_constraints,
+                                                  original_request_.motion_plan_request.path_constraints,
+                                                  error_code,
+                                                  traj_error_codes,
+                                                  false))
+      return false;
+    if(covers_goal)
+      revalidation_index_ = revalidation_trajectory_.points.size();
+    else
+      revalidation_index_ = last_index;
+    return true;
+  }
+
   bool isControllerDone(arm_navigation_msgs::ArmNavigationErrorCodes& error_code)
   {      
     if (controller_status_ == SUCCESS)
@@ -817,7 +1176,7 @@ private:
       // 		      << current.position[4]
       // 		      << current.position[5]
       // 		      << current.position[6]);
-      trajectory_out.points[0].positions = arm_navigation_msgs::jointStateToJointTrajectoryPoint(current).positions;
+      trajectory_out.points[0].positions = current.position;
       trajectory_out.points[0].time_from_start = ros::Duration(0.0);
       offset = 0.3 + d;
     } 
@@ -838,11 +1197,43 @@ private:
   ///
   void resetStateMachine()
   {
+    discardTrajectoryFilter();
     num_planning_attempts_ = 0;
-    current_trajectory_.points.clear();
-    current_trajectory_.joint_names.clear();
-    state_ = PLANNING;    
+    current_trajectory_.clear();
+    state_ = PLANNING;
+  }
+
+  /** @brief Publish a trace span for a stage whose start and end do
+      not share a scope, e.g. trajectory execution across state
+      machine cycles */
+  void publishTraceSpan(const std::string &stage, const ros::Time &start_time)
+  {
+    if(current_trace_id_ == 0)
+      return;
+    arm_navigation_msgs::TraceSpan span;
+    span.trace_id = current_trace_id_;
+    span.node = ros::this_node::getName();
+    span.stage = stage;
+    span.start_time = start_time;
+    span.end_time = ros::Time::now();
+    trace_publisher_.publish(span);
+  }
+
+  /** @brief Record when a preempt request was first noticed so each
+      cancellation stage can be stamped relative to it */
+  void noticePreempt()
+  {
+    if(preempt_notice_stamp_.isZero())
+      preempt_notice_stamp_ = ros::Time::now();
+  }
+
+  double timeSincePreemptNotice()
+  {
+    if(preempt_notice_stamp_.isZero())
+      return -1.0;
+    return (ros::Time::now()-preempt_notice_stamp_).toSec();
   }
+
   bool executeCycle(arm_navigation_msgs::GetMotionPlan::Request &req)
   {
     arm_navigation_msgs::GetMotionPlan::Response res;
@@ -874,11 +1265,19 @@ private:
           return true;
         }
         ros::Time planning_time = ros::Time::now();
-        if(createPlan(req,res))
+        bool created_plan;
+        {
+          arm_navigation_msgs::ScopedTraceSpan span(trace_publisher_, current_trace_id_, "planning");
+          created_plan = createPlan(req,res);
+        }
+        if(created_plan)
         {
           std::vector<arm_navigation_msgs::ArmNavigationErrorCodes> traj_error_codes;
           move_arm_stats_.planning_time = (ros::Time::now()-planning_time).toSec();
           ROS_DEBUG("createPlan succeeded");
+          //overlap the filter service call with the validity check
+          //below; the filtered result is collected in START_CONTROL
+          startTrajectoryFilter(res.trajectory.joint_trajectory);
           resetToStartState(planning_scene_state_);
           if(!collision_models_->isJointTrajectoryValid(*planning_scene_state_,
                                                         res.trajectory.joint_trajectory, 
@@ -888,6 +1287,8 @@ private:
                                                         traj_error_codes,
                                                         true))
           {
+            discardTrajectoryFilter();
+            req.motion_plan_request.seed_trajectory = res.trajectory.joint_trajectory;
             if(error_code.val == error_code.COLLISION_CONSTRAINTS_VIOLATED) {
               ROS_WARN("Planner trajectory collides");
             } else if (error_code.val == error_code.PATH_CONSTRAINTS_VIOLATED) {
@@ -909,13 +1310,18 @@ private:
           else{
             ROS_DEBUG("Trajectory validity check was successful");
 	    
-	    current_trajectory_ = res.trajectory.joint_trajectory;
-	    visualizePlan(current_trajectory_);
-	    //          printTrajectory(current_trajectory_);
+	    //the response is dead after this, so its trajectory can be taken
+	    current_trajectory_.takeFrom(res.trajectory.joint_trajectory);
+	    visualizePlan(current_trajectory_.read());
 	    state_ = START_CONTROL;
 	    ROS_DEBUG("Done planning. Transitioning to control");
 	  }
         }
+        else if(action_server_->isPreemptRequested())
+        {
+          //the outer loop runs the preemption path
+          break;
+        }
         else if(action_server_->isActive())
         {
           num_planning_attempts_++;
@@ -941,14 +1347,14 @@ private:
         move_arm_action_feedback_.time_to_completion = ros::Duration(1.0/move_arm_frequency_);
         action_server_->publishFeedback(move_arm_action_feedback_);
         ROS_DEBUG("Filtering Trajectory");
-        trajectory_msgs::JointTrajectory filtered_trajectory;
-        if(filterTrajectory(current_trajectory_, filtered_trajectory))
+        TrajectoryHandle filtered_trajectory;
+        if(waitForFilteredTrajectory(filtered_trajectory))
         {
           arm_navigation_msgs::ArmNavigationErrorCodes error_code;
           std::vector<arm_navigation_msgs::ArmNavigationErrorCodes> traj_error_codes;
           resetToStartState(planning_scene_state_);
           if(!collision_models_->isJointTrajectoryValid(*planning_scene_state_,
-                                                        filtered_trajectory,
+                                                        filtered_trajectory.read(),
                                                         original_request_.motion_plan_request.goal_constraints,
                                                         original_request_.motion_plan_request.path_constraints,
                                                         error_code,
@@ -965,8 +1371,11 @@ private:
               ROS_WARN("Filtered trajectory doesn't reach goal");
             }
             ROS_ERROR("Move arm will abort this goal.  Will replan");
+            //seed the replan with the trajectory that just went stale;
+            //the planner reuses whatever part of it is still valid
+            req.motion_plan_request.seed_trajectory = current_trajectory_.read();
             state_ = PLANNING;
-	    num_planning_attempts_++;	    
+	    num_planning_attempts_++;
 	    if(num_planning_attempts_ > req.motion_plan_request.num_planning_attempts)
             {
               resetStateMachine();
@@ -982,8 +1391,14 @@ private:
           else{
             ROS_DEBUG("Trajectory validity check was successful");
           }
-          current_trajectory_ = filtered_trajectory;
+          current_trajectory_.takeFrom(filtered_trajectory);
         } else {
+          if(action_server_->isPreemptRequested())
+          {
+            //the wait was abandoned for a preempt; the outer loop runs
+            //the preemption path
+            break;
+          }
           resetStateMachine();
           ROS_INFO_STREAM("Setting aborted because trajectory filter call failed");
           action_server_->setAborted(move_arm_action_result_);
@@ -993,6 +1408,7 @@ private:
         move_arm_stats_.time_to_execution = (ros::Time::now() - ros::Time(move_arm_stats_.time_to_execution)).toSec();
         if(sendTrajectory(current_trajectory_))
         {
+          execution_trace_start_ = ros::Time::now();
           state_ = MONITOR;
         }
         else
@@ -1007,12 +1423,49 @@ private:
     case MONITOR:
       {
         move_arm_action_feedback_.state = "monitor";
-        move_arm_action_feedback_.time_to_completion = current_trajectory_.points.back().time_from_start;
+        move_arm_action_feedback_.time_to_completion = current_trajectory_.read().points.back().time_from_start;
         action_server_->publishFeedback(move_arm_action_feedback_);
         ROS_DEBUG("Start to monitor");
+        //in-flight revalidation is event driven and windowed: a scene
+        //version change snapshots the unexecuted suffix, then one
+        //look-ahead window of it is checked per cycle starting with the
+        //imminent motion, so the per-cycle cost is bounded by the
+        //window length instead of the trajectory length. A quiet
+        //environment still costs one integer compare per cycle. The
+        //scene version does not say where the mutation happened, so
+        //every mutation restarts the sweep.
+        if(!move_arm_parameters_.disable_collision_monitoring)
+        {
+          if(collision_models_->getCollisionSceneVersion() != last_validated_scene_version_)
+          {
+            last_validated_scene_version_ = collision_models_->getCollisionSceneVersion();
+            getRemainingTrajectory(revalidation_trajectory_);
+            revalidation_index_ = 0;
+          }
+          arm_navigation_msgs::ArmNavigationErrorCodes traj_error_code;
+          if(!validateNextMonitoringWindow(traj_error_code))
+          {
+            ROS_WARN("Remaining trajectory no longer valid after scene change. Stopping and replanning");
+            stopTrajectory();
+            trajectory_msgs::JointTrajectory remaining_trajectory;
+            getRemainingTrajectory(remaining_trajectory);
+            req.motion_plan_request.seed_trajectory = remaining_trajectory;
+            state_ = PLANNING;
+            num_planning_attempts_++;
+            if(num_planning_attempts_ > req.motion_plan_request.num_planning_attempts)
+            {
+              resetStateMachine();
+              ROS_INFO_STREAM("Setting aborted because we're out of planning attempts");
+              action_server_->setAborted(move_arm_action_result_);
+              return true;
+            }
+            break;
+          }
+        }
         arm_navigation_msgs::ArmNavigationErrorCodes controller_error_code;
         if(isControllerDone(controller_error_code))
         {
+          publishTraceSpan("execution", execution_trace_start_);
           move_arm_stats_.time_to_result = (ros::Time::now()-ros::Time(move_arm_stats_.time_to_result)).toSec();
 
           arm_navigation_msgs::RobotState empty_state;
@@ -1094,6 +1547,7 @@ private:
                                                             collision_models_->getWorldFrameId(),
                                                             req.motion_plan_request.start_state);
     original_request_ = req;
+    capture_log_.write(arm_navigation_msgs::CAPTURE_MOTION_PLAN_REQUEST, req);
 
     ros::Rate move_arm_rate(move_arm_frequency_);
     move_arm_action_result_.contacts.clear();
@@ -1104,8 +1558,17 @@ private:
     {	    	    
       if (action_server_->isPreemptRequested())
       {
+        noticePreempt();
+        if(state_ == MONITOR)
+        {
+          //cancel the controller goal as soon as the preempt is seen so
+          //the arm does not keep moving while we clean up
+          stopTrajectory();
+          move_arm_stats_.preempt_controller_cancel_time = timeSincePreemptNotice();
+        }
         revertPlanningScene();
         move_arm_stats_.preempted = true;
+        move_arm_stats_.preempt_total_time = timeSincePreemptNotice();
         if(publish_stats_)
           publishStats();
         move_arm_stats_.time_to_execution = ros::Time::now().toSec();
@@ -1134,6 +1597,7 @@ private:
                                                                   collision_models_->getWorldFrameId(),
                                                                   req.motion_plan_request.start_state);
           original_request_ = req;
+          capture_log_.write(arm_navigation_msgs::CAPTURE_MOTION_PLAN_REQUEST, req);
 
           state_ = PLANNING;
         }
@@ -1181,9 +1645,12 @@ private:
     planning_scene_req.planning_scene_diff = planning_diff;
     planning_scene_req.operations = operations;
 
-    if(!set_planning_scene_diff_client_.call(planning_scene_req, planning_scene_res)) {
-      ROS_WARN("Can't get planning scene");
-      return false;
+    {
+      arm_navigation_msgs::ScopedTraceSpan span(trace_publisher_, current_trace_id_, "set_planning_scene");
+      if(!set_planning_scene_diff_client_.call(planning_scene_req, planning_scene_res)) {
+        ROS_WARN("Can't get planning scene");
+        return false;
+      }
     }
 
     current_planning_scene_ = planning_scene_res.planning_scene;
@@ -1233,8 +1700,12 @@ private:
     move_arm_stats_.time_to_execution = -1.0;
     move_arm_stats_.time_to_result = -1.0;
     move_arm_stats_.preempted = false;
+    move_arm_stats_.preempt_planner_cancel_time = -1.0;
+    move_arm_stats_.preempt_controller_cancel_time = -1.0;
+    move_arm_stats_.preempt_total_time = -1.0;
     move_arm_stats_.num_replans = 0.0;
     move_arm_stats_.trajectory_duration = -1.0;
+    preempt_notice_stamp_ = ros::Time();
   }
 
   void printTrajectory(const trajectory_msgs::JointTrajectory &trajectory)
@@ -1388,7 +1859,7 @@ private:
   tf::TransformListener *tf_;
   MoveArmState state_;
   double move_arm_frequency_;      	
-  trajectory_msgs::JointTrajectory current_trajectory_;
+  TrajectoryHandle current_trajectory_;
 
   int num_planning_attempts_;
 
@@ -1422,7 +1893,59 @@ private:
   bool publish_stats_;
   arm_navigation_msgs::MoveArmStatistics move_arm_stats_;
   ros::Publisher stats_publisher_;
-  
+
+  //per-goal trace ids for end-to-end latency spans
+  bool publish_traces_;
+  ros::Publisher trace_publisher_;
+  unsigned int trace_id_counter_;
+  unsigned int current_trace_id_;
+  ros::Time execution_trace_start_;
+
+  bool use_in_process_planner_;
+  std::string in_process_planner_namespace_;
+  boost::shared_ptr<ompl_ros_interface::OmplRos> in_process_planner_;
+
+  bool use_in_process_kinematics_;
+  std::string in_process_kinematics_namespace_;
+  boost::shared_ptr<arm_kinematics_constraint_aware::ArmKinematicsConstraintAware> in_process_kinematics_;
+
+  //startup priming of services and collision structures (prime_on_startup)
+  bool prime_on_startup_;
+  boost::shared_ptr<boost::thread> primer_thread_;
+
+  std::string reachability_map_filename_;
+  move_arm::ReachabilityMap reachability_map_;
+
+  //state of the filter call running concurrently with trajectory validation
+  boost::shared_ptr<boost::thread> filter_thread_;
+  arm_navigation_msgs::FilterJointTrajectoryWithConstraints::Request filter_request_;
+  arm_navigation_msgs::FilterJointTrajectoryWithConstraints::Response filter_response_;
+  bool filter_call_ok_;
+  bool filter_passthrough_;
+  ros::Time filter_start_time_;
+
+  //state of a planning call running on a background thread so a preempt
+  //does not wait out the planner's allowed time
+  boost::shared_ptr<boost::thread> plan_thread_;
+  arm_navigation_msgs::GetMotionPlan::Request plan_request_;
+  arm_navigation_msgs::GetMotionPlan::Response plan_response_;
+  bool plan_call_ok_;
+  bool plan_call_done_;
+  boost::mutex plan_call_lock_;
+
+  double preempt_check_period_;
+  ros::Time preempt_notice_stamp_;
+
+  unsigned long last_validated_scene_version_;
+
+  //suffix snapshot being swept window-by-window after a scene change
+  trajectory_msgs::JointTrajectory revalidation_trajectory_;
+  unsigned int revalidation_index_;
+  double monitoring_lookahead_time_;
+
+  //ignores writes unless ~capture_file is set
+  arm_navigation_msgs::CaptureLogWriter capture_log_;
+
 };
 }
 
@@ -55,6 +55,7 @@
 #include <interactive_markers/interactive_marker_server.h>
 #include <interactive_markers/menu_handler.h>
 #include <sensor_msgs/JointState.h>
+#include <ros/serialization.h>
 
 using namespace std;
 using namespace arm_navigation_msgs;
@@ -77,6 +78,10 @@ static const double BASE_ROT_SPEED = .15;
 static const double HAND_TRANS_SPEED = .05;
 static const double HAND_ROT_SPEED = .15;
 
+//unchanged markers are normally not re-sent; a full array goes out this
+//often so a freshly started rviz still picks up the whole display
+static const double MARKER_REFRESH_SECONDS = 5.0;
+
 static const string SET_PLANNING_SCENE_DIFF_NAME = "/environment_server/set_planning_scene_diff";
 static const string PLANNER_SERVICE_NAME = "/ompl_planning/plan_kinematic_path";
 static const string TRAJECTORY_FILTER_SERVICE_NAME = "/trajectory_filter_server/filter_trajectory_with_constraints";
@@ -1489,10 +1494,85 @@ class PlanningComponentsVisualizer
           }
         }
       }
-      vis_marker_array_publisher_.publish(arr);
+      publishMarkerArrayDiff(arr);
       lock_.unlock();
     }
 
+    /////
+    /// @brief Hashes everything about a marker except its stamp, so two
+    /// markers with identical content made on different cycles compare equal.
+    /////
+    unsigned long long hashMarker(const Marker& marker)
+    {
+      Marker stripped = marker;
+      stripped.header.stamp = ros::Time();
+      unsigned int length = ros::serialization::serializationLength(stripped);
+      vector<unsigned char> buffer(length);
+      ros::serialization::OStream stream(&buffer[0], length);
+      ros::serialization::serialize(stream, stripped);
+      //FNV-1a over the serialized bytes
+      unsigned long long hash = 1469598103934665603ull;
+      for(unsigned int i = 0; i < length; i++)
+      {
+        hash ^= (unsigned long long)buffer[i];
+        hash *= 1099511628211ull;
+      }
+      return hash;
+    }
+
+    /////
+    /// @brief Retained-mode publication: only markers whose content changed
+    /// since the last cycle are sent, with explicit DELETEs for markers that
+    /// disappeared, so interactive dragging re-sends the moving links instead
+    /// of the whole robot and scene each update. Lifetimes are cleared since
+    /// unchanged markers are no longer refreshed; a periodic full publish
+    /// covers late-joining subscribers. Robot link meshes are already
+    /// referenced by resource URL, so the diff is what bounds the bandwidth.
+    /////
+    void publishMarkerArrayDiff(MarkerArray& arr)
+    {
+      if((ros::Time::now() - last_full_marker_publish_).toSec() > MARKER_REFRESH_SECONDS)
+      {
+        published_marker_hashes_.clear();
+        last_full_marker_publish_ = ros::Time::now();
+      }
+      MarkerArray diff;
+      map<pair<string, int>, unsigned long long> current;
+      for(unsigned int i = 0; i < arr.markers.size(); i++)
+      {
+        Marker& marker = arr.markers[i];
+        //deletion is explicit, so retained markers must not expire on their own
+        marker.lifetime = ros::Duration(0.0);
+        unsigned long long hash = hashMarker(marker);
+        pair<string, int> key(marker.ns, marker.id);
+        current[key] = hash;
+        map<pair<string, int>, unsigned long long>::iterator it = published_marker_hashes_.find(key);
+        if(it == published_marker_hashes_.end() || it->second != hash)
+        {
+          diff.markers.push_back(marker);
+        }
+      }
+      for(map<pair<string, int>, unsigned long long>::iterator it = published_marker_hashes_.begin(); it
+          != published_marker_hashes_.end(); it++)
+      {
+        if(current.find(it->first) == current.end())
+        {
+          Marker del;
+          del.header.frame_id = cm_->getWorldFrameId();
+          del.header.stamp = ros::Time::now();
+          del.ns = it->first.first;
+          del.id = it->first.second;
+          del.action = Marker::DELETE;
+          diff.markers.push_back(del);
+        }
+      }
+      published_marker_hashes_ = current;
+      if(!diff.markers.empty())
+      {
+        vis_marker_array_publisher_.publish(diff);
+      }
+    }
+
     void sendTransforms()
     {
       lock_.lock();
@@ -2418,6 +2498,10 @@ class PlanningComponentsVisualizer
     ros::Publisher joint_state_publisher_;
     ros::Publisher vis_marker_array_publisher_;
     ros::Publisher vis_marker_publisher_;
+
+    /// Content hashes of what rviz already displays, keyed by marker ns/id.
+    map<pair<string, int>, unsigned long long> published_marker_hashes_;
+    ros::Time last_full_marker_publish_;
     ros::ServiceClient set_planning_scene_diff_client_;
     ros::ServiceClient planner_service_client_;
     ros::ServiceClient trajectory_filter_service_client_;
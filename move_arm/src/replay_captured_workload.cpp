@@ -0,0 +1,204 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2011, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  \author E. Gil Jones
+ *********************************************************************/
+
+/* Replays a binary capture log (see arm_navigation_msgs/capture_log.h,
+   recorded by environment_server and move_arm when ~capture_file is
+   set) against the live stack, headless: planning scene records go to
+   the environment server, motion plan requests to the planner service
+   and filter requests to the trajectory filter, in the captured order.
+   Per-stage call time distributions are printed at the end, so the
+   same production session can be re-run before and after a change. */
+
+#include <ros/ros.h>
+#include <arm_navigation_msgs/capture_log.h>
+#include <arm_navigation_msgs/SetPlanningSceneDiff.h>
+#include <arm_navigation_msgs/GetMotionPlan.h>
+#include <arm_navigation_msgs/FilterJointTrajectoryWithConstraints.h>
+#include <algorithm>
+#include <vector>
+#include <string>
+
+namespace
+{
+
+struct StageTimings
+{
+  StageTimings() : failures(0)
+  {
+  }
+
+  std::vector<double> seconds;
+  unsigned int failures;
+};
+
+double percentile(std::vector<double> &sorted, double fraction)
+{
+  unsigned int index = (unsigned int)(fraction * (sorted.size() - 1) + 0.5);
+  return sorted[index];
+}
+
+void reportStage(const std::string &name, StageTimings &timings)
+{
+  if(timings.seconds.empty() && timings.failures == 0)
+    return;
+  if(timings.seconds.empty())
+  {
+    ROS_INFO_STREAM(name << ": " << timings.failures << " calls, all failed");
+    return;
+  }
+  std::sort(timings.seconds.begin(), timings.seconds.end());
+  double total = 0.0;
+  for(unsigned int i = 0; i < timings.seconds.size(); i++)
+    total += timings.seconds[i];
+  ROS_INFO_STREAM(name << ": " << timings.seconds.size() << " calls, "
+                  << timings.failures << " failed, mean "
+                  << total / timings.seconds.size() << "s, median "
+                  << percentile(timings.seconds, 0.5) << "s, p90 "
+                  << percentile(timings.seconds, 0.9) << "s, max "
+                  << timings.seconds.back() << "s");
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "replay_captured_workload");
+  ros::NodeHandle root_handle;
+  ros::NodeHandle private_handle("~");
+
+  std::string capture_file;
+  private_handle.param<std::string>("capture_file", capture_file, "");
+  if(capture_file.empty() && argc > 1)
+    capture_file = argv[1];
+  if(capture_file.empty())
+  {
+    ROS_ERROR("No capture file given; set ~capture_file or pass a path");
+    return 1;
+  }
+
+  std::string set_planning_scene_diff_name, planner_service_name, filter_service_name;
+  private_handle.param<std::string>("set_planning_scene_diff_name", set_planning_scene_diff_name,
+                                    "/environment_server/set_planning_scene_diff");
+  private_handle.param<std::string>("planner_service_name", planner_service_name,
+                                    "/ompl_planning/plan_kinematic_path");
+  private_handle.param<std::string>("filter_service_name", filter_service_name,
+                                    "/trajectory_filter_server/filter_trajectory_with_constraints");
+
+  arm_navigation_msgs::CaptureLogReader reader;
+  if(!reader.open(capture_file))
+    return 1;
+
+  ros::ServiceClient scene_client =
+    root_handle.serviceClient<arm_navigation_msgs::SetPlanningSceneDiff>(set_planning_scene_diff_name);
+  ros::ServiceClient plan_client =
+    root_handle.serviceClient<arm_navigation_msgs::GetMotionPlan>(planner_service_name);
+  ros::ServiceClient filter_client =
+    root_handle.serviceClient<arm_navigation_msgs::FilterJointTrajectoryWithConstraints>(filter_service_name);
+
+  StageTimings scene_timings, plan_timings, filter_timings;
+
+  uint32_t record_type;
+  double stamp;
+  std::vector<uint8_t> payload;
+  unsigned int record_count = 0;
+  while(ros::ok() && reader.next(record_type, stamp, payload))
+  {
+    record_count++;
+    switch(record_type)
+    {
+    case arm_navigation_msgs::CAPTURE_PLANNING_SCENE:
+      {
+        arm_navigation_msgs::SetPlanningSceneDiff::Request req;
+        arm_navigation_msgs::SetPlanningSceneDiff::Response res;
+        if(!arm_navigation_msgs::CaptureLogReader::decode(payload, req))
+        {
+          ROS_WARN("Skipping undecodable planning scene record %u", record_count);
+          break;
+        }
+        ros::WallTime start = ros::WallTime::now();
+        if(scene_client.call(req, res))
+          scene_timings.seconds.push_back((ros::WallTime::now() - start).toSec());
+        else
+          scene_timings.failures++;
+      }
+      break;
+    case arm_navigation_msgs::CAPTURE_MOTION_PLAN_REQUEST:
+      {
+        arm_navigation_msgs::GetMotionPlan::Request req;
+        arm_navigation_msgs::GetMotionPlan::Response res;
+        if(!arm_navigation_msgs::CaptureLogReader::decode(payload, req))
+        {
+          ROS_WARN("Skipping undecodable motion plan record %u", record_count);
+          break;
+        }
+        ros::WallTime start = ros::WallTime::now();
+        //a planner returning no trajectory is still a completed call;
+        //only transport failures count as failed
+        if(plan_client.call(req, res))
+          plan_timings.seconds.push_back((ros::WallTime::now() - start).toSec());
+        else
+          plan_timings.failures++;
+      }
+      break;
+    case arm_navigation_msgs::CAPTURE_FILTER_REQUEST:
+      {
+        arm_navigation_msgs::FilterJointTrajectoryWithConstraints::Request req;
+        arm_navigation_msgs::FilterJointTrajectoryWithConstraints::Response res;
+        if(!arm_navigation_msgs::CaptureLogReader::decode(payload, req))
+        {
+          ROS_WARN("Skipping undecodable filter record %u", record_count);
+          break;
+        }
+        ros::WallTime start = ros::WallTime::now();
+        if(filter_client.call(req, res))
+          filter_timings.seconds.push_back((ros::WallTime::now() - start).toSec());
+        else
+          filter_timings.failures++;
+      }
+      break;
+    default:
+      ROS_WARN("Skipping record %u of unknown type %u", record_count, record_type);
+      break;
+    }
+  }
+
+  ROS_INFO_STREAM("Replayed " << record_count << " records from " << capture_file);
+  reportStage("set_planning_scene_diff", scene_timings);
+  reportStage("plan_kinematic_path", plan_timings);
+  reportStage("filter_trajectory", filter_timings);
+
+  return 0;
+}
@@ -97,6 +97,29 @@ public:
   std::vector<ompl_ros_interface::MAPPING_TYPE> multi_dof_joint_mapping_type;
 };
 
+/**
+   @brief enumeration of the ways a scalar can be reached inside an
+   ompl::base::CompoundState when executing a precompiled copy plan
+*/
+typedef enum{COPY_REAL_VECTOR, COPY_SO2_VALUE, COPY_TRANSLATION, COPY_ROTATION, COPY_YAW}COPY_ACCESS_TYPE;
+
+/**
+ * @class One scalar transfer in a precompiled copy plan between an
+ * ompl::base::CompoundState and a kinematic joint state group. The
+ * plan is derived once from a mapping and replayed without any
+ * per-joint branching on state space types.
+ */
+class StateCopyOp
+{
+public:
+  unsigned int space_index;///the top level subspace holding the scalar
+  unsigned int space_offset;///the scalar's offset within the subspace block
+  COPY_ACCESS_TYPE access;///how to reach the scalar inside the subspace
+  unsigned int joint_index;///the joint in the joint state group
+  unsigned int value_index;///the value within that joint
+  bool wrap;///normalize the angle when writing into an SO2 subspace
+};
+
 /**
  * @class This class contains a mapping from a kinematic_state object
  * to an ompl::base::CompoundState object
@@ -108,6 +131,15 @@ public:
   int real_vector_index;
   std::vector<unsigned int> joint_state_mapping;
   std::vector<ompl_ros_interface::MAPPING_TYPE> joint_mapping_type;
+
+  /**
+     @brief Flatten this mapping into a scalar copy plan. The mapping
+     is fixed for the duration of a planning request, so the per-joint
+     type dispatch can be paid once here instead of on every
+     conversion.
+  */
+  void compileCopyPlan();
+  std::vector<StateCopyOp> copy_plan;
 };
 
 /**
@@ -122,6 +154,14 @@ public:
   std::vector<unsigned int> ompl_state_mapping;
   std::vector<unsigned int> real_vector_mapping;
   std::vector<ompl_ros_interface::MAPPING_TYPE> mapping_type;
+
+  /**
+     @brief Flatten this mapping into a scalar copy plan. This
+     conversion brackets every validity check the planner makes, so
+     the compiled plan is what the hot path replays.
+  */
+  void compileCopyPlan();
+  std::vector<StateCopyOp> copy_plan;
 };
 
 /**
@@ -150,7 +190,23 @@ ompl_ros_interface::MAPPING_TYPE getMappingType(const ompl::base::StateSpacePtr
  * @param ompl_kinematic_mapping Mapping from the ompl state to the corresponding kinematic state
  * @param kinematic_ompl_mapping Mapping from the kinematic state to the corresponding ompl state
  */
-ompl::base::StateSpacePtr jointGroupToOmplStateSpacePtr(const planning_models::KinematicModel::JointModelGroup *joint_group, 
+ompl::base::StateSpacePtr jointGroupToOmplStateSpacePtr(const planning_models::KinematicModel::JointModelGroup *joint_group,
+                                                              ompl_ros_interface::OmplStateToKinematicStateMapping &ompl_kinematic_mapping,
+                                                              ompl_ros_interface::KinematicStateToOmplStateMapping &kinematic_ompl_mapping);
+
+/**
+ * @brief Cached variant of jointGroupToOmplStateSpacePtr. The state space and
+ * its mappings are constructed once per joint model group and shared by every
+ * planner configuration for that group, so the joint name resolution and
+ * bounds construction run only for the first configuration. All group scoped
+ * settings (projection evaluator, segment fraction) are identical across a
+ * group's configurations, which is what makes sharing the space safe. Only
+ * call during (single threaded) node initialization.
+ * @param joint_group The joint group to construct this from
+ * @param ompl_kinematic_mapping Mapping from the ompl state to the corresponding kinematic state
+ * @param kinematic_ompl_mapping Mapping from the kinematic state to the corresponding ompl state
+ */
+ompl::base::StateSpacePtr cachedJointGroupToOmplStateSpacePtr(const planning_models::KinematicModel::JointModelGroup *joint_group,
                                                               ompl_ros_interface::OmplStateToKinematicStateMapping &ompl_kinematic_mapping,
                                                               ompl_ros_interface::KinematicStateToOmplStateMapping &kinematic_ompl_mapping);
 
@@ -58,6 +58,12 @@
 #include <pluginlib/class_loader.h>
 #include <kinematics_base/kinematics_base.h>
 
+// Boost
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <deque>
+
 namespace ompl_ros_interface
 {
 /**
@@ -114,6 +120,20 @@ public:
 
 private:
 
+  /**
+     @brief Dispatch a batch of seeds across the solver pool, each
+     thread working on its own kinematics plugin instance, and queue
+     the solutions found
+  */
+  void sampleBatch();
+
+  /** @brief One solver's share of a batch; a non-zero worker index
+      pins the thread node round-robin on multi-socket machines */
+  void sampleBatchThread(kinematics::KinematicsBase *solver,
+                         unsigned int pose_offset,
+                         unsigned int attempts,
+                         unsigned int worker_index);
+
   std::vector<geometry_msgs::PoseStamped> ik_poses_;
   unsigned int max_sample_count_,num_samples_;
   unsigned int ik_poses_counter_;
@@ -129,6 +149,14 @@ private:
   ompl_ros_interface::RobotStateToOmplStateMapping robot_state_to_ompl_state_mapping_;
   const planning_environment::CollisionModelsInterface *collision_models_interface_;
 
+  /** Extra kinematics plugin instances for batched sampling, one per
+      solver thread; from the <group>/ik_solver_threads parameter, 1
+      (the default) keeps the one seed at a time behavior */
+  std::vector<kinematics::KinematicsBase*> solver_pool_;
+  int ik_batch_size_;
+  std::deque<arm_navigation_msgs::RobotState> pending_solutions_;
+  boost::mutex solutions_lock_;
+
 };
 
 }
@@ -52,6 +52,9 @@
 // Diagnostics Message
 #include <ompl_ros_interface/OmplPlannerDiagnostics.h>
 
+#include <std_srvs/Empty.h>
+#include <boost/thread/mutex.hpp>
+
 namespace ompl_ros_interface
 {
   /**
@@ -63,6 +66,14 @@ class OmplRos
 public:
 
   OmplRos();
+
+  /**
+     @brief Construct the planner reading its configuration from the
+     given namespace instead of the node's private namespace. Intended
+     for hosting the planner inside another node's process.
+   */
+  OmplRos(const std::string &ns);
+
   ~OmplRos();
 
   /**
@@ -73,18 +84,32 @@ public:
   /**
      @brief Get a particular planner for a given group
    */
-  boost::shared_ptr<ompl_ros_interface::OmplRosPlanningGroup>& getPlanner(const std::string &group_name, 
+  boost::shared_ptr<ompl_ros_interface::OmplRosPlanningGroup>& getPlanner(const std::string &group_name,
                                                                           const std::string &planner_config_name);
 
-private:
-
  /**
     @brief Planning - choose the correct planner and then call it
-    with the request.
+    with the request. This is the service handler, but it is also the
+    direct in-process entry point: a caller hosting the planner in its
+    own process passes the request and response by reference and no
+    serialization of the (potentially large) planning scene payload
+    takes place.
  */
   bool computePlan(arm_navigation_msgs::GetMotionPlan::Request &request,
                    arm_navigation_msgs::GetMotionPlan::Response &response);
 
+  /**
+     @brief Service callback: rebuild every planner from the current
+     parameter server contents. Parameters are only ever read here and
+     at startup - never on the request path - so edited planner
+     configurations take effect through this service. Waits for an
+     in-flight plan to finish before swapping the planners.
+  */
+  bool reloadPlannerConfigs(std_srvs::Empty::Request &req,
+                            std_srvs::Empty::Response &res);
+
+private:
+
  /**
     @brief Get the names of all groups we will be planning for
  */
@@ -104,9 +129,12 @@ private:
   */
   std::map<std::string,boost::shared_ptr<ompl_ros_interface::OmplRosPlanningGroup> > planner_map_;
 
-  // ROS interface 
+  // ROS interface
   boost::shared_ptr<ompl_ros_interface::OmplRosPlanningGroup> empty_ptr;
   ros::ServiceServer                     plan_path_service_;
+  ros::ServiceServer                     reload_planner_configs_service_;
+  /// Serializes planning against planner reloads
+  boost::mutex                           planner_map_lock_;
   planning_environment::CollisionModelsInterface *collision_models_interface_;
   ros::NodeHandle                        node_handle_;
   std::string default_planner_config_;
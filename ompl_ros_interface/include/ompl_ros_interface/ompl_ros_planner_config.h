@@ -46,23 +46,27 @@
 
 namespace ompl_ros_interface
 {
-/** 
+/**
  * @class PlannerConfig
- * @brief A class to define a planner configuration 
+ * @brief A class to define a planner configuration. The whole
+ * configuration subtree is snapshotted from the ROS parameter server
+ * at construction; every accessor afterwards answers from memory, so
+ * no XML-RPC round trip ever happens on the planning request path.
  */
 class PlannerConfig
 {
 public:
   /**
-   * @brief Default constructor 
+   * @brief Default constructor
    * @param description - the namespace containing the parameters corresponding to the planner
-   * @param config - the actual name of the configuration space for this planner, the parameters will be 
-read from the ROS parameter server at "description/config".
+   * @param config - the actual name of the configuration space for this planner, the parameters are
+read from the ROS parameter server at "description/planner_configs/config" and cached.
    */
   PlannerConfig(const std::string &description, const std::string &config) : description_(description), config_(config)
   {
+    loadFromParamServer();
   }
-  
+
   ~PlannerConfig(void)
   {
   }
@@ -100,12 +104,19 @@ read from the ROS parameter server at "description/config".
    * @param def (optional) - the return value if the parameter does not exist 
    */
   int         getParamInt(const std::string &param, int def);
-  
+
 private:
-  
+
+  /**
+   * @brief Snapshot the configuration subtree with a single getParam
+   * call; called once at construction
+   */
+  void loadFromParamServer(void);
+
   std::string     description_;
   std::string     config_;
-  ros::NodeHandle nh_;	  
+  ros::NodeHandle nh_;
+  std::map<std::string, XmlRpc::XmlRpcValue> params_; /// In-memory snapshot of the configuration subtree
 };
 
 /** 
@@ -44,6 +44,7 @@
 // ROS msgs
 #include <arm_navigation_msgs/ArmNavigationErrorCodes.h>
 #include <arm_navigation_msgs/RobotTrajectory.h>
+#include <arm_navigation_msgs/MotionPlanStatistics.h>
 
 // Planning environment and models
 #include <planning_environment/models/collision_models_interface.h>
@@ -56,6 +57,10 @@
 #include <ompl_ros_interface/ompl_ros_planner_config.h>
 #include <ompl_ros_interface/helpers/ompl_ros_conversions.h>
 
+// Boost
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+
 // OMPL
 #include <ompl/geometric/SimpleSetup.h>
 #include <ompl/geometric/planners/rrt/RRT.h>
@@ -69,6 +74,7 @@
 #include <ompl/geometric/planners/kpiece/BKPIECE1.h>
 #include <ompl/geometric/planners/kpiece/LBKPIECE1.h>
 #include <ompl/geometric/planners/rrt/RRTstar.h>
+#include <ompl/geometric/planners/prm/PRM.h>
 
 namespace ompl_ros_interface
 {
@@ -159,6 +165,19 @@ namespace ompl_ros_interface
      */
     virtual bool initializePlanningStateSpace(ompl::base::StateSpacePtr &state_space) = 0;
 
+    /*
+      @brief Try to satisfy the request from the seed trajectory it
+      carries, if any, before the planner runs. Returns true when a
+      solution path has been installed in the problem definition and
+      planning can be skipped. The default implementation does not use
+      seeds.
+     */
+    virtual bool warmStart(arm_navigation_msgs::GetMotionPlan::Request &request,
+                           arm_navigation_msgs::GetMotionPlan::Response &response)
+    {
+      return false;
+    }
+
     std::string group_name_;///the name of the group
 
     planning_environment::CollisionModelsInterface* collision_models_interface_;///A pointer to an instance of the planning monitor
@@ -181,6 +200,11 @@ namespace ompl_ros_interface
     */
     ompl_ros_interface::OmplRosStateValidityCheckerPtr state_validity_checker_;
 
+    /** Cap on the number of waypoints interpolated into the solution
+        path (<group>/max_trajectory_points); 0 (the default) keeps
+        OMPL's interpolation at the valid segment resolution */
+    int max_trajectory_points_;
+
     /**
       @brief Returns the solution path
      */
@@ -206,18 +230,91 @@ namespace ompl_ros_interface
 
     bool initializePhysicalGroup();
 
-    bool initializePlanner();
-    bool initializeESTPlanner();
-    bool initializeSBLPlanner();
-    bool initializeRRTPlanner();
-    bool initializepRRTPlanner();
-    bool initializepSBLPlanner();
-    bool initializeKPIECEPlanner();
-    bool initializeLazyRRTPlanner();
-    bool initializeLBKPIECEPlanner();
-    bool initializeRRTConnectPlanner();
-    bool initializeRRTStarPlanner();
-    bool initializeBKPIECEPlanner();
+    /** The initializers fill in the passed planner instance, so extra
+        instances for parallel planning can be allocated from the same
+        configuration */
+    bool initializePlanner(ompl::base::PlannerPtr &planner);
+    bool initializeESTPlanner(ompl::base::PlannerPtr &planner);
+    bool initializeSBLPlanner(ompl::base::PlannerPtr &planner);
+    bool initializeRRTPlanner(ompl::base::PlannerPtr &planner);
+    bool initializepRRTPlanner(ompl::base::PlannerPtr &planner);
+    bool initializepSBLPlanner(ompl::base::PlannerPtr &planner);
+    bool initializeKPIECEPlanner(ompl::base::PlannerPtr &planner);
+    bool initializeLazyRRTPlanner(ompl::base::PlannerPtr &planner);
+    bool initializeLBKPIECEPlanner(ompl::base::PlannerPtr &planner);
+    bool initializeRRTConnectPlanner(ompl::base::PlannerPtr &planner);
+    bool initializeRRTStarPlanner(ompl::base::PlannerPtr &planner);
+    bool initializeBKPIECEPlanner(ompl::base::PlannerPtr &planner);
+    bool initializePRMPlanner(ompl::base::PlannerPtr &planner);
+
+    /** Multi-query mode (<group>/multi_query, PRM configurations
+        only): the roadmap persists across requests and only the
+        previous query's start/goal connections are dropped, so
+        repeated queries in a static scene become graph searches. The
+        roadmap is rebuilt whenever the collision scene version moved
+        or a request carries path constraints, since its edges were
+        not validated against those. */
+    bool multi_query_;
+    unsigned long roadmap_scene_version_;
+
+    /**
+       @brief Race parallel_planners_ instances of the configured
+       planner over the same problem; the first solution wins and
+       flips the shared termination flag so the others stop. Each
+       instance has its own problem definition, the validity checker
+       hands each thread its own clone of the kinematic state, and
+       collision checks run on per-thread clones of the environment.
+     */
+    bool solveParallel(double timeout);
+    void parallelSolveThread(ompl::base::Planner *planner, ros::WallTime deadline, unsigned int worker_index);
+    bool terminateParallelSolve(const ros::WallTime &deadline);
+
+    /**
+       @brief Simplify the solution path in small time slices. The
+       path stays valid after every pass, so whatever has been
+       achieved when the budget runs out is what gets returned. A
+       budget of zero or less runs the passes once to completion,
+       which is the old behavior.
+     */
+    void simplifySolutionPath(double budget);
+
+    /** Simplification budget in seconds, from
+        <group>/simplification_time */
+    double simplification_time_;
+
+    /**
+       @brief Set the longest valid segment fraction for the current
+       scene. With <group>/adaptive_segment_resolution enabled, the
+       configured fraction is treated as the cluttered-scene value and
+       relaxed by up to <group>/segment_resolution_max_relaxation in
+       sparse scenes, using the collision map cell count as the
+       density proxy; fewer motion validation checks are then spent in
+       open space.
+     */
+    void updateSegmentResolution();
+
+    bool adaptive_segment_resolution_;
+    double longest_valid_segment_fraction_;
+    int segment_resolution_dense_cells_;
+    double segment_resolution_max_relaxation_;
+
+    /** Per-request planner statistics, filled in over the course of
+        computePlan() and published on the planner_statistics topic
+        when the request finishes */
+    arm_navigation_msgs::MotionPlanStatistics planner_statistics_;
+    ros::Publisher statistics_publisher_;
+
+    /** Publisher for per-stage trace spans; spans are only emitted
+        for requests that carry a non-zero trace_id */
+    ros::Publisher trace_publisher_;
+
+    /** Number of planner instances raced per request; from the
+        <group>/parallel_planners parameter, 1 (the default) keeps the
+        single-threaded behavior */
+    int parallel_planners_;
+    std::vector<ompl::base::PlannerPtr> extra_planners_;
+    bool parallel_solve_found_;
+    boost::mutex parallel_solve_lock_;
 
 
     bool configureStateValidityChecker(arm_navigation_msgs::GetMotionPlan::Request &request,
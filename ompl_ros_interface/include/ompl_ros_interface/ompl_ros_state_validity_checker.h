@@ -46,6 +46,9 @@
 #include <ompl/base/StateValidityChecker.h>
 #include <ompl/base/State.h>
 
+#include <boost/thread/thread.hpp>
+#include <boost/thread/tss.hpp>
+
 
 namespace ompl_ros_interface
 {
@@ -61,10 +64,14 @@ public:
    * @param si - A pointer to the space information used by this checker
    * @param planning_monitor - A pointer to the planning monitor instance used by this checker
    */
-  OmplRosStateValidityChecker(ompl::base::SpaceInformation *si, 
+  OmplRosStateValidityChecker(ompl::base::SpaceInformation *si,
                               planning_environment::CollisionModelsInterface *cmi) :
-    ompl::base::StateValidityChecker(si), 
-    collision_models_interface_(cmi)
+    ompl::base::StateValidityChecker(si),
+    collision_models_interface_(cmi),
+    configure_epoch_(0),
+    validity_check_count_(0),
+    validity_check_time_(0.0),
+    workspace_check_active_(false)
   {
   }
   
@@ -100,11 +107,144 @@ public:
    */
   virtual bool isStateValid(const ompl::base::State *ompl_state) = 0;
 
-protected:	
+  /*
+    @brief Number of validity checks evaluated since the checker was
+    last configured for a request
+   */
+  unsigned int getValidityCheckCount() const
+  {
+    return validity_check_count_;
+  }
+
+  /*
+    @brief Wall time (seconds) spent evaluating validity checks since
+    the checker was last configured for a request
+   */
+  double getValidityCheckTime() const
+  {
+    return validity_check_time_;
+  }
+
+  /**
+     @brief Accounts one isValid() call: bumps the check counter on
+     construction and adds the elapsed wall time on destruction.
+     Derived checkers put one of these at the top of isValid(). The
+     counters are updated without synchronization, so under parallel
+     planning the totals are approximate.
+   */
+  class ScopedCheckStat
+  {
+  public:
+    ScopedCheckStat(const OmplRosStateValidityChecker *checker) : checker_(checker), start_(ros::WallTime::now())
+    {
+    }
+    ~ScopedCheckStat()
+    {
+      checker_->validity_check_count_++;
+      checker_->validity_check_time_ += (ros::WallTime::now() - start_).toSec();
+    }
+  private:
+    const OmplRosStateValidityChecker *checker_;
+    ros::WallTime start_;
+  };
+  friend class ScopedCheckStat;
+
+protected:
   planning_models::KinematicState::JointStateGroup *joint_state_group_;
   planning_environment::CollisionModelsInterface* collision_models_interface_;
   planning_models::KinematicState *kinematic_state_;
-    
+
+  /*
+    @brief Get the kinematic state and joint state group the calling
+    thread should write into while checking a state. The thread that
+    called configureOnRequest() gets the configured master state;
+    every other thread gets a lazily created thread-local clone of it
+    (refreshed on each new request), so several planner threads can
+    evaluate states against this checker concurrently.
+   */
+  void getThreadSafeState(planning_models::KinematicState *&kinematic_state,
+                          planning_models::KinematicState::JointStateGroup *&joint_state_group) const;
+
+  /** @brief One planner thread's clone of the configured state */
+  struct PerThreadState
+  {
+    PerThreadState(const planning_models::KinematicState &master,
+                   const std::string &group_name,
+                   unsigned int epoch) : state(master), epoch(epoch)
+    {
+      group = state.getJointStateGroup(group_name);
+    }
+
+    planning_models::KinematicState state;
+    planning_models::KinematicState::JointStateGroup *group;
+    unsigned int epoch;
+  };
+
+  mutable boost::thread_specific_ptr<PerThreadState> per_thread_state_;
+  boost::thread::id configure_thread_;
+  unsigned int configure_epoch_;
+
+  /*
+    @brief Compute the memoization key for the current values of a
+    joint state group. Joint values are quantized well below any
+    collision-relevant motion, so states the planner revisits hash
+    identically despite floating point noise.
+   */
+  unsigned long long validityCacheKey(const planning_models::KinematicState::JointStateGroup *joint_state_group) const;
+
+  /*
+    @brief Look up a previously computed verdict for the key. Returns
+    true on a hit and writes the verdict to valid.
+   */
+  bool lookupValidity(unsigned long long key, bool &valid) const;
+
+  /** @brief Record the verdict for the key */
+  void storeValidity(unsigned long long key, bool valid) const;
+
+  /**
+     @brief A per-thread direct-mapped cache of validity verdicts
+     keyed by the quantized joint vector. RRT variants revisit states
+     and path simplification re-checks segments the planner already
+     validated; a hit skips the full FK + collision pass. The cache
+     lives for one request only (the epoch ties it to
+     configureOnRequest(), which is called whenever the planning
+     scene changes), so verdicts can never go stale.
+   */
+  struct ValidityCache
+  {
+    enum { SIZE = 65536 };
+
+    ValidityCache(unsigned int epoch) : epoch(epoch), keys(SIZE, 0), verdicts(SIZE, 0)
+    {
+    }
+
+    unsigned int epoch;
+    std::vector<unsigned long long> keys;
+    std::vector<unsigned char> verdicts;
+  };
+
+  ValidityCache* getValidityCache() const;
+
+  mutable boost::thread_specific_ptr<ValidityCache> validity_cache_;
+
+  mutable unsigned int validity_check_count_;
+  mutable double validity_check_time_;
+
+  /*
+    @brief Cheap workspace pretest run right after FK: every link the
+    group updates must have its origin inside the axis-aligned
+    workspace box the request carried, so out-of-bounds states are
+    rejected before any collision checking. Only active when the
+    request supplied an axis-aligned box in the world frame; when the
+    pretest is inactive it returns true, leaving behavior without
+    workspace parameters unchanged.
+   */
+  bool isStateInWorkspace(const planning_models::KinematicState::JointStateGroup *joint_state_group) const;
+
+  bool workspace_check_active_;
+  tf::Vector3 workspace_min_;
+  tf::Vector3 workspace_max_;
+
   planning_environment::KinematicConstraintEvaluatorSet path_constraint_evaluator_set_;
   planning_environment::KinematicConstraintEvaluatorSet goal_constraint_evaluator_set_;
   arm_navigation_msgs::ArmNavigationErrorCodes error_code_;
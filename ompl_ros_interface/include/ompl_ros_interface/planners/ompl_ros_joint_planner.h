@@ -78,6 +78,12 @@ namespace ompl_ros_interface
     virtual bool setGoal(arm_navigation_msgs::GetMotionPlan::Request &request,
                          arm_navigation_msgs::GetMotionPlan::Response &response);
 
+    /**
+     * @brief Try to reuse the request's seed trajectory as the solution
+     */
+    virtual bool warmStart(arm_navigation_msgs::GetMotionPlan::Request &request,
+                           arm_navigation_msgs::GetMotionPlan::Response &response);
+
     /**
      * @brief Initialize the state validity checker
      */
@@ -45,6 +45,9 @@
 #include <pluginlib/class_loader.h>
 #include <kinematics_base/kinematics_base.h>
 
+// Boost
+#include <boost/thread/tss.hpp>
+
 namespace ompl_ros_interface
 {
 /**
@@ -105,11 +108,50 @@ public:
 protected:
   kinematics::KinematicsBase* kinematics_solver_;
 
+  /**
+   * @brief Look up a cached IK solution for a pose in the same workspace voxel.
+   * Nearby task-space samples resolve to the same voxel, so the cached joint
+   * configuration is a seed from which searchPositionIK converges almost
+   * immediately. Returns false when the voxel has no cached solution.
+   */
+  bool lookupIKSeed(const geometry_msgs::Pose &pose, std::vector<double> &seed) const;
+
+  /**
+   * @brief Cache a successful IK solution under the workspace voxel of its pose
+   */
+  void storeIKSolution(const geometry_msgs::Pose &pose, const std::vector<double> &solution) const;
+
+  /**
+   * @brief Invalidate all cached IK solutions. Derived classes should call this
+   * from configureOnRequest so solutions never persist across planning requests.
+   */
+  void clearIKSolutionCache();
+
 private:
   std::string group_name_;
   std::string physical_group_name_;
   pluginlib::ClassLoader<kinematics::KinematicsBase> kinematics_loader_;
 
+  /// Per-thread direct mapped cache of recent IK solutions keyed by the
+  /// hash of the quantized pose; slots with a zero key are empty
+  struct IKSeedCache
+  {
+    enum { SIZE = 4096 };
+    IKSeedCache(unsigned int epoch) : epoch(epoch), keys(SIZE,0), solutions(SIZE)
+    {
+    }
+    unsigned int epoch;
+    std::vector<unsigned long long> keys;
+    std::vector<std::vector<double> > solutions;
+  };
+
+  unsigned long long ikCacheKey(const geometry_msgs::Pose &pose) const;
+  IKSeedCache* getIKSeedCache() const;
+
+  mutable boost::thread_specific_ptr<IKSeedCache> ik_seed_cache_;
+  unsigned int ik_cache_epoch_;
+  double ik_cache_translation_resolution_;
+  double ik_cache_rotation_resolution_;
 };
 }
 
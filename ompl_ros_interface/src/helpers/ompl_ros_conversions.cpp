@@ -135,10 +135,43 @@ ompl::base::StateSpacePtr jointGroupToOmplStateSpacePtr(const planning_models::K
   {
     ROS_DEBUG("State state space: subspace %d has name %s",i,state_space->getSubspace(i)->getName().c_str());
   }
+  ompl_kinematic_mapping.compileCopyPlan();
+  kinematic_ompl_mapping.compileCopyPlan();
   return ompl_state_space;
 };
 
-bool addToOmplStateSpace(const planning_models::KinematicModel* kinematic_model, 
+ompl::base::StateSpacePtr cachedJointGroupToOmplStateSpacePtr(const planning_models::KinematicModel::JointModelGroup *joint_group,
+                                                              ompl_ros_interface::OmplStateToKinematicStateMapping &ompl_kinematic_mapping,
+                                                              ompl_ros_interface::KinematicStateToOmplStateMapping &kinematic_ompl_mapping)
+{
+  struct CachedGroupSpace
+  {
+    ompl::base::StateSpacePtr state_space;
+    ompl_ros_interface::OmplStateToKinematicStateMapping ompl_kinematic_mapping;
+    ompl_ros_interface::KinematicStateToOmplStateMapping kinematic_ompl_mapping;
+  };
+  static std::map<const planning_models::KinematicModel::JointModelGroup*, CachedGroupSpace> cache;
+
+  std::map<const planning_models::KinematicModel::JointModelGroup*, CachedGroupSpace>::iterator it = cache.find(joint_group);
+  if(it == cache.end())
+  {
+    CachedGroupSpace entry;
+    entry.state_space = jointGroupToOmplStateSpacePtr(joint_group,
+                                                      entry.ompl_kinematic_mapping,
+                                                      entry.kinematic_ompl_mapping);
+    if(!entry.state_space)
+      return entry.state_space;
+    it = cache.insert(std::make_pair(joint_group,entry)).first;
+    ROS_DEBUG("Constructed state space for group %s",joint_group->getName().c_str());
+  }
+  else
+    ROS_DEBUG("Reusing state space for group %s",joint_group->getName().c_str());
+  ompl_kinematic_mapping = it->second.ompl_kinematic_mapping;
+  kinematic_ompl_mapping = it->second.kinematic_ompl_mapping;
+  return it->second.state_space;
+};
+
+bool addToOmplStateSpace(const planning_models::KinematicModel* kinematic_model,
                          const std::string &joint_name,
                          ompl::base::StateSpacePtr &ompl_state_space)
 {
@@ -327,6 +360,7 @@ bool getJointStateGroupToOmplStateMapping(planning_models::KinematicState::Joint
       return false;
     }
   }
+  mapping.compileCopyPlan();
   return true;
 };
 
@@ -385,7 +419,8 @@ bool getOmplStateToJointStateGroupMapping(const ompl::base::ScopedState<ompl::ba
       ROS_ERROR("Could not find mapping for joint_state %s",real_vector_state_space->as<ompl::base::RealVectorStateSpace>()->getDimensionName(i).c_str());
       return false;
     }
-  }  
+  }
+  mapping.compileCopyPlan();
   return true;
 };
 
@@ -722,38 +757,201 @@ void quaternionMsgToSO3StateSpace(const geometry_msgs::Quaternion &quaternion_ms
   quaternion.w = quaternion_msg.w;
 };
 
+/**
+   @brief Resolve the address of the scalar a copy plan op refers to
+   inside a compound state. The rotation access leans on
+   ompl::base::SO3StateSpace::StateType laying out x,y,z,w as
+   consecutive doubles, the same assumption OMPL itself makes in
+   getValueAddressAtIndex().
+*/
+static inline double* stateCopyAddress(ompl::base::CompoundState *state,
+                                       const ompl_ros_interface::StateCopyOp &op)
+{
+  switch(op.access)
+  {
+  case ompl_ros_interface::COPY_REAL_VECTOR:
+    return &state->as<ompl::base::RealVectorStateSpace::StateType>(op.space_index)->values[op.space_offset];
+  case ompl_ros_interface::COPY_SO2_VALUE:
+    return &state->as<ompl::base::SO2StateSpace::StateType>(op.space_index)->value;
+  case ompl_ros_interface::COPY_TRANSLATION:
+    return &state->as<ompl::base::CompoundState>(op.space_index)->as<ompl::base::RealVectorStateSpace::StateType>(0)->values[op.space_offset];
+  case ompl_ros_interface::COPY_ROTATION:
+    return &state->as<ompl::base::CompoundState>(op.space_index)->as<ompl::base::SO3StateSpace::StateType>(1)->x + op.space_offset;
+  case ompl_ros_interface::COPY_YAW:
+  default:
+    return &state->as<ompl::base::CompoundState>(op.space_index)->as<ompl::base::SO2StateSpace::StateType>(1)->value;
+  }
+}
+
+void KinematicStateToOmplStateMapping::compileCopyPlan()
+{
+  copy_plan.clear();
+  for(unsigned int i=0; i < joint_mapping_type.size(); i++)
+  {
+    StateCopyOp op;
+    op.joint_index = i;
+    op.wrap = false;
+    if(joint_mapping_type[i] == ompl_ros_interface::SO2)
+    {
+      op.space_index = joint_state_mapping[i];
+      op.space_offset = 0;
+      op.access = ompl_ros_interface::COPY_SO2_VALUE;
+      op.value_index = 0;
+      op.wrap = true;
+      copy_plan.push_back(op);
+    }
+    else if(joint_mapping_type[i] == ompl_ros_interface::SE2)
+    {
+      op.space_index = joint_state_mapping[i];
+      op.access = ompl_ros_interface::COPY_TRANSLATION;
+      for(unsigned int j=0; j < 2; j++)
+      {
+        op.space_offset = j;
+        op.value_index = j;
+        copy_plan.push_back(op);
+      }
+      op.access = ompl_ros_interface::COPY_YAW;
+      op.space_offset = 0;
+      op.value_index = 2;
+      copy_plan.push_back(op);
+    }
+    else if(joint_mapping_type[i] == ompl_ros_interface::SE3)
+    {
+      op.space_index = joint_state_mapping[i];
+      op.access = ompl_ros_interface::COPY_TRANSLATION;
+      for(unsigned int j=0; j < 3; j++)
+      {
+        op.space_offset = j;
+        op.value_index = j;
+        copy_plan.push_back(op);
+      }
+      op.access = ompl_ros_interface::COPY_ROTATION;
+      for(unsigned int j=0; j < 4; j++)
+      {
+        op.space_offset = j;
+        op.value_index = 3+j;
+        copy_plan.push_back(op);
+      }
+    }
+    else if(joint_mapping_type[i] == ompl_ros_interface::REAL_VECTOR)
+    {
+      op.space_index = real_vector_index;
+      op.space_offset = joint_state_mapping[i];
+      op.access = ompl_ros_interface::COPY_REAL_VECTOR;
+      op.value_index = 0;
+      copy_plan.push_back(op);
+    }
+  }
+};
+
+void OmplStateToKinematicStateMapping::compileCopyPlan()
+{
+  copy_plan.clear();
+  for(unsigned int i=0; i < mapping_type.size(); i++)
+  {
+    StateCopyOp op;
+    op.space_index = i;
+    op.wrap = false;
+    if(mapping_type[i] == ompl_ros_interface::SO2)
+    {
+      op.space_offset = 0;
+      op.access = ompl_ros_interface::COPY_SO2_VALUE;
+      op.joint_index = ompl_state_mapping[i];
+      op.value_index = 0;
+      copy_plan.push_back(op);
+    }
+    else if(mapping_type[i] == ompl_ros_interface::SE2)
+    {
+      op.joint_index = ompl_state_mapping[i];
+      op.access = ompl_ros_interface::COPY_TRANSLATION;
+      for(unsigned int j=0; j < 2; j++)
+      {
+        op.space_offset = j;
+        op.value_index = j;
+        copy_plan.push_back(op);
+      }
+      op.access = ompl_ros_interface::COPY_YAW;
+      op.space_offset = 0;
+      op.value_index = 2;
+      copy_plan.push_back(op);
+    }
+    else if(mapping_type[i] == ompl_ros_interface::SE3)
+    {
+      op.joint_index = ompl_state_mapping[i];
+      op.access = ompl_ros_interface::COPY_TRANSLATION;
+      for(unsigned int j=0; j < 3; j++)
+      {
+        op.space_offset = j;
+        op.value_index = j;
+        copy_plan.push_back(op);
+      }
+      op.access = ompl_ros_interface::COPY_ROTATION;
+      for(unsigned int j=0; j < 4; j++)
+      {
+        op.space_offset = j;
+        op.value_index = 3+j;
+        copy_plan.push_back(op);
+      }
+    }
+    else if(mapping_type[i] == ompl_ros_interface::REAL_VECTOR)
+    {
+      op.access = ompl_ros_interface::COPY_REAL_VECTOR;
+      op.value_index = 0;
+      for(unsigned int j=0; j < real_vector_mapping.size(); j++)
+      {
+        op.space_offset = j;
+        op.joint_index = real_vector_mapping[j];
+        copy_plan.push_back(op);
+      }
+    }
+  }
+};
+
 /**
    @brief Convert a kinematic state to an ompl state given the appropriate mapping
    @param joint_state_group The kinematic state to convert from
    @param mapping The given mapping
    @param ompl_scoped_state The ompl state to convert to
 */
-bool kinematicStateGroupToOmplState(const planning_models::KinematicState::JointStateGroup* joint_state_group, 
+bool kinematicStateGroupToOmplState(const planning_models::KinematicState::JointStateGroup* joint_state_group,
                                     const ompl_ros_interface::KinematicStateToOmplStateMapping &mapping,
                                     ompl::base::ScopedState<ompl::base::CompoundStateSpace> &ompl_scoped_state)
 {
   //  unsigned int num_state_spaces = ompl_scoped_state.getSpace()->as<ompl::base::CompoundStateSpace>()->getSubspaceCount();
   unsigned int num_states = joint_state_group->getDimension();
 
-  std::vector<planning_models::KinematicState::JointState*> joint_states = joint_state_group->getJointStateVector();
-  std::vector<std::string> joint_names = joint_state_group->getJointNames();
+  const std::vector<planning_models::KinematicState::JointState*>& joint_states = joint_state_group->getJointStateVector();
+  if(!mapping.copy_plan.empty())
+  {
+    ompl::base::CompoundState *state = ompl_scoped_state.get();
+    unsigned int num_ops = mapping.copy_plan.size();
+    for(unsigned int i=0; i < num_ops; i++)
+    {
+      const StateCopyOp &op = mapping.copy_plan[i];
+      double value = joint_states[op.joint_index]->getJointStateValues()[op.value_index];
+      if(op.wrap)
+        value = angles::normalize_angle(value);
+      *stateCopyAddress(state, op) = value;
+    }
+    return true;
+  }
   for(unsigned int i=0; i < num_states; i++)
   {
     if(mapping.joint_mapping_type[i] == ompl_ros_interface::SO2)
     {
-      std::vector<double> value = joint_states[i]->getJointStateValues();
+      const std::vector<double>& value = joint_states[i]->getJointStateValues();
       ompl_scoped_state->as<ompl::base::SO2StateSpace::StateType>(mapping.joint_state_mapping[i])->value = angles::normalize_angle(value[0]);
     }
     else if(mapping.joint_mapping_type[i] == ompl_ros_interface::SE2)
     {
-      std::vector<double> value = joint_states[i]->getJointStateValues();
+      const std::vector<double>& value = joint_states[i]->getJointStateValues();
       ompl_scoped_state->as<ompl::base::SE2StateSpace::StateType>(mapping.joint_state_mapping[i])->setX(value[0]);
       ompl_scoped_state->as<ompl::base::SE2StateSpace::StateType>(mapping.joint_state_mapping[i])->setY(value[1]);
       ompl_scoped_state->as<ompl::base::SE2StateSpace::StateType>(mapping.joint_state_mapping[i])->setYaw(value[2]);
     }
     else if(mapping.joint_mapping_type[i] == ompl_ros_interface::SE3)
     {
-      std::vector<double> value = joint_states[i]->getJointStateValues();
+      const std::vector<double>& value = joint_states[i]->getJointStateValues();
       ompl_scoped_state->as<ompl::base::SE3StateSpace::StateType>(mapping.joint_state_mapping[i])->setX(value[0]);
       ompl_scoped_state->as<ompl::base::SE3StateSpace::StateType>(mapping.joint_state_mapping[i])->setY(value[1]);
       ompl_scoped_state->as<ompl::base::SE3StateSpace::StateType>(mapping.joint_state_mapping[i])->setZ(value[2]);
@@ -764,7 +962,7 @@ bool kinematicStateGroupToOmplState(const planning_models::KinematicState::Joint
     }
     else if(mapping.joint_mapping_type[i] == ompl_ros_interface::REAL_VECTOR)
     {
-      std::vector<double> value = joint_states[i]->getJointStateValues();
+      const std::vector<double>& value = joint_states[i]->getJointStateValues();
       ompl_scoped_state->as<ompl::base::RealVectorStateSpace::StateType>(mapping.real_vector_index)->values[mapping.joint_state_mapping[i]] = value[0];
     }
   }
@@ -781,47 +979,44 @@ bool omplStateToKinematicStateGroup(const ompl::base::ScopedState<ompl::base::Co
                                     const ompl_ros_interface::OmplStateToKinematicStateMapping &mapping,
                                     planning_models::KinematicState::JointStateGroup* joint_state_group)
 {
+  if(!mapping.copy_plan.empty())
+    return omplStateToKinematicStateGroup(static_cast<const ompl::base::State*>(ompl_scoped_state.get()), mapping, joint_state_group);
   unsigned int num_state_spaces = ompl_scoped_state.getSpace()->as<ompl::base::CompoundStateSpace>()->getSubspaceCount();
   //  unsigned int num_states = joint_state_group->getDimension();
 
-  std::vector<planning_models::KinematicState::JointState*> joint_states = joint_state_group->getJointStateVector();
+  const std::vector<planning_models::KinematicState::JointState*>& joint_states = joint_state_group->getJointStateVector();
   for(unsigned int i=0; i < num_state_spaces; i++)
   {
     if(mapping.mapping_type[i] == ompl_ros_interface::SO2)
     {
-      std::vector<double> value;
-      value.push_back(ompl_scoped_state->as<ompl::base::SO2StateSpace::StateType>(i)->value);
-      joint_states[mapping.ompl_state_mapping[i]]->setJointStateValues(value);
+      joint_states[mapping.ompl_state_mapping[i]]->setJointStateValue(0,ompl_scoped_state->as<ompl::base::SO2StateSpace::StateType>(i)->value);
     }
     else if(mapping.mapping_type[i] == ompl_ros_interface::SE2)
     {
-      std::vector<double> values;
-      values.push_back(ompl_scoped_state->as<ompl::base::SE2StateSpace::StateType>(i)->getX());
-      values.push_back(ompl_scoped_state->as<ompl::base::SE2StateSpace::StateType>(i)->getY());
-      values.push_back(ompl_scoped_state->as<ompl::base::SE2StateSpace::StateType>(i)->getYaw());
-      joint_states[mapping.ompl_state_mapping[i]]->setJointStateValues(values);
+      double values[3];
+      values[0] = ompl_scoped_state->as<ompl::base::SE2StateSpace::StateType>(i)->getX();
+      values[1] = ompl_scoped_state->as<ompl::base::SE2StateSpace::StateType>(i)->getY();
+      values[2] = ompl_scoped_state->as<ompl::base::SE2StateSpace::StateType>(i)->getYaw();
+      joint_states[mapping.ompl_state_mapping[i]]->setJointStateValues(values,3);
     }
     else if(mapping.mapping_type[i] == ompl_ros_interface::SE3)
     {
-      std::vector<double> values;
-      values.push_back(ompl_scoped_state->as<ompl::base::SE3StateSpace::StateType>(i)->getX());
-      values.push_back(ompl_scoped_state->as<ompl::base::SE3StateSpace::StateType>(i)->getY());
-      values.push_back(ompl_scoped_state->as<ompl::base::SE3StateSpace::StateType>(i)->getZ());
-      values.push_back(ompl_scoped_state->as<ompl::base::SE3StateSpace::StateType>(i)->rotation().x);
-      values.push_back(ompl_scoped_state->as<ompl::base::SE3StateSpace::StateType>(i)->rotation().y);
-      values.push_back(ompl_scoped_state->as<ompl::base::SE3StateSpace::StateType>(i)->rotation().z);
-      values.push_back(ompl_scoped_state->as<ompl::base::SE3StateSpace::StateType>(i)->rotation().w);
-      joint_states[mapping.ompl_state_mapping[i]]->setJointStateValues(values);
+      double values[7];
+      values[0] = ompl_scoped_state->as<ompl::base::SE3StateSpace::StateType>(i)->getX();
+      values[1] = ompl_scoped_state->as<ompl::base::SE3StateSpace::StateType>(i)->getY();
+      values[2] = ompl_scoped_state->as<ompl::base::SE3StateSpace::StateType>(i)->getZ();
+      values[3] = ompl_scoped_state->as<ompl::base::SE3StateSpace::StateType>(i)->rotation().x;
+      values[4] = ompl_scoped_state->as<ompl::base::SE3StateSpace::StateType>(i)->rotation().y;
+      values[5] = ompl_scoped_state->as<ompl::base::SE3StateSpace::StateType>(i)->rotation().z;
+      values[6] = ompl_scoped_state->as<ompl::base::SE3StateSpace::StateType>(i)->rotation().w;
+      joint_states[mapping.ompl_state_mapping[i]]->setJointStateValues(values,7);
     }
     else if(mapping.mapping_type[i] == ompl_ros_interface::REAL_VECTOR)
     {
-      ompl::base::StateSpacePtr real_vector_state_space = ompl_scoped_state.getSpace()->as<ompl::base::CompoundStateSpace>()->getSubspace(mapping.real_vector_index);
       unsigned int real_vector_size = mapping.real_vector_mapping.size();
       for(unsigned int j=0; j < real_vector_size; j++)
       {
-        std::vector<double> values;
-        values.push_back(ompl_scoped_state->as<ompl::base::RealVectorStateSpace::StateType>(mapping.real_vector_index)->values[j]);
-        joint_states[mapping.real_vector_mapping[j]]->setJointStateValues(values);
+        joint_states[mapping.real_vector_mapping[j]]->setJointStateValue(0,ompl_scoped_state->as<ompl::base::RealVectorStateSpace::StateType>(mapping.real_vector_index)->values[j]);
       }
     }
   }
@@ -841,43 +1036,63 @@ bool omplStateToKinematicStateGroup(const ompl::base::State *ompl_state,
   unsigned int num_state_spaces = mapping.ompl_state_mapping.size();
   const ompl::base::CompoundState *ompl_compound_state = dynamic_cast<const ompl::base::CompoundState*> (ompl_state);
 
-  std::vector<planning_models::KinematicState::JointState*> joint_states = joint_state_group->getJointStateVector();
+  const std::vector<planning_models::KinematicState::JointState*>& joint_states = joint_state_group->getJointStateVector();
+  if(!mapping.copy_plan.empty())
+  {
+    //replay the compiled plan; ops for a joint are contiguous, so the
+    //values of each joint are gathered and handed over in one call
+    ompl::base::CompoundState *state = const_cast<ompl::base::CompoundState*>(ompl_compound_state);
+    unsigned int num_ops = mapping.copy_plan.size();
+    unsigned int i = 0;
+    while(i < num_ops)
+    {
+      unsigned int joint_index = mapping.copy_plan[i].joint_index;
+      double values[7];
+      unsigned int count = 0;
+      do
+      {
+        const StateCopyOp &op = mapping.copy_plan[i];
+        values[op.value_index] = *stateCopyAddress(state, op);
+        count++;
+        i++;
+      }
+      while(i < num_ops && mapping.copy_plan[i].joint_index == joint_index);
+      joint_states[joint_index]->setJointStateValues(values, count);
+    }
+    return true;
+  }
   for(unsigned int i=0; i < num_state_spaces; i++)
   {
     if(mapping.mapping_type[i] == ompl_ros_interface::SO2)
     {
-      std::vector<double> value;
-      value.push_back(ompl_compound_state->as<ompl::base::SO2StateSpace::StateType>(i)->value);
-      joint_states[mapping.ompl_state_mapping[i]]->setJointStateValues(value);
+      joint_states[mapping.ompl_state_mapping[i]]->setJointStateValue(0,ompl_compound_state->as<ompl::base::SO2StateSpace::StateType>(i)->value);
     }
     else if(mapping.mapping_type[i] == ompl_ros_interface::SE2)
     {
-      std::vector<double> values;
-      values.push_back(ompl_compound_state->as<ompl::base::SE2StateSpace::StateType>(i)->getX());
-      values.push_back(ompl_compound_state->as<ompl::base::SE2StateSpace::StateType>(i)->getY());
-      values.push_back(ompl_compound_state->as<ompl::base::SE2StateSpace::StateType>(i)->getYaw());
-      joint_states[mapping.ompl_state_mapping[i]]->setJointStateValues(values);
+      double values[3];
+      values[0] = ompl_compound_state->as<ompl::base::SE2StateSpace::StateType>(i)->getX();
+      values[1] = ompl_compound_state->as<ompl::base::SE2StateSpace::StateType>(i)->getY();
+      values[2] = ompl_compound_state->as<ompl::base::SE2StateSpace::StateType>(i)->getYaw();
+      joint_states[mapping.ompl_state_mapping[i]]->setJointStateValues(values,3);
     }
     else if(mapping.mapping_type[i] == ompl_ros_interface::SE3)
     {
-      std::vector<double> values;
-      values.push_back(ompl_compound_state->as<ompl::base::SE3StateSpace::StateType>(i)->getX());
-      values.push_back(ompl_compound_state->as<ompl::base::SE3StateSpace::StateType>(i)->getY());
-      values.push_back(ompl_compound_state->as<ompl::base::SE3StateSpace::StateType>(i)->getZ());
-      values.push_back(ompl_compound_state->as<ompl::base::SE3StateSpace::StateType>(i)->rotation().x);
-      values.push_back(ompl_compound_state->as<ompl::base::SE3StateSpace::StateType>(i)->rotation().y);
-      values.push_back(ompl_compound_state->as<ompl::base::SE3StateSpace::StateType>(i)->rotation().z);
-      values.push_back(ompl_compound_state->as<ompl::base::SE3StateSpace::StateType>(i)->rotation().w);
-      joint_states[mapping.ompl_state_mapping[i]]->setJointStateValues(values);
+      double values[7];
+      values[0] = ompl_compound_state->as<ompl::base::SE3StateSpace::StateType>(i)->getX();
+      values[1] = ompl_compound_state->as<ompl::base::SE3StateSpace::StateType>(i)->getY();
+      values[2] = ompl_compound_state->as<ompl::base::SE3StateSpace::StateType>(i)->getZ();
+      values[3] = ompl_compound_state->as<ompl::base::SE3StateSpace::StateType>(i)->rotation().x;
+      values[4] = ompl_compound_state->as<ompl::base::SE3StateSpace::StateType>(i)->rotation().y;
+      values[5] = ompl_compound_state->as<ompl::base::SE3StateSpace::StateType>(i)->rotation().z;
+      values[6] = ompl_compound_state->as<ompl::base::SE3StateSpace::StateType>(i)->rotation().w;
+      joint_states[mapping.ompl_state_mapping[i]]->setJointStateValues(values,7);
     }
     else if(mapping.mapping_type[i] == ompl_ros_interface::REAL_VECTOR)
     {
       unsigned int real_vector_size = mapping.real_vector_mapping.size();
       for(unsigned int j=0; j < real_vector_size; j++)
       {
-        std::vector<double> values;
-        values.push_back(ompl_compound_state->as<ompl::base::RealVectorStateSpace::StateType>(mapping.real_vector_index)->values[j]);
-        joint_states[mapping.real_vector_mapping[j]]->setJointStateValues(values);
+        joint_states[mapping.real_vector_mapping[j]]->setJointStateValue(0,ompl_compound_state->as<ompl::base::RealVectorStateSpace::StateType>(mapping.real_vector_index)->values[j]);
       }
     }
   }
@@ -971,27 +1186,66 @@ bool omplPathGeometricToRobotTrajectory(const ompl::geometric::PathGeometric &pa
       }
   }
   
+  //compile the single dof portion of the mapping into a flat scalar
+  //plan once and collect the pose subspaces; the per-waypoint loop
+  //then runs without any dispatch on state space types
+  std::vector<StateCopyOp> copy_plan;
+  std::vector<unsigned int> pose_spaces;
+  for(unsigned int j=0; j < num_state_spaces; j++)
+  {
+    StateCopyOp op;
+    op.space_index = j;
+    op.wrap = false;
+    if(mapping.mapping_type[j] == ompl_ros_interface::SO2)
+    {
+      op.space_offset = 0;
+      op.access = ompl_ros_interface::COPY_SO2_VALUE;
+      op.joint_index = mapping.ompl_state_mapping[j];
+      op.value_index = 0;
+      copy_plan.push_back(op);
+    }
+    else if(mapping.mapping_type[j] == ompl_ros_interface::SE2 ||
+            mapping.mapping_type[j] == ompl_ros_interface::SE3 ||
+            mapping.mapping_type[j] == ompl_ros_interface::SO3)
+      pose_spaces.push_back(j);
+    else if(j == (unsigned int) mapping.real_vector_index)
+    {
+      op.access = ompl_ros_interface::COPY_REAL_VECTOR;
+      op.value_index = 0;
+      for(unsigned int k=0; k < mapping.real_vector_mapping.size(); k++)
+      {
+        op.space_offset = k;
+        op.joint_index = mapping.real_vector_mapping[k];
+        copy_plan.push_back(op);
+      }
+    }
+  }
+
   for(unsigned int i=0; i < num_points; i++)
   {
-    for(unsigned int j=0; j < num_state_spaces; j++)
+    ompl::base::CompoundState *state = const_cast<ompl::base::CompoundState*>(path.getState(i)->as<ompl::base::CompoundState>());
+    if(single_dof)
     {
-      if(mapping.mapping_type[j] == ompl_ros_interface::SO2)
-        robot_trajectory.joint_trajectory.points[i].positions[mapping.ompl_state_mapping[j]] = path.getState(i)->as<ompl::base::CompoundState>()->as<ompl::base::SO2StateSpace::StateType>(j)->value;
-      else if(mapping.mapping_type[j] == ompl_ros_interface::SE2)
-        ompl_ros_interface::SE2StateSpaceToPoseMsg(*(path.getState(i)->as<ompl::base::CompoundState>()->as<ompl::base::SE2StateSpace::StateType>(j)),robot_trajectory.multi_dof_joint_trajectory.points[i].poses[mapping.ompl_state_mapping[j]]);
-      else if(mapping.mapping_type[j] == ompl_ros_interface::SE3)
-        ompl_ros_interface::SE3StateSpaceToPoseMsg(*(path.getState(i)->as<ompl::base::CompoundState>()->as<ompl::base::SE3StateSpace::StateType>(j)),robot_trajectory.multi_dof_joint_trajectory.points[i].poses[mapping.ompl_state_mapping[j]]);
-      else if(mapping.mapping_type[j] == ompl_ros_interface::SO3)
-        ompl_ros_interface::SO3StateSpaceToPoseMsg(*(path.getState(i)->as<ompl::base::CompoundState>()->as<ompl::base::SO3StateSpace::StateType>(j)),robot_trajectory.multi_dof_joint_trajectory.points[i].poses[mapping.ompl_state_mapping[j]]);
-      else // real vector value
+      std::vector<double> &positions = robot_trajectory.joint_trajectory.points[i].positions;
+      for(unsigned int j=0; j < copy_plan.size(); j++)
       {
-        const ompl::base::State* real_vector_state = path.getState(i)->as<ompl::base::CompoundState>()->as<ompl::base::RealVectorStateSpace::StateType>(mapping.real_vector_index);
-        for(unsigned int k=0; k < mapping.real_vector_mapping.size(); k++)
-          robot_trajectory.joint_trajectory.points[i].positions[mapping.real_vector_mapping[k]] = real_vector_state->as<ompl::base::RealVectorStateSpace::StateType>()->values[k];
+        const StateCopyOp &op = copy_plan[j];
+        positions[op.joint_index] = *stateCopyAddress(state, op);
       }
     }
+    for(unsigned int j=0; j < pose_spaces.size(); j++)
+    {
+      unsigned int space = pose_spaces[j];
+      geometry_msgs::Pose &pose = robot_trajectory.multi_dof_joint_trajectory.points[i].poses[mapping.ompl_state_mapping[space]];
+      if(mapping.mapping_type[space] == ompl_ros_interface::SE2)
+        ompl_ros_interface::SE2StateSpaceToPoseMsg(*(state->as<ompl::base::SE2StateSpace::StateType>(space)),pose);
+      else if(mapping.mapping_type[space] == ompl_ros_interface::SE3)
+        ompl_ros_interface::SE3StateSpaceToPoseMsg(*(state->as<ompl::base::SE3StateSpace::StateType>(space)),pose);
+      else
+        ompl_ros_interface::SO3StateSpaceToPoseMsg(*(state->as<ompl::base::SO3StateSpace::StateType>(space)),pose);
+    }
   }
-  return true;  
+  return true;
 };
 
 bool getOmplStateToRobotTrajectoryMapping(const ompl::base::StateSpacePtr &state_space,
@@ -1106,13 +1360,13 @@ bool getOmplStateToJointTrajectoryMapping(const ompl::base::StateSpacePtr &state
 bool jointConstraintsToOmplState(const std::vector<arm_navigation_msgs::JointConstraint> &joint_constraints,
                                  ompl::base::ScopedState<ompl::base::CompoundStateSpace> &ompl_scoped_state)
 {
-  sensor_msgs::JointState joint_state = arm_navigation_msgs::jointConstraintsToJointState(joint_constraints);
+  arm_navigation_msgs::RobotState robot_state;
+  arm_navigation_msgs::jointConstraintsToJointState(joint_constraints,robot_state.joint_state);
+  const sensor_msgs::JointState &joint_state = robot_state.joint_state;
   for(unsigned int i=0; i < joint_state.name.size(); i++)
   {
     ROS_DEBUG("Joint %s: %f",joint_state.name[i].c_str(), joint_state.position[i]);
   }
-  arm_navigation_msgs::RobotState robot_state;
-  robot_state.joint_state = joint_state;
 
   ompl_ros_interface::RobotStateToOmplStateMapping mapping;
   if(ompl_ros_interface::getJointStateToOmplStateMapping(joint_state,ompl_scoped_state,mapping))
@@ -1125,7 +1379,7 @@ bool constraintsToOmplState(const arm_navigation_msgs::Constraints &constraints,
                             const bool &fail_if_match_not_found)
 {
   arm_navigation_msgs::RobotState robot_state;
-  robot_state.joint_state = arm_navigation_msgs::jointConstraintsToJointState(constraints.joint_constraints);
+  arm_navigation_msgs::jointConstraintsToJointState(constraints.joint_constraints,robot_state.joint_state);
   ROS_DEBUG_STREAM("There are " << constraints.joint_constraints.size() << "  joint constraints");
   for(unsigned int i=0; i < robot_state.joint_state.name.size(); i++)
     ROS_DEBUG("Joint Constraint:: Joint %s: %f",robot_state.joint_state.name[i].c_str(), robot_state.joint_state.position[i]);
@@ -1186,29 +1440,27 @@ bool robotStateToJointStateGroup(const arm_navigation_msgs::RobotState &robot_st
                                  const ompl_ros_interface::RobotStateToKinematicStateMapping &mapping,
                                  planning_models::KinematicState::JointStateGroup *joint_state_group)
 {
-  std::vector<planning_models::KinematicState::JointState*> joint_states = joint_state_group->getJointStateVector();
+  const std::vector<planning_models::KinematicState::JointState*>& joint_states = joint_state_group->getJointStateVector();
   for(unsigned int i=0; i < robot_state.joint_state.name.size(); i++)
   {
-    std::vector<double> value;
-    value.push_back(robot_state.joint_state.position[i]);
-    joint_states[mapping.joint_state_mapping[i]]->setJointStateValues(value);
-  }    
+    joint_states[mapping.joint_state_mapping[i]]->setJointStateValue(0,robot_state.joint_state.position[i]);
+  }
 
   for(unsigned int i=0; i < robot_state.multi_dof_joint_state.joint_names.size(); i++)
   {
-    std::vector<double> values;
-    values.push_back(robot_state.multi_dof_joint_state.poses[i].position.x);
-    values.push_back(robot_state.multi_dof_joint_state.poses[i].position.y);
-    values.push_back(robot_state.multi_dof_joint_state.poses[i].position.z);
+    double values[7];
+    values[0] = robot_state.multi_dof_joint_state.poses[i].position.x;
+    values[1] = robot_state.multi_dof_joint_state.poses[i].position.y;
+    values[2] = robot_state.multi_dof_joint_state.poses[i].position.z;
 
-    values.push_back(robot_state.multi_dof_joint_state.poses[i].orientation.x);
-    values.push_back(robot_state.multi_dof_joint_state.poses[i].orientation.y);
-    values.push_back(robot_state.multi_dof_joint_state.poses[i].orientation.z);
-    values.push_back(robot_state.multi_dof_joint_state.poses[i].orientation.w);
+    values[3] = robot_state.multi_dof_joint_state.poses[i].orientation.x;
+    values[4] = robot_state.multi_dof_joint_state.poses[i].orientation.y;
+    values[5] = robot_state.multi_dof_joint_state.poses[i].orientation.z;
+    values[6] = robot_state.multi_dof_joint_state.poses[i].orientation.w;
 
     int index = mapping.multi_dof_mapping[i];
-    joint_states[index]->setJointStateValues(values);
+    joint_states[index]->setJointStateValues(values,7);
   }
   return true;
-}                                 
+}
 }
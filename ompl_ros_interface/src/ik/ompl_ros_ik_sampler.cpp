@@ -35,6 +35,9 @@
 /** \author Sachin Chitta, Ioan Sucan */
 
 #include <ompl_ros_interface/ik/ompl_ros_ik_sampler.h>
+#include <collision_space/thread_affinity.h>
+
+#include <boost/bind.hpp>
 
 namespace ompl_ros_interface
 {
@@ -93,6 +96,38 @@ bool OmplRosIKSampler::initialize(const ompl::base::StateSpacePtr &state_space,
     return false;
   }
   ROS_DEBUG("Initialized solver %s",kinematics_solver_name.c_str());
+
+  int ik_solver_threads = 1;
+  node_handle.param<int>(group_name_+"/ik_solver_threads",ik_solver_threads,1);
+  node_handle.param<int>(group_name_+"/ik_batch_size",ik_batch_size_,4);
+  if(ik_batch_size_ < 1)
+    ik_batch_size_ = 1;
+  solver_pool_.clear();
+  for(int i=1; i < ik_solver_threads; i++)
+  {
+    kinematics::KinematicsBase* solver = NULL;
+    try
+    {
+      solver = kinematics_loader_.createClassInstance(kinematics_solver_name);
+    }
+    catch(pluginlib::PluginlibException& ex)
+    {
+      ROS_WARN("Could not create extra instance of kinematics solver %s: %s",kinematics_solver_name.c_str(),ex.what());
+      break;
+    }
+    if(!solver->initialize(group_name,
+                           base_name,
+                           tip_name,
+                           .01))
+    {
+      ROS_WARN("Could not initialize extra instance of kinematics solver for group %s",group_name.c_str());
+      break;
+    }
+    solver_pool_.push_back(solver);
+  }
+  if(!solver_pool_.empty())
+    ROS_DEBUG("Sampling IK goals in batches across %d solver threads",(int)solver_pool_.size()+1);
+
   scoped_state_.reset(new ompl::base::ScopedState<ompl::base::CompoundStateSpace>(state_space_));
   seed_state_.joint_state.name = kinematics_solver_->getJointNames();
   seed_state_.joint_state.position.resize(kinematics_solver_->getJointNames().size());
@@ -127,6 +162,7 @@ bool OmplRosIKSampler::configureOnRequest(const arm_navigation_msgs::GetMotionPl
   max_sample_count_ = max_sample_count;
   num_samples_ = 0;
   ik_poses_.clear();
+  pending_solutions_.clear();
   arm_navigation_msgs::Constraints goal_constraints = request.motion_plan_request.goal_constraints;
 
   if(!collision_models_interface_->convertConstraintsGivenNewWorldTransform(*collision_models_interface_->getPlanningSceneState(),
@@ -163,6 +199,28 @@ bool OmplRosIKSampler::configureOnRequest(const arm_navigation_msgs::GetMotionPl
 
 bool OmplRosIKSampler::sampleGoal(const ompl::base::GoalLazySamples *gls, ompl::base::State *state)
 {
+  if(!solver_pool_.empty())
+  {
+    //batched sampling: drain the solutions found by the last
+    //dispatch and only go back to the solvers when they run out
+    boost::mutex::scoped_lock lock(solutions_lock_);
+    if(pending_solutions_.empty())
+    {
+      lock.unlock();
+      sampleBatch();
+      lock.lock();
+    }
+    if(pending_solutions_.empty())
+      return false;
+    arm_navigation_msgs::RobotState solution_state = pending_solutions_.front();
+    pending_solutions_.pop_front();
+    lock.unlock();
+    ompl_ros_interface::robotStateToOmplState(solution_state,
+                                              robot_state_to_ompl_state_mapping_,
+                                              state);
+    return true;
+  }
+
   arm_navigation_msgs::RobotState seed_state,solution_state;
   seed_state = seed_state_;
   solution_state = solution_state_; 
@@ -190,6 +248,55 @@ bool OmplRosIKSampler::sampleGoal(const ompl::base::GoalLazySamples *gls, ompl::
   return false;
 }
 
+void OmplRosIKSampler::sampleBatch()
+{
+  unsigned int num_threads = solver_pool_.size() + 1;
+  boost::thread_group threads;
+  for(unsigned int i=0; i < solver_pool_.size(); i++)
+    threads.create_thread(boost::bind(&OmplRosIKSampler::sampleBatchThread,
+                                      this,
+                                      solver_pool_[i],
+                                      ik_poses_counter_ + (i+1)*ik_batch_size_,
+                                      ik_batch_size_,
+                                      i+1));
+  //this thread works through its own share on the primary solver
+  sampleBatchThread(kinematics_solver_,ik_poses_counter_,ik_batch_size_,0);
+  threads.join_all();
+  ik_poses_counter_ = (ik_poses_counter_ + num_threads*ik_batch_size_)%ik_poses_.size();
+}
+
+void OmplRosIKSampler::sampleBatchThread(kinematics::KinematicsBase *solver,
+                                         unsigned int pose_offset,
+                                         unsigned int attempts,
+                                         unsigned int worker_index)
+{
+  //index 0 is the caller's share and stays unpinned, since affinity
+  //would outlive the call
+  if(worker_index > 0)
+    collision_space::thread_affinity::bindCurrentThreadForWorker(worker_index);
+  arm_navigation_msgs::RobotState seed_state,solution_state;
+  seed_state = seed_state_;
+  solution_state = solution_state_;
+  ompl::base::ScopedState<ompl::base::CompoundStateSpace> scoped_state(state_space_);
+  for(unsigned int i=0; i < attempts; i++)
+  {
+    //sample a seed state at random
+    scoped_state.random();
+    ompl_ros_interface::omplStateToRobotState(scoped_state,
+                                              ompl_state_to_robot_state_mapping_,
+                                              seed_state);
+    int error_code;
+    if(solver->getPositionIK(ik_poses_[(pose_offset+i)%ik_poses_.size()].pose,
+                             seed_state.joint_state.position,
+                             solution_state.joint_state.position,
+                             error_code))
+    {
+      boost::mutex::scoped_lock lock(solutions_lock_);
+      pending_solutions_.push_back(solution_state);
+    }
+  }
+}
+
 bool OmplRosIKSampler::sampleGoals(const ompl::base::GoalLazySamples *gls, ompl::base::State *state)
 {
   bool continue_sampling = sampleGoal(gls,state);
@@ -44,6 +44,11 @@ namespace ompl_ros_interface
   collision_models_interface_ = new planning_environment::CollisionModelsInterface("robot_description");
 }
 
+OmplRos::OmplRos(const std::string &ns): node_handle_(ns)
+{
+  collision_models_interface_ = new planning_environment::CollisionModelsInterface("robot_description");
+}
+
 /** Free the memory */
 OmplRos::~OmplRos(void)
 {
@@ -57,6 +62,7 @@ void OmplRos::run(void)
   if (collision_models_interface_->loadedModels())
   {
     plan_path_service_ = node_handle_.advertiseService("plan_kinematic_path", &OmplRos::computePlan, this);
+    reload_planner_configs_service_ = node_handle_.advertiseService("reload_planner_configs", &OmplRos::reloadPlannerConfigs, this);
     node_handle_.param<bool>("publish_diagnostics", publish_diagnostics_,false);
     if(publish_diagnostics_)
       diagnostic_publisher_ = node_handle_.advertise<ompl_ros_interface::OmplPlannerDiagnostics>("diagnostics", 1);
@@ -215,9 +221,29 @@ bool OmplRos::initializePlanningInstance(const std::string &param_server_prefix,
   return true;
 };
 
-bool OmplRos::computePlan(arm_navigation_msgs::GetMotionPlan::Request &request, 
+bool OmplRos::reloadPlannerConfigs(std_srvs::Empty::Request &req,
+                                   std_srvs::Empty::Response &res)
+{
+  boost::mutex::scoped_lock lock(planner_map_lock_);
+  std::map<std::string,boost::shared_ptr<ompl_ros_interface::OmplRosPlanningGroup> > old_planner_map;
+  old_planner_map.swap(planner_map_);
+  if(!initialize(node_handle_.getNamespace()))
+  {
+    //keep serving with the previous planners rather than none at all
+    ROS_ERROR("Reloading planner configurations failed, keeping the previous ones");
+    old_planner_map.swap(planner_map_);
+    return false;
+  }
+  ROS_INFO("Reloaded %u planner configurations", (unsigned int) planner_map_.size());
+  return true;
+}
+
+bool OmplRos::computePlan(arm_navigation_msgs::GetMotionPlan::Request &request,
                           arm_navigation_msgs::GetMotionPlan::Response &response)
 {
+  //holds off a concurrent planner reload; parameters themselves are
+  //never read here
+  boost::mutex::scoped_lock lock(planner_map_lock_);
   std::string location;
   std::string planner_id;
   if(request.motion_plan_request.planner_id == "")
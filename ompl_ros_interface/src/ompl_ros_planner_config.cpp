@@ -43,31 +43,57 @@ const std::string& ompl_ros_interface::PlannerConfig::getName(void)
     return config_;
 }
 
+void ompl_ros_interface::PlannerConfig::loadFromParamServer(void)
+{
+    params_.clear();
+    XmlRpc::XmlRpcValue values;
+    if(!nh_.getParam(description_ + "/planner_configs/" + config_, values))
+    {
+        ROS_WARN_STREAM("No parameters found for planner configuration " << config_);
+        return;
+    }
+    if(values.getType() != XmlRpc::XmlRpcValue::TypeStruct)
+    {
+        ROS_WARN_STREAM("Planner configuration " << config_ << " is not a struct");
+        return;
+    }
+    for(XmlRpc::XmlRpcValue::iterator it = values.begin(); it != values.end(); ++it)
+        params_[it->first] = it->second;
+}
+
 bool ompl_ros_interface::PlannerConfig::hasParam(const std::string &param)
 {
-    return nh_.hasParam(description_ + "/planner_configs/" + config_ + "/" + param);
+    return params_.find(param) != params_.end();
 }
 
 std::string ompl_ros_interface::PlannerConfig::getParamString(const std::string &param, const std::string& def)
 {
-    std::string value;
-    nh_.param(description_ + "/planner_configs/" + config_ + "/" + param, value, def);
+    std::map<std::string, XmlRpc::XmlRpcValue>::iterator it = params_.find(param);
+    if(it == params_.end() || it->second.getType() != XmlRpc::XmlRpcValue::TypeString)
+        return def;
+    std::string value = static_cast<std::string>(it->second);
     boost::trim(value);
     return value;
 }
 
 double ompl_ros_interface::PlannerConfig::getParamDouble(const std::string &param, double def)
 {
-    double value;
-    nh_.param(description_ + "/planner_configs/" + config_ + "/" + param, value, def);
-    return value;
+    std::map<std::string, XmlRpc::XmlRpcValue>::iterator it = params_.find(param);
+    if(it == params_.end())
+        return def;
+    if(it->second.getType() == XmlRpc::XmlRpcValue::TypeDouble)
+        return static_cast<double>(it->second);
+    if(it->second.getType() == XmlRpc::XmlRpcValue::TypeInt)
+        return static_cast<int>(it->second);
+    return def;
 }
 
 int ompl_ros_interface::PlannerConfig::getParamInt(const std::string &param, int def)
 {
-    int value;
-    nh_.param(description_ + "/planner_configs/" + config_ + "/" + param, value, def);
-    return value;
+    std::map<std::string, XmlRpc::XmlRpcValue>::iterator it = params_.find(param);
+    if(it == params_.end() || it->second.getType() != XmlRpc::XmlRpcValue::TypeInt)
+        return def;
+    return static_cast<int>(it->second);
 }
 
 void ompl_ros_interface::PlannerConfigMap::loadPlannerConfigs() {
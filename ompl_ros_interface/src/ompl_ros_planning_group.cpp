@@ -35,7 +35,12 @@
 /** \author Sachin Chitta, Ioan Sucan */
 
 #include <ompl_ros_interface/ompl_ros_planning_group.h>
+#include <arm_navigation_msgs/trace.h>
 #include <planning_environment/models/model_utils.h>
+#include <collision_space/thread_affinity.h>
+#include <boost/bind.hpp>
+#include <ompl/base/PlannerData.h>
+#include <ompl/base/goals/GoalStates.h>
 
 namespace ompl_ros_interface
 {
@@ -55,9 +60,39 @@ bool OmplRosPlanningGroup::initialize(const ros::NodeHandle &node_handle,
   if(!initializePlanningStateSpace(state_space_))
     return false;
 
-  double longest_valid_segment_fraction;
-  node_handle_.param(group_name_+"/longest_valid_segment_fraction",longest_valid_segment_fraction,0.005);
-  state_space_->setLongestValidSegmentFraction(longest_valid_segment_fraction);
+  node_handle_.param(group_name_+"/longest_valid_segment_fraction",longest_valid_segment_fraction_,0.005);
+  state_space_->setLongestValidSegmentFraction(longest_valid_segment_fraction_);
+
+  node_handle_.param(group_name_+"/adaptive_segment_resolution",adaptive_segment_resolution_,false);
+  node_handle_.param(group_name_+"/segment_resolution_dense_cells",segment_resolution_dense_cells_,2000);
+  node_handle_.param(group_name_+"/segment_resolution_max_relaxation",segment_resolution_max_relaxation_,3.0);
+  if(segment_resolution_dense_cells_ < 1)
+    segment_resolution_dense_cells_ = 1;
+  if(segment_resolution_max_relaxation_ < 1.0)
+    segment_resolution_max_relaxation_ = 1.0;
+
+  node_handle_.param(group_name_+"/parallel_planners",parallel_planners_,1);
+  if(parallel_planners_ < 1)
+    parallel_planners_ = 1;
+  parallel_solve_found_ = false;
+
+  node_handle_.param(group_name_+"/multi_query",multi_query_,false);
+  roadmap_scene_version_ = 0;
+
+  node_handle_.param(group_name_+"/max_trajectory_points",max_trajectory_points_,0);
+  if(max_trajectory_points_ < 0)
+    max_trajectory_points_ = 0;
+
+  node_handle_.param(group_name_+"/simplification_time",simplification_time_,0.0);
+
+  //all groups publish on the same topic; the group_name field in the
+  //message identifies the source
+  statistics_publisher_ = node_handle_.advertise<arm_navigation_msgs::MotionPlanStatistics>("planner_statistics",10);
+
+  //trace spans go on the globally resolved topic so the whole
+  //pipeline's spans end up in one stream
+  ros::NodeHandle root_handle;
+  trace_publisher_ = arm_navigation_msgs::advertiseTraceTopic(root_handle);
 
   //Setup the projection evaluator for this group
   if(!initializeProjectionEvaluator())
@@ -68,7 +103,7 @@ bool OmplRosPlanningGroup::initialize(const ros::NodeHandle &node_handle,
 
   planner_.reset(new ompl::geometric::SimpleSetup(state_space_));
   
-  if(!initializePlanner())
+  if(!initializePlanner(ompl_planner_))
     return false;
 
   if(!initializeStateValidityChecker(state_validity_checker_))
@@ -77,6 +112,21 @@ bool OmplRosPlanningGroup::initialize(const ros::NodeHandle &node_handle,
   planner_->setStateValidityChecker(static_cast<ompl::base::StateValidityCheckerPtr> (state_validity_checker_));
   planner_->setPlanner(ompl_planner_);
 
+  //warm the planning context now: running setup() here pays the
+  //space information and planner configuration cost once at startup,
+  //so a request only swaps in its start and goal
+  planner_->setup();
+  for(int i=1; i < parallel_planners_; i++)
+  {
+    ompl::base::PlannerPtr extra;
+    if(!initializePlanner(extra))
+    {
+      ROS_WARN("Could not warm extra planner instance %d for group %s",i,group_name_.c_str());
+      break;
+    }
+    extra_planners_.push_back(extra);
+  }
+
   return true;
 };
 
@@ -125,32 +175,34 @@ bool OmplRosPlanningGroup::initializeProjectionEvaluator()
   return true;
 }
 
-bool OmplRosPlanningGroup::initializePlanner()
+bool OmplRosPlanningGroup::initializePlanner(ompl::base::PlannerPtr &planner)
 {
   planner_config_.reset(new ompl_ros_interface::PlannerConfig(node_handle_.getNamespace(),planner_config_name_));
   std::string planner_type = planner_config_->getParamString("type");
   if(planner_type == "kinematic::RRT")
-    return initializeRRTPlanner();
+    return initializeRRTPlanner(planner);
   else if(planner_type == "kinematic::RRTConnect")
-    return initializeRRTConnectPlanner();
+    return initializeRRTConnectPlanner(planner);
   else if(planner_type == "kinematic::pRRT")
-    return initializepRRTPlanner();
+    return initializepRRTPlanner(planner);
   else if(planner_type == "kinematic::LazyRRT")
-    return initializeLazyRRTPlanner();
+    return initializeLazyRRTPlanner(planner);
   else if(planner_type == "kinematic::EST")
-    return initializeESTPlanner();
+    return initializeESTPlanner(planner);
   else if(planner_type == "kinematic::SBL")
-    return initializeSBLPlanner();
+    return initializeSBLPlanner(planner);
   else if(planner_type == "kinematic::pSBL")
-    return initializepSBLPlanner();
+    return initializepSBLPlanner(planner);
   else if(planner_type == "kinematic::KPIECE")
-    return initializeKPIECEPlanner();
+    return initializeKPIECEPlanner(planner);
   else if(planner_type == "kinematic::LBKPIECE")
-    return initializeLBKPIECEPlanner();
+    return initializeLBKPIECEPlanner(planner);
   else if(planner_type == "kinematic::RRTStar")
-    return initializeRRTStarPlanner();
+    return initializeRRTStarPlanner(planner);
   else if(planner_type == "kinematic::BKPIECE")
-    return initializeBKPIECEPlanner();
+    return initializeBKPIECEPlanner(planner);
+  else if(planner_type == "kinematic::PRM")
+    return initializePRMPlanner(planner);
 	else
   {
     ROS_WARN("Unknown planner type: %s", planner_type.c_str());
@@ -158,10 +210,10 @@ bool OmplRosPlanningGroup::initializePlanner()
   }
 }
 
-bool OmplRosPlanningGroup::initializeRRTPlanner()
+bool OmplRosPlanningGroup::initializeRRTPlanner(ompl::base::PlannerPtr &planner)
 {
-  ompl_planner_.reset(new ompl::geometric::RRT(planner_->getSpaceInformation()));
-  ompl::geometric::RRT* new_planner = dynamic_cast<ompl::geometric::RRT*>(ompl_planner_.get());
+  planner.reset(new ompl::geometric::RRT(planner_->getSpaceInformation()));
+  ompl::geometric::RRT* new_planner = dynamic_cast<ompl::geometric::RRT*>(planner.get());
   if (planner_config_->hasParam("goal_bias"))
   {
     new_planner->setGoalBias(planner_config_->getParamDouble("goal_bias",new_planner->getGoalBias()));
@@ -175,10 +227,10 @@ bool OmplRosPlanningGroup::initializeRRTPlanner()
   return true;
 }
 
-bool OmplRosPlanningGroup::initializeRRTStarPlanner()
+bool OmplRosPlanningGroup::initializeRRTStarPlanner(ompl::base::PlannerPtr &planner)
 {
-  ompl_planner_.reset(new ompl::geometric::RRTstar(planner_->getSpaceInformation()));
-  ompl::geometric::RRTstar* new_planner = dynamic_cast<ompl::geometric::RRTstar*>(ompl_planner_.get());
+  planner.reset(new ompl::geometric::RRTstar(planner_->getSpaceInformation()));
+  ompl::geometric::RRTstar* new_planner = dynamic_cast<ompl::geometric::RRTstar*>(planner.get());
   if (planner_config_->hasParam("goal_bias"))
   {
     new_planner->setGoalBias(planner_config_->getParamDouble("goal_bias",new_planner->getGoalBias()));
@@ -192,10 +244,10 @@ bool OmplRosPlanningGroup::initializeRRTStarPlanner()
   return true;
 }
 
-bool OmplRosPlanningGroup::initializeRRTConnectPlanner()
+bool OmplRosPlanningGroup::initializeRRTConnectPlanner(ompl::base::PlannerPtr &planner)
 {
-  ompl_planner_.reset(new ompl::geometric::RRTConnect(planner_->getSpaceInformation()));
-  ompl::geometric::RRTConnect* new_planner = dynamic_cast<ompl::geometric::RRTConnect*>(ompl_planner_.get());
+  planner.reset(new ompl::geometric::RRTConnect(planner_->getSpaceInformation()));
+  ompl::geometric::RRTConnect* new_planner = dynamic_cast<ompl::geometric::RRTConnect*>(planner.get());
   if (planner_config_->hasParam("range"))
   {
     new_planner->setRange(planner_config_->getParamDouble("range",new_planner->getRange()));
@@ -204,10 +256,10 @@ bool OmplRosPlanningGroup::initializeRRTConnectPlanner()
   return true;
 }
 
-bool OmplRosPlanningGroup::initializepRRTPlanner()
+bool OmplRosPlanningGroup::initializepRRTPlanner(ompl::base::PlannerPtr &planner)
 {
-  ompl_planner_.reset(new ompl::geometric::pRRT(planner_->getSpaceInformation()));
-  ompl::geometric::pRRT* new_planner = dynamic_cast<ompl::geometric::pRRT*>(ompl_planner_.get());
+  planner.reset(new ompl::geometric::pRRT(planner_->getSpaceInformation()));
+  ompl::geometric::pRRT* new_planner = dynamic_cast<ompl::geometric::pRRT*>(planner.get());
   if (planner_config_->hasParam("range"))
   {
     new_planner->setRange(planner_config_->getParamDouble("range",new_planner->getRange()));
@@ -226,10 +278,10 @@ bool OmplRosPlanningGroup::initializepRRTPlanner()
   return true;
 }
 
-bool OmplRosPlanningGroup::initializeLazyRRTPlanner()
+bool OmplRosPlanningGroup::initializeLazyRRTPlanner(ompl::base::PlannerPtr &planner)
 {
-  ompl_planner_.reset(new ompl::geometric::LazyRRT(planner_->getSpaceInformation()));
-  ompl::geometric::LazyRRT* new_planner = dynamic_cast<ompl::geometric::LazyRRT*>(ompl_planner_.get());
+  planner.reset(new ompl::geometric::LazyRRT(planner_->getSpaceInformation()));
+  ompl::geometric::LazyRRT* new_planner = dynamic_cast<ompl::geometric::LazyRRT*>(planner.get());
   if (planner_config_->hasParam("range"))
   {
     new_planner->setRange(planner_config_->getParamDouble("range",new_planner->getRange()));
@@ -243,10 +295,10 @@ bool OmplRosPlanningGroup::initializeLazyRRTPlanner()
   return true;
 }
 
-bool OmplRosPlanningGroup::initializeESTPlanner()
+bool OmplRosPlanningGroup::initializeESTPlanner(ompl::base::PlannerPtr &planner)
 {
-  ompl_planner_.reset(new ompl::geometric::EST(planner_->getSpaceInformation()));
-  ompl::geometric::EST* new_planner = dynamic_cast<ompl::geometric::EST*>(ompl_planner_.get());
+  planner.reset(new ompl::geometric::EST(planner_->getSpaceInformation()));
+  ompl::geometric::EST* new_planner = dynamic_cast<ompl::geometric::EST*>(planner.get());
   if (planner_config_->hasParam("range"))
   {
     new_planner->setRange(planner_config_->getParamDouble("range",new_planner->getRange()));
@@ -260,10 +312,10 @@ bool OmplRosPlanningGroup::initializeESTPlanner()
   return true;
 }
 
-bool OmplRosPlanningGroup::initializeSBLPlanner()
+bool OmplRosPlanningGroup::initializeSBLPlanner(ompl::base::PlannerPtr &planner)
 {
-  ompl_planner_.reset(new ompl::geometric::SBL(planner_->getSpaceInformation()));
-  ompl::geometric::SBL* new_planner = dynamic_cast<ompl::geometric::SBL*>(ompl_planner_.get());
+  planner.reset(new ompl::geometric::SBL(planner_->getSpaceInformation()));
+  ompl::geometric::SBL* new_planner = dynamic_cast<ompl::geometric::SBL*>(planner.get());
   if (planner_config_->hasParam("range"))
   {
     new_planner->setRange(planner_config_->getParamDouble("range",new_planner->getRange()));
@@ -272,10 +324,10 @@ bool OmplRosPlanningGroup::initializeSBLPlanner()
   return true;
 }
 
-bool OmplRosPlanningGroup::initializepSBLPlanner()
+bool OmplRosPlanningGroup::initializepSBLPlanner(ompl::base::PlannerPtr &planner)
 {
-  ompl_planner_.reset(new ompl::geometric::pSBL(planner_->getSpaceInformation()));
-  ompl::geometric::pSBL* new_planner = dynamic_cast<ompl::geometric::pSBL*>(ompl_planner_.get());
+  planner.reset(new ompl::geometric::pSBL(planner_->getSpaceInformation()));
+  ompl::geometric::pSBL* new_planner = dynamic_cast<ompl::geometric::pSBL*>(planner.get());
   if (planner_config_->hasParam("range"))
   {
     new_planner->setRange(planner_config_->getParamDouble("range",new_planner->getRange()));
@@ -289,10 +341,10 @@ bool OmplRosPlanningGroup::initializepSBLPlanner()
   return true;
 }
 
-bool OmplRosPlanningGroup::initializeKPIECEPlanner()
+bool OmplRosPlanningGroup::initializeKPIECEPlanner(ompl::base::PlannerPtr &planner)
 {
-  ompl_planner_.reset(new ompl::geometric::KPIECE1(planner_->getSpaceInformation()));
-  ompl::geometric::KPIECE1* new_planner = dynamic_cast<ompl::geometric::KPIECE1*>(ompl_planner_.get());
+  planner.reset(new ompl::geometric::KPIECE1(planner_->getSpaceInformation()));
+  ompl::geometric::KPIECE1* new_planner = dynamic_cast<ompl::geometric::KPIECE1*>(planner.get());
   if (planner_config_->hasParam("range"))
   {
     new_planner->setRange(planner_config_->getParamDouble("range",new_planner->getRange()));
@@ -317,10 +369,10 @@ bool OmplRosPlanningGroup::initializeKPIECEPlanner()
   return true;
 }
 
-bool OmplRosPlanningGroup::initializeBKPIECEPlanner()
+bool OmplRosPlanningGroup::initializeBKPIECEPlanner(ompl::base::PlannerPtr &planner)
 {
-  ompl_planner_.reset(new ompl::geometric::BKPIECE1(planner_->getSpaceInformation()));
-  ompl::geometric::BKPIECE1* new_planner = dynamic_cast<ompl::geometric::BKPIECE1*>(ompl_planner_.get());
+  planner.reset(new ompl::geometric::BKPIECE1(planner_->getSpaceInformation()));
+  ompl::geometric::BKPIECE1* new_planner = dynamic_cast<ompl::geometric::BKPIECE1*>(planner.get());
   if (planner_config_->hasParam("range"))
   {
     new_planner->setRange(planner_config_->getParamDouble("range",new_planner->getRange()));
@@ -341,14 +393,26 @@ bool OmplRosPlanningGroup::initializeBKPIECEPlanner()
   {
     new_planner->setMinValidPathFraction(planner_config_->getParamDouble("min_valid_path_fraction",new_planner->getMinValidPathFraction()));
     ROS_DEBUG("BKPIECEPlanner::Min valid path fraction is set to %g", new_planner->getMinValidPathFraction());
-  }  
+  }
+  return true;
+}
+
+bool OmplRosPlanningGroup::initializePRMPlanner(ompl::base::PlannerPtr &planner)
+{
+  planner.reset(new ompl::geometric::PRM(planner_->getSpaceInformation()));
+  ompl::geometric::PRM* new_planner = dynamic_cast<ompl::geometric::PRM*>(planner.get());
+  if (planner_config_->hasParam("max_nearest_neighbors"))
+  {
+    new_planner->setMaxNearestNeighbors((unsigned int)planner_config_->getParamDouble("max_nearest_neighbors",10));
+    ROS_DEBUG("PRMPlanner::Max nearest neighbors is set to %d", (int)planner_config_->getParamDouble("max_nearest_neighbors",10));
+  }
   return true;
 }
 
-bool OmplRosPlanningGroup::initializeLBKPIECEPlanner()
+bool OmplRosPlanningGroup::initializeLBKPIECEPlanner(ompl::base::PlannerPtr &planner)
 {
-  ompl_planner_.reset(new ompl::geometric::LBKPIECE1(planner_->getSpaceInformation()));
-  ompl::geometric::LBKPIECE1* new_planner = dynamic_cast<ompl::geometric::LBKPIECE1*>(ompl_planner_.get());
+  planner.reset(new ompl::geometric::LBKPIECE1(planner_->getSpaceInformation()));
+  ompl::geometric::LBKPIECE1* new_planner = dynamic_cast<ompl::geometric::LBKPIECE1*>(planner.get());
   if (planner_config_->hasParam("range"))
   {
     new_planner->setRange(planner_config_->getParamDouble("range",new_planner->getRange()));
@@ -396,55 +460,112 @@ bool OmplRosPlanningGroup::omplPathGeometricToRobotTrajectory(const ompl::geomet
   return true;
 }
 
-bool OmplRosPlanningGroup::computePlan(arm_navigation_msgs::GetMotionPlan::Request &request, 
+bool OmplRosPlanningGroup::computePlan(arm_navigation_msgs::GetMotionPlan::Request &request,
                                        arm_navigation_msgs::GetMotionPlan::Response &response)
 {
-  planner_->clear();
-  planning_models::KinematicState* kinematic_state = collision_models_interface_->getPlanningSceneState();
-  if(kinematic_state == NULL) {
-    ROS_ERROR_STREAM("Planning scene hasn't been set");
-    return finish(false);
-  }
-
-  //updating for new start state
-  planning_environment::setRobotStateAndComputeTransforms(request.motion_plan_request.start_state,
-                                                          *kinematic_state);
+  planner_statistics_ = arm_navigation_msgs::MotionPlanStatistics();
+  planner_statistics_.group_name = group_name_;
+  planner_statistics_.planner_config = planner_config_name_;
 
-  physical_joint_state_group_ = kinematic_state->getJointStateGroup(physical_joint_group_->getName());
-  if(!physical_joint_state_group_)
+  unsigned int trace_id = request.motion_plan_request.trace_id;
   {
-    ROS_ERROR("Could not find physical joint state group");
-    response.error_code.val = arm_navigation_msgs::ArmNavigationErrorCodes::PLANNING_FAILED;
-    return finish(false);
-  }
+    arm_navigation_msgs::ScopedTraceSpan setup_span(trace_publisher_,trace_id,"planner_setup");
 
-  //disabling collisions that don't affect this group
-  collision_models_interface_->disableCollisionsForNonUpdatedLinks(physical_joint_group_->getName());
+    ompl::geometric::PRM *roadmap_planner = NULL;
+    if(multi_query_)
+      roadmap_planner = dynamic_cast<ompl::geometric::PRM*>(ompl_planner_.get());
+    bool reuse_roadmap = false;
+    if(roadmap_planner)
+    {
+      //the roadmap can only be reused when the scene its edges were
+      //validated against is unchanged and the request adds no path
+      //constraints of its own
+      unsigned long scene_version = collision_models_interface_->getCollisionSceneVersion();
+      const arm_navigation_msgs::Constraints &path_constraints = request.motion_plan_request.path_constraints;
+      bool unconstrained = path_constraints.joint_constraints.empty() &&
+        path_constraints.position_constraints.empty() &&
+        path_constraints.orientation_constraints.empty() &&
+        path_constraints.visibility_constraints.empty();
+      if(unconstrained && scene_version == roadmap_scene_version_)
+        reuse_roadmap = true;
+      else
+        roadmap_scene_version_ = scene_version;
+    }
+    if(reuse_roadmap)
+    {
+      //keep the milestones and edges; drop only the previous query's
+      //start/goal connections and solution
+      roadmap_planner->clearQuery();
+      planner_->getProblemDefinition()->clearSolutionPaths();
+    }
+    else
+      planner_->clear();
+    planning_models::KinematicState* kinematic_state = collision_models_interface_->getPlanningSceneState();
+    if(kinematic_state == NULL) {
+      ROS_ERROR_STREAM("Planning scene hasn't been set");
+      return finish(false);
+    }
 
-  if (!isRequestValid(request,response))
-    return finish(false);
+    //updating for new start state
+    planning_environment::setRobotStateAndComputeTransforms(request.motion_plan_request.start_state,
+                                                            *kinematic_state);
 
-  if(!configureStateValidityChecker(request,response,kinematic_state))
-    return finish(false);
-  
-  if(!transformConstraints(request,response))
-    return finish(false);
-  
-  if(!setStartAndGoalStates(request,response))
-    return finish(false);
+    physical_joint_state_group_ = kinematic_state->getJointStateGroup(physical_joint_group_->getName());
+    if(!physical_joint_state_group_)
+    {
+      ROS_ERROR("Could not find physical joint state group");
+      response.error_code.val = arm_navigation_msgs::ArmNavigationErrorCodes::PLANNING_FAILED;
+      return finish(false);
+    }
+
+    //disabling collisions that don't affect this group
+    collision_models_interface_->disableCollisionsForNonUpdatedLinks(physical_joint_group_->getName());
+
+    if (!isRequestValid(request,response))
+      return finish(false);
+
+    if(!configureStateValidityChecker(request,response,kinematic_state))
+      return finish(false);
   
-  bool solved = planner_->solve(request.motion_plan_request.allowed_planning_time.toSec());
+    if(!transformConstraints(request,response))
+      return finish(false);
   
+    if(!setStartAndGoalStates(request,response))
+      return finish(false);
+
+    updateSegmentResolution();
+  }
+
+  bool solved;
+  bool warm_started;
+  {
+    arm_navigation_msgs::ScopedTraceSpan solve_span(trace_publisher_,trace_id,"planner_solve");
+    warm_started = warmStart(request,response);
+    if(warm_started)
+    {
+      ROS_DEBUG("Seed trajectory accepted as solution, skipping planning");
+      solved = true;
+    }
+    else if(parallel_planners_ > 1)
+      solved = solveParallel(request.motion_plan_request.allowed_planning_time.toSec());
+    else
+      solved = planner_->solve(request.motion_plan_request.allowed_planning_time.toSec());
+  }
+
   if(solved)
   {
-    ROS_DEBUG("Found solution for request in %f seconds",planner_->getLastPlanComputationTime());
-    response.planning_time = ros::Duration(planner_->getLastPlanComputationTime());
-    planner_->getPathSimplifier()->reduceVertices(planner_->getSolutionPath());
-    planner_->getPathSimplifier()->collapseCloseVertices(planner_->getSolutionPath());
-    
+    double planning_time = warm_started ? 0.0 : planner_->getLastPlanComputationTime();
+    ROS_DEBUG("Found solution for request in %f seconds",planning_time);
+    response.planning_time = ros::Duration(planning_time);
+    planner_statistics_.planning_time = planning_time;
+    arm_navigation_msgs::ScopedTraceSpan postprocess_span(trace_publisher_,trace_id,"planner_postprocess");
+    simplifySolutionPath(simplification_time_);
+
     try
     {
       response.trajectory = getSolutionPath();
+      planner_statistics_.trajectory_points = std::max(response.trajectory.joint_trajectory.points.size(),
+                                                       response.trajectory.multi_dof_joint_trajectory.points.size());
       response.error_code.val = arm_navigation_msgs::ArmNavigationErrorCodes::SUCCESS;
       return finish(true);
     }
@@ -464,8 +585,172 @@ bool OmplRosPlanningGroup::computePlan(arm_navigation_msgs::GetMotionPlan::Reque
 }
 
 
+void OmplRosPlanningGroup::updateSegmentResolution()
+{
+  if(!adaptive_segment_resolution_)
+    return;
+  //the configured fraction is tuned for the worst (cluttered) case;
+  //relax it as the collision map empties so open scenes don't pay
+  //cluttered-scene validation density. Minimum clearance would be the
+  //exact signal but the collision checker offers no cheap distance
+  //query, so the cell count stands in for scene density.
+  unsigned int cells = collision_models_interface_->getCollisionMapShapes().size();
+  double fraction = longest_valid_segment_fraction_;
+  if(cells < (unsigned int)segment_resolution_dense_cells_)
+  {
+    double sparseness = 1.0 - (double)cells/(double)segment_resolution_dense_cells_;
+    fraction *= 1.0 + sparseness*(segment_resolution_max_relaxation_ - 1.0);
+  }
+  if(fraction != state_space_->getLongestValidSegmentFraction())
+  {
+    state_space_->setLongestValidSegmentFraction(fraction);
+    //recompute the cached segment length the motion validator uses
+    state_space_->setup();
+    ROS_DEBUG("Using longest valid segment fraction %f for %u collision map cells",fraction,cells);
+  }
+}
+
+void OmplRosPlanningGroup::simplifySolutionPath(double budget)
+{
+  ompl::geometric::PathGeometric &path = planner_->getSolutionPath();
+  ros::WallTime start_time = ros::WallTime::now();
+  planner_statistics_.solution_length_before_simplification = path.length();
+  if(budget <= 0.0)
+  {
+    planner_->getPathSimplifier()->reduceVertices(path);
+    planner_->getPathSimplifier()->collapseCloseVertices(path);
+  }
+  else
+  {
+    //run the passes in small slices and keep whatever has been achieved
+    //when the budget runs out; on hard queries full simplification can
+    //exceed the planning time itself
+    ros::WallTime deadline = start_time + ros::WallDuration(budget);
+    double last_length = path.length();
+    while(ros::WallTime::now() < deadline)
+    {
+      planner_->getPathSimplifier()->reduceVertices(path,10,5);
+      if(ros::WallTime::now() >= deadline)
+        break;
+      planner_->getPathSimplifier()->collapseCloseVertices(path,10,5);
+      double length = path.length();
+      if(length >= last_length - 1e-6)
+        break;
+      last_length = length;
+    }
+  }
+  planner_statistics_.solution_length_after_simplification = path.length();
+  planner_statistics_.simplification_time = (ros::WallTime::now() - start_time).toSec();
+}
+
+bool OmplRosPlanningGroup::solveParallel(double timeout)
+{
+  //allocate the extra instances once and reuse them across requests
+  while((int)extra_planners_.size() < parallel_planners_ - 1)
+  {
+    ompl::base::PlannerPtr extra;
+    if(!initializePlanner(extra))
+    {
+      ROS_WARN("Could not allocate extra planner instance, falling back to single-threaded planning");
+      return planner_->solve(timeout);
+    }
+    extra_planners_.push_back(extra);
+  }
+
+  planner_->setup();
+
+  //every instance races on its own problem definition over the shared
+  //space information; the validity checker hands each thread its own
+  //clone of the kinematic state and collision checks already run on
+  //per-thread clones of the environment
+  ompl::base::ProblemDefinitionPtr master_pdef = planner_->getProblemDefinition();
+  std::vector<ompl::base::ProblemDefinitionPtr> pdefs;
+  for(unsigned int i=0; i < extra_planners_.size(); i++)
+  {
+    ompl::base::ProblemDefinitionPtr pdef(new ompl::base::ProblemDefinition(planner_->getSpaceInformation()));
+    for(unsigned int j=0; j < master_pdef->getStartStateCount(); j++)
+      pdef->addStartState(master_pdef->getStartState(j));
+    pdef->setGoal(master_pdef->getGoal());
+    extra_planners_[i]->clear();
+    extra_planners_[i]->setProblemDefinition(pdef);
+    pdefs.push_back(pdef);
+  }
+
+  parallel_solve_found_ = false;
+  ros::WallTime deadline = ros::WallTime::now() + ros::WallDuration(timeout);
+
+  boost::thread_group threads;
+  for(unsigned int i=0; i < extra_planners_.size(); i++)
+    threads.create_thread(boost::bind(&OmplRosPlanningGroup::parallelSolveThread, this, extra_planners_[i].get(), deadline, i+1));
+
+  //the configured planner runs on this thread; the first solution
+  //flips the shared flag and everyone else's termination fires
+  ompl::base::PlannerTerminationCondition ptc(boost::bind(&OmplRosPlanningGroup::terminateParallelSolve, this, deadline));
+  bool solved = planner_->solve(ptc);
+  if(solved)
+  {
+    boost::mutex::scoped_lock lock(parallel_solve_lock_);
+    parallel_solve_found_ = true;
+  }
+  threads.join_all();
+
+  if(!solved)
+  {
+    //adopt the winning instance's solution so the usual
+    //simplification and conversion run unchanged
+    for(unsigned int i=0; i < pdefs.size(); i++)
+      if(pdefs[i]->hasSolution())
+      {
+        master_pdef->addSolutionPath(pdefs[i]->getSolutionPath());
+        solved = true;
+        break;
+      }
+  }
+  return solved;
+}
+
+void OmplRosPlanningGroup::parallelSolveThread(ompl::base::Planner *planner,
+                                               ros::WallTime deadline,
+                                               unsigned int worker_index)
+{
+  //spread extra planner instances across memory nodes; the configured
+  //planner stays on the (unpinned) calling thread
+  collision_space::thread_affinity::bindCurrentThreadForWorker(worker_index);
+  ompl::base::PlannerTerminationCondition ptc(boost::bind(&OmplRosPlanningGroup::terminateParallelSolve, this, deadline));
+  if(planner->solve(ptc))
+  {
+    boost::mutex::scoped_lock lock(parallel_solve_lock_);
+    parallel_solve_found_ = true;
+  }
+}
+
+bool OmplRosPlanningGroup::terminateParallelSolve(const ros::WallTime &deadline)
+{
+  boost::mutex::scoped_lock lock(parallel_solve_lock_);
+  return parallel_solve_found_ || ros::WallTime::now() > deadline;
+}
+
 bool OmplRosPlanningGroup::finish(const bool &result)
 {
+  planner_statistics_.solved = result;
+  if(state_validity_checker_)
+  {
+    planner_statistics_.validity_checks = state_validity_checker_->getValidityCheckCount();
+    planner_statistics_.validity_check_time = state_validity_checker_->getValidityCheckTime();
+  }
+  if(planner_)
+  {
+    ompl::base::PlannerData planner_data;
+    planner_->getPlannerData(planner_data);
+    planner_statistics_.states_sampled = planner_data.states.size();
+    ompl::base::GoalPtr goal = planner_->getProblemDefinition()->getGoal();
+    //joint and pose goals both end up as (lazily sampled) goal states
+    ompl::base::GoalStates *goal_states = dynamic_cast<ompl::base::GoalStates*>(goal.get());
+    if(goal_states)
+      planner_statistics_.goal_samples = goal_states->getStateCount();
+  }
+  statistics_publisher_.publish(planner_statistics_);
+
   if(collision_models_interface_->getPlanningSceneState() != NULL) {
     collision_models_interface_->resetToStartState(*collision_models_interface_->getPlanningSceneState());
   }
@@ -34,8 +34,12 @@
 
 #include <ompl_ros_interface/ompl_ros_projection_evaluator.h>
 
+#if defined __SSE2__
+#include <emmintrin.h>
+#endif
+
 namespace ompl_ros_interface
-{ 
+{
  
 OmplRosProjectionEvaluator::OmplRosProjectionEvaluator(const ompl::base::StateSpace *state_space, 
                                                        const std::string &evaluator_name) : ompl::base::ProjectionEvaluator(state_space)
@@ -117,34 +121,34 @@ unsigned int OmplRosProjectionEvaluator::getDimension(void) const
 	
 void OmplRosProjectionEvaluator::project(const ompl::base::State *state, ompl::base::EuclideanProjection &projection) const
 {
+  //every projection reads dimension_ consecutive doubles out of one
+  //sub-block of the compound state, so a single dispatch resolves the
+  //base pointer and the copy below runs without further extraction.
+  //KPIECE projects every state it processes; recomputing this copy is
+  //cheaper than any lookup a cached projection would need
+  const ompl::base::CompoundState *compound_state = state->as<ompl::base::CompoundState>();
+  const double *values = NULL;
   if(mapping_type_ == ompl_ros_interface::REAL_VECTOR)
-  {
-    for(unsigned int i=0; i < dimension_; i++)
-      projection[i] = state->as<ompl::base::CompoundState>()->as<ompl::base::RealVectorStateSpace::StateType>(mapping_index_)->values[i];
-  }
-  if(mapping_type_ == ompl_ros_interface::SO2)
-  {
-    projection[0] = state->as<ompl::base::CompoundState>()->as<ompl::base::SO2StateSpace::StateType>(mapping_index_)->value;
-  }
+    values = compound_state->as<ompl::base::RealVectorStateSpace::StateType>(mapping_index_)->values;
+  else if(mapping_type_ == ompl_ros_interface::SO2)
+    values = &compound_state->as<ompl::base::SO2StateSpace::StateType>(mapping_index_)->value;
   else if(mapping_type_ == ompl_ros_interface::SE2)
-  {
-    const double *se2_vals = state->as<ompl::base::CompoundState>()->as<ompl::base::SE2StateSpace::StateType>(mapping_index_)->as<ompl::base::RealVectorStateSpace::StateType>(0)->values;
-    projection[0] = se2_vals[0];
-    projection[1] = se2_vals[1];
-  }
+    values = compound_state->as<ompl::base::SE2StateSpace::StateType>(mapping_index_)->as<ompl::base::RealVectorStateSpace::StateType>(0)->values;
   else if(mapping_type_ == ompl_ros_interface::SO3)
-  {
-    projection[0] = state->as<ompl::base::CompoundState>()->as<ompl::base::SO3StateSpace::StateType>(mapping_index_)->x;
-    projection[1] = state->as<ompl::base::CompoundState>()->as<ompl::base::SO3StateSpace::StateType>(mapping_index_)->y;
-    projection[2] = state->as<ompl::base::CompoundState>()->as<ompl::base::SO3StateSpace::StateType>(mapping_index_)->z;
-  }
+    values = &compound_state->as<ompl::base::SO3StateSpace::StateType>(mapping_index_)->x;
   else if(mapping_type_ == ompl_ros_interface::SE3)
-  {
-    const double *se3_vals = state->as<ompl::base::CompoundState>()->as<ompl::base::SE3StateSpace::StateType>(mapping_index_)->as<ompl::base::RealVectorStateSpace::StateType>(0)->values;
-    projection[0] = se3_vals[0];
-    projection[1] = se3_vals[1];
-    projection[2] = se3_vals[2];
-  }
+    values = compound_state->as<ompl::base::SE3StateSpace::StateType>(mapping_index_)->as<ompl::base::RealVectorStateSpace::StateType>(0)->values;
+  else
+    return;
+
+  double *out = &projection[0];
+  unsigned int i = 0;
+#if defined __SSE2__
+  for(; i + 2 <= dimension_; i += 2)
+    _mm_storeu_pd(out + i, _mm_loadu_pd(values + i));
+#endif
+  for(; i < dimension_; i++)
+    out[i] = values[i];
 };
 
 }
@@ -36,8 +36,10 @@
 
 #include <ompl_ros_interface/ompl_ros_state_validity_checker.h>
 
+#include <cmath>
+
 namespace ompl_ros_interface
-{    
+{
 void OmplRosStateValidityChecker::configureOnRequest(planning_models::KinematicState *kinematic_state,
                                                      planning_models::KinematicState::JointStateGroup *joint_state_group,
                                                      const arm_navigation_msgs::GetMotionPlan::Request &request)
@@ -45,6 +47,14 @@ void OmplRosStateValidityChecker::configureOnRequest(planning_models::KinematicS
   kinematic_state_ = kinematic_state;
   joint_state_group_ = joint_state_group;
 
+  //thread-local clones of the state are per-request; bumping the
+  //epoch makes stale ones refresh on their next use
+  configure_thread_ = boost::this_thread::get_id();
+  configure_epoch_++;
+
+  validity_check_count_ = 0;
+  validity_check_time_ = 0.0;
+
   goal_constraint_evaluator_set_.clear();
   path_constraint_evaluator_set_.clear();
 
@@ -61,6 +71,60 @@ void OmplRosStateValidityChecker::configureOnRequest(planning_models::KinematicS
   path_constraint_evaluator_set_.add(path_constraints.position_constraints);
   path_constraint_evaluator_set_.add(path_constraints.orientation_constraints);
   path_constraint_evaluator_set_.add(path_constraints.visibility_constraints);
+
+  //constraints are fixed for the duration of the request, so resolve
+  //their name lookups once
+  goal_constraint_evaluator_set_.compile(kinematic_state_);
+  path_constraint_evaluator_set_.compile(kinematic_state_);
+
+  //an axis-aligned workspace box in the world frame lets states be
+  //rejected right after FK; anything else in the workspace
+  //parameters deactivates the pretest rather than approximating it
+  workspace_check_active_ = false;
+  const arm_navigation_msgs::WorkspaceParameters &workspace = request.motion_plan_request.workspace_parameters;
+  if(workspace.workspace_region_shape.type == arm_navigation_msgs::Shape::BOX &&
+     workspace.workspace_region_shape.dimensions.size() == 3 &&
+     workspace.workspace_region_shape.dimensions[0] > 0.0 &&
+     workspace.workspace_region_shape.dimensions[1] > 0.0 &&
+     workspace.workspace_region_shape.dimensions[2] > 0.0)
+  {
+    const geometry_msgs::PoseStamped &region_pose = workspace.workspace_region_pose;
+    bool axis_aligned = fabs(region_pose.pose.orientation.x) < 1e-6 &&
+      fabs(region_pose.pose.orientation.y) < 1e-6 &&
+      fabs(region_pose.pose.orientation.z) < 1e-6;
+    bool in_world_frame = region_pose.header.frame_id.empty() ||
+      region_pose.header.frame_id == collision_models_interface_->getWorldFrameId();
+    if(axis_aligned && in_world_frame)
+    {
+      workspace_min_.setValue(region_pose.pose.position.x - 0.5 * workspace.workspace_region_shape.dimensions[0],
+                              region_pose.pose.position.y - 0.5 * workspace.workspace_region_shape.dimensions[1],
+                              region_pose.pose.position.z - 0.5 * workspace.workspace_region_shape.dimensions[2]);
+      workspace_max_.setValue(region_pose.pose.position.x + 0.5 * workspace.workspace_region_shape.dimensions[0],
+                              region_pose.pose.position.y + 0.5 * workspace.workspace_region_shape.dimensions[1],
+                              region_pose.pose.position.z + 0.5 * workspace.workspace_region_shape.dimensions[2]);
+      workspace_check_active_ = true;
+    }
+    else
+    {
+      ROS_DEBUG("Workspace region is not an axis-aligned box in the world frame, skipping workspace pretest");
+    }
+  }
+}
+
+bool OmplRosStateValidityChecker::isStateInWorkspace(const planning_models::KinematicState::JointStateGroup *joint_state_group) const
+{
+  if(!workspace_check_active_)
+    return true;
+  const std::vector<planning_models::KinematicState::LinkState*> &links = joint_state_group->getUpdatedLinkStates();
+  for(unsigned int i = 0; i < links.size(); i++)
+  {
+    const tf::Vector3 &origin = links[i]->getGlobalLinkTransform().getOrigin();
+    if(origin.x() < workspace_min_.x() || origin.x() > workspace_max_.x() ||
+       origin.y() < workspace_min_.y() || origin.y() > workspace_max_.y() ||
+       origin.z() < workspace_min_.z() || origin.z() > workspace_max_.z())
+      return false;
+  }
+  return true;
 }
 
 arm_navigation_msgs::Constraints OmplRosStateValidityChecker::getPhysicalConstraints(const arm_navigation_msgs::Constraints &constraints)
@@ -85,6 +149,78 @@ arm_navigation_msgs::Constraints OmplRosStateValidityChecker::getPhysicalConstra
   return result_constraints;
 }
 
+void OmplRosStateValidityChecker::getThreadSafeState(planning_models::KinematicState *&kinematic_state,
+                                                     planning_models::KinematicState::JointStateGroup *&joint_state_group) const
+{
+  if(boost::this_thread::get_id() == configure_thread_)
+  {
+    kinematic_state = kinematic_state_;
+    joint_state_group = joint_state_group_;
+    return;
+  }
+  PerThreadState *thread_state = per_thread_state_.get();
+  if(!thread_state || thread_state->epoch != configure_epoch_)
+  {
+    thread_state = new PerThreadState(*kinematic_state_, joint_state_group_->getName(), configure_epoch_);
+    per_thread_state_.reset(thread_state);
+  }
+  kinematic_state = &thread_state->state;
+  joint_state_group = thread_state->group;
+}
+
+unsigned long long OmplRosStateValidityChecker::validityCacheKey(const planning_models::KinematicState::JointStateGroup *joint_state_group) const
+{
+  static const double resolution = 1e-4;
+  unsigned long long h = 0xc6a4a7935bd1e995ULL;
+  const std::vector<planning_models::KinematicState::JointState*>& joint_states = joint_state_group->getJointStateVector();
+  for(unsigned int i=0; i < joint_states.size(); i++)
+  {
+    const std::vector<double>& values = joint_states[i]->getJointStateValues();
+    for(unsigned int j=0; j < values.size(); j++)
+    {
+      unsigned long long k = (unsigned long long)(long long)floor(values[j]/resolution + 0.5);
+      k ^= k >> 33;
+      k *= 0xff51afd7ed558ccdULL;
+      k ^= k >> 33;
+      h = (h ^ k) * 0xc6a4a7935bd1e995ULL;
+    }
+  }
+  h ^= h >> 33;
+  //zero marks an empty cache slot
+  if(!h)
+    h = 1;
+  return h;
+}
+
+OmplRosStateValidityChecker::ValidityCache* OmplRosStateValidityChecker::getValidityCache() const
+{
+  ValidityCache *cache = validity_cache_.get();
+  if(!cache || cache->epoch != configure_epoch_)
+  {
+    cache = new ValidityCache(configure_epoch_);
+    validity_cache_.reset(cache);
+  }
+  return cache;
+}
+
+bool OmplRosStateValidityChecker::lookupValidity(unsigned long long key, bool &valid) const
+{
+  ValidityCache *cache = getValidityCache();
+  unsigned int slot = (unsigned int)(key & (ValidityCache::SIZE - 1));
+  if(cache->keys[slot] != key)
+    return false;
+  valid = cache->verdicts[slot] != 0;
+  return true;
+}
+
+void OmplRosStateValidityChecker::storeValidity(unsigned long long key, bool valid) const
+{
+  ValidityCache *cache = getValidityCache();
+  unsigned int slot = (unsigned int)(key & (ValidityCache::SIZE - 1));
+  cache->keys[slot] = key;
+  cache->verdicts[slot] = valid ? 1 : 0;
+}
+
 void OmplRosStateValidityChecker::printSettings(std::ostream &out) const
 {    
   out << "ROS State Validity Checker" << std::endl;
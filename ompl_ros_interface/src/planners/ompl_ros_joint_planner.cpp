@@ -41,8 +41,9 @@ namespace ompl_ros_interface
 
 bool OmplRosJointPlanner::initializePlanningStateSpace(ompl::base::StateSpacePtr &state_space)
 {
-  //Setup the corresponding ompl state space
-  state_space = ompl_ros_interface::jointGroupToOmplStateSpacePtr(physical_joint_group_,
+  //Setup the corresponding ompl state space; planner configurations
+  //for the same group share one cached space and mapping pair
+  state_space = ompl_ros_interface::cachedJointGroupToOmplStateSpacePtr(physical_joint_group_,
                                                                         ompl_state_to_kinematic_state_mapping_,
                                                                         kinematic_state_to_ompl_state_mapping_);
   if(!state_space)
@@ -171,6 +172,70 @@ bool OmplRosJointPlanner::setStart(arm_navigation_msgs::GetMotionPlan::Request &
   return true;
 }
 
+bool OmplRosJointPlanner::warmStart(arm_navigation_msgs::GetMotionPlan::Request &request,
+                                    arm_navigation_msgs::GetMotionPlan::Response &response)
+{
+  const trajectory_msgs::JointTrajectory &seed = request.motion_plan_request.seed_trajectory;
+  if(seed.points.empty())
+    return false;
+  ompl::base::SpaceInformationPtr space_information = planner_->getSpaceInformation();
+  ompl::base::ProblemDefinitionPtr problem_definition = planner_->getProblemDefinition();
+  if(problem_definition->getStartStateCount() == 0 || !problem_definition->getGoal())
+    return false;
+
+  //convert the seed waypoints into ompl states through the physical joint group
+  std::vector<ompl::base::ScopedState<ompl::base::CompoundStateSpace> > waypoints;
+  std::map<std::string,double> joint_values;
+  ompl::base::ScopedState<ompl::base::CompoundStateSpace> waypoint(state_space_);
+  for(unsigned int i=0; i < seed.points.size(); i++)
+  {
+    if(seed.points[i].positions.size() != seed.joint_names.size())
+      return false;
+    for(unsigned int j=0; j < seed.joint_names.size(); j++)
+      joint_values[seed.joint_names[j]] = seed.points[i].positions[j];
+    if(!physical_joint_state_group_->setKinematicState(joint_values))
+      return false;
+    if(!ompl_ros_interface::kinematicStateGroupToOmplState(physical_joint_state_group_,
+                                                           kinematic_state_to_ompl_state_mapping_,
+                                                           waypoint))
+      return false;
+    waypoints.push_back(waypoint);
+  }
+
+  //the seed must still end in the goal region of this request
+  if(!problem_definition->getGoal()->isSatisfied(waypoints.back().get()))
+    return false;
+
+  //the robot may have stopped partway along the old path: find the
+  //earliest waypoint directly reachable from the new start, then
+  //require the remaining suffix to be entirely valid
+  const ompl::base::State *start_state = problem_definition->getStartState(0);
+  int rejoin_index = -1;
+  for(unsigned int i=0; i < waypoints.size(); i++)
+  {
+    if(space_information->checkMotion(start_state,waypoints[i].get()))
+    {
+      rejoin_index = i;
+      break;
+    }
+  }
+  if(rejoin_index < 0)
+    return false;
+  for(unsigned int i=rejoin_index; i+1 < waypoints.size(); i++)
+  {
+    if(!space_information->checkMotion(waypoints[i].get(),waypoints[i+1].get()))
+      return false;
+  }
+
+  ompl::geometric::PathGeometric *seed_path = new ompl::geometric::PathGeometric(space_information);
+  seed_path->append(start_state);
+  for(unsigned int i=rejoin_index; i < waypoints.size(); i++)
+    seed_path->append(waypoints[i].get());
+  problem_definition->addSolutionPath(ompl::base::PathPtr(seed_path));
+  ROS_DEBUG("Reusing seed trajectory from waypoint %d of %d",rejoin_index,(int)waypoints.size());
+  return true;
+}
+
 bool OmplRosJointPlanner::setJointGoal(arm_navigation_msgs::GetMotionPlan::Request &request,
                                         arm_navigation_msgs::GetMotionPlan::Response &response)
 {
@@ -246,7 +311,12 @@ arm_navigation_msgs::RobotTrajectory OmplRosJointPlanner::getSolutionPath()
 {
   arm_navigation_msgs::RobotTrajectory robot_trajectory;
   ompl::geometric::PathGeometric solution = planner_->getSolutionPath();
-  solution.interpolate();
+  //interpolating at the valid segment resolution can produce far
+  //more waypoints than the downstream filter chain needs
+  if(max_trajectory_points_ > 0)
+    solution.interpolate(max_trajectory_points_);
+  else
+    solution.interpolate();
   omplPathGeometricToRobotTrajectory(solution,robot_trajectory);
   return robot_trajectory;
 }
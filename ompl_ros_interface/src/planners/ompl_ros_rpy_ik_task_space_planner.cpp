@@ -66,7 +66,10 @@ arm_navigation_msgs::RobotTrajectory OmplRosRPYIKTaskSpacePlanner::getSolutionPa
   arm_navigation_msgs::RobotTrajectory robot_trajectory;
   
   ompl::geometric::PathGeometric path = planner_->getSolutionPath();
-  path.interpolate();
+  if(max_trajectory_points_ > 0)
+    path.interpolate(max_trajectory_points_);
+  else
+    path.interpolate();
   unsigned int num_points = path.getStateCount();
   ROS_DEBUG("Path has %d waypoints",(int)path.getStateCount());
   for(unsigned int i=0; i < num_points; i++)
@@ -195,8 +198,8 @@ bool OmplRosRPYIKTaskSpacePlanner::constraintsToOmplState(const arm_navigation_m
     ROS_WARN("Goal constraints probably don't have a position and orientation constraint");
     return false;
   }
-  geometry_msgs::PoseStamped desired_pose = arm_navigation_msgs::poseConstraintsToPoseStamped(position_constraint,
-                                                                                               orientation_constraint);
+  geometry_msgs::PoseStamped desired_pose;
+  arm_navigation_msgs::poseConstraintsToPoseStamped(position_constraint,orientation_constraint,desired_pose);
 
   tf::Quaternion orientation;
   double roll,pitch,yaw;
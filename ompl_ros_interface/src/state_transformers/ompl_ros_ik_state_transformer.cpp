@@ -36,10 +36,12 @@
 
 #include <ompl_ros_interface/state_transformers/ompl_ros_ik_state_transformer.h>
 
+#include <cmath>
+
 namespace ompl_ros_interface
 {
 OmplRosIKStateTransformer::OmplRosIKStateTransformer(const ompl::base::StateSpacePtr &state_space,
-                                                     const planning_models::KinematicModel::JointModelGroup* physical_joint_model_group) : OmplRosStateTransformer(state_space, physical_joint_model_group), kinematics_loader_("kinematics_base","kinematics::KinematicsBase")
+                                                     const planning_models::KinematicModel::JointModelGroup* physical_joint_model_group) : OmplRosStateTransformer(state_space, physical_joint_model_group), kinematics_loader_("kinematics_base","kinematics::KinematicsBase"), ik_cache_epoch_(0)
 
 {
   ros::NodeHandle node_handle("~");
@@ -48,6 +50,9 @@ OmplRosIKStateTransformer::OmplRosIKStateTransformer(const ompl::base::StateSpac
   physical_group_name_ = physical_joint_model_group_->getName();
   std::string base_name, tip_name;
 
+  node_handle.param(group_name_+"/ik_cache_translation_resolution",ik_cache_translation_resolution_,0.02);
+  node_handle.param(group_name_+"/ik_cache_rotation_resolution",ik_cache_rotation_resolution_,0.05);
+
   if(!node_handle.hasParam(group_name_+"/kinematics_solver"))
   {
     ROS_ERROR("Kinematics solver not defined for group %s in namespace %s",group_name_.c_str(),node_handle.getNamespace().c_str());
@@ -97,5 +102,71 @@ OmplRosIKStateTransformer::OmplRosIKStateTransformer(const ompl::base::StateSpac
     throw new OMPLROSException();
   }
   ROS_DEBUG("Initialized ompl ros state transformer %s",kinematics_solver_name.c_str());
-}  
+}
+
+unsigned long long OmplRosIKStateTransformer::ikCacheKey(const geometry_msgs::Pose &pose) const
+{
+  //hash the voxel indices of the pose so that all poses within one
+  //workspace voxel share a cache slot; the quaternion is quantized at
+  //the rotation resolution
+  double quantized[7];
+  quantized[0] = pose.position.x/ik_cache_translation_resolution_;
+  quantized[1] = pose.position.y/ik_cache_translation_resolution_;
+  quantized[2] = pose.position.z/ik_cache_translation_resolution_;
+  quantized[3] = pose.orientation.x/ik_cache_rotation_resolution_;
+  quantized[4] = pose.orientation.y/ik_cache_rotation_resolution_;
+  quantized[5] = pose.orientation.z/ik_cache_rotation_resolution_;
+  quantized[6] = pose.orientation.w/ik_cache_rotation_resolution_;
+
+  unsigned long long hash = 0;
+  for(unsigned int i=0; i < 7; i++)
+  {
+    unsigned long long cell = (unsigned long long)(long long)floor(quantized[i] + 0.5);
+    hash ^= cell;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+  }
+  hash ^= hash >> 33;
+  if(!hash)
+    hash = 1;
+  return hash;
+}
+
+OmplRosIKStateTransformer::IKSeedCache* OmplRosIKStateTransformer::getIKSeedCache() const
+{
+  IKSeedCache* cache = ik_seed_cache_.get();
+  if(!cache || cache->epoch != ik_cache_epoch_)
+  {
+    ik_seed_cache_.reset(new IKSeedCache(ik_cache_epoch_));
+    cache = ik_seed_cache_.get();
+  }
+  return cache;
+}
+
+bool OmplRosIKStateTransformer::lookupIKSeed(const geometry_msgs::Pose &pose, std::vector<double> &seed) const
+{
+  unsigned long long key = ikCacheKey(pose);
+  IKSeedCache* cache = getIKSeedCache();
+  unsigned int slot = (unsigned int)(key & (unsigned long long)(IKSeedCache::SIZE-1));
+  if(cache->keys[slot] != key || cache->solutions[slot].size() != seed.size())
+    return false;
+  seed = cache->solutions[slot];
+  return true;
+}
+
+void OmplRosIKStateTransformer::storeIKSolution(const geometry_msgs::Pose &pose, const std::vector<double> &solution) const
+{
+  unsigned long long key = ikCacheKey(pose);
+  IKSeedCache* cache = getIKSeedCache();
+  unsigned int slot = (unsigned int)(key & (unsigned long long)(IKSeedCache::SIZE-1));
+  cache->keys[slot] = key;
+  cache->solutions[slot] = solution;
+}
+
+void OmplRosIKStateTransformer::clearIKSolutionCache()
+{
+  //per-thread caches notice the new epoch lazily and recreate themselves
+  ik_cache_epoch_++;
+}
+
 }
@@ -79,8 +79,8 @@ bool OmplRosRPYIKStateTransformer::initialize()
 
 bool OmplRosRPYIKStateTransformer::configureOnRequest(const arm_navigation_msgs::GetMotionPlan::Request &request,
                                                       arm_navigation_msgs::GetMotionPlan::Response &response)
-{  
-
+{
+  clearIKSolutionCache();
   return true;
 }
 
@@ -89,7 +89,11 @@ bool OmplRosRPYIKStateTransformer::inverseTransform(const ompl::base::State &omp
 {
   geometry_msgs::Pose pose;
   omplStateToPose(ompl_state,pose);
-  generateRandomState(seed_state_);
+  //a solution cached for the same workspace voxel is a much better
+  //seed than a random configuration: nearby task-space samples then
+  //converge in a handful of solver iterations
+  if(!lookupIKSeed(pose,seed_state_.joint_state.position))
+    generateRandomState(seed_state_);
 
   (*scoped_state_) = ompl_state;
   ompl_ros_interface::omplStateToRobotState(*scoped_state_,ompl_state_to_robot_state_mapping_,seed_state_);
@@ -110,6 +114,7 @@ bool OmplRosRPYIKStateTransformer::inverseTransform(const ompl::base::State &omp
                                           solution_state_.joint_state.position,
                                           error_code))
   {
+    storeIKSolution(pose,solution_state_.joint_state.position);
     robot_state.joint_state = solution_state_.joint_state;
     return true;
   }
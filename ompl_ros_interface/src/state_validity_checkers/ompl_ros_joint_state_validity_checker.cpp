@@ -41,35 +41,57 @@ namespace ompl_ros_interface
 
 bool OmplRosJointStateValidityChecker::isValid(const ompl::base::State *ompl_state) const
 {
-  //ros::WallTime n1 = ros::WallTime::now();
+  ScopedCheckStat check_stat(this);
+  planning_models::KinematicState *kinematic_state;
+  planning_models::KinematicState::JointStateGroup *joint_state_group;
+  getThreadSafeState(kinematic_state,joint_state_group);
+
   ompl_ros_interface::omplStateToKinematicStateGroup(ompl_state,
                                                      ompl_state_to_kinematic_state_mapping_,
-                                                     joint_state_group_);
-  std::vector<planning_models::KinematicState::JointState*> joint_states = joint_state_group_->getJointStateVector();
+                                                     joint_state_group);
+
+  //planners revisit states and simplification re-checks validated
+  //segments; a cached verdict skips the full FK + collision pass
+  unsigned long long cache_key = validityCacheKey(joint_state_group);
+  bool cached_valid;
+  if(lookupValidity(cache_key, cached_valid))
+    return cached_valid;
+
+  std::vector<planning_models::KinematicState::JointState*> joint_states = joint_state_group->getJointStateVector();
   for(unsigned int i=0; i < joint_states.size(); i++)
   {
     if(!joint_states[i]->areJointStateValuesWithinBounds())
     {
       ROS_ERROR("State violates joint limits for Joint %s",joint_states[i]->getName().c_str());
+      storeValidity(cache_key, false);
       return false;
     }
   }
 
-  if(!path_constraint_evaluator_set_.decide(kinematic_state_, false))
+  if(!path_constraint_evaluator_set_.decide(kinematic_state, false))
   {
     ROS_DEBUG("Path constraints violated");
+    storeValidity(cache_key, false);
     return false;
   }
 
-  joint_state_group_->updateKinematicLinks();
+  joint_state_group->updateKinematicLinks();
+  if(!isStateInWorkspace(joint_state_group))
+  {
+    ROS_DEBUG("State outside workspace bounds");
+    storeValidity(cache_key, false);
+    return false;
+  }
   //ros::WallTime n2 = ros::WallTime::now();
-  if(collision_models_interface_->isKinematicStateInCollision(*kinematic_state_))
+  if(collision_models_interface_->isKinematicStateInCollision(*kinematic_state))
   {
     ROS_DEBUG("State is in collision");
     //ROS_INFO_STREAM("Positive collision check took " << (ros::WallTime::now()-n2).toSec());
+    storeValidity(cache_key, false);
     return false;
   }
   //ROS_INFO_STREAM("Negative collision check took " << (ros::WallTime::now()-n2).toSec());
+  storeValidity(cache_key, true);
   return true;
 }
 
@@ -97,10 +119,16 @@ bool OmplRosJointStateValidityChecker::isStateValid(const ompl::base::State *omp
   }
 
   joint_state_group_->updateKinematicLinks();
+  if(!isStateInWorkspace(joint_state_group_))
+  {
+    ROS_DEBUG("State outside workspace bounds");
+    error_code_.val = error_code_.PATH_CONSTRAINTS_VIOLATED;
+    return false;
+  }
   if(collision_models_interface_->isKinematicStateInCollision(*kinematic_state_))
   {
     ROS_DEBUG("State is in collision");
-    error_code_.val = error_code_.COLLISION_CONSTRAINTS_VIOLATED;        
+    error_code_.val = error_code_.COLLISION_CONSTRAINTS_VIOLATED;
     return false;
   }
   ROS_DEBUG("State is ok");
@@ -41,15 +41,20 @@ namespace ompl_ros_interface
 
 bool OmplRosTaskSpaceValidityChecker::isValid(const ompl::base::State *ompl_state) const
 {
+  ScopedCheckStat check_stat(this);
   arm_navigation_msgs::RobotState robot_state_msg;
   if(!state_transformer_->inverseTransform(*ompl_state,
                                            robot_state_msg))
     return false;
 
+  planning_models::KinematicState *kinematic_state;
+  planning_models::KinematicState::JointStateGroup *joint_state_group;
+  getThreadSafeState(kinematic_state,joint_state_group);
+
   ompl_ros_interface::robotStateToJointStateGroup(robot_state_msg,
                                                   robot_state_to_joint_state_group_mapping_,
-                                                  joint_state_group_);
-  std::vector<planning_models::KinematicState::JointState*> joint_states = joint_state_group_->getJointStateVector();
+                                                  joint_state_group);
+  std::vector<planning_models::KinematicState::JointState*> joint_states = joint_state_group->getJointStateVector();
   for(unsigned int i=0; i < joint_states.size(); i++)
   {
     if(!joint_states[i]->areJointStateValuesWithinBounds())
@@ -58,13 +63,18 @@ bool OmplRosTaskSpaceValidityChecker::isValid(const ompl::base::State *ompl_stat
       return false;
     }
   }
-  joint_state_group_->updateKinematicLinks();
-  if(!path_constraint_evaluator_set_.decide(kinematic_state_, false))
+  joint_state_group->updateKinematicLinks();
+  if(!isStateInWorkspace(joint_state_group))
+  {
+    ROS_DEBUG("State outside workspace bounds");
+    return false;
+  }
+  if(!path_constraint_evaluator_set_.decide(kinematic_state, false))
   {
     ROS_DEBUG("Path constraints violated in task space");
     return false;
   }
-  if(collision_models_interface_->isKinematicStateInCollision(*kinematic_state_))
+  if(collision_models_interface_->isKinematicStateInCollision(*kinematic_state))
   {
     ROS_DEBUG("State is in collision");
     return false;
@@ -104,10 +114,16 @@ bool OmplRosTaskSpaceValidityChecker::isStateValid(const ompl::base::State *ompl
   }
 
   joint_state_group_->updateKinematicLinks();
+  if(!isStateInWorkspace(joint_state_group_))
+  {
+    ROS_DEBUG("State outside workspace bounds");
+    error_code_.val = error_code_.PATH_CONSTRAINTS_VIOLATED;
+    return false;
+  }
   if(collision_models_interface_->isKinematicStateInCollision(*kinematic_state_))
   {
     ROS_DEBUG("State is in collision");
-    error_code_.val = error_code_.COLLISION_CONSTRAINTS_VIOLATED;        
+    error_code_.val = error_code_.COLLISION_CONSTRAINTS_VIOLATED;
     return false;
   }
   return true;
@@ -141,6 +157,11 @@ void OmplRosTaskSpaceValidityChecker::configureOnRequest(planning_models::Kinema
   kinematic_state_ = kinematic_state;
   joint_state_group_ = joint_state_group;
 
+  //thread-local clones of the state are per-request; bumping the
+  //epoch makes stale ones refresh on their next use
+  configure_thread_ = boost::this_thread::get_id();
+  configure_epoch_++;
+
   goal_constraint_evaluator_set_.clear();
   path_constraint_evaluator_set_.clear();
 
@@ -158,6 +179,11 @@ void OmplRosTaskSpaceValidityChecker::configureOnRequest(planning_models::Kinema
   path_constraint_evaluator_set_.add(path_constraints.orientation_constraints);
   path_constraint_evaluator_set_.add(path_constraints.visibility_constraints);
 
+  //constraints are fixed for the duration of the request, so resolve
+  //their name lookups once
+  goal_constraint_evaluator_set_.compile(kinematic_state_);
+  path_constraint_evaluator_set_.compile(kinematic_state_);
+
   arm_navigation_msgs::RobotState default_state = state_transformer_->getDefaultState();
   if(!getRobotStateToJointModelGroupMapping(default_state,joint_state_group_->getJointModelGroup(),robot_state_to_joint_state_group_mapping_))
     return;
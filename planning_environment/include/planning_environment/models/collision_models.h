@@ -39,6 +39,7 @@
 
 #include "planning_environment/models/robot_models.h"
 #include <tf/tf.h>
+#include <boost/thread/tss.hpp>
 #include <collision_space/environmentODE.h>
 #include <arm_navigation_msgs/PlanningScene.h>
 #include <arm_navigation_msgs/Shape.h>
@@ -48,17 +49,21 @@
 #include <arm_navigation_msgs/ArmNavigationErrorCodes.h>
 #include <arm_navigation_msgs/MotionPlanRequest.h>
 #include <arm_navigation_msgs/ContactInformation.h>
+#include <arm_navigation_msgs/CompactCollisionMap.h>
 #include <visualization_msgs/Marker.h>
 #include <visualization_msgs/MarkerArray.h>
 #include <arm_navigation_msgs/OrderedCollisionOperations.h>
+#include <list>
 
 static const std::string COLLISION_MAP_NAME="collision_map";
 
 namespace planning_environment
 {
 
+class CollisionMarkerPool;
+
 /** \brief A class capable of loading a robot model from the parameter server */
-    
+
 class CollisionModels : public RobotModels
 {
 public:
@@ -67,7 +72,13 @@ public:
   // Constructors
   //
 	
-  CollisionModels(const std::string &description);
+  /** \brief Load the models from the parameter server. When
+      \e kinematics_only is true the kinematic model is built without
+      link shapes and no collision environment is constructed - mesh
+      parsing and ODE space setup are skipped entirely, which cuts
+      startup time and memory for nodes that only do kinematics.
+      Collision checking functions must not be used in that mode. */
+  CollisionModels(const std::string &description, bool kinematics_only = false);
 
   CollisionModels(boost::shared_ptr<urdf::Model> urdf,
                   planning_models::KinematicModel* kmodel,
@@ -80,8 +91,31 @@ public:
   //
   planning_models::KinematicState* setPlanningScene(const arm_navigation_msgs::PlanningScene& planning_scene);
 
+  /** \brief Apply a planning scene by diffing it against the scene
+      currently set instead of tearing everything down. Static and
+      attached objects that are unchanged keep their collision
+      geometry in place, an identical collision map skips re-masking
+      and re-insertion entirely, and padding, allowed contacts and the
+      allowed collision matrix are only reapplied when their parts of
+      the message differ. old_state (as returned by setPlanningScene()
+      or a previous diff) is deleted and a state for the new scene is
+      returned; when no scene is set this falls back to a full
+      setPlanningScene(). Returns NULL on the same errors as the full
+      path, in which case no scene is set anymore. */
+  planning_models::KinematicState* applyPlanningSceneDiff(const arm_navigation_msgs::PlanningScene& planning_scene,
+                                                          planning_models::KinematicState* old_state);
+
   void revertPlanningScene(planning_models::KinematicState* state);
 
+  /** \brief Exchange the entire collision environment - objects,
+      attached objects, collision map, applied-scene bookkeeping and
+      the kinematic model backing it - with another instance built
+      from the same robot description. Callers must hold the bodies
+      lock; the point is that a scene can be built into the other
+      instance without any lock held and then swapped in, with the
+      lock taken only for the swap. */
+  void swapEnvironmentContents(CollisionModels& other);
+
   // 
   // Planning scene and state based transform functions
   //
@@ -138,10 +172,29 @@ public:
   void setCollisionMap(const arm_navigation_msgs::CollisionMap& map,
                        bool mask_before_insertion=true);
 
+  /** \brief Sets the collision map from its run-length encoded form,
+      expanding the runs straight into collision space shapes without
+      building the per-voxel box message in between. The header must be
+      in the world frame. */
+  void setCollisionMap(const arm_navigation_msgs::CompactCollisionMap& map,
+                       bool mask_before_insertion=true);
+
   void setCollisionMap(std::vector<shapes::Shape*>& shapes,
                        const std::vector<tf::Transform>& poses,
                        bool mask_before_insertion=true);
-  
+
+  /** \brief Replaces the collision map by diffing against the
+      currently loaded boxes, keyed by their centers quantized at the
+      given resolution - only boxes that actually changed are removed
+      from or added to the collision space. The final contents are the
+      same as setCollisionMap without masking; when no map is loaded,
+      most of the map changed, or the resolution is not positive, the
+      whole map is set instead. Ownership of the shapes passes to the
+      models either way. */
+  void updateCollisionMap(std::vector<shapes::Shape*>& shapes,
+                          const std::vector<tf::Transform>& poses,
+                          double resolution);
+
   void remaskCollisionMap();
 
   void maskAndDeleteShapeVector(std::vector<shapes::Shape*>& shapes,
@@ -223,9 +276,21 @@ public:
   //
   // Functions for checking collisions and validity
   //
-  
+  // The state-based queries run on a per-thread clone of the
+  // collision environment, kept fresh through the environment's
+  // modification epoch, so any number of threads can check
+  // caller-provided states concurrently; only scene mutations
+  // serialize on the locks.
+
   bool isKinematicStateInCollision(const planning_models::KinematicState& state);
 
+  /** \brief Check the straight joint-space motion between two states
+      for collision using the environment's clearance-adaptive segment
+      check, which only refines where the clearance is low. Runs on
+      the per-thread clone like the other state-based queries. */
+  bool isKinematicSegmentInCollision(const planning_models::KinematicState& from,
+                                     const planning_models::KinematicState& to);
+
   bool isKinematicStateInSelfCollision(const planning_models::KinematicState& state);
 
   bool isKinematicStateInEnvironmentCollision(const planning_models::KinematicState& state);
@@ -235,12 +300,55 @@ public:
 
   bool isObjectInCollision(const std::string& object_name);
 
+  /** \brief Process-wide count of collision space queries (state,
+      segment, self, environment and object checks) made through any
+      CollisionModels instance since the last reset. Memoized verdict
+      hits are not counted. Intended for benchmarking filter and
+      planner configurations. */
+  static unsigned long getCollisionCheckCount();
+
+  static void resetCollisionCheckCount();
+
+  //
+  // Managed clone pool
+  //
+  // Parallel planning, validation and shortcutting all need cloned
+  // environments. Rather than each subsystem cloning ad hoc, workers
+  // check clones out of a per-group pool and return them when done;
+  // a checked-in clone is kept as-is and only re-cloned at its next
+  // checkout if the master's modification epoch moved while it sat
+  // in the pool. The environment carries no group state - per-group
+  // keying just keeps each pipeline's clones warm and its pool
+  // bounded independently of the others.
+
+  /** \brief Pre-build count clones for the given group, up to the
+      pool cap, so the first wave of workers does not pay clone cost
+      on the hot path. */
+  void primeClonedEnvironments(const std::string& group_name, unsigned int count);
+
+  /** \brief Check a clone of the collision environment out of the
+      group's pool, refreshing it first if its generation is stale.
+      Falls back to an unpooled fresh clone when every pooled clone
+      is checked out. The clone must be returned through
+      checkinClonedEnvironment(). */
+  collision_space::EnvironmentModel* checkoutClonedEnvironment(const std::string& group_name);
+
+  /** \brief Return a clone obtained from checkoutClonedEnvironment().
+      Overflow clones that never had a pool slot are deleted here. */
+  void checkinClonedEnvironment(const std::string& group_name, collision_space::EnvironmentModel* env);
+
   void getPlanningSceneGivenState(const planning_models::KinematicState& state,
                                   arm_navigation_msgs::PlanningScene& scene);
 
+  /** \brief Get the contacts for the given state. A max_total
+      greater than zero bounds the total number of contacts gathered,
+      so diagnostic callers with a latency budget are not at the
+      mercy of how deeply penetrating the state is; zero gathers
+      every contact. */
   void getAllCollisionsForState(const planning_models::KinematicState& state,
                                 std::vector<arm_navigation_msgs::ContactInformation>& contacts,
-                                unsigned int num_per_pair = 1);
+                                unsigned int num_per_pair = 1,
+                                unsigned int max_total = 0);
 
   void getAllEnvironmentCollisionsForObject(const std::string& object_name, 
 					    std::vector<arm_navigation_msgs::ContactInformation>& contacts,
@@ -261,13 +369,18 @@ public:
                               std::vector<arm_navigation_msgs::ArmNavigationErrorCodes>& trajectory_error_codes,
                               const bool evaluate_entire_trajectory);
 
+  /** \brief Checks the trajectory point by point. Long trajectories
+      are sharded across worker threads, each checking its range
+      against its own clone of the collision environment; on an early
+      exit all shards stop at the first invalid point, and error
+      codes for points never reached read SUCCESS. */
   bool isJointTrajectoryValid(planning_models::KinematicState& state,
                               const trajectory_msgs::JointTrajectory &trajectory,
                               const arm_navigation_msgs::Constraints& goal_constraints,
                               const arm_navigation_msgs::Constraints& path_constraints,
                               arm_navigation_msgs::ArmNavigationErrorCodes& error_code,
                               std::vector<arm_navigation_msgs::ArmNavigationErrorCodes>& trajectory_error_codes,
-                              const bool evaluate_entire_trajectory);  
+                              const bool evaluate_entire_trajectory);
 
   // bool isRobotTrajectoryValid(const arm_navigation_msgs::PlanningScene& planning_scene,
   //                             const arm_navigation_msgs::RobotTrajectory &trajectory,
@@ -323,6 +436,15 @@ public:
                                    const std_msgs::ColorRGBA& color,
                                    const ros::Duration& lifetime);
 
+  /** \brief Pool-backed variant for per-cycle visualization: contacts
+      and markers are built in the pool's retained storage, so
+      steady-state use does not allocate. The returned array
+      references the pool and is valid until its next fill. */
+  const visualization_msgs::MarkerArray& getAllCollisionPointMarkers(const planning_models::KinematicState& state,
+                                                                     CollisionMarkerPool& pool,
+                                                                     const std_msgs::ColorRGBA& color,
+                                                                     const ros::Duration& lifetime);
+
 
   void getRobotMarkersGivenState(const planning_models::KinematicState& state,
                                  visualization_msgs::MarkerArray& arr,
@@ -377,11 +499,18 @@ public:
   /// Accessors
   ///
 
-  /** \brief Return the instance of the constructed ODE collision model */  
+  /** \brief Return the instance of the constructed ODE collision model */
   const collision_space::EnvironmentModel* getCollisionSpace() const {
     return ode_collision_model_;
   }
 
+  /** \brief Monotonically increasing version of the collision scene,
+      bumped on every mutation of the environment. Cached query
+      verdicts are keyed against it. */
+  unsigned long getCollisionSceneVersion() const {
+    return ode_collision_model_->getModificationEpoch();
+  }
+
   /** \brief Get the scaling to be used for the robot parts when inserted in the collision space */
   double getDefaultScale(void) const
   {
@@ -473,14 +602,189 @@ protected:
   std::map<std::string, bodies::BodyVector*> static_object_map_;
 
   std::map<std::string, std::map<std::string, bodies::BodyVector*> > link_attached_objects_;
-	
+
+  /** \brief The attached objects of one link in flat form for pose
+      updates; the name and body vectors run in parallel */
+  struct AttachedBodyCacheEntry
+  {
+    std::string link_name;
+
+    /** \brief Position of the link in the state vectors, resolved
+        lazily on the first pose update; -1 until then */
+    int link_index;
+
+    std::vector<std::string> object_names;
+    std::vector<bodies::BodyVector*> object_bodies;
+  };
+
+  /** \brief Flat per-link view of link_attached_objects_, rebuilt
+      by rebuildAttachedBodyCache() on every attach and detach so
+      per-state pose updates walk arrays instead of nested string
+      maps */
+  std::vector<AttachedBodyCacheEntry> attached_body_cache_;
+
+  /** \brief Rebuild attached_body_cache_ from
+      link_attached_objects_; the caller must hold bodies_lock_ */
+  void rebuildAttachedBodyCache();
+
+  /** \brief Copy the state's attached body poses into one cache
+      entry's body vectors; the caller must hold bodies_lock_ */
+  bool updateAttachedBodyPosesForCacheEntry(const planning_models::KinematicState& state,
+                                            AttachedBodyCacheEntry& entry);
+
+  /** \brief Coarse grid over the bounding spheres of every maskable
+      body. A cell is marked when it lies within the uncertainty band
+      of some sphere; collision map boxes whose cell is unmarked (or
+      outside the grid) skip the exact containment tests entirely.
+      Conservative by half a cell diagonal, so quantization can never
+      flip a box from inside to clear. */
+  struct MaskDistanceField
+  {
+    MaskDistanceField() : resolution(0.0), valid(false)
+    {
+      dims[0] = dims[1] = dims[2] = 0;
+    }
+
+    tf::Vector3 origin;
+    double resolution;
+    unsigned int dims[3];
+    std::vector<unsigned char> cells;
+
+    /** \brief False when the body set was too large to grid; masking
+        then falls back to the exact path for every box */
+    bool valid;
+  };
+
+  MaskDistanceField mask_field_;
+
+  /** \brief Set whenever a maskable body is added, removed or moved;
+      the field is rebuilt lazily at the next mask */
+  bool mask_field_dirty_;
+
+  /** \brief Rebuild mask_field_ from the current bounding spheres;
+      the caller must hold bodies_lock_ */
+  void rebuildMaskField();
+
+  /** \brief True when the point is definitely outside every maskable
+      body according to the field; the caller must hold bodies_lock_ */
+  bool maskFieldClear(const tf::Vector3& pt) const;
+
   void loadCollisionFromParamServer();
+
+  /** \brief Fetch the collision configuration - default collision
+      operations, padding values, link padding overrides and bounding
+      planes - from the parameter server. Touches no model state, so
+      the constructor runs it on a worker while the kinematic model
+      builds. */
+  void loadCollisionConfigurationFromParamServer();
+
+  /** \brief Create the collision environment backend and set the
+      robot model on it. Requires the kinematic model and the fetched
+      collision configuration. */
+  void createCollisionEnvironmentFromParamServer();
+
   void setupModelFromParamServer(collision_space::EnvironmentModel* model);
+
+  /** \brief Get the calling thread's clone of the collision
+      environment for read-only queries, re-cloning under the
+      master's lock only when its modification epoch moved. Robot
+      state updates on the clone are thread-local. */
+  collision_space::EnvironmentModel* getThreadQueryEnvironment();
+
+  /** \brief Bumps the process-wide collision query counter. */
+  static void countCollisionCheck();
+
+  /** \brief Worker for the parallel trajectory validation path -
+      checks waypoints [start, end) on its own kinematic state,
+      starting from the base values, and records per-point error
+      codes. Sets the shared abort flag on the first invalid point
+      and gives up once any worker has set it; a NULL flag means the
+      whole range is always checked. */
+  void checkJointTrajectoryRange(const trajectory_msgs::JointTrajectory& trajectory,
+                                 const arm_navigation_msgs::Constraints& path_constraints,
+                                 const std::map<std::string, double>& base_values,
+                                 unsigned int start,
+                                 unsigned int end,
+                                 std::vector<arm_navigation_msgs::ArmNavigationErrorCodes>& trajectory_error_codes,
+                                 volatile bool* abort);
+
+  /** \brief One thread's query clone, plus the master it was cloned
+      from and the epoch it was taken at. The master pointer is kept
+      so a swapped-in environment forces a re-clone even if its epoch
+      happens to match the old one. Also carries the thread's memo of
+      collision verdicts keyed by state hash - valid as long as the
+      clone is, so it empties whenever the clone is refreshed - and a
+      reusable flat-state buffer for computing the hashes. */
+  struct QueryEnvironment
+  {
+    ~QueryEnvironment()
+    {
+      delete env;
+    }
+
+    collision_space::EnvironmentModel* env;
+    const collision_space::EnvironmentModel* master;
+    unsigned long epoch;
+    std::map<unsigned long long, bool> collision_verdicts;
+    std::vector<double> state_values;
+  };
+
+  boost::thread_specific_ptr<QueryEnvironment> thread_query_env_;
+
+  /** \brief One pooled clone: the environment, the master it was
+      cloned from and the epoch it was cloned at, so staleness is
+      detected the same way the per-thread query clones do it. */
+  struct ClonePoolEntry
+  {
+    collision_space::EnvironmentModel* env;
+    const collision_space::EnvironmentModel* master;
+    unsigned long epoch;
+    bool checked_out;
+  };
+
+  /** \brief Refresh the entry's clone from the current master if its
+      generation is stale; the caller must hold clone_pools_lock_. */
+  void refreshClonePoolEntry(ClonePoolEntry& entry);
+
+  std::map<std::string, std::vector<ClonePoolEntry> > clone_pools_;
+  boost::mutex clone_pools_lock_;
+
+  /** \brief Hash identifying an ordered collision operations request
+      against the current environment - covers the serialized
+      operations, the object and attached object names set operations
+      expand to, the link names of any model group an operation
+      references, and the contents of the default matrix the
+      operations are applied on top of. */
+  unsigned long long makeOrderedCollisionOperationsKey(const arm_navigation_msgs::OrderedCollisionOperations& ord,
+                                                       const std::vector<std::string>& object_names,
+                                                       const std::vector<std::string>& att_names) const;
+
+  /** \brief Small LRU cache of altered matrices computed from
+      ordered collision operations, most recently used first. Clients
+      tend to resend the same few operation lists, so a hit skips
+      recomputing the matrix, and a repeat of the operations applied
+      last - with nothing else having touched the environment since -
+      skips the application entirely. */
+  struct OrderedOperationsCacheEntry
+  {
+    unsigned long long key;
+    collision_space::EnvironmentModel::AllowedCollisionMatrix acm;
+  };
+  std::list<OrderedOperationsCacheEntry> ordered_operations_acm_cache_;
+  unsigned long long last_applied_operations_key_;
+  unsigned long last_applied_operations_epoch_;
 	
   collision_space::EnvironmentModel* ode_collision_model_;
 
   bool planning_scene_set_;
 
+  /** \brief The scene currently applied, plus the converted object
+      messages it resulted in, kept so applyPlanningSceneDiff() can
+      tell what actually changed */
+  arm_navigation_msgs::PlanningScene last_planning_scene_;
+  std::vector<arm_navigation_msgs::CollisionObject> last_scene_objects_;
+  std::vector<arm_navigation_msgs::AttachedCollisionObject> last_scene_attached_objects_;
+
   double default_scale_;
   double default_padd_;
   double object_padd_;
@@ -489,6 +793,11 @@ protected:
 
   std::vector<arm_navigation_msgs::CollisionOperation> default_collision_operations_;
 
+  /** \brief Per-link padding overrides from the ~link_padding param,
+      applied on top of the default padding when the robot model is
+      set on an environment */
+  std::map<std::string, double> configured_link_padding_;
+
   std::map<std::string, geometry_msgs::TransformStamped> scene_transform_map_;
 
 };
@@ -55,14 +55,26 @@ public:
   // Constructors
   //
 	
-  CollisionModelsInterface(const std::string &description, bool register_with_server = true);
+  /** \brief When \e kinematics_only is true the underlying models are
+      loaded without geometry or a collision environment (see
+      CollisionModels); combine with register_with_server = false so no
+      planning scene syncs arrive that would touch collision space. */
+  CollisionModelsInterface(const std::string &description, bool register_with_server = true, bool kinematics_only = false);
 
   virtual ~CollisionModelsInterface(void);
  
   void syncPlanningSceneCallback(const arm_navigation_msgs::SyncPlanningSceneGoalConstPtr& scene);
 
   bool setPlanningSceneWithCallbacks(const arm_navigation_msgs::PlanningScene& scene);
-  
+
+  /** \brief When enabled, incoming scenes are built into a shadow
+      environment and swapped in atomically, so queries keep
+      answering against the old scene for the duration of the build
+      instead of blocking on the bodies lock. Off by default. */
+  void setUseDoubleBufferedSceneSync(bool use) {
+    use_double_buffered_sync_ = use;
+  }
+
   void addSetPlanningSceneCallback(const boost::function<void(const arm_navigation_msgs::PlanningScene &scene)> &callback)
   {
     set_planning_scene_callback_ = callback;
@@ -89,8 +101,23 @@ public:
   
 protected:
 
+  /** \brief Build the scene into a shadow CollisionModels without
+      holding the bodies lock, then swap it in and run the
+      callbacks. Returns false if the scene could not be set. */
+  bool setPlanningSceneDoubleBuffered(const arm_navigation_msgs::PlanningScene& planning_scene);
+
+  /** \brief Overlay the components flagged in a diff goal onto a copy
+      of the last applied scene */
+  void applySceneDiff(const arm_navigation_msgs::SyncPlanningSceneGoal& goal,
+                      arm_navigation_msgs::PlanningScene& scene) const;
+
   planning_models::KinematicState* planning_scene_state_;
-  arm_navigation_msgs::PlanningScene last_planning_scene_;
+
+  /** version of the last scene applied through the sync action; 0
+      when no scene is cached, which makes the server send keyframes */
+  unsigned int last_scene_version_;
+
+  bool use_double_buffered_sync_;
 
   boost::function<void(const arm_navigation_msgs::PlanningScene &scene)> set_planning_scene_callback_;
   boost::function<void(void)> revert_planning_scene_callback_;
@@ -46,6 +46,7 @@
 #include <planning_environment/util/kinematic_state_constraint_evaluator.h>
 #include <arm_navigation_msgs/Shape.h>
 #include <visualization_msgs/Marker.h>
+#include <visualization_msgs/MarkerArray.h>
 #include <arm_navigation_msgs/LinkPadding.h>
 #include <collision_space/environment.h>
 #include <arm_navigation_msgs/AllowedCollisionMatrix.h>
@@ -53,10 +54,20 @@
 
 namespace planning_environment {
 
-//returns true if the joint_state_map sets all the joints in the state, 
+//returns true if the joint_state_map sets all the joints in the state,
 bool setRobotStateAndComputeTransforms(const arm_navigation_msgs::RobotState &robot_state,
                                        planning_models::KinematicState& state);
 
+//group-scoped variant - applies only the joints belonging to the named
+//group and recomputes transforms over the group's updated-links list
+//instead of running forward kinematics for the whole robot. Falls back
+//to the full-state version when the group does not exist or the message
+//carries multi-dof transforms, since those move links outside any group.
+//Returns true if the message covered every joint in the group
+bool setRobotStateAndComputeGroupTransforms(const arm_navigation_msgs::RobotState &robot_state,
+                                            const std::string& group_name,
+                                            planning_models::KinematicState& state);
+
 void convertKinematicStateToRobotState(const planning_models::KinematicState& kinematic_state,
                                        const ros::Time& timestamp,
                                        const std::string& header_frame,
@@ -105,5 +116,80 @@ void getCollisionMarkersFromContactInformation(const std::vector<arm_navigation_
                                                visualization_msgs::MarkerArray& arr,
                                                const std_msgs::ColorRGBA& color,
                                                const ros::Duration& lifetime);
+
+/** \brief Preallocated pool of collision point markers for
+    continuous visualization. fill() produces the same markers
+    getCollisionMarkersFromContactInformation produces, but writes
+    them into retained Marker objects - the namespace strings, headers
+    and the array itself keep their storage across cycles - so marker
+    generation stops allocating once the pool has grown to the contact
+    high-water mark. Slots live last cycle but not this one go out
+    once as DELETE markers for the ids they last carried, which also
+    clears them from displays without waiting for lifetime expiry. */
+class CollisionMarkerPool
+{
+public:
+  CollisionMarkerPool() : last_live_(0)
+  {
+  }
+
+  /** \brief Scratch contact storage, retained across cycles; fill()
+      reads whatever the caller put here */
+  std::vector<arm_navigation_msgs::ContactInformation>& contacts()
+  {
+    return contacts_;
+  }
+
+  /** \brief Rebuild the marker array from contacts(). The returned
+      array references pooled storage and is valid until the next
+      fill. */
+  const visualization_msgs::MarkerArray& fill(const std::string& world_frame_id,
+                                              const std_msgs::ColorRGBA& color,
+                                              const ros::Duration& lifetime);
+
+private:
+  std::vector<arm_navigation_msgs::ContactInformation> contacts_;
+
+  /** \brief Per-namespace id counters; kept across fills so steady
+      contact pairs don't reallocate map nodes */
+  std::map<std::string, unsigned int> ns_counts_;
+  std::string ns_scratch_;
+  visualization_msgs::MarkerArray arr_;
+  unsigned int last_live_;
+};
+
+/** \brief Publishes collision point markers as diffs against the set
+    published the cycle before. Unchanged markers are not re-sent and
+    markers that disappeared are deleted explicitly, so a steady
+    contact set costs almost nothing per cycle. Markers are published
+    with zero lifetime - explicit deletion replaces expiry - and the
+    outgoing message keeps its storage between cycles. */
+class ContactMarkerPublisher
+{
+public:
+  ContactMarkerPublisher(ros::NodeHandle& nh,
+                         const std::string& topic,
+                         unsigned int queue_size = 128);
+
+  /** \brief Publish markers for the given contacts, named and
+      numbered the way getCollisionMarkersFromContactInformation names
+      them. Only markers that moved, changed color, appeared or
+      disappeared since the last call go out on the wire. */
+  void publishMarkers(const std::vector<arm_navigation_msgs::ContactInformation>& contacts,
+                      const std::string& world_frame_id,
+                      const std_msgs::ColorRGBA& color);
+
+private:
+  ros::Publisher marker_publisher_;
+
+  /** \brief Positions published last cycle, per contact pair
+      namespace, indexed by marker id */
+  std::map<std::string, std::vector<geometry_msgs::Point> > last_published_;
+  std_msgs::ColorRGBA last_color_;
+
+  /** \brief Reused outgoing message, so steady-state publishing does
+      not allocate */
+  visualization_msgs::MarkerArray diff_;
+};
 }
 #endif
@@ -40,6 +40,7 @@
 #include <planning_models/kinematic_model.h>
 #include <ros/ros.h>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include <map>
 #include <string>
@@ -111,7 +112,15 @@ public:
   }
 
 protected:
-	
+
+  /** \brief Construct without loading the model, so a derived class
+      can overlap the model build with its own setup. The derived
+      constructor must call loadRobotFromParamServer itself. When
+      \e load_geometry is false the kinematic model is built without
+      link shapes, skipping mesh parsing entirely - for consumers that
+      only do kinematics and never touch geometry. */
+  RobotModels(const std::string &description, bool load_robot_model, bool load_geometry = true);
+
   void loadRobotFromParamServer(void);
 
   bool loadMultiDofConfigsFromParamServer(std::vector<planning_models::KinematicModel::MultiDofConfig>& configs);
@@ -120,13 +129,38 @@ protected:
 	
   ros::NodeHandle nh_;
   ros::NodeHandle priv_nh_;
-	  
+
   std::string description_;
-	
+
   bool loaded_models_;
+  bool load_geometry_;
   planning_models::KinematicModel* kmodel_;
-  
-  boost::shared_ptr<urdf::Model> urdf_;  
+
+  boost::shared_ptr<urdf::Model> urdf_;
+
+private:
+
+  /** \brief Process-wide cache of parsed descriptions and built
+      models, keyed by a hash of the description content and the
+      planning configs. A node typically constructs several
+      RobotModels (directly and through CollisionModels), and without
+      the cache each one re-parses the URDF, re-loads the meshes and
+      re-runs group construction. The parsed urdf::Model is shared
+      between instances; the kinematic model is copied from the cached
+      prototype, since attached bodies modify it per instance. */
+  struct ModelCacheEntry
+  {
+    boost::shared_ptr<urdf::Model> urdf;
+    boost::shared_ptr<planning_models::KinematicModel> kmodel;
+  };
+
+  static std::string makeModelCacheKey(const std::string& content,
+                                       const std::vector<planning_models::KinematicModel::MultiDofConfig>& multi_dof_configs,
+                                       const std::vector<planning_models::KinematicModel::GroupConfig>& group_configs,
+                                       bool load_geometry);
+
+  static std::map<std::string, ModelCacheEntry> model_cache_;
+  static boost::mutex model_cache_lock_;
 };
     
 }
@@ -40,6 +40,7 @@
 #include <planning_environment/models/collision_models.h>
 #include <planning_environment/monitors/kinematic_model_state_monitor.h>
 #include <arm_navigation_msgs/CollisionMap.h>
+#include <arm_navigation_msgs/CollisionMapDelta.h>
 #include <arm_navigation_msgs/CollisionObject.h>
 #include <arm_navigation_msgs/AttachedCollisionObject.h>
 #include <boost/thread/mutex.hpp>
@@ -75,6 +76,10 @@ public:
       delete collisionMapUpdateFilter_;
     if (collisionMapUpdateSubscriber_)
       delete collisionMapUpdateSubscriber_;
+    if (collisionMapDeltaFilter_)
+      delete collisionMapDeltaFilter_;
+    if (collisionMapDeltaSubscriber_)
+      delete collisionMapDeltaSubscriber_;
     if (attachedCollisionObjectSubscriber_)
       delete attachedCollisionObjectSubscriber_;
 
@@ -142,6 +147,7 @@ protected:
                            std::vector<shapes::Shape*> &boxes, std::vector<tf::Transform> &poses);
   void collisionMapCallback(const arm_navigation_msgs::CollisionMapConstPtr &collisionMap);
   void collisionMapUpdateCallback(const arm_navigation_msgs::CollisionMapConstPtr &collisionMap);
+  void collisionMapDeltaCallback(const arm_navigation_msgs::CollisionMapDeltaConstPtr &delta);
   void collisionObjectCallback(const arm_navigation_msgs::CollisionObjectConstPtr &collisionObject);
   virtual bool attachObjectCallback(const arm_navigation_msgs::AttachedCollisionObjectConstPtr &attachedObject);
 
@@ -157,6 +163,8 @@ protected:
   tf::MessageFilter<arm_navigation_msgs::CollisionMap> *collisionMapFilter_;
   message_filters::Subscriber<arm_navigation_msgs::CollisionMap> *collisionMapUpdateSubscriber_;
   tf::MessageFilter<arm_navigation_msgs::CollisionMap> *collisionMapUpdateFilter_;
+  message_filters::Subscriber<arm_navigation_msgs::CollisionMapDelta> *collisionMapDeltaSubscriber_;
+  tf::MessageFilter<arm_navigation_msgs::CollisionMapDelta> *collisionMapDeltaFilter_;
   message_filters::Subscriber<arm_navigation_msgs::CollisionObject> *collisionObjectSubscriber_;
   tf::MessageFilter<arm_navigation_msgs::CollisionObject> *collisionObjectFilter_;
 
@@ -164,6 +172,12 @@ protected:
 
   bool use_collision_map_;
 
+  /** \brief Voxels accumulated from collision map delta messages,
+      keyed by quantized center so additions and removals from
+      successive deltas line up */
+  std::map<long long, geometry_msgs::Point32> delta_map_voxels_;
+  std::string delta_map_frame_;
+
   boost::recursive_mutex collision_map_lock_;
 };
     
@@ -61,10 +61,28 @@ namespace planning_environment
     sensor_msgs::JointState getJointState();
     sensor_msgs::JointState getJointStateRealJoints();
     sensor_msgs::JointState getJointState(std::vector<std::string> names);
+
+    /** \brief Interpolate the monitored state at the given time from
+        the ring buffer of recent samples. Continuous joints are
+        interpolated along the shortest arc. Returns false if no
+        samples have been received or the time is older than the
+        oldest buffered sample; times newer than the latest sample
+        return the latest sample. */
+    bool getInterpolatedState(const ros::Time& time, sensor_msgs::JointState& joint_state);
+
     ros::Time last_update_;
     bool active_;
 
     private:
+
+    /** \brief One ring buffer slot - a sample's timestamp and its
+        joint positions in joint_state_ order */
+    struct TimedJointValues
+    {
+      ros::Time stamp;
+      std::vector<double> position;
+    };
+
     ros::Subscriber joint_state_subscriber_;
     bool state_monitor_started_;
     bool first_time_;
@@ -75,6 +93,14 @@ namespace planning_environment
     ros::NodeHandle root_handle_;
     std::vector<int> joint_real_state_index_;
     urdf::Model robot_model_;
+
+    /** \brief Fixed-size ring of recent samples, sized by the
+        ~joint_state_buffer_size parameter and preallocated at
+        construction so the callback never allocates */
+    std::vector<TimedJointValues> joint_state_ring_;
+    unsigned int ring_head_;
+    unsigned int ring_count_;
+    std::vector<bool> joint_continuous_;
   };
 
 }
@@ -140,7 +140,10 @@ public:
   /** \brief Output the current state as ROS INFO */
   void printRobotState(void) const;
   
-  /** \brief Sets the model used for collision/valditity checking to the current state values*/
+  /** \brief Sets the model used for collision/valditity checking to
+      the current state values. Reads from the latest snapshot buffer
+      without locking, so planner threads never stall behind the
+      joint state callback. */
   void setStateValuesFromCurrentValues(planning_models::KinematicState& state) const;
 
   bool getCurrentRobotState(arm_navigation_msgs::RobotState &robot_state) const;
@@ -172,6 +175,27 @@ protected:
 
   mutable boost::recursive_mutex current_joint_values_lock_;
 
+  /** \brief One buffer of the latest-state snapshot. The sequence
+      counter is odd while the subscriber is writing the buffer and
+      even once it is stable; it starts at zero, which marks a buffer
+      that has never been written. */
+  struct StateSnapshotBuffer
+  {
+    volatile unsigned int sequence;
+    std::vector<double> values;
+  };
+
+  /** \brief Triple buffer holding flat copies of the full state in
+      setKinematicState() order. The subscriber writes each update
+      into the next buffer round-robin, bumping its sequence counter
+      around the write, then publishes the buffer index; readers copy
+      from the published buffer and retry if its counter moved, so
+      neither side ever blocks the other. The buffers are reserved to
+      the state dimension up front so the vectors never reallocate
+      under a concurrent reader. */
+  StateSnapshotBuffer state_snapshot_buffers_[3];
+  volatile unsigned int latest_snapshot_index_;
+
   double joint_state_cache_time_;
   double joint_state_cache_allowed_difference_;
 
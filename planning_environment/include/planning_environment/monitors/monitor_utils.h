@@ -49,6 +49,7 @@
 #include <pcl/point_types.h>
 #include <sensor_msgs/JointState.h>
 #include <trajectory_msgs/JointTrajectory.h>
+#include <boost/thread/mutex.hpp>
 
 namespace planning_environment 
 {
@@ -56,7 +57,33 @@ namespace planning_environment
 bool getLatestIdentityTransform(const std::string& to_frame,
                                 const std::string& from_frame,
                                 tf::TransformListener& tf,
-                                tf::Transform& pose); 
+                                tf::Transform& pose);
+
+/** \brief One entry of a batched transform lookup; a zero stamp
+    requests the latest common time of the pair */
+struct TransformLookup
+{
+  TransformLookup(void) : ok(false)
+  {
+  }
+
+  std::string target_frame;
+  std::string source_frame;
+  ros::Time stamp;
+  bool ok;
+  tf::StampedTransform transform;
+};
+
+/** \brief Resolve a set of transform lookups in one pass. The whole
+    set shares a single deadline - polling availability is cheap -
+    instead of each pair burning a full timeout on its own, and the
+    lookups then run back to back so the listener's lock is taken in
+    one short burst rather than once per frame per cloud. Entries
+    that cannot be resolved keep ok false. Returns the number of
+    entries resolved */
+unsigned int lookupTransformsBatch(const tf::TransformListener& tf,
+                                   std::vector<TransformLookup>& lookups,
+                                   const ros::Duration& timeout = ros::Duration(0, 0));
 
 bool createAndPoseShapes(tf::TransformListener& tf, 
                          const std::vector<arm_navigation_msgs::Shape>& orig_shapes,
@@ -96,9 +123,76 @@ bool configureForAttachedBodyMask(planning_models::KinematicState& state,
                                   tf::Vector3& sensor_pos);
 
 int computeAttachedObjectPointMask(const planning_environment::CollisionModels* cm,
-                                   const tf::Vector3 &pt, 
+                                   const tf::Vector3 &pt,
                                    const tf::Vector3 &sensor_pos);
 
+/** \brief Shared cache of posed attached-object bodies for filters
+    running in the same process. Body poses are updated once per
+    sensor timestamp - every consumer masking a cloud with the same
+    stamp reuses the update instead of re-running the transform
+    lookups and body pose updates - and the kinematic state is kept
+    across clouds instead of being rebuilt for each one. */
+class SharedBodyCache
+{
+public:
+  SharedBodyCache(CollisionModels* cm, tf::TransformListener& tf);
+
+  /** \brief Make sure the attached bodies are posed for the given
+      timestamp, updating them only if the stamp or sensor frame
+      differs from the last call, and return the sensor position.
+      Consumers can then mask points through
+      computeAttachedObjectPointMask. */
+  bool prepareForStamp(const std::string& sensor_frame,
+                       const ros::Time& stamp,
+                       tf::Vector3& sensor_pos);
+
+  /** \brief Mask a cloud against the attached bodies, reusing the
+      body poses if another consumer already prepared this stamp */
+  bool computePointCloudMask(const pcl::PointCloud<pcl::PointXYZ>& pcl_cloud,
+                             const std::string& sensor_frame,
+                             std::vector<int>& mask);
+
+private:
+  CollisionModels* cm_;
+  tf::TransformListener& tf_;
+  planning_models::KinematicState state_;
+  ros::Time last_stamp_;
+  std::string last_sensor_frame_;
+  tf::Vector3 last_sensor_pos_;
+  unsigned long last_scene_version_;
+  bool have_last_update_;
+  boost::mutex cache_lock_;
+};
+
+
+/** \brief Applies joint trajectory points to a kinematic state
+    without per-point name resolution. The trajectory's joint name
+    ordering is resolved against the state's joint states once at
+    construction; each point is then applied as a flat copy of its
+    positions followed by one forward kinematics update. Falls invalid
+    if a name is unknown or names a multi-dof joint, in which case the
+    caller should keep the string-keyed path. */
+class TrajectoryStateApplicator
+{
+public:
+  TrajectoryStateApplicator(planning_models::KinematicState& state,
+                            const std::vector<std::string>& joint_names);
+
+  bool isValid() const
+  {
+    return valid_;
+  }
+
+  /** \brief Set the resolved joints from the point's positions and
+      recompute the link transforms; false if the applicator is
+      invalid or the point's size doesn't match the resolved names */
+  bool applyPoint(const trajectory_msgs::JointTrajectoryPoint& point);
+
+private:
+  planning_models::KinematicState& state_;
+  std::vector<planning_models::KinematicState::JointState*> joints_;
+  bool valid_;
+};
 
 int closestStateOnTrajectory(const boost::shared_ptr<urdf::Model> &model,
                              const trajectory_msgs::JointTrajectory &trajectory, 
@@ -161,8 +161,18 @@ protected:
   void accumulateAdjacentLinksRecursive(const planning_models::KinematicModel::LinkModel* parent,
                                         std::vector<StringPair>& adjacencies);
 
+  /** \brief Test num random states and accumulate per-pair collision
+      counts, spreading the states over a pool of worker threads. Each
+      worker samples through its own per-thread clone of the
+      environment, so the only shared work is merging the counters. */
   void sampleAndCountCollisions(unsigned int num);
 
+  /** \brief Worker for sampleAndCountCollisions - samples num states
+      into the given counter and joint value maps */
+  void sampleAndCountCollisionsRange(unsigned int num,
+                                     std::map<std::string, std::map<std::string, unsigned int> >& counts,
+                                     std::map<std::string, std::map<std::string, CollidingJointValues> >& joint_values);
+
   void buildOutputStructures(unsigned int num, double low_value, double high_value, 
                              std::vector<StringPair>& meets_threshold_collision,
                              std::vector<double>& collision_percentages, 
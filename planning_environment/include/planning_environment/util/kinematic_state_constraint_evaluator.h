@@ -69,10 +69,26 @@ public:
   /** \brief Clear the stored constraint */
   virtual void clear(void) = 0;
 
+  /** \brief Resolve name lookups against the layout of the given
+      state, so decide() runs without string maps. The resolved
+      indices stay valid for any state built on the same kinematic
+      model; decide() falls back to name lookups when this was not
+      called. */
+  virtual void compile(const planning_models::KinematicState* state)
+  {
+  }
+
   /** \brief Decide whether the constraint is satisfied in the indicated state or group, if specified */
   virtual bool decide(const planning_models::KinematicState *state,
                       bool verbose=false) const = 0;
 
+  /** \brief Rough cost of one decide() call relative to a joint
+      bounds check, used to order evaluation within a set */
+  virtual double relativeCost(void) const
+  {
+    return 1.0;
+  }
+
   /** \brief Print the constraint data */
   virtual void print(std::ostream &out = std::cout) const
   {
@@ -86,11 +102,15 @@ public:
   JointConstraintEvaluator(void) : KinematicConstraintEvaluator()
   {
     m_joint = NULL;
+    m_joint_index = -1;
+    m_continuous = false;
   }
-	
+
   /** \brief This function assumes the constraint has been transformed into the proper frame, if such a transform is needed */
   bool use(const arm_navigation_msgs::JointConstraint &jc);
 
+  virtual void compile(const planning_models::KinematicState* state);
+
   /** \brief Decide whether the constraint is satisfied in the indicated state or group, if specified */
   virtual bool decide(const planning_models::KinematicState  *state,
                       bool verbose=false) const;
@@ -107,7 +127,12 @@ public:
 protected:
 	
   arm_navigation_msgs::JointConstraint         m_jc;
-  const planning_models::KinematicModel::JointModel *m_joint;    
+  const planning_models::KinematicModel::JointModel *m_joint;
+
+  /** \brief Position of the joint in the state vectors, resolved by
+      compile(); -1 before compilation */
+  int m_joint_index;
+  bool m_continuous;
 };
     
 	
@@ -117,18 +142,26 @@ public:
 	
   OrientationConstraintEvaluator(void) : KinematicConstraintEvaluator()
   {
+    m_link_index = -1;
   }
-	
+
   /** \brief This function assumes the constraint has been transformed into the proper frame, if such a transform is needed */
   bool use(const arm_navigation_msgs::OrientationConstraint &pc);
 
+  virtual void compile(const planning_models::KinematicState* state);
+
   /** \brief Clear the stored constraint */
   virtual void clear(void);
 	
   /** \brief Decide whether the constraint is satisfied in the indicated state or group, if specified */
-  virtual bool decide(const planning_models::KinematicState* state, 
+  virtual bool decide(const planning_models::KinematicState* state,
                       bool verbose=false) const;
 
+  virtual double relativeCost(void) const
+  {
+    return 10.0;
+  }
+
   /** \brief Evaluate the distances to the position and to the orientation are given. */
   void evaluate(const planning_models::KinematicState* state, double &distAng, bool verbose=false) const;
   
@@ -146,8 +179,15 @@ protected:
   arm_navigation_msgs::OrientationConstraint  m_oc;
   double m_roll, m_pitch, m_yaw;
   tf::Matrix3x3 m_rotation_matrix;
+
+  /** \brief Inverse of m_rotation_matrix, cached so decide() does
+      not invert per state */
+  tf::Matrix3x3 m_rotation_matrix_inverse;
   boost::scoped_ptr<bodies::Body> m_constraint_region;
-	
+
+  /** \brief Position of the link in the state vectors, resolved by
+      compile(); -1 before compilation */
+  int m_link_index;
 };
 
 class VisibilityConstraintEvaluator : public KinematicConstraintEvaluator
@@ -156,11 +196,14 @@ public:
 	
   VisibilityConstraintEvaluator(void) : KinematicConstraintEvaluator()
   {
+    m_link_index = -1;
   }
-	
+
   /** \brief This function assumes the constraint has been transformed into the proper frame, if such a transform is needed */
   bool use(const arm_navigation_msgs::VisibilityConstraint &vc);
 
+  virtual void compile(const planning_models::KinematicState* state);
+
   /** \brief Clear the stored constraint */
   virtual void clear(void);
 	
@@ -168,15 +211,29 @@ public:
   virtual bool decide(const planning_models::KinematicState* state,
                       bool verbose=false) const;
 
+  virtual double relativeCost(void) const
+  {
+    return 50.0;
+  }
+
   /** \brief Print the constraint data */
   void print(std::ostream &out = std::cout) const;
 
   /** \brief Get the constraint message */
   const arm_navigation_msgs::VisibilityConstraint& getConstraintMessage(void) const;
 	
-protected:	
+protected:
   arm_navigation_msgs::VisibilityConstraint  m_vc;
   tf::Transform m_sensor_offset_pose;
+
+  /** \brief Target point and cosine of the cone half-angle, cached
+      by use() so decide() is a transform compose and a dot product */
+  tf::Vector3 m_target;
+  double m_cos_tolerance;
+
+  /** \brief Position of the sensor link in the state vectors,
+      resolved by compile(); -1 before compilation */
+  int m_link_index;
 };
 
 class PositionConstraintEvaluator : public KinematicConstraintEvaluator
@@ -185,11 +242,14 @@ public:
 	
   PositionConstraintEvaluator(void) : KinematicConstraintEvaluator()
   {
+    m_link_index = -1;
   }
-	
+
   /** \brief This function assumes the constraint has been transformed into the proper frame, if such a transform is needed */
   bool use(const arm_navigation_msgs::PositionConstraint &pc);
 
+  virtual void compile(const planning_models::KinematicState* state);
+
   /** \brief Clear the stored constraint */
   virtual void clear(void);
 	
@@ -197,6 +257,11 @@ public:
   virtual bool decide(const planning_models::KinematicState* state,
                       bool verbose=false) const;
 
+  virtual double relativeCost(void) const
+  {
+    return 10.0;
+  }
+
   /** \brief Evaluate the distances to the position and to the orientation are given. */
   void evaluate(const planning_models::KinematicState* state, double& distPos, bool verbose=false) const;
 	
@@ -215,6 +280,10 @@ protected:
   double                                       m_x, m_y, m_z;
   tf::Vector3                                    m_offset;
   boost::scoped_ptr<bodies::Body> m_constraint_region;
+
+  /** \brief Position of the link in the state vectors, resolved by
+      compile(); -1 before compilation */
+  int m_link_index;
 };
         
 class KinematicConstraintEvaluatorSet
@@ -244,7 +313,13 @@ public:
 
   /** \brief Add a set of orientation constraints */
   bool add(const std::vector<arm_navigation_msgs::VisibilityConstraint> &pc);
-	
+
+  /** \brief Resolve every evaluator's name lookups against the
+      layout of the given state once, so each decide() call is a
+      flat walk with index lookups only. Call after the last add();
+      the set then works with any state built on the same model. */
+  void compile(const planning_models::KinematicState* state);
+
   /** \brief Decide whether the set of constraints is satisfied  */
   bool decide(const planning_models::KinematicState* state,
               bool verbose=false) const;
@@ -271,13 +346,30 @@ public:
   }
 	
 protected:
-	
+
+  /** \brief Re-sort m_order so cheap, frequently rejecting
+      evaluators run first. Only called from compile(), which runs
+      once per request before solving starts, so parallel decide()
+      calls never see the order change. */
+  void reorder(void);
+
   std::vector<KinematicConstraintEvaluator*>         m_kce;
   std::vector<arm_navigation_msgs::JointConstraint> m_jc;
 
   std::vector<arm_navigation_msgs::PositionConstraint>  m_pc;
   std::vector<arm_navigation_msgs::OrientationConstraint>  m_oc;
   std::vector<arm_navigation_msgs::VisibilityConstraint> m_vc;
+
+  /** \brief Indices into m_kce in the order decide() evaluates
+      them; registration order until reorder() learns a better one */
+  std::vector<unsigned int> m_order;
+
+  /** \brief Per-evaluator decide() call and rejection counts,
+      bumped from the const decide(). Updates may race under
+      parallel planners; the counts only steer reorder(), so a lost
+      increment is harmless. */
+  mutable std::vector<unsigned long> m_calls;
+  mutable std::vector<unsigned long> m_rejections;
 };
 } // planning_environment
 
@@ -36,8 +36,10 @@
 
 #include "planning_environment/models/collision_models.h"
 #include "planning_environment/models/model_utils.h"
+#include "planning_environment/monitors/monitor_utils.h"
 #include "planning_environment/util/construct_object.h"
 #include <collision_space/environmentODE.h>
+#include <collision_space/environmentBullet.h>
 #include <sstream>
 #include <vector>
 #include <geometric_shapes/shape_operations.h>
@@ -45,25 +47,188 @@
 #include <boost/foreach.hpp>
 #include <rosbag/bag.h>
 #include <rosbag/view.h>
+#include <ros/serialization.h>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+
+static const unsigned int MAX_ORDERED_OPERATIONS_ACM_CACHE_SIZE = 8;
+static const unsigned int MIN_TRAJECTORY_POINTS_PER_VALIDATION_THREAD = 32;
+static const unsigned int MAX_COLLISION_VERDICT_CACHE_SIZE = 128;
+static const unsigned int MAX_CLONE_POOL_SIZE_PER_GROUP = 8;
+//cap on the contacts gathered for verbose collision diagnostics -
+//deeply penetrating states can produce thousands of contacts, and a
+//handful is enough to tell what is hitting what
+static const unsigned int MAX_VERBOSE_COLLISION_CONTACTS = 10;
 
 inline static std::string stripTFPrefix(const std::string& s) {
-  
+
   if(s.find_last_of('/') == std::string::npos) {
     return s;
   }
   return s.substr(s.find_last_of('/')+1);
 }
 
-planning_environment::CollisionModels::CollisionModels(const std::string &description) : RobotModels(description)
+namespace {
+
+//byte-wise comparison through serialization, so messages (and vectors
+//of messages) compare without per-field code
+template<typename M>
+bool messagesEqual(const M& a, const M& b)
+{
+  uint32_t length = ros::serialization::serializationLength(a);
+  if(length != ros::serialization::serializationLength(b)) {
+    return false;
+  }
+  if(length == 0) {
+    return true;
+  }
+  std::vector<uint8_t> buffer_a(length);
+  std::vector<uint8_t> buffer_b(length);
+  ros::serialization::OStream stream_a(&buffer_a[0], length);
+  ros::serialization::serialize(stream_a, a);
+  ros::serialization::OStream stream_b(&buffer_b[0], length);
+  ros::serialization::serialize(stream_b, b);
+  return memcmp(&buffer_a[0], &buffer_b[0], length) == 0;
+}
+
+//FNV-1a over raw bytes, for keying the ordered operations ACM cache
+unsigned long long hashBytes(const unsigned char* data, unsigned int length, unsigned long long hash)
+{
+  for(unsigned int i = 0; i < length; i++) {
+    hash = (hash ^ (unsigned long long)data[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+//includes the terminating NUL so adjacent strings cannot alias
+unsigned long long hashString(const std::string& s, unsigned long long hash)
+{
+  return hashBytes((const unsigned char*)s.c_str(), s.size()+1, hash);
+}
+
+//exact cell key for a collision map box - the three center coordinates
+//quantized at the map resolution, packed into 21 bits each
+unsigned long long collisionMapCellKey(const tf::Vector3& center, double resolution)
+{
+  const long long offset = 1 << 20;
+  const long long mask = (1 << 21) - 1;
+  long long ix = ((long long)floor(center.x() / resolution + 0.5) + offset) & mask;
+  long long iy = ((long long)floor(center.y() / resolution + 0.5) + offset) & mask;
+  long long iz = ((long long)floor(center.z() / resolution + 0.5) + offset) & mask;
+  return ((unsigned long long)ix << 42) | ((unsigned long long)iy << 21) | (unsigned long long)iz;
+}
+
+//compiled form of the expanded default collision matrix - the key of
+//the configuration it was expanded from, the entry names in index
+//order and the raw matrix rows. Reading it back skips the per-pair
+//expansion of the default collision operations at launch.
+bool readCompiledCollisionMatrix(const std::string& path,
+                                 unsigned long long key,
+                                 collision_space::EnvironmentModel::AllowedCollisionMatrix& acm)
+{
+  std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+  if(!in) {
+    return false;
+  }
+  unsigned long long stored_key = 0;
+  unsigned int num_entries = 0;
+  in.read((char*)&stored_key, sizeof(stored_key));
+  in.read((char*)&num_entries, sizeof(num_entries));
+  if(!in || stored_key != key || num_entries == 0) {
+    return false;
+  }
+  std::map<std::string, unsigned int> indices;
+  for(unsigned int i = 0; i < num_entries; i++) {
+    unsigned int len = 0;
+    in.read((char*)&len, sizeof(len));
+    if(!in || len == 0 || len > 1024) {
+      return false;
+    }
+    std::string name(len, ' ');
+    in.read(&name[0], len);
+    indices[name] = i;
+  }
+  std::vector<std::vector<bool> > entries(num_entries, std::vector<bool>(num_entries, false));
+  std::vector<char> row(num_entries);
+  for(unsigned int i = 0; i < num_entries; i++) {
+    in.read(&row[0], num_entries);
+    for(unsigned int j = 0; j < num_entries; j++) {
+      entries[i][j] = (row[j] != 0);
+    }
+  }
+  if(!in || indices.size() != num_entries) {
+    return false;
+  }
+  acm = collision_space::EnvironmentModel::AllowedCollisionMatrix(entries, indices);
+  return true;
+}
+
+void writeCompiledCollisionMatrix(const std::string& path,
+                                  unsigned long long key,
+                                  const collision_space::EnvironmentModel::AllowedCollisionMatrix& acm)
+{
+  std::ofstream out(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if(!out) {
+    ROS_WARN_STREAM("Unable to write compiled collision matrix to " << path);
+    return;
+  }
+  std::vector<std::string> names;
+  acm.getAllEntryNames(names);
+  unsigned int num_entries = names.size();
+  out.write((const char*)&key, sizeof(key));
+  out.write((const char*)&num_entries, sizeof(num_entries));
+  for(unsigned int i = 0; i < num_entries; i++) {
+    unsigned int len = names[i].size();
+    out.write((const char*)&len, sizeof(len));
+    out.write(names[i].c_str(), len);
+  }
+  std::vector<char> row(num_entries);
+  for(unsigned int i = 0; i < num_entries; i++) {
+    for(unsigned int j = 0; j < num_entries; j++) {
+      bool allowed = false;
+      acm.getAllowedCollision(i, j, allowed);
+      row[j] = allowed ? 1 : 0;
+    }
+    out.write(&row[0], num_entries);
+  }
+}
+
+}
+
+planning_environment::CollisionModels::CollisionModels(const std::string &description, bool kinematics_only) : RobotModels(description, false, !kinematics_only)
 {
   planning_scene_set_ = false;
-  loadCollisionFromParamServer();
+  last_applied_operations_key_ = 0;
+  last_applied_operations_epoch_ = 0;
+  mask_field_dirty_ = true;
+  if(kinematics_only) {
+    //no link shapes were loaded, so there is nothing to put into a
+    //collision environment; leave it unconstructed
+    ode_collision_model_ = NULL;
+    loadRobotFromParamServer();
+    return;
+  }
+  //the collision configuration lives entirely on the parameter server
+  //and does not touch the kinematic model, so fetch it on a worker
+  //while the model builds - otherwise those roundtrips serialize
+  //behind the URDF parse and mesh loading at every node launch
+  boost::thread config_loader(boost::bind(&CollisionModels::loadCollisionConfigurationFromParamServer, this));
+  loadRobotFromParamServer();
+  config_loader.join();
+  createCollisionEnvironmentFromParamServer();
 }
 
 planning_environment::CollisionModels::CollisionModels(boost::shared_ptr<urdf::Model> urdf,
                                                        planning_models::KinematicModel* kmodel,
                                                        collision_space::EnvironmentModel* ode_collision_model) : RobotModels(urdf, kmodel)
 {
+  last_applied_operations_key_ = 0;
+  last_applied_operations_epoch_ = 0;
+  mask_field_dirty_ = true;
   ode_collision_model_ = ode_collision_model;
 }
 
@@ -72,30 +237,90 @@ planning_environment::CollisionModels::~CollisionModels(void)
   deleteAllStaticObjects();
   deleteAllAttachedObjects();
   shapes::deleteShapeVector(collision_map_shapes_);
+  for(std::map<std::string, std::vector<ClonePoolEntry> >::iterator it = clone_pools_.begin();
+      it != clone_pools_.end();
+      it++) {
+    for(unsigned int i = 0; i < it->second.size(); i++) {
+      if(it->second[i].checked_out) {
+        ROS_WARN_STREAM("Cloned environment for group " << it->first << " still checked out at destruction");
+      }
+      delete it->second[i].env;
+    }
+  }
   delete ode_collision_model_;
 }
 
-void planning_environment::CollisionModels::setupModelFromParamServer(collision_space::EnvironmentModel* model)
+void planning_environment::CollisionModels::loadCollisionConfigurationFromParamServer()
 {
+  nh_.param(description_ + "_planning/default_robot_padding", default_padd_, 0.01);
+  nh_.param(description_ + "_planning/default_robot_scale", default_scale_, 1.0);
+  nh_.param(description_ + "_planning/default_object_padding", object_padd_, 0.02);
+  nh_.param(description_ + "_planning/default_attached_padding", attached_padd_, 0.05);
+
+  configured_link_padding_.clear();
+
+  ros::NodeHandle priv("~");
+
+  if(priv.hasParam("link_padding")) {
+    XmlRpc::XmlRpcValue link_padding_xml;
+    priv.getParam("link_padding", link_padding_xml);
+    if(link_padding_xml.getType() != XmlRpc::XmlRpcValue::TypeArray) {
+      ROS_WARN("link_padding is not an array");
+    } else if(link_padding_xml.size() == 0) {
+      ROS_WARN("No links specified in link_padding");
+    } else {
+      for(int i = 0; i < link_padding_xml.size(); i++) {
+        if(!link_padding_xml[i].hasMember("link") || !link_padding_xml[i].hasMember("padding")) {
+          ROS_WARN("Each entry in link padding must specify a link and a padding");
+          continue;
+        }
+        std::string link = std::string(link_padding_xml[i]["link"]);
+        double padding = link_padding_xml[i]["padding"];
+        //we don't care if this is a group or what, we're shoving it in
+        configured_link_padding_[link] = padding;
+      }
+    }
+  }
+
+  // a list of static planes bounding the environment
+  bounding_planes_.clear();
+
+  std::string planes;
+  nh_.param<std::string>("bounding_planes", planes, std::string());
+
+  std::stringstream ss(planes);
+  if (!planes.empty())
+    while (ss.good() && !ss.eof())
+    {
+      double value;
+      ss >> value;
+      bounding_planes_.push_back(value);
+    }
+  if (bounding_planes_.size() % 4 != 0)
+  {
+    ROS_WARN("~bounding_planes must be a list of 4-tuples (a b c d) that define planes ax+by+cz+d=0");
+    bounding_planes_.resize(bounding_planes_.size() - (bounding_planes_.size() % 4));
+  }
+
   XmlRpc::XmlRpcValue coll_ops;
 
-  //first we do default collision operations
+  //finally the default collision operations
   if(!nh_.hasParam(description_ + "_planning/default_collision_operations")) {
     ROS_WARN("No default collision operations specified");
   } else {
-  
+
     nh_.getParam(description_ + "_planning/default_collision_operations", coll_ops);
-    
+
     if(coll_ops.getType() != XmlRpc::XmlRpcValue::TypeArray) {
       ROS_WARN("default_collision_operations is not an array");
       return;
     }
-    
+
     if(coll_ops.size() == 0) {
       ROS_WARN("No collision operations in default collision operations");
       return;
     }
-    
+
     for(int i = 0; i < coll_ops.size(); i++) {
       if(!coll_ops[i].hasMember("object1") || !coll_ops[i].hasMember("object2") || !coll_ops[i].hasMember("operation")) {
         ROS_WARN("All collision operations must have two objects and an operation");
@@ -116,62 +341,81 @@ void planning_environment::CollisionModels::setupModelFromParamServer(collision_
       default_collision_operations_.push_back(collision_operation);
     }
   }
+}
 
-  nh_.param(description_ + "_planning/default_robot_padding", default_padd_, 0.01);
-  nh_.param(description_ + "_planning/default_robot_scale", default_scale_, 1.0);
-  nh_.param(description_ + "_planning/default_object_padding", object_padd_, 0.02);
-  nh_.param(description_ + "_planning/default_attached_padding", attached_padd_, 0.05);
-
+void planning_environment::CollisionModels::setupModelFromParamServer(collision_space::EnvironmentModel* model)
+{
   const std::vector<planning_models::KinematicModel::LinkModel*>& coll_links = kmodel_->getLinkModelsWithCollisionGeometry();
-  std::map<std::string, double> default_link_padding_map;  
+  std::map<std::string, double> default_link_padding_map;
   std::vector<std::string> coll_names;
   for(unsigned int i = 0; i < coll_links.size(); i++) {
     default_link_padding_map[coll_links[i]->getName()] = default_padd_;
     coll_names.push_back(coll_links[i]->getName());
   }
 
-  ros::NodeHandle priv("~");
+  for(std::map<std::string, double>::const_iterator it = configured_link_padding_.begin();
+      it != configured_link_padding_.end();
+      it++) {
+    default_link_padding_map[it->first] = it->second;
+  }
 
-  if(priv.hasParam("link_padding")) {
-    XmlRpc::XmlRpcValue link_padding_xml;
-    priv.getParam("link_padding", link_padding_xml);
-    if(link_padding_xml.getType() != XmlRpc::XmlRpcValue::TypeArray) {
-      ROS_WARN("link_padding is not an array");
-    } else if(link_padding_xml.size() == 0) {
-      ROS_WARN("No links specified in link_padding");
-    } else {
-      for(int i = 0; i < link_padding_xml.size(); i++) {
-        if(!link_padding_xml[i].hasMember("link") || !link_padding_xml[i].hasMember("padding")) {
-          ROS_WARN("Each entry in link padding must specify a link and a padding");
-          continue;
+  //key identifying the expanded default matrix - the link names, the
+  //default operations and the group expansions they refer to
+  unsigned long long matrix_key = 14695981039346656037ULL;
+  for(unsigned int i = 0; i < coll_names.size(); i++) {
+    matrix_key = hashString(coll_names[i], matrix_key);
+  }
+  for(std::vector<arm_navigation_msgs::CollisionOperation>::iterator it = default_collision_operations_.begin();
+      it != default_collision_operations_.end();
+      it++) {
+    matrix_key = hashString((*it).object1, matrix_key);
+    matrix_key = hashString((*it).object2, matrix_key);
+    matrix_key = hashBytes((const unsigned char*)(&(*it).operation), sizeof((*it).operation), matrix_key);
+    for(unsigned int oi = 0; oi < 2; oi++) {
+      const std::string& obj = (oi == 0) ? (*it).object1 : (*it).object2;
+      if(kmodel_->getModelGroup(obj)) {
+        const std::vector<std::string>& group_links = kmodel_->getModelGroup(obj)->getGroupLinkNames();
+        for(unsigned int i = 0; i < group_links.size(); i++) {
+          matrix_key = hashString(group_links[i], matrix_key);
         }
-        std::string link = std::string(link_padding_xml[i]["link"]);
-        double padding = link_padding_xml[i]["padding"];
-        //we don't care if this is a group or what, we're shoving it in
-        default_link_padding_map[link] = padding;
       }
     }
   }
-  
-  //no allowed collisions by default
-  collision_space::EnvironmentModel::AllowedCollisionMatrix default_collision_matrix(coll_names,false);
 
-  for(std::vector<arm_navigation_msgs::CollisionOperation>::iterator it = default_collision_operations_.begin();
-      it != default_collision_operations_.end();
-      it++) {
-    std::vector<std::string> svec1;
-    std::vector<std::string> svec2;
-    if(kmodel_->getModelGroup((*it).object1)) {
-      svec1 = kmodel_->getModelGroup((*it).object1)->getGroupLinkNames();
-    } else {
-      svec1.push_back((*it).object1);
+  //the expanded matrix can be compiled to disk so later launches of
+  //the same configuration skip the per-pair expansion entirely
+  ros::NodeHandle cache_priv("~");
+  std::string matrix_cache_path;
+  cache_priv.param<std::string>("planning_description_cache", matrix_cache_path, std::string());
+
+  collision_space::EnvironmentModel::AllowedCollisionMatrix default_collision_matrix;
+  if(matrix_cache_path.empty() ||
+     !readCompiledCollisionMatrix(matrix_cache_path, matrix_key, default_collision_matrix)) {
+    //no allowed collisions by default
+    default_collision_matrix = collision_space::EnvironmentModel::AllowedCollisionMatrix(coll_names,false);
+
+    for(std::vector<arm_navigation_msgs::CollisionOperation>::iterator it = default_collision_operations_.begin();
+        it != default_collision_operations_.end();
+        it++) {
+      std::vector<std::string> svec1;
+      std::vector<std::string> svec2;
+      if(kmodel_->getModelGroup((*it).object1)) {
+        svec1 = kmodel_->getModelGroup((*it).object1)->getGroupLinkNames();
+      } else {
+        svec1.push_back((*it).object1);
+      }
+      if(kmodel_->getModelGroup((*it).object2)) {
+        svec2 = kmodel_->getModelGroup((*it).object2)->getGroupLinkNames();
+      } else {
+        svec2.push_back((*it).object2);
+      }
+      default_collision_matrix.changeEntry(svec1, svec2, (*it).operation != arm_navigation_msgs::CollisionOperation::ENABLE);
     }
-    if(kmodel_->getModelGroup((*it).object2)) {
-      svec2 = kmodel_->getModelGroup((*it).object2)->getGroupLinkNames();
-    } else {
-      svec2.push_back((*it).object2);
+    if(!matrix_cache_path.empty()) {
+      writeCompiledCollisionMatrix(matrix_cache_path, matrix_key, default_collision_matrix);
     }
-    default_collision_matrix.changeEntry(svec1, svec2, (*it).operation != arm_navigation_msgs::CollisionOperation::ENABLE);
+  } else {
+    ROS_DEBUG_STREAM("Loaded compiled default collision matrix from " << matrix_cache_path);
   }
 
   model->lock();
@@ -189,33 +433,29 @@ void planning_environment::CollisionModels::setupModelFromParamServer(collision_
 
 void planning_environment::CollisionModels::loadCollisionFromParamServer()
 {
-  // a list of static planes bounding the environment
-  bounding_planes_.clear();
-    
-  std::string planes;
-  nh_.param<std::string>("bounding_planes", planes, std::string());
-    
-  std::stringstream ss(planes);
-  if (!planes.empty())
-    while (ss.good() && !ss.eof())
-    {
-      double value;
-      ss >> value;
-      bounding_planes_.push_back(value);
-    }
-  if (bounding_planes_.size() % 4 != 0)
-  {
-    ROS_WARN("~bounding_planes must be a list of 4-tuples (a b c d) that define planes ax+by+cz+d=0");
-    bounding_planes_.resize(bounding_planes_.size() - (bounding_planes_.size() % 4));
-  }
+  loadCollisionConfigurationFromParamServer();
+  createCollisionEnvironmentFromParamServer();
+}
 
+void planning_environment::CollisionModels::createCollisionEnvironmentFromParamServer()
+{
   if (loadedModels())
   {
-    ode_collision_model_ = new collision_space::EnvironmentModelODE();
+    //the collision environment backend is selectable; ODE remains the
+    //default, bullet uses a dynamic AABB tree broadphase that can do
+    //better on dense scenes
+    std::string collision_environment_type;
+    nh_.param<std::string>("collision_environment_type", collision_environment_type, "ode");
+    if (collision_environment_type == "bullet") {
+      ROS_INFO("Using bullet collision environment");
+      ode_collision_model_ = new collision_space::EnvironmentModelBullet();
+    } else {
+      if (collision_environment_type != "ode") {
+        ROS_WARN_STREAM("Unknown collision environment type " << collision_environment_type << ", using ode");
+      }
+      ode_collision_model_ = new collision_space::EnvironmentModelODE();
+    }
     setupModelFromParamServer(ode_collision_model_);
-	
-    //	bullet_collision_model_ = boost::shared_ptr<collision_space::EnvironmentModel>(new collision_space::EnvironmentModelBullet());
-    //	setupModel(bullet_collision_model_, links);
   } else {
     ROS_WARN("Models not loaded");
   }
@@ -283,16 +523,24 @@ planning_environment::CollisionModels::setPlanningScene(const arm_navigation_msg
   //now we delete temp_state to release the lock
   delete state;
   
+  //one broadphase commit for all the scene's objects instead of a
+  //rebuild per object
+  ode_collision_model_->lock();
+  ode_collision_model_->beginObjectBatch();
+  ode_collision_model_->unlock();
   for(unsigned int i = 0; i < conv_objects.size(); i++) {
     addStaticObject(conv_objects[i]);
   }
+  ode_collision_model_->lock();
+  ode_collision_model_->commitObjectBatch();
+  ode_collision_model_->unlock();
   for(unsigned int i = 0; i < conv_att_objects.size(); i++) {
     addAttachedObject(conv_att_objects[i]);
   }
 
   //now we create again after adding the attached objects
   state = new planning_models::KinematicState(kmodel_);
-  setRobotStateAndComputeTransforms(planning_scene.robot_state, *state);  
+  setRobotStateAndComputeTransforms(planning_scene.robot_state, *state);
 
   //this updates the attached bodies before we mask the collision map
   updateAttachedBodyPoses(*state);
@@ -333,12 +581,193 @@ planning_environment::CollisionModels::setPlanningScene(const arm_navigation_msg
     ode_collision_model_->unlock();
   } 
   planning_scene_set_ = true;
+  last_planning_scene_ = planning_scene;
+  last_scene_objects_ = conv_objects;
+  last_scene_attached_objects_ = conv_att_objects;
+  return state;
+}
+
+planning_models::KinematicState*
+planning_environment::CollisionModels::applyPlanningSceneDiff(const arm_navigation_msgs::PlanningScene& planning_scene,
+                                                              planning_models::KinematicState* old_state)
+{
+  if(!planning_scene_set_) {
+    delete old_state;
+    return setPlanningScene(planning_scene);
+  }
+
+  delete old_state;
+  planning_scene_set_ = false;
+
+  scene_transform_map_.clear();
+  for(unsigned int i = 0; i < planning_scene.fixed_frame_transforms.size(); i++) {
+    if(planning_scene.fixed_frame_transforms[i].header.frame_id != getWorldFrameId()) {
+      ROS_WARN_STREAM("Fixed transform for " << planning_scene.fixed_frame_transforms[i].child_frame_id
+                      << " has non-fixed header frame "  << planning_scene.fixed_frame_transforms[i].header.frame_id);
+      return NULL;
+    }
+    scene_transform_map_[planning_scene.fixed_frame_transforms[i].child_frame_id] = planning_scene.fixed_frame_transforms[i];
+  }
+
+  planning_models::KinematicState* state = new planning_models::KinematicState(kmodel_);
+  bool complete = setRobotStateAndComputeTransforms(planning_scene.robot_state, *state);
+  if(!complete) {
+    ROS_WARN_STREAM("Incomplete robot state in applyPlanningSceneDiff");
+    delete state;
+    return NULL;
+  }
+  std::vector<arm_navigation_msgs::CollisionObject> conv_objects;
+  std::vector<arm_navigation_msgs::AttachedCollisionObject> conv_att_objects;
+
+  for(unsigned int i = 0; i < planning_scene.collision_objects.size(); i++) {
+    if(planning_scene.collision_objects[i].operation.operation != arm_navigation_msgs::CollisionObjectOperation::ADD) {
+      ROS_WARN_STREAM("Planning scene shouldn't have collision operations other than add");
+      delete state;
+      return NULL;
+    }
+    conv_objects.push_back(planning_scene.collision_objects[i]);
+    convertCollisionObjectToNewWorldFrame(*state, conv_objects.back());
+  }
+  for(unsigned int i = 0; i < planning_scene.attached_collision_objects.size(); i++) {
+    if(planning_scene.attached_collision_objects[i].object.operation.operation != arm_navigation_msgs::CollisionObjectOperation::ADD) {
+      ROS_WARN_STREAM("Planning scene shouldn't have collision operations other than add");
+      delete state;
+      return NULL;
+    }
+    conv_att_objects.push_back(planning_scene.attached_collision_objects[i]);
+    convertAttachedCollisionObjectToNewWorldFrame(*state, conv_att_objects.back());
+  }
+
+  delete state;
+
+  //static objects: delete what is gone or changed, add what is new or
+  //changed; unchanged objects keep their geometry in the environment
+  std::map<std::string, const arm_navigation_msgs::CollisionObject*> new_object_map;
+  for(unsigned int i = 0; i < conv_objects.size(); i++) {
+    new_object_map[conv_objects[i].id] = &conv_objects[i];
+  }
+  std::map<std::string, const arm_navigation_msgs::CollisionObject*> old_object_map;
+  for(unsigned int i = 0; i < last_scene_objects_.size(); i++) {
+    old_object_map[last_scene_objects_[i].id] = &last_scene_objects_[i];
+  }
+  for(std::map<std::string, const arm_navigation_msgs::CollisionObject*>::iterator it = old_object_map.begin();
+      it != old_object_map.end();
+      it++) {
+    std::map<std::string, const arm_navigation_msgs::CollisionObject*>::iterator nit = new_object_map.find(it->first);
+    if(nit == new_object_map.end() || !messagesEqual(*it->second, *nit->second)) {
+      deleteStaticObject(it->first);
+    }
+  }
+  ode_collision_model_->lock();
+  ode_collision_model_->beginObjectBatch();
+  ode_collision_model_->unlock();
+  for(unsigned int i = 0; i < conv_objects.size(); i++) {
+    std::map<std::string, const arm_navigation_msgs::CollisionObject*>::iterator oit = old_object_map.find(conv_objects[i].id);
+    if(oit == old_object_map.end() || !messagesEqual(*oit->second, conv_objects[i])) {
+      addStaticObject(conv_objects[i]);
+    }
+  }
+  ode_collision_model_->lock();
+  ode_collision_model_->commitObjectBatch();
+  ode_collision_model_->unlock();
+
+  //attached objects the same way; track whether anything changed, as
+  //that forces the collision map to be re-masked
+  bool attached_changed = false;
+  std::map<std::string, const arm_navigation_msgs::AttachedCollisionObject*> new_att_map;
+  for(unsigned int i = 0; i < conv_att_objects.size(); i++) {
+    new_att_map[conv_att_objects[i].object.id] = &conv_att_objects[i];
+  }
+  std::map<std::string, const arm_navigation_msgs::AttachedCollisionObject*> old_att_map;
+  for(unsigned int i = 0; i < last_scene_attached_objects_.size(); i++) {
+    old_att_map[last_scene_attached_objects_[i].object.id] = &last_scene_attached_objects_[i];
+  }
+  for(std::map<std::string, const arm_navigation_msgs::AttachedCollisionObject*>::iterator it = old_att_map.begin();
+      it != old_att_map.end();
+      it++) {
+    std::map<std::string, const arm_navigation_msgs::AttachedCollisionObject*>::iterator nit = new_att_map.find(it->first);
+    if(nit == new_att_map.end() || !messagesEqual(*it->second, *nit->second)) {
+      deleteAttachedObject(it->first, it->second->link_name);
+      attached_changed = true;
+    }
+  }
+  for(unsigned int i = 0; i < conv_att_objects.size(); i++) {
+    std::map<std::string, const arm_navigation_msgs::AttachedCollisionObject*>::iterator oit = old_att_map.find(conv_att_objects[i].object.id);
+    if(oit == old_att_map.end() || !messagesEqual(*oit->second, conv_att_objects[i])) {
+      addAttachedObject(conv_att_objects[i]);
+      attached_changed = true;
+    }
+  }
+
+  //the state has to be created again after attach changes
+  state = new planning_models::KinematicState(kmodel_);
+  setRobotStateAndComputeTransforms(planning_scene.robot_state, *state);
+
+  updateAttachedBodyPoses(*state);
+
+  //re-masking and re-inserting the collision map is the expensive part
+  //of a scene set, so skip it when neither the map nor the attached
+  //objects it is masked against changed. Calling setCollisionMap
+  //reverts the allowed collision matrix, so note that it happened.
+  bool map_applied = false;
+  if(attached_changed || !messagesEqual(last_planning_scene_.collision_map, planning_scene.collision_map)) {
+    setCollisionMap(planning_scene.collision_map, true);
+    map_applied = true;
+  }
+
+  if(!messagesEqual(last_planning_scene_.link_padding, planning_scene.link_padding)) {
+    revertCollisionSpacePaddingToDefault();
+    if(planning_scene.link_padding.size() > 0) {
+      applyLinkPaddingToCollisionSpace(planning_scene.link_padding);
+    }
+  }
+
+  if(!messagesEqual(last_planning_scene_.allowed_contacts, planning_scene.allowed_contacts)) {
+    clearAllowedContacts();
+    std::vector<arm_navigation_msgs::AllowedContactSpecification> acmv = planning_scene.allowed_contacts;
+    for(unsigned int i = 0; i < planning_scene.allowed_contacts.size(); i++) {
+      if(!convertPoseGivenWorldTransform(*state,
+                                         getWorldFrameId(),
+                                         planning_scene.allowed_contacts[i].pose_stamped.header,
+                                         planning_scene.allowed_contacts[i].pose_stamped.pose,
+                                         acmv[i].pose_stamped)) {
+        ROS_WARN_STREAM("Can't transform allowed contact from frame " << planning_scene.allowed_contacts[i].pose_stamped.header.frame_id
+                        << " into " << getWorldFrameId());
+      }
+    }
+    if(!planning_scene.allowed_contacts.empty()) {
+      std::vector<collision_space::EnvironmentModel::AllowedContact> acv;
+      convertAllowedContactSpecificationMsgToAllowedContactVector(acmv, acv);
+      ode_collision_model_->lock();
+      ode_collision_model_->setAllowedContacts(acv);
+      ode_collision_model_->unlock();
+    }
+  }
+
+  if(map_applied || !messagesEqual(last_planning_scene_.allowed_collision_matrix, planning_scene.allowed_collision_matrix)) {
+    if(!planning_scene.allowed_collision_matrix.link_names.empty()) {
+      ode_collision_model_->lock();
+      ode_collision_model_->setAlteredCollisionMatrix(convertFromACMMsgToACM(planning_scene.allowed_collision_matrix));
+      ode_collision_model_->unlock();
+    } else if(!map_applied) {
+      //setCollisionMap already reverted the matrix
+      revertAllowedCollisionToDefault();
+    }
+  }
+
+  planning_scene_set_ = true;
+  last_planning_scene_ = planning_scene;
+  last_scene_objects_ = conv_objects;
+  last_scene_attached_objects_ = conv_att_objects;
   return state;
 }
 
 void planning_environment::CollisionModels::revertPlanningScene(planning_models::KinematicState* ks) {
   bodiesLock();
   planning_scene_set_ = false;
+  last_planning_scene_ = arm_navigation_msgs::PlanningScene();
+  last_scene_objects_.clear();
+  last_scene_attached_objects_.clear();
   delete ks;
   deleteAllStaticObjects();
   deleteAllAttachedObjects();
@@ -348,6 +777,28 @@ void planning_environment::CollisionModels::revertPlanningScene(planning_models:
   bodiesUnlock();
 }
 
+void planning_environment::CollisionModels::swapEnvironmentContents(CollisionModels& other)
+{
+  //everything the applied scene touched changes owner, including the
+  //kinematic model the attached bodies hang off of
+  std::swap(ode_collision_model_, other.ode_collision_model_);
+  collision_map_shapes_.swap(other.collision_map_shapes_);
+  collision_map_poses_.swap(other.collision_map_poses_);
+  static_object_map_.swap(other.static_object_map_);
+  link_attached_objects_.swap(other.link_attached_objects_);
+  attached_body_cache_.swap(other.attached_body_cache_);
+  //the field is cheap to rebuild, so just invalidate both sides
+  mask_field_dirty_ = true;
+  other.mask_field_dirty_ = true;
+  scene_transform_map_.swap(other.scene_transform_map_);
+  std::swap(planning_scene_set_, other.planning_scene_set_);
+  std::swap(last_planning_scene_, other.last_planning_scene_);
+  last_scene_objects_.swap(other.last_scene_objects_);
+  last_scene_attached_objects_.swap(other.last_scene_attached_objects_);
+  std::swap(kmodel_, other.kmodel_);
+  urdf_.swap(other.urdf_);
+}
+
 ///
 ///  Conversion functions
 ///
@@ -582,45 +1033,84 @@ bool planning_environment::CollisionModels::convertQuaternionGivenWorldTransform
   return true;
 }
 
-bool planning_environment::CollisionModels::updateAttachedBodyPosesForLink(const planning_models::KinematicState& state,
-                                                                           const std::string& link_name)
+void planning_environment::CollisionModels::rebuildAttachedBodyCache()
 {
-  bodiesLock();
-  if(link_attached_objects_.find(link_name) == link_attached_objects_.end()) {
-    bodiesUnlock();
-    return false;
+  attached_body_cache_.clear();
+  for(std::map<std::string, std::map<std::string, bodies::BodyVector*> >::iterator it = link_attached_objects_.begin();
+      it != link_attached_objects_.end();
+      it++) {
+    AttachedBodyCacheEntry entry;
+    entry.link_name = it->first;
+    entry.link_index = -1;
+    for(std::map<std::string, bodies::BodyVector*>::iterator it2 = it->second.begin();
+        it2 != it->second.end();
+        it2++) {
+      entry.object_names.push_back(it2->first);
+      entry.object_bodies.push_back(it2->second);
+    }
+    attached_body_cache_.push_back(entry);
   }
-  const planning_models::KinematicState::LinkState* ls = state.getLinkState(link_name);
+  mask_field_dirty_ = true;
+}
+
+bool planning_environment::CollisionModels::updateAttachedBodyPosesForCacheEntry(const planning_models::KinematicState& state,
+                                                                                 AttachedBodyCacheEntry& entry)
+{
+  if(entry.link_index < 0) {
+    entry.link_index = state.getLinkIndex(entry.link_name);
+  }
+  const planning_models::KinematicState::LinkState* ls =
+    entry.link_index >= 0 ? state.getLinkState((unsigned int)entry.link_index) : state.getLinkState(entry.link_name);
   for(unsigned int j = 0; j < ls->getAttachedBodyStateVector().size(); j++) {
     const planning_models::KinematicState::AttachedBodyState* att_state = ls->getAttachedBodyStateVector()[j];
-    std::map<std::string, bodies::BodyVector*>::iterator bvit = link_attached_objects_[link_name].find(att_state->getName());
-    if(bvit == link_attached_objects_[link_name].end()) {
-      ROS_WARN_STREAM("State out of sync with attached body vector for attached body " << att_state->getName());
-      bodiesUnlock();
-      return false;
+    //the cache holds the objects in name order while the state holds
+    //them in attachment order, so fall back to a scan of the few
+    //attached objects when positions disagree
+    unsigned int k = j < entry.object_names.size() && entry.object_names[j] == att_state->getName() ? j : entry.object_names.size();
+    if(k == entry.object_names.size()) {
+      for(k = 0; k < entry.object_names.size(); k++) {
+        if(entry.object_names[k] == att_state->getName()) break;
+      }
     }
-    if(bvit->second->getSize() != att_state->getGlobalCollisionBodyTransforms().size()) {
+    if(k == entry.object_names.size() ||
+       entry.object_bodies[k]->getSize() != att_state->getNumGlobalCollisionBodyTransforms()) {
       ROS_WARN_STREAM("State out of sync with attached body vector for attached body " << att_state->getName());
-      bodiesUnlock();
       return false;
     }
-    for(unsigned int k = 0; k < att_state->getGlobalCollisionBodyTransforms().size(); k++) {
-      bvit->second->setPose(k, att_state->getGlobalCollisionBodyTransforms()[k]);
+    for(unsigned int m = 0; m < att_state->getNumGlobalCollisionBodyTransforms(); m++) {
+      entry.object_bodies[k]->setPose(m, att_state->getGlobalCollisionBodyTransforms()[m]);
     }
   }
-  bodiesUnlock();
   return true;
 }
 
+bool planning_environment::CollisionModels::updateAttachedBodyPosesForLink(const planning_models::KinematicState& state,
+                                                                           const std::string& link_name)
+{
+  bodiesLock();
+  for(unsigned int i = 0; i < attached_body_cache_.size(); i++) {
+    if(attached_body_cache_[i].link_name == link_name) {
+      bool ok = updateAttachedBodyPosesForCacheEntry(state, attached_body_cache_[i]);
+      mask_field_dirty_ = true;
+      bodiesUnlock();
+      return ok;
+    }
+  }
+  bodiesUnlock();
+  return false;
+}
+
 bool planning_environment::CollisionModels::updateAttachedBodyPoses(const planning_models::KinematicState& state)
 {
-  for(std::map<std::string, std::map<std::string, bodies::BodyVector*> >::iterator it = link_attached_objects_.begin();
-      it != link_attached_objects_.end();
-      it++) {
-    if(!updateAttachedBodyPosesForLink(state, it->first)) {
+  bodiesLock();
+  mask_field_dirty_ = true;
+  for(unsigned int i = 0; i < attached_body_cache_.size(); i++) {
+    if(!updateAttachedBodyPosesForCacheEntry(state, attached_body_cache_[i])) {
+      bodiesUnlock();
       return false;
     }
   }
+  bodiesUnlock();
   return true;
 }
 
@@ -663,6 +1153,7 @@ void planning_environment::CollisionModels::addStaticObject(const std::string& n
   }
   bodiesLock();
   static_object_map_[name] = new bodies::BodyVector(shapes, poses, padding);
+  mask_field_dirty_ = true;
   ode_collision_model_->lock();
   ode_collision_model_->addObjects(name, shapes, poses);
   ode_collision_model_->unlock();
@@ -677,6 +1168,7 @@ void planning_environment::CollisionModels::deleteStaticObject(const std::string
   }
   delete static_object_map_.find(name)->second;
   static_object_map_.erase(name);
+  mask_field_dirty_ = true;
   ode_collision_model_->lock();
   ode_collision_model_->clearObjects(name);
   ode_collision_model_->unlock();
@@ -691,6 +1183,7 @@ void planning_environment::CollisionModels::deleteAllStaticObjects() {
     delete it->second;
   }
   static_object_map_.clear();
+  mask_field_dirty_ = true;
   ode_collision_model_->lock();
   ode_collision_model_->clearObjects();
   ode_collision_model_->unlock();
@@ -711,6 +1204,30 @@ void planning_environment::CollisionModels::setCollisionMap(const arm_navigation
   setCollisionMap(shapes, poses, mask_before_insertion);
 }
 
+void planning_environment::CollisionModels::setCollisionMap(const arm_navigation_msgs::CompactCollisionMap& map,
+                                                            bool mask_before_insertion) {
+  unsigned int num_voxels = 0;
+  for(unsigned int i = 0; i+3 < map.runs.size(); i += 4) {
+    num_voxels += map.runs[i+3];
+  }
+  std::vector<shapes::Shape*> shapes;
+  std::vector<tf::Transform> poses;
+  shapes.reserve(num_voxels);
+  poses.reserve(num_voxels);
+  for(unsigned int i = 0; i+3 < map.runs.size(); i += 4) {
+    double y = map.origin.y + map.runs[i+1]*map.resolution;
+    double z = map.origin.z + map.runs[i+2]*map.resolution;
+    for(unsigned int k = 0; k < map.runs[i+3]; k++) {
+      shapes.push_back(new shapes::Box(map.resolution, map.resolution, map.resolution));
+      tf::Transform pose;
+      pose.setOrigin(tf::Vector3(map.origin.x + (map.runs[i]+k)*map.resolution, y, z));
+      pose.setRotation(tf::Quaternion(0.0, 0.0, 0.0, 1.0));
+      poses.push_back(pose);
+    }
+  }
+  setCollisionMap(shapes, poses, mask_before_insertion);
+}
+
 void planning_environment::CollisionModels::setCollisionMap(std::vector<shapes::Shape*>& shapes,
                                                             const std::vector<tf::Transform>& poses,
                                                             bool mask_before_insertion)
@@ -734,6 +1251,116 @@ void planning_environment::CollisionModels::setCollisionMap(std::vector<shapes::
   bodiesUnlock();
 }
 
+void planning_environment::CollisionModels::updateCollisionMap(std::vector<shapes::Shape*>& shapes,
+                                                               const std::vector<tf::Transform>& poses,
+                                                               double resolution)
+{
+  bodiesLock();
+  if(collision_map_shapes_.empty() || resolution <= 0.0) {
+    setCollisionMap(shapes, poses, false);
+    bodiesUnlock();
+    return;
+  }
+  //the delta works off the index parallelism between our bookkeeping
+  //and the environment namespace, which masking breaks
+  const collision_space::EnvironmentObjects::NamespaceObjects& no =
+    ode_collision_model_->getObjects()->getObjects(COLLISION_MAP_NAME);
+  if(no.shape.size() != collision_map_shapes_.size()) {
+    setCollisionMap(shapes, poses, false);
+    bodiesUnlock();
+    return;
+  }
+
+  std::map<unsigned long long, unsigned int> current_cells;
+  for(unsigned int i = 0; i < collision_map_poses_.size(); i++) {
+    current_cells[collisionMapCellKey(collision_map_poses_[i].getOrigin(), resolution)] = i;
+  }
+
+  //classify first, so a fallback to the full set can still hand every
+  //incoming shape over untouched
+  std::vector<bool> keep(collision_map_shapes_.size(), false);
+  std::vector<int> match(shapes.size(), -1);
+  unsigned int num_added = 0;
+  for(unsigned int i = 0; i < shapes.size(); i++) {
+    std::map<unsigned long long, unsigned int>::iterator it =
+      current_cells.find(collisionMapCellKey(poses[i].getOrigin(), resolution));
+    bool same = false;
+    if(it != current_cells.end() && !keep[it->second] &&
+       collision_map_shapes_[it->second]->type == shapes::BOX && shapes[i]->type == shapes::BOX) {
+      const shapes::Box* cur = static_cast<const shapes::Box*>(collision_map_shapes_[it->second]);
+      const shapes::Box* inc = static_cast<const shapes::Box*>(shapes[i]);
+      same = (cur->size[0] == inc->size[0] && cur->size[1] == inc->size[1] && cur->size[2] == inc->size[2]);
+    }
+    if(same) {
+      keep[it->second] = true;
+      match[i] = it->second;
+    } else {
+      num_added++;
+    }
+  }
+  unsigned int num_removed = 0;
+  for(unsigned int i = 0; i < keep.size(); i++) {
+    if(!keep[i]) {
+      num_removed++;
+    }
+  }
+  if(num_added + num_removed > shapes.size() / 2) {
+    //most of the map moved - a full reset is cheaper than a
+    //geom-by-geom delta
+    setCollisionMap(shapes, poses, false);
+    bodiesUnlock();
+    return;
+  }
+
+  ode_collision_model_->lock();
+  std::vector<const shapes::Shape*> removed_shapes;
+  for(unsigned int i = 0; i < keep.size(); i++) {
+    if(!keep[i]) {
+      removed_shapes.push_back(no.shape[i]);
+    }
+  }
+  if(!removed_shapes.empty()) {
+    ode_collision_model_->removeObjects(COLLISION_MAP_NAME, removed_shapes);
+  }
+  std::vector<shapes::Shape*> added_shapes;
+  std::vector<tf::Transform> added_poses;
+  for(unsigned int i = 0; i < shapes.size(); i++) {
+    if(match[i] < 0) {
+      added_shapes.push_back(shapes[i]);
+      added_poses.push_back(poses[i]);
+    }
+  }
+  if(!added_shapes.empty()) {
+    ode_collision_model_->addObjects(COLLISION_MAP_NAME, added_shapes, added_poses);
+  }
+  ode_collision_model_->unlock();
+
+  //rebuild the bookkeeping in the environment's order - survivors
+  //first, added boxes at the end
+  std::vector<shapes::Shape*> new_shapes;
+  std::vector<tf::Transform> new_poses;
+  for(unsigned int i = 0; i < keep.size(); i++) {
+    if(keep[i]) {
+      new_shapes.push_back(collision_map_shapes_[i]);
+      new_poses.push_back(collision_map_poses_[i]);
+    } else {
+      delete collision_map_shapes_[i];
+    }
+  }
+  for(unsigned int i = 0; i < shapes.size(); i++) {
+    if(match[i] < 0) {
+      new_shapes.push_back(shapes::cloneShape(shapes[i]));
+      new_poses.push_back(poses[i]);
+    } else {
+      //the environment keeps its own copy of unchanged boxes
+      delete shapes[i];
+    }
+  }
+  collision_map_shapes_ = new_shapes;
+  collision_map_poses_ = new_poses;
+  bodiesUnlock();
+}
+
 void planning_environment::CollisionModels::remaskCollisionMap() {
   std::vector<shapes::Shape*> shapes = shapes::cloneShapeVector(collision_map_shapes_);
   std::vector<tf::Transform> masked_poses = collision_map_poses_;
@@ -744,6 +1371,123 @@ void planning_environment::CollisionModels::remaskCollisionMap() {
   ode_collision_model_->unlock();
 }
 
+void planning_environment::CollisionModels::rebuildMaskField()
+{
+  //coarse on purpose - the field only has to separate far-away boxes
+  //from ones near a body; exact containment handles the rest
+  static const double RESOLUTION = 0.05;
+  //cap on grid size; a scene that exceeds it just falls back to the
+  //exact path for every box
+  static const unsigned int MAX_CELLS = 4000000;
+
+  mask_field_dirty_ = false;
+  mask_field_.valid = false;
+
+  std::vector<bodies::BoundingSphere> spheres;
+  for(std::map<std::string, bodies::BodyVector*>::iterator it = static_object_map_.begin();
+      it != static_object_map_.end();
+      it++) {
+    for(unsigned int i = 0; i < it->second->getSize(); i++) {
+      spheres.push_back(it->second->getPaddedBoundingSphere(i));
+    }
+  }
+  for(std::map<std::string, std::map<std::string, bodies::BodyVector*> >::iterator it = link_attached_objects_.begin();
+      it != link_attached_objects_.end();
+      it++) {
+    for(std::map<std::string, bodies::BodyVector*>::iterator it2 = it->second.begin();
+	it2 != it->second.end();
+	it2++) {
+      for(unsigned int i = 0; i < it2->second->getSize(); i++) {
+        spheres.push_back(it2->second->getPaddedBoundingSphere(i));
+      }
+    }
+  }
+
+  if(spheres.empty()) {
+    //no bodies at all - an empty but valid field means everything is clear
+    mask_field_.cells.clear();
+    mask_field_.dims[0] = mask_field_.dims[1] = mask_field_.dims[2] = 0;
+    mask_field_.resolution = RESOLUTION;
+    mask_field_.valid = true;
+    return;
+  }
+
+  tf::Vector3 lo = spheres[0].center;
+  tf::Vector3 hi = spheres[0].center;
+  for(unsigned int i = 0; i < spheres.size(); i++) {
+    lo.setMin(spheres[i].center - tf::Vector3(spheres[i].radius, spheres[i].radius, spheres[i].radius));
+    hi.setMax(spheres[i].center + tf::Vector3(spheres[i].radius, spheres[i].radius, spheres[i].radius));
+  }
+  //one cell of margin so boundary lookups land inside the grid
+  lo -= tf::Vector3(RESOLUTION, RESOLUTION, RESOLUTION);
+  hi += tf::Vector3(RESOLUTION, RESOLUTION, RESOLUTION);
+
+  unsigned int dims[3];
+  double total = 1.0;
+  for(unsigned int d = 0; d < 3; d++) {
+    dims[d] = (unsigned int)(ceil((hi[d] - lo[d]) / RESOLUTION)) + 1;
+    total *= dims[d];
+  }
+  if(total > (double) MAX_CELLS) {
+    ROS_DEBUG("Mask distance field would need %.0f cells, falling back to exact masking", total);
+    return;
+  }
+
+  mask_field_.origin = lo;
+  mask_field_.resolution = RESOLUTION;
+  mask_field_.dims[0] = dims[0];
+  mask_field_.dims[1] = dims[1];
+  mask_field_.dims[2] = dims[2];
+  mask_field_.cells.clear();
+  mask_field_.cells.resize(dims[0] * dims[1] * dims[2], 0);
+
+  //splat each sphere, marking every cell whose center could be within
+  //the sphere; inflating by half the cell diagonal keeps the band
+  //conservative for any point inside the cell
+  const double inflate = 0.5 * sqrt(3.0) * RESOLUTION;
+  for(unsigned int i = 0; i < spheres.size(); i++) {
+    const double r = spheres[i].radius + inflate;
+    int cmin[3], cmax[3];
+    for(unsigned int d = 0; d < 3; d++) {
+      cmin[d] = std::max(0, (int) floor((spheres[i].center[d] - r - lo[d]) / RESOLUTION));
+      cmax[d] = std::min((int) dims[d] - 1, (int) ceil((spheres[i].center[d] + r - lo[d]) / RESOLUTION));
+    }
+    const double r2 = r * r;
+    for(int x = cmin[0]; x <= cmax[0]; x++) {
+      for(int y = cmin[1]; y <= cmax[1]; y++) {
+        for(int z = cmin[2]; z <= cmax[2]; z++) {
+          tf::Vector3 cell_center(lo.x() + x * RESOLUTION,
+                                  lo.y() + y * RESOLUTION,
+                                  lo.z() + z * RESOLUTION);
+          if(cell_center.distance2(spheres[i].center) <= r2) {
+            mask_field_.cells[(x * dims[1] + y) * dims[2] + z] = 1;
+          }
+        }
+      }
+    }
+  }
+  mask_field_.valid = true;
+}
+
+bool planning_environment::CollisionModels::maskFieldClear(const tf::Vector3& pt) const
+{
+  if(!mask_field_.valid) {
+    return false;
+  }
+  if(mask_field_.cells.empty()) {
+    return true;
+  }
+  const int x = (int) floor((pt.x() - mask_field_.origin.x()) / mask_field_.resolution + 0.5);
+  const int y = (int) floor((pt.y() - mask_field_.origin.y()) / mask_field_.resolution + 0.5);
+  const int z = (int) floor((pt.z() - mask_field_.origin.z()) / mask_field_.resolution + 0.5);
+  if(x < 0 || y < 0 || z < 0 ||
+     x >= (int) mask_field_.dims[0] || y >= (int) mask_field_.dims[1] || z >= (int) mask_field_.dims[2]) {
+    //outside the grid means outside every bounding sphere
+    return true;
+  }
+  return mask_field_.cells[((unsigned int) x * mask_field_.dims[1] + (unsigned int) y) * mask_field_.dims[2] + (unsigned int) z] == 0;
+}
+
 void planning_environment::CollisionModels::maskAndDeleteShapeVector(std::vector<shapes::Shape*>& shapes,
                                                                      std::vector<tf::Transform>& poses)
 {
@@ -764,9 +1508,34 @@ void planning_environment::CollisionModels::maskAndDeleteShapeVector(std::vector
 	it2 != it->second.end();
 	it2++) {
       object_vector.push_back(it2->second);
-    }    
+    }
+  }
+  if(mask_field_dirty_) {
+    rebuildMaskField();
+  }
+  if(mask_field_.valid) {
+    //grid lookup settles the common all-clear case; only poses in the
+    //uncertainty band around a body need the exact containment tests
+    mask.clear();
+    mask.resize(poses.size(), true);
+    std::vector<tf::Transform> band_poses;
+    std::vector<unsigned int> band_indices;
+    for(unsigned int i = 0; i < poses.size(); i++) {
+      if(!maskFieldClear(poses[i].getOrigin())) {
+        band_poses.push_back(poses[i]);
+        band_indices.push_back(i);
+      }
+    }
+    if(!band_poses.empty()) {
+      std::vector<bool> band_mask;
+      bodies::maskPosesInsideBodyVectors(band_poses, object_vector, band_mask, true);
+      for(unsigned int i = 0; i < band_indices.size(); i++) {
+        mask[band_indices[i]] = band_mask[i];
+      }
+    }
+  } else {
+    bodies::maskPosesInsideBodyVectors(poses, object_vector, mask, true);
   }
-  bodies::maskPosesInsideBodyVectors(poses, object_vector, mask, true);
   std::vector<tf::Transform> ret_poses;
   std::vector<shapes::Shape*> ret_shapes;
   unsigned int num_masked = 0;
@@ -842,7 +1611,8 @@ bool planning_environment::CollisionModels::addAttachedObject(const std::string&
   }
 
   //the poses will be totally incorrect until they are updated with a state
-  link_attached_objects_[link_name][object_name] = new bodies::BodyVector(shapes, poses, padding);  
+  link_attached_objects_[link_name][object_name] = new bodies::BodyVector(shapes, poses, padding);
+  rebuildAttachedBodyCache();
 
   std::vector<std::string> modded_touch_links;
   
@@ -885,6 +1655,7 @@ bool planning_environment::CollisionModels::deleteAttachedObject(const std::stri
       kmodel_->clearLinkAttachedBodyModel(link_name, object_id);
       delete link_attached_objects_[link_name][object_id];
       link_attached_objects_[link_name].erase(object_id);
+      rebuildAttachedBodyCache();
     } else {
       ROS_WARN_STREAM("Link " << link_name << " has no object " << object_id << " to delete");
       bodiesUnlock();
@@ -921,7 +1692,8 @@ void planning_environment::CollisionModels::deleteAllAttachedObjects(const std::
   } else {
     link_attached_objects_.erase(link_name);
   }
-  
+  rebuildAttachedBodyCache();
+
   if(link_name.empty()) {
     ROS_DEBUG_STREAM("Clearing all attached body models");
     kmodel_->clearAllAttachedBodyModels();
@@ -954,6 +1726,7 @@ bool planning_environment::CollisionModels::convertStaticObjectToAttachedObject(
   }
   link_attached_objects_[link_name][object_name] = static_object_map_[object_name];
   static_object_map_.erase(object_name);
+  rebuildAttachedBodyCache();
 
   std::vector<std::string> modded_touch_links = touch_links;
   if(find(touch_links.begin(), touch_links.end(), link_name) == touch_links.end()) {
@@ -1018,6 +1791,7 @@ bool planning_environment::CollisionModels::convertAttachedObjectToStaticObject(
 
   static_object_map_[object_name] = link_attached_objects_[link_name][object_name];
   link_attached_objects_[link_name].erase(object_name);
+  rebuildAttachedBodyCache();
 
   const planning_models::KinematicModel::AttachedBodyModel* att = NULL;
   for (unsigned int i = 0 ; i < link->getAttachedBodyModels().size() ; ++i) {
@@ -1079,21 +1853,123 @@ void planning_environment::CollisionModels::getCurrentLinkPadding(std::vector<ar
   convertFromLinkPaddingMapToLinkPaddingVector(ode_collision_model_->getCurrentLinkPaddingMap(), link_padding);
 }
 
-bool planning_environment::CollisionModels::applyOrderedCollisionOperationsToCollisionSpace(const arm_navigation_msgs::OrderedCollisionOperations &ord, bool print) {
+unsigned long long planning_environment::CollisionModels::makeOrderedCollisionOperationsKey(const arm_navigation_msgs::OrderedCollisionOperations& ord,
+                                                                                            const std::vector<std::string>& object_names,
+                                                                                            const std::vector<std::string>& att_names) const
+{
+  unsigned long long hash = 14695981039346656037ULL;
+
+  //the serialized operations capture their order, operands and verbs
+  uint32_t length = ros::serialization::serializationLength(ord);
+  if(length > 0) {
+    std::vector<uint8_t> buffer(length);
+    ros::serialization::OStream stream(&buffer[0], length);
+    ros::serialization::serialize(stream, ord);
+    hash = hashBytes(&buffer[0], length, hash);
+  }
+
+  for(unsigned int i = 0; i < object_names.size(); i++) {
+    hash = hashString(object_names[i], hash);
+  }
+  for(unsigned int i = 0; i < att_names.size(); i++) {
+    hash = hashString(att_names[i], hash);
+  }
+
+  //operations naming a model group expand to its links, so group
+  //membership is part of what the operations mean
+  kmodel_->sharedLock();
+  for(std::vector<arm_navigation_msgs::CollisionOperation>::const_iterator it = ord.collision_operations.begin();
+      it != ord.collision_operations.end();
+      it++) {
+    const planning_models::KinematicModel::JointModelGroup* group1 = kmodel_->getModelGroup((*it).object1);
+    if(group1 != NULL) {
+      const std::vector<std::string>& links = group1->getGroupLinkNames();
+      for(unsigned int i = 0; i < links.size(); i++) {
+        hash = hashString(links[i], hash);
+      }
+    }
+    const planning_models::KinematicModel::JointModelGroup* group2 = kmodel_->getModelGroup((*it).object2);
+    if(group2 != NULL) {
+      const std::vector<std::string>& links = group2->getGroupLinkNames();
+      for(unsigned int i = 0; i < links.size(); i++) {
+        hash = hashString(links[i], hash);
+      }
+    }
+  }
+  kmodel_->sharedUnlock();
 
+  //the default matrix the operations start from
   ode_collision_model_->lock();
-  collision_space::EnvironmentModel::AllowedCollisionMatrix acm = ode_collision_model_->getDefaultAllowedCollisionMatrix();;
+  const collision_space::EnvironmentModel::AllowedCollisionMatrix& def = ode_collision_model_->getDefaultAllowedCollisionMatrix();
+  unsigned int num_entries = def.getSize();
+  for(unsigned int i = 0; i < num_entries; i++) {
+    std::string name;
+    def.getEntryName(i, name);
+    hash = hashString(name, hash);
+    for(unsigned int j = 0; j <= i; j++) {
+      bool allowed = false;
+      def.getAllowedCollision(i, j, allowed);
+      hash = (hash ^ (unsigned long long)(allowed ? 1 : 2)) * 1099511628211ULL;
+    }
+  }
   ode_collision_model_->unlock();
 
+  return hash;
+}
+
+bool planning_environment::CollisionModels::applyOrderedCollisionOperationsToCollisionSpace(const arm_navigation_msgs::OrderedCollisionOperations &ord, bool print) {
+
+  bodiesLock();
+
   std::vector<std::string> o_strings;
   getCollisionObjectNames(o_strings);
   std::vector<std::string> a_strings;
   getAttachedCollisionObjectNames(a_strings);
 
-  bool ok = applyOrderedCollisionOperationsListToACM(ord, o_strings, a_strings, kmodel_, acm);
+  unsigned long long key = makeOrderedCollisionOperationsKey(ord, o_strings, a_strings);
+
+  ode_collision_model_->lock();
+  unsigned long epoch = ode_collision_model_->getModificationEpoch();
+  ode_collision_model_->unlock();
+
+  if(key == last_applied_operations_key_ && epoch == last_applied_operations_epoch_) {
+    //nothing has touched the environment since these exact operations
+    //were applied, so the altered matrix is already in place
+    bodiesUnlock();
+    return true;
+  }
+
+  collision_space::EnvironmentModel::AllowedCollisionMatrix acm;
+  bool found = false;
+  for(std::list<OrderedOperationsCacheEntry>::iterator it = ordered_operations_acm_cache_.begin();
+      it != ordered_operations_acm_cache_.end();
+      it++) {
+    if(it->key == key) {
+      acm = it->acm;
+      ordered_operations_acm_cache_.splice(ordered_operations_acm_cache_.begin(), ordered_operations_acm_cache_, it);
+      found = true;
+      break;
+    }
+  }
+
+  if(!found) {
+    ode_collision_model_->lock();
+    acm = ode_collision_model_->getDefaultAllowedCollisionMatrix();
+    ode_collision_model_->unlock();
+
+    bool ok = applyOrderedCollisionOperationsListToACM(ord, o_strings, a_strings, kmodel_, acm);
+
+    if(!ok) {
+      ROS_WARN_STREAM("Bad collision operations");
+    }
 
-  if(!ok) {
-    ROS_WARN_STREAM("Bad collision operations");
+    OrderedOperationsCacheEntry entry;
+    entry.key = key;
+    entry.acm = acm;
+    ordered_operations_acm_cache_.push_front(entry);
+    if(ordered_operations_acm_cache_.size() > MAX_ORDERED_OPERATIONS_ACM_CACHE_SIZE) {
+      ordered_operations_acm_cache_.pop_back();
+    }
   }
 
   if(print) {
@@ -1102,7 +1978,11 @@ bool planning_environment::CollisionModels::applyOrderedCollisionOperationsToCol
 
   ode_collision_model_->lock();
   ode_collision_model_->setAlteredCollisionMatrix(acm);
+  last_applied_operations_epoch_ = ode_collision_model_->getModificationEpoch();
   ode_collision_model_->unlock();
+  last_applied_operations_key_ = key;
+
+  bodiesUnlock();
   return true;
 }
 
@@ -1163,9 +2043,15 @@ bool planning_environment::CollisionModels::disableCollisionsForNonUpdatedLinks(
     kmodel_->sharedUnlock();  
     return false;
   }
-  setAlteredAllowedCollisionMatrix(acm);  
+  setAlteredAllowedCollisionMatrix(acm);
+
+  //beyond allowing the collisions, scope the self collision pass to the
+  //group so static-vs-static pairs are never even traversed
+  ode_collision_model_->lock();
+  ode_collision_model_->setSelfCollisionGroupScope(group_name);
+  ode_collision_model_->unlock();
 
-  kmodel_->sharedUnlock();  
+  kmodel_->sharedUnlock();
   return true;
 }
 
@@ -1173,6 +2059,9 @@ bool planning_environment::CollisionModels::setAlteredAllowedCollisionMatrix(con
 {
   ode_collision_model_->lock();
   ode_collision_model_->setAlteredCollisionMatrix(acm);
+  //an arbitrary altered matrix carries no group semantics, so any
+  //group scope set alongside a previous matrix no longer applies
+  ode_collision_model_->setSelfCollisionGroupScope("");
   ode_collision_model_->unlock();
   return true;
 }
@@ -1223,9 +2112,10 @@ void planning_environment::CollisionModels::getCollisionSpaceCollisionMap(arm_na
   cmap.header.frame_id = getWorldFrameId();
   cmap.header.stamp = ros::Time::now();
   cmap.boxes.clear();
-  
+
   const collision_space::EnvironmentObjects::NamespaceObjects &no = ode_collision_model_->getObjects()->getObjects(COLLISION_MAP_NAME);
   const unsigned int n = no.shape.size();
+  cmap.boxes.reserve(n);
   for (unsigned int i = 0 ; i < n ; ++i) {
     if (no.shape[i]->type == shapes::BOX) {
       const shapes::Box* box = static_cast<const shapes::Box*>(no.shape[i]);
@@ -1253,6 +2143,7 @@ void planning_environment::CollisionModels::getCollisionSpaceCollisionMap(arm_na
 void planning_environment::CollisionModels::revertAllowedCollisionToDefault() {
   ode_collision_model_->lock();
   ode_collision_model_->revertAlteredCollisionMatrix();
+  ode_collision_model_->setSelfCollisionGroupScope("");
   ode_collision_model_->unlock();
 }
 
@@ -1275,6 +2166,10 @@ void planning_environment::CollisionModels::getCollisionSpaceCollisionObjects(st
   omap.clear();
   const collision_space::EnvironmentObjects *eo = ode_collision_model_->getObjects();
   std::vector<std::string> ns = eo->getNamespaces();
+  omap.reserve(ns.size());
+  //scratch shape reused across all objects so mesh buffers keep their storage
+  arm_navigation_msgs::Shape obj;
+  geometry_msgs::Pose pose;
   for (unsigned int i = 0 ; i < ns.size() ; ++i)
   {
     if (ns[i] == COLLISION_MAP_NAME)
@@ -1287,10 +2182,10 @@ void planning_environment::CollisionModels::getCollisionSpaceCollisionObjects(st
     o.header.stamp = ros::Time::now();
     o.id = ns[i];
     o.operation.operation = arm_navigation_msgs::CollisionObjectOperation::ADD;
+    o.shapes.reserve(n);
+    o.poses.reserve(n);
     for (unsigned int j = 0 ; j < n ; ++j) {
-      arm_navigation_msgs::Shape obj;
       if (constructObjectMsg(no.shape[j], obj)) {
-        geometry_msgs::Pose pose;
         tf::poseTFToMsg(no.shape_pose[j], pose);
         o.shapes.push_back(obj);
         o.poses.push_back(pose);
@@ -1315,17 +2210,21 @@ void planning_environment::CollisionModels::getCollisionSpaceAttachedCollisionOb
   ode_collision_model_->lock();
 
   std::vector<const planning_models::KinematicModel::AttachedBodyModel*> att_vec = kmodel_->getAttachedBodyModels();
-  for(unsigned int i = 0; i < att_vec.size(); i++) 
+  avec.reserve(att_vec.size());
+  //scratch shape reused across all objects so mesh buffers keep their storage
+  arm_navigation_msgs::Shape shape;
+  geometry_msgs::Pose pose;
+  for(unsigned int i = 0; i < att_vec.size(); i++)
   {
     arm_navigation_msgs::AttachedCollisionObject ao;
     ao.object.header.frame_id = att_vec[i]->getAttachedLinkModel()->getName();
     ao.object.header.stamp = ros::Time::now();
     ao.link_name = att_vec[i]->getAttachedLinkModel()->getName();
     double attached_padd = ode_collision_model_->getCurrentLinkPadding("attached");
+    ao.object.shapes.reserve(att_vec[i]->getShapes().size());
+    ao.object.poses.reserve(att_vec[i]->getShapes().size());
     for(unsigned int j = 0; j < att_vec[i]->getShapes().size(); j++) {
-      arm_navigation_msgs::Shape shape;
       constructObjectMsg(att_vec[i]->getShapes()[j], shape, attached_padd);
-      geometry_msgs::Pose pose;
       tf::poseTFToMsg(att_vec[i]->getAttachedBodyFixedTransforms()[j], pose);
       ao.object.shapes.push_back(shape);
       ao.object.poses.push_back(pose);
@@ -1346,59 +2245,235 @@ void planning_environment::CollisionModels::getCollisionSpaceAttachedCollisionOb
   bodiesUnlock();
 }
 
-bool planning_environment::CollisionModels::isKinematicStateInCollision(const planning_models::KinematicState& state)                                                                     
+namespace {
+//process-wide so benchmarks can observe the checks made by every
+//CollisionModels instance in the process, not just their own
+boost::mutex collision_check_count_lock;
+unsigned long collision_check_count = 0;
+}
+
+unsigned long planning_environment::CollisionModels::getCollisionCheckCount()
+{
+  boost::mutex::scoped_lock lock(collision_check_count_lock);
+  return collision_check_count;
+}
+
+void planning_environment::CollisionModels::resetCollisionCheckCount()
+{
+  boost::mutex::scoped_lock lock(collision_check_count_lock);
+  collision_check_count = 0;
+}
+
+void planning_environment::CollisionModels::countCollisionCheck()
+{
+  boost::mutex::scoped_lock lock(collision_check_count_lock);
+  collision_check_count++;
+}
+
+collision_space::EnvironmentModel* planning_environment::CollisionModels::getThreadQueryEnvironment()
+{
+  QueryEnvironment* qe = thread_query_env_.get();
+  if(qe == NULL) {
+    qe = new QueryEnvironment;
+    qe->env = NULL;
+    qe->master = NULL;
+    qe->epoch = 0;
+    thread_query_env_.reset(qe);
+  }
+  if(qe->env == NULL || qe->master != ode_collision_model_ || qe->epoch != ode_collision_model_->getModificationEpoch()) {
+    delete qe->env;
+    qe->env = NULL;
+    //clone under the master's lock so a mutation cannot interleave,
+    //and record the epoch read inside the lock
+    ode_collision_model_->lock();
+    qe->env = ode_collision_model_->clone();
+    qe->master = ode_collision_model_;
+    qe->epoch = ode_collision_model_->getModificationEpoch();
+    ode_collision_model_->unlock();
+    //the memoized verdicts were for the old scene version
+    qe->collision_verdicts.clear();
+  }
+  return qe->env;
+}
+
+void planning_environment::CollisionModels::refreshClonePoolEntry(ClonePoolEntry& entry)
 {
+  if(entry.env != NULL && entry.master == ode_collision_model_ &&
+     entry.epoch == ode_collision_model_->getModificationEpoch()) {
+    return;
+  }
+  delete entry.env;
+  entry.env = NULL;
+  //same discipline as the per-thread query clones - clone under the
+  //master's lock and record the epoch read inside it
   ode_collision_model_->lock();
-  ode_collision_model_->updateRobotModel(&state);
-  bool in_coll = ode_collision_model_->isCollision();
+  entry.env = ode_collision_model_->clone();
+  entry.master = ode_collision_model_;
+  entry.epoch = ode_collision_model_->getModificationEpoch();
   ode_collision_model_->unlock();
-  return in_coll;
 }
 
-bool planning_environment::CollisionModels::isKinematicStateInSelfCollision(const planning_models::KinematicState& state)
+void planning_environment::CollisionModels::primeClonedEnvironments(const std::string& group_name,
+                                                                    unsigned int count)
+{
+  boost::mutex::scoped_lock lock(clone_pools_lock_);
+  std::vector<ClonePoolEntry>& pool = clone_pools_[group_name];
+  if(count > MAX_CLONE_POOL_SIZE_PER_GROUP) {
+    count = MAX_CLONE_POOL_SIZE_PER_GROUP;
+  }
+  while(pool.size() < count) {
+    ClonePoolEntry entry;
+    entry.env = NULL;
+    entry.master = NULL;
+    entry.epoch = 0;
+    entry.checked_out = false;
+    pool.push_back(entry);
+  }
+  for(unsigned int i = 0; i < pool.size(); i++) {
+    if(!pool[i].checked_out) {
+      refreshClonePoolEntry(pool[i]);
+    }
+  }
+}
+
+collision_space::EnvironmentModel* planning_environment::CollisionModels::checkoutClonedEnvironment(const std::string& group_name)
 {
+  boost::mutex::scoped_lock lock(clone_pools_lock_);
+  std::vector<ClonePoolEntry>& pool = clone_pools_[group_name];
+  for(unsigned int i = 0; i < pool.size(); i++) {
+    if(!pool[i].checked_out) {
+      refreshClonePoolEntry(pool[i]);
+      pool[i].checked_out = true;
+      return pool[i].env;
+    }
+  }
+  if(pool.size() < MAX_CLONE_POOL_SIZE_PER_GROUP) {
+    ClonePoolEntry entry;
+    entry.env = NULL;
+    entry.master = NULL;
+    entry.epoch = 0;
+    entry.checked_out = true;
+    refreshClonePoolEntry(entry);
+    pool.push_back(entry);
+    return entry.env;
+  }
+  //more workers than pool slots - hand out an unpooled clone and let
+  //checkin delete it
   ode_collision_model_->lock();
-  ode_collision_model_->updateRobotModel(&state);
-  bool in_coll = ode_collision_model_->isSelfCollision();
+  collision_space::EnvironmentModel* env = ode_collision_model_->clone();
   ode_collision_model_->unlock();
-  return in_coll;
+  return env;
+}
+
+void planning_environment::CollisionModels::checkinClonedEnvironment(const std::string& group_name,
+                                                                     collision_space::EnvironmentModel* env)
+{
+  if(env == NULL) {
+    return;
+  }
+  boost::mutex::scoped_lock lock(clone_pools_lock_);
+  std::map<std::string, std::vector<ClonePoolEntry> >::iterator it = clone_pools_.find(group_name);
+  if(it != clone_pools_.end()) {
+    for(unsigned int i = 0; i < it->second.size(); i++) {
+      if(it->second[i].env == env) {
+        if(!it->second[i].checked_out) {
+          ROS_WARN_STREAM("Cloned environment for group " << group_name << " checked in twice");
+        }
+        //deliberately not refreshed here - the next checkout refreshes
+        //only if the master moved while it sat in the pool
+        it->second[i].checked_out = false;
+        return;
+      }
+    }
+  }
+  //an overflow clone that never had a slot
+  delete env;
+}
+
+bool planning_environment::CollisionModels::isKinematicStateInCollision(const planning_models::KinematicState& state)
+{
+  collision_space::EnvironmentModel* env = getThreadQueryEnvironment();
+  QueryEnvironment* qe = thread_query_env_.get();
+
+  //monitoring loops re-ask about the same state against the same
+  //scene version over and over; a hash of the state values answers
+  //those repeats without touching the collision space
+  state.getKinematicStateValues(qe->state_values);
+  unsigned long long state_hash = 14695981039346656037ULL;
+  if(!qe->state_values.empty()) {
+    state_hash = hashBytes((const unsigned char*)(&qe->state_values[0]),
+                           qe->state_values.size() * sizeof(double), state_hash);
+  }
+  std::map<unsigned long long, bool>::const_iterator it = qe->collision_verdicts.find(state_hash);
+  if(it != qe->collision_verdicts.end()) {
+    return it->second;
+  }
+
+  countCollisionCheck();
+  env->updateRobotModel(&state);
+  bool in_collision = env->isCollision();
+  if(qe->collision_verdicts.size() >= MAX_COLLISION_VERDICT_CACHE_SIZE) {
+    //planners hashing all-new states each query would otherwise grow
+    //this without bound; a monitoring loop refills it in one cycle
+    qe->collision_verdicts.clear();
+  }
+  qe->collision_verdicts[state_hash] = in_collision;
+  return in_collision;
+}
+
+bool planning_environment::CollisionModels::isKinematicSegmentInCollision(const planning_models::KinematicState& from,
+                                                                          const planning_models::KinematicState& to)
+{
+  collision_space::EnvironmentModel* env = getThreadQueryEnvironment();
+  countCollisionCheck();
+  return env->isTrajectorySegmentInCollision(&from, &to);
+}
+
+bool planning_environment::CollisionModels::isKinematicStateInSelfCollision(const planning_models::KinematicState& state)
+{
+  collision_space::EnvironmentModel* env = getThreadQueryEnvironment();
+  countCollisionCheck();
+  env->updateRobotModel(&state);
+  return env->isSelfCollision();
 }
 
 bool planning_environment::CollisionModels::isKinematicStateInEnvironmentCollision(const planning_models::KinematicState& state)
 {
-  ode_collision_model_->lock();
-  ode_collision_model_->updateRobotModel(&state);
-  bool in_coll = ode_collision_model_->isEnvironmentCollision();
-  ode_collision_model_->unlock();
-  return in_coll;
+  collision_space::EnvironmentModel* env = getThreadQueryEnvironment();
+  countCollisionCheck();
+  env->updateRobotModel(&state);
+  return env->isEnvironmentCollision();
 }
 
-bool planning_environment::CollisionModels::isKinematicStateInObjectCollision(const planning_models::KinematicState &state, 
+bool planning_environment::CollisionModels::isKinematicStateInObjectCollision(const planning_models::KinematicState &state,
                                                                               const std::string& object_name) {
-  ode_collision_model_->lock();
-  ode_collision_model_->updateRobotModel(&state);
-  bool in_coll = ode_collision_model_->isObjectRobotCollision(object_name);
-  ode_collision_model_->unlock();
-  return in_coll;
+  collision_space::EnvironmentModel* env = getThreadQueryEnvironment();
+  countCollisionCheck();
+  env->updateRobotModel(&state);
+  return env->isObjectRobotCollision(object_name);
 }
 
 bool planning_environment::CollisionModels::isObjectInCollision(const std::string& object_name) {
-  ode_collision_model_->lock();
-  bool in_coll = ode_collision_model_->isObjectInEnvironmentCollision(object_name);
-  ode_collision_model_->unlock();
-  return in_coll;
+  return getThreadQueryEnvironment()->isObjectInEnvironmentCollision(object_name);
 }
 
 void planning_environment::CollisionModels::getAllCollisionsForState(const planning_models::KinematicState& state,
                                                                      std::vector<arm_navigation_msgs::ContactInformation>& contacts,
-                                                                     unsigned int num_per_pair) 
+                                                                     unsigned int num_per_pair,
+                                                                     unsigned int max_total)
 {
-  ode_collision_model_->lock();
-  ode_collision_model_->updateRobotModel(&state);
+  collision_space::EnvironmentModel* env = getThreadQueryEnvironment();
+  env->updateRobotModel(&state);
   std::vector<collision_space::EnvironmentModel::Contact> coll_space_contacts;
   ros::WallTime n1 = ros::WallTime::now();
-  ode_collision_model_->getAllCollisionContacts(coll_space_contacts,
-                                                num_per_pair);
+  if(max_total > 0) {
+    env->getCollisionContacts(coll_space_contacts,
+                              max_total,
+                              num_per_pair);
+  } else {
+    env->getAllCollisionContacts(coll_space_contacts,
+                                 num_per_pair);
+  }
   ros::WallTime n2 = ros::WallTime::now();
   ROS_DEBUG_STREAM("Got " << coll_space_contacts.size() << " collisions in " << (n2-n1).toSec());
   for(unsigned int i = 0; i < coll_space_contacts.size(); i++) {
@@ -1426,15 +2501,14 @@ void planning_environment::CollisionModels::getAllCollisionsForState(const plann
     contact_info.position.z = contact.pos.z();
     contacts.push_back(contact_info);
   }
-  ode_collision_model_->unlock();
 }
 
 void planning_environment::CollisionModels::getAllEnvironmentCollisionsForObject(const std::string& object_name,  
                                                                                  std::vector<arm_navigation_msgs::ContactInformation>& contacts, 
                                                                                  unsigned int num_per_pair) {
-  ode_collision_model_->lock();
+  collision_space::EnvironmentModel* env = getThreadQueryEnvironment();
   std::vector<collision_space::EnvironmentModel::Contact> coll_space_contacts;
-  ode_collision_model_->getAllObjectEnvironmentCollisionContacts(object_name, coll_space_contacts, num_per_pair);
+  env->getAllObjectEnvironmentCollisionContacts(object_name, coll_space_contacts, num_per_pair);
   for(unsigned int i = 0; i < coll_space_contacts.size(); i++) {
     arm_navigation_msgs::ContactInformation contact_info;
     contact_info.header.frame_id = getWorldFrameId();
@@ -1460,8 +2534,6 @@ void planning_environment::CollisionModels::getAllEnvironmentCollisionsForObject
     contact_info.position.z = contact.pos.z();
     contacts.push_back(contact_info);
   }
-  ode_collision_model_->unlock();
-
 }
 
 bool planning_environment::CollisionModels::isKinematicStateValid(const planning_models::KinematicState& state,
@@ -1505,14 +2577,19 @@ bool planning_environment::CollisionModels::isKinematicStateValid(const planning
   if(isKinematicStateInCollision(state)) {
     error_code.val = error_code.COLLISION_CONSTRAINTS_VIOLATED;    
     if(verbose) {
-      std::vector<arm_navigation_msgs::ContactInformation> contacts;
-      getAllCollisionsForState(state, contacts,1);
+      //gather a bounded number of raw contacts and only format them
+      //inside the lazily-evaluated debug macro, so verbose mode can
+      //stay enabled without blowing monitoring deadlines
+      collision_space::EnvironmentModel* env = getThreadQueryEnvironment();
+      env->updateRobotModel(&state);
+      std::vector<collision_space::EnvironmentModel::Contact> contacts;
+      env->getCollisionContacts(contacts, MAX_VERBOSE_COLLISION_CONTACTS, 1);
       if(contacts.size() == 0) {
         ROS_WARN_STREAM("Collision reported but no contacts");
       }
       for(unsigned int i = 0; i < contacts.size(); i++) {
-	ROS_DEBUG_STREAM("Collision between " << contacts[i].contact_body_1 
-                         << " and " << contacts[i].contact_body_2);
+	ROS_DEBUG_STREAM("Collision between " << contacts[i].body_name_1
+                         << " and " << contacts[i].body_name_2);
       }
     }
     return false;
@@ -1591,9 +2668,9 @@ bool planning_environment::CollisionModels::isJointTrajectoryValid(planning_mode
     }
   }
 
-  //next check collision
-  ode_collision_model_->updateRobotModel(&state);
-  if(ode_collision_model_->isCollision()) {
+  //next check collision, through the per-thread clone so concurrent
+  //callers don't contend on the master environment
+  if(isKinematicStateInCollision(state)) {
     error_code.val = error_code.START_STATE_IN_COLLISION;
     if(!evaluate_entire_trajectory) {
       return false;
@@ -1627,32 +2704,129 @@ bool planning_environment::CollisionModels::isJointTrajectoryValid(planning_mode
     return false;
   }
 
-  //now we can start checking the actual 
+  //now we can start checking the actual
   arm_navigation_msgs::Constraints emp_goal_constraints;
-  for(unsigned int i = 0; i < trajectory.points.size(); i++) {
-    arm_navigation_msgs::ArmNavigationErrorCodes suc;
-    suc.val = error_code.SUCCESS;
-    trajectory_error_codes.push_back(suc);
-    for (unsigned int j = 0 ; j < trajectory.points[i].positions.size(); j++)
-    {
-      joint_value_map[trajectory.joint_names[j]] = trajectory.points[i].positions[j];
-    }
-    state.setKinematicState(joint_value_map);
 
-    if(!isKinematicStateValid(state, trajectory.joint_names, suc, 
-                              emp_goal_constraints, path_constraints)) {
-      //this means we return the last error code if we are evaluating the whole trajectory
-      error_code = suc;
+  //long trajectories get sharded across worker threads, each checking
+  //its range against its own clone of the collision environment
+  unsigned int num_threads = boost::thread::hardware_concurrency();
+  if(num_threads == 0) {
+    num_threads = 1;
+  }
+  if(trajectory.points.size() / MIN_TRAJECTORY_POINTS_PER_VALIDATION_THREAD < num_threads) {
+    num_threads = std::max((unsigned int)(trajectory.points.size() / MIN_TRAJECTORY_POINTS_PER_VALIDATION_THREAD),
+                           (unsigned int) 1);
+  }
+
+  if(num_threads == 1) {
+    //the joint name ordering is resolved once here, so the per-point
+    //application below is a flat copy instead of a string-keyed map pass
+    TrajectoryStateApplicator applicator(state, trajectory.joint_names);
+    for(unsigned int i = 0; i < trajectory.points.size(); i++) {
+      arm_navigation_msgs::ArmNavigationErrorCodes suc;
+      suc.val = error_code.SUCCESS;
+      trajectory_error_codes.push_back(suc);
+      if(!applicator.applyPoint(trajectory.points[i])) {
+        //multi-dof or mismatched points fall back to the keyed path
+        for (unsigned int j = 0 ; j < trajectory.points[i].positions.size(); j++)
+        {
+          joint_value_map[trajectory.joint_names[j]] = trajectory.points[i].positions[j];
+        }
+        state.setKinematicState(joint_value_map);
+      }
+
+      if(!isKinematicStateValid(state, trajectory.joint_names, suc,
+                                emp_goal_constraints, path_constraints)) {
+        //this means we return the last error code if we are evaluating the whole trajectory
+        error_code = suc;
+        trajectory_error_codes.back() = suc;
+        if(!evaluate_entire_trajectory) {
+          return false;
+        }
+      }
       trajectory_error_codes.back() = suc;
+    }
+    return(error_code.val == error_code.SUCCESS);
+  }
+
+  arm_navigation_msgs::ArmNavigationErrorCodes suc;
+  suc.val = error_code.SUCCESS;
+  trajectory_error_codes.resize(trajectory.points.size(), suc);
+
+  //workers seed their own states from the caller's, so joints the
+  //trajectory doesn't name keep the values they have right now
+  std::map<std::string, double> base_values;
+  state.getKinematicStateValues(base_values);
+
+  volatile bool abort = false;
+  volatile bool* abort_flag = evaluate_entire_trajectory ? NULL : &abort;
+
+  boost::thread_group workers;
+  unsigned int start = 0;
+  for(unsigned int i = 0; i < num_threads; i++) {
+    unsigned int this_num = trajectory.points.size()/num_threads + (i < trajectory.points.size()%num_threads ? 1 : 0);
+    workers.create_thread(boost::bind(&CollisionModels::checkJointTrajectoryRange, this,
+                                      boost::cref(trajectory), boost::cref(path_constraints), boost::cref(base_values),
+                                      start, start + this_num, boost::ref(trajectory_error_codes), abort_flag));
+    start += this_num;
+  }
+  workers.join_all();
+
+  for(unsigned int i = 0; i < trajectory_error_codes.size(); i++) {
+    if(trajectory_error_codes[i].val != error_code.SUCCESS) {
+      //the last error code when evaluating the whole trajectory, the
+      //first one when the shards stopped at the first invalid point
+      error_code = trajectory_error_codes[i];
       if(!evaluate_entire_trajectory) {
-        return false;
+        break;
       }
     }
-    trajectory_error_codes.back() = suc;
   }
   return(error_code.val == error_code.SUCCESS);
 }
 
+void planning_environment::CollisionModels::checkJointTrajectoryRange(const trajectory_msgs::JointTrajectory& trajectory,
+                                                                      const arm_navigation_msgs::Constraints& path_constraints,
+                                                                      const std::map<std::string, double>& base_values,
+                                                                      unsigned int start,
+                                                                      unsigned int end,
+                                                                      std::vector<arm_navigation_msgs::ArmNavigationErrorCodes>& trajectory_error_codes,
+                                                                      volatile bool* abort)
+{
+  planning_models::KinematicState state(kmodel_);
+  state.setKinematicState(base_values);
+
+  arm_navigation_msgs::Constraints emp_goal_constraints;
+  //resolved once against this worker's state; the per-point
+  //application is then a flat copy
+  TrajectoryStateApplicator applicator(state, trajectory.joint_names);
+  std::map<std::string, double> joint_value_map;
+  for(unsigned int i = start; i < end; i++) {
+    if(abort != NULL && *abort) {
+      return;
+    }
+    if(!applicator.applyPoint(trajectory.points[i])) {
+      //multi-dof or mismatched points fall back to the keyed path
+      for (unsigned int j = 0 ; j < trajectory.points[i].positions.size(); j++)
+      {
+        joint_value_map[trajectory.joint_names[j]] = trajectory.points[i].positions[j];
+      }
+      state.setKinematicState(joint_value_map);
+    }
+
+    arm_navigation_msgs::ArmNavigationErrorCodes suc;
+    suc.val = suc.SUCCESS;
+    if(!isKinematicStateValid(state, trajectory.joint_names, suc,
+                              emp_goal_constraints, path_constraints)) {
+      trajectory_error_codes[i] = suc;
+      if(abort != NULL) {
+        *abort = true;
+        return;
+      }
+    }
+  }
+}
+
 // bool planning_environment::CollisionModels::isRobotTrajectoryValid(const arm_navigation_msgs::PlanningScene& planning_scene,
 //                                                                    const arm_navigation_msgs::RobotTrajectory& trajectory,
 //                                                                    const arm_navigation_msgs::Constraints& goal_constraints,
@@ -1777,6 +2951,16 @@ void planning_environment::CollisionModels::getAllCollisionPointMarkers(const pl
                                             lifetime);
 }
 
+const visualization_msgs::MarkerArray& planning_environment::CollisionModels::getAllCollisionPointMarkers(const planning_models::KinematicState& state,
+                                                                                                          CollisionMarkerPool& pool,
+                                                                                                          const std_msgs::ColorRGBA& color,
+                                                                                                          const ros::Duration& lifetime)
+{
+  pool.contacts().clear();
+  getAllCollisionsForState(state, pool.contacts(), 1);
+  return pool.fill(getWorldFrameId(), color, lifetime);
+}
+
 void planning_environment::CollisionModels::getStaticCollisionObjectMarkers(visualization_msgs::MarkerArray& arr,
                                                                             const std::string& name,
                                                                             const std_msgs::ColorRGBA& color,
@@ -41,11 +41,15 @@
 
 static const std::string REGISTER_PLANNING_SCENE_NAME = "register_planning_scene";
 
-planning_environment::CollisionModelsInterface::CollisionModelsInterface(const std::string& description, bool register_with_server)
-  : CollisionModels(description)
+planning_environment::CollisionModelsInterface::CollisionModelsInterface(const std::string& description, bool register_with_server, bool kinematics_only)
+  : CollisionModels(description, kinematics_only)
 {
   planning_scene_state_ = NULL;
 
+  last_scene_version_ = 0;
+
+  use_double_buffered_sync_ = false;
+
   set_planning_scene_callback_ = NULL;
   revert_planning_scene_callback_ = NULL;
 
@@ -88,15 +92,105 @@ planning_environment::CollisionModelsInterface::~CollisionModelsInterface()
   }
 }
 
+void planning_environment::CollisionModelsInterface::applySceneDiff(const arm_navigation_msgs::SyncPlanningSceneGoal& goal,
+                                                                    arm_navigation_msgs::PlanningScene& scene) const
+{
+  if(goal.changed_components & arm_navigation_msgs::SyncPlanningSceneGoal::ROBOT_STATE) {
+    scene.robot_state = goal.planning_scene.robot_state;
+  }
+  if(goal.changed_components & arm_navigation_msgs::SyncPlanningSceneGoal::FIXED_FRAME_TRANSFORMS) {
+    scene.fixed_frame_transforms = goal.planning_scene.fixed_frame_transforms;
+  }
+  if(goal.changed_components & arm_navigation_msgs::SyncPlanningSceneGoal::ALLOWED_COLLISION_MATRIX) {
+    scene.allowed_collision_matrix = goal.planning_scene.allowed_collision_matrix;
+  }
+  if(goal.changed_components & arm_navigation_msgs::SyncPlanningSceneGoal::ALLOWED_CONTACTS) {
+    scene.allowed_contacts = goal.planning_scene.allowed_contacts;
+  }
+  if(goal.changed_components & arm_navigation_msgs::SyncPlanningSceneGoal::LINK_PADDING) {
+    scene.link_padding = goal.planning_scene.link_padding;
+  }
+  if(goal.changed_components & arm_navigation_msgs::SyncPlanningSceneGoal::COLLISION_OBJECTS) {
+    scene.collision_objects = goal.planning_scene.collision_objects;
+  }
+  if(goal.changed_components & arm_navigation_msgs::SyncPlanningSceneGoal::ATTACHED_COLLISION_OBJECTS) {
+    scene.attached_collision_objects = goal.planning_scene.attached_collision_objects;
+  }
+  if(goal.changed_components & arm_navigation_msgs::SyncPlanningSceneGoal::COLLISION_MAP) {
+    scene.collision_map = goal.planning_scene.collision_map;
+  }
+}
+
 void planning_environment::CollisionModelsInterface::syncPlanningSceneCallback(const arm_navigation_msgs::SyncPlanningSceneGoalConstPtr& scene)
 {
   ros::WallTime t1 = ros::WallTime::now();
-  bodiesLock();
   arm_navigation_msgs::SyncPlanningSceneResult res;
   res.ok = true;
+  res.need_keyframe = false;
 
   ROS_DEBUG("Syncing planning scene");
 
+  //diff goals only carry the changed components; they are overlaid on
+  //the cached copy of the scene they are based on.  A version mismatch
+  //(missed sync, failed apply) is answered with need_keyframe so the
+  //server resends the full scene
+  const arm_navigation_msgs::PlanningScene* scene_to_set = &scene->planning_scene;
+  arm_navigation_msgs::PlanningScene patched_scene;
+  if(scene->base_version != 0) {
+    if(last_scene_version_ != scene->base_version) {
+      ROS_DEBUG_STREAM("Got scene diff based on version " << scene->base_version
+                       << " but have version " << last_scene_version_ << ", requesting keyframe");
+      res.ok = false;
+      res.need_keyframe = true;
+      action_server_->setAborted(res);
+      return;
+    }
+    if(scene->changed_components == 0 && planning_scene_set_ && planning_scene_state_ != NULL) {
+      //a diff with no changed components means the scene we already
+      //have set is exactly the one being synced - this happens every
+      //time the trajectory filter runs against the scene the planner
+      //just used - so just adopt the new version number
+      ROS_DEBUG_STREAM("Scene version " << scene->version << " identical to the scene already set, skipping setup");
+      last_scene_version_ = scene->version;
+      //a fresh setup would hand out a state at the scene's robot
+      //state; put the retained one back there too in case the host
+      //moved it
+      resetToStartState(*planning_scene_state_);
+      if(set_planning_scene_callback_ != NULL) {
+        set_planning_scene_callback_(getLastPlanningScene());
+      }
+      arm_navigation_msgs::SyncPlanningSceneFeedback feedback;
+      feedback.client_processing = true;
+      feedback.ready = true;
+      action_server_->publishFeedback(feedback);
+      action_server_->setSucceeded(res);
+      return;
+    }
+    patched_scene = getLastPlanningScene();
+    applySceneDiff(*scene, patched_scene);
+    scene_to_set = &patched_scene;
+  }
+
+  if(use_double_buffered_sync_) {
+    arm_navigation_msgs::SyncPlanningSceneFeedback feedback;
+    feedback.client_processing = true;
+    feedback.ready = false;
+    action_server_->publishFeedback(feedback);
+    if(!setPlanningSceneDoubleBuffered(*scene_to_set)) {
+      last_scene_version_ = 0;
+      res.ok = false;
+      action_server_->setAborted(res);
+      return;
+    }
+    last_scene_version_ = scene->version;
+    feedback.ready = true;
+    action_server_->publishFeedback(feedback);
+    action_server_->setSucceeded(res);
+    ROS_DEBUG_STREAM("Setting took " << (ros::WallTime::now()-t1).toSec());
+    return;
+  }
+
+  bodiesLock();
   if(planning_scene_set_) {
     ROS_DEBUG("Reverting planning scene");
     revertPlanningScene(planning_scene_state_);
@@ -105,15 +199,16 @@ void planning_environment::CollisionModelsInterface::syncPlanningSceneCallback(c
       revert_planning_scene_callback_();
     }
   }
-  planning_scene_state_ = setPlanningScene(scene->planning_scene);
+  planning_scene_state_ = setPlanningScene(*scene_to_set);
   if(planning_scene_state_ == NULL) {
     ROS_ERROR("Setting planning scene state to NULL");
+    last_scene_version_ = 0;
     res.ok = false;
     action_server_->setAborted(res);
     bodiesUnlock();
     return;
   }
-  last_planning_scene_ = scene->planning_scene;
+  last_scene_version_ = scene->version;
   arm_navigation_msgs::SyncPlanningSceneFeedback feedback;
   feedback.client_processing = true;
   feedback.ready = false;
@@ -133,6 +228,12 @@ void planning_environment::CollisionModelsInterface::syncPlanningSceneCallback(c
 
 bool planning_environment::CollisionModelsInterface::setPlanningSceneWithCallbacks(const arm_navigation_msgs::PlanningScene& planning_scene)
 {
+  //scenes set directly (not through the sync action) have no version,
+  //so drop the cached one and let the next sync send a keyframe
+  last_scene_version_ = 0;
+  if(use_double_buffered_sync_) {
+    return setPlanningSceneDoubleBuffered(planning_scene);
+  }
   if(planning_scene_set_) {
     revertPlanningScene(planning_scene_state_);
     planning_scene_state_ = NULL;
@@ -145,7 +246,6 @@ bool planning_environment::CollisionModelsInterface::setPlanningSceneWithCallbac
     ROS_ERROR("Setting planning scene state to NULL");
     return false;
   }
-  last_planning_scene_ = planning_scene;
   //TODO - we can run the callback in a new thread, but it's going to mean communicating
   //preempts over semaphors and whatnot
   if(set_planning_scene_callback_ != NULL) {
@@ -154,6 +254,42 @@ bool planning_environment::CollisionModelsInterface::setPlanningSceneWithCallbac
   return true;
 }
 
+bool planning_environment::CollisionModelsInterface::setPlanningSceneDoubleBuffered(const arm_navigation_msgs::PlanningScene& planning_scene)
+{
+  //all the expensive work - mesh conversion, attached body setup, the
+  //allowed collision matrix - happens on a shadow environment while
+  //queries keep running against the current one
+  CollisionModels* shadow = new CollisionModels(getDescription());
+  if(!shadow->loadedModels()) {
+    ROS_ERROR("Could not load shadow collision models");
+    delete shadow;
+    return false;
+  }
+  planning_models::KinematicState* new_state = shadow->setPlanningScene(planning_scene);
+  if(new_state == NULL) {
+    ROS_ERROR("Setting planning scene state to NULL");
+    delete shadow;
+    return false;
+  }
+
+  bodiesLock();
+  if(planning_scene_set_ && revert_planning_scene_callback_ != NULL) {
+    revert_planning_scene_callback_();
+  }
+  delete planning_scene_state_;
+  swapEnvironmentContents(*shadow);
+  planning_scene_state_ = new_state;
+  bodiesUnlock();
+
+  //the shadow now owns the old environment and takes it down with it
+  delete shadow;
+
+  if(set_planning_scene_callback_ != NULL) {
+    set_planning_scene_callback_(planning_scene);
+  }
+  return true;
+}
+
 void planning_environment::CollisionModelsInterface::resetToStartState(planning_models::KinematicState& state) const {
   setRobotStateAndComputeTransforms(last_planning_scene_.robot_state, state);
 }
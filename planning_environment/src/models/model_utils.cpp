@@ -37,6 +37,7 @@
 #include <planning_environment/models/model_utils.h>
 #include <geometric_shapes/bodies.h>
 #include <planning_environment/util/construct_object.h>
+#include <algorithm>
 
 //returns true if the joint_state_map sets all the joints in the state, 
 bool planning_environment::setRobotStateAndComputeTransforms(const arm_navigation_msgs::RobotState &robot_state,
@@ -108,6 +109,36 @@ bool planning_environment::setRobotStateAndComputeTransforms(const arm_navigatio
   return true;
 }
 
+bool planning_environment::setRobotStateAndComputeGroupTransforms(const arm_navigation_msgs::RobotState &robot_state,
+                                                                  const std::string& group_name,
+                                                                  planning_models::KinematicState& state)
+{
+  if(robot_state.joint_state.name.size() != robot_state.joint_state.position.size()) {
+    ROS_INFO_STREAM("Different number of names and positions: " << robot_state.joint_state.name.size()
+                    << " " << robot_state.joint_state.position.size());
+    return false;
+  }
+  //multi-dof transforms move links no group updates, so the full-state
+  //path is the only correct one when the message carries them
+  if(!robot_state.multi_dof_joint_state.joint_names.empty()) {
+    return setRobotStateAndComputeTransforms(robot_state, state);
+  }
+  planning_models::KinematicState::JointStateGroup* joint_state_group = state.getJointStateGroup(group_name);
+  if(joint_state_group == NULL) {
+    ROS_WARN_STREAM("No group " << group_name << " in state - setting full state");
+    return setRobotStateAndComputeTransforms(robot_state, state);
+  }
+  std::map<std::string, double> joint_state_map;
+  for (unsigned int i = 0 ; i < robot_state.joint_state.name.size(); ++i)
+  {
+    if(joint_state_group->hasJointState(robot_state.joint_state.name[i])) {
+      joint_state_map[robot_state.joint_state.name[i]] = robot_state.joint_state.position[i];
+    }
+  }
+  //updates the group's links as part of setting the values
+  return joint_state_group->setKinematicState(joint_state_map);
+}
+
 void planning_environment::convertKinematicStateToRobotState(const planning_models::KinematicState& kinematic_state,
                                                              const ros::Time& timestamp,
                                                              const std::string& header_frame,
@@ -122,6 +153,9 @@ void planning_environment::convertKinematicStateToRobotState(const planning_mode
   robot_state.multi_dof_joint_state.poses.clear();
 
   const std::vector<planning_models::KinematicState::JointState*>& joints = kinematic_state.getJointStateVector();
+  //most joints carry a single value, so the joint count is a good estimate
+  robot_state.joint_state.name.reserve(joints.size());
+  robot_state.joint_state.position.reserve(joints.size());
   for(std::vector<planning_models::KinematicState::JointState*>::const_iterator it = joints.begin();
       it != joints.end();
       it++) {
@@ -196,6 +230,10 @@ void planning_environment::convertFromACMToACMMsg(const collision_space::Environ
   if(!acm.getValid()) return;
   matrix.link_names.resize(acm.getSize());
   matrix.entries.resize(acm.getSize());
+  //size every row once up front instead of re-resizing inside the n^2 loop
+  for(unsigned int i = 0; i < acm.getSize(); i++) {
+    matrix.entries[i].enabled.resize(acm.getSize());
+  }
   const collision_space::EnvironmentModel::AllowedCollisionMatrix::entry_type& bm = acm.getEntriesBimap();
   for(collision_space::EnvironmentModel::AllowedCollisionMatrix::entry_type::right_const_iterator it = bm.right.begin();
       it != bm.right.end();
@@ -203,10 +241,9 @@ void planning_environment::convertFromACMToACMMsg(const collision_space::Environ
     matrix.link_names[it->first] = it->second;
     for(unsigned int i = 0; i < acm.getSize(); i++) {
       bool allowed;
-      matrix.entries[i].enabled.resize(acm.getSize());
-      acm.getAllowedCollision(it->first, i, allowed); 
+      acm.getAllowedCollision(it->first, i, allowed);
       if(it->first >= matrix.entries[i].enabled.size()) {
-        ROS_WARN_STREAM("Trouble size " << matrix.entries[i].enabled.size() << " ind " << it->first); 
+        ROS_WARN_STREAM("Trouble size " << matrix.entries[i].enabled.size() << " ind " << it->first);
       } else {
         matrix.entries[it->first].enabled[i] = allowed;
       }
@@ -364,6 +401,7 @@ bool planning_environment::doesKinematicStateObeyConstraints(const planning_mode
   constraint_evaluator.add(constraints.position_constraints);
   constraint_evaluator.add(constraints.orientation_constraints);
   constraint_evaluator.add(constraints.visibility_constraints);
+  constraint_evaluator.compile(&state);
   return(constraint_evaluator.decide(&state, verbose));
 }
 
@@ -543,6 +581,7 @@ void planning_environment::setMarkerShapeFromShape(const shapes::Shape *obj, vis
 void planning_environment::convertFromLinkPaddingMapToLinkPaddingVector(const std::map<std::string, double>& link_padding_map,
                                                                         std::vector<arm_navigation_msgs::LinkPadding>& link_padding_vector)
 {
+  link_padding_vector.reserve(link_padding_vector.size()+link_padding_map.size());
   for(std::map<std::string, double>::const_iterator it = link_padding_map.begin();
       it != link_padding_map.end();
       it++) {
@@ -641,3 +680,147 @@ void planning_environment::getCollisionMarkersFromContactInformation(const std::
     arr.markers.push_back(mk);
   }
 }
+
+const visualization_msgs::MarkerArray& planning_environment::CollisionMarkerPool::fill(const std::string& world_frame_id,
+                                                                                       const std_msgs::ColorRGBA& color,
+                                                                                       const ros::Duration& lifetime)
+{
+  //reset the counters without dropping the map nodes
+  for(std::map<std::string, unsigned int>::iterator it = ns_counts_.begin();
+      it != ns_counts_.end();
+      it++) {
+    it->second = 0;
+  }
+
+  unsigned int live = contacts_.size();
+  unsigned int total = std::max(live, last_live_);
+  if(arr_.markers.size() < total) {
+    arr_.markers.resize(total);
+  }
+
+  ros::Time now = ros::Time::now();
+  for(unsigned int i = 0; i < live; i++) {
+    visualization_msgs::Marker& mk = arr_.markers[i];
+    //building the namespace in the retained scratch string and
+    //assigning it over reuses both strings' storage
+    ns_scratch_.clear();
+    ns_scratch_ += contacts_[i].contact_body_1;
+    ns_scratch_ += "+";
+    ns_scratch_ += contacts_[i].contact_body_2;
+    mk.ns = ns_scratch_;
+    mk.id = ns_counts_[ns_scratch_]++;
+    mk.header.stamp = now;
+    mk.header.frame_id = world_frame_id;
+    mk.type = visualization_msgs::Marker::SPHERE;
+    mk.action = visualization_msgs::Marker::ADD;
+    mk.pose.position.x = contacts_[i].position.x;
+    mk.pose.position.y = contacts_[i].position.y;
+    mk.pose.position.z = contacts_[i].position.z;
+    mk.pose.orientation.x = 0.0;
+    mk.pose.orientation.y = 0.0;
+    mk.pose.orientation.z = 0.0;
+    mk.pose.orientation.w = 1.0;
+    mk.scale.x = mk.scale.y = mk.scale.z = 0.035;
+    mk.color.a = color.a;
+    if(mk.color.a == 0.0) {
+      mk.color.a = 1.0;
+    }
+    mk.color.r = color.r;
+    mk.color.g = color.g;
+    mk.color.b = color.b;
+    mk.lifetime = lifetime;
+  }
+
+  //slots live last cycle but not now go out once as deletions for the
+  //ns/id they last carried, then the tail is dropped
+  for(unsigned int i = live; i < total; i++) {
+    visualization_msgs::Marker& mk = arr_.markers[i];
+    mk.header.stamp = now;
+    mk.action = visualization_msgs::Marker::DELETE;
+  }
+  arr_.markers.resize(total);
+
+  last_live_ = live;
+  return arr_;
+}
+
+planning_environment::ContactMarkerPublisher::ContactMarkerPublisher(ros::NodeHandle& nh,
+                                                                     const std::string& topic,
+                                                                     unsigned int queue_size)
+{
+  marker_publisher_ = nh.advertise<visualization_msgs::MarkerArray>(topic, queue_size);
+  last_color_.r = last_color_.g = last_color_.b = last_color_.a = 0.0;
+}
+
+void planning_environment::ContactMarkerPublisher::publishMarkers(const std::vector<arm_navigation_msgs::ContactInformation>& contacts,
+                                                                  const std::string& world_frame_id,
+                                                                  const std_msgs::ColorRGBA& color)
+{
+  //clearing retains the capacity from earlier cycles
+  diff_.markers.clear();
+
+  bool color_changed = (color.r != last_color_.r || color.g != last_color_.g ||
+                        color.b != last_color_.b || color.a != last_color_.a);
+
+  std::map<std::string, std::vector<geometry_msgs::Point> > current;
+  for(unsigned int i = 0; i < contacts.size(); i++) {
+    std::string ns_name = contacts[i].contact_body_1 + "+" + contacts[i].contact_body_2;
+    current[ns_name].push_back(contacts[i].position);
+  }
+
+  for(std::map<std::string, std::vector<geometry_msgs::Point> >::iterator it = current.begin();
+      it != current.end();
+      it++) {
+    std::map<std::string, std::vector<geometry_msgs::Point> >::iterator last = last_published_.find(it->first);
+    for(unsigned int id = 0; id < it->second.size(); id++) {
+      if(!color_changed && last != last_published_.end() && id < last->second.size() &&
+         last->second[id].x == it->second[id].x &&
+         last->second[id].y == it->second[id].y &&
+         last->second[id].z == it->second[id].z) {
+        continue;
+      }
+      visualization_msgs::Marker mk;
+      mk.header.stamp = ros::Time::now();
+      mk.header.frame_id = world_frame_id;
+      mk.ns = it->first;
+      mk.id = id;
+      mk.type = visualization_msgs::Marker::SPHERE;
+      mk.action = visualization_msgs::Marker::ADD;
+      mk.pose.position = it->second[id];
+      mk.pose.orientation.w = 1.0;
+      mk.scale.x = mk.scale.y = mk.scale.z = 0.035;
+      mk.color.a = color.a;
+      if(mk.color.a == 0.0) {
+        mk.color.a = 1.0;
+      }
+      mk.color.r = color.r;
+      mk.color.g = color.g;
+      mk.color.b = color.b;
+      diff_.markers.push_back(mk);
+    }
+  }
+
+  //explicitly delete what was published last cycle and is gone now
+  for(std::map<std::string, std::vector<geometry_msgs::Point> >::iterator it = last_published_.begin();
+      it != last_published_.end();
+      it++) {
+    std::map<std::string, std::vector<geometry_msgs::Point> >::iterator cur = current.find(it->first);
+    unsigned int first_dead = (cur == current.end()) ? 0 : cur->second.size();
+    for(unsigned int id = first_dead; id < it->second.size(); id++) {
+      visualization_msgs::Marker mk;
+      mk.header.stamp = ros::Time::now();
+      mk.header.frame_id = world_frame_id;
+      mk.ns = it->first;
+      mk.id = id;
+      mk.action = visualization_msgs::Marker::DELETE;
+      diff_.markers.push_back(mk);
+    }
+  }
+
+  last_published_.swap(current);
+  last_color_ = color;
+
+  if(!diff_.markers.empty()) {
+    marker_publisher_.publish(diff_);
+  }
+}
@@ -40,18 +40,86 @@
 #include <boost/algorithm/string.hpp>
 #include <sstream>
 
+std::map<std::string, planning_environment::RobotModels::ModelCacheEntry> planning_environment::RobotModels::model_cache_;
+boost::mutex planning_environment::RobotModels::model_cache_lock_;
+
+namespace
+{
+//FNV-1a; identifies a description and config combination without
+//keeping the whole XML around as a map key
+unsigned long long hashString(const std::string& s, unsigned long long hash)
+{
+  for(unsigned int i = 0; i < s.size(); i++) {
+    hash = (hash ^ (unsigned long long)(unsigned char)s[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+}
+
+std::string planning_environment::RobotModels::makeModelCacheKey(const std::string& content,
+                                                                 const std::vector<planning_models::KinematicModel::MultiDofConfig>& multi_dof_configs,
+                                                                 const std::vector<planning_models::KinematicModel::GroupConfig>& group_configs,
+                                                                 bool load_geometry)
+{
+  unsigned long long hash = hashString(content, 14695981039346656037ULL);
+  //geometry-free and full builds of the same description must not
+  //share a cache slot
+  hash = hashString(load_geometry ? "geom" : "no_geom", hash);
+  for(unsigned int i = 0; i < multi_dof_configs.size(); i++) {
+    const planning_models::KinematicModel::MultiDofConfig& config = multi_dof_configs[i];
+    hash = hashString(config.name, hash);
+    hash = hashString(config.type, hash);
+    hash = hashString(config.parent_frame_id, hash);
+    hash = hashString(config.child_frame_id, hash);
+    for(std::map<std::string, std::string>::const_iterator it = config.name_equivalents.begin();
+        it != config.name_equivalents.end();
+        it++) {
+      hash = hashString(it->first, hash);
+      hash = hashString(it->second, hash);
+    }
+  }
+  for(unsigned int i = 0; i < group_configs.size(); i++) {
+    const planning_models::KinematicModel::GroupConfig& config = group_configs[i];
+    hash = hashString(config.name_, hash);
+    hash = hashString(config.base_link_, hash);
+    hash = hashString(config.tip_link_, hash);
+    for(unsigned int j = 0; j < config.joints_.size(); j++) {
+      hash = hashString(config.joints_[j], hash);
+    }
+    for(unsigned int j = 0; j < config.subgroups_.size(); j++) {
+      hash = hashString(config.subgroups_[j], hash);
+    }
+  }
+  std::stringstream key;
+  key << hash;
+  return key.str();
+}
+
 planning_environment::RobotModels::RobotModels(const std::string &description) : priv_nh_("~")
 {
   description_ = nh_.resolveName(description);
   loaded_models_ = false;
+  load_geometry_ = true;
   loadRobotFromParamServer();
 }
 
+planning_environment::RobotModels::RobotModels(const std::string &description, bool load_robot_model, bool load_geometry) : priv_nh_("~")
+{
+  description_ = nh_.resolveName(description);
+  loaded_models_ = false;
+  load_geometry_ = load_geometry;
+  kmodel_ = NULL;
+  if(load_robot_model) {
+    loadRobotFromParamServer();
+  }
+}
+
 planning_environment::RobotModels::RobotModels(boost::shared_ptr<urdf::Model> urdf,
                                                planning_models::KinematicModel* kmodel) {
   urdf_ = urdf;
   kmodel_ = kmodel;
   loaded_models_ = true;
+  load_geometry_ = true;
 }
 
 
@@ -67,16 +135,39 @@ void planning_environment::RobotModels::loadRobotFromParamServer(void)
   std::string content;
   if (nh_.getParam(description_, content))
   {
+    //the group config load validates joint names against the parsed
+    //description, so the parse has to come first; the cache below
+    //still skips the expensive part - mesh loading and group
+    //construction in the kinematic model build
     urdf_ = boost::shared_ptr<urdf::Model>(new urdf::Model());
     if (urdf_->initString(content))
     {
-      loaded_models_ = true;
       std::vector<planning_models::KinematicModel::GroupConfig> group_configs;
       std::vector<planning_models::KinematicModel::MultiDofConfig> multi_dof_configs;
       bool hasMulti = loadMultiDofConfigsFromParamServer(multi_dof_configs);
       loadGroupConfigsFromParamServer(multi_dof_configs, group_configs);
+
+      std::string cache_key = makeModelCacheKey(content, multi_dof_configs, group_configs, load_geometry_);
+      {
+        boost::mutex::scoped_lock slock(model_cache_lock_);
+        std::map<std::string, ModelCacheEntry>::iterator it = model_cache_.find(cache_key);
+        if(it != model_cache_.end()) {
+          //this process already loaded the meshes and built the
+          //groups; reuse the parsed model and copy the built prototype
+          urdf_ = it->second.urdf;
+          kmodel_ = new planning_models::KinematicModel(*it->second.kmodel);
+          loaded_models_ = true;
+          return;
+        }
+      }
+
+      loaded_models_ = true;
       if(hasMulti) {
-        kmodel_ = new planning_models::KinematicModel(*urdf_, group_configs, multi_dof_configs);
+        kmodel_ = new planning_models::KinematicModel(*urdf_, group_configs, multi_dof_configs, load_geometry_);
+        boost::mutex::scoped_lock slock(model_cache_lock_);
+        ModelCacheEntry& entry = model_cache_[cache_key];
+        entry.urdf = urdf_;
+        entry.kmodel.reset(new planning_models::KinematicModel(*kmodel_));
       } else {
         ROS_WARN("Can't do anything without a root transform");
       }
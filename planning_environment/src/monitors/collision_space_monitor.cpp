@@ -35,6 +35,7 @@
 /** \author Ioan Sucan, E. Gil Jones */
 #include <boost/bind.hpp>
 #include <climits>
+#include <cmath>
 #include <sstream>
 
 #include <planning_environment/monitors/collision_space_monitor.h>
@@ -47,6 +48,16 @@ static inline double maxCoord(const geometry_msgs::Point32 &point)
 {
   return std::max(std::max(point.x, point.y), point.z);
 }
+
+static inline long long voxelKey(const geometry_msgs::Point32 &point, double resolution)
+{
+  // quantize the center so the same voxel sent in different deltas
+  // maps to the same key; 21 bits per (offset) coordinate
+  long long x = (long long)floor(point.x / resolution + 0.5) + (1 << 20);
+  long long y = (long long)floor(point.y / resolution + 0.5) + (1 << 20);
+  long long z = (long long)floor(point.z / resolution + 0.5) + (1 << 20);
+  return (x << 42) | (y << 21) | z;
+}
 }
 
 void planning_environment::CollisionSpaceMonitor::setupCSM(void)
@@ -55,10 +66,12 @@ void planning_environment::CollisionSpaceMonitor::setupCSM(void)
 
   collisionMapFilter_ = NULL;
   collisionMapUpdateFilter_ = NULL;
+  collisionMapDeltaFilter_ = NULL;
   collisionObjectFilter_ = NULL;
-    
+
   collisionMapSubscriber_ = NULL;
   collisionMapUpdateSubscriber_ = NULL;
+  collisionMapDeltaSubscriber_ = NULL;
   collisionObjectSubscriber_ = NULL;
     
   have_map_ = false;
@@ -82,6 +95,11 @@ void planning_environment::CollisionSpaceMonitor::startEnvironmentMonitor(void)
     collisionMapUpdateFilter_ = new tf::MessageFilter<arm_navigation_msgs::CollisionMap>(*collisionMapUpdateSubscriber_, *tf_, cm_->getWorldFrameId(), 1);
     collisionMapUpdateFilter_->registerCallback(boost::bind(&CollisionSpaceMonitor::collisionMapUpdateCallback, this, _1));
     ROS_DEBUG("Listening to collision_map_update using message notifier with target frame %s", collisionMapUpdateFilter_->getTargetFramesString().c_str());
+
+    collisionMapDeltaSubscriber_ = new message_filters::Subscriber<arm_navigation_msgs::CollisionMapDelta>(root_handle_, "collision_map_occ_delta", 1024);
+    collisionMapDeltaFilter_ = new tf::MessageFilter<arm_navigation_msgs::CollisionMapDelta>(*collisionMapDeltaSubscriber_, *tf_, cm_->getWorldFrameId(), 1024);
+    collisionMapDeltaFilter_->registerCallback(boost::bind(&CollisionSpaceMonitor::collisionMapDeltaCallback, this, _1));
+    ROS_DEBUG("Listening to collision_map_occ_delta using message notifier with target frame %s", collisionMapDeltaFilter_->getTargetFramesString().c_str());
   }
 
   collisionObjectSubscriber_ = new message_filters::Subscriber<arm_navigation_msgs::CollisionObject>(root_handle_, "collision_object", 1024);
@@ -113,7 +131,20 @@ void planning_environment::CollisionSpaceMonitor::setUseCollisionMap(bool use_co
     collisionMapUpdateFilter_ = new tf::MessageFilter<arm_navigation_msgs::CollisionMap>(*collisionMapUpdateSubscriber_, *tf_, cm_->getWorldFrameId(), 1);
     collisionMapUpdateFilter_->registerCallback(boost::bind(&CollisionSpaceMonitor::collisionMapUpdateCallback, this, _1));
     ROS_DEBUG("Listening to collision_map_update using message notifier with target frame %s", collisionMapUpdateFilter_->getTargetFramesString().c_str());
+
+    collisionMapDeltaSubscriber_ = new message_filters::Subscriber<arm_navigation_msgs::CollisionMapDelta>(root_handle_, "collision_map_occ_delta", 1);
+    collisionMapDeltaFilter_ = new tf::MessageFilter<arm_navigation_msgs::CollisionMapDelta>(*collisionMapDeltaSubscriber_, *tf_, cm_->getWorldFrameId(), 1);
+    collisionMapDeltaFilter_->registerCallback(boost::bind(&CollisionSpaceMonitor::collisionMapDeltaCallback, this, _1));
+    ROS_DEBUG("Listening to collision_map_occ_delta using message notifier with target frame %s", collisionMapDeltaFilter_->getTargetFramesString().c_str());
   } else {
+    if(collisionMapDeltaFilter_) {
+      delete collisionMapDeltaFilter_;
+      collisionMapDeltaFilter_ = NULL;
+    }
+    if(collisionMapDeltaSubscriber_) {
+      delete collisionMapDeltaSubscriber_;
+      collisionMapDeltaSubscriber_ = NULL;
+    }
     if(collisionMapUpdateFilter_) {
       delete collisionMapUpdateFilter_;
       collisionMapUpdateFilter_ = NULL;
@@ -138,7 +169,15 @@ void planning_environment::CollisionSpaceMonitor::stopEnvironmentMonitor(void)
 {
   if (!envMonitorStarted_)
     return;
-    
+
+  if(collisionMapDeltaFilter_) {
+    delete collisionMapDeltaFilter_;
+    collisionMapDeltaFilter_ = NULL;
+  }
+  if(collisionMapDeltaSubscriber_) {
+    delete collisionMapDeltaSubscriber_;
+    collisionMapDeltaSubscriber_ = NULL;
+  }
   if(collisionMapUpdateFilter_) {
     delete collisionMapUpdateFilter_;
     collisionMapUpdateFilter_ = NULL;
@@ -229,6 +268,43 @@ void planning_environment::CollisionSpaceMonitor::collisionMapCallback(const arm
   updateCollisionSpace(collisionMap, true);
 }
 
+void planning_environment::CollisionSpaceMonitor::collisionMapDeltaCallback(const arm_navigation_msgs::CollisionMapDeltaConstPtr &delta)
+{
+  // keyframes (and frame changes, which make accumulated voxels
+  // meaningless) restart the accumulated state
+  if (delta->keyframe || delta->header.frame_id != delta_map_frame_)
+  {
+    delta_map_voxels_.clear();
+    delta_map_frame_ = delta->header.frame_id;
+  }
+
+  for (unsigned int i = 0 ; i < delta->removed.size() ; ++i)
+    delta_map_voxels_.erase(voxelKey(delta->removed[i], delta->resolution));
+  for (unsigned int i = 0 ; i < delta->added.size() ; ++i)
+    delta_map_voxels_[voxelKey(delta->added[i], delta->resolution)] = delta->added[i];
+
+  // reconstitute the full map and hand it to the usual ingestion path
+  arm_navigation_msgs::CollisionMap cmap;
+  cmap.header = delta->header;
+  cmap.boxes.resize(delta_map_voxels_.size());
+  unsigned int i = 0;
+  for (std::map<long long, geometry_msgs::Point32>::const_iterator it = delta_map_voxels_.begin() ; it != delta_map_voxels_.end() ; ++it, ++i)
+  {
+    cmap.boxes[i].center = it->second;
+    cmap.boxes[i].extents.x = cmap.boxes[i].extents.y = cmap.boxes[i].extents.z = delta->resolution;
+    cmap.boxes[i].axis.x = cmap.boxes[i].axis.y = 0.0;
+    cmap.boxes[i].axis.z = 1.0;
+    cmap.boxes[i].angle = 0.0;
+  }
+
+  std::vector<shapes::Shape*> shapes;
+  std::vector<tf::Transform> poses;
+  collisionMapAsBoxes(cmap, shapes, poses);
+  cm_->updateCollisionMap(shapes, poses, delta->resolution);
+  last_map_update_ = delta->header.stamp;
+  have_map_ = true;
+}
+
 void planning_environment::CollisionSpaceMonitor::collisionMapAsSpheres(const arm_navigation_msgs::CollisionMapConstPtr &collisionMap,
                                                                         std::vector<shapes::Shape*> &spheres, std::vector<tf::Transform> &poses)
 {
@@ -354,10 +430,13 @@ void planning_environment::CollisionSpaceMonitor::updateCollisionSpace(const arm
 { 
   std::vector<shapes::Shape*> shapes;
   std::vector<tf::Transform> poses;
-  
+
   collisionMapAsBoxes(*collision_map, shapes, poses);
-  //not masking here
-  cm_->setCollisionMap(shapes, poses, false);
+  //not masking here; successive maps from the sensor pipeline mostly
+  //repeat each other, so only boxes that changed touch the collision
+  //space
+  double resolution = collision_map->boxes.empty() ? 0.0 : collision_map->boxes[0].extents.x;
+  cm_->updateCollisionMap(shapes, poses, resolution);
   last_map_update_ = collision_map->header.stamp;
   have_map_ = true;
 }
@@ -44,6 +44,7 @@
 #include <ros/package.h>
 #include <std_srvs/Empty.h>
 #include <arm_navigation_msgs/SyncPlanningSceneAction.h>
+#include <arm_navigation_msgs/capture_log.h>
 #include <actionlib/client/simple_action_client.h>
 #include <planning_environment/models/model_utils.h>
 
@@ -53,6 +54,32 @@ static const ros::Duration PLANNING_SCENE_CLIENT_TIMEOUT(5.0);
 
 namespace planning_environment
 {
+
+namespace
+{
+
+//byte-wise comparison through serialization, so scene components (and
+//vectors of messages) compare without per-field code
+template<typename M>
+bool messagesEqual(const M& a, const M& b)
+{
+  uint32_t length = ros::serialization::serializationLength(a);
+  if(length != ros::serialization::serializationLength(b)) {
+    return false;
+  }
+  if(length == 0) {
+    return true;
+  }
+  std::vector<uint8_t> buffer_a(length);
+  std::vector<uint8_t> buffer_b(length);
+  ros::serialization::OStream stream_a(&buffer_a[0], length);
+  ros::serialization::serialize(stream_a, a);
+  ros::serialization::OStream stream_b(&buffer_b[0], length);
+  ros::serialization::serialize(stream_b, b);
+  return memcmp(&buffer_a[0], &buffer_b[0], length) == 0;
+}
+
+}
 class EnvironmentServer
 {
 public:	
@@ -62,6 +89,15 @@ public:
     private_handle_.param<bool>("use_monitor", use_monitor_, true);
     private_handle_.param<bool>("use_collision_map", use_collision_map_, false);
 
+    //when set, every planning scene request is appended to this binary
+    //log so a production session can be replayed by replay_captured_workload
+    std::string capture_file;
+    private_handle_.param<std::string>("capture_file", capture_file, "");
+    if(!capture_file.empty())
+      capture_log_.open(capture_file);
+
+    scene_version_ = 0;
+
     std::string robot_description_name = root_handle_.resolveName("robot_description", true);
 
     collision_models_ = new planning_environment::CollisionModels(robot_description_name);
@@ -119,6 +155,8 @@ private:
       delete sync_planning_scene_clients_[callerid];
     }
     sync_planning_scene_clients_[callerid] = new actionlib::SimpleActionClient<arm_navigation_msgs::SyncPlanningSceneAction>(callerid+"/"+SYNC_PLANNING_SCENE_NAME, true);
+    //a (re)registered client has no cached scene, so its first sync is a keyframe
+    client_scene_versions_[callerid] = 0;
     if(!sync_planning_scene_clients_[callerid]->waitForServer(ros::Duration(10.0))) {
       ROS_INFO_STREAM("Couldn't connect back to action server for " << callerid << ". Removing from list");
       delete sync_planning_scene_clients_[callerid];
@@ -155,6 +193,7 @@ private:
                             arm_navigation_msgs::SetPlanningSceneDiff::Response &res) 
   {
     ros::WallTime s1 = ros::WallTime::now();
+    capture_log_.write(arm_navigation_msgs::CAPTURE_PLANNING_SCENE, req);
     if(use_monitor_) {
       planning_monitor_->getCompletePlanningScene(req.planning_scene_diff,
                                                   req.operations,
@@ -180,12 +219,68 @@ private:
                                                            a_strings);
       }
     }
-    arm_navigation_msgs::SyncPlanningSceneGoal planning_scene_goal;
-    planning_scene_goal.planning_scene = res.planning_scene;
+    scene_version_++;
+
+    arm_navigation_msgs::SyncPlanningSceneGoal full_goal;
+    full_goal.planning_scene = res.planning_scene;
+    full_goal.version = scene_version_;
+    full_goal.base_version = 0;
+
+    //diff against the previously broadcast scene: only components that
+    //changed are carried, which typically drops the collision map and
+    //attached object meshes from the payload
+    arm_navigation_msgs::SyncPlanningSceneGoal diff_goal;
+    diff_goal.version = scene_version_;
+    diff_goal.base_version = scene_version_ - 1;
+    diff_goal.changed_components = 0;
+    if(scene_version_ > 1) {
+      const arm_navigation_msgs::PlanningScene& prev = last_broadcast_scene_;
+      const arm_navigation_msgs::PlanningScene& cur = res.planning_scene;
+      if(!messagesEqual(prev.robot_state, cur.robot_state)) {
+        diff_goal.changed_components |= arm_navigation_msgs::SyncPlanningSceneGoal::ROBOT_STATE;
+        diff_goal.planning_scene.robot_state = cur.robot_state;
+      }
+      if(!messagesEqual(prev.fixed_frame_transforms, cur.fixed_frame_transforms)) {
+        diff_goal.changed_components |= arm_navigation_msgs::SyncPlanningSceneGoal::FIXED_FRAME_TRANSFORMS;
+        diff_goal.planning_scene.fixed_frame_transforms = cur.fixed_frame_transforms;
+      }
+      if(!messagesEqual(prev.allowed_collision_matrix, cur.allowed_collision_matrix)) {
+        diff_goal.changed_components |= arm_navigation_msgs::SyncPlanningSceneGoal::ALLOWED_COLLISION_MATRIX;
+        diff_goal.planning_scene.allowed_collision_matrix = cur.allowed_collision_matrix;
+      }
+      if(!messagesEqual(prev.allowed_contacts, cur.allowed_contacts)) {
+        diff_goal.changed_components |= arm_navigation_msgs::SyncPlanningSceneGoal::ALLOWED_CONTACTS;
+        diff_goal.planning_scene.allowed_contacts = cur.allowed_contacts;
+      }
+      if(!messagesEqual(prev.link_padding, cur.link_padding)) {
+        diff_goal.changed_components |= arm_navigation_msgs::SyncPlanningSceneGoal::LINK_PADDING;
+        diff_goal.planning_scene.link_padding = cur.link_padding;
+      }
+      if(!messagesEqual(prev.collision_objects, cur.collision_objects)) {
+        diff_goal.changed_components |= arm_navigation_msgs::SyncPlanningSceneGoal::COLLISION_OBJECTS;
+        diff_goal.planning_scene.collision_objects = cur.collision_objects;
+      }
+      if(!messagesEqual(prev.attached_collision_objects, cur.attached_collision_objects)) {
+        diff_goal.changed_components |= arm_navigation_msgs::SyncPlanningSceneGoal::ATTACHED_COLLISION_OBJECTS;
+        diff_goal.planning_scene.attached_collision_objects = cur.attached_collision_objects;
+      }
+      if(!messagesEqual(prev.collision_map, cur.collision_map)) {
+        diff_goal.changed_components |= arm_navigation_msgs::SyncPlanningSceneGoal::COLLISION_MAP;
+        diff_goal.planning_scene.collision_map = cur.collision_map;
+      }
+    }
+    last_broadcast_scene_ = res.planning_scene;
+
     for(std::map<std::string, actionlib::SimpleActionClient<arm_navigation_msgs::SyncPlanningSceneAction>* >::iterator it = sync_planning_scene_clients_.begin();
         it != sync_planning_scene_clients_.end();
         it++) {
-      it->second->sendGoal(planning_scene_goal);
+      //clients that acknowledged the previous scene get the diff,
+      //everyone else (fresh registrations, failed applies) a keyframe
+      if(scene_version_ > 1 && client_scene_versions_[it->first] == diff_goal.base_version) {
+        it->second->sendGoal(diff_goal);
+      } else {
+        it->second->sendGoal(full_goal);
+      }
     }
     std::vector<std::string> bad_list;
     for(std::map<std::string, actionlib::SimpleActionClient<arm_navigation_msgs::SyncPlanningSceneAction>* >::iterator it = sync_planning_scene_clients_.begin();
@@ -193,21 +288,35 @@ private:
         it++) {
       if(!it->second->waitForResult(PLANNING_SCENE_CLIENT_TIMEOUT)) {
         unsuccessful_planning_scene_client_replies_[it->first]++;
-        ROS_INFO_STREAM("Did not get reply from planning scene client " << it->first 
+        client_scene_versions_[it->first] = 0;
+        ROS_INFO_STREAM("Did not get reply from planning scene client " << it->first
                         << ".  Incrementing counter to " << unsuccessful_planning_scene_client_replies_[it->first]);
         if(unsuccessful_planning_scene_client_replies_[it->first] > UNSUCCESSFUL_REPLY_LIMIT) {
-          ROS_WARN_STREAM("Failed to get reply from planning scene client " << it->first << " for " 
+          ROS_WARN_STREAM("Failed to get reply from planning scene client " << it->first << " for "
                           << UNSUCCESSFUL_REPLY_LIMIT << " consecutive tries.  Removing");
           bad_list.push_back(it->first);
-        } 
+        }
         continue;
-      } 
+      }
       unsuccessful_planning_scene_client_replies_[it->first] = 0;
+
+      arm_navigation_msgs::SyncPlanningSceneResultConstPtr result = it->second->getResult();
+      if(result && result->need_keyframe) {
+        ROS_DEBUG_STREAM("Planning scene client " << it->first << " could not apply diff, resending keyframe");
+        it->second->sendGoal(full_goal);
+        if(!it->second->waitForResult(PLANNING_SCENE_CLIENT_TIMEOUT)) {
+          client_scene_versions_[it->first] = 0;
+          continue;
+        }
+        result = it->second->getResult();
+      }
+      client_scene_versions_[it->first] = (result && result->ok) ? scene_version_ : 0;
     }
 
     for(unsigned int i = 0; i < bad_list.size(); i++) {
       delete sync_planning_scene_clients_[bad_list[i]];
       sync_planning_scene_clients_.erase(bad_list[i]);
+      client_scene_versions_.erase(bad_list[i]);
     }
     ROS_DEBUG_STREAM("Setting planning scene diff took " << (ros::WallTime::now()-s1).toSec());
     return true;
@@ -231,7 +340,16 @@ private:
   ros::ServiceServer register_planning_scene_service_;
   std::map<std::string, unsigned int> unsuccessful_planning_scene_client_replies_;
   std::map<std::string, actionlib::SimpleActionClient<arm_navigation_msgs::SyncPlanningSceneAction>* > sync_planning_scene_clients_;
-};    
+
+  //scene version counter and the last scene sent out, for diffing;
+  //per-client record of the last version each client acknowledged
+  unsigned int scene_version_;
+  arm_navigation_msgs::PlanningScene last_broadcast_scene_;
+  std::map<std::string, unsigned int> client_scene_versions_;
+
+  //ignores writes unless ~capture_file is set
+  arm_navigation_msgs::CaptureLogWriter capture_log_;
+};
 }
 
 int main(int argc, char** argv)
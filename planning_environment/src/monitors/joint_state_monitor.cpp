@@ -40,7 +40,16 @@
 
 planning_environment::JointStateMonitor::JointStateMonitor()
 {
-  first_time_ = true;  
+  first_time_ = true;
+  ring_head_ = 0;
+  ring_count_ = 0;
+  int buffer_size;
+  root_handle_.param("joint_state_buffer_size", buffer_size, 100);
+  if(buffer_size < 1)
+  {
+    buffer_size = 1;
+  }
+  joint_state_ring_.resize(buffer_size);
   std::string urdf_xml,full_urdf_xml;
   root_handle_.param("urdf_xml",urdf_xml,std::string("robot_description"));
 
@@ -82,6 +91,7 @@ void planning_environment::JointStateMonitor::jointStateCallback(const sensor_ms
     joint_state_.header.frame_id = "base_footprint";
     joint_state_.name = joint_state->name;
     joint_state_.position.resize(joint_state->position.size());
+    joint_continuous_.resize(joint_state->position.size(), false);
     for(unsigned int i=0; i < joint_state_.name.size(); i++)
     {
       joint_state_index_[joint_state_.name[i]] = i;
@@ -91,6 +101,12 @@ void planning_environment::JointStateMonitor::jointStateCallback(const sensor_ms
       {
         joint_real_state_index_.push_back(i);
       }
+      joint_continuous_[i] = (joint->type == urdf::Joint::CONTINUOUS);
+    }
+    //size the ring slots once, so storing a sample never allocates
+    for(unsigned int i=0; i < joint_state_ring_.size(); i++)
+    {
+      joint_state_ring_[i].position.resize(joint_state->position.size());
     }
   }
   joint_state_.header.stamp = ros::Time::now();
@@ -104,6 +120,71 @@ void planning_environment::JointStateMonitor::jointStateCallback(const sensor_ms
   }
   first_time_ = false;
   last_update_ = joint_state->header.stamp;
+
+  TimedJointValues& slot = joint_state_ring_[ring_head_];
+  slot.stamp = joint_state->header.stamp;
+  slot.position = joint_state_.position;
+  ring_head_ = (ring_head_ + 1) % joint_state_ring_.size();
+  if(ring_count_ < joint_state_ring_.size())
+  {
+    ring_count_++;
+  }
+}
+
+bool planning_environment::JointStateMonitor::getInterpolatedState(const ros::Time& time, sensor_msgs::JointState& joint_state)
+{
+  boost::mutex::scoped_lock lock(state_mutex_);
+  if(ring_count_ == 0)
+  {
+    return false;
+  }
+  unsigned int size = joint_state_ring_.size();
+  unsigned int newest = (ring_head_ + size - 1) % size;
+  unsigned int oldest = (ring_head_ + size - ring_count_) % size;
+
+  joint_state.header.frame_id = joint_state_.header.frame_id;
+  joint_state.name = joint_state_.name;
+
+  if(time >= joint_state_ring_[newest].stamp)
+  {
+    joint_state.header.stamp = joint_state_ring_[newest].stamp;
+    joint_state.position = joint_state_ring_[newest].position;
+    return true;
+  }
+  if(time < joint_state_ring_[oldest].stamp)
+  {
+    ROS_WARN("Asking for time older than that contained in joint state buffer");
+    return false;
+  }
+
+  //walk back from the newest sample to the pair bracketing the time
+  unsigned int upper = newest;
+  unsigned int lower = (upper + size - 1) % size;
+  while(joint_state_ring_[lower].stamp > time)
+  {
+    upper = lower;
+    lower = (upper + size - 1) % size;
+  }
+  const TimedJointValues& before = joint_state_ring_[lower];
+  const TimedJointValues& after = joint_state_ring_[upper];
+  double span = (after.stamp - before.stamp).toSec();
+  double fraction = span > 0.0 ? (time - before.stamp).toSec() / span : 0.0;
+
+  joint_state.position.resize(before.position.size());
+  for(unsigned int i=0; i < before.position.size(); i++)
+  {
+    if(joint_continuous_[i])
+    {
+      joint_state.position[i] = angles::normalize_angle(before.position[i] +
+                                                        fraction * angles::shortest_angular_distance(before.position[i], after.position[i]));
+    }
+    else
+    {
+      joint_state.position[i] = before.position[i] + fraction * (after.position[i] - before.position[i]);
+    }
+  }
+  joint_state.header.stamp = time;
+  return true;
 }
 
 sensor_msgs::JointState planning_environment::JointStateMonitor::getJointState()
@@ -35,6 +35,7 @@
 /** \author Ioan Sucan */
 
 #include "planning_environment/monitors/kinematic_model_state_monitor.h"
+#include "planning_environment/monitors/monitor_utils.h"
 #include "planning_environment/util/construct_object.h"
 #include "planning_environment/models/model_utils.h"
 #include <angles/angles.h>
@@ -47,11 +48,19 @@ void planning_environment::KinematicModelStateMonitor::setupRSM(void)
   have_pose_ = have_joint_state_ = false;
     
   printed_out_of_date_ = false;
+  latest_snapshot_index_ = 0;
+  for(unsigned int i = 0; i < 3; i++) {
+    state_snapshot_buffers_[i].sequence = 0;
+  }
   if (rm_->loadedModels())
   {
     kmodel_ = rm_->getKinematicModel();
     robot_frame_ = rm_->getRobotFrameId();
     ROS_INFO("Robot frame is '%s'", robot_frame_.c_str());
+    unsigned int dimension = planning_models::KinematicState(kmodel_).getDimension();
+    for(unsigned int i = 0; i < 3; i++) {
+      state_snapshot_buffers_[i].values.reserve(dimension);
+    }
     startStateMonitor();
   } else {
     ROS_INFO("Can't start state monitor yet");
@@ -117,55 +126,51 @@ void planning_environment::KinematicModelStateMonitor::jointStateCallback(const
   }
 
   std::vector<planning_models::KinematicState::JointState*>& joint_state_vector = state.getJointStateVector();
-  
+
+  //resolve all the tf-driven joints in one batch so the listener's
+  //lock is taken in a single burst rather than once per joint
+  std::vector<TransformLookup> tf_lookups;
+  std::vector<planning_models::KinematicState::JointState*> tf_joints;
   for(std::vector<planning_models::KinematicState::JointState*>::iterator it = joint_state_vector.begin();
       it != joint_state_vector.end();
       it++) {
-    bool tfSets = false;
-    bool joint_state_sets = false;
-    //see if we need to update any transforms
     std::string parent_frame_id = (*it)->getParentFrameId();
     std::string child_frame_id = (*it)->getChildFrameId();
     if(!parent_frame_id.empty() && !child_frame_id.empty()) {
-      std::string err;
-      ros::Time tm;
-      tf::StampedTransform transf;
-      bool ok = false;
-      if (tf_->getLatestCommonTime(parent_frame_id, child_frame_id, tm, &err) == tf::NO_ERROR) {
-        ok = true;
-        try
-        {
-          tf_->lookupTransform(parent_frame_id, child_frame_id, tm, transf);
-        }
-        catch(tf::TransformException& ex)
-        {
-          ROS_ERROR("Unable to lookup transform from %s to %s.  Exception: %s", parent_frame_id.c_str(), child_frame_id.c_str(), ex.what());
-          ok = false;
-        }
-      } else {
-        ROS_DEBUG("Unable to lookup transform from %s to %s: no common time.", parent_frame_id.c_str(), child_frame_id.c_str());
-        ok = false;
-      }
-      if(ok) {
-        tfSets = (*it)->setJointStateValues(transf);
-        if(tfSets) {
-          const std::vector<std::string>& joint_state_names = (*it)->getJointStateNameOrder();
-          for(std::vector<std::string>::const_iterator it = joint_state_names.begin();
-              it != joint_state_names.end();
-              it++) {
-            last_joint_update_[*it] = tm;
-          }
-        }
-        // tf::Transform transf = getKinematicModel()->getRoot()->variable_transform;
-        // ROS_INFO_STREAM("transform is to " << transf.getRotation().x() << " " 
-        //                 << transf.getRotation().y() << " z " << transf.getRotation().z()
-        //                 << " w " << transf.getRotation().w());
-        have_pose_ = tfSets;
-        last_pose_update_ = tm;
+      TransformLookup lookup;
+      lookup.target_frame = parent_frame_id;
+      lookup.source_frame = child_frame_id;
+      tf_lookups.push_back(lookup);
+      tf_joints.push_back(*it);
+    }
+  }
+  if(!tf_lookups.empty()) {
+    lookupTransformsBatch(*tf_, tf_lookups);
+  }
+  for(unsigned int i = 0; i < tf_joints.size(); i++) {
+    if(!tf_lookups[i].ok) continue;
+    bool tfSets = tf_joints[i]->setJointStateValues(tf_lookups[i].transform);
+    if(tfSets) {
+      const std::vector<std::string>& joint_state_names = tf_joints[i]->getJointStateNameOrder();
+      for(std::vector<std::string>::const_iterator it = joint_state_names.begin();
+          it != joint_state_names.end();
+          it++) {
+        last_joint_update_[*it] = tf_lookups[i].transform.stamp_;
       }
     }
+    // tf::Transform transf = getKinematicModel()->getRoot()->variable_transform;
+    // ROS_INFO_STREAM("transform is to " << transf.getRotation().x() << " "
+    //                 << transf.getRotation().y() << " z " << transf.getRotation().z()
+    //                 << " w " << transf.getRotation().w());
+    have_pose_ = tfSets;
+    last_pose_update_ = tf_lookups[i].transform.stamp_;
+  }
+
+  for(std::vector<planning_models::KinematicState::JointState*>::iterator it = joint_state_vector.begin();
+      it != joint_state_vector.end();
+      it++) {
     //now we update from joint state
-    joint_state_sets = (*it)->setJointStateValues(joint_state_map);
+    bool joint_state_sets = (*it)->setJointStateValues(joint_state_map);
     if(joint_state_sets) {
       const std::vector<std::string>& joint_state_names = (*it)->getJointStateNameOrder();
       for(std::vector<std::string>::const_iterator it = joint_state_names.begin();
@@ -179,6 +184,15 @@ void planning_environment::KinematicModelStateMonitor::jointStateCallback(const
   state.updateKinematicLinks();
   state.getKinematicStateValues(current_joint_state_map_);
 
+  //publish the new values into the next snapshot buffer so readers
+  //never have to wait for the lock this callback holds
+  unsigned int next_snapshot = (latest_snapshot_index_ + 1) % 3;
+  StateSnapshotBuffer& snapshot = state_snapshot_buffers_[next_snapshot];
+  snapshot.sequence++;
+  state.getKinematicStateValues(snapshot.values);
+  snapshot.sequence++;
+  latest_snapshot_index_ = next_snapshot;
+
   if(allJointsUpdated()) {
     have_joint_state_ = true;
     last_joint_state_update_ = joint_state->header.stamp;
@@ -249,9 +263,26 @@ bool planning_environment::KinematicModelStateMonitor::allJointsUpdated(ros::Dur
 
 void planning_environment::KinematicModelStateMonitor::setStateValuesFromCurrentValues(planning_models::KinematicState& state) const
 {
-  current_joint_values_lock_.lock();
-  state.setKinematicState(current_joint_state_map_);
-  current_joint_values_lock_.unlock();
+  //snapshot the latest published buffer; if the subscriber reuses the
+  //buffer while we copy, its sequence counter moves and we try again
+  std::vector<double> values;
+  while(true) {
+    unsigned int index = latest_snapshot_index_;
+    const StateSnapshotBuffer& snapshot = state_snapshot_buffers_[index];
+    unsigned int sequence = snapshot.sequence;
+    if(sequence == 0) {
+      //no state has been received yet
+      return;
+    }
+    if(sequence & 1) {
+      continue;
+    }
+    values = snapshot.values;
+    if(snapshot.sequence == sequence) {
+      break;
+    }
+  }
+  state.setKinematicState(values);
 }
 
 
@@ -66,7 +66,59 @@ bool planning_environment::getLatestIdentityTransform(const std::string& to_fram
   tf::poseMsgToTF(trans_pose.pose, pose);
   return true;
 }
-                                                
+
+unsigned int planning_environment::lookupTransformsBatch(const tf::TransformListener& tf,
+                                                         std::vector<TransformLookup>& lookups,
+                                                         const ros::Duration& timeout)
+{
+  //one shared deadline for the whole set instead of a full timeout
+  //per pair; canTransform is a cheap availability check
+  if(!timeout.isZero()) {
+    ros::Time deadline = ros::Time::now() + timeout;
+    while(true) {
+      bool all_ready = true;
+      for(unsigned int i = 0; i < lookups.size(); i++) {
+        if(!lookups[i].stamp.isZero() &&
+           !tf.canTransform(lookups[i].target_frame, lookups[i].source_frame, lookups[i].stamp)) {
+          all_ready = false;
+          break;
+        }
+      }
+      if(all_ready || ros::Time::now() >= deadline) {
+        break;
+      }
+      ros::Duration(0.01).sleep();
+    }
+  }
+
+  //the lookups run back to back so the listener's cache stays warm
+  //and its lock is taken in one short burst
+  unsigned int resolved = 0;
+  for(unsigned int i = 0; i < lookups.size(); i++) {
+    TransformLookup& lookup = lookups[i];
+    lookup.ok = false;
+    ros::Time tm = lookup.stamp;
+    if(tm.isZero()) {
+      std::string err;
+      if(tf.getLatestCommonTime(lookup.target_frame, lookup.source_frame, tm, &err) != tf::NO_ERROR) {
+        ROS_DEBUG("Unable to lookup transform from %s to %s: no common time.",
+                  lookup.target_frame.c_str(), lookup.source_frame.c_str());
+        continue;
+      }
+    }
+    try {
+      tf.lookupTransform(lookup.target_frame, lookup.source_frame, tm, lookup.transform);
+      lookup.ok = true;
+      resolved++;
+    } catch(tf::TransformException& ex) {
+      ROS_ERROR("Unable to lookup transform from %s to %s.  Exception: %s",
+                lookup.target_frame.c_str(), lookup.source_frame.c_str(), ex.what());
+    }
+  }
+  return resolved;
+}
+
+
 bool planning_environment::createAndPoseShapes(tf::TransformListener& tf,
                                                const std::vector<arm_navigation_msgs::Shape>& orig_shapes,
                                                const std::vector<geometry_msgs::Pose>& orig_poses,
@@ -385,6 +437,90 @@ bool planning_environment::computeAttachedObjectPointCloudMask(const pcl::PointC
   return true;
 }
 
+planning_environment::SharedBodyCache::SharedBodyCache(planning_environment::CollisionModels* cm,
+                                                       tf::TransformListener& tf)
+  : cm_(cm), tf_(tf), state_(cm->getKinematicModel())
+{
+  have_last_update_ = false;
+  last_scene_version_ = 0;
+  last_sensor_pos_.setValue(0.0, 0.0, 0.0);
+}
+
+bool planning_environment::SharedBodyCache::prepareForStamp(const std::string& sensor_frame,
+                                                            const ros::Time& stamp,
+                                                            tf::Vector3& sensor_pos)
+{
+  boost::mutex::scoped_lock lock(cache_lock_);
+  if(have_last_update_ && stamp == last_stamp_ && sensor_frame == last_sensor_frame_ &&
+     cm_->getCollisionSceneVersion() == last_scene_version_) {
+    //another consumer already posed the bodies for this cloud
+    sensor_pos = last_sensor_pos_;
+    return true;
+  }
+  if(!configureForAttachedBodyMask(state_, cm_, tf_, sensor_frame, stamp, last_sensor_pos_)) {
+    have_last_update_ = false;
+    return false;
+  }
+  last_stamp_ = stamp;
+  last_sensor_frame_ = sensor_frame;
+  last_scene_version_ = cm_->getCollisionSceneVersion();
+  have_last_update_ = true;
+  sensor_pos = last_sensor_pos_;
+  return true;
+}
+
+bool planning_environment::SharedBodyCache::computePointCloudMask(const pcl::PointCloud<pcl::PointXYZ>& pcl_cloud,
+                                                                  const std::string& sensor_frame,
+                                                                  std::vector<int>& mask)
+{
+  int n = pcl_cloud.points.size();
+  mask.resize(n, robot_self_filter::OUTSIDE);
+
+  tf::Vector3 sensor_pos;
+  prepareForStamp(sensor_frame, ros::Time(pcl_cloud.header.stamp), sensor_pos);
+
+  if (cm_->getWorldFrameId() != pcl_cloud.header.frame_id) {
+    pcl::PointCloud<pcl::PointXYZ> trans_cloud = pcl_cloud;
+    pcl_ros::transformPointCloud(cm_->getWorldFrameId(), pcl_cloud, trans_cloud, tf_);
+    for (int i = 0 ; i < n ; ++i) {
+      tf::Vector3 pt = tf::Vector3(trans_cloud.points[i].x, trans_cloud.points[i].y, trans_cloud.points[i].z);
+      mask[i] = computeAttachedObjectPointMask(cm_, pt, sensor_pos);
+    }
+  } else {
+    for (int i = 0 ; i < n ; ++i) {
+      tf::Vector3 pt = tf::Vector3(pcl_cloud.points[i].x, pcl_cloud.points[i].y, pcl_cloud.points[i].z);
+      mask[i] = computeAttachedObjectPointMask(cm_, pt, sensor_pos);
+    }
+  }
+  return true;
+}
+
+planning_environment::TrajectoryStateApplicator::TrajectoryStateApplicator(planning_models::KinematicState& state,
+                                                                           const std::vector<std::string>& joint_names)
+  : state_(state), valid_(true)
+{
+  joints_.resize(joint_names.size());
+  for(unsigned int j = 0; j < joint_names.size(); j++) {
+    joints_[j] = state.getJointState(joint_names[j]);
+    if(joints_[j] == NULL || joints_[j]->getDimension() != 1) {
+      valid_ = false;
+      return;
+    }
+  }
+}
+
+bool planning_environment::TrajectoryStateApplicator::applyPoint(const trajectory_msgs::JointTrajectoryPoint& point)
+{
+  if(!valid_ || point.positions.size() != joints_.size()) {
+    return false;
+  }
+  for(unsigned int j = 0; j < joints_.size(); j++) {
+    joints_[j]->setJointStateValue(0, point.positions[j]);
+  }
+  state_.updateKinematicLinks();
+  return true;
+}
+
 int planning_environment::closestStateOnTrajectory(const boost::shared_ptr<urdf::Model> &model,
                                                    const trajectory_msgs::JointTrajectory &trajectory, 
                                                    const sensor_msgs::JointState &joint_state, 
@@ -395,11 +531,14 @@ int planning_environment::closestStateOnTrajectory(const boost::shared_ptr<urdf:
   int    pos  = -1;
   
   std::map<std::string, double> current_state_map;
-  std::map<std::string, bool> continuous;
   for(unsigned int i = 0; i < joint_state.name.size(); i++) {
     current_state_map[joint_state.name[i]] = joint_state.position[i];
   }
 
+  //resolve each trajectory joint against the model and the current
+  //state once, so the per-point loop below is flat array arithmetic
+  std::vector<double> current_positions(trajectory.joint_names.size(), 0.0);
+  std::vector<bool> continuous(trajectory.joint_names.size(), false);
   for(unsigned int j = 0; j < trajectory.joint_names.size(); j++) {
     std::string name = trajectory.joint_names[j];
     boost::shared_ptr<const urdf::Joint> joint = model->getJoint(name);
@@ -408,23 +547,19 @@ int planning_environment::closestStateOnTrajectory(const boost::shared_ptr<urdf:
       ROS_ERROR("Joint name %s not found in urdf model", name.c_str());
       return false;
     }
-    if (joint->type == urdf::Joint::CONTINUOUS) {
-      continuous[name] = true;
-    } else {
-      continuous[name] = false;
-    }
-
+    continuous[j] = (joint->type == urdf::Joint::CONTINUOUS);
+    current_positions[j] = current_state_map[name];
   }
 
   for (unsigned int i = start ; i <= end ; ++i)
   {
     double d = 0.0;
     for(unsigned int j = 0; j < trajectory.joint_names.size(); j++) {
-      double diff; 
-      if(!continuous[trajectory.joint_names[j]]) {
-        diff = fabs(trajectory.points[i].positions[j] - current_state_map[trajectory.joint_names[j]]);
+      double diff;
+      if(!continuous[j]) {
+        diff = fabs(trajectory.points[i].positions[j] - current_positions[j]);
       } else {
-        diff = angles::shortest_angular_distance(trajectory.points[i].positions[j],current_state_map[trajectory.joint_names[j]]);
+        diff = angles::shortest_angular_distance(trajectory.points[i].positions[j],current_positions[j]);
       }
       d += diff * diff;
     }
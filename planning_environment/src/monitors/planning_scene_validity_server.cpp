@@ -44,6 +44,12 @@
 
 namespace planning_environment
 {
+
+//cap on the contacts reported in a validity response - enough for a
+//caller to see what is colliding without letting a deeply penetrating
+//state blow the service deadline
+static const unsigned int MAX_REPORTED_CONTACTS = 50;
+
 class PlanningSceneValidityServer
 {
 public:	
@@ -147,8 +153,9 @@ public:
                                                        true);
     if(res.error_code.val == arm_navigation_msgs::ArmNavigationErrorCodes::COLLISION_CONSTRAINTS_VIOLATED) {
       collision_models_interface_->getAllCollisionsForState(*collision_models_interface_->getPlanningSceneState(),
-                                                            res.contacts, 
-                                                            1);
+                                                            res.contacts,
+                                                            1,
+                                                            MAX_REPORTED_CONTACTS);
     }
     collision_models_interface_->bodiesUnlock();
     return true;
@@ -62,6 +62,7 @@ public:
   FilterAttachedObjects(void): priv_handle_("~")
   {    
     cm_ = new planning_environment::CollisionModels("robot_description");
+    body_cache_ = new planning_environment::SharedBodyCache(cm_, tf_);
     priv_handle_.param<std::string>("sensor_frame", sensor_frame_, std::string());
     
     cloud_publisher_ = root_handle_.advertise<sensor_msgs::PointCloud2>("cloud_out", 1);	    
@@ -92,6 +93,7 @@ public:
     delete cloud_subscriber_;
     delete attached_collision_object_subscriber_;
     delete collision_object_subscriber_;
+    delete body_cache_;
     delete cm_;
   }
         
@@ -133,11 +135,9 @@ public:
 
     std::vector<int> mask;
 
-    if(planning_environment::computeAttachedObjectPointCloudMask(pcl_cloud, 
-                                                                 sensor_frame_,
-                                                                 cm_,
-                                                                 tf_,
-                                                                 mask)) {
+    if(body_cache_->computePointCloudMask(pcl_cloud,
+                                          sensor_frame_,
+                                          mask)) {
       // publish new cloud
       const unsigned int np = pcl_cloud.size();
             
@@ -190,6 +190,7 @@ public:
   ros::NodeHandle root_handle_;
   tf::TransformListener tf_;
   planning_environment::CollisionModels *cm_;
+  planning_environment::SharedBodyCache *body_cache_;
 
   message_filters::Subscriber<sensor_msgs::PointCloud2> *cloud_subscriber_;
   tf::MessageFilter<sensor_msgs::PointCloud2> *cloud_filter_;
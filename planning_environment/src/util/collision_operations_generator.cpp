@@ -40,13 +40,33 @@
 #include <planning_environment/util/collision_operations_generator.h>
 #include <yaml-cpp/yaml.h>
 
+#include <boost/thread/thread.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/bind.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_real.hpp>
+#include <algorithm>
+
 using namespace planning_environment;
 
+namespace
+{
+//one generator per thread, so sampling workers never contend or share state
+boost::thread_specific_ptr<boost::mt19937> g_sampling_rng;
+
+boost::mt19937& samplingRNG(void)
+{
+  if(g_sampling_rng.get() == NULL) {
+    g_sampling_rng.reset(new boost::mt19937(static_cast<unsigned long>(ros::WallTime::now().toNSec())));
+  }
+  return *g_sampling_rng;
+}
+}
+
 inline double gen_rand(double min, double max)
 {
-  int rand_num = rand()%100+1;
-  double result = min + (double)((max-min)*rand_num)/101.0;
-  return result;
+  boost::uniform_real<double> dist(min, max);
+  return dist(samplingRNG());
 }
 
 CollisionOperationsGenerator::CollisionOperationsGenerator(planning_environment::CollisionModels* cm) 
@@ -283,12 +303,66 @@ void CollisionOperationsGenerator::generateSamplingStructures(const std::map<std
 
 void CollisionOperationsGenerator::sampleAndCountCollisions(unsigned int num) {
   resetCountingMap();
-  
+
+  //each worker samples through its own per-thread clone of the
+  //environment and its own RNG, so no locking happens during sampling
+  unsigned int num_threads = boost::thread::hardware_concurrency();
+  if(num_threads == 0) {
+    num_threads = 1;
+  }
+  const unsigned int min_samples_per_thread = 100;
+  if(num / min_samples_per_thread < num_threads) {
+    num_threads = std::max(num / min_samples_per_thread, (unsigned int) 1);
+  }
+
+  std::vector<std::map<std::string, std::map<std::string, unsigned int> > > counts(num_threads);
+  std::vector<std::map<std::string, std::map<std::string, CollidingJointValues> > > joint_values(num_threads);
+
+  if(num_threads == 1) {
+    sampleAndCountCollisionsRange(num, counts[0], joint_values[0]);
+  } else {
+    boost::thread_group workers;
+    for(unsigned int i = 0; i < num_threads; i++) {
+      unsigned int this_num = num/num_threads + (i < num%num_threads ? 1 : 0);
+      workers.create_thread(boost::bind(&CollisionOperationsGenerator::sampleAndCountCollisionsRange, this,
+                                        this_num, boost::ref(counts[i]), boost::ref(joint_values[i])));
+    }
+    workers.join_all();
+  }
+
+  for(unsigned int i = 0; i < num_threads; i++) {
+    for(std::map<std::string, std::map<std::string, unsigned int> >::iterator it = counts[i].begin();
+        it != counts[i].end();
+        it++) {
+      if(collision_count_map_.find(it->first) == collision_count_map_.end()) {
+        ROS_WARN_STREAM("Problem - have no count for collision body " << it->first);
+      }
+      for(std::map<std::string, unsigned int>::iterator it2 = it->second.begin();
+          it2 != it->second.end();
+          it2++) {
+        collision_count_map_[it->first][it2->first] += it2->second;
+      }
+    }
+    for(std::map<std::string, std::map<std::string, CollidingJointValues> >::iterator it = joint_values[i].begin();
+        it != joint_values[i].end();
+        it++) {
+      for(std::map<std::string, CollidingJointValues>::iterator it2 = it->second.begin();
+          it2 != it->second.end();
+          it2++) {
+        collision_joint_values_[it->first][it2->first] = it2->second;
+      }
+    }
+  }
+}
+
+void CollisionOperationsGenerator::sampleAndCountCollisionsRange(unsigned int num,
+                                                                 std::map<std::string, std::map<std::string, unsigned int> >& counts,
+                                                                 std::map<std::string, std::map<std::string, CollidingJointValues> >& joint_values) {
   planning_models::KinematicState state(cm_->getKinematicModel());
-  
+
   for(unsigned int i = 0; i < num; i++) {
     generateRandomState(state);
-    
+
     std::vector<arm_navigation_msgs::ContactInformation> contacts;
     cm_->getAllCollisionsForState(state,
                                   contacts);
@@ -296,21 +370,15 @@ void CollisionOperationsGenerator::sampleAndCountCollisions(unsigned int num) {
     if(i != 0 && i % 10000 == 0) {
       ROS_INFO_STREAM("On iteration " << i);
     }
-    
-    for(unsigned int i = 0; i < contacts.size(); i++) {
-      arm_navigation_msgs::ContactInformation& contact = contacts[i];
-      if(collision_count_map_.find(contact.contact_body_1) == collision_count_map_.end()) {
-        ROS_WARN_STREAM("Problem - have no count for collision body " << contact.contact_body_1);
-      }
-      if(collision_count_map_.find(contact.contact_body_2) == collision_count_map_.end()) {
-        ROS_WARN_STREAM("Problem - have no count for collision body " << contact.contact_body_2);
-      }
-      collision_count_map_[contact.contact_body_1][contact.contact_body_2]++;
-      collision_count_map_[contact.contact_body_2][contact.contact_body_1]++;
+
+    for(unsigned int j = 0; j < contacts.size(); j++) {
+      arm_navigation_msgs::ContactInformation& contact = contacts[j];
+      counts[contact.contact_body_1][contact.contact_body_2]++;
+      counts[contact.contact_body_2][contact.contact_body_1]++;
       CollidingJointValues cjv;
       state.getKinematicStateValues(cjv);
-      collision_joint_values_[contact.contact_body_1][contact.contact_body_2] = cjv;
-      collision_joint_values_[contact.contact_body_2][contact.contact_body_1] = cjv;
+      joint_values[contact.contact_body_1][contact.contact_body_2] = cjv;
+      joint_values[contact.contact_body_2][contact.contact_body_1] = cjv;
     }
   }
 }
@@ -38,6 +38,7 @@
 #include <geometric_shapes/shape_operations.h>
 #include <tf/transform_datatypes.h>
 #include <angles/angles.h>
+#include <algorithm>
 #include <cassert>
 
 bool planning_environment::JointConstraintEvaluator::use(const arm_navigation_msgs::JointConstraint &jc)
@@ -46,15 +47,26 @@ bool planning_environment::JointConstraintEvaluator::use(const arm_navigation_ms
   return true;
 }
 
-bool planning_environment::JointConstraintEvaluator::decide(const planning_models::KinematicState* state, 
+void planning_environment::JointConstraintEvaluator::compile(const planning_models::KinematicState* state)
+{
+  m_joint_index = state->getJointIndex(m_jc.joint_name);
+  m_continuous = false;
+  if(m_joint_index >= 0) {
+    const planning_models::KinematicModel::RevoluteJointModel *revolute_joint =
+      dynamic_cast<const planning_models::KinematicModel::RevoluteJointModel*>(state->getJointState((unsigned int)m_joint_index)->getJointModel());
+    m_continuous = revolute_joint != NULL && revolute_joint->continuous_;
+  }
+}
+
+bool planning_environment::JointConstraintEvaluator::decide(const planning_models::KinematicState* state,
                                                             bool verbose) const
 {
-  std::vector<double> cur_joint_values;
-  const planning_models::KinematicState::JointState* joint = state->getJointState(m_jc.joint_name);
+  const planning_models::KinematicState::JointState* joint =
+    m_joint_index >= 0 ? state->getJointState((unsigned int)m_joint_index) : state->getJointState(m_jc.joint_name);
   if(!joint) {
     ROS_WARN_STREAM("No joint in state with name " << m_jc.joint_name);
   }
-  cur_joint_values = joint->getJointStateValues();
+  const std::vector<double>& cur_joint_values = joint->getJointStateValues();
 
   if(cur_joint_values.size() == 0) {
     ROS_WARN_STREAM("Trying to decide joint with no value " << joint->getName());
@@ -65,10 +77,16 @@ bool planning_environment::JointConstraintEvaluator::decide(const planning_model
 
   double current_joint_position = cur_joint_values[0];
   double dif;
-  
-  const planning_models::KinematicModel::RevoluteJointModel *revolute_joint = dynamic_cast<const planning_models::KinematicModel::RevoluteJointModel*>(joint->getJointModel());
 
-  if(revolute_joint && revolute_joint->continuous_)
+  bool continuous;
+  if(m_joint_index >= 0) {
+    continuous = m_continuous;
+  } else {
+    const planning_models::KinematicModel::RevoluteJointModel *revolute_joint = dynamic_cast<const planning_models::KinematicModel::RevoluteJointModel*>(joint->getJointModel());
+    continuous = revolute_joint != NULL && revolute_joint->continuous_;
+  }
+
+  if(continuous)
     dif = angles::shortest_angular_distance(m_jc.position,current_joint_position);
   else
     dif = current_joint_position - m_jc.position;
@@ -194,6 +212,7 @@ bool planning_environment::OrientationConstraintEvaluator::use(const arm_navigat
   tf::Quaternion q;
   tf::quaternionMsgToTF(m_oc.orientation,q);
   m_rotation_matrix = tf::Matrix3x3(q);
+  m_rotation_matrix_inverse = m_rotation_matrix.inverse();
   geometry_msgs::Pose id;
   id.orientation.w = 1.0;
   ROS_DEBUG("Orientation constraint: %f %f %f %f",m_oc.orientation.x,m_oc.orientation.y,m_oc.orientation.z,m_oc.orientation.w);
@@ -208,12 +227,23 @@ void planning_environment::OrientationConstraintEvaluator::clear(void)
 {
 }
 
+void planning_environment::PositionConstraintEvaluator::compile(const planning_models::KinematicState* state)
+{
+  m_link_index = state->getLinkIndex(m_pc.link_name);
+}
+
+void planning_environment::OrientationConstraintEvaluator::compile(const planning_models::KinematicState* state)
+{
+  m_link_index = state->getLinkIndex(m_oc.link_name);
+}
+
 bool planning_environment::PositionConstraintEvaluator::decide(const planning_models::KinematicState  *state,
                                                                bool verbose) const
 {
-  const planning_models::KinematicState::LinkState* link_state = state->getLinkState(m_pc.link_name);
+  const planning_models::KinematicState::LinkState* link_state =
+    m_link_index >= 0 ? state->getLinkState((unsigned int)m_link_index) : state->getLinkState(m_pc.link_name);
 
-  if(!link_state) 
+  if(!link_state)
   {
     ROS_WARN_STREAM("No link in state with name " << m_pc.link_name);
     return false;
@@ -237,9 +267,10 @@ bool planning_environment::PositionConstraintEvaluator::decide(const planning_mo
 bool planning_environment::OrientationConstraintEvaluator::decide(const planning_models::KinematicState *state,
                                                                   bool verbose) const
 {
-  const planning_models::KinematicState::LinkState* link_state = state->getLinkState(m_oc.link_name);
+  const planning_models::KinematicState::LinkState* link_state =
+    m_link_index >= 0 ? state->getLinkState((unsigned int)m_link_index) : state->getLinkState(m_oc.link_name);
 
-  if(!link_state) 
+  if(!link_state)
   {
     ROS_WARN_STREAM("No link in state with name " << m_oc.link_name);
     return false;
@@ -251,13 +282,13 @@ bool planning_environment::OrientationConstraintEvaluator::decide(const planning
   tfScalar yaw, pitch, roll;
   if(m_oc.type == m_oc.HEADER_FRAME)
   {
-    tf::Matrix3x3 result = link_state->getGlobalLinkTransform().getBasis() *  m_rotation_matrix.inverse();
+    tf::Matrix3x3 result = link_state->getGlobalLinkTransform().getBasis() *  m_rotation_matrix_inverse;
     result.getRPY(roll, pitch, yaw);
     //    result.getEulerYPR(yaw, pitch, roll);
   }
   else
   {
-    tf::Matrix3x3 result = m_rotation_matrix.inverse() * link_state->getGlobalLinkTransform().getBasis();
+    tf::Matrix3x3 result = m_rotation_matrix_inverse * link_state->getGlobalLinkTransform().getBasis();
     result.getRPY(roll, pitch, yaw);
   }
   if(fabs(roll) < m_oc.absolute_roll_tolerance &&
@@ -320,12 +351,12 @@ void planning_environment::OrientationConstraintEvaluator::evaluate(const planni
   tfScalar yaw, pitch, roll;
   if(m_oc.type == m_oc.HEADER_FRAME)
   {
-    tf::Matrix3x3 result = m_rotation_matrix.inverse() * link_state->getGlobalLinkTransform().getBasis();
+    tf::Matrix3x3 result = m_rotation_matrix_inverse * link_state->getGlobalLinkTransform().getBasis();
     result.getEulerYPR(yaw, pitch, roll);
   }
   else
   {
-    tf::Matrix3x3 result = link_state->getGlobalLinkTransform().getBasis() *  m_rotation_matrix.inverse();
+    tf::Matrix3x3 result = link_state->getGlobalLinkTransform().getBasis() *  m_rotation_matrix_inverse;
     result.getRPY(roll, pitch, yaw);
   }
   distAng += fabs(yaw); 
@@ -410,10 +441,14 @@ void planning_environment::KinematicConstraintEvaluatorSet::clear(void)
 {
   for (unsigned int i = 0 ; i < m_kce.size() ; ++i)
     delete m_kce[i];
-  m_kce.clear();	
+  m_kce.clear();
   m_jc.clear();
   m_pc.clear();
   m_oc.clear();
+  m_vc.clear();
+  m_order.clear();
+  m_calls.clear();
+  m_rejections.clear();
 }
 	
 bool planning_environment::KinematicConstraintEvaluatorSet::add(const std::vector<arm_navigation_msgs::JointConstraint> &jc)
@@ -425,6 +460,9 @@ bool planning_environment::KinematicConstraintEvaluatorSet::add(const std::vecto
     result = result && ev->use(jc[i]);
     m_kce.push_back(ev);
     m_jc.push_back(jc[i]);
+    m_order.push_back(m_kce.size() - 1);
+    m_calls.push_back(0);
+    m_rejections.push_back(0);
   }
   return result;
 }
@@ -438,6 +476,9 @@ bool planning_environment::KinematicConstraintEvaluatorSet::add(const std::vecto
     result = result && ev->use(pc[i]);
     m_kce.push_back(ev);
     m_pc.push_back(pc[i]);
+    m_order.push_back(m_kce.size() - 1);
+    m_calls.push_back(0);
+    m_rejections.push_back(0);
   }
   return result;
 }
@@ -451,6 +492,9 @@ bool planning_environment::KinematicConstraintEvaluatorSet::add(const std::vecto
     result = result && ev->use(oc[i]);
     m_kce.push_back(ev);
     m_oc.push_back(oc[i]);
+    m_order.push_back(m_kce.size() - 1);
+    m_calls.push_back(0);
+    m_rejections.push_back(0);
   }
   return result;
 }
@@ -465,16 +509,60 @@ bool planning_environment::KinematicConstraintEvaluatorSet::add(const std::vecto
     result = result && ev->use(vc[i]);
     m_kce.push_back(ev);
     m_vc.push_back(vc[i]);
+    m_order.push_back(m_kce.size() - 1);
+    m_calls.push_back(0);
+    m_rejections.push_back(0);
   }
   return result;
 }
 
-bool planning_environment::KinematicConstraintEvaluatorSet::decide(const planning_models::KinematicState* state, 
+void planning_environment::KinematicConstraintEvaluatorSet::compile(const planning_models::KinematicState* state)
+{
+  for (unsigned int i = 0 ; i < m_kce.size() ; ++i)
+    m_kce[i]->compile(state);
+  reorder();
+}
+
+namespace
+{
+/** Orders evaluator indices by descending score; used by reorder() */
+struct EvaluatorScoreOrder
+{
+  EvaluatorScoreOrder(const std::vector<double> &scores) : scores_(scores)
+  {
+  }
+
+  bool operator()(unsigned int a, unsigned int b) const
+  {
+    return scores_[a] > scores_[b];
+  }
+
+  const std::vector<double> &scores_;
+};
+}
+
+void planning_environment::KinematicConstraintEvaluatorSet::reorder(void)
+{
+  // rejection rate per unit cost; evaluators that have not run yet
+  // are scored as if they rejected half the time
+  std::vector<double> scores(m_kce.size());
+  for (unsigned int i = 0 ; i < m_kce.size() ; ++i)
+  {
+    double rate = m_calls[i] > 0 ? (double)m_rejections[i] / (double)m_calls[i] : 0.5;
+    scores[i] = rate / m_kce[i]->relativeCost();
+  }
+  std::stable_sort(m_order.begin(), m_order.end(), EvaluatorScoreOrder(scores));
+}
+
+bool planning_environment::KinematicConstraintEvaluatorSet::decide(const planning_models::KinematicState* state,
                                                                    bool verbose) const
 {
   for (unsigned int i = 0 ; i < m_kce.size() ; ++i) {
-    if (!m_kce[i]->decide(state, verbose)) {
-      return false;            
+    unsigned int e = i < m_order.size() ? m_order[i] : i;
+    ++m_calls[e];
+    if (!m_kce[e]->decide(state, verbose)) {
+      ++m_rejections[e];
+      return false;
     }
   }
   return true;
@@ -502,31 +590,34 @@ bool planning_environment::VisibilityConstraintEvaluator::use(const arm_navigati
 {
   m_vc   = vc;
   tf::poseMsgToTF(m_vc.sensor_pose.pose,m_sensor_offset_pose);
+  // the target and cone half-angle are fixed for the life of the
+  // constraint; cache them so decide() never recomputes trig
+  m_target = tf::Vector3(m_vc.target.point.x, m_vc.target.point.y, m_vc.target.point.z);
+  m_cos_tolerance = cos(m_vc.absolute_tolerance);
   return true;
 }
+void planning_environment::VisibilityConstraintEvaluator::compile(const planning_models::KinematicState* state)
+{
+  m_link_index = state->getLinkIndex(m_vc.sensor_pose.header.frame_id);
+}
 bool planning_environment::VisibilityConstraintEvaluator::decide(const planning_models::KinematicState* state,
                                                                  bool verbose) const
 {
-  std::string link_name = m_vc.sensor_pose.header.frame_id;
-  const planning_models::KinematicState::LinkState* link_state = state->getLinkState(link_name);
+  const std::string& link_name = m_vc.sensor_pose.header.frame_id;
+  const planning_models::KinematicState::LinkState* link_state =
+    m_link_index >= 0 ? state->getLinkState((unsigned int)m_link_index) : state->getLinkState(link_name);
   if(!link_state) {
     ROS_WARN_STREAM("No link state for link " << link_name);
     return false;
   }
 
   tf::Transform sensor_pose = link_state->getGlobalLinkTransform() * m_sensor_offset_pose;
-  double dx = m_vc.target.point.x - sensor_pose.getOrigin().x();
-  double dy = m_vc.target.point.y - sensor_pose.getOrigin().y();
-  double dz = m_vc.target.point.z - sensor_pose.getOrigin().z();
-
-  tf::Vector3 x_axis(1,0,0);
-  tf::Vector3 target_vector(dx,dy,dz);
-  tf::Vector3 sensor_x_axis = sensor_pose.getBasis()*x_axis;
+  tf::Vector3 target_vector = m_target - sensor_pose.getOrigin();
+  tf::Vector3 sensor_x_axis = sensor_pose.getBasis().getColumn(0);
 
-  double angle = fabs(target_vector.angle(sensor_x_axis));
-  if(angle < m_vc.absolute_tolerance)
-    return true;
-  else
-    return false;
+  // the target lies inside the sensor cone iff the angle to the
+  // sensor x axis is below the tolerance; compare cosines instead of
+  // calling acos per state
+  return target_vector.dot(sensor_x_axis) > m_cos_tolerance * target_vector.length();
 }
 
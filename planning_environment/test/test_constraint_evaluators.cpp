@@ -0,0 +1,128 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+/** \author E. Gil Jones */
+
+#include <planning_environment/models/collision_models.h>
+#include <planning_environment/util/kinematic_state_constraint_evaluator.h>
+#include <planning_models/kinematic_state.h>
+#include <gtest/gtest.h>
+#include <ros/package.h>
+
+static const std::string rel_path = "/test_urdf/robot.xml";
+static const double VERY_SMALL = .0001;
+
+class TestConstraintEvaluators : public testing::Test
+{
+protected:
+
+  virtual void SetUp() {
+
+    full_path_ = ros::package::getPath("planning_models")+rel_path;
+
+    std::string com = "rosparam set robot_description -t "+full_path_;
+
+    int ok = system(com.c_str());
+
+    if(ok != 0) {
+      ROS_WARN_STREAM("Setting parameter system call not ok");
+    }
+  }
+
+  virtual void TearDown() {
+  }
+
+protected:
+
+  std::string full_path_;
+};
+
+TEST_F(TestConstraintEvaluators, OrientationConstraintCachedInverse)
+{
+  planning_environment::CollisionModels cm("robot_description");
+  planning_models::KinematicState state(cm.getKinematicModel());
+  state.setKinematicStateToDefault();
+
+  const planning_models::KinematicState::LinkState* link_state = state.getLinkState("r_wrist_roll_link");
+  ASSERT_TRUE(link_state != NULL);
+
+  tf::Quaternion link_quat;
+  link_state->getGlobalLinkTransform().getBasis().getRotation(link_quat);
+
+  arm_navigation_msgs::OrientationConstraint oc;
+  oc.header.frame_id = cm.getWorldFrameId();
+  oc.link_name = "r_wrist_roll_link";
+  oc.type = oc.HEADER_FRAME;
+  tf::quaternionTFToMsg(link_quat, oc.orientation);
+  oc.absolute_roll_tolerance = 0.1;
+  oc.absolute_pitch_tolerance = 0.1;
+  oc.absolute_yaw_tolerance = 0.1;
+
+  planning_environment::OrientationConstraintEvaluator oce;
+  EXPECT_TRUE(oce.use(oc));
+
+  //the link's own orientation must satisfy its own constraint
+  EXPECT_TRUE(oce.decide(&state));
+
+  double dist_ang = 0.0;
+  oce.evaluate(&state, dist_ang);
+  EXPECT_LE(dist_ang, VERY_SMALL);
+
+  //rotating the constraint well past tolerance must make the same state fail
+  tf::Quaternion off_quat = link_quat * tf::Quaternion(tf::Vector3(1,0,0), 0.5);
+  tf::quaternionTFToMsg(off_quat, oc.orientation);
+  EXPECT_TRUE(oce.use(oc));
+  EXPECT_FALSE(oce.decide(&state));
+
+  oce.evaluate(&state, dist_ang);
+  EXPECT_GE(dist_ang, 0.1);
+
+  //same checks through the link frame branch
+  oc.type = oc.LINK_FRAME;
+  tf::quaternionTFToMsg(link_quat, oc.orientation);
+  EXPECT_TRUE(oce.use(oc));
+  EXPECT_TRUE(oce.decide(&state));
+
+  tf::quaternionTFToMsg(off_quat, oc.orientation);
+  EXPECT_TRUE(oce.use(oc));
+  EXPECT_FALSE(oce.decide(&state));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  ros::init(argc, argv, "test_constraint_evaluators");
+
+  return RUN_ALL_TESTS();
+}
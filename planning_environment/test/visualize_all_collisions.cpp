@@ -128,8 +128,10 @@ int main(int argc, char** argv)
     exit(0);
   }
   ros::Rate r(10.0);
+  //marker storage reused every cycle
+  planning_environment::CollisionMarkerPool marker_pool;
   while(nh.ok()) {
-    
+
     robot_state_service.call(rob_state_req,rob_state_res);
     planning_environment::setRobotStateAndComputeTransforms(rob_state_res.robot_state, *state);
 
@@ -151,12 +153,12 @@ int main(int argc, char** argv)
     attached_color.g = 0.4;
     attached_color.b = 0.3;
 
+    vis_marker_array_publisher.publish(cmodel.getAllCollisionPointMarkers(*state,
+                                                                          marker_pool,
+                                                                          point_color,
+                                                                          ros::Duration(.2)));
+
     visualization_msgs::MarkerArray arr;
-    cmodel.getAllCollisionPointMarkers(*state,
-                                       arr,
-                                       point_color,
-                                       ros::Duration(.2));
- 
     cmodel.getAllCollisionSpaceObjectMarkers(*state,
                                              arr,
                                              "",
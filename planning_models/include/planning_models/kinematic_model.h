@@ -53,8 +53,18 @@
 namespace planning_models
 {
  
-/** \brief Definition of a kinematic model. This class is not thread
-    safe, however multiple instances can be created */
+/** \brief Definition of a kinematic model.
+
+    Threading contract: the joint and link structure, the group
+    definitions and all constant transforms are immutable after
+    construction, so any number of threads may call const accessors
+    concurrently without locking; each thread should do its forward
+    kinematics on its own KinematicState (see KinematicStatePool).
+    Only the attached body models and the model groups can change
+    after construction, and callers that modify them must hold the
+    exclusive lock while readers hold the shared lock; code that never
+    touches attached bodies or changes groups needs no locking at
+    all. */
 class KinematicModel
 {
 public:	
@@ -364,6 +374,22 @@ public:
       return collision_origin_transform_;
     }
 
+    /** \brief For a link whose parent joint is fixed, the closest
+        ancestor link whose parent joint actually moves (or the root
+        link); NULL for links on moving joints. Runs of fixed joints
+        fold onto this link so FK composes one precomputed constant
+        instead of multiplying through every mount in the chain */
+    const LinkModel* getFixedChainBase() const {
+      return fixed_chain_base_;
+    }
+
+    /** \brief The precomposed constant transform from the fixed
+        chain base to this link; only meaningful when
+        getFixedChainBase() is not NULL */
+    const tf::Transform& getFixedChainTransform() const {
+      return fixed_chain_transform_;
+    }
+
     const shapes::Shape* getLinkShape() const {
       return shape_;
     }
@@ -403,6 +429,12 @@ public:
     
     /** \brief The constant transform applied to the collision geometry of the link (local) */
     tf::Transform  collision_origin_transform_;
+
+    /** \brief Closest ancestor link below a moving joint, when the parent joint is fixed */
+    const LinkModel* fixed_chain_base_;
+
+    /** \brief Precomposed constant transform from the fixed chain base to this link */
+    tf::Transform fixed_chain_transform_;
     
     /** \brief The geometry of the link */
     shapes::Shape *shape_;
@@ -575,10 +607,14 @@ public:
   /** \brief Construct a kinematic model from another one */
   KinematicModel(const KinematicModel &source);
 
-  /** \brief Construct a kinematic model from a parsed description and a list of planning groups */
-  KinematicModel(const urdf::Model &model, 
+  /** \brief Construct a kinematic model from a parsed description and a list of planning groups.
+      When \e load_geometry is false the link shapes are not
+      constructed, which skips mesh loading entirely - useful for
+      consumers that only need the kinematic skeleton */
+  KinematicModel(const urdf::Model &model,
                  const std::vector<GroupConfig>& group_configs,
-                 const std::vector<MultiDofConfig>& multi_dof_configs);
+                 const std::vector<MultiDofConfig>& multi_dof_configs,
+                 bool load_geometry = true);
 	
   /** \brief Destructor. Clear all memory. */
   ~KinematicModel(void);
@@ -731,12 +767,16 @@ private:
 
   /** \brief The root joint */
   JointModel *root_;
+
+  /** \brief Whether link shapes were constructed at build time */
+  bool load_geometry_;
 	
   std::map<std::string, JointModelGroup*> joint_model_group_map_;
   std::map<std::string, GroupConfig> joint_model_group_config_map_;
 
   void buildGroups(const std::vector<GroupConfig>&);
-  JointModel* buildRecursive(LinkModel *parent, const urdf::Link *link, 
+  void foldFixedJointChains(void);
+  JointModel* buildRecursive(LinkModel *parent, const urdf::Link *link,
                              const std::vector<MultiDofConfig>& multi_dof_configs);
   JointModel* constructJointModel(const urdf::Joint *urdfJointModel,  const urdf::Link *child_link,
                         const std::vector<MultiDofConfig>& multi_dof_configs);
@@ -38,6 +38,7 @@
 #define PLANNING_MODELS_KINEMATIC_STATE_
 
 #include "kinematic_model.h"
+#include "string_table.h"
 
 /** \brief Main namespace */
 namespace planning_models
@@ -63,8 +64,9 @@ public:
   {
   public: 
     
-    /** brief Constructs the joint state from the model */
-    JointState(const KinematicModel::JointModel* jm);
+    /** brief Constructs the joint state from the model; the variable
+        transform lives in the owning state's flat transform array */
+    JointState(const KinematicModel::JointModel* jm, tf::Transform* variable_transform_slot);
 
     ~JointState()
     {
@@ -79,7 +81,16 @@ public:
     
     /** \brief Sets the internal values from the supplied vector, which are assumed to be in the required order*/
     bool setJointStateValues(const std::vector<double>& joint_value_vector);
-    
+
+    /** \brief Sets the internal values from count doubles in the
+        required order, without requiring a temporary vector in
+        per-sample loops */
+    bool setJointStateValues(const double* joint_value_array, unsigned int count);
+
+    /** \brief Sets a single value by its position in the required
+        order; for the common single-dof joints this is index 0 */
+    bool setJointStateValue(unsigned int value_index, double value);
+
     /** \brief Sets the internal values from the transform */
     bool setJointStateValues(const tf::Transform& transform);
 
@@ -117,7 +128,7 @@ public:
     /** \brief Gets the current variable transform */
     const tf::Transform& getVariableTransform() const 
     {
-      return variable_transform_;
+      return *variable_transform_;
     }
     
     /** \brief Gets the joint model */
@@ -141,12 +152,36 @@ public:
       return joint_model_->getChildFrameId();
     }
 
+    /** \brief Whether the joint values changed since the last update
+        pass recomputed the dependent link transforms */
+    bool isDirty() const
+    {
+      return dirty_;
+    }
+
+    /** \brief Called by the update passes once the dependent link
+        transforms have been recomputed */
+    void clearDirty()
+    {
+      dirty_ = false;
+    }
+
+    /** \brief Force the next update pass to recompute the subtree */
+    void markDirty()
+    {
+      dirty_ = true;
+    }
+
   private:
     
     const KinematicModel::JointModel* joint_model_;
+
+    /** \brief True until an update pass consumes the current values */
+    bool dirty_;
     
-    /** \brief the local transform (computed by forward kinematics) */
-    tf::Transform variable_transform_; 
+    /** \brief the local transform (computed by forward kinematics);
+        points into the owning state's flat transform array */
+    tf::Transform* variable_transform_; 
       
     std::map<std::string, unsigned int> joint_state_index_map_;
 
@@ -158,7 +193,11 @@ public:
   class LinkState 
   {
   public:
-    LinkState(const KinematicModel::LinkModel* lm);
+    /** \brief Constructs the link state; the global transforms live
+        in the owning state's flat transform arrays */
+    LinkState(const KinematicModel::LinkModel* lm,
+              tf::Transform* global_link_transform_slot,
+              tf::Transform* global_collision_body_transform_slot);
 
     ~LinkState();
 
@@ -179,8 +218,8 @@ public:
 
     void updateGivenGlobalLinkTransform(const tf::Transform& transform)
     {
-      global_link_transform_ = transform;
-      global_collision_body_transform_.mult(global_link_transform_, link_model_->getCollisionOriginTransform());
+      *global_link_transform_ = transform;
+      global_collision_body_transform_->mult(*global_link_transform_, link_model_->getCollisionOriginTransform());
       updateAttachedBodies();
     }
     
@@ -210,37 +249,72 @@ public:
       return attached_body_state_vector_;
     }
 
+    /** \brief Contiguous global transforms for all shapes of all
+        bodies attached to this link, in attached body state order;
+        updated as a whole by updateAttachedBodies() */
+    const std::vector<tf::Transform>& getAttachedBodyTransforms() const
+    {
+      return attached_body_global_transforms_;
+    }
+
     const tf::Transform& getGlobalLinkTransform() const 
     {
-      return global_link_transform_;
+      return *global_link_transform_;
     }
 
     const tf::Transform& getGlobalCollisionBodyTransform() const
     {
-      return global_collision_body_transform_;
+      return *global_collision_body_transform_;
+    }
+
+    /** \brief Transient flag the update passes use to propagate
+        recomputation down the tree; false outside a pass */
+    bool updatedThisPass() const
+    {
+      return updated_this_pass_;
+    }
+
+    void setUpdatedThisPass(bool updated)
+    {
+      updated_this_pass_ = updated;
     }
 
   private:
     
     const KinematicModel::LinkModel* link_model_;
 
+    bool updated_this_pass_;
+
     const JointState* parent_joint_state_;
 
     const LinkState* parent_link_state_;
 
     std::vector<AttachedBodyState*> attached_body_state_vector_;
 
-    /** \brief The global transform this link forwards (computed by forward kinematics) */
-    tf::Transform global_link_transform_;
+    /** \brief Flat copies of the fixed transforms of all attached
+        shapes and their global counterparts, one entry per shape
+        across all attached bodies, so updateAttachedBodies() can run
+        a single loop over contiguous storage instead of one call per
+        body; the attached body states point into the global array */
+    std::vector<tf::Transform> attached_body_fixed_transforms_;
+    std::vector<tf::Transform> attached_body_global_transforms_;
+
+    /** \brief The global transform this link forwards (computed by
+        forward kinematics); points into the owning state's flat
+        transform array */
+    tf::Transform* global_link_transform_;
     
-    /** \brief The global transform for this link (computed by forward kinematics) */
-    tf::Transform global_collision_body_transform_;    
+    /** \brief The global transform for this link (computed by forward
+        kinematics); points into the owning state's flat transform
+        array */
+    tf::Transform* global_collision_body_transform_;    
   };
 
   class AttachedBodyState 
   {
   public:
-    AttachedBodyState(const KinematicModel::AttachedBodyModel* abm, const LinkState* parent_link_state);
+    AttachedBodyState(const KinematicModel::AttachedBodyModel* abm, const LinkState* parent_link_state,
+                      tf::Transform* global_collision_body_transform_slots);
     
     ~AttachedBodyState()
     {
@@ -264,19 +338,28 @@ public:
     /** \brief Recompute global_collision_body_transform */
     void computeTransform(void);
 
-    const std::vector<tf::Transform>& getGlobalCollisionBodyTransforms() const
+    const tf::Transform* getGlobalCollisionBodyTransforms() const
     {
       return global_collision_body_transforms_;
     }
 
+    unsigned int getNumGlobalCollisionBodyTransforms() const
+    {
+      return num_transforms_;
+    }
+
   private:
     const KinematicModel::AttachedBodyModel* attached_body_model_;
 
     const LinkState* parent_link_state_;
 
-    /** \brief The global transforms for these attached bodies (computed by forward kinematics) */
-    std::vector<tf::Transform> global_collision_body_transforms_;
-    
+    /** \brief The global transforms for these attached bodies
+        (computed by forward kinematics); points into the parent
+        link state's contiguous attached body transform array */
+    tf::Transform* global_collision_body_transforms_;
+
+    unsigned int num_transforms_;
+
   };
 
   class JointStateGroup
@@ -317,8 +400,21 @@ public:
         group are not recomputed.  */
     bool setKinematicState(const std::map<std::string, double>& joint_state_map);
 
+    /** \brief Run forward kinematics over every waypoint of a
+        trajectory in one pass, filling link_transforms with one row
+        per waypoint holding the global link transforms in
+        getUpdatedLinkStates() order. Equivalent to calling
+        setKinematicState() per waypoint and reading the transforms
+        back, but amortizes the per-call overhead and reuses the
+        output storage; joints whose values do not change between
+        consecutive waypoints keep their subtrees untouched. The
+        group is left at the last waypoint. Returns false if any
+        waypoint does not match the group dimension. */
+    bool computeTrajectoryTransforms(const std::vector<std::vector<double> >& trajectory,
+                                     std::vector<std::vector<tf::Transform> >& link_transforms);
+
     /** compute transforms using current joint values */
-    void updateKinematicLinks();	
+    void updateKinematicLinks();
 
     /** \brief Check if a joint is part of this group */
     bool hasJointState(const std::string &joint) const;
@@ -329,6 +425,19 @@ public:
     /** \brief Get a joint state by its name */
     JointState* getJointState(const std::string &joint) const;
 
+    /** \brief Get the position of the named joint in the group's
+        joint state vector, or -1 if the joint is not in the group.
+        Resolve indices once per query and use getJointState(index)
+        in per-sample loops instead of repeating the string lookup */
+    int getJointIndex(const std::string &joint) const;
+
+    /** \brief Get a joint state by its position in the group's joint state vector */
+    JointState* getJointState(unsigned int index) const
+    {
+      if(index >= joint_state_vector_.size()) return NULL;
+      return joint_state_vector_[index];
+    }
+
     void getKinematicStateValues(std::vector<double>& joint_state_values) const;
     
     void getKinematicStateValues(std::map<std::string, double>& joint_state_values) const;
@@ -338,7 +447,60 @@ public:
         middle of the bounds is used. */
     void setKinematicStateToDefault();
 
-    const std::vector<JointState*>& getJointRoots() const 
+    /** \brief Compute the geometric Jacobian of the named link with
+        respect to the group's joint values, using the global link
+        transforms the last FK pass already produced. The result is
+        row-major 6 x getDimension(): rows 0-2 are the linear
+        velocity of the link origin, rows 3-5 the angular velocity,
+        both in the world frame; columns follow group state order.
+        Revolute, prismatic and planar joints fill their columns;
+        the quaternion values of floating joints get zero columns.
+        Returns false if the group does not update the link. Make
+        sure the state is up to date before calling. */
+    bool getJacobian(const std::string& link_name, std::vector<double>& jacobian) const;
+
+    /** \brief Interpolate between two flat value arrays of group
+        dimension, writing the configuration at fraction t (0 gives
+        from, 1 gives to) into values_out. Values of continuous
+        joints take the shortest arc and stay normalized; everything
+        else interpolates linearly. Operates purely on the arrays:
+        no maps are built and the group state is not touched. */
+    void interpolate(const double* from, const double* to, double t, double* values_out) const;
+
+    /** \brief Fill values_out with a uniform random configuration
+        for the group, in the order setKinematicState() expects. The
+        bounds come from flat arrays precomputed at construction and
+        the generator is per-thread, so concurrent planners can
+        sample without shared state or per-joint map walks. Values
+        without finite bounds are set to zero. The group state itself
+        is not changed. */
+    void sampleUniform(std::vector<double>& values_out) const;
+
+    /** \brief Fill values_out with a configuration drawn from a
+        Gaussian centered on mean (one value per group dimension)
+        with the given standard deviation, clamped to the bounds.
+        Values without finite bounds stay at the mean. Returns false
+        if mean does not match the group dimension. */
+    bool sampleGaussianNear(const std::vector<double>& mean, double stddev, std::vector<double>& values_out) const;
+
+    /** \brief Weighted joint-space distance between two flat value
+        arrays in group state order. Values of continuous joints
+        measure along the shortest arc; everything else is a plain
+        difference. Weights, bounds and wrap flags are baked into
+        flat arrays at construction, so the evaluator is a single
+        tight loop suitable for nearest-neighbor queries that call
+        it millions of times per plan. Weights default to 1. */
+    double distance(const double* values_a, const double* values_b) const;
+
+    /** \brief Convenience overload; returns -1.0 if either vector
+        does not match the group dimension */
+    double distance(const std::vector<double>& values_a, const std::vector<double>& values_b) const;
+
+    /** \brief Set the per-value weights used by distance(); returns
+        false if the size does not match the group dimension */
+    bool setDistanceWeights(const std::vector<double>& weights);
+
+    const std::vector<JointState*>& getJointRoots() const
     {
       return joint_roots_;
     }
@@ -357,7 +519,13 @@ public:
     {
       return joint_state_vector_;
     }
-	    
+
+    /** \brief The links that are updated when the group state changes, in the order they are updated */
+    const std::vector<LinkState*>& getUpdatedLinkStates() const
+    {
+      return updated_links_;
+    }
+
   private:
     
     /** \brief The kinematic model that owns the group */
@@ -374,8 +542,21 @@ public:
     /** \brief Joint instances in the order they appear in the group state */
     std::vector<JointState*> joint_state_vector_;
 
-    /** \brief A map from joint names to their instances */
-    std::map<std::string, JointState*> joint_state_map_;
+    /** \brief A map from interned joint name ids to their instances */
+    std::map<unsigned int, JointState*> joint_state_map_;
+
+    /** \brief A map from joint names to their positions in the group state */
+    std::map<std::string, unsigned int> joint_index_map_;
+
+    /** \brief Flat per-value bounds in group state order, precomputed for the samplers */
+    std::vector<double> bounds_low_;
+    std::vector<double> bounds_high_;
+
+    /** \brief Marks values of continuous joints, which interpolate along the shortest arc */
+    std::vector<bool> value_continuous_;
+
+    /** \brief Per-value weights for distance(), all 1 unless changed */
+    std::vector<double> distance_weights_;
 
      /** \brief The list of joints that are roots in this group */
     std::vector<JointState*> joint_roots_;
@@ -440,9 +621,33 @@ public:
   /** \brief Get a joint state by its name */
   JointState* getJointState(const std::string &joint) const;
 
+  /** \brief Get the position of the named joint in the joint state
+      vector, or -1 if there is no such joint. Resolve indices once
+      per query and use getJointState(index) in per-sample loops
+      instead of repeating the string lookup */
+  int getJointIndex(const std::string &joint) const;
+
+  /** \brief Get a joint state by its position in the joint state vector */
+  JointState* getJointState(unsigned int index) const
+  {
+    if(index >= joint_state_vector_.size()) return NULL;
+    return joint_state_vector_[index];
+  }
+
   /** \brief Get a link state by its name */
   LinkState* getLinkState(const std::string &link) const;
 
+  /** \brief Get the position of the named link in the link state
+      vector, or -1 if there is no such link */
+  int getLinkIndex(const std::string &link) const;
+
+  /** \brief Get a link state by its position in the link state vector */
+  LinkState* getLinkState(unsigned int index) const
+  {
+    if(index >= link_state_vector_.size()) return NULL;
+    return link_state_vector_[index];
+  }
+
   /** \brief Get an attached body state by its name */
   AttachedBodyState* getAttachedBodyState(const std::string &attached) const;
 
@@ -494,14 +699,48 @@ private:
 
   const KinematicModel* kinematic_model_;
 
+  /** \brief Flat structure-of-arrays transform storage, indexed by
+      joint and link position in the state vectors. The joint and link
+      state accessors point into these arrays, and the full update
+      pass runs straight over them instead of chasing per-link heap
+      objects. */
+  std::vector<tf::Transform> joint_variable_transforms_;
+  std::vector<tf::Transform> global_link_transforms_;
+  std::vector<tf::Transform> global_collision_body_transforms_;
+
+  /** \brief Per-link indices and static transforms for the flat
+      update pass: the parent link index (-1 for the root), the index
+      of the parent joint's variable transform, and copies of the
+      joint and collision origin transforms from the model */
+  std::vector<int> parent_link_indices_;
+  std::vector<unsigned int> link_parent_joint_indices_;
+  std::vector<tf::Transform> joint_origin_transforms_;
+  std::vector<tf::Transform> collision_origin_transforms_;
+
+  /** \brief For links on fixed joints the model folds the run of
+      fixed joints into one constant from the closest moving link;
+      fk_base_link_indices_ holds the link to compose from (the plain
+      parent for moving joints) and link_on_fixed_joint_ marks links
+      whose identity variable transform can be skipped */
+  std::vector<int> fk_base_link_indices_;
+  std::vector<bool> link_on_fixed_joint_;
+
   unsigned int dimension_;
   std::map<std::string, unsigned int> kinematic_state_index_map_;
 
   std::vector<JointState*> joint_state_vector_;
-  std::map<std::string, JointState*> joint_state_map_;
+
+  //keyed by interned name ids (see StringTable), so the per-state
+  //maps hold no string copies and resolve without string comparisons
+  std::map<unsigned int, JointState*> joint_state_map_;
+
+  //positions in the state vectors, so callers can resolve a name to a
+  //stable index once and avoid the string maps in per-sample loops
+  std::map<std::string, unsigned int> joint_index_map_;
+  std::map<std::string, unsigned int> link_index_map_;
 
   std::vector<LinkState*> link_state_vector_;
-  std::map<std::string, LinkState*> link_state_map_;
+  std::map<unsigned int, LinkState*> link_state_map_;
 
   //vector of bodies, owned by states
   std::vector<const AttachedBodyState*> attached_body_state_vector_;
@@ -0,0 +1,159 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef PLANNING_MODELS_KINEMATIC_STATE_POOL_
+#define PLANNING_MODELS_KINEMATIC_STATE_POOL_
+
+#include "kinematic_state.h"
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+
+namespace planning_models
+{
+
+/** \brief A pool of fully-built KinematicState instances for one
+    KinematicModel. Constructing a KinematicState news up every joint,
+    link and attached body state and builds several string-keyed
+    indices, which is far too expensive to repeat inside shortcutters
+    and validity checkers that need a scratch state per iteration.
+    Acquiring from the pool is a pointer pop; the caller just sets the
+    values it needs.
+
+    Pooled states keep the model shared-locked, so the pool must be
+    cleared (or destroyed) before the model is modified; states built
+    against an old model layout (e.g. before bodies were attached)
+    must not be recycled past such a change. */
+class KinematicStatePool
+{
+public:
+
+  KinematicStatePool(const KinematicModel* model, unsigned int initial_size = 0);
+
+  ~KinematicStatePool(void);
+
+  /** \brief Get a state, recycling one if available. The values are
+      whatever the state last held; set them before use. */
+  KinematicState* acquire(void);
+
+  /** \brief Return a state to the pool. The state must have been
+      created for the same model this pool serves. */
+  void release(KinematicState* state);
+
+  /** \brief Get the calling thread's own scratch state, acquiring
+      one on the thread's first call and keeping it for the lifetime
+      of the thread. After the first call this is lock-free, so N
+      planner threads can run forward kinematics on the shared model
+      concurrently with no contention. The state is released back to
+      the pool when the thread exits; the pool must outlive every
+      thread that calls this. */
+  KinematicState* threadState(void);
+
+  /** \brief Delete all pooled states, e.g. before the model changes.
+      States currently acquired are unaffected, but must not be
+      released back afterwards unless the model is unchanged. */
+  void clear(void);
+
+  const KinematicModel* getKinematicModel(void) const
+  {
+    return model_;
+  }
+
+  /** \brief Acquires a state for the scope of the instance and
+      releases it on destruction */
+  class ScopedState
+  {
+  public:
+
+    ScopedState(KinematicStatePool& pool) : pool_(pool)
+    {
+      state_ = pool_.acquire();
+    }
+
+    ~ScopedState(void)
+    {
+      pool_.release(state_);
+    }
+
+    KinematicState* operator->(void) const
+    {
+      return state_;
+    }
+
+    KinematicState& operator*(void) const
+    {
+      return *state_;
+    }
+
+    KinematicState* get(void) const
+    {
+      return state_;
+    }
+
+  private:
+
+    //not copyable; the state would be released twice
+    ScopedState(const ScopedState&);
+    ScopedState& operator=(const ScopedState&);
+
+    KinematicStatePool& pool_;
+    KinematicState* state_;
+  };
+
+private:
+
+  /** \brief Holds one thread's scratch state and returns it to the
+      pool when the thread exits */
+  struct ThreadSlot
+  {
+    ~ThreadSlot(void)
+    {
+      pool->release(state);
+    }
+
+    KinematicStatePool* pool;
+    KinematicState* state;
+  };
+
+  const KinematicModel* model_;
+
+  std::vector<KinematicState*> free_states_;
+
+  boost::thread_specific_ptr<ThreadSlot> thread_slot_;
+
+  boost::mutex lock_;
+};
+
+}
+
+#endif
@@ -0,0 +1,71 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef PLANNING_MODELS_STRING_TABLE_
+#define PLANNING_MODELS_STRING_TABLE_
+
+#include <string>
+
+/** \brief Main namespace */
+namespace planning_models
+{
+
+/** \brief A process-wide interning table for identifier strings (link
+    names, joint names, object namespaces).  These identifiers form a
+    small, stable set but are used as keys in maps built per state and
+    per query; interning them once gives a small integer id that keys
+    those maps without per-entry string copies and character-wise
+    comparisons.  Strings remain the API at the boundaries - lookup()
+    recovers the original string from an id. */
+class StringTable
+{
+public:
+
+  /** \brief Returns the stable id for a string, assigning the next
+      free id on first use.  Id 0 is always the empty string.
+      Thread safe. */
+  static unsigned int intern(const std::string &str);
+
+  /** \brief Returns the string for an id previously assigned by
+      intern(); the reference stays valid for the lifetime of the
+      process.  An unknown id maps to the empty string. */
+  static const std::string& lookup(unsigned int id);
+
+  /** \brief Returns the number of distinct strings interned so far */
+  static unsigned int size(void);
+};
+
+}
+
+#endif
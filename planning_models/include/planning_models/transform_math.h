@@ -0,0 +1,112 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+/** \author E. Gil Jones */
+
+#ifndef PLANNING_MODELS_TRANSFORM_MATH_
+#define PLANNING_MODELS_TRANSFORM_MATH_
+
+#include <tf/LinearMath/Transform.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/** \brief Main namespace */
+namespace planning_models
+{
+
+/** \brief Transform composition kernels for the FK hot paths.
+
+    tf composes transforms through btMatrix3x3 operator overloads,
+    which is fine for occasional use but shows up heavily in FK
+    profiles - every link update is two or three compositions. The
+    kernels here write straight into the destination with no
+    temporaries, and when SSE2 is available the basis rows are
+    multiplied two columns at a time: a tf::Matrix3x3 row is four
+    contiguous doubles (tfScalar is double and the w slot is unused),
+    so the packed loads line up with the storage as-is. The scalar
+    fallback produces bit-identical results to tf's own composition,
+    and so does the packed path - same products, same addition
+    order. */
+namespace transform_math
+{
+
+/** \brief out = a * b. out must not alias a or b. */
+inline void compose(const tf::Transform& a, const tf::Transform& b, tf::Transform& out)
+{
+#if defined(__SSE2__)
+  const tf::Matrix3x3& a_basis = a.getBasis();
+  const tf::Matrix3x3& b_basis = b.getBasis();
+  tf::Matrix3x3& out_basis = out.getBasis();
+  //unaligned loads and stores - transforms live wherever their owners
+  //put them and tf makes no alignment promises
+  const __m128d b_row0 = _mm_loadu_pd(&b_basis[0][0]);
+  const __m128d b_row1 = _mm_loadu_pd(&b_basis[1][0]);
+  const __m128d b_row2 = _mm_loadu_pd(&b_basis[2][0]);
+  for(int i = 0; i < 3; i++) {
+    const tfScalar ai0 = a_basis[i][0];
+    const tfScalar ai1 = a_basis[i][1];
+    const tfScalar ai2 = a_basis[i][2];
+    const __m128d lo = _mm_add_pd(_mm_add_pd(_mm_mul_pd(_mm_set1_pd(ai0), b_row0),
+                                             _mm_mul_pd(_mm_set1_pd(ai1), b_row1)),
+                                  _mm_mul_pd(_mm_set1_pd(ai2), b_row2));
+    _mm_storeu_pd(&out_basis[i][0], lo);
+    //third column stays scalar so the unused w slot is never written
+    out_basis[i][2] = ai0 * b_basis[0][2] + ai1 * b_basis[1][2] + ai2 * b_basis[2][2];
+  }
+  const tf::Vector3& b_origin = b.getOrigin();
+  out.getOrigin().setValue(a_basis[0].dot(b_origin) + a.getOrigin()[0],
+                           a_basis[1].dot(b_origin) + a.getOrigin()[1],
+                           a_basis[2].dot(b_origin) + a.getOrigin()[2]);
+#else
+  out.mult(a, b);
+#endif
+}
+
+/** \brief out = a * b * c through a stack intermediate, replacing the
+    mult-then-*= pattern whose operator*= builds a whole temporary
+    transform. out must not alias a, b or c. */
+inline void compose(const tf::Transform& a, const tf::Transform& b, const tf::Transform& c,
+                    tf::Transform& out)
+{
+  tf::Transform ab;
+  compose(a, b, ab);
+  compose(ab, c, out);
+}
+
+}
+}
+
+#endif
@@ -46,15 +46,18 @@
 
 
 /* ------------------------ KinematicModel ------------------------ */
-planning_models::KinematicModel::KinematicModel(const urdf::Model &model, 
+planning_models::KinematicModel::KinematicModel(const urdf::Model &model,
                                                 const std::vector<GroupConfig>& group_configs,
-                                                const std::vector<MultiDofConfig>& multi_dof_configs)
-{    
+                                                const std::vector<MultiDofConfig>& multi_dof_configs,
+                                                bool load_geometry)
+{
   model_name_ = model.getName();
+  load_geometry_ = load_geometry;
   if (model.getRoot())
   {
     const urdf::Link *root = model.getRoot().get();
     root_ = buildRecursive(NULL, root, multi_dof_configs);
+    foldFixedJointChains();
     buildGroups(group_configs);
   }
   else
@@ -108,11 +111,13 @@ const std::string& planning_models::KinematicModel::getName() const {
 void planning_models::KinematicModel::copyFrom(const KinematicModel &source)
 {
   model_name_ = source.model_name_;
+  load_geometry_ = source.load_geometry_;
 
   if (source.root_)
   {
     root_ = copyRecursive(NULL, source.root_->child_link_model_);
-    
+    foldFixedJointChains();
+
 
     const std::map<std::string, JointModelGroup*>& source_group_map = source.getJointModelGroupMap();
     std::map< std::string, std::vector<std::string> > groupContent;
@@ -130,7 +135,37 @@ void planning_models::KinematicModel::copyFrom(const KinematicModel &source)
   }
 }
 
-void planning_models::KinematicModel::buildGroups(const std::vector<GroupConfig>& group_configs) 
+void planning_models::KinematicModel::foldFixedJointChains(void)
+{
+  //sensor mounts and shells give long runs of fixed joints; FK should
+  //compose one precomputed constant from the closest moving link
+  //instead of multiplying through every intermediate mount. The link
+  //vector is ordered parents before children, so a single pass sees
+  //each chain base before the links that fold onto it
+  for(unsigned int i = 0; i < link_model_vector_.size(); i++) {
+    LinkModel* lm = link_model_vector_[i];
+    lm->fixed_chain_base_ = NULL;
+    lm->fixed_chain_transform_.setIdentity();
+    if(dynamic_cast<const FixedJointModel*>(lm->getParentJointModel()) == NULL) {
+      continue;
+    }
+    const LinkModel* parent = lm->getParentJointModel()->getParentLinkModel();
+    if(parent == NULL) {
+      //fixed root joint; the link is constant in the world frame
+      lm->fixed_chain_transform_ = lm->joint_origin_transform_;
+      continue;
+    }
+    if(parent->fixed_chain_base_ != NULL) {
+      lm->fixed_chain_base_ = parent->fixed_chain_base_;
+      lm->fixed_chain_transform_.mult(parent->fixed_chain_transform_, lm->joint_origin_transform_);
+    } else {
+      lm->fixed_chain_base_ = parent;
+      lm->fixed_chain_transform_ = lm->joint_origin_transform_;
+    }
+  }
+}
+
+void planning_models::KinematicModel::buildGroups(const std::vector<GroupConfig>& group_configs)
 {
   //the only thing tricky is dealing with subgroups
   std::vector<bool> processed(group_configs.size(), false);
@@ -429,10 +464,10 @@ planning_models::KinematicModel::LinkModel* planning_models::KinematicModel::con
 
   if(urdf_link->collision && urdf_link->collision->geometry) {
     result->collision_origin_transform_ = urdfPose2TFTransform(urdf_link->collision->origin);
-    result->shape_ = constructShape(urdf_link->collision->geometry.get());
+    result->shape_ = load_geometry_ ? constructShape(urdf_link->collision->geometry.get()) : NULL;
   } else if(urdf_link->visual && urdf_link->visual->geometry){
     result->collision_origin_transform_ = urdfPose2TFTransform(urdf_link->visual->origin);
-    result->shape_ = constructShape(urdf_link->visual->geometry.get());
+    result->shape_ = load_geometry_ ? constructShape(urdf_link->visual->geometry.get()) : NULL;
   } else {
     result->collision_origin_transform_.setIdentity();
     result->shape_ = NULL;
@@ -1104,21 +1139,27 @@ bool planning_models::KinematicModel::RevoluteJointModel::isValueWithinVariableB
 
 /* ------------------------ LinkModel ------------------------ */
 
-planning_models::KinematicModel::LinkModel::LinkModel(const KinematicModel* kinematic_model) : 
+planning_models::KinematicModel::LinkModel::LinkModel(const KinematicModel* kinematic_model) :
   kinematic_model_(kinematic_model),
-  parent_joint_model_(NULL), 
+  parent_joint_model_(NULL),
+  fixed_chain_base_(NULL),
   shape_(NULL)
 {
   joint_origin_transform_.setIdentity();
   collision_origin_transform_.setIdentity();
+  fixed_chain_transform_.setIdentity();
 }
 
 planning_models::KinematicModel::LinkModel::LinkModel(const LinkModel* link_model) :
-  name_(link_model->name_), 
+  name_(link_model->name_),
   kinematic_model_(link_model->kinematic_model_),
   joint_origin_transform_(link_model->joint_origin_transform_),
-  collision_origin_transform_(link_model->collision_origin_transform_)
+  collision_origin_transform_(link_model->collision_origin_transform_),
+  fixed_chain_base_(NULL),
+  fixed_chain_transform_(link_model->fixed_chain_transform_)
 {
+  //fixed_chain_base_ must point into the copied tree; it is rewired by
+  //foldFixedJointChains() once the whole tree exists
   if(link_model->shape_) {
     shape_ = shapes::cloneShape(link_model->shape_);
   } else {
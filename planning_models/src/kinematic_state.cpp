@@ -35,7 +35,29 @@
 /** \author E. Gil Jones, Ioan Sucan */
 
 #include <planning_models/kinematic_state.h>
+#include <planning_models/transform_math.h>
 #include <ros/console.h>
+#include <cmath>
+#include <ros/time.h>
+#include <angles/angles.h>
+#include <boost/thread/tss.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_real.hpp>
+#include <boost/random/normal_distribution.hpp>
+
+namespace
+{
+//one generator per thread, so samplers never contend or share state
+boost::thread_specific_ptr<boost::mt19937> g_sampling_rng;
+
+boost::mt19937& samplingRNG(void)
+{
+  if(g_sampling_rng.get() == NULL) {
+    g_sampling_rng.reset(new boost::mt19937(static_cast<unsigned long>(ros::WallTime::now().toNSec())));
+  }
+  return *g_sampling_rng;
+}
+}
 
 planning_models::KinematicState::KinematicState(const KinematicModel* kinematic_model) :
   kinematic_model_(kinematic_model), dimension_(0)
@@ -44,25 +66,32 @@ planning_models::KinematicState::KinematicState(const KinematicModel* kinematic_
 
   const std::vector<KinematicModel::JointModel*>& joint_model_vector = kinematic_model_->getJointModels();
   joint_state_vector_.resize(joint_model_vector.size());
+  //the flat transform arrays are sized once here and never resized, so
+  //the slots handed to the joint and link states stay valid
+  joint_variable_transforms_.resize(joint_model_vector.size());
   //joint_index_location_.resize(joint_model_vector.size());
   unsigned int vector_index_counter = 0;
   for(unsigned int i = 0; i < joint_model_vector.size(); i++) {
-    joint_state_vector_[i] = new JointState(joint_model_vector[i]);
-    joint_state_map_[joint_state_vector_[i]->getName()] = joint_state_vector_[i];
+    joint_state_vector_[i] = new JointState(joint_model_vector[i], &joint_variable_transforms_[i]);
+    joint_state_map_[StringTable::intern(joint_state_vector_[i]->getName())] = joint_state_vector_[i];
+    joint_index_map_[joint_state_vector_[i]->getName()] = i;
     unsigned int joint_dim = joint_state_vector_[i]->getDimension();
     dimension_ += joint_dim;
     const std::vector<std::string>& name_order = joint_state_vector_[i]->getJointStateNameOrder();
     for(unsigned int j = 0; j < name_order.size(); j++) {
-      joint_state_map_[name_order[j]] = joint_state_vector_[i];
+      joint_state_map_[StringTable::intern(name_order[j])] = joint_state_vector_[i];
       kinematic_state_index_map_[name_order[j]] = vector_index_counter+j;
     }
     vector_index_counter += joint_dim;
   }
   const std::vector<KinematicModel::LinkModel*>& link_model_vector = kinematic_model_->getLinkModels();
   link_state_vector_.resize(link_model_vector.size());
+  global_link_transforms_.resize(link_model_vector.size());
+  global_collision_body_transforms_.resize(link_model_vector.size());
   for(unsigned int i = 0; i < link_model_vector.size(); i++) {
-    link_state_vector_[i] = new LinkState(link_model_vector[i]);
-    link_state_map_[link_state_vector_[i]->getName()] = link_state_vector_[i];
+    link_state_vector_[i] = new LinkState(link_model_vector[i], &global_link_transforms_[i], &global_collision_body_transforms_[i]);
+    link_state_map_[StringTable::intern(link_state_vector_[i]->getName())] = link_state_vector_[i];
+    link_index_map_[link_state_vector_[i]->getName()] = i;
     for(unsigned int j = 0; j < link_state_vector_[i]->getAttachedBodyStateVector().size(); j++) {
       attached_body_state_vector_.push_back(link_state_vector_[i]->getAttachedBodyStateVector()[j]);
     }
@@ -85,12 +114,14 @@ planning_models::KinematicState::KinematicState(const KinematicState& ks) :
   const std::vector<JointState*>& joint_state_vector = ks.getJointStateVector();
   unsigned int vector_index_counter = 0;
   joint_state_vector_.resize(joint_state_vector.size());
+  joint_variable_transforms_.resize(joint_state_vector.size());
   for(unsigned int i = 0; i < joint_state_vector_.size(); i++) {
-    joint_state_vector_[i] = new JointState(joint_state_vector[i]->getJointModel());
-    joint_state_map_[joint_state_vector_[i]->getName()] = joint_state_vector_[i];
+    joint_state_vector_[i] = new JointState(joint_state_vector[i]->getJointModel(), &joint_variable_transforms_[i]);
+    joint_state_map_[StringTable::intern(joint_state_vector_[i]->getName())] = joint_state_vector_[i];
+    joint_index_map_[joint_state_vector_[i]->getName()] = i;
     const std::vector<std::string>& name_order = joint_state_vector_[i]->getJointStateNameOrder();
     for(unsigned int j = 0; j < name_order.size(); j++) {
-      joint_state_map_[name_order[j]] = joint_state_vector_[i];
+      joint_state_map_[StringTable::intern(name_order[j])] = joint_state_vector_[i];
       kinematic_state_index_map_[name_order[j]] = vector_index_counter+j;
     }
     unsigned int joint_dim = joint_state_vector_[i]->getDimension();
@@ -101,9 +132,12 @@ planning_models::KinematicState::KinematicState(const KinematicState& ks) :
   }
   const std::vector<LinkState*>& link_state_vector = ks.getLinkStateVector();
   link_state_vector_.resize(link_state_vector.size());
+  global_link_transforms_.resize(link_state_vector.size());
+  global_collision_body_transforms_.resize(link_state_vector.size());
   for(unsigned int i = 0; i < link_state_vector.size(); i++) {
-    link_state_vector_[i] = new LinkState(link_state_vector[i]->getLinkModel());
-    link_state_map_[link_state_vector_[i]->getName()] = link_state_vector_[i];
+    link_state_vector_[i] = new LinkState(link_state_vector[i]->getLinkModel(), &global_link_transforms_[i], &global_collision_body_transforms_[i]);
+    link_state_map_[StringTable::intern(link_state_vector_[i]->getName())] = link_state_vector_[i];
+    link_index_map_[link_state_vector_[i]->getName()] = i;
     for(unsigned int j = 0; j < link_state_vector_[i]->getAttachedBodyStateVector().size(); j++) {
       attached_body_state_vector_.push_back(link_state_vector_[i]->getAttachedBodyStateVector()[j]);
     }
@@ -144,11 +178,7 @@ bool planning_models::KinematicState::setKinematicState(const std::vector<double
   for(unsigned int i = 0; i < joint_state_vector_.size(); i++) {
     unsigned int dim = joint_state_vector_[i]->getDimension();
     if(dim != 0) {
-      std::vector<double> vec(dim, 0.0); 
-      copy(joint_state_values.begin()+value_counter,
-           joint_state_values.begin()+value_counter+dim,
-           vec.begin());
-      bool ok = joint_state_vector_[i]->setJointStateValues(vec);
+      bool ok = joint_state_vector_[i]->setJointStateValues(&joint_state_values[value_counter], dim);
       if(!ok) {
         ROS_WARN("Joint state unhappy");
       }
@@ -159,7 +189,7 @@ bool planning_models::KinematicState::setKinematicState(const std::vector<double
   return true;
 }
 
-bool planning_models::KinematicState::setKinematicState(const std::map<std::string, double>& joint_state_map) 
+bool planning_models::KinematicState::setKinematicState(const std::map<std::string, double>& joint_state_map)
 {
   bool all_set = true;
   for(unsigned int i = 0; i < joint_state_vector_.size(); i++) {
@@ -217,8 +247,37 @@ void planning_models::KinematicState::getKinematicStateValues(std::map<std::stri
 
 void planning_models::KinematicState::updateKinematicLinks() 
 {
+  //only the subtrees below joints whose values actually changed get
+  //recomputed: a link needs new transforms when its parent joint moved
+  //or its parent link was recomputed earlier in this pass. The math
+  //runs straight over the flat arrays; the link state accessors point
+  //into the same storage.
   for(unsigned int i = 0; i < link_state_vector_.size(); i++) {
-    link_state_vector_[i]->computeTransform();
+    LinkState* ls = link_state_vector_[i];
+    const int p = parent_link_indices_[i];
+    if(!ls->getParentJointState()->isDirty() && !(p >= 0 && link_state_vector_[p]->updatedThisPass())) {
+      continue;
+    }
+    if(p >= 0) {
+      //links on fixed joints compose straight from the closest moving
+      //link; the folded constant already spans the mount chain and
+      //the identity variable transform is skipped
+      global_link_transforms_[i].mult(global_link_transforms_[fk_base_link_indices_[i]], joint_origin_transforms_[i]);
+    } else {
+      global_link_transforms_[i] = joint_origin_transforms_[i];
+    }
+    if(!link_on_fixed_joint_[i]) {
+      global_link_transforms_[i] *= joint_variable_transforms_[link_parent_joint_indices_[i]];
+    }
+    global_collision_body_transforms_[i].mult(global_link_transforms_[i], collision_origin_transforms_[i]);
+    ls->updateAttachedBodies();
+    ls->setUpdatedThisPass(true);
+  }
+  for(unsigned int i = 0; i < link_state_vector_.size(); i++) {
+    link_state_vector_[i]->setUpdatedThisPass(false);
+  }
+  for(unsigned int i = 0; i < joint_state_vector_.size(); i++) {
+    joint_state_vector_[i]->clearDirty();
   }
 }
 
@@ -226,12 +285,18 @@ bool planning_models::KinematicState::updateKinematicStateWithLinkAt(const std::
 {
   if(!hasLinkState(link_name)) return false;
 
-  link_state_map_.find(link_name)->second->updateGivenGlobalLinkTransform(transform);
+  link_state_map_.find(StringTable::intern(link_name))->second->updateGivenGlobalLinkTransform(transform);
   std::vector<LinkState*> child_links = getChildLinkStates(link_name);
   //the zeroith link will be the link itself, which shouldn't be getting updated, so we start at 1
   for(unsigned int i = 1; i < child_links.size(); i++) {
     child_links[i]->computeTransform();
   }
+  //the externally imposed transform bypassed FK; mark everything dirty
+  //so the next update pass recomputes from the joint values the way a
+  //full pass always used to
+  for(unsigned int i = 0; i < joint_state_vector_.size(); i++) {
+    joint_state_vector_[i]->markDirty();
+  }
   return true;
 }
 
@@ -245,7 +310,7 @@ std::vector<planning_models::KinematicState::LinkState*> planning_models::Kinema
   std::vector<const KinematicModel::LinkModel*> child_link_models;
   kinematic_model_->getChildLinkModels(kinematic_model_->getLinkModel(link_name), child_link_models);
   for(unsigned int i = 0; i < child_link_models.size(); i++) {
-    child_link_states.push_back(link_state_map_.find((child_link_models[i]->getName()))->second);
+    child_link_states.push_back(link_state_map_.find(StringTable::intern(child_link_models[i]->getName()))->second);
   }
   return child_link_states;
 }
@@ -289,24 +354,54 @@ bool planning_models::KinematicState::areJointsWithinBounds(const std::vector<st
 }
 
 void planning_models::KinematicState::setLinkStatesParents() {
+  std::map<const JointState*, unsigned int> joint_indices;
+  for(unsigned int i = 0; i < joint_state_vector_.size(); i++) {
+    joint_indices[joint_state_vector_[i]] = i;
+  }
+  std::map<const LinkState*, int> link_indices;
+  for(unsigned int i = 0; i < link_state_vector_.size(); i++) {
+    link_indices[link_state_vector_[i]] = i;
+  }
+  parent_link_indices_.resize(link_state_vector_.size(), -1);
+  link_parent_joint_indices_.resize(link_state_vector_.size(), 0);
+  joint_origin_transforms_.resize(link_state_vector_.size());
+  collision_origin_transforms_.resize(link_state_vector_.size());
+  fk_base_link_indices_.resize(link_state_vector_.size(), -1);
+  link_on_fixed_joint_.resize(link_state_vector_.size(), false);
+
   //now we need to figure out who are the link parents are
   for(unsigned int i = 0; i < link_state_vector_.size(); i++) {
-    const KinematicModel::JointModel* parent_joint_model = link_state_vector_[i]->getLinkModel()->getParentJointModel();
+    const KinematicModel::LinkModel* link_model = link_state_vector_[i]->getLinkModel();
+    joint_origin_transforms_[i] = link_model->getJointOriginTransform();
+    collision_origin_transforms_[i] = link_model->getCollisionOriginTransform();
+    //links on fixed joints compose the folded constant from the
+    //closest moving link instead of walking the whole mount chain
+    if(link_model->getFixedChainBase() != NULL) {
+      joint_origin_transforms_[i] = link_model->getFixedChainTransform();
+      fk_base_link_indices_[i] = link_indices[link_state_map_[StringTable::intern(link_model->getFixedChainBase()->getName())]];
+      link_on_fixed_joint_[i] = true;
+    }
+    const KinematicModel::JointModel* parent_joint_model = link_model->getParentJointModel();
     if(parent_joint_model == NULL) {
       ROS_WARN("Parent joint really should be NULL");
       continue;
     }
-    if(joint_state_map_.find(parent_joint_model->getName()) == joint_state_map_.end()) {
+    if(joint_state_map_.find(StringTable::intern(parent_joint_model->getName())) == joint_state_map_.end()) {
       ROS_WARN_STREAM("Don't have a joint state for parent joint " << parent_joint_model->getName());
       continue;
     }
-    link_state_vector_[i]->setParentJointState(joint_state_map_[parent_joint_model->getName()]);
+    link_state_vector_[i]->setParentJointState(joint_state_map_[StringTable::intern(parent_joint_model->getName())]);
+    link_parent_joint_indices_[i] = joint_indices[joint_state_map_[StringTable::intern(parent_joint_model->getName())]];
     if(parent_joint_model->getParentLinkModel() != NULL) {
-      if(link_state_map_.find(parent_joint_model->getParentLinkModel()->getName()) == link_state_map_.end()) {
+      if(link_state_map_.find(StringTable::intern(parent_joint_model->getParentLinkModel()->getName())) == link_state_map_.end()) {
         ROS_WARN_STREAM("Don't have a link state for parent link " << parent_joint_model->getParentLinkModel()->getName());
         continue;
       }
-      link_state_vector_[i]->setParentLinkState(link_state_map_[parent_joint_model->getParentLinkModel()->getName()]);
+      link_state_vector_[i]->setParentLinkState(link_state_map_[StringTable::intern(parent_joint_model->getParentLinkModel()->getName())]);
+      parent_link_indices_[i] = link_indices[link_state_map_[StringTable::intern(parent_joint_model->getParentLinkModel()->getName())]];
+      if(fk_base_link_indices_[i] < 0) {
+        fk_base_link_indices_[i] = parent_link_indices_[i];
+      }
     }
   }
 }
@@ -339,23 +434,37 @@ void planning_models::KinematicState::getJointStateGroupNames(std::vector<std::s
 
 bool planning_models::KinematicState::hasJointState(const std::string &joint) const
 {
-  return joint_state_map_.find(joint) != joint_state_map_.end();
+  return joint_state_map_.find(StringTable::intern(joint)) != joint_state_map_.end();
 }
 bool planning_models::KinematicState::hasLinkState(const std::string& link) const
 {
-  return (link_state_map_.find(link) != link_state_map_.end());
+  return (link_state_map_.find(StringTable::intern(link)) != link_state_map_.end());
 }
 
 planning_models::KinematicState::JointState* planning_models::KinematicState::getJointState(const std::string &joint) const
 {
   if(!hasJointState(joint)) return NULL;
-  return joint_state_map_.find(joint)->second;
+  return joint_state_map_.find(StringTable::intern(joint))->second;
+}
+
+int planning_models::KinematicState::getJointIndex(const std::string &joint) const
+{
+  std::map<std::string, unsigned int>::const_iterator it = joint_index_map_.find(joint);
+  if(it == joint_index_map_.end()) return -1;
+  return it->second;
 }
 
 planning_models::KinematicState::LinkState* planning_models::KinematicState::getLinkState(const std::string &link) const
 {
   if(!hasLinkState(link)) return NULL;
-  return link_state_map_.find(link)->second;
+  return link_state_map_.find(StringTable::intern(link))->second;
+}
+
+int planning_models::KinematicState::getLinkIndex(const std::string &link) const
+{
+  std::map<std::string, unsigned int>::const_iterator it = link_index_map_.find(link);
+  if(it == link_index_map_.end()) return -1;
+  return it->second;
 }
 
 planning_models::KinematicState::AttachedBodyState* planning_models::KinematicState::getAttachedBodyState(const std::string &att) const
@@ -372,11 +481,12 @@ planning_models::KinematicState::AttachedBodyState* planning_models::KinematicSt
 
 //-------------------- JointState ---------------------
 
-planning_models::KinematicState::JointState::JointState(const planning_models::KinematicModel::JointModel* jm) :
-  joint_model_(jm)
+planning_models::KinematicState::JointState::JointState(const planning_models::KinematicModel::JointModel* jm,
+                                                        tf::Transform* variable_transform_slot) :
+  joint_model_(jm), dirty_(true), variable_transform_(variable_transform_slot)
 {
-  variable_transform_.setIdentity();
-  joint_state_values_ = joint_model_->computeJointStateValues(variable_transform_);
+  variable_transform_->setIdentity();
+  joint_state_values_ = joint_model_->computeJointStateValues(*variable_transform_);
   joint_state_name_order_.resize(joint_state_values_.size());
 
   unsigned int i = 0;
@@ -396,14 +506,50 @@ bool planning_models::KinematicState::JointState::setJointStateValues(const std:
   if(joint_state_values.size() != joint_state_index_map_.size()) {
     return false;
   }
+  //planners perturb one or two joints per step; joints set to the
+  //values they already hold stay clean and their subtrees skip FK
+  if(joint_state_values == joint_state_values_) {
+    return true;
+  }
   joint_state_values_ = joint_state_values;
-  variable_transform_ = joint_model_->computeTransform(joint_state_values);
+  *variable_transform_ = joint_model_->computeTransform(joint_state_values);
+  dirty_ = true;
+  return true;
+}
+
+bool planning_models::KinematicState::JointState::setJointStateValues(const double* joint_value_array, unsigned int count) {
+  if(count != joint_state_values_.size()) {
+    return false;
+  }
+  bool changed = false;
+  for(unsigned int i = 0; i < count; i++) {
+    if(joint_state_values_[i] != joint_value_array[i]) {
+      joint_state_values_[i] = joint_value_array[i];
+      changed = true;
+    }
+  }
+  if(changed) {
+    *variable_transform_ = joint_model_->computeTransform(joint_state_values_);
+    dirty_ = true;
+  }
+  return true;
+}
+
+bool planning_models::KinematicState::JointState::setJointStateValue(unsigned int value_index, double value) {
+  if(value_index >= joint_state_values_.size()) {
+    return false;
+  }
+  if(joint_state_values_[value_index] != value) {
+    joint_state_values_[value_index] = value;
+    *variable_transform_ = joint_model_->computeTransform(joint_state_values_);
+    dirty_ = true;
+  }
   return true;
 }
 
 bool planning_models::KinematicState::JointState::setJointStateValues(const std::map<std::string, double>& joint_value_map) {
   bool has_all = true;
-  bool has_any = false;
+  bool changed = false;
   for(std::map<std::string, unsigned int>::const_iterator it = joint_state_index_map_.begin();
       it != joint_state_index_map_.end();
       it++) {
@@ -411,17 +557,17 @@ bool planning_models::KinematicState::JointState::setJointStateValues(const std:
     if(it2 == joint_value_map.end()) {
       has_all = false;
       continue;
-    } else {
-      has_any = true;
     }
     if(it->second > joint_state_values_.size()) {
       ROS_WARN_STREAM("Trying to set value " << it->second << " which is larger than joint state values size " << joint_state_values_.size());
-    } else {
+    } else if(joint_state_values_[it->second] != it2->second) {
       joint_state_values_[it->second] = it2->second;
+      changed = true;
     }
   }
-  if(has_any) {
-    variable_transform_ = joint_model_->computeTransform(joint_state_values_);
+  if(changed) {
+    *variable_transform_ = joint_model_->computeTransform(joint_state_values_);
+    dirty_ = true;
   }
   return has_all;
 }
@@ -438,24 +584,25 @@ bool planning_models::KinematicState::JointState::setJointStateValues(const std:
       has_all = false;
       missing_values.push_back(it->first);
       continue;
-    } else {
-      has_any = true;
     }
     if(it->second > joint_state_values_.size()) {
       ROS_WARN_STREAM("Trying to set value " << it->second << " which is larger than joint state values size " << joint_state_values_.size());
-    } else {
+    } else if(joint_state_values_[it->second] != it2->second) {
       joint_state_values_[it->second] = it2->second;
+      has_any = true;
     }
   }
   if(has_any) {
-    variable_transform_ = joint_model_->computeTransform(joint_state_values_);
+    *variable_transform_ = joint_model_->computeTransform(joint_state_values_);
+    dirty_ = true;
   }
   return has_all;
 }
 
 bool planning_models::KinematicState::JointState::setJointStateValues(const tf::Transform& transform) {
-  variable_transform_ = transform;
-  joint_state_values_ = joint_model_->computeJointStateValues(variable_transform_);
+  *variable_transform_ = transform;
+  joint_state_values_ = joint_model_->computeJointStateValues(*variable_transform_);
+  dirty_ = true;
   return true;
 }
 
@@ -510,18 +657,37 @@ bool planning_models::KinematicState::JointState::areJointStateValuesWithinBound
 
 //-------------------- LinkState ---------------------
 
-planning_models::KinematicState::LinkState::LinkState(const planning_models::KinematicModel::LinkModel* lm) :
-  link_model_(lm), parent_joint_state_(NULL), parent_link_state_(NULL)
+planning_models::KinematicState::LinkState::LinkState(const planning_models::KinematicModel::LinkModel* lm,
+                                                      tf::Transform* global_link_transform_slot,
+                                                      tf::Transform* global_collision_body_transform_slot) :
+  link_model_(lm), updated_this_pass_(false), parent_joint_state_(NULL), parent_link_state_(NULL),
+  global_link_transform_(global_link_transform_slot),
+  global_collision_body_transform_(global_collision_body_transform_slot)
 {
-  global_link_transform_.setIdentity();
-  global_collision_body_transform_.setIdentity();
+  global_link_transform_->setIdentity();
+  global_collision_body_transform_->setIdentity();
   const std::vector<planning_models::KinematicModel::AttachedBodyModel*>& attached_body_vector = link_model_->getAttachedBodyModels();
   attached_body_state_vector_.resize(attached_body_vector.size());
+  //lay out one contiguous transform per attached shape before
+  //handing out slots, so the array never reallocates afterwards
+  unsigned int num_shapes = 0;
+  for(unsigned int i = 0; i < attached_body_vector.size(); i++) {
+    num_shapes += attached_body_vector[i]->getAttachedBodyFixedTransforms().size();
+  }
+  attached_body_fixed_transforms_.reserve(num_shapes);
+  for(unsigned int i = 0; i < attached_body_vector.size(); i++) {
+    const std::vector<tf::Transform>& fixed = attached_body_vector[i]->getAttachedBodyFixedTransforms();
+    attached_body_fixed_transforms_.insert(attached_body_fixed_transforms_.end(), fixed.begin(), fixed.end());
+  }
+  attached_body_global_transforms_.resize(num_shapes);
   unsigned int j = 0;
+  unsigned int shape_counter = 0;
   for(std::vector<planning_models::KinematicModel::AttachedBodyModel*>::const_iterator it = attached_body_vector.begin();
       it != attached_body_vector.end();
       it++, j++) {
-    attached_body_state_vector_[j] = new AttachedBodyState(*it, this);
+    attached_body_state_vector_[j] = new AttachedBodyState(*it, this,
+                                                           num_shapes > 0 ? &attached_body_global_transforms_[shape_counter] : NULL);
+    shape_counter += (*it)->getAttachedBodyFixedTransforms().size();
   }
 }
 
@@ -535,36 +701,45 @@ planning_models::KinematicState::LinkState::~LinkState()
 void planning_models::KinematicState::LinkState::computeTransform() {
   tf::Transform ident;
   ident.setIdentity();
-  global_link_transform_.mult(parent_link_state_ ? parent_link_state_->global_link_transform_ : ident, link_model_->getJointOriginTransform());
-  global_link_transform_ *= parent_joint_state_->getVariableTransform();
-  global_collision_body_transform_.mult(global_link_transform_, link_model_->getCollisionOriginTransform());
+  transform_math::compose(parent_link_state_ ? *parent_link_state_->global_link_transform_ : ident,
+                          link_model_->getJointOriginTransform(),
+                          parent_joint_state_->getVariableTransform(),
+                          *global_link_transform_);
+  transform_math::compose(*global_link_transform_, link_model_->getCollisionOriginTransform(),
+                          *global_collision_body_transform_);
   updateAttachedBodies();
 }
 
-void planning_models::KinematicState::LinkState::updateAttachedBodies() 
+void planning_models::KinematicState::LinkState::updateAttachedBodies()
 {
-  for (unsigned int i = 0 ; i < attached_body_state_vector_.size() ; ++i) {
-    attached_body_state_vector_[i]->computeTransform();
+  //one pass over contiguous storage instead of one call per attached body
+  for (unsigned int i = 0 ; i < attached_body_global_transforms_.size() ; ++i) {
+    transform_math::compose(*global_link_transform_, attached_body_fixed_transforms_[i],
+                            attached_body_global_transforms_[i]);
   }
 }
 
 //-------------------- AttachedBodyState ---------------------
 
 planning_models::KinematicState::AttachedBodyState::AttachedBodyState(const planning_models::KinematicModel::AttachedBodyModel* abm,
-                                                                      const planning_models::KinematicState::LinkState* parent_link_state) :
+                                                                      const planning_models::KinematicState::LinkState* parent_link_state,
+                                                                      tf::Transform* global_collision_body_transform_slots) :
   attached_body_model_(abm),
-  parent_link_state_(parent_link_state)
+  parent_link_state_(parent_link_state),
+  global_collision_body_transforms_(global_collision_body_transform_slots),
+  num_transforms_(attached_body_model_->getAttachedBodyFixedTransforms().size())
 {
-  global_collision_body_transforms_.resize(attached_body_model_->getAttachedBodyFixedTransforms().size());
-  for(unsigned int i = 0; i < attached_body_model_->getAttachedBodyFixedTransforms().size(); i++) {
+  for(unsigned int i = 0; i < num_transforms_; i++) {
     global_collision_body_transforms_[i].setIdentity();
   }
 }
 
-void planning_models::KinematicState::AttachedBodyState::computeTransform() 
+void planning_models::KinematicState::AttachedBodyState::computeTransform()
 {
-  for(unsigned int i = 0; i < global_collision_body_transforms_.size(); i++) {
-    global_collision_body_transforms_[i] = parent_link_state_->getGlobalLinkTransform() * attached_body_model_->getAttachedBodyFixedTransforms()[i];
+  for(unsigned int i = 0; i < num_transforms_; i++) {
+    transform_math::compose(parent_link_state_->getGlobalLinkTransform(),
+                            attached_body_model_->getAttachedBodyFixedTransforms()[i],
+                            global_collision_body_transforms_[i]);
   }
 }
 
@@ -584,12 +759,24 @@ planning_models::KinematicState::JointStateGroup::JointStateGroup(const planning
     JointState* js = kinematic_state->getJointState(joint_model_vector[i]->getName());
     joint_state_vector_.push_back(js);
     joint_names_.push_back(joint_model_vector[i]->getName());
-    joint_state_map_[joint_model_vector[i]->getName()] = js;
+    joint_state_map_[StringTable::intern(joint_model_vector[i]->getName())] = js;
+    joint_index_map_[joint_model_vector[i]->getName()] = joint_state_vector_.size()-1;
     unsigned int joint_dim = joint_state_vector_[i]->getDimension();
     dimension_ += joint_dim;
     const std::vector<std::string>& name_order = joint_state_vector_[i]->getJointStateNameOrder();
     for(unsigned int i = 0; i < name_order.size(); i++) {
       kinematic_state_index_map_[name_order[i]] = vector_index_counter+i;
+      //flat bounds in state order, so the samplers don't walk the
+      //per-joint maps; unbounded values keep the DBL_MAX sentinels
+      double low = -DBL_MAX;
+      double high = DBL_MAX;
+      js->getJointValueBounds(name_order[i], low, high);
+      bounds_low_.push_back(low);
+      bounds_high_.push_back(high);
+      const KinematicModel::RevoluteJointModel* revolute_joint =
+        dynamic_cast<const KinematicModel::RevoluteJointModel*>(js->getJointModel());
+      value_continuous_.push_back(revolute_joint != NULL && revolute_joint->continuous_);
+      distance_weights_.push_back(1.0);
     }
     vector_index_counter += joint_dim;
   }
@@ -605,13 +792,13 @@ planning_models::KinematicState::JointStateGroup::JointStateGroup(const planning
 
   const std::vector<const KinematicModel::JointModel*>& joint_root_vector = jmg->getJointRoots();
   for(unsigned int i = 0; i < joint_root_vector.size(); i++) {
-    joint_roots_.push_back(joint_state_map_[joint_root_vector[i]->getName()]);
+    joint_roots_.push_back(joint_state_map_[StringTable::intern(joint_root_vector[i]->getName())]);
   }
 }
 
 bool planning_models::KinematicState::JointStateGroup::hasJointState(const std::string &joint) const
 {
-  return joint_state_map_.find(joint) != joint_state_map_.end();
+  return joint_state_map_.find(StringTable::intern(joint)) != joint_state_map_.end();
 }
 bool planning_models::KinematicState::JointStateGroup::updatesLinkState(const std::string& link) const
 {
@@ -627,11 +814,7 @@ bool planning_models::KinematicState::JointStateGroup::setKinematicState(const s
   for(unsigned int i = 0; i < joint_state_vector_.size(); i++) {
     unsigned int dim = joint_state_vector_[i]->getDimension();
     if(dim != 0) {
-      std::vector<double> vec(dim); 
-      copy(joint_state_values.begin()+value_counter,
-           joint_state_values.begin()+value_counter+dim,
-           vec.begin());
-      bool ok = joint_state_vector_[i]->setJointStateValues(vec);
+      bool ok = joint_state_vector_[i]->setJointStateValues(&joint_state_values[value_counter], dim);
       if(!ok) {
         ROS_WARN("Joint state unhappy");
       }
@@ -653,10 +836,51 @@ bool planning_models::KinematicState::JointStateGroup::setKinematicState(const s
   return all_set;
 }
 
-void planning_models::KinematicState::JointStateGroup::updateKinematicLinks() 
+bool planning_models::KinematicState::JointStateGroup::computeTrajectoryTransforms(const std::vector<std::vector<double> >& trajectory,
+                                                                                   std::vector<std::vector<tf::Transform> >& link_transforms)
+{
+  link_transforms.resize(trajectory.size());
+  for(unsigned int w = 0; w < trajectory.size(); w++) {
+    const std::vector<double>& waypoint = trajectory[w];
+    if(waypoint.size() != dimension_) {
+      ROS_WARN_STREAM("Trajectory waypoint " << w << " has " << waypoint.size() << " values but group dimension is " << dimension_);
+      return false;
+    }
+    unsigned int value_counter = 0;
+    for(unsigned int i = 0; i < joint_state_vector_.size(); i++) {
+      unsigned int dim = joint_state_vector_[i]->getDimension();
+      if(dim != 0) {
+        joint_state_vector_[i]->setJointStateValues(&waypoint[value_counter], dim);
+        value_counter += dim;
+      }
+    }
+    updateKinematicLinks();
+    std::vector<tf::Transform>& waypoint_transforms = link_transforms[w];
+    waypoint_transforms.resize(updated_links_.size());
+    for(unsigned int i = 0; i < updated_links_.size(); i++) {
+      waypoint_transforms[i] = updated_links_[i]->getGlobalLinkTransform();
+    }
+  }
+  return true;
+}
+
+void planning_models::KinematicState::JointStateGroup::updateKinematicLinks()
 {
+  //same subtree propagation as the full state pass, over the links
+  //this group updates
   for(unsigned int i = 0; i < updated_links_.size(); i++) {
-    updated_links_[i]->computeTransform();
+    LinkState* ls = updated_links_[i];
+    const LinkState* parent = ls->getParentLinkState();
+    if(ls->getParentJointState()->isDirty() || (parent && parent->updatedThisPass())) {
+      ls->computeTransform();
+      ls->setUpdatedThisPass(true);
+    }
+  }
+  for(unsigned int i = 0; i < updated_links_.size(); i++) {
+    updated_links_[i]->setUpdatedThisPass(false);
+  }
+  for(unsigned int i = 0; i < joint_state_vector_.size(); i++) {
+    joint_state_vector_[i]->clearDirty();
   }
 }
 
@@ -672,6 +896,158 @@ void planning_models::KinematicState::JointStateGroup::setKinematicStateToDefaul
   setKinematicState(default_joint_states);
 }
 
+bool planning_models::KinematicState::JointStateGroup::getJacobian(const std::string& link_name, std::vector<double>& jacobian) const
+{
+  const LinkState* target = NULL;
+  for(unsigned int i = 0; i < updated_links_.size(); i++) {
+    if(updated_links_[i]->getName() == link_name) {
+      target = updated_links_[i];
+      break;
+    }
+  }
+  if(target == NULL) {
+    ROS_WARN_STREAM("Group " << getName() << " does not update link " << link_name);
+    return false;
+  }
+  jacobian.assign(6 * dimension_, 0.0);
+  //map each ancestor joint of the target to the link it moves, so
+  //group joints that don't affect the link keep zero columns
+  std::map<const JointState*, const LinkState*> ancestor_joints;
+  for(const LinkState* ls = target; ls != NULL; ls = ls->getParentLinkState()) {
+    ancestor_joints[ls->getParentJointState()] = ls;
+  }
+  const tf::Vector3& point = target->getGlobalLinkTransform().getOrigin();
+  unsigned int value_counter = 0;
+  for(unsigned int i = 0; i < joint_state_vector_.size(); i++) {
+    const JointState* js = joint_state_vector_[i];
+    unsigned int dim = js->getDimension();
+    std::map<const JointState*, const LinkState*>::const_iterator it = ancestor_joints.find(js);
+    if(it == ancestor_joints.end()) {
+      value_counter += dim;
+      continue;
+    }
+    const tf::Transform& child = it->second->getGlobalLinkTransform();
+    const KinematicModel::JointModel* joint_model = js->getJointModel();
+    const KinematicModel::RevoluteJointModel* revolute_joint = dynamic_cast<const KinematicModel::RevoluteJointModel*>(joint_model);
+    const KinematicModel::PrismaticJointModel* prismatic_joint = dynamic_cast<const KinematicModel::PrismaticJointModel*>(joint_model);
+    const KinematicModel::PlanarJointModel* planar_joint = dynamic_cast<const KinematicModel::PlanarJointModel*>(joint_model);
+    if(revolute_joint != NULL) {
+      //the axis is its own rotation's fixed point, so the child basis
+      //carries it to the world frame; rotation is about the child origin
+      tf::Vector3 axis = child.getBasis() * revolute_joint->axis_;
+      tf::Vector3 linear = axis.cross(point - child.getOrigin());
+      for(unsigned int r = 0; r < 3; r++) {
+        jacobian[r * dimension_ + value_counter] = linear[r];
+        jacobian[(r + 3) * dimension_ + value_counter] = axis[r];
+      }
+    } else if(prismatic_joint != NULL) {
+      tf::Vector3 axis = child.getBasis() * prismatic_joint->axis_;
+      for(unsigned int r = 0; r < 3; r++) {
+        jacobian[r * dimension_ + value_counter] = axis[r];
+      }
+    } else if(planar_joint != NULL) {
+      //x and y translate in the frame before the yaw; the yaw rotates
+      //about that frame's z axis through the joint position
+      double yaw = js->getJointStateValues()[2];
+      tf::Matrix3x3 frame_basis = child.getBasis() * tf::Matrix3x3(tf::Quaternion(tf::Vector3(0.0, 0.0, 1.0), -yaw));
+      tf::Vector3 z_axis = frame_basis.getColumn(2);
+      tf::Vector3 linear = z_axis.cross(point - child.getOrigin());
+      for(unsigned int r = 0; r < 3; r++) {
+        jacobian[r * dimension_ + value_counter] = frame_basis.getColumn(0)[r];
+        jacobian[r * dimension_ + value_counter + 1] = frame_basis.getColumn(1)[r];
+        jacobian[r * dimension_ + value_counter + 2] = linear[r];
+        jacobian[(r + 3) * dimension_ + value_counter + 2] = z_axis[r];
+      }
+    }
+    //floating joints keep zero columns: their values are quaternion
+    //components with no direct velocity mapping
+    value_counter += dim;
+  }
+  return true;
+}
+
+void planning_models::KinematicState::JointStateGroup::interpolate(const double* from, const double* to, double t, double* values_out) const
+{
+  for(unsigned int i = 0; i < dimension_; i++) {
+    if(value_continuous_[i]) {
+      values_out[i] = angles::normalize_angle(from[i] + angles::shortest_angular_distance(from[i], to[i]) * t);
+    } else {
+      values_out[i] = from[i] + (to[i] - from[i]) * t;
+    }
+  }
+}
+
+void planning_models::KinematicState::JointStateGroup::sampleUniform(std::vector<double>& values_out) const
+{
+  values_out.resize(dimension_);
+  boost::mt19937& rng = samplingRNG();
+  for(unsigned int i = 0; i < dimension_; i++) {
+    if(bounds_low_[i] <= -DBL_MAX || bounds_high_[i] >= DBL_MAX) {
+      values_out[i] = 0.0;
+      continue;
+    }
+    boost::uniform_real<double> dist(bounds_low_[i], bounds_high_[i]);
+    values_out[i] = dist(rng);
+  }
+}
+
+bool planning_models::KinematicState::JointStateGroup::sampleGaussianNear(const std::vector<double>& mean, double stddev, std::vector<double>& values_out) const
+{
+  if(mean.size() != dimension_) {
+    ROS_WARN_STREAM("Gaussian sample mean has " << mean.size() << " values but group dimension is " << dimension_);
+    return false;
+  }
+  values_out.resize(dimension_);
+  boost::mt19937& rng = samplingRNG();
+  for(unsigned int i = 0; i < dimension_; i++) {
+    if(bounds_low_[i] <= -DBL_MAX || bounds_high_[i] >= DBL_MAX) {
+      values_out[i] = mean[i];
+      continue;
+    }
+    boost::normal_distribution<double> dist(mean[i], stddev);
+    double value = dist(rng);
+    if(value < bounds_low_[i]) {
+      value = bounds_low_[i];
+    } else if(value > bounds_high_[i]) {
+      value = bounds_high_[i];
+    }
+    values_out[i] = value;
+  }
+  return true;
+}
+
+double planning_models::KinematicState::JointStateGroup::distance(const double* values_a, const double* values_b) const
+{
+  double sum = 0.0;
+  for(unsigned int i = 0; i < dimension_; i++) {
+    double d = value_continuous_[i] ?
+      angles::shortest_angular_distance(values_a[i], values_b[i]) :
+      values_b[i] - values_a[i];
+    sum += distance_weights_[i] * d * d;
+  }
+  return sqrt(sum);
+}
+
+double planning_models::KinematicState::JointStateGroup::distance(const std::vector<double>& values_a, const std::vector<double>& values_b) const
+{
+  if(values_a.size() != dimension_ || values_b.size() != dimension_) {
+    ROS_WARN_STREAM("Distance arguments have " << values_a.size() << " and " << values_b.size()
+                    << " values but group dimension is " << dimension_);
+    return -1.0;
+  }
+  return distance(&values_a[0], &values_b[0]);
+}
+
+bool planning_models::KinematicState::JointStateGroup::setDistanceWeights(const std::vector<double>& weights)
+{
+  if(weights.size() != dimension_) {
+    ROS_WARN_STREAM("Got " << weights.size() << " distance weights but group dimension is " << dimension_);
+    return false;
+  }
+  distance_weights_ = weights;
+  return true;
+}
+
 void planning_models::KinematicState::JointStateGroup::getKinematicStateValues(std::vector<double>& joint_state_values) const {
   joint_state_values.clear();
   for(unsigned int i = 0; i < joint_state_vector_.size(); i++) {
@@ -705,7 +1081,14 @@ void planning_models::KinematicState::JointStateGroup::getKinematicStateValues(s
 planning_models::KinematicState::JointState* planning_models::KinematicState::JointStateGroup::getJointState(const std::string &joint) const
 {
   if(!hasJointState(joint)) return NULL;
-  return joint_state_map_.find(joint)->second;
+  return joint_state_map_.find(StringTable::intern(joint))->second;
+}
+
+int planning_models::KinematicState::JointStateGroup::getJointIndex(const std::string &joint) const
+{
+  std::map<std::string, unsigned int>::const_iterator it = joint_index_map_.find(joint);
+  if(it == joint_index_map_.end()) return -1;
+  return it->second;
 }
 
 // ------ printing transforms -----
@@ -0,0 +1,99 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2010, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <planning_models/kinematic_state_pool.h>
+#include <ros/console.h>
+
+planning_models::KinematicStatePool::KinematicStatePool(const KinematicModel* model, unsigned int initial_size) :
+  model_(model)
+{
+  free_states_.reserve(initial_size);
+  for(unsigned int i = 0; i < initial_size; i++) {
+    free_states_.push_back(new KinematicState(model_));
+  }
+}
+
+planning_models::KinematicStatePool::~KinematicStatePool(void)
+{
+  clear();
+}
+
+planning_models::KinematicState* planning_models::KinematicStatePool::acquire(void)
+{
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    if(!free_states_.empty()) {
+      KinematicState* state = free_states_.back();
+      free_states_.pop_back();
+      return state;
+    }
+  }
+  //construction happens outside the lock; it is the expensive part
+  return new KinematicState(model_);
+}
+
+void planning_models::KinematicStatePool::release(KinematicState* state)
+{
+  if(state == NULL) {
+    return;
+  }
+  if(state->getKinematicModel() != model_) {
+    ROS_WARN("Released state was built for a different kinematic model; deleting instead of pooling");
+    delete state;
+    return;
+  }
+  boost::mutex::scoped_lock slock(lock_);
+  free_states_.push_back(state);
+}
+
+planning_models::KinematicState* planning_models::KinematicStatePool::threadState(void)
+{
+  ThreadSlot* slot = thread_slot_.get();
+  if(slot == NULL) {
+    slot = new ThreadSlot;
+    slot->pool = this;
+    slot->state = acquire();
+    thread_slot_.reset(slot);
+  }
+  return slot->state;
+}
+
+void planning_models::KinematicStatePool::clear(void)
+{
+  boost::mutex::scoped_lock slock(lock_);
+  for(unsigned int i = 0; i < free_states_.size(); i++) {
+    delete free_states_[i];
+  }
+  free_states_.clear();
+}
@@ -0,0 +1,95 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include "planning_models/string_table.h"
+
+#include <boost/thread/mutex.hpp>
+#include <deque>
+#include <map>
+
+namespace
+{
+
+//strings live in a deque so references handed out by lookup() stay
+//valid while later interns grow the table
+struct TableData
+{
+  TableData(void)
+  {
+    strings.push_back(std::string());
+    ids[std::string()] = 0;
+  }
+  boost::mutex lock;
+  std::map<std::string, unsigned int> ids;
+  std::deque<std::string> strings;
+};
+
+TableData& table(void)
+{
+  static TableData data;
+  return data;
+}
+
+}
+
+unsigned int planning_models::StringTable::intern(const std::string &str)
+{
+  TableData &data = table();
+  boost::mutex::scoped_lock slock(data.lock);
+  std::map<std::string, unsigned int>::const_iterator it = data.ids.find(str);
+  if(it != data.ids.end()) {
+    return it->second;
+  }
+  unsigned int id = data.strings.size();
+  data.strings.push_back(str);
+  data.ids[str] = id;
+  return id;
+}
+
+const std::string& planning_models::StringTable::lookup(unsigned int id)
+{
+  TableData &data = table();
+  boost::mutex::scoped_lock slock(data.lock);
+  if(id >= data.strings.size()) {
+    return data.strings[0];
+  }
+  return data.strings[id];
+}
+
+unsigned int planning_models::StringTable::size(void)
+{
+  TableData &data = table();
+  boost::mutex::scoped_lock slock(data.lock);
+  return data.strings.size();
+}
@@ -490,6 +490,100 @@ TEST(FK, OneRobot)
     EXPECT_NEAR(0.0, state.getLinkState("link_c")->getGlobalLinkTransform().getRotation().z(), 1e-5);
     EXPECT_NEAR(1.0, state.getLinkState("link_c")->getGlobalLinkTransform().getRotation().w(), 1e-5);
 
+    //index lookups should agree with the name-based accessors
+    planning_models::KinematicState::JointStateGroup* group = state.getJointStateGroup("base_from_joints");
+    int joint_a_index = group->getJointIndex("joint_a");
+    ASSERT_TRUE(joint_a_index >= 0);
+    EXPECT_EQ(group->getJointState("joint_a"), group->getJointState((unsigned int) joint_a_index));
+    EXPECT_EQ(-1, group->getJointIndex("monkey"));
+    EXPECT_EQ(state.getLinkState("link_b"), state.getLinkState((unsigned int) state.getLinkIndex("link_b")));
+
+    //batch FK over a trajectory should give the same transforms as
+    //setting each waypoint individually
+    std::vector<std::vector<double> > trajectory;
+    for(unsigned int i = 0; i < 3; i++) {
+      std::vector<double> waypoint(group->getDimension(), 0.0);
+      waypoint[0] = 1.0;
+      waypoint[1] = 1.0;
+      waypoint[2] = 0.5;
+      waypoint[3] = -0.5 + 0.1 * i;
+      waypoint[4] = 0.1;
+      trajectory.push_back(waypoint);
+    }
+    std::vector<std::vector<tf::Transform> > link_transforms;
+    ASSERT_TRUE(group->computeTrajectoryTransforms(trajectory, link_transforms));
+    ASSERT_EQ(trajectory.size(), link_transforms.size());
+    const std::vector<planning_models::KinematicState::LinkState*>& updated_links = group->getUpdatedLinkStates();
+    for(unsigned int i = 0; i < trajectory.size(); i++) {
+      ASSERT_EQ(updated_links.size(), link_transforms[i].size());
+      group->setKinematicState(trajectory[i]);
+      for(unsigned int j = 0; j < updated_links.size(); j++) {
+        EXPECT_NEAR(0.0, link_transforms[i][j].getOrigin().distance(updated_links[j]->getGlobalLinkTransform().getOrigin()), 1e-10);
+        EXPECT_NEAR(link_transforms[i][j].getRotation().x(), updated_links[j]->getGlobalLinkTransform().getRotation().x(), 1e-10);
+        EXPECT_NEAR(link_transforms[i][j].getRotation().y(), updated_links[j]->getGlobalLinkTransform().getRotation().y(), 1e-10);
+        EXPECT_NEAR(link_transforms[i][j].getRotation().z(), updated_links[j]->getGlobalLinkTransform().getRotation().z(), 1e-10);
+        EXPECT_NEAR(link_transforms[i][j].getRotation().w(), updated_links[j]->getGlobalLinkTransform().getRotation().w(), 1e-10);
+      }
+    }
+
+    //continuous joints interpolate along the shortest arc, the rest linearly
+    std::vector<double> from(group->getDimension(), 0.0);
+    std::vector<double> to(group->getDimension(), 0.0);
+    std::vector<double> mid(group->getDimension(), 0.0);
+    from[3] = 3.0;   //joint_a is continuous
+    to[3] = -3.0;
+    from[4] = 0.0;   //joint_c is prismatic
+    to[4] = 0.08;
+    group->interpolate(&from[0], &to[0], 0.5, &mid[0]);
+    EXPECT_NEAR(M_PI, fabs(mid[3]), 1e-5);
+    EXPECT_NEAR(0.04, mid[4], 1e-10);
+
+    //distance wraps continuous joints and honors the weights
+    EXPECT_NEAR(sqrt(pow(2 * M_PI - 6.0, 2) + pow(0.08, 2)), group->distance(from, to), 1e-10);
+    std::vector<double> weights(group->getDimension(), 1.0);
+    weights[4] = 0.0;
+    EXPECT_TRUE(group->setDistanceWeights(weights));
+    EXPECT_NEAR(2 * M_PI - 6.0, group->distance(from, to), 1e-10);
+    weights.push_back(1.0);
+    EXPECT_FALSE(group->setDistanceWeights(weights));
+    std::vector<double> short_values(2, 0.0);
+    EXPECT_NEAR(-1.0, group->distance(short_values, to), 1e-10);
+
+    //Jacobian linear rows agree with finite differences of FK
+    std::vector<double> jac;
+    EXPECT_FALSE(group->getJacobian("monkey", jac));
+    ASSERT_TRUE(group->getJacobian("link_c", jac));
+    ASSERT_EQ(6 * group->getDimension(), (unsigned int) jac.size());
+    std::vector<double> base_values;
+    group->getKinematicStateValues(base_values);
+    tf::Vector3 p0 = state.getLinkState("link_c")->getGlobalLinkTransform().getOrigin();
+    const double eps = 1e-7;
+    for(unsigned int j = 0; j < group->getDimension(); j++) {
+      std::vector<double> perturbed = base_values;
+      perturbed[j] += eps;
+      group->setKinematicState(perturbed);
+      tf::Vector3 diff = (state.getLinkState("link_c")->getGlobalLinkTransform().getOrigin() - p0) / eps;
+      EXPECT_NEAR(jac[0 * group->getDimension() + j], diff.x(), 1e-5);
+      EXPECT_NEAR(jac[1 * group->getDimension() + j], diff.y(), 1e-5);
+      EXPECT_NEAR(jac[2 * group->getDimension() + j], diff.z(), 1e-5);
+    }
+    group->setKinematicState(base_values);
+
+    //samples have the group dimension and respect the bounds
+    std::vector<double> sampled;
+    for(unsigned int i = 0; i < 20; i++) {
+      group->sampleUniform(sampled);
+      ASSERT_EQ(group->getDimension(), (unsigned int) sampled.size());
+      EXPECT_TRUE(group->setKinematicState(sampled));
+      for(unsigned int j = 0; j < group->getJointStateVector().size(); j++) {
+        EXPECT_TRUE(group->getJointStateVector()[j]->areJointStateValuesWithinBounds());
+      }
+    }
+    std::vector<double> near;
+    ASSERT_TRUE(group->sampleGaussianNear(sampled, 0.01, near));
+    ASSERT_EQ(group->getDimension(), (unsigned int) near.size());
+    EXPECT_FALSE(group->sampleGaussianNear(std::vector<double>(2, 0.0), 0.01, near));
+
     //bonus bounds lookup test
     std::vector<std::string> jn;
     jn.push_back("planar_x");
@@ -34,6 +34,7 @@
 #include <geometric_shapes/bodies.h>
 #include <tf/transform_listener.h>
 #include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
 #include <string>
 #include <vector>
 
@@ -61,19 +62,68 @@ namespace robot_self_filter
     class SelfMask
     {	
       protected:
-    
+
+        /** \brief Tri-state voxel grid storing a body's occupancy in
+            its local frame. Cells are INSIDE or OUTSIDE only when the
+            whole cell is known to lie on one side of the surface;
+            cells straddling it (and their neighbours, as a
+            conservative band) are BOUNDARY and fall back to the exact
+            containment test. */
+        struct OccupancyGrid
+        {
+          enum { CELL_OUTSIDE = 0, CELL_INSIDE = 1, CELL_BOUNDARY = 2 };
+
+          OccupancyGrid(void)
+          {
+            cellSize = 0.0;
+            nx = ny = nz = 0;
+          }
+
+          /** \brief Classify a point given in the grid's (local)
+              frame; points outside the grid extent are outside the
+              body, an empty grid defers to the exact test */
+          int lookup(const tf::Vector3 &p) const
+          {
+            if (cells.empty())
+              return CELL_BOUNDARY;
+            double fx = (p.x() - origin.x()) / cellSize;
+            double fy = (p.y() - origin.y()) / cellSize;
+            double fz = (p.z() - origin.z()) / cellSize;
+            if (fx < 0.0 || fy < 0.0 || fz < 0.0)
+              return CELL_OUTSIDE;
+            unsigned int ix = (unsigned int)fx, iy = (unsigned int)fy, iz = (unsigned int)fz;
+            if (ix >= nx || iy >= ny || iz >= nz)
+              return CELL_OUTSIDE;
+            return cells[(iz * ny + iy) * nx + ix];
+          }
+
+          tf::Vector3                origin;
+          double                     cellSize;
+          unsigned int               nx, ny, nz;
+          std::vector<unsigned char> cells;
+        };
+
         struct SeeLink
         {
           SeeLink(void)
           {
             body = unscaledBody = NULL;
           }
-            
+
           std::string   name;
           bodies::Body *body;
           bodies::Body *unscaledBody;
           tf::Transform   constTransf;
           double        volume;
+
+          /** \brief Occupancy of the (scaled and padded) body in its
+              local frame, built once at configure() */
+          OccupancyGrid grid;
+
+          /** \brief Inverse of the body's current pose, kept by
+              assumeFrame() so points can be taken into the grid's
+              frame */
+          tf::Transform iPose;
         };
         
         struct SortBodies
@@ -164,24 +214,63 @@ namespace robot_self_filter
         /** \brief Configure the filter. */
         bool configure (const std::vector<LinkInfo> &links);
         
-        /** \brief Compute bounding spheres for the checked robot links. */
-        void computeBoundingSpheres (void);
+        /** \brief Build the local-frame occupancy grid of a link's
+            body at the given resolution (meters per cell) */
+        void buildOccupancyGrid (SeeLink &sl, double resolution);
         
+        /** \brief Re-sort the containment test order by descending
+            per-body hit count, so the statistically likeliest
+            containing body is tried first. Called between scans,
+            never while worker threads run */
+        void updateTestOrder (void);
+
         /** \brief Perform the actual mask computation. */
         void maskAuxContainment (const pcl::PointCloud<pcl::PointXYZ>& data_in, std::vector<int> &mask);
 
         /** \brief Perform the actual mask computation. */
         void maskAuxIntersection (const pcl::PointCloud<pcl::PointXYZ>& data_in, std::vector<int> &mask, const boost::function<void(const tf::Vector3&)> &callback);
-        
+
+        /** \brief Containment test for a contiguous range of points;
+            the per-point work is read-only after assumeFrame() and
+            each range writes a disjoint segment of the mask, so
+            ranges can run on separate threads */
+        void maskAuxContainmentRange (const pcl::PointCloud<pcl::PointXYZ>& data_in, unsigned int start, unsigned int end,
+                  const bodies::BoundingSphere &bound, double radiusSquared, std::vector<int> &mask);
+
+        /** \brief Intersection test for a contiguous range of points; see maskAuxContainmentRange() */
+        void maskAuxIntersectionRange (const pcl::PointCloud<pcl::PointXYZ>& data_in, unsigned int start, unsigned int end,
+                  const bodies::BoundingSphere &bound, double radiusSquared, std::vector<int> &mask,
+                  const boost::function<void(const tf::Vector3&)> &callback);
+
         tf::TransformListener               &tf_;
         ros::NodeHandle                     nh_;
-        
+
         tf::Vector3                           sensor_pos_;
         double                              min_sensor_dist_;
-        
+
+        /** \brief Number of threads the point mask is sharded
+            across; set from the self_mask_workers parameter and
+            defaulting to the hardware thread count */
+        unsigned int                        num_workers_;
+
         std::vector<SeeLink>                bodies_;
         std::vector<double>                 bspheresRadius2_;
         std::vector<bodies::BoundingSphere> bspheres_;
+
+        /** \brief Order in which bodies are tried for containment,
+            most frequently containing first. Rebuilt between scans
+            from hit_counts_, which the workers bump without
+            synchronization -- a lost increment only delays the
+            reordering, it cannot change a mask value */
+        std::vector<unsigned int>           test_order_;
+        std::vector<unsigned long>          hit_counts_;
+
+        /** \brief Pose each body was last placed at (and the frame
+            it was placed in), so assumeFrame() can skip updating
+            links whose transform has not changed between scans */
+        std::vector<tf::Transform>          last_poses_;
+        std::vector<bool>                   last_pose_valid_;
+        std::string                         last_frame_id_;
     };
 }
 
@@ -36,6 +36,7 @@
 
 #include <pcl/point_types.h>
 #include <pcl/point_cloud.h>
+#include <pcl/PointIndices.h>
 
 namespace filters
 {
@@ -169,6 +170,36 @@ namespace filters
         return (true);
       }
 
+      bool updateWithSensorFrame
+        (const pcl::PointCloud<pcl::PointXYZ>& data_in, pcl::PointIndices& indices_out, const std::string& sensor_frame)
+      {
+        sensor_frame_ = sensor_frame;
+        return (update (data_in, indices_out));
+      }
+
+      /** \brief Indices-only variant of update(): instead of copying
+       * the kept points into a new cloud, fill in the indices of the
+       * kept points in data_in, so consumers can keep working off the
+       * original cloud without any point copy
+       * \param data_in T array with length width
+       * \param indices_out indices of the points to keep
+       */
+      virtual bool
+        update (const pcl::PointCloud<pcl::PointXYZ>& data_in, pcl::PointIndices& indices_out)
+      {
+        std::vector<int> keep (data_in.points.size ());
+        if (sensor_frame_.empty ())
+        {
+          sm_->maskContainment (data_in, keep);
+        }
+        else
+        {
+          sm_->maskIntersection (data_in, sensor_frame_, min_sensor_dist_, keep);
+        }
+        fillResultIndices (keep, indices_out);
+        return (true);
+      }
+
       bool updateWithSensorFrame (const pcl::PointCloud<pcl::PointXYZ>& data_in, pcl::PointCloud<pcl::PointXYZ>& data_out, pcl::PointCloud<pcl::PointXYZ>& data_diff, const std::string& sensor_frame)
       {
         sensor_frame_ = sensor_frame;
@@ -224,6 +255,19 @@ namespace filters
         }
       }
 
+      void fillResultIndices (const std::vector<int> &keep, pcl::PointIndices& indices_out)
+      {
+        const unsigned int np = keep.size ();
+
+        // fill in the indices of the points that are NOT on the robot
+        indices_out.indices.resize (0);
+        indices_out.indices.reserve (np);
+
+        for (unsigned int i = 0 ; i < np ; ++i)
+          if (keep[i] == robot_self_filter::OUTSIDE)
+            indices_out.indices.push_back (i);
+      }
+
       void fillResult (const pcl::PointCloud<pcl::PointXYZ>& data_in, const std::vector<int> &keep, pcl::PointCloud<pcl::PointXYZ>& data_out)
       {
         const unsigned int np = data_in.points.size ();
@@ -40,7 +40,9 @@
 #include <tf/message_filter.h>
 #include <message_filters/subscriber.h>
 #include <pcl_conversions/pcl_conversions.h>
+#include <pcl_msgs/PointIndices.h>
 #include <pcl/filters/voxel_grid.h>
+#include <arm_navigation_msgs/shm_cloud_transport.h>
 
 class SelfFilter
 {
@@ -49,13 +51,25 @@ class SelfFilter
     {
       nh_.param<std::string> ("sensor_frame", sensor_frame_, std::string ());
       nh_.param<double> ("subsample_value", subsample_param_, 0.01);
+      nh_.param<bool> ("publish_indices", publish_indices_, false);
+      nh_.param<bool> ("publish_shm", publish_shm_, false);
       self_filter_ = new filters::SelfFilter<pcl::PointCloud<pcl::PointXYZ> > (nh_);
+      shm_writer_ = NULL;
 
-      sub_ = new message_filters::Subscriber<sensor_msgs::PointCloud2> (root_handle_, "cloud_in", 1);	
+      sub_ = new message_filters::Subscriber<sensor_msgs::PointCloud2> (root_handle_, "cloud_in", 1);
       mn_ = new tf::MessageFilter<sensor_msgs::PointCloud2> (*sub_, tf_, "", 1);
 
       //mn_ = new tf::MessageNotifier<sensor_msgs::PointCloud2>(tf_, boost::bind(&SelfFilter::cloudCallback, this, _1), "cloud_in", "", 1);
       pointCloudPublisher_ = root_handle_.advertise<sensor_msgs::PointCloud2>("cloud_out", 1);
+      if (publish_shm_)
+      {
+        // same-host consumers read the cloud straight out of shared
+        // memory; only the small descriptor crosses the topic
+        shm_writer_ = new arm_navigation_msgs::ShmCloudWriter (ros::names::resolve ("cloud_out"));
+        shmPublisher_ = root_handle_.advertise<arm_navigation_msgs::ShmPointCloud>("cloud_out_shm", 1);
+      }
+      if (publish_indices_)
+        indicesPublisher_ = root_handle_.advertise<pcl_msgs::PointIndices>("cloud_out_indices", 1);
       std::vector<std::string> frames;
       self_filter_->getSelfMask()->getLinkNames(frames);
       if (frames.empty())
@@ -76,13 +90,30 @@ class SelfFilter
       delete self_filter_;
       delete mn_;
       delete sub_;
+      delete shm_writer_;
     }
-      
+
   private:
-    void 
-      noFilterCallback (const sensor_msgs::PointCloud2ConstPtr &cloud)
+    void
+      publishCloud (const sensor_msgs::PointCloud2 &cloud)
     {
+      if (publish_shm_)
+      {
+        arm_navigation_msgs::ShmPointCloud descriptor;
+        shm_writer_->write (cloud, descriptor);
+        shmPublisher_.publish (descriptor);
+        // remote subscribers still get the full cloud; when only the
+        // shm path is consumed, nothing is serialized
+        if (pointCloudPublisher_.getNumSubscribers () == 0)
+          return;
+      }
       pointCloudPublisher_.publish (cloud);
+    }
+
+    void
+      noFilterCallback (const sensor_msgs::PointCloud2ConstPtr &cloud)
+    {
+      publishCloud (*cloud);
       ROS_DEBUG ("Self filter publishing unfiltered frame");
     }
       
@@ -95,6 +126,39 @@ class SelfFilter
       pcl::PointCloud<pcl::PointXYZ> cloud, cloud_filtered;
       pcl::fromROSMsg (*cloud2, cloud);
 
+      if (publish_indices_)
+      {
+        // indices-only mode: the cloud the indices refer to is
+        // published unmodified, so no kept point is ever copied
+        pcl::PointIndices kept;
+        if (subsample_param_ != 0)
+        {
+          pcl::PointCloud<pcl::PointXYZ> cloud_downsampled;
+          grid_.setLeafSize (subsample_param_, subsample_param_, subsample_param_);
+          grid_.setInputCloud (boost::make_shared <pcl::PointCloud<pcl::PointXYZ> > (cloud));
+          grid_.filter (cloud_downsampled);
+
+          self_filter_->updateWithSensorFrame (cloud_downsampled, kept, sensor_frame_);
+          sensor_msgs::PointCloud2 out;
+          pcl::toROSMsg (cloud_downsampled, out);
+          publishCloud (out);
+        }
+        else
+        {
+          self_filter_->updateWithSensorFrame (cloud, kept, sensor_frame_);
+          publishCloud (*cloud2);
+        }
+
+        pcl_msgs::PointIndices kept_msg;
+        kept_msg.indices = kept.indices;
+        kept_msg.header = cloud2->header;
+        indicesPublisher_.publish (kept_msg);
+
+        double sec = (ros::WallTime::now() - tm).toSec ();
+        ROS_DEBUG ("Self filter: kept %d of %d points in %f seconds", (int)kept.indices.size (), (int)cloud.points.size (), sec);
+        return;
+      }
+
       if (subsample_param_ != 0)
       {
         pcl::PointCloud<pcl::PointXYZ> cloud_downsampled;
@@ -104,11 +168,11 @@ class SelfFilter
         grid_.filter (cloud_downsampled);
 
         self_filter_->updateWithSensorFrame (cloud_downsampled, cloud_filtered, sensor_frame_);
-      } 
-      else 
+      }
+      else
       {
         self_filter_->updateWithSensorFrame (cloud, cloud_filtered, sensor_frame_);
-      }      
+      }
 
       double sec = (ros::WallTime::now() - tm).toSec ();
 
@@ -116,7 +180,7 @@ class SelfFilter
 
       sensor_msgs::PointCloud2 out;
       pcl::toROSMsg (cloud_filtered, out);
-      pointCloudPublisher_.publish (out);
+      publishCloud (out);
     }
 
     tf::TransformListener                                 tf_;
@@ -129,8 +193,13 @@ class SelfFilter
     filters::SelfFilter<pcl::PointCloud<pcl::PointXYZ> > *self_filter_;
     std::string sensor_frame_;
     double subsample_param_;
+    bool publish_indices_;
 
     ros::Publisher                                        pointCloudPublisher_;
+    ros::Publisher                                        indicesPublisher_;
+    ros::Publisher                                        shmPublisher_;
+    bool                                                  publish_shm_;
+    arm_navigation_msgs::ShmCloudWriter                  *shm_writer_;
     ros::Subscriber                                       no_filter_sub_;
 
     pcl::VoxelGrid<pcl::PointXYZ>                         grid_;
@@ -112,11 +112,22 @@ namespace robot_self_filter
     }
 }
 
+namespace robot_self_filter
+{
+    // clouds smaller than this are masked on the calling thread;
+    // sharding them would cost more than it saves
+    static const unsigned int MIN_POINTS_PER_WORKER = 4096;
+}
+
 bool robot_self_filter::SelfMask::configure(const std::vector<LinkInfo> &links)
 {
   // in case configure was called before, we free the memory
   freeMemory();
   sensor_pos_.setValue(0, 0, 0);
+
+  int workers = boost::thread::hardware_concurrency();
+  nh_.param("self_mask_workers", workers, workers);
+  num_workers_ = workers > 0 ? workers : 1;
     
   std::string content;
   boost::shared_ptr<urdf::Model> urdfModel;
@@ -196,10 +207,27 @@ bool robot_self_filter::SelfMask::configure(const std::vector<LinkInfo> &links)
     
   // put larger volume bodies first -- higher chances of containing a point
   std::sort(bodies_.begin(), bodies_.end(), SortBodies());
-  
+
+  // voxelize each body in its local frame so containment masking can
+  // answer most points with one grid fetch; 0 disables the grids
+  double voxel_resolution = 0.02;
+  nh_.param("self_mask_voxel_resolution", voxel_resolution, voxel_resolution);
+  for (unsigned int i = 0 ; i < bodies_.size() ; ++i)
+    buildOccupancyGrid(bodies_[i], voxel_resolution);
+
   bspheres_.resize(bodies_.size());
   bspheresRadius2_.resize(bodies_.size());
 
+  // start testing in volume order until hit counts accumulate
+  test_order_.resize(bodies_.size());
+  for (unsigned int i = 0 ; i < bodies_.size() ; ++i)
+    test_order_[i] = i;
+  hit_counts_.assign(bodies_.size(), 0);
+
+  last_frame_id_.clear();
+  last_poses_.resize(bodies_.size());
+  last_pose_valid_.assign(bodies_.size(), false);
+
   for (unsigned int i = 0 ; i < bodies_.size() ; ++i)
     ROS_DEBUG("Self mask includes link %s with volume %f", bodies_[i].name.c_str(), bodies_[i].volume);
     
@@ -256,14 +284,92 @@ void robot_self_filter::SelfMask::maskIntersection(const pcl::PointCloud<pcl::Po
   }
 }
 
-void robot_self_filter::SelfMask::computeBoundingSpheres(void)
+void robot_self_filter::SelfMask::buildOccupancyGrid(SeeLink &sl, double resolution)
 {
-  const unsigned int bs = bodies_.size();
-  for (unsigned int i = 0 ; i < bs ; ++i)
+  sl.grid.cells.clear();
+  sl.grid.nx = sl.grid.ny = sl.grid.nz = 0;
+  if (resolution <= 0.0)
+    return;
+
+  // at configure time the body has not been posed yet, so its frame
+  // is the grid's (local) frame
+  bodies::BoundingSphere bsphere;
+  sl.body->computeBoundingSphere(bsphere);
+  double half = bsphere.radius + resolution;
+  if (half <= 0.0)
+    return;
+
+  static const unsigned int MAX_CELLS_PER_AXIS = 128;
+  double cellSize = resolution;
+  unsigned int n = (unsigned int)ceil(2.0 * half / cellSize);
+  if (n > MAX_CELLS_PER_AXIS)
   {
-    bodies_[i].body->computeBoundingSphere(bspheres_[i]);
-    bspheresRadius2_[i] = bspheres_[i].radius * bspheres_[i].radius;
+    n = MAX_CELLS_PER_AXIS;
+    cellSize = 2.0 * half / (double)n;
   }
+
+  sl.grid.origin = bsphere.center - tf::Vector3(half, half, half);
+  sl.grid.cellSize = cellSize;
+  sl.grid.nx = sl.grid.ny = sl.grid.nz = n;
+
+  // sample the corner lattice once; a cell is INSIDE or OUTSIDE only
+  // when all eight of its corners agree. The lattice is classified a
+  // slice at a time through the body's batch containment kernel, so
+  // cylinder and box links take their packed path with one virtual
+  // dispatch per slice instead of one per corner
+  const unsigned int nc = n + 1;
+  std::vector<bool> corner(nc * nc * nc);
+  std::vector<float> slice_points(3 * nc * nc);
+  std::vector<bool> slice_inside;
+  for (unsigned int z = 0 ; z < nc ; ++z)
+  {
+    unsigned int idx = 0;
+    for (unsigned int y = 0 ; y < nc ; ++y)
+      for (unsigned int x = 0 ; x < nc ; ++x)
+      {
+        slice_points[idx++] = (float)(sl.grid.origin.x() + x * cellSize);
+        slice_points[idx++] = (float)(sl.grid.origin.y() + y * cellSize);
+        slice_points[idx++] = (float)(sl.grid.origin.z() + z * cellSize);
+      }
+    sl.body->containsPoints(&slice_points[0], nc * nc, slice_inside);
+    for (unsigned int i = 0 ; i < nc * nc ; ++i)
+      corner[z * nc * nc + i] = slice_inside[i];
+  }
+
+  std::vector<unsigned char> cells(n * n * n);
+  for (unsigned int z = 0 ; z < n ; ++z)
+    for (unsigned int y = 0 ; y < n ; ++y)
+      for (unsigned int x = 0 ; x < n ; ++x)
+      {
+        unsigned int in = 0;
+        for (unsigned int dz = 0 ; dz < 2 ; ++dz)
+          for (unsigned int dy = 0 ; dy < 2 ; ++dy)
+            for (unsigned int dx = 0 ; dx < 2 ; ++dx)
+              if (corner[((z + dz) * nc + y + dy) * nc + x + dx])
+                in++;
+        cells[(z * n + y) * n + x] = in == 8 ? (unsigned char)OccupancyGrid::CELL_INSIDE :
+          (in == 0 ? (unsigned char)OccupancyGrid::CELL_OUTSIDE : (unsigned char)OccupancyGrid::CELL_BOUNDARY);
+      }
+
+  // widen the boundary by one cell in every direction so grid
+  // classifications stay conservative near the surface
+  sl.grid.cells = cells;
+  for (unsigned int z = 0 ; z < n ; ++z)
+    for (unsigned int y = 0 ; y < n ; ++y)
+      for (unsigned int x = 0 ; x < n ; ++x)
+      {
+        if (cells[(z * n + y) * n + x] != OccupancyGrid::CELL_BOUNDARY)
+          continue;
+        for (int dz = -1 ; dz <= 1 ; ++dz)
+          for (int dy = -1 ; dy <= 1 ; ++dy)
+            for (int dx = -1 ; dx <= 1 ; ++dx)
+            {
+              int zz = (int)z + dz, yy = (int)y + dy, xx = (int)x + dx;
+              if (zz < 0 || yy < 0 || xx < 0 || zz >= (int)n || yy >= (int)n || xx >= (int)n)
+                continue;
+              sl.grid.cells[(zz * n + yy) * n + xx] = OccupancyGrid::CELL_BOUNDARY;
+            }
+      }
 }
 
 void robot_self_filter::SelfMask::assumeFrame(const std::string& frame_id, const ros::Time& stamp, const tf::Vector3 &sensor_pos, double min_sensor_dist)
@@ -300,18 +406,57 @@ void robot_self_filter::SelfMask::assumeFrame(const std::string& frame_id, const
   min_sensor_dist_ = min_sensor_dist;
 }
 
+namespace robot_self_filter
+{
+    // poses closer than this are considered unchanged, so the
+    // corresponding body update can be skipped
+    static inline bool samePose(const tf::Transform &a, const tf::Transform &b)
+    {
+      static const double POSITION_TOLERANCE = 1e-4; // 0.1 mm
+      static const double ROTATION_TOLERANCE = 1e-8; // on the quaternion dot product
+      if ((a.getOrigin() - b.getOrigin()).length2() > POSITION_TOLERANCE * POSITION_TOLERANCE)
+        return false;
+      return fabs(a.getRotation().dot(b.getRotation())) > 1.0 - ROTATION_TOLERANCE;
+    }
+}
+
 void robot_self_filter::SelfMask::assumeFrame(const std::string &frame_id, const ros::Time &stamp)
 {
   const unsigned int bs = bodies_.size();
-  
-  // place the links in the assumed frame 
+
+  // a frame change invalidates every cached pose
+  if (frame_id != last_frame_id_)
+  {
+    std::fill(last_pose_valid_.begin(), last_pose_valid_.end(), false);
+    last_frame_id_ = frame_id;
+  }
+
+  // wait once, under a deadline shared by all the link frames,
+  // instead of burning a full timeout (and a lock acquisition) per
+  // link; canTransform is a cheap availability check
+  ros::Time deadline = ros::Time::now() + ros::Duration(.1);
+  while (true)
+  {
+    bool all_ready = true;
+    for (unsigned int i = 0 ; i < bs ; ++i)
+      if (!tf_.canTransform(frame_id, bodies_[i].name, stamp))
+      {
+        all_ready = false;
+        break;
+      }
+    if (all_ready)
+      break;
+    if (ros::Time::now() >= deadline)
+    {
+      ROS_ERROR("Transforms from links to %s were not all available after 100ms", frame_id.c_str());
+      break;
+    }
+    ros::Duration(.01).sleep();
+  }
+
+  // place the links in the assumed frame
   for (unsigned int i = 0 ; i < bs ; ++i)
   {
-    std::string err;
-    if(!tf_.waitForTransform(frame_id, bodies_[i].name, stamp, ros::Duration(.1), ros::Duration(.01), &err)) {
-      ROS_ERROR("WaitForTransform timed out from %s to %s after 100ms.  Error string: %s", bodies_[i].name.c_str(), frame_id.c_str(), err.c_str());      
-    } 
-    
     // find the transform between the link's frame and the pointcloud frame
     tf::StampedTransform transf;
     try
@@ -321,57 +466,170 @@ void robot_self_filter::SelfMask::assumeFrame(const std::string &frame_id, const
     catch(tf::TransformException& ex)
     {
       transf.setIdentity();
-      ROS_ERROR("Unable to lookup transform from %s to %s. Exception: %s", bodies_[i].name.c_str(), frame_id.c_str(), ex.what());	
+      ROS_ERROR("Unable to lookup transform from %s to %s. Exception: %s", bodies_[i].name.c_str(), frame_id.c_str(), ex.what());
     }
-    
+
+    // links that did not move between scans keep their internal data
+    // and bounding sphere; typically only a few links change per scan
+    tf::Transform pose = transf * bodies_[i].constTransf;
+    if (last_pose_valid_[i] && samePose(pose, last_poses_[i]))
+      continue;
+
     // set it for each body; we also include the offset specified in URDF
-    bodies_[i].body->setPose(transf * bodies_[i].constTransf);
-    bodies_[i].unscaledBody->setPose(transf * bodies_[i].constTransf);
+    bodies_[i].body->setPose(pose);
+    bodies_[i].unscaledBody->setPose(pose);
+    bodies_[i].iPose = pose.inverse();
+    last_poses_[i] = pose;
+    last_pose_valid_[i] = true;
+
+    bodies_[i].body->computeBoundingSphere(bspheres_[i]);
+    bspheresRadius2_[i] = bspheres_[i].radius * bspheres_[i].radius;
   }
-  
-  computeBoundingSpheres();
+}
+
+namespace robot_self_filter
+{
+    struct SortByHitCount
+    {
+      SortByHitCount(const std::vector<unsigned long> &hits) : hits_(hits)
+      {
+      }
+      bool operator()(unsigned int a, unsigned int b) const
+      {
+        return hits_[a] > hits_[b];
+      }
+      const std::vector<unsigned long> &hits_;
+    };
+}
+
+void robot_self_filter::SelfMask::updateTestOrder(void)
+{
+  if (hit_counts_.empty())
+    return;
+
+  // halve the counts once they grow large so the ordering keeps
+  // tracking the current posture instead of the whole run's history
+  static const unsigned long DECAY_THRESHOLD = 1 << 24;
+  unsigned long total = 0;
+  for (unsigned int i = 0 ; i < hit_counts_.size() ; ++i)
+    total += hit_counts_[i];
+  if (total > DECAY_THRESHOLD)
+    for (unsigned int i = 0 ; i < hit_counts_.size() ; ++i)
+      hit_counts_[i] /= 2;
+
+  // stable sort keeps the volume order as the tie-break for bodies
+  // that have not contained anything yet
+  std::stable_sort(test_order_.begin(), test_order_.end(), SortByHitCount(hit_counts_));
 }
 
 void robot_self_filter::SelfMask::maskAuxContainment(const pcl::PointCloud<pcl::PointXYZ>& data_in, std::vector<int> &mask)
 {
-    const unsigned int bs = bodies_.size();
     const unsigned int np = data_in.points.size();
-    
+
     // compute a sphere that bounds the entire robot
     bodies::BoundingSphere bound;
-    bodies::mergeBoundingSpheres(bspheres_, bound);	  
+    bodies::mergeBoundingSpheres(bspheres_, bound);
     tfScalar radiusSquared = bound.radius * bound.radius;
-    
-    // we now decide which points we keep
-    //#pragma omp parallel for schedule(dynamic) 
-    for (int i = 0 ; i < (int)np ; ++i)
+
+    // no workers are running here, so the test order is safe to change
+    updateTestOrder();
+
+    // we now decide which points we keep; the per-point test is
+    // read-only, so large clouds are sharded across worker threads,
+    // each writing its own segment of the mask
+    unsigned int nw = num_workers_;
+    if (nw > 1 && np / nw < MIN_POINTS_PER_WORKER)
+      nw = np / MIN_POINTS_PER_WORKER > 0 ? np / MIN_POINTS_PER_WORKER : 1;
+    if (nw <= 1)
+      maskAuxContainmentRange(data_in, 0, np, bound, radiusSquared, mask);
+    else
+    {
+      boost::thread_group workers;
+      const unsigned int chunk = (np + nw - 1) / nw;
+      for (unsigned int w = 0 ; w < nw ; ++w)
+      {
+        unsigned int start = w * chunk;
+        unsigned int end = std::min(start + chunk, np);
+        workers.create_thread(boost::bind(&SelfMask::maskAuxContainmentRange, this,
+                                          boost::ref(data_in), start, end, boost::ref(bound), (double)radiusSquared, boost::ref(mask)));
+      }
+      workers.join_all();
+    }
+}
+
+void robot_self_filter::SelfMask::maskAuxContainmentRange(const pcl::PointCloud<pcl::PointXYZ>& data_in, unsigned int start, unsigned int end,
+                                                          const bodies::BoundingSphere &bound, double radiusSquared, std::vector<int> &mask)
+{
+    const unsigned int bs = bodies_.size();
+    for (unsigned int i = start ; i < end ; ++i)
     {
       tf::Vector3 pt = tf::Vector3(data_in.points[i].x, data_in.points[i].y, data_in.points[i].z);
       int out = OUTSIDE;
       if (bound.center.distance2(pt) < radiusSquared)
-          for (unsigned int j = 0 ; out == OUTSIDE && j < bs ; ++j)
-        if (bodies_[j].body->containsPoint(pt))
-            out = INSIDE;
-      
+          for (unsigned int k = 0 ; out == OUTSIDE && k < bs ; ++k)
+          {
+            // bodies are tried most-frequently-containing first, so
+            // contained points usually stop after a test or two
+            const unsigned int j = test_order_[k];
+
+            // one grid fetch in the link frame answers most points;
+            // only the boundary band needs the exact test
+            int cell = bodies_[j].grid.lookup(bodies_[j].iPose * pt);
+            if (cell == OccupancyGrid::CELL_INSIDE)
+              out = INSIDE;
+            else if (cell == OccupancyGrid::CELL_BOUNDARY && bodies_[j].body->containsPoint(pt))
+              out = INSIDE;
+            if (out == INSIDE)
+              ++hit_counts_[j];
+          }
+
       mask[i] = out;
     }
 }
 
 void robot_self_filter::SelfMask::maskAuxIntersection(const pcl::PointCloud<pcl::PointXYZ>& data_in, std::vector<int> &mask, const boost::function<void(const tf::Vector3&)> &callback)
 {
-  const unsigned int bs = bodies_.size();
   const unsigned int np = data_in.points.size();
-  
+
   // compute a sphere that bounds the entire robot
   bodies::BoundingSphere bound;
-  bodies::mergeBoundingSpheres(bspheres_, bound);	  
+  bodies::mergeBoundingSpheres(bspheres_, bound);
   tfScalar radiusSquared = bound.radius * bound.radius;
 
+  // no workers are running here, so the test order is safe to change
+  updateTestOrder();
+
   //std::cout << "Testing " << np << " points\n";
 
-  // we now decide which points we keep
-  //#pragma omp parallel for schedule(dynamic) 
-  for (int i = 0 ; i < (int)np ; ++i)
+  // we now decide which points we keep; with an intersection
+  // callback registered we stay on the calling thread, since the
+  // callback would otherwise fire concurrently from the workers
+  unsigned int nw = callback ? 1 : num_workers_;
+  if (nw > 1 && np / nw < MIN_POINTS_PER_WORKER)
+    nw = np / MIN_POINTS_PER_WORKER > 0 ? np / MIN_POINTS_PER_WORKER : 1;
+  if (nw <= 1)
+    maskAuxIntersectionRange(data_in, 0, np, bound, radiusSquared, mask, callback);
+  else
+  {
+    boost::thread_group workers;
+    const unsigned int chunk = (np + nw - 1) / nw;
+    for (unsigned int w = 0 ; w < nw ; ++w)
+    {
+      unsigned int start = w * chunk;
+      unsigned int end = std::min(start + chunk, np);
+      workers.create_thread(boost::bind(&SelfMask::maskAuxIntersectionRange, this,
+                                        boost::ref(data_in), start, end, boost::ref(bound), (double)radiusSquared, boost::ref(mask), boost::ref(callback)));
+    }
+    workers.join_all();
+  }
+}
+
+void robot_self_filter::SelfMask::maskAuxIntersectionRange(const pcl::PointCloud<pcl::PointXYZ>& data_in, unsigned int start, unsigned int end,
+                                                           const bodies::BoundingSphere &bound, double radiusSquared, std::vector<int> &mask,
+                                                           const boost::function<void(const tf::Vector3&)> &callback)
+{
+  const unsigned int bs = bodies_.size();
+  for (unsigned int i = start ; i < end ; ++i)
   {
     bool print = false;
     //if(i%100 == 0) print = true;
@@ -381,13 +639,17 @@ void robot_self_filter::SelfMask::maskAuxIntersection(const pcl::PointCloud<pcl:
     // we first check is the point is in the unscaled body. 
     // if it is, the point is definitely inside
     if (bound.center.distance2(pt) < radiusSquared)
-      for (unsigned int j = 0 ; out == OUTSIDE && j < bs ; ++j)
-        if (bodies_[j].unscaledBody->containsPoint(pt)) 
+      for (unsigned int k = 0 ; out == OUTSIDE && k < bs ; ++k)
+      {
+        const unsigned int j = test_order_[k];
+        if (bodies_[j].unscaledBody->containsPoint(pt))
         {
           if(print)
           std::cout << "Point " << i << " in unscaled body part " << bodies_[j].name << std::endl;
         out = INSIDE;
+        ++hit_counts_[j];
         }
+      }
 
         // if the point is not inside the unscaled body,
         if (out == OUTSIDE)
@@ -419,13 +681,17 @@ void robot_self_filter::SelfMask::maskAuxIntersection(const pcl::PointCloud<pcl:
 		       }
            // if it is not a shadow point, we check if it is inside the scaled body
            if (out == OUTSIDE && bound.center.distance2(pt) < radiusSquared)
-             for (unsigned int j = 0 ; out == OUTSIDE && j < bs ; ++j)
-               if (bodies_[j].body->containsPoint(pt)) 
+             for (unsigned int k = 0 ; out == OUTSIDE && k < bs ; ++k)
+             {
+               const unsigned int j = test_order_[k];
+               if (bodies_[j].body->containsPoint(pt))
                {
-                 if(print) 
+                 if(print)
                    std::cout << "Point " << i << " in scaled body part " << bodies_[j].name << std::endl;
                  out = INSIDE;
+                 ++hit_counts_[j];
                }
+             }
           }
         }
         mask[i] = out;
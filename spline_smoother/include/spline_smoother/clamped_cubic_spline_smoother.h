@@ -52,8 +52,9 @@ namespace spline_smoother
  * be equal, constraining start and end velocities to be equal to zero, then solving the resulting
  * linear system of equations.
  *
- * Processing time is O(N), but this method appears to be numerically unstable for long trajectories
- * (N>20)
+ * Processing time is O(N). The tridiagonal system is diagonally dominant, so
+ * the Thomas-algorithm solve is stable without pivoting for arbitrary
+ * trajectory lengths.
  */
 template <typename T>
 class ClampedCubicSplineSmoother: public SplineSmoother<T>
@@ -62,16 +63,34 @@ public:
   ClampedCubicSplineSmoother();
   virtual ~ClampedCubicSplineSmoother();
 
+  /** Retained for backwards compatibility; trajectories of any length are
+      now smoothed directly. */
   static const int MAX_TRIDIAGONAL_SOLVER_ELEMENTS = 20;
 
+  /** Number of already-smoothed waypoints before an append that are
+      re-solved together with the appended points, so the velocity profile
+      blends smoothly into the new segment. */
+  static const int SMOOTH_BLEND_WINDOW = 5;
+
   /**
    * \brief Smooths the input position trajectory by generating velocities and accelerations at the waypoints.
    *
    * \return true if successful, false if not
    */
-  virtual bool smooth(const T& trajectory_in, 
+  virtual bool smooth(const T& trajectory_in,
                       T& trajectory_out) const;
 
+  /**
+   * \brief Re-smooths only the appended points plus SMOOTH_BLEND_WINDOW
+   * waypoints before them. The previously smoothed velocity at the edge of
+   * the window becomes the clamped start boundary condition of the partial
+   * solve, so the blend is C1 continuous with the untouched prefix and the
+   * cost is O(appended + window) instead of O(total).
+   */
+  virtual bool smoothIncremental(const T& trajectory_in,
+                                 T& trajectory_out,
+                                 int append_index) const;
+
 private:
   NumericalDifferentiationSplineSmoother<T> num_diff_spline_smoother_;
   bool smoothSegment(std::vector<trajectory_msgs::JointTrajectoryPoint>& waypoints) const;
@@ -101,16 +120,42 @@ bool ClampedCubicSplineSmoother<T>::smooth(const T& trajectory_in, T& trajectory
   if (length<3)
     return true;
 
-  if (length <= MAX_TRIDIAGONAL_SOLVER_ELEMENTS)
+  smoothSegment(trajectory_out.request.trajectory.points);
+
+  return true;
+}
+
+template <typename T>
+bool ClampedCubicSplineSmoother<T>::smoothIncremental(const T& trajectory_in,
+                                                      T& trajectory_out,
+                                                      int append_index) const
+{
+  int length = trajectory_in.request.trajectory.points.size();
+  trajectory_out = trajectory_in;
+
+  if (!checkTrajectoryConsistency(trajectory_out))
+    return false;
+
+  if (length<3)
+    return true;
+
+  int window_start = append_index - SMOOTH_BLEND_WINDOW;
+  if (window_start < 1)
   {
+    // not enough smoothed prefix to clamp against; solve the whole thing
     smoothSegment(trajectory_out.request.trajectory.points);
-  }
-  else
-  {
-    ROS_ERROR("ClampedCubicSplineSmoother: does not support trajectory lengths > %d due to numerical instability.", MAX_TRIDIAGONAL_SOLVER_ELEMENTS);
-    return false;
+    return true;
   }
 
+  // solve only the tail, clamped at the previously smoothed velocity of the
+  // waypoint at the edge of the blend window
+  std::vector<trajectory_msgs::JointTrajectoryPoint> tail(
+      trajectory_out.request.trajectory.points.begin() + window_start,
+      trajectory_out.request.trajectory.points.end());
+  smoothSegment(tail);
+  for (int i=1; i<(int)tail.size()-1; i++)
+    trajectory_out.request.trajectory.points[window_start+i].velocities = tail[i].velocities;
+
   return true;
 }
 
@@ -128,34 +173,61 @@ bool ClampedCubicSplineSmoother<T>::smoothSegment(std::vector<trajectory_msgs::J
   for (int i=0; i<length-1; i++)
     intervals[i] = (wpts[i+1].time_from_start - wpts[i].time_from_start).toSec();
 
-  // arrays for tridiagonal matrix
-  std::vector<double> a(length-2);
-  std::vector<double> b(length-2);
-  std::vector<double> c(length-2);
-  std::vector<double> d(length-2);
-  std::vector<double> x(length-2);
+  int n = length-2;
+
+  // The band of the tridiagonal system depends only on the time intervals
+  // and is shared by every joint, so the elimination multipliers are
+  // computed once. The right-hand sides for all joints are then built and
+  // forward-eliminated in a single pass over the waypoints, with the joints
+  // packed contiguously per waypoint (the JointTrajectoryPoint layout) so
+  // the inner loop runs over consecutive doubles.
+  std::vector<double> a(n);
+  std::vector<double> cp(n);     // eliminated upper diagonal
+  std::vector<double> inv_m(n);  // inverse pivots
+  std::vector<double> dp(n*num_joints);
+
+  a[0] = 0.0;
+  for (int i=0; i<n-1; i++)
+    a[i+1] = intervals[i+2];
+
+  inv_m[0] = 1.0/(2.0*(intervals[0] + intervals[1]));
+  cp[0] = intervals[0]*inv_m[0];
+  for (int i=1; i<n; i++)
+  {
+    inv_m[i] = 1.0/(2.0*(intervals[i] + intervals[i+1]) - a[i]*cp[i-1]);
+    cp[i] = intervals[i]*inv_m[i];
+  }
 
-  // for each joint:
-  for (int j=0; j<num_joints; j++)
+  // forward pass: build and eliminate the right-hand sides for all joints
+  for (int i=0; i<n; i++)
   {
-    a[0] = 0.0;
-    c[length-3] = 0.0;
-    for (int i=0; i<length-2; i++)
+    double scale = 3.0/(intervals[i]*intervals[i+1]);
+    double h0_sq = intervals[i]*intervals[i];
+    double h1_sq = intervals[i+1]*intervals[i+1];
+    double* dp_row = &dp[i*num_joints];
+    for (int j=0; j<num_joints; j++)
     {
-      c[i] = intervals[i];
-      if (i<length-3)
-        a[i+1] = intervals[i+2];
-      b[i] = 2.0*(intervals[i] + intervals[i+1]);
-      d[i] = (3.0/(intervals[i]*intervals[i+1]))*
-          ((intervals[i]*intervals[i])*(wpts[i+2].positions[j]-wpts[i+1].positions[j]) +
-              (intervals[i+1]*intervals[i+1])*(wpts[i+1].positions[j]-wpts[i].positions[j]));
+      double d = scale*(h0_sq*(wpts[i+2].positions[j]-wpts[i+1].positions[j]) +
+                        h1_sq*(wpts[i+1].positions[j]-wpts[i].positions[j]));
+      if (i == 0)
+        d -= wpts[0].velocities[j]*intervals[1];
+      if (i == n-1)
+        d -= wpts[length-1].velocities[j]*intervals[n-1];
+      if (i == 0)
+        dp_row[j] = d*inv_m[i];
+      else
+        dp_row[j] = (d - a[i]*dp_row[j-num_joints])*inv_m[i];
     }
-    d[0] -= wpts[0].velocities[j]*intervals[1];
-    d[length-3] -= wpts[length-1].velocities[j]*intervals[length-3];
+  }
 
-    tridiagonalSolve(a, b, c, d, x);
-    for (int i=0; i<length-2; i++)
-      wpts[i+1].velocities[j] = x[i];
+  // backward substitution straight into the waypoint velocities
+  for (int j=0; j<num_joints; j++)
+    wpts[n].velocities[j] = dp[(n-1)*num_joints + j];
+  for (int i=n-2; i>=0; i--)
+  {
+    const double* dp_row = &dp[i*num_joints];
+    for (int j=0; j<num_joints; j++)
+      wpts[i+1].velocities[j] = dp_row[j] - cp[i]*wpts[i+2].velocities[j];
   }
   return true;
 }
@@ -82,11 +82,21 @@ namespace spline_smoother
     
     void solveCubicSpline(const double &q0,
                           const double &q1,
-                          const double &v0, 
+                          const double &v0,
                           const double &v1,
                           const double &dt,
                           std::vector<double> &coefficients);
 
+    /**
+     * \brief Parameterizes the segments [segment_begin,segment_end); used as a
+     * parallel worker, with the per-segment scratch hoisted out of the loop
+     */
+    void parameterizeSegments(const trajectory_msgs::JointTrajectory& trajectory_in,
+                              const std::vector<arm_navigation_msgs::JointLimits> &limits,
+                              int segment_begin,
+                              int segment_end,
+                              spline_smoother::SplineTrajectory& spline);
+
     static const double EPS_TRAJECTORY = 1.0e-8;
 
     bool apply_limits_;
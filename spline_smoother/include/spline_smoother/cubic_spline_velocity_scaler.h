@@ -70,44 +70,18 @@ namespace spline_smoother
   bool CubicSplineVelocityScaler<T>::smooth(const T& trajectory_in, T& trajectory_out) const
   {
     spline_smoother::CubicTrajectory traj;
-    spline_smoother::SplineTrajectory spline;
-    T trajectory_local = trajectory_in;
-    if (!checkTrajectoryConsistency(trajectory_local))
+    trajectory_out = trajectory_in;
+    if (!checkTrajectoryConsistency(trajectory_out))
       return false;
-    bool success = traj.parameterize(trajectory_local.request.trajectory,trajectory_local.request.limits,spline);
-    if(!success)
-      return false;
-
-    trajectory_out = trajectory_local;
 
+    //fused mode: limit stretching, coefficient computation and resampling on
+    //the regular grid happen in a single pass over the waypoints, with no
+    //intermediate spline representation or trajectory copy
     double dT = 0.01;
-    std::set<double> times;
-    double total_time;
-    spline_smoother::getTotalTime(spline,total_time);
-    for(int i=1; i< (int) (total_time/dT); i++)
-      times.insert(i*dT);
-    times.insert(total_time);
-
-    double insert_time = 0;
-    for(unsigned int i=0; i < spline.segments.size(); i++)
-    {
-      insert_time += spline.segments[i].duration.toSec();
-      times.insert(insert_time);
-    }
-
-    std::vector<double> times_vec;
-    for(std::set<double>::iterator set_iter = times.begin(); set_iter != times.end(); set_iter++)
-    {
-      times_vec.push_back(*set_iter);
-    }
-    std::sort(times_vec.begin(), times_vec.end());
-    //traj_gen->write(spline,times_vec,"shortcutter_robot.txt");    
-    //traj_gen->sample(spline,times,trajectory_out.trajectory);
-
-    if(!spline_smoother::sampleSplineTrajectory(spline,times_vec,trajectory_out.request.trajectory))
-      return false;
-
-    return true;
+    return traj.parameterizeAndSample(trajectory_out.request.trajectory,
+                                      trajectory_out.request.limits,
+                                      dT,
+                                      trajectory_out.request.trajectory);
   }
 }
 
@@ -50,10 +50,24 @@ namespace spline_smoother
 
     CubicTrajectory();
 
-    bool parameterize(const trajectory_msgs::JointTrajectory& trajectory_in, 
+    bool parameterize(const trajectory_msgs::JointTrajectory& trajectory_in,
                       const std::vector<arm_navigation_msgs::JointLimits> &limits,
                       spline_smoother::SplineTrajectory& spline);
 
+    /**
+     * \brief Fused equivalent of parameterize() followed by resampling on a regular grid
+     *
+     * Each segment is stretched to its velocity/acceleration limits, its cubic
+     * coefficients are computed and it is immediately sampled at the grid times
+     * (multiples of sample_dt) falling inside it plus the segment boundary, so
+     * no intermediate SplineTrajectory is built and the waypoints are walked
+     * only once. trajectory_out may alias trajectory_in.
+     */
+    bool parameterizeAndSample(const trajectory_msgs::JointTrajectory& trajectory_in,
+                               const std::vector<arm_navigation_msgs::JointLimits> &limits,
+                               const double& sample_dt,
+                               trajectory_msgs::JointTrajectory& trajectory_out);
+
     private:
 
     double minSegmentTime(const double &q0, 
@@ -67,10 +67,30 @@ namespace spline_smoother
                      const double &bb,
                      const double &cc);
 
-    double calculateMinimumTime(const trajectory_msgs::JointTrajectoryPoint &start, 
-                                const trajectory_msgs::JointTrajectoryPoint &end, 
+    double calculateMinimumTime(const trajectory_msgs::JointTrajectoryPoint &start,
+                                const trajectory_msgs::JointTrajectoryPoint &end,
                                 const std::vector<arm_navigation_msgs::JointLimits> &limits);
 
+    /**
+     * \brief Fills the minimum segment durations for joints [joint_begin,joint_end) into
+     * a segment-major arena of size num_segments*num_joints; used as a parallel worker
+     */
+    void computeJointDurations(const trajectory_msgs::JointTrajectory &trajectory,
+                               const std::vector<arm_navigation_msgs::JointLimits> &limits,
+                               int joint_begin,
+                               int joint_end,
+                               std::vector<double> &min_durations);
+
+    /**
+     * \brief Fills the blend coefficients for joints [joint_begin,joint_end) of every
+     * segment, using the final segment durations already stored in the spline
+     */
+    void computeJointCoefficients(const trajectory_msgs::JointTrajectory &trajectory,
+                                  const std::vector<arm_navigation_msgs::JointLimits> &limits,
+                                  int joint_begin,
+                                  int joint_end,
+                                  spline_smoother::LSPBTrajectoryMsg &spline);
+
     bool apply_limits_;
   };
 }
@@ -0,0 +1,88 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/** \author Sachin Chitta */
+
+#ifndef SPLINE_COEFFICIENT_CACHE_H_
+#define SPLINE_COEFFICIENT_CACHE_H_
+
+#include <trajectory_msgs/JointTrajectory.h>
+#include <arm_navigation_msgs/JointLimits.h>
+#include <spline_smoother/SplineTrajectory.h>
+
+namespace spline_smoother
+{
+/**
+ * \brief Process-wide memo of spline parameterizations keyed by
+ * trajectory content.
+ *
+ * Filter chains re-derive the same coefficients stage after stage: a
+ * smoothing stage parameterizes the waypoints, and the velocity
+ * scaling and unnormalization stages behind it parameterize them
+ * again when the waypoints did not change in between. Parameterizers
+ * consult this cache before computing and store their result after.
+ * The key covers everything a parameterization reads - joint names,
+ * waypoint data, limits and a per-parameterizer salt - so any
+ * waypoint mutation between stages misses naturally instead of
+ * needing explicit invalidation. Only a handful of entries are kept;
+ * a chain only ever replays its last few trajectories.
+ */
+class SplineCoefficientCache
+{
+public:
+  /**
+   * \brief Compute the cache key for a trajectory/limits pair. The
+   * salt distinguishes parameterizers (and their settings) that
+   * would derive different splines from the same waypoints.
+   */
+  static unsigned long long key(const trajectory_msgs::JointTrajectory& trajectory,
+                                const std::vector<arm_navigation_msgs::JointLimits>& limits,
+                                unsigned long long salt);
+
+  /**
+   * \brief Look up a previously stored parameterization. Returns
+   * true on a hit and fills in spline.
+   */
+  static bool lookup(unsigned long long key, SplineTrajectory& spline);
+
+  /** \brief Record a computed parameterization for the key */
+  static void store(unsigned long long key, const SplineTrajectory& spline);
+
+  /** \brief Process-wide count of cache hits, for benchmarking */
+  static unsigned long getHitCount();
+};
+
+}
+
+#endif
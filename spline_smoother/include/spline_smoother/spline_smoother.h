@@ -77,6 +77,23 @@ public:
    * \return true if successful, false if not
    */
   virtual bool smooth(const T& trajectory_in, T& trajectory_out) const = 0;
+
+  /**
+   * \brief Smooths a trajectory that grew by appending points to an already smoothed prefix.
+   *
+   * Points before append_index carry the velocities and accelerations from the
+   * previous smooth and are left untouched (apart from a smoother-specific
+   * blend window just before the append), so the cost scales with the
+   * appended region rather than the whole trajectory. The default
+   * implementation simply re-smooths everything, which is always correct;
+   * smoothers with local structure override it.
+   * \param append_index index of the first appended point
+   * \return true if successful, false if not
+   */
+  virtual bool smoothIncremental(const T& trajectory_in, T& trajectory_out, int append_index) const
+  {
+    return smooth(trajectory_in, trajectory_out);
+  }
 };
 
 /////////////////////////// inline functions follow //////////////////////////
@@ -71,6 +71,24 @@ void tridiagonalSolve(std::vector<T>& a,
                       std::vector<T>& d,
                       std::vector<T>& x);
 
+/**
+ * \brief Solves the tridiagonal system of equations, Ax = d, without modifying the inputs
+ *
+ * Same system layout as tridiagonalSolve() above, but the forward elimination
+ * streams the modified diagonals into a caller-provided workspace (resized to
+ * 2n) instead of destroying the inputs, so the band (a, b, c) can be built
+ * once and reused across right-hand sides. Stable without pivoting for the
+ * diagonally dominant systems produced by cubic spline smoothing, for
+ * arbitrary n. Time complexity: O(n)
+ */
+template <typename T>
+void tridiagonalSolve(const std::vector<T>& a,
+                      const std::vector<T>& b,
+                      const std::vector<T>& c,
+                      const std::vector<T>& d,
+                      std::vector<T>& x,
+                      std::vector<T>& workspace);
+
 /////////////////////////// inline implementations follow //////////////////////////////
 
 template <typename T>
@@ -111,6 +129,38 @@ void tridiagonalSolve(std::vector<T>& a,
   }
 }
 
+template <typename T>
+void tridiagonalSolve(const std::vector<T>& a,
+                      const std::vector<T>& b,
+                      const std::vector<T>& c,
+                      const std::vector<T>& d,
+                      std::vector<T>& x,
+                      std::vector<T>& workspace)
+{
+  int n = (int)d.size();
+
+  x.resize(n);
+  if ((int)workspace.size() < 2*n)
+    workspace.resize(2*n);
+
+  // forward elimination into the workspace, leaving a, b, c, d untouched
+  workspace[0] = c[0]/b[0];
+  workspace[n] = d[0]/b[0];
+  for (int i=1; i<n; i++)
+  {
+    T m = b[i] - a[i]*workspace[i-1];
+    workspace[i] = c[i]/m;
+    workspace[n+i] = (d[i] - a[i]*workspace[n+i-1])/m;
+  }
+
+  // backward substitution
+  x[n-1] = workspace[2*n-1];
+  for (int i=n-2; i>=0; i--)
+  {
+    x[i] = workspace[n+i] - workspace[i]*x[i+1];
+  }
+}
+
 /**
  * \brief Ensures the consistency of a WaypointTrajWithLimits message, and resizes vel and acc arrays
  *
@@ -234,10 +284,27 @@ bool sampleSplineTrajectory(const spline_smoother::LSPBTrajectorySegmentMsg &spl
                             const double& input_time, 
                             trajectory_msgs::JointTrajectoryPoint &point_out);
 
-bool sampleSplineTrajectory(const spline_smoother::SplineTrajectory& spline, 
-                            const std::vector<double> &times, 
+bool sampleSplineTrajectory(const spline_smoother::SplineTrajectory& spline,
+                            const std::vector<double> &times,
                             trajectory_msgs::JointTrajectory& traj_out);
 
+/*!
+  \brief Batch-sample a spline trajectory at a set of times
+  \return true on success, false if any failure occurs
+  \param spline The input spline representation of the trajectory.
+  \param times The set of times (in seconds) where the trajectory needs to be sampled, time = 0.0 corresponds to the start of the trajectory.
+  \param traj_out Reference to the output trajectory, one point per input time.
+
+  Unlike repeated single-time sampling, the segment boundaries are computed
+  once up front and sorted times are bucketed into segments in a single
+  forward pass (unsorted times fall back to a binary search), so re-sampling
+  a smoothed trajectory at controller rate costs one segment lookup per
+  segment rather than one per sample.
+*/
+bool samplePoints(const spline_smoother::SplineTrajectory& spline,
+                  const std::vector<double> &times,
+                  trajectory_msgs::JointTrajectory& traj_out);
+
 bool sampleSplineTrajectory(const spline_smoother::LSPBTrajectoryMsg& spline, 
                             const std::vector<double> &times, 
                             trajectory_msgs::JointTrajectory& traj_out);
@@ -75,6 +75,16 @@ void getCubicSplineCoefficients(double start_pos, double start_vel,
 void sampleQuinticSpline(const std::vector<double>& coefficients, double time,
     double& position, double& velocity, double& acceleration);
 
+/**
+ * \brief Samples a polynomial spline segment of arbitrary degree at a particular time
+ *
+ * Evaluates position, velocity and acceleration in a single Horner pass over
+ * the coefficients, avoiding the per-coefficient pow() calls of the naive
+ * evaluation.
+ */
+void samplePolynomial(const std::vector<double>& coefficients, double time,
+    double& position, double& velocity, double& acceleration);
+
 /**
  * \brief Samples a cubic spline segment at a particular time
  */
@@ -143,6 +153,33 @@ inline void sampleQuinticSpline(const std::vector<double>& coefficients, double
       20.0*t[3]*coefficients[5];
 }
 
+inline void samplePolynomial(const std::vector<double>& coefficients, double time,
+    double& position, double& velocity, double& acceleration)
+{
+  int n = coefficients.size();
+  if (n == 0)
+  {
+    position = 0.0;
+    velocity = 0.0;
+    acceleration = 0.0;
+    return;
+  }
+
+  // Horner evaluation of the polynomial and its first two derivatives
+  double b = coefficients[n-1];
+  double d = 0.0;
+  double e = 0.0;
+  for (int j = n-2; j >= 0; j--)
+  {
+    e = e*time + d;
+    d = d*time + b;
+    b = b*time + coefficients[j];
+  }
+  position = b;
+  velocity = d;
+  acceleration = 2.0*e;
+}
+
 inline void getCubicSplineCoefficients(double start_pos, double start_vel,
     double end_pos, double end_vel, double time, std::vector<double>& coefficients)
 {
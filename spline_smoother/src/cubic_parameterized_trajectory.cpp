@@ -35,9 +35,24 @@
 /** \author Sachin Chitta */
 
 #include <spline_smoother/cubic_parameterized_trajectory.h>
+#include <spline_smoother/spline_coefficient_cache.h>
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+
+namespace
+{
+  static const unsigned long long CUBIC_PARAMETERIZED_CACHE_SALT = 0x637562707261ULL;
+  //short sub-trajectories (shortcut candidates and the like) would
+  //churn the cache; only full-length trajectories go through it
+  static const unsigned int MIN_POINTS_FOR_COEFFICIENT_CACHE = 10;
+}
 
 namespace spline_smoother
 {
+  //each segment carries a full 1-d parameterization solve, so the fan-out
+  //already pays off on fairly short trajectories
+  static const int MIN_SEGMENTS_FOR_PARALLEL_PARAMETERIZATION = 8;
+
   CubicParameterizedTrajectory::CubicParameterizedTrajectory()
   {
     apply_limits_ = true;
@@ -135,82 +150,135 @@ namespace spline_smoother
     coefficients[3] = (-2*diff+(v0+v1)*dt)/pow(dt,3);
   }
 
-  bool CubicParameterizedTrajectory::parameterize(const trajectory_msgs::JointTrajectory& trajectory_in, 
-                                                  const std::vector<arm_navigation_msgs::JointLimits> &limits,
-                                                  spline_smoother::SplineTrajectory& spline)
+  void CubicParameterizedTrajectory::parameterizeSegments(const trajectory_msgs::JointTrajectory& trajectory_in,
+                                                          const std::vector<arm_navigation_msgs::JointLimits> &limits,
+                                                          int segment_begin,
+                                                          int segment_end,
+                                                          spline_smoother::SplineTrajectory& spline)
   {
-    int num_traj = trajectory_in.points.size();
     int num_joints = trajectory_in.joint_names.size();
-    spline.names = trajectory_in.joint_names;
-    spline.segments.resize(num_traj-1);
 
-    for(int i=0; i<num_joints; i++)
-    {
-      if(!limits[i].has_velocity_limits)
-      {
-        ROS_ERROR("Trying to apply velocity limits without supplying them. Set velocity_limits in the message and set has_velocity_limits flag to true.");
-        return false;
-      }
-    }
-    for (int i=1; i< num_traj; ++i)
-    {
-      spline.segments[i-1].joints.resize(num_joints);
+    // Start and end parameterized positions, shared by every segment of this worker
+    trajectory_msgs::JointTrajectoryPoint start,end;
+    start.positions.resize(1);
+    start.velocities.resize(1);
+    start.positions[0] = 0.0;
 
-      for(int j =0; j < num_joints; j++)
-        spline.segments[i-1].joints[j].coefficients.resize(4);
-      double dT = (trajectory_in.points[i].time_from_start - trajectory_in.points[i-1].time_from_start).toSec();
+    end.positions.resize(1);
+    end.velocities.resize(1);
+    end.positions[0] = 1.0;
 
-      // Start and end parameterized positions
-      trajectory_msgs::JointTrajectoryPoint start,end;
-      start.positions.resize(1);
-      start.velocities.resize(1);
-      start.positions[0] = 0.0;
+    arm_navigation_msgs::JointLimits parameter_limits;
+    parameter_limits.joint_name = "cubic_parameterization";
 
-      end.positions.resize(1);
-      end.velocities.resize(1);
-      end.positions[0] = 1.0;
+    spline_smoother::CubicTrajectory solver;
+    spline_smoother::SplineTrajectory parameter_spline;
+    arm_navigation_msgs::JointTrajectoryWithLimits wpt;
+    wpt.trajectory.points.push_back(start);
+    wpt.trajectory.points.push_back(end);
+    wpt.limits.resize(1);
+
+    std::vector<double> coefficients;
+
+    for (int i=segment_begin; i< segment_end; ++i)
+    {
+      spline.segments[i].joints.resize(num_joints);
+
+      for(int j =0; j < num_joints; j++)
+        spline.segments[i].joints[j].coefficients.resize(4);
+      double dT = (trajectory_in.points[i+1].time_from_start - trajectory_in.points[i].time_from_start).toSec();
 
       // Velocity limits on parameter
-      arm_navigation_msgs::JointLimits parameter_limits;
-      parameter_limits.joint_name = "cubic_parameterization";
-      getLimit(trajectory_in.points[i-1],trajectory_in.points[i],limits,parameter_limits);
+      getLimit(trajectory_in.points[i],trajectory_in.points[i+1],limits,parameter_limits);
 
       if(apply_limits_)
       {
-        spline_smoother::CubicTrajectory solver;
-        spline_smoother::SplineTrajectory spline;
-        arm_navigation_msgs::JointTrajectoryWithLimits wpt;
         double dTMin;
-
-        wpt.trajectory.points.push_back(start);
-        wpt.trajectory.points.push_back(end);
-        wpt.limits.push_back(parameter_limits);
-
-        solver.parameterize(wpt.trajectory,wpt.limits,spline);
-        spline_smoother::getTotalTime(spline,dTMin);
+        wpt.limits[0] = parameter_limits;
+        solver.parameterize(wpt.trajectory,wpt.limits,parameter_spline);
+        spline_smoother::getTotalTime(parameter_spline,dTMin);
         if(dTMin > dT) // if minimum time required to satisfy limits is greater than time available, stretch this segment
-          dT = dTMin;      
+          dT = dTMin;
       }
 
-      std::vector<double> coefficients;
       solveCubicSpline(start.positions[0],
                        end.positions[0],
                        0.0,
                        0.0,
                        dT,
                        coefficients);
-      spline.segments[i-1].duration = ros::Duration(dT);
+      spline.segments[i].duration = ros::Duration(dT);
 
       for(int j=0; j<num_joints; j++)
       {
-        double diff = trajectory_in.points[i].positions[j] - trajectory_in.points[i-1].positions[j];
+        double diff = trajectory_in.points[i+1].positions[j] - trajectory_in.points[i].positions[j];
 
-        spline.segments[i-1].joints[j].coefficients[0] = trajectory_in.points[i-1].positions[j] + diff * coefficients[0];
-        spline.segments[i-1].joints[j].coefficients[1] = diff*coefficients[1];
-        spline.segments[i-1].joints[j].coefficients[2] = diff*coefficients[2];
-        spline.segments[i-1].joints[j].coefficients[3] = diff*coefficients[3];
+        spline.segments[i].joints[j].coefficients[0] = trajectory_in.points[i].positions[j] + diff * coefficients[0];
+        spline.segments[i].joints[j].coefficients[1] = diff*coefficients[1];
+        spline.segments[i].joints[j].coefficients[2] = diff*coefficients[2];
+        spline.segments[i].joints[j].coefficients[3] = diff*coefficients[3];
       }
     }
+  }
+
+  bool CubicParameterizedTrajectory::parameterize(const trajectory_msgs::JointTrajectory& trajectory_in,
+                                                  const std::vector<arm_navigation_msgs::JointLimits> &limits,
+                                                  spline_smoother::SplineTrajectory& spline)
+  {
+    int num_traj = trajectory_in.points.size();
+    int num_joints = trajectory_in.joint_names.size();
+    int num_segments = num_traj-1;
+
+    //same memo the cubic parameterizer uses - a stage downstream of an
+    //unchanged trajectory gets its coefficients back without rework
+    unsigned long long cache_key = 0;
+    bool use_cache = (unsigned int) num_traj >= MIN_POINTS_FOR_COEFFICIENT_CACHE;
+    if(use_cache)
+    {
+      cache_key = SplineCoefficientCache::key(trajectory_in, limits,
+                                              CUBIC_PARAMETERIZED_CACHE_SALT + (apply_limits_ ? 1 : 0));
+      if(SplineCoefficientCache::lookup(cache_key, spline))
+        return true;
+    }
+
+    spline.names = trajectory_in.joint_names;
+    spline.segments.resize(num_segments);
+
+    for(int i=0; i<num_joints; i++)
+    {
+      if(!limits[i].has_velocity_limits)
+      {
+        ROS_ERROR("Trying to apply velocity limits without supplying them. Set velocity_limits in the message and set has_velocity_limits flag to true.");
+        return false;
+      }
+    }
+
+    //segments only depend on their own pair of waypoints, so they can be
+    //parameterized in parallel, each worker taking a contiguous range
+    int num_threads = 1;
+    if(num_segments >= MIN_SEGMENTS_FOR_PARALLEL_PARAMETERIZATION)
+    {
+      num_threads = (int)boost::thread::hardware_concurrency();
+      if(num_threads > num_segments)
+        num_threads = num_segments;
+      if(num_threads < 1)
+        num_threads = 1;
+    }
+
+    if(num_threads > 1)
+    {
+      boost::thread_group worker_threads;
+      for(int t=0; t<num_threads; t++)
+        worker_threads.create_thread(boost::bind(&CubicParameterizedTrajectory::parameterizeSegments,this,
+                                                 boost::cref(trajectory_in),boost::cref(limits),
+                                                 (num_segments*t)/num_threads,(num_segments*(t+1))/num_threads,
+                                                 boost::ref(spline)));
+      worker_threads.join_all();
+    }
+    else
+      parameterizeSegments(trajectory_in,limits,0,num_segments,spline);
+    if(use_cache)
+      SplineCoefficientCache::store(cache_key, spline);
     return true;
   }
 }
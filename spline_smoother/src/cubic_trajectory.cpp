@@ -35,6 +35,16 @@
 /** \author Sachin Chitta */
 
 #include <spline_smoother/cubic_trajectory.h>
+#include <spline_smoother/splines.h>
+#include <spline_smoother/spline_coefficient_cache.h>
+
+namespace
+{
+static const unsigned long long CUBIC_TRAJECTORY_CACHE_SALT = 0x6375626963ULL;
+//the shortcutters parameterize lots of tiny sub-trajectories that
+//would churn the cache; only full-length trajectories go through it
+static const unsigned int MIN_POINTS_FOR_COEFFICIENT_CACHE = 10;
+}
 
 namespace spline_smoother
 {
@@ -208,6 +218,20 @@ bool CubicTrajectory::validSolution(const double &q0,
   {
     int num_traj = trajectory_in.points.size();
     int num_joints = trajectory_in.joint_names.size();
+
+    //downstream filter stages re-parameterize the waypoints the stage
+    //before them just parameterized; a content-keyed hit hands back
+    //the coefficients without re-deriving them
+    unsigned long long cache_key = 0;
+    bool use_cache = (unsigned int) num_traj >= MIN_POINTS_FOR_COEFFICIENT_CACHE;
+    if(use_cache)
+    {
+      cache_key = SplineCoefficientCache::key(trajectory_in, limits,
+                                              CUBIC_TRAJECTORY_CACHE_SALT + (apply_limits_ ? 1 : 0));
+      if(SplineCoefficientCache::lookup(cache_key, spline))
+        return true;
+    }
+
     spline.names = trajectory_in.joint_names;
     spline.segments.resize(num_traj-1);
 
@@ -233,22 +257,114 @@ bool CubicTrajectory::validSolution(const double &q0,
         dT = dTMin;      
       }
       spline.segments[i-1].duration = ros::Duration(dT);
+      //segment-wide values hoisted out of the joint loop
+      double dTs = spline.segments[i-1].duration.toSec();
+      double dTs2 = dTs*dTs;
+      double dTs3 = dTs2*dTs;
+      const trajectory_msgs::JointTrajectoryPoint& prev = trajectory_in.points[i-1];
+      const trajectory_msgs::JointTrajectoryPoint& next = trajectory_in.points[i];
       for(int j=0; j<num_joints; j++)
       {
-        //        double diff = jointDiff(trajectory_in.points[i-1].positions[j],trajectory_in.points[i].positions[j],limits[j]);
-        double diff = trajectory_in.points[i].positions[j] - trajectory_in.points[i-1].positions[j];
-        spline.segments[i-1].joints[j].coefficients[0] = trajectory_in.points[i-1].positions[j];
-        spline.segments[i-1].joints[j].coefficients[1] = trajectory_in.points[i-1].velocities[j];
-        spline.segments[i-1].joints[j].coefficients[2] = (3*diff-(2*trajectory_in.points[i-1].velocities[j]+trajectory_in.points[i].velocities[j])*spline.segments[i-1].duration.toSec())/(spline.segments[i-1].duration.toSec()*spline.segments[i-1].duration.toSec());;
-        spline.segments[i-1].joints[j].coefficients[3] = (-2*diff+(trajectory_in.points[i-1].velocities[j]+trajectory_in.points[i].velocities[j])*spline.segments[i-1].duration.toSec())/pow(spline.segments[i-1].duration.toSec(),3);
+        //        double diff = jointDiff(prev.positions[j],next.positions[j],limits[j]);
+        double diff = next.positions[j] - prev.positions[j];
+        std::vector<double>& coefficients = spline.segments[i-1].joints[j].coefficients;
+        coefficients[0] = prev.positions[j];
+        coefficients[1] = prev.velocities[j];
+        coefficients[2] = (3*diff-(2*prev.velocities[j]+next.velocities[j])*dTs)/dTs2;
+        coefficients[3] = (-2*diff+(prev.velocities[j]+next.velocities[j])*dTs)/dTs3;
       }
     }
+    if(use_cache)
+      SplineCoefficientCache::store(cache_key, spline);
     return true;
   }
 
-bool CubicTrajectory::quadSolve(const double &a, 
-                                const double &b, 
-                                const double &c, 
+  bool CubicTrajectory::parameterizeAndSample(const trajectory_msgs::JointTrajectory& trajectory_in,
+                                              const std::vector<arm_navigation_msgs::JointLimits> &limits,
+                                              const double& sample_dt,
+                                              trajectory_msgs::JointTrajectory& trajectory_out)
+  {
+    int num_traj = trajectory_in.points.size();
+    int num_joints = trajectory_in.joint_names.size();
+    if(num_traj < 2 || sample_dt <= 0.0)
+      return false;
+
+    for(int i=0; i<num_joints; i++)
+    {
+      if(!limits[i].has_velocity_limits)
+      {
+        ROS_ERROR("Trying to apply velocity limits without supplying them. Set velocity_limits in the message and set has_velocity_limits flag to true.");
+        return false;
+      }
+    }
+
+    //sampled points are built on the side so trajectory_out may alias trajectory_in
+    std::vector<trajectory_msgs::JointTrajectoryPoint> points;
+    points.reserve((size_t)(trajectory_in.points.back().time_from_start.toSec()/sample_dt)+num_traj);
+
+    //cubic coefficients of the current segment, one set per joint, reused
+    //across segments
+    std::vector<std::vector<double> > coefficients(num_joints,std::vector<double>(4));
+    trajectory_msgs::JointTrajectoryPoint point;
+    point.positions.resize(num_joints);
+    point.velocities.resize(num_joints);
+    point.accelerations.resize(num_joints);
+
+    double start_time = 0.0;
+    double next_grid_time = sample_dt;
+    for (int i=1; i< num_traj; ++i)
+    {
+      const trajectory_msgs::JointTrajectoryPoint& prev = trajectory_in.points[i-1];
+      const trajectory_msgs::JointTrajectoryPoint& next = trajectory_in.points[i];
+      double dT = (next.time_from_start - prev.time_from_start).toSec();
+      if(apply_limits_)
+      {
+      double dTMin = calculateMinimumTime(prev,next,limits);
+      if(dTMin > dT) // if minimum time required to satisfy limits is greater than time available, stretch this segment
+        dT = dTMin;
+      }
+      double dTs = dT;
+      double dTs2 = dTs*dTs;
+      double dTs3 = dTs2*dTs;
+      for(int j=0; j<num_joints; j++)
+      {
+        double diff = next.positions[j] - prev.positions[j];
+        coefficients[j][0] = prev.positions[j];
+        coefficients[j][1] = prev.velocities[j];
+        coefficients[j][2] = (3*diff-(2*prev.velocities[j]+next.velocities[j])*dTs)/dTs2;
+        coefficients[j][3] = (-2*diff+(prev.velocities[j]+next.velocities[j])*dTs)/dTs3;
+      }
+      //sample the grid times inside this segment, then the segment boundary
+      double end_time = start_time + dTs;
+      while(next_grid_time < end_time)
+      {
+        for(int j=0; j<num_joints; j++)
+          samplePolynomial(coefficients[j],next_grid_time-start_time,
+                           point.positions[j],point.velocities[j],point.accelerations[j]);
+        point.time_from_start = ros::Duration(next_grid_time);
+        points.push_back(point);
+        next_grid_time += sample_dt;
+      }
+      for(int j=0; j<num_joints; j++)
+        samplePolynomial(coefficients[j],dTs,
+                         point.positions[j],point.velocities[j],point.accelerations[j]);
+      point.time_from_start = ros::Duration(end_time);
+      points.push_back(point);
+      //a grid time coinciding with the boundary has just been emitted
+      while(next_grid_time <= end_time)
+        next_grid_time += sample_dt;
+      start_time = end_time;
+    }
+
+    trajectory_out.header = trajectory_in.header;
+    trajectory_out.joint_names = trajectory_in.joint_names;
+    trajectory_out.points.swap(points);
+    return true;
+  }
+
+bool CubicTrajectory::quadSolve(const double &a,
+                                const double &b,
+                                const double &c,
                                 double &solution)
 {
   double t1(0.0), t2(0.0);
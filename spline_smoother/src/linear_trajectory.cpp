@@ -95,10 +95,11 @@ namespace spline_smoother
           dT = dTMin;      
       }
       spline.segments[i-1].duration = ros::Duration(dT);
+      double inv_dTs = 1.0/spline.segments[i-1].duration.toSec();
       for(int j=0; j<num_joints; j++)
       {
         spline.segments[i-1].joints[j].coefficients[0] = trajectory_in.points[i-1].positions[j];
-        spline.segments[i-1].joints[j].coefficients[1] = jointDiff(trajectory_in.points[i-1].positions[j],trajectory_in.points[i].positions[j],limits[j])/spline.segments[i-1].duration.toSec();
+        spline.segments[i-1].joints[j].coefficients[1] = jointDiff(trajectory_in.points[i-1].positions[j],trajectory_in.points[i].positions[j],limits[j])*inv_dTs;
       }
     }
     return true;
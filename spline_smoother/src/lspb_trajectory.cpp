@@ -35,9 +35,15 @@
 /** \author Sachin Chitta */
 
 #include <spline_smoother/lspb_trajectory.h>
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
 
 namespace spline_smoother
 {
+  //below this many joints the per-segment timings are too cheap for the
+  //thread fan-out to pay off; dual-arm setups sit comfortably above it
+  static const int MIN_JOINTS_FOR_PARALLEL_PARAMETERIZATION = 8;
+
   LSPBTrajectory::LSPBTrajectory()
   {
     apply_limits_ = true;
@@ -133,14 +139,62 @@ namespace spline_smoother
     return fabs(diff/(a*tf));
   }
 */
+  void LSPBTrajectory::computeJointDurations(const trajectory_msgs::JointTrajectory &trajectory,
+                                             const std::vector<arm_navigation_msgs::JointLimits> &limits,
+                                             int joint_begin,
+                                             int joint_end,
+                                             std::vector<double> &min_durations)
+  {
+    int num_traj = (int)trajectory.points.size();
+    int num_joints = (int)trajectory.joint_names.size();
+    for (int i=1; i< num_traj; ++i)
+    {
+      const trajectory_msgs::JointTrajectoryPoint &prev = trajectory.points[i-1];
+      const trajectory_msgs::JointTrajectoryPoint &next = trajectory.points[i];
+      for(int j=joint_begin; j<joint_end; j++)
+        min_durations[(i-1)*num_joints+j] = minSegmentTime(prev.positions[j],next.positions[j],prev.velocities[j],next.velocities[j],limits[j]);
+    }
+  }
+
+  void LSPBTrajectory::computeJointCoefficients(const trajectory_msgs::JointTrajectory &trajectory,
+                                                const std::vector<arm_navigation_msgs::JointLimits> &limits,
+                                                int joint_begin,
+                                                int joint_end,
+                                                spline_smoother::LSPBTrajectoryMsg &spline)
+  {
+    int num_traj = (int)trajectory.points.size();
+    for (int i=1; i< num_traj; ++i)
+    {
+      double dT = spline.segments[i-1].duration.toSec();
+      for(int j=joint_begin; j<joint_end; j++)
+      {
+        double diff = jointDiff(trajectory.points[i-1].positions[j],trajectory.points[i].positions[j],limits[j]);
+        double acc = 0.0;
+        if(diff > 0)
+          acc = limits[j].max_acceleration;
+        else
+          acc = - limits[j].max_acceleration;
+        double tb = blendTime(acc,-acc*dT,diff);
+//        double tb = blendTime(diff,acc,dT);
+
+        spline.segments[i-1].joints[j].coefficients[0] = trajectory.points[i-1].positions[j];
+        spline.segments[i-1].joints[j].coefficients[1] = 0.0;
+        spline.segments[i-1].joints[j].coefficients[2] = 0.5*acc;
+        spline.segments[i-1].joints[j].quadratic_segment_duration = tb;
+        spline.segments[i-1].joints[j].linear_segment_duration = std::max(dT-2*tb,0.0);
+      }
+    }
+  }
+
   bool LSPBTrajectory::parameterize(const trajectory_msgs::JointTrajectory& trajectory_in,
                                     const std::vector<arm_navigation_msgs::JointLimits>& limits,
                                     spline_smoother::LSPBTrajectoryMsg& spline)
   {
     int num_traj = trajectory_in.points.size();
     int num_joints = trajectory_in.joint_names.size();
+    int num_segments = num_traj-1;
     spline.names = trajectory_in.joint_names;
-    spline.segments.resize(num_traj-1);
+    spline.segments.resize(num_segments);
 
     for(int i=0; i<num_joints; i++)
     {
@@ -155,38 +209,71 @@ namespace spline_smoother
         return false;
       }
     }
-    for (int i=1; i< num_traj; ++i)
+    for (int i=0; i< num_segments; ++i)
     {
-      spline.segments[i-1].joints.resize(num_joints);
-      for(unsigned int j=0; j < spline.segments[i-1].joints.size(); j++)
-        spline.segments[i-1].joints[j].coefficients.resize(3);
+      spline.segments[i].joints.resize(num_joints);
+      for(unsigned int j=0; j < spline.segments[i].joints.size(); j++)
+        spline.segments[i].joints[j].coefficients.resize(3);
+    }
+
+    int num_threads = 1;
+    if(num_joints >= MIN_JOINTS_FOR_PARALLEL_PARAMETERIZATION)
+    {
+      num_threads = (int)boost::thread::hardware_concurrency();
+      if(num_threads > num_joints)
+        num_threads = num_joints;
+      if(num_threads < 1)
+        num_threads = 1;
+    }
+
+    //per-joint minimum durations go into one segment-major arena that is
+    //allocated once and shared by the workers, each writing its own joints
+    std::vector<double> min_durations;
+    if(apply_limits_)
+    {
+      min_durations.resize(num_segments*num_joints);
+      if(num_threads > 1)
+      {
+        boost::thread_group worker_threads;
+        for(int t=0; t<num_threads; t++)
+          worker_threads.create_thread(boost::bind(&LSPBTrajectory::computeJointDurations,this,
+                                                   boost::cref(trajectory_in),boost::cref(limits),
+                                                   (num_joints*t)/num_threads,(num_joints*(t+1))/num_threads,
+                                                   boost::ref(min_durations)));
+        worker_threads.join_all();
+      }
+      else
+        computeJointDurations(trajectory_in,limits,0,num_joints,min_durations);
+    }
 
+    //max-reduction over the per-joint durations fixes each segment's time
+    for (int i=1; i< num_traj; ++i)
+    {
       double dT = (trajectory_in.points[i].time_from_start - trajectory_in.points[i-1].time_from_start).toSec();
       if(apply_limits_)
       {
-        double dTMin = calculateMinimumTime(trajectory_in.points[i-1],trajectory_in.points[i],limits);
+        double dTMin = 0.0;
+        for(int j=0; j<num_joints; j++)
+          if(min_durations[(i-1)*num_joints+j] > dTMin)
+            dTMin = min_durations[(i-1)*num_joints+j];
         if(dTMin > dT) // if minimum time required to satisfy limits is greater than time available, stretch this segment
-          dT = dTMin;      
+          dT = dTMin;
       }
       spline.segments[i-1].duration = ros::Duration(dT);
-      for(int j=0; j<num_joints; j++)
-      {
-        double diff = jointDiff(trajectory_in.points[i-1].positions[j],trajectory_in.points[i].positions[j],limits[j]);
-        double acc = 0.0;
-        if(diff > 0)
-          acc = limits[j].max_acceleration;
-        else
-          acc = - limits[j].max_acceleration;
-        double tb = blendTime(acc,-acc*dT,diff);
-//        double tb = blendTime(diff,acc,dT);
+    }
 
-        spline.segments[i-1].joints[j].coefficients[0] = trajectory_in.points[i-1].positions[j];
-        spline.segments[i-1].joints[j].coefficients[1] = 0.0;
-        spline.segments[i-1].joints[j].coefficients[2] = 0.5*acc;
-        spline.segments[i-1].joints[j].quadratic_segment_duration = tb;
-        spline.segments[i-1].joints[j].linear_segment_duration = std::max(dT-2*tb,0.0);
-      }
+    if(num_threads > 1)
+    {
+      boost::thread_group worker_threads;
+      for(int t=0; t<num_threads; t++)
+        worker_threads.create_thread(boost::bind(&LSPBTrajectory::computeJointCoefficients,this,
+                                                 boost::cref(trajectory_in),boost::cref(limits),
+                                                 (num_joints*t)/num_threads,(num_joints*(t+1))/num_threads,
+                                                 boost::ref(spline)));
+      worker_threads.join_all();
     }
+    else
+      computeJointCoefficients(trajectory_in,limits,0,num_joints,spline);
     return true;
   }
 }
@@ -0,0 +1,138 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/** \author Sachin Chitta */
+
+#include <spline_smoother/spline_coefficient_cache.h>
+
+#include <boost/thread/mutex.hpp>
+#include <list>
+#include <utility>
+
+namespace
+{
+//splines can be sizable and a chain only replays its last few
+//trajectories, so the cache stays tiny
+static const unsigned int MAX_CACHE_ENTRIES = 4;
+
+boost::mutex cache_lock;
+std::list<std::pair<unsigned long long, spline_smoother::SplineTrajectory> > cache_entries;
+unsigned long cache_hits = 0;
+
+//FNV-1a
+unsigned long long hashBytes(const unsigned char* bytes, unsigned int count, unsigned long long hash)
+{
+  for(unsigned int i = 0; i < count; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+unsigned long long hashDoubles(const std::vector<double>& values, unsigned long long hash)
+{
+  if(values.empty()) {
+    return hash;
+  }
+  return hashBytes((const unsigned char*)(&values[0]), values.size() * sizeof(double), hash);
+}
+}
+
+unsigned long long spline_smoother::SplineCoefficientCache::key(const trajectory_msgs::JointTrajectory& trajectory,
+                                                                const std::vector<arm_navigation_msgs::JointLimits>& limits,
+                                                                unsigned long long salt)
+{
+  unsigned long long hash = 14695981039346656037ULL;
+  hash = hashBytes((const unsigned char*)(&salt), sizeof(salt), hash);
+  for(unsigned int i = 0; i < trajectory.joint_names.size(); i++) {
+    hash = hashBytes((const unsigned char*)(trajectory.joint_names[i].c_str()),
+                     trajectory.joint_names[i].size() + 1, hash);
+  }
+  for(unsigned int i = 0; i < trajectory.points.size(); i++) {
+    const trajectory_msgs::JointTrajectoryPoint& point = trajectory.points[i];
+    double stamp = point.time_from_start.toSec();
+    hash = hashBytes((const unsigned char*)(&stamp), sizeof(stamp), hash);
+    hash = hashDoubles(point.positions, hash);
+    hash = hashDoubles(point.velocities, hash);
+    hash = hashDoubles(point.accelerations, hash);
+  }
+  for(unsigned int i = 0; i < limits.size(); i++) {
+    double values[4];
+    values[0] = limits[i].has_velocity_limits ? limits[i].max_velocity : -1.0;
+    values[1] = limits[i].has_acceleration_limits ? limits[i].max_acceleration : -1.0;
+    values[2] = limits[i].has_position_limits ? limits[i].min_position : 0.0;
+    values[3] = limits[i].has_position_limits ? limits[i].max_position : 0.0;
+    hash = hashBytes((const unsigned char*)(values), sizeof(values), hash);
+  }
+  return hash;
+}
+
+bool spline_smoother::SplineCoefficientCache::lookup(unsigned long long key, SplineTrajectory& spline)
+{
+  boost::mutex::scoped_lock lock(cache_lock);
+  for(std::list<std::pair<unsigned long long, SplineTrajectory> >::iterator it = cache_entries.begin();
+      it != cache_entries.end();
+      it++) {
+    if(it->first == key) {
+      spline = it->second;
+      //most recently used first
+      cache_entries.splice(cache_entries.begin(), cache_entries, it);
+      cache_hits++;
+      return true;
+    }
+  }
+  return false;
+}
+
+void spline_smoother::SplineCoefficientCache::store(unsigned long long key, const SplineTrajectory& spline)
+{
+  boost::mutex::scoped_lock lock(cache_lock);
+  for(std::list<std::pair<unsigned long long, SplineTrajectory> >::iterator it = cache_entries.begin();
+      it != cache_entries.end();
+      it++) {
+    if(it->first == key) {
+      return;
+    }
+  }
+  cache_entries.push_front(std::make_pair(key, spline));
+  while(cache_entries.size() > MAX_CACHE_ENTRIES) {
+    cache_entries.pop_back();
+  }
+}
+
+unsigned long spline_smoother::SplineCoefficientCache::getHitCount()
+{
+  boost::mutex::scoped_lock lock(cache_lock);
+  return cache_hits;
+}
@@ -35,9 +35,11 @@
 /** \author Sachin Chitta */
 
 #include <spline_smoother/spline_smoother_utils.h>
+#include <spline_smoother/splines.h>
 #include <spline_smoother/LSPBTrajectoryMsg.h>
 #include <spline_smoother/SplineTrajectory.h>
 #include <angles/angles.h>
+#include <algorithm>
 
 namespace spline_smoother
 {
@@ -242,26 +244,71 @@ bool sampleSplineTrajectory(const spline_smoother::LSPBTrajectorySegmentMsg &spl
   return true;
 }
 
-bool sampleSplineTrajectory(const spline_smoother::SplineTrajectory& spline, 
-                            const std::vector<double> &times, 
+bool sampleSplineTrajectory(const spline_smoother::SplineTrajectory& spline,
+                            const std::vector<double> &times,
                             trajectory_msgs::JointTrajectory& traj_out)
 {
-  bool success = true;
-  trajectory_msgs::JointTrajectoryPoint point_out;
-  spline_smoother::SplineTrajectorySegment spline_segment;
-  double segment_time;
+  return samplePoints(spline,times,traj_out);
+}
+
+bool samplePoints(const spline_smoother::SplineTrajectory& spline,
+                  const std::vector<double> &times,
+                  trajectory_msgs::JointTrajectory& traj_out)
+{
   traj_out.points.clear();
   traj_out.points.resize(times.size());
+  traj_out.joint_names = spline.names;
+
+  int num_segments = spline.segments.size();
+  if(num_segments == 0)
+    return times.empty();
+
+  //cumulative segment end times, computed once for the whole batch
+  std::vector<double> segment_end_times(num_segments);
+  double total_time = 0.0;
+  for(int i=0; i < num_segments; i++)
+  {
+    total_time += spline.segments[i].duration.toSec();
+    segment_end_times[i] = total_time;
+  }
+
+  int segment_index = 0;
+  double prev_time = -DBL_MAX;
   for(int i=0; i < (int)times.size(); i++)
   {
     ROS_DEBUG("Input time:%d %f",i,times[i]);
-    success = success && findSplineSegment(spline,times[i],spline_segment,segment_time);
-    success = success && sampleSplineTrajectory(spline_segment,segment_time,point_out);    
+    if(times[i] < prev_time)
+    {
+      //unsorted input; restart the lookup with a binary search
+      segment_index = std::upper_bound(segment_end_times.begin(),segment_end_times.end(),times[i]) - segment_end_times.begin();
+      if(segment_index >= num_segments)
+        segment_index = num_segments-1;
+    }
+    else
+    {
+      while(segment_index < num_segments-1 && times[i] > segment_end_times[segment_index])
+        segment_index++;
+    }
+    prev_time = times[i];
+
+    const spline_smoother::SplineTrajectorySegment& segment = spline.segments[segment_index];
+    double segment_time = times[i] - (segment_end_times[segment_index] - segment.duration.toSec());
+    if(segment_time > segment.duration.toSec())
+      segment_time = segment.duration.toSec();
+
+    trajectory_msgs::JointTrajectoryPoint& point_out = traj_out.points[i];
+    int joint_num = segment.joints.size();
+    point_out.positions.resize(joint_num);
+    point_out.velocities.resize(joint_num);
+    point_out.accelerations.resize(joint_num);
+    for(int j=0; j < joint_num; j++)
+    {
+      samplePolynomial(segment.joints[j].coefficients,segment_time,
+                       point_out.positions[j],point_out.velocities[j],point_out.accelerations[j]);
+    }
     point_out.time_from_start = ros::Duration(times[i]);
-    traj_out.points[i] = point_out;
   }
-  traj_out.joint_names = spline.names;
-  return success;
+  return true;
 }
 
 bool sampleSplineTrajectory(const spline_smoother::LSPBTrajectoryMsg& spline, 
@@ -0,0 +1,138 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2009, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+/** \author Sachin Chitta */
+
+#include <gtest/gtest.h>
+#include <arm_navigation_msgs/JointTrajectoryWithLimits.h>
+#include <spline_smoother/cubic_trajectory.h>
+#include <spline_smoother/spline_coefficient_cache.h>
+
+static void makeTrajectory(arm_navigation_msgs::JointTrajectoryWithLimits& wpt)
+{
+  //long enough to clear the cache's minimum-size gate
+  int length = 12;
+  int joints = 2;
+
+  wpt.trajectory.points.resize(length);
+  wpt.trajectory.joint_names.resize(joints);
+  wpt.trajectory.joint_names[0] = std::string("test0");
+  wpt.trajectory.joint_names[1] = std::string("test1");
+
+  wpt.limits.resize(joints);
+  wpt.limits[0].max_velocity = 0.5;
+  wpt.limits[0].has_velocity_limits = 1;
+  wpt.limits[1].max_velocity = 0.25;
+  wpt.limits[1].has_velocity_limits = 1;
+
+  for (int i=0; i<length; i++)
+  {
+    wpt.trajectory.points[i].positions.resize(joints);
+    wpt.trajectory.points[i].velocities.resize(joints);
+    wpt.trajectory.points[i].accelerations.resize(joints);
+    for(int j=0; j<joints; j++)
+    {
+      wpt.trajectory.points[i].positions[j] = 0.1*i+j;
+      wpt.trajectory.points[i].velocities[j] = 0.0;
+      wpt.trajectory.points[i].accelerations[j] = 0.0;
+    }
+    wpt.trajectory.points[i].time_from_start = ros::Duration(0.0);
+  }
+}
+
+TEST(TestSplineCoefficientCache, TestRepeatHitsAndMutationMisses)
+{
+  spline_smoother::CubicTrajectory traj;
+
+  arm_navigation_msgs::JointTrajectoryWithLimits wpt;
+  makeTrajectory(wpt);
+
+  spline_smoother::SplineTrajectory first_spline;
+  EXPECT_TRUE(traj.parameterize(wpt.trajectory,wpt.limits,first_spline));
+
+  //the second pass over identical waypoints must come from the cache
+  //and match the first result exactly
+  unsigned long hits_before = spline_smoother::SplineCoefficientCache::getHitCount();
+  spline_smoother::SplineTrajectory second_spline;
+  EXPECT_TRUE(traj.parameterize(wpt.trajectory,wpt.limits,second_spline));
+  EXPECT_EQ(hits_before+1, spline_smoother::SplineCoefficientCache::getHitCount());
+
+  ASSERT_EQ(first_spline.segments.size(), second_spline.segments.size());
+  for(unsigned int i=0; i < first_spline.segments.size(); i++)
+  {
+    EXPECT_EQ(first_spline.segments[i].duration, second_spline.segments[i].duration);
+    ASSERT_EQ(first_spline.segments[i].joints.size(), second_spline.segments[i].joints.size());
+    for(unsigned int j=0; j < first_spline.segments[i].joints.size(); j++)
+    {
+      ASSERT_EQ(first_spline.segments[i].joints[j].coefficients.size(),
+                second_spline.segments[i].joints[j].coefficients.size());
+      for(unsigned int k=0; k < first_spline.segments[i].joints[j].coefficients.size(); k++)
+        EXPECT_EQ(first_spline.segments[i].joints[j].coefficients[k],
+                  second_spline.segments[i].joints[j].coefficients[k]);
+    }
+  }
+
+  //mutating a waypoint must miss and re-derive
+  wpt.trajectory.points[5].positions[0] += 0.25;
+  hits_before = spline_smoother::SplineCoefficientCache::getHitCount();
+  spline_smoother::SplineTrajectory mutated_spline;
+  EXPECT_TRUE(traj.parameterize(wpt.trajectory,wpt.limits,mutated_spline));
+  EXPECT_EQ(hits_before, spline_smoother::SplineCoefficientCache::getHitCount());
+}
+
+TEST(TestSplineCoefficientCache, TestKeyCoverage)
+{
+  arm_navigation_msgs::JointTrajectoryWithLimits wpt;
+  makeTrajectory(wpt);
+
+  unsigned long long base_key = spline_smoother::SplineCoefficientCache::key(wpt.trajectory,wpt.limits,0);
+  EXPECT_EQ(base_key, spline_smoother::SplineCoefficientCache::key(wpt.trajectory,wpt.limits,0));
+
+  //different salt, mutated waypoint and changed limits must all move the key
+  EXPECT_NE(base_key, spline_smoother::SplineCoefficientCache::key(wpt.trajectory,wpt.limits,1));
+
+  arm_navigation_msgs::JointTrajectoryWithLimits mutated = wpt;
+  mutated.trajectory.points[3].velocities[1] = 0.05;
+  EXPECT_NE(base_key, spline_smoother::SplineCoefficientCache::key(mutated.trajectory,mutated.limits,0));
+
+  mutated = wpt;
+  mutated.limits[0].max_velocity = 0.4;
+  EXPECT_NE(base_key, spline_smoother::SplineCoefficientCache::key(mutated.trajectory,mutated.limits,0));
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
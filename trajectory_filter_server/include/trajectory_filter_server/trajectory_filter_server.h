@@ -72,6 +72,7 @@ private:
 
   ros::NodeHandle private_handle_, root_handle_;
   ros::ServiceServer filter_service_, filter_constraints_service_;
+  ros::Publisher trace_publisher_;
   std::map<std::string, arm_navigation_msgs::JointLimits> joint_limits_;
 
   int service_type_;
@@ -35,6 +35,7 @@
 /** \author Mrinal Kalakrishnan, Sachin Chitta */
 
 #include <trajectory_filter_server/trajectory_filter_server.h>
+#include <arm_navigation_msgs/trace.h>
 #include <pluginlib/class_loader.h>
 
 namespace trajectory_filter_server
@@ -58,7 +59,8 @@ TrajectoryFilterServer::TrajectoryFilterServer() : private_handle_("~"),
   }
   else
     service_type_ = FILTER_JOINT_TRAJECTORY;
-  
+
+  trace_publisher_ = arm_navigation_msgs::advertiseTraceTopic(root_handle_);
 }
 
 TrajectoryFilterServer::~TrajectoryFilterServer()
@@ -108,15 +110,27 @@ bool TrajectoryFilterServer::filter(arm_navigation_msgs::FilterJointTrajectory::
             (int)req.trajectory.joint_names.size());
   getLimits(req.trajectory,req.limits);
   arm_navigation_msgs::FilterJointTrajectory orig_request;
-  orig_request.request = req;
+  //swap the point and limit arrays into the chain buffer instead of copying
+  //them; the incoming request is not read again after this
+  orig_request.request.trajectory.header = req.trajectory.header;
+  orig_request.request.trajectory.joint_names.swap(req.trajectory.joint_names);
+  orig_request.request.trajectory.points.swap(req.trajectory.points);
+  orig_request.request.start_state = req.start_state;
+  orig_request.request.limits.swap(req.limits);
+  orig_request.request.allowed_time = req.allowed_time;
+  orig_request.request.trace_id = req.trace_id;
   arm_navigation_msgs::FilterJointTrajectory chain_response;
+  chain_response.request.trajectory.points.reserve(orig_request.request.trajectory.points.size());
+  arm_navigation_msgs::ScopedTraceSpan span(trace_publisher_,req.trace_id,"filter_chain");
   if (!filter_chain_.update(orig_request,chain_response))
   {
     ROS_WARN("Filter chain failed to process trajectory");
     resp.error_code.val = chain_response.response.error_code.val;
     return true;
   }
-  resp.trajectory = chain_response.request.trajectory;
+  resp.trajectory.header = chain_response.request.trajectory.header;
+  resp.trajectory.joint_names.swap(chain_response.request.trajectory.joint_names);
+  resp.trajectory.points.swap(chain_response.request.trajectory.points);
   resp.error_code.val = resp.error_code.SUCCESS;
   return true;
 }
@@ -130,14 +144,28 @@ bool TrajectoryFilterServer::filterConstraints(arm_navigation_msgs::FilterJointT
   arm_navigation_msgs::FilterJointTrajectoryWithConstraints filter_response;
   getLimits(req.trajectory,req.limits);
   arm_navigation_msgs::FilterJointTrajectoryWithConstraints orig_request;
-  orig_request.request = req;
+  //as above, hand the trajectory to the chain by swapping the heavy arrays
+  orig_request.request.trajectory.header = req.trajectory.header;
+  orig_request.request.trajectory.joint_names.swap(req.trajectory.joint_names);
+  orig_request.request.trajectory.points.swap(req.trajectory.points);
+  orig_request.request.group_name = req.group_name;
+  orig_request.request.start_state = req.start_state;
+  orig_request.request.limits.swap(req.limits);
+  orig_request.request.allowed_time = req.allowed_time;
+  orig_request.request.path_constraints = req.path_constraints;
+  orig_request.request.goal_constraints = req.goal_constraints;
+  orig_request.request.trace_id = req.trace_id;
+  filter_response.request.trajectory.points.reserve(orig_request.request.trajectory.points.size());
+  arm_navigation_msgs::ScopedTraceSpan span(trace_publisher_,req.trace_id,"filter_chain");
   if (!filter_constraints_chain_.update(orig_request,filter_response))
   {
     ROS_WARN("Filter chain failed to process trajectory");
     resp.error_code.val = filter_response.response.error_code.val;
     return true;
   }
-  resp.trajectory = filter_response.request.trajectory;
+  resp.trajectory.header = filter_response.request.trajectory.header;
+  resp.trajectory.joint_names.swap(filter_response.request.trajectory.joint_names);
+  resp.trajectory.points.swap(filter_response.request.trajectory.points);
   resp.error_code.val = resp.error_code.SUCCESS;
   return true;
 }